@@ -5,34 +5,40 @@
 #include <click/hashcode.hh>
 #include <click/timer.hh>
 #include <click/vector.hh>
+#include <click/integers.hh>
+#include <elements/json/jsonwriter.hh>
 #include "frame.hh"
 #include "sma.hh"
+#include "rollup.hh"
 CLICK_DECLS
 
 class DstInfo {
 public:
 	EtherAddress _eth;
     int _sender_type;
-	int _accum_rssi;
-	int _squares_rssi;
-	int _packets;
+	WindowStats _window_rssi; // since the last update()
+	// frames since the last update(), with an RSSI sample or not
+	uint32_t _window_frames;
+	// data frames to go before the next RSSI sample
+	uint32_t _skip;
 	int _last_rssi;
 	int _last_std;
 	int _last_packets;
-	SMA *_sma_rssi;
+	SMA _sma_rssi;
 	unsigned _silent_window_count;
 	int _hist_packets;
 	int _iface_id;
 	Timestamp _last_received;
+	Timestamp _sma_changed; // last time the windowed rssi moved
+	// windows of 1 s, 10 s, 100 s and 10 min, fed by update()
+	Rollup<16> _rssi_rollup;
 
-	DstInfo() {
+	DstInfo() : _rssi_rollup(1000) {
 		_eth = EtherAddress();
 		_sender_type = 0;
-		_sma_rssi = 0;
-		_accum_rssi = 0;
-		_squares_rssi = 0;
 		_silent_window_count = 0;
-		_packets = 0;
+		_window_frames = 0;
+		_skip = 0;
 		_last_rssi = 0;
 		_last_std= 0;
 		_last_packets= 0;
@@ -40,36 +46,49 @@ public:
 		_iface_id = -1;
 	}
 
-	~DstInfo() {
-		delete _sma_rssi;
-	}
-
 	// This update is called form empowerrxstats in run_timer
 	void update() {
+		int packets = _window_frames;
+		int samples = _window_rssi.count();
 		 //number of pkts over which rssi is being meaured. Upcouter
-		_hist_packets += _packets;
-		// average rssi over the time between 2 update calls 
-		_last_rssi = (_packets > 0) ? _accum_rssi / (double) _packets : 0;
-		// std of rssi over the time between 2 update calls 
-		_last_std = (_packets > 0) ? sqrt( (_squares_rssi / (double) _packets) - (_last_rssi * _last_rssi) ) : 0;
+		_hist_packets += packets;
+		// average and std of rssi over the time between 2 update calls,
+		// in integers so that it builds in the kernel too
+		_last_rssi = _window_rssi.mean();
+		_last_std = _window_rssi.stddev();
 		// number of pkts over the time between 2 update calls 
-		_last_packets = _packets;
-		if (_packets == 0) {
+		_last_packets = packets;
+		if (packets == 0) {
 			_silent_window_count++;
 		} else {
 			_silent_window_count = 0;
-			_sma_rssi->add(_last_rssi);
+			// the rollup counts every frame, the sum is scaled up to
+			// keep the mean of the samples
+			int32_t sum = _window_rssi.sum();
+			if (samples != packets) {
+				sum = (int64_t) sum * packets / samples;
+			}
+			_rssi_rollup.add(Timestamp::now_steady().msecval(), sum, packets, _window_rssi.min(), _window_rssi.max());
+			int avg = _sma_rssi.avg();
+			_sma_rssi.add(_last_rssi);
+			if (_sma_rssi.avg() != avg) {
+				_sma_changed = Timestamp::now_steady();
+			}
 		}
-		_packets = 0;
-		_accum_rssi = 0;
-		_squares_rssi = 0;
+		_window_rssi.clear();
+		_window_frames = 0;
+	}
+
+	// received is the timestamp annotation of the frame
+	void add_sample(uint8_t rssi, const Timestamp &received) {
+		_window_rssi.add(rssi);
+		add_frame(received);
 	}
 
-	void add_sample(uint8_t rssi) {
-		_packets++;
-		_accum_rssi += rssi;
-		_squares_rssi += rssi * rssi;
-		_last_received.assign_now();
+	// a frame whose RSSI is not sampled
+	void add_frame(const Timestamp &received) {
+		_window_frames++;
+		_last_received = received;
 	}
 
 	String unparse() {
@@ -78,7 +97,7 @@ public:
 		Timestamp age = now - _last_received;
 		sa << _eth.unparse();
 		sa << (_sender_type == 0 ? " STA" : " AP");
-		sa << " sma_rssi " << _sma_rssi->avg();
+		sa << " sma_rssi " << _sma_rssi.avg();
 		sa << " last_rssi_avg " << _last_rssi;
 		sa << " last_rssi_std " << _last_std;
 		sa << " last_packets " << _last_packets;
@@ -88,6 +107,22 @@ public:
 		sa << " iface_id " << _iface_id << "\n";
 		return sa.take_string();
 	}
+
+	// Same fields as unparse(), as a JSON object
+	void unparse_json(JsonWriter &w, const Timestamp &now) {
+		w.begin_object();
+		w.key("addr").quoted(_eth);
+		w.member("type", _sender_type == 0 ? "STA" : "AP");
+		w.member("sma_rssi", _sma_rssi.avg());
+		w.member("last_rssi_avg", _last_rssi);
+		w.member("last_rssi_std", _last_std);
+		w.member("last_packets", _last_packets);
+		w.member("hist_packets", _hist_packets);
+		w.member("last_received_msecs", (now - _last_received).msecval());
+		w.member("silent_window_count", _silent_window_count);
+		w.member("iface_id", _iface_id);
+		w.end_object();
+	}
 };
 
 CLICK_ENDDECLS
@@ -34,7 +34,8 @@
 CLICK_DECLS
 
 Empower11k::Empower11k() :
-		_el(0), _debug(false) {
+		_el(0), _timer(this), _ttl(10000), _interval(100), _burst(4),
+		_cache_hits(0), _debug(false) {
 }
 
 Empower11k::~Empower11k() {
@@ -44,12 +45,187 @@ int Empower11k::configure(Vector<String> &conf, ErrorHandler *errh) {
 
 	int ret = Args(conf, this, errh)
               .read_m("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			  .read("TTL", _ttl)
+			  .read("INTERVAL", _interval)
+			  .read("BURST", _burst)
 			  .read("DEBUG", _debug).complete();
 
+	if (!_interval || !_burst)
+		return errh->error("INTERVAL and BURST must be positive");
+
 	return ret;
 
 }
 
+int Empower11k::initialize(ErrorHandler *) {
+	_timer.initialize(this);
+	_timer.schedule_after_msec(_interval);
+	return 0;
+}
+
+bool Empower11k::fresh(const Timestamp &t, const Timestamp &now) const {
+	return t && (now - t).msecval() < _ttl;
+}
+
+bool Empower11k::schedule(EtherAddress sta, uint8_t token, bool link) {
+
+	Empower11kReports *r = _reports.get_pointer(sta);
+
+	if (r && fresh(link ? r->_link_time : r->_neighbors_time, Timestamp::now())) {
+		_cache_hits++;
+		return false;
+	}
+
+	for (int i = 0; i < _pending.size(); i++) {
+		if (_pending[i]._sta == sta && _pending[i]._link == link) {
+			return false;
+		}
+	}
+
+	Request req;
+	req._sta = sta;
+	req._token = token;
+	req._link = link;
+	_pending.push_back(req);
+
+	return true;
+
+}
+
+void Empower11k::run_timer(Timer *) {
+
+	// send at most _burst requests, skipping the stations that are gone
+	uint32_t sent = 0;
+
+	while (sent < _burst && !_pending.empty()) {
+		Request req = _pending.front();
+		_pending.pop_front();
+		if (!_el->get_ess(req._sta)) {
+			continue;
+		}
+		if (req._link) {
+			send_link_measurement_request(req._sta, req._token);
+		} else {
+			send_neighbor_report_request(req._sta, req._token);
+		}
+		sent++;
+	}
+
+	// forget the stations that are gone or that answered nothing
+	// fresh for a while
+	Timestamp now = Timestamp::now();
+
+	for (HashTable<EtherAddress, Empower11kReports>::iterator it = _reports.begin(); it.live(); ) {
+		if (!_el->get_ess(it.key()) ||
+				(!fresh(it.value()._link_time, now) && !fresh(it.value()._neighbors_time, now))) {
+			it = _reports.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	_timer.reschedule_after_msec(_interval);
+
+}
+
+void Empower11k::parse_neighbor_report(EtherAddress sta, const uint8_t *ptr, const uint8_t *end) {
+
+	Vector<Empower11kNeighbor> neighbors;
+
+	// neighbor report elements, each at least 13 bytes long
+	while (ptr + 2 <= end && ptr + 2 + ptr[1] <= end) {
+		if (ptr[0] == 52 && ptr[1] >= 13) {
+			Empower11kNeighbor n;
+			n._bssid = EtherAddress(ptr + 2);
+			n._bssid_info = ptr[8] | (ptr[9] << 8) | (ptr[10] << 16) | ((uint32_t) ptr[11] << 24);
+			n._op_class = ptr[12];
+			n._channel = ptr[13];
+			n._phy_type = ptr[14];
+			neighbors.push_back(n);
+		}
+		ptr += 2 + ptr[1];
+	}
+
+	Empower11kReports &r = _reports[sta];
+	r._neighbors.swap(neighbors);
+	r._neighbors_time = Timestamp::now();
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: %s reported %d neighbors",
+				      this,
+				      __func__,
+				      sta.unparse().c_str(),
+				      r._neighbors.size());
+	}
+
+}
+
+void Empower11k::parse_link_measurement(EtherAddress sta, const uint8_t *ptr, const uint8_t *end) {
+
+	// TPC report element, rx and tx antenna ids, RCPI, RSNI
+	if (end - ptr < 8 || ptr[0] != 35 || ptr[1] != 2) {
+		click_chatter("%{element} :: %s :: malformed link measurement report from %s",
+				      this,
+				      __func__,
+				      sta.unparse().c_str());
+		return;
+	}
+
+	Empower11kReports &r = _reports[sta];
+	r._tx_power = ptr[2];
+	r._link_margin = ptr[3];
+	r._rcpi = ptr[6];
+	r._rsni = ptr[7];
+	r._link_time = Timestamp::now();
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: %s tx power %d link margin %d rcpi %u rsni %u",
+				      this,
+				      __func__,
+				      sta.unparse().c_str(),
+				      r._tx_power,
+				      r._link_margin,
+				      r._rcpi,
+				      r._rsni);
+	}
+
+}
+
+String Empower11k::unparse_reports(bool link) {
+
+	StringAccum sa;
+	Timestamp now = Timestamp::now();
+
+	for (HashTable<EtherAddress, Empower11kReports>::iterator it = _reports.begin(); it.live(); ++it) {
+		const Empower11kReports &r = it.value();
+		if (link) {
+			if (!fresh(r._link_time, now))
+				continue;
+			sa << it.key() << " age " << (now - r._link_time).msecval();
+			sa << " tx_power " << (int) r._tx_power;
+			sa << " link_margin " << (int) r._link_margin;
+			sa << " rcpi " << (int) r._rcpi;
+			sa << " rsni " << (int) r._rsni << "\n";
+		} else {
+			if (!fresh(r._neighbors_time, now))
+				continue;
+			sa << it.key() << " age " << (now - r._neighbors_time).msecval() << "\n";
+			for (int i = 0; i < r._neighbors.size(); i++) {
+				const Empower11kNeighbor &n = r._neighbors[i];
+				sa << "  " << n._bssid;
+				sa << " info 0x";
+				sa.snprintf(9, "%08x", n._bssid_info);
+				sa << " op_class " << (int) n._op_class;
+				sa << " channel " << (int) n._channel;
+				sa << " phy " << (int) n._phy_type << "\n";
+			}
+		}
+	}
+
+	return sa.take_string();
+
+}
+
 void Empower11k::push(int, Packet *p) {
 
 	if (p->length() < sizeof(struct click_wifi)) {
@@ -117,10 +293,38 @@ void Empower11k::push(int, Packet *p) {
 		return;
 	}
 
-	click_chatter("%{element} :: %s :: management action from %s",
-			      this,
-			      __func__,
-			      src.unparse().c_str());
+	const uint8_t *ptr = (const uint8_t *) p->data() + sizeof(struct click_wifi);
+	const uint8_t *end = p->end_data();
+
+	// category, action, dialog token
+	if (end - ptr < 3 || ptr[0] != 5) {
+		if (_debug) {
+			click_chatter("%{element} :: %s :: non radio measurement action from %s",
+					      this,
+					      __func__,
+					      src.unparse().c_str());
+		}
+		p->kill();
+		return;
+	}
+
+	switch (ptr[1]) {
+	case 3: /* link measurement report */
+		parse_link_measurement(src, ptr + 3, end);
+		break;
+	case 5: /* neighbor report response */
+		parse_neighbor_report(src, ptr + 3, end);
+		break;
+	default:
+		if (_debug) {
+			click_chatter("%{element} :: %s :: radio measurement action %u from %s",
+					      this,
+					      __func__,
+					      ptr[1],
+					      src.unparse().c_str());
+		}
+		break;
+	}
 
 	p->kill();
 	return;
@@ -129,7 +333,15 @@ void Empower11k::push(int, Packet *p) {
 
 void Empower11k::send_neighbor_report_request(EtherAddress sta, uint8_t token) {
 
-    EmpowerStationState *ess = _el->get_ess(sta);
+	EmpowerStationState *ess = _el->get_ess(sta);
+
+	if (!ess) {
+		click_chatter("%{element} :: %s :: unknown station %s",
+				      this,
+				      __func__,
+				      sta.unparse().c_str());
+		return;
+	}
 
 	if (_debug) {
 		click_chatter("%{element} :: %s :: sending neighbor report request to %s token %u",
@@ -194,10 +406,18 @@ void Empower11k::send_neighbor_report_request(EtherAddress sta, uint8_t token) {
 
 void Empower11k::send_link_measurement_request(EtherAddress sta, uint8_t token) {
 
-    EmpowerStationState *ess = _el->get_ess(sta);
+	EmpowerStationState *ess = _el->get_ess(sta);
+
+	if (!ess) {
+		click_chatter("%{element} :: %s :: unknown station %s",
+				      this,
+				      __func__,
+				      sta.unparse().c_str());
+		return;
+	}
 
 	if (_debug) {
-		click_chatter("%{element} :: %s :: sending neighbor report request to %s token %u",
+		click_chatter("%{element} :: %s :: sending link measurement request to %s token %u",
 				      this,
 				      __func__,
 				      sta.unparse().c_str(),
@@ -240,7 +460,7 @@ void Empower11k::send_link_measurement_request(EtherAddress sta, uint8_t token)
 	*(uint8_t *) ptr = 5; /* radio measurement */
 	ptr += 1;
 
-	*(uint8_t *) ptr = 2; /* neighbor request */
+	*(uint8_t *) ptr = 2; /* link measurement request */
 	ptr += 1;
 
 	*(uint8_t *) ptr = token; /* dialog token */
@@ -260,7 +480,11 @@ void Empower11k::send_link_measurement_request(EtherAddress sta, uint8_t token)
 enum {
 	H_DEBUG,
 	H_NEIGHBOR_REPORT_REQUEST,
-	H_LINK_MEASUREMENT_REQUEST
+	H_LINK_MEASUREMENT_REQUEST,
+	H_NEIGHBOR_REPORTS,
+	H_LINK_MEASUREMENTS,
+	H_PENDING,
+	H_CACHE_HITS
 };
 
 String Empower11k::read_handler(Element *e, void *thunk) {
@@ -268,6 +492,14 @@ String Empower11k::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_NEIGHBOR_REPORTS:
+		return td->unparse_reports(false);
+	case H_LINK_MEASUREMENTS:
+		return td->unparse_reports(true);
+	case H_PENDING:
+		return String(td->_pending.size()) + "\n";
+	case H_CACHE_HITS:
+		return String(td->_cache_hits) + "\n";
 	default:
 		return String();
 	}
@@ -306,7 +538,7 @@ int Empower11k::write_handler(const String &in_s, Element *e,
 			return errh->error("error param %s: must start with an int", tokens[1].c_str());
 		}
 
-		f->send_neighbor_report_request(sta, token);
+		f->schedule(sta, token, false);
 
 		break;
 
@@ -317,7 +549,7 @@ int Empower11k::write_handler(const String &in_s, Element *e,
 		cp_spacevec(s, tokens);
 
 		if (tokens.size() != 2)
-			return errh->error("ports send_neighbor_report_request 2 parameters");
+			return errh->error("ports send_link_measurement_request 2 parameters");
 
 		EtherAddress sta;
 		uint8_t token;
@@ -330,7 +562,7 @@ int Empower11k::write_handler(const String &in_s, Element *e,
 			return errh->error("error param %s: must start with an int", tokens[1].c_str());
 		}
 
-		f->send_link_measurement_request(sta, token);
+		f->schedule(sta, token, true);
 
 		break;
 
@@ -344,6 +576,10 @@ void Empower11k::add_handlers() {
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 	add_write_handler("send_neighbor_report_request", write_handler, (void *) H_NEIGHBOR_REPORT_REQUEST);
 	add_write_handler("send_link_measurement_request", write_handler, (void *) H_LINK_MEASUREMENT_REQUEST);
+	add_read_handler("neighbor_reports", read_handler, (void *) H_NEIGHBOR_REPORTS);
+	add_read_handler("link_measurements", read_handler, (void *) H_LINK_MEASUREMENTS);
+	add_read_handler("pending", read_handler, (void *) H_PENDING);
+	add_read_handler("cache_hits", read_handler, (void *) H_CACHE_HITS);
 }
 
 CLICK_ENDDECLS
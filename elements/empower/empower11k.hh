@@ -1,8 +1,12 @@
 // -*- mode: c++; c-basic-offset: 2 -*-
 #ifndef CLICK_EMPOWER11K_HH
-#define CLICK_EMPOWER11k_HH
+#define CLICK_EMPOWER11K_HH
 #include <click/element.hh>
 #include <click/config.h>
+#include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+#include <click/deque.hh>
+#include <click/timer.hh>
 CLICK_DECLS
 
 /*
@@ -16,6 +20,14 @@ Send and parse 802.11k messages.
 
 =d
 
+Neighbor report and link measurement requests do not go on the air
+right away: they are queued, at most one of each kind per station, and
+sent BURST at a time every INTERVAL msecs, so that asking many LVAPs
+at once does not take up the channel. The answers of the stations are
+kept for TTL msecs; a request for a station whose answer of that kind
+is still fresh is not sent again, the cached answer is read from the
+neighbor_reports and link_measurements handlers instead.
+
 Keyword arguments are:
 
 =over 8
@@ -23,14 +35,61 @@ Keyword arguments are:
 =item EL
 An EmpowerLVAPManager element
 
+=item TTL
+How long answers are kept, in msecs. Default 10000.
+
+=item INTERVAL
+Interval between two bursts of requests, in msecs. Default 100.
+
+=item BURST
+Requests sent per burst. Default 4.
+
 =item DEBUG
 Turn debug on/off
 
 =back 8
 
+=h send_neighbor_report_request write-only
+Queue a neighbor report request, "STA TOKEN".
+
+=h send_link_measurement_request write-only
+Queue a link measurement request, "STA TOKEN".
+
+=h neighbor_reports read-only
+Neighbors reported by each station, with the age of the report.
+
+=h link_measurements read-only
+Last link measurement report of each station, with its age.
+
+=h pending read-only
+Requests waiting to be sent.
+
+=h cache_hits read-only
+Requests not sent because a fresh answer was cached.
+
 =a EmpowerLVAPManager
 */
 
+// a BSS reported in a neighbor report response
+struct Empower11kNeighbor {
+	EtherAddress _bssid;
+	uint32_t _bssid_info;
+	uint8_t _op_class;
+	uint8_t _channel;
+	uint8_t _phy_type;
+};
+
+// what a station last answered, a null time if it never did
+struct Empower11kReports {
+	Timestamp _neighbors_time;
+	Vector<Empower11kNeighbor> _neighbors;
+	Timestamp _link_time;
+	int8_t _tx_power;
+	int8_t _link_margin;
+	uint8_t _rcpi;
+	uint8_t _rsni;
+};
+
 class Empower11k: public Element {
 public:
 
@@ -42,17 +101,40 @@ public:
 	const char *processing() const { return PUSH; }
 
 	int configure(Vector<String> &, ErrorHandler *);
+	int initialize(ErrorHandler *);
 	void add_handlers();
+	void run_timer(Timer *);
 	void send_neighbor_report_request(EtherAddress, uint8_t);
 	void send_link_measurement_request(EtherAddress, uint8_t);
+	// queue a request, false if the cached answer is fresh or one is
+	// already queued
+	bool schedule(EtherAddress, uint8_t, bool);
 	void push(int, Packet *);
 
 private:
 
+	struct Request {
+		EtherAddress _sta;
+		uint8_t _token;
+		bool _link; // link measurement, else neighbor report
+	};
+
 	class EmpowerLVAPManager *_el;
+	Timer _timer;
+	Deque<Request> _pending;
+	HashTable<EtherAddress, Empower11kReports> _reports;
+	uint32_t _ttl;
+	uint32_t _interval;
+	uint32_t _burst;
+	uint32_t _cache_hits;
 
 	bool _debug;
 
+	bool fresh(const Timestamp &, const Timestamp &) const;
+	void parse_neighbor_report(EtherAddress, const uint8_t *, const uint8_t *);
+	void parse_link_measurement(EtherAddress, const uint8_t *, const uint8_t *);
+	String unparse_reports(bool);
+
 	static String read_handler(Element *e, void *user_data);
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 
@@ -28,8 +28,12 @@
 #include "empowerlvapmanager.hh"
 CLICK_DECLS
 
+static const char * const log_sites[] = {
+	"too_small", "not_management", "wrong_subtype", "unknown_station", "csa_active", "wrong_iface", "blank_ssid"
+};
+
 EmpowerAssociationResponder::EmpowerAssociationResponder() :
-		_el(0), _debug(false) {
+		_el(0), _template_hits(0), _template_builds(0), _debug(false), _log(log_sites, NB_LOGS) {
 }
 
 EmpowerAssociationResponder::~EmpowerAssociationResponder() {
@@ -49,7 +53,7 @@ int EmpowerAssociationResponder::configure(Vector<String> &conf,
 void EmpowerAssociationResponder::push(int, Packet *p) {
 
 	if (p->length() < sizeof(struct click_wifi)) {
-		click_chatter("%{element} :: %s :: Packet too small: %d Vs. %d",
+		empower_chatter_limited(_log, LOG_TOO_SMALL, "%{element} :: %s :: Packet too small: %d Vs. %d",
 				      this,
 				      __func__,
 				      p->length(),
@@ -64,7 +68,7 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 	uint8_t type = w->i_fc[0] & WIFI_FC0_TYPE_MASK;
 
 	if (type != WIFI_FC0_TYPE_MGT) {
-		click_chatter("%{element} :: %s :: Received non-management packet",
+		empower_chatter_limited(_log, LOG_NOT_MANAGEMENT, "%{element} :: %s :: Received non-management packet",
 				      this,
 				      __func__);
 		p->kill();
@@ -74,7 +78,7 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 	uint8_t subtype = w->i_fc[0] & WIFI_FC0_SUBTYPE_MASK;
 
 	if ((subtype != WIFI_FC0_SUBTYPE_ASSOC_REQ) && (subtype != WIFI_FC0_SUBTYPE_REASSOC_REQ)) {
-		click_chatter("%{element} :: %s :: Received non-association request packet",
+		empower_chatter_limited(_log, LOG_WRONG_SUBTYPE, "%{element} :: %s :: Received non-association request packet",
 				      this,
 				      __func__);
 		p->kill();
@@ -87,7 +91,7 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 
 	//If we're not aware of this LVAP, ignore
 	if (!ess) {
-		click_chatter("%{element} :: %s :: Unknown station %s",
+		empower_chatter_limited(_log, LOG_UNKNOWN_STATION, "%{element} :: %s :: Unknown station %s",
 				      this,
 				      __func__,
 				      src.unparse().c_str());
@@ -96,22 +100,22 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 	}
 
     if (ess->_csa_active) {
-		click_chatter("%{element} :: %s :: lvap %s csa active ignoring request.",
+		empower_chatter_limited(_log, LOG_CSA_ACTIVE, "%{element} :: %s :: lvap %s csa active ignoring request.",
 				      this,
 				      __func__,
 				      ess->_sta.unparse().c_str());
     	return;
     }
 
-	// if this is an uplink only lvap then ignore request
-	if (!ess->_set_mask) {
+	// if this is an uplink only or a staged lvap then ignore request
+	if (!ess->_set_mask || ess->_staged) {
 		p->kill();
 		return;
 	}
 
     // If auth request is coming from different channel, ignore
 	if (ess->_iface_id != iface_id) {
-		click_chatter("%{element} :: %s :: %s is on iface %u, message coming from %u",
+		empower_chatter_limited(_log, LOG_WRONG_IFACE, "%{element} :: %s :: %s is on iface %u, message coming from %u",
 				      this,
 				      __func__,
 				      src.unparse().c_str(),
@@ -183,7 +187,7 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 	}
 
 	if (!ssid) {
-		click_chatter("%{element} :: %s :: Blank SSID from %s",
+		empower_chatter_limited(_log, LOG_BLANK_SSID, "%{element} :: %s :: Blank SSID from %s",
 					  this,
 					  __func__,
 					  src.unparse().c_str());
@@ -320,7 +324,7 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 		}
 
 		int max_ampdu_length = ht->ampdu_params & WIFI_HT_CI_AMDU_PARAMS_MAX_AMPDU_LENGTH_MASK >> WIFI_HT_CI_AMDU_PARAMS_MAX_AMPDU_LENGTH_SHIFT;
-		sa << " RX A-MPDU Length: " << (pow(2, 13 + max_ampdu_length) - 1);
+		sa << " RX A-MPDU Length: " << ((1 << (13 + max_ampdu_length)) - 1);
 
 		int mpdu_density = (ht->ampdu_params & WIFI_HT_CI_AMDU_PARAMS_MPDU_DENSITY_MASK) >> WIFI_HT_CI_AMDU_PARAMS_MPDU_DENSITY_SHIFT;
 		if (mpdu_density == 0) {
@@ -393,10 +397,13 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 	// if authenticated with the requested bssid then send request to the
 	// controller, otherwise ignore the message
 	if (ess->_authentication_status && ess->_lvap_bssid == bssid) {
-		if (htcaps && (ess->_band == EMPOWER_BT_HT20)) {
-			_el->send_association_request(src, bssid, ssid, ess->_hwaddr, ess->_channel, ess->_band, EMPOWER_BT_HT20);
+		empower_bands_types supported_band = (htcaps && (ess->_band == EMPOWER_BT_HT20)) ? EMPOWER_BT_HT20 : EMPOWER_BT_L20;
+		// preauthorized LVAPs are admitted here, the controller is told after
+		if (_el->admit_assoc(ess, ssid, supported_band)) {
+			send_association_response(src, WIFI_STATUS_SUCCESS, ess->_channel, ess->_iface_id);
+			_el->send_status_lvap(src);
 		} else {
-			_el->send_association_request(src, bssid, ssid, ess->_hwaddr, ess->_channel, ess->_band, EMPOWER_BT_L20);
+			_el->send_association_request(src, bssid, ssid, ess->_hwaddr, ess->_channel, ess->_band, supported_band);
 		}
 		p->kill();
 		return;
@@ -407,12 +414,26 @@ void EmpowerAssociationResponder::push(int, Packet *p) {
 
 }
 
+bool EmpowerAssociationResponder::same_rates(const TxPolicyRates &a, const TxPolicyRates &b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (int i = 0; i < a.size(); i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
 void EmpowerAssociationResponder::send_association_response(EtherAddress dst,
 		uint16_t status, int channel, int iface_id) {
 
     EmpowerStationState *ess = _el->get_ess(dst);
 
 	ess->_association_status = true;
+	_el->update_iface_lists();
+	_el->timeline(dst, LVAPTimeline::ASSOC);
 
 	if (_debug) {
 		click_chatter("%{element} :: %s :: association %s assoc_id %d",
@@ -422,17 +443,33 @@ void EmpowerAssociationResponder::send_association_response(EtherAddress dst,
 				      ess->_assoc_id);
 	}
 
-	int max_len = sizeof(struct click_wifi) + 2 + /* cap_info */
-											  2 + /* status  */
-											  2 + /* assoc_id */
-											  2 + WIFI_RATES_MAXSIZE + /* rates */
-											  2 + WIFI_RATES_MAXSIZE + /* xrates */
-											  2 + 26 + /* ht capabilities */
-											  2 + 22 + /* ht information */
-											  2 + 24 + /* wmm parameter element */
-											  0;
+	// the information elements only depend on the interface, its channel
+	// and the rates of the station, which are almost always the default
+	// ones of the interface
+	TransmissionPolicies * tx_table = _el->get_tx_policies(iface_id);
+	const TxPolicyRates &rates = tx_table->lookup(ess->_sta)->_mcs;
+
+	if (iface_id >= _templates.size()) {
+		_templates.resize(iface_id + 1);
+	}
+
+	AssocTemplate &t = _templates[iface_id];
+
+	if (!t._ies || t._channel != channel || !same_rates(t._rates, rates)) {
+		t._channel = channel;
+		t._rates = rates;
+		t._ies = build_ies(iface_id, channel, rates);
+		_template_builds++;
+	} else {
+		_template_hits++;
+	}
+
+	int len = sizeof(struct click_wifi) + 2 + /* cap_info */
+										  2 + /* status  */
+										  2 + /* assoc_id */
+										  t._ies.length();
 
-	WritablePacket *p = Packet::make(max_len);
+	WritablePacket *p = Packet::make(len);
 
 	if (!p) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
@@ -454,25 +491,42 @@ void EmpowerAssociationResponder::send_association_response(EtherAddress dst,
 	w->i_seq = 0;
 
 	uint8_t *ptr = (uint8_t *) p->data() + sizeof(struct click_wifi);
-	int actual_length = sizeof(struct click_wifi);
 
-	uint16_t cap_info = 0;
-	cap_info |= WIFI_CAPINFO_ESS;
-	*(uint16_t *) ptr = cpu_to_le16(cap_info);
+	*(uint16_t *) ptr = cpu_to_le16(WIFI_CAPINFO_ESS);
 	ptr += 2;
-	actual_length += 2;
 
 	*(uint16_t *) ptr = cpu_to_le16(status);
 	ptr += 2;
-	actual_length += 2;
 
 	*(uint16_t *) ptr = cpu_to_le16(0xc000 | ess->_assoc_id);
 	ptr += 2;
-	actual_length += 2;
+
+	memcpy(ptr, t._ies.data(), t._ies.length());
+
+	_el->send_status_lvap(dst);
+	SET_PAINT_ANNO(p, iface_id);
+	output(0).push(p);
+
+}
+
+// Information elements of the association responses sent on iface_id:
+// supported rates, then HT capabilities, HT information and WMM on HT
+// interfaces
+String EmpowerAssociationResponder::build_ies(int iface_id, int channel, const TxPolicyRates &rates) {
+
+	uint8_t buf[2 + WIFI_RATES_MAXSIZE + /* rates */
+				2 + WIFI_RATES_MAXSIZE + /* xrates */
+				2 + 26 + /* ht capabilities */
+				2 + 22 + /* ht information */
+				2 + 24 + /* wmm parameter element */
+				0];
+
+	memset(buf, 0, sizeof(buf));
+
+	uint8_t *ptr = buf;
+	int actual_length = 0;
 
 	/* rates */
-	TransmissionPolicies * tx_table = _el->get_tx_policies(iface_id);
-	Vector<int> rates = tx_table->lookup(ess->_sta)->_mcs;
 	ptr[0] = WIFI_ELEMID_RATES;
 	ptr[1] = WIFI_MIN(WIFI_RATE_SIZE, rates.size());
 	for (int x = 0; x < WIFI_MIN(WIFI_RATE_SIZE, rates.size()); x++) {
@@ -581,15 +635,13 @@ void EmpowerAssociationResponder::send_association_response(EtherAddress dst,
 		actual_length += 2 + WIFI_WME_LEN;
 	}
 
-	p->take(max_len - actual_length);
-	_el->send_status_lvap(dst);
-	SET_PAINT_ANNO(p, iface_id);
-	output(0).push(p);
+	return String((const char *) buf, actual_length);
+
 
 }
 
 enum {
-	H_DEBUG
+	H_DEBUG, H_TEMPLATES, H_LOG
 };
 
 String EmpowerAssociationResponder::read_handler(Element *e, void *thunk) {
@@ -597,6 +649,13 @@ String EmpowerAssociationResponder::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_LOG:
+		return td->_log.unparse();
+	case H_TEMPLATES: {
+		StringAccum sa;
+		sa << "hits " << td->_template_hits << " builds " << td->_template_builds << "\n";
+		return sa.take_string();
+	}
 	default:
 		return String();
 	}
@@ -622,6 +681,8 @@ int EmpowerAssociationResponder::write_handler(const String &in_s, Element *e,
 
 void EmpowerAssociationResponder::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
+	add_read_handler("log", read_handler, (void *) H_LOG);
+	add_read_handler("templates", read_handler, (void *) H_TEMPLATES);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
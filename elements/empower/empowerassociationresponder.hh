@@ -4,6 +4,8 @@
 #include <click/element.hh>
 #include <click/config.h>
 #include <elements/wifi/availablerates.hh>
+#include <elements/wifi/transmissionpolicy.hh>
+#include "empowerloglimit.hh"
 CLICK_DECLS
 
 /*
@@ -32,6 +34,15 @@ Turn debug on/off
 
 =back 8
 
+=h templates read-only
+Association responses built from the cached information elements of
+their interface, and times those elements had to be built, e.g. after a
+channel change.
+
+=h log read-only
+One line per message logged per frame: name, times it was due, times
+it was suppressed. Each message is logged at most 10 times per second.
+
 =a EmpowerLVAPManager
 */
 
@@ -52,11 +63,31 @@ public:
 
 private:
 
+	// information elements of the responses sent on an interface
+	struct AssocTemplate {
+		int _channel;
+		TxPolicyRates _rates;
+		String _ies;
+		AssocTemplate() : _channel(0) {
+		}
+	};
+
 	class EmpowerLVAPManager *_el;
 
+	Vector<AssocTemplate> _templates;
+	static bool same_rates(const TxPolicyRates &, const TxPolicyRates &);
+	uint32_t _template_hits;
+	uint32_t _template_builds;
+
 	bool _debug;
 
+	// messages logged per frame, see log_sites
+	enum { LOG_TOO_SMALL, LOG_NOT_MANAGEMENT, LOG_WRONG_SUBTYPE, LOG_UNKNOWN_STATION, LOG_CSA_ACTIVE, LOG_WRONG_IFACE, LOG_BLANK_SSID, NB_LOGS };
+	EmpowerLogLimit _log;
+
 	// Read/Write handlers
+	String build_ies(int, int, const TxPolicyRates &);
+
 	static String read_handler(Element *e, void *user_data);
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 
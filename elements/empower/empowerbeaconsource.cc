@@ -26,13 +26,25 @@
 #include <elements/wifi/minstrel.hh>
 #include "empowerpacket.hh"
 #include "empowerlvapmanager.hh"
+#include "empowerpowersavebuffer.hh"
 CLICK_DECLS
 
 EmpowerBeaconSource::EmpowerBeaconSource() :
-		_el(0), _period(500), _timer(this), _debug(false) {
+		_el(0), _period(500), _timer(this), _slots(10), _slot(0), _generation(0),
+		_probe_window(1000), _probe_rssi_delta(6), _probes_forwarded(0), _probes_suppressed(0),
+		_group_csa(true), _debug(false) {
 }
 
 EmpowerBeaconSource::~EmpowerBeaconSource() {
+	for (BCIter it = _beacons.begin(); it.live(); it++) {
+		it.value()._p->kill();
+	}
+	for (BCIter it = _probe_responses.begin(); it.live(); it++) {
+		it.value()._p->kill();
+	}
+	for (CSAGIter it = _csa_groups.begin(); it.live(); it++) {
+		kill_templates(it.value());
+	}
 }
 
 int EmpowerBeaconSource::configure(Vector<String> &conf, ErrorHandler *errh) {
@@ -40,8 +52,22 @@ int EmpowerBeaconSource::configure(Vector<String> &conf, ErrorHandler *errh) {
 	int ret = Args(conf, this, errh)
               .read_m("EL", ElementCastArg("EmpowerLVAPManager"), _el)
 			  .read("PERIOD", _period)
+			  .read("SLOTS", _slots)
+			  .read("PROBE_WINDOW", _probe_window)
+			  .read("PROBE_RSSI_DELTA", _probe_rssi_delta)
+			  .read("GROUP_CSA", _group_csa)
 			  .read("DEBUG", _debug).complete();
 
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (_slots == 0 || _slots > _period) {
+		return errh->error("SLOTS must be between 1 and PERIOD");
+	}
+
+	_slot_load.resize(_slots, 0);
+
 	return ret;
 
 }
@@ -54,33 +80,94 @@ int EmpowerBeaconSource::initialize(ErrorHandler *) {
 
 void EmpowerBeaconSource::run_timer(Timer *) {
 
+	// a new beacon period starts with slot 0
+	if (_slot == 0) {
+		_generation++;
+		advance_csa_groups();
+	}
+
+	uint32_t load = 0;
+
 	// send LVAP beacon
 	for (LVAPIter it = _el->lvaps()->begin(); it.live(); it++) {
-		send_lvap_csa_beacon(&it.value());
+		if (it.value()._staged) {
+			continue;
+		}
+		if (slot(it.key()) == _slot) {
+			send_lvap_csa_beacon(&it.value());
+			load++;
+		}
 	}
 
 	// send VAP beacons
 	for (VAPIter it = _el->vaps()->begin(); it.live(); it++) {
-		send_beacon(EtherAddress::make_broadcast(), it.value()._net_bssid,
-				it.value()._ssid, it.value()._channel, it.value()._iface_id,
-				false, false, 0, 0, 0);
+		if (slot(it.key()) == _slot) {
+			send_cached_beacon(EtherAddress::make_broadcast(), it.value()._net_bssid,
+					it.value()._ssid, it.value()._channel, it.value()._iface_id,
+					false, false, 0, 0, 0);
+			load++;
+		}
+	}
+
+	_slot_load[_slot] = load;
+
+	// every LVAP/VAP had its slot, drop the beacons of the ones that are gone
+	if (_slot == _slots - 1) {
+		Vector<BeaconKey> stale;
+		for (BCIter it = _beacons.begin(); it.live(); it++) {
+			if (it.value()._generation != _generation) {
+				stale.push_back(it.key());
+			}
+		}
+		for (int i = 0; i < stale.size(); i++) {
+			_beacons.get_pointer(stale[i])->_p->kill();
+			_beacons.erase(stale[i]);
+		}
+		// probe responses are only used on demand, keep them for a while
+		stale.clear();
+		for (BCIter it = _probe_responses.begin(); it.live(); it++) {
+			if (_generation - it.value()._generation >= PROBE_RESPONSE_PERIODS) {
+				stale.push_back(it.key());
+			}
+		}
+		for (int i = 0; i < stale.size(); i++) {
+			_probe_responses.get_pointer(stale[i])->_p->kill();
+			_probe_responses.erase(stale[i]);
+		}
+		expire_probes();
 	}
 
-	// re-schedule the timer with some jitter
-	_timer.schedule_after_msec(_period);
+	_slot = (_slot + 1) % _slots;
+
+	// re-schedule the timer for the next slot, relative to this expiry so
+	// that the period does not drift
+	_timer.reschedule_after(Timestamp::make_usec((uint64_t) _period * 1000 / _slots));
+
+}
 
+// Set the bit of aid in the TIM element at tim, whose partial virtual
+// bitmap has two octets: the first one at an even offset, as N1 must be
+void EmpowerBeaconSource::set_tim(uint8_t *tim, uint16_t aid) {
+	uint8_t n1 = (aid >> 3) & ~1;
+	tim[4] = n1; // bitmap offset, N1 / 2 in bits 1-7
+	tim[5 + (aid >> 3) - n1] |= 1 << (aid & 7);
 }
 
 void EmpowerBeaconSource::send_lvap_csa_beacon(EmpowerStationState *ess) {
 
 	if (!ess->_csa_active) {
 		for (int i = 0; i < ess->_ssids.size(); i++) {
-			send_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i],
+			send_cached_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i],
 					ess->_channel, ess->_iface_id, false, false, 0, 0, 0);
 		}
 		return;
 	}
 
+	if (_group_csa) {
+		send_group_csa_beacon(ess);
+		return;
+	}
+
 	click_chatter("%{element} :: %s :: sending CSA to %s current channel %u target channel %u csa mode %u csa count %u",
 			      this,
 			      __func__,
@@ -91,7 +178,7 @@ void EmpowerBeaconSource::send_lvap_csa_beacon(EmpowerStationState *ess) {
 				  ess->_csa_switch_count);
 
 	for (int i = 0; i < ess->_ssids.size(); i++) {
-		send_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i], ess->_channel,
+		send_cached_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i], ess->_channel,
 				ess->_iface_id, false, true, ess->_csa_switch_mode,
 				ess->_csa_switch_count, ess->_target_channel);
 	}
@@ -99,56 +186,309 @@ void EmpowerBeaconSource::send_lvap_csa_beacon(EmpowerStationState *ess) {
 	ess->_csa_switch_count--;
 
 	if (ess->_csa_switch_count < 0) {
+		finish_csa(ess, _el->element_to_iface(ess->_target_hwaddr, ess->_target_channel, ess->_target_band));
+		_el->update_iface_lists();
+	}
+
+}
+
+void EmpowerBeaconSource::send_group_csa_beacon(EmpowerStationState *ess) {
+
+	CSAKey key(ess);
+	CSAGroup *group = _csa_groups.get_pointer(key);
+
+	// a new member joins the countdown where it is, the first one sets it
+	const CSAKey *member = _csa_members.get_pointer(ess->_sta);
+	if (!group || !member || !(*member == key)) {
+		if (!group) {
+			group = &_csa_groups[key];
+			group->_count = ess->_csa_switch_count;
+			click_chatter("%{element} :: %s :: CSA group iface %d target hwaddr %s target channel %u csa mode %u csa count %u",
+						  this,
+						  __func__,
+						  key._iface_id,
+						  key._target_hwaddr.unparse().c_str(),
+						  key._target_channel,
+						  key._mode,
+						  group->_count);
+		}
+		if (!member || !(*member == key)) {
+			_csa_members.set(ess->_sta, key);
+			group->_stas.push_back(ess->_sta);
+		}
+	}
+
+	const TxPolicyRates &rates = _el->get_tx_policies(ess->_iface_id)->lookup(ess->_net_bssid)->_mcs;
+
+	for (int i = 0; i < ess->_ssids.size(); i++) {
+
+		BeaconTemplate *t = group->_templates.get_pointer(ess->_ssids[i]);
 
-		int target_iface = _el->element_to_iface(ess->_target_hwaddr, ess->_target_channel, ess->_target_band);
+		if (!t || !t->matches(ess->_channel, ess->_iface_id, true, key._mode, key._target_channel, _period, rates)) {
+			int csa_offset = -1;
+			int tim_offset = -1;
+			WritablePacket *p = build_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i],
+					ess->_channel, ess->_iface_id, false, true, key._mode,
+					group->_count, key._target_channel, &csa_offset, &tim_offset);
+			if (!p) {
+				continue;
+			}
+			if (!t) {
+				t = &group->_templates[ess->_ssids[i]];
+			} else {
+				t->_p->kill();
+			}
+			t->_p = p;
+			t->_channel = ess->_channel;
+			t->_iface_id = ess->_iface_id;
+			t->_csa_active = true;
+			t->_csa_mode = key._mode;
+			t->_csa_channel = key._target_channel;
+			t->_period = _period;
+			t->_rates = rates;
+			t->_csa_offset = csa_offset;
+			t->_tim_offset = tim_offset;
+		}
+
+		Packet *p = t->_p->clone();
+		if (!p) {
+			continue;
+		}
+		WritablePacket *q = p->uniqueify();
+		if (!q) {
+			continue;
+		}
+
+		struct click_wifi *w = (struct click_wifi *) q->data();
+		memcpy(w->i_addr1, ess->_sta.data(), 6);
+		memcpy(w->i_addr2, ess->_net_bssid.data(), 6);
+		memcpy(w->i_addr3, ess->_net_bssid.data(), 6);
+		q->data()[t->_csa_offset] = (uint8_t) group->_count;
+		if (uint16_t aid = tim_aid(ess->_sta, ess->_iface_id)) {
+			set_tim(q->data() + t->_tim_offset, aid);
+		}
+
+		SET_PAINT_ANNO(q, ess->_iface_id);
+		output(0).push(q);
+
+	}
+
+}
+
+// Called at the start of every beacon period: every member of a group has
+// been sent the current count in the last one
+void EmpowerBeaconSource::advance_csa_groups() {
+
+	Vector<CSAKey> done;
+
+	for (CSAGIter it = _csa_groups.begin(); it.live(); it++) {
+		if (--it.value()._count < 0) {
+			done.push_back(it.key());
+		}
+	}
+
+	if (done.empty()) {
+		return;
+	}
 
-		if (target_iface == -1) {
+	for (int i = 0; i < done.size(); i++) {
+
+		CSAGroup *group = _csa_groups.get_pointer(done[i]);
+		int target_iface = _el->element_to_iface(done[i]._target_hwaddr, done[i]._target_channel,
+				(empower_bands_types) done[i]._target_band);
+		int switched = 0;
+
+		for (int j = 0; j < group->_stas.size(); j++) {
+			EtherAddress sta = group->_stas[j];
+			const CSAKey *member = _csa_members.get_pointer(sta);
+			// gone, or moved on to another group since
+			if (!member || !(*member == done[i])) {
+				continue;
+			}
+			_csa_members.erase(sta);
+			EmpowerStationState *ess = _el->lvaps()->get_pointer(sta);
+			if (!ess || !ess->_csa_active || !(CSAKey(ess) == done[i])) {
+				continue;
+			}
+			finish_csa(ess, target_iface);
+			switched++;
+		}
+
+		click_chatter("%{element} :: %s :: CSA group iface %d target channel %u is over, %d LVAPs switched",
+					  this,
+					  __func__,
+					  done[i]._iface_id,
+					  done[i]._target_channel,
+					  switched);
+
+		kill_templates(*group);
+		_csa_groups.erase(done[i]);
+
+	}
+
+	// the mask changes are coalesced by the LVAP manager already, the
+	// snapshot is rebuilt once for all the groups
+	_el->update_iface_lists();
+
+}
+
+// End the CSA procedure of ess, leaves update_iface_lists() to the caller
+void EmpowerBeaconSource::finish_csa(EmpowerStationState *ess, int target_iface) {
+
+	if (target_iface == -1) {
+		if (_debug) {
 			click_chatter("%{element} :: %s :: CSA procedure for %s is over, removing LVAP",
 						  this,
 						  __func__,
 						  ess->_sta.unparse().c_str());
-			// remove lvap
-			_el->remove_lvap(ess);
-			// send del lvap response
-			_el->send_add_del_lvap_response(EMPOWER_PT_DEL_LVAP_RESPONSE, ess->_sta, ess->_del_lvap_module_id, 0);
-			ess->_del_lvap_module_id = 0;
-			return;
 		}
+		EtherAddress sta = ess->_sta;
+		uint32_t module_id = ess->_del_lvap_module_id;
+		// remove lvap
+		_el->remove_lvap(ess, false);
+		// send del lvap response
+		_el->send_add_del_lvap_response(EMPOWER_PT_DEL_LVAP_RESPONSE, sta, module_id, 0);
+		return;
+	}
 
+	if (_debug) {
 		click_chatter("%{element} :: %s :: CSA procedure for %s is over, updating LVAP",
 					  this,
 					  __func__,
 					  ess->_sta.unparse().c_str());
+	}
 
-		// if target iface is found then this is a band steering operation, update LVAP
-		ess->_hwaddr = ess->_target_hwaddr;
-		ess->_channel = ess->_target_channel;
-		ess->_band = ess->_target_band;
-		ess->_iface_id = target_iface;
+	// if target iface is found then this is a band steering operation, update LVAP
+	ess->_hwaddr = ess->_target_hwaddr;
+	ess->_channel = ess->_target_channel;
+	ess->_band = ess->_target_band;
+	ess->_iface_id = target_iface;
+	ess->_wifi_hdr.build(ess->_sta, ess->_lvap_bssid);
+	_el->update_bssid_mask(ess);
+
+	// set the CSA values to their default
+	ess->_csa_active = false;
+	ess->_csa_switch_count = 0;
+	ess->_csa_switch_mode = 1;
+	ess->_target_hwaddr = EtherAddress::make_broadcast();
+	ess->_target_band = EMPOWER_BT_L20;
+	ess->_target_channel = 0;
+
+	// send del lvap response
+	_el->send_add_del_lvap_response(EMPOWER_PT_DEL_LVAP_RESPONSE, ess->_sta, ess->_del_lvap_module_id, 0);
+	ess->_del_lvap_module_id = 0;
+	// send add lvap response
+	_el->send_add_del_lvap_response(EMPOWER_PT_ADD_LVAP_RESPONSE, ess->_sta, ess->_add_lvap_module_id, 0);
+	ess->_add_lvap_module_id = 0;
 
-		// set the CSA values to their default
-		ess->_csa_active = false;
-		ess->_csa_switch_count = 0;
-		ess->_csa_switch_mode = 1;
-		ess->_target_hwaddr = EtherAddress::make_broadcast();
-		ess->_target_band = EMPOWER_BT_L20;
-		ess->_target_channel = 0;
+}
 
-		// send del lvap response
-		_el->send_add_del_lvap_response(EMPOWER_PT_DEL_LVAP_RESPONSE, ess->_sta, ess->_del_lvap_module_id, 0);
-		ess->_del_lvap_module_id = 0;
-		// send add lvap response
-		_el->send_add_del_lvap_response(EMPOWER_PT_ADD_LVAP_RESPONSE, ess->_sta, ess->_add_lvap_module_id, 0);
-		ess->_add_lvap_module_id = 0;
+void EmpowerBeaconSource::kill_templates(CSAGroup &group) {
+	for (HashTable<String, BeaconTemplate>::iterator it = group._templates.begin(); it.live(); it++) {
+		it.value()._p->kill();
+	}
+	group._templates.clear();
+}
 
+void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
+		String ssid, int channel, int iface_id, bool probe, bool csa_active,
+		int csa_mode, int csa_count, int csa_channel) {
+
+	WritablePacket *p = build_beacon(dst, bssid, ssid, channel, iface_id, probe,
+			csa_active, csa_mode, csa_count, csa_channel, 0, 0);
+
+	if (!p) {
+		return;
 	}
 
+	SET_PAINT_ANNO(p, iface_id);
+	output(0).push(p);
+
 }
 
-void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
+void EmpowerBeaconSource::send_cached_beacon(EtherAddress dst, EtherAddress bssid,
 		String ssid, int channel, int iface_id, bool probe, bool csa_active,
 		int csa_mode, int csa_count, int csa_channel) {
 
+	BeaconCache &cache = probe ? _probe_responses : _beacons;
+	BeaconKey key(probe ? EtherAddress() : dst, bssid, ssid);
+	BeaconTemplate *t = cache.get_pointer(key);
+	const TxPolicyRates &rates = _el->get_tx_policies(iface_id)->lookup(bssid)->_mcs;
+
+	if (!t || !t->matches(channel, iface_id, csa_active, csa_mode, csa_channel, _period, rates)) {
+		int csa_offset = -1;
+		int tim_offset = -1;
+		WritablePacket *p = build_beacon(dst, bssid, ssid, channel, iface_id, probe,
+				csa_active, csa_mode, csa_count, csa_channel, &csa_offset, &tim_offset);
+		if (!p) {
+			return;
+		}
+		if (!t) {
+			t = &cache[key];
+		} else {
+			t->_p->kill();
+		}
+		t->_p = p;
+		t->_channel = channel;
+		t->_iface_id = iface_id;
+		t->_csa_active = csa_active;
+		t->_csa_mode = csa_mode;
+		t->_csa_channel = csa_channel;
+		t->_period = _period;
+		t->_rates = rates;
+		t->_csa_offset = csa_offset;
+		t->_tim_offset = tim_offset;
+	}
+
+	t->_generation = _generation;
+
+	Packet *p = t->_p->clone();
+
+	if (!p) {
+		return;
+	}
+
+	uint16_t aid = (t->_tim_offset >= 0) ? tim_aid(dst, iface_id) : 0;
+
+	// only the CSA countdown and the TIM differ between two beacons and
+	// only the destination between two probe responses, the timestamp is
+	// left to the driver
+	if (probe || t->_csa_offset >= 0 || aid) {
+		WritablePacket *q = p->uniqueify();
+		if (!q) {
+			return;
+		}
+		if (probe) {
+			memcpy(((struct click_wifi *) q->data())->i_addr1, dst.data(), 6);
+		}
+		if (t->_csa_offset >= 0) {
+			q->data()[t->_csa_offset] = (uint8_t) csa_count;
+		}
+		if (aid) {
+			set_tim(q->data() + t->_tim_offset, aid);
+		}
+		p = q;
+	}
+
+	SET_PAINT_ANNO(p, iface_id);
+	output(0).push(p);
+
+}
+
+// Association id of dst if frames are parked for it, 0 otherwise
+uint16_t EmpowerBeaconSource::tim_aid(EtherAddress dst, int iface_id) {
+	EmpowerPowerSaveBuffer *epsb = _el->epsb(iface_id);
+	if (!epsb || !epsb->buffered(dst)) {
+		return 0;
+	}
+	EmpowerStationState *ess = _el->lvaps()->get_pointer(dst);
+	return ess ? ess->_assoc_id & 0x3fff : 0;
+}
+
+WritablePacket *EmpowerBeaconSource::build_beacon(EtherAddress dst, EtherAddress bssid,
+		String ssid, int channel, int iface_id, bool probe, bool csa_active,
+		int csa_mode, int csa_count, int csa_channel, int *csa_offset, int *tim_offset) {
+
 	/* order elements by standard
 	 * needed by sloppy 802.11b driver implementations
 	 * to be able to connect to 802.11g APs
@@ -161,7 +501,7 @@ void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
 		2 + WIFI_RATES_MAXSIZE + /* rates */
 		2 + 1 + /* ds param */
 		2 + WIFI_RATES_MAXSIZE + /* xrates */
-		2 + 4 + /* tim */
+		2 + 5 + /* tim */
 		2 + 26 + /* ht capabilities */
 		2 + 22 + /* ht information */
 		2 + 24 + /* wmm parameter element */
@@ -174,15 +514,16 @@ void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
 	}
 
 	WritablePacket *p = Packet::make(max_len);
-	memset(p->data(), 0, p->length());
 
 	if (!p) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 				      this,
 				      __func__);
-		return;
+		return 0;
 	}
 
+	memset(p->data(), 0, p->length());
+
 	struct click_wifi *w = (struct click_wifi *) p->data();
 
 	w->i_fc[0] = WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_MGT;
@@ -234,7 +575,7 @@ void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
 
 	/* rates */
 	TransmissionPolicies * tx_table = _el->get_tx_policies(iface_id);
-	Vector<int> rates = tx_table->lookup(bssid)->_mcs;
+	TxPolicyRates rates = tx_table->lookup(bssid)->_mcs;
 	ptr[0] = WIFI_ELEMID_RATES;
 	ptr[1] = WIFI_MIN(WIFI_RATE_SIZE, rates.size());
 	for (int x = 0; x < WIFI_MIN(WIFI_RATE_SIZE, rates.size()); x++) {
@@ -258,13 +599,17 @@ void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
 	/* tim */
 	if (!probe) {
 		ptr[0] = WIFI_ELEMID_TIM;
-		ptr[1] = 4;
+		ptr[1] = 5;
 		ptr[2] = 0; //count
 		ptr[3] = 1; //period
 		ptr[4] = 0; //bitmap control
-		ptr[5] = 0; //partial virtual bitmap
-		ptr += 2 + 4;
-		actual_length += 2 + 4;
+		ptr[5] = 0; //partial virtual bitmap, see set_tim()
+		ptr[6] = 0;
+		if (tim_offset) {
+			*tim_offset = ptr - p->data();
+		}
+		ptr += 2 + 5;
+		actual_length += 2 + 5;
 	}
 
 	/* Channel switch */
@@ -276,6 +621,9 @@ void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
 		ptr[2] = (uint8_t) csa_mode;
 		ptr[3] = (uint8_t) csa_channel;
 		ptr[4] = (uint8_t) csa_count;
+		if (csa_offset) {
+			*csa_offset = ptr + 4 - p->data();
+		}
 		ptr += 2 + 3;
 		actual_length += 2 + 3;
 	}
@@ -378,8 +726,8 @@ void EmpowerBeaconSource::send_beacon(EtherAddress dst, EtherAddress bssid,
 	}
 
 	p->take(max_len - actual_length);
-	SET_PAINT_ANNO(p, iface_id);
-	output(0).push(p);
+
+	return p;
 
 }
 
@@ -573,7 +921,7 @@ void EmpowerBeaconSource::push(int, Packet *p) {
 		}
 
 		int max_ampdu_length = ht->ampdu_params & WIFI_HT_CI_AMDU_PARAMS_MAX_AMPDU_LENGTH_MASK >> WIFI_HT_CI_AMDU_PARAMS_MAX_AMPDU_LENGTH_SHIFT;
-		sa << " RX A-MPDU Length: " << (pow(2, 13 + max_ampdu_length) - 1);
+		sa << " RX A-MPDU Length: " << ((1 << (13 + max_ampdu_length)) - 1);
 
 		int mpdu_density = (ht->ampdu_params & WIFI_HT_CI_AMDU_PARAMS_MPDU_DENSITY_MASK) >> WIFI_HT_CI_AMDU_PARAMS_MPDU_DENSITY_SHIFT;
 		if (mpdu_density == 0) {
@@ -653,6 +1001,13 @@ void EmpowerBeaconSource::push(int, Packet *p) {
 	EmpowerStationState *ess = _el->get_ess(src);
 
 	if (!ess) {
+		int8_t rssi;
+		memcpy(&rssi, &WIFI_EXTRA_ANNO(p)->rssi, 1);
+		if (!forward_probe(src, ssid, iface_id, rssi)) {
+			p->kill();
+			return;
+		}
+		_el->timeline(src, LVAPTimeline::PROBE);
 		if (_debug) {
 			click_chatter("%{element} :: %s :: sending probe request to ctrl %s",
 					      this,
@@ -669,8 +1024,8 @@ void EmpowerBeaconSource::push(int, Packet *p) {
 		return;
 	}
 
-	// if this is an uplink only lvap then ignore request
-	if (!ess->_set_mask) {
+	// if this is an uplink only or a staged lvap then ignore request
+	if (!ess->_set_mask || ess->_staged) {
 		p->kill();
 		return;
 	}
@@ -691,47 +1046,95 @@ void EmpowerBeaconSource::push(int, Packet *p) {
 
 void EmpowerBeaconSource::send_probe_response(EmpowerStationState *ess, String ssid) {
 
+	int ssid_id = -1;
+
 	if (ssid == "") {
 
 		// reply with lvap's ssid
 		for (int i = 0; i < ess->_ssids.size(); i++) {
-			send_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i], ess->_channel,
+			send_cached_beacon(ess->_sta, ess->_net_bssid, ess->_ssids[i], ess->_channel,
 					ess->_iface_id, true, false, 0, 0, 0);
 		}
 
-		// reply also with all vaps
-		for (VAPIter it = _el->vaps()->begin(); it.live(); it++) {
-			send_beacon(ess->_sta, it.value()._net_bssid, it.value()._ssid,
-					it.value()._channel, it.value()._iface_id, true, false, 0,
-					0, 0);
-		}
-
 	} else {
 
+		// an SSID no LVAP or VAP has is not served here
+		ssid_id = _el->ssid_table()->lookup(ssid);
+		if (ssid_id < 0) {
+			return;
+		}
+
 		// reply with lvap's ssid
-		for (int i = 0; i < ess->_ssids.size(); i++) {
-			if (ess->_ssids[i] == ssid) {
-				send_beacon(ess->_sta, ess->_net_bssid, ssid, ess->_channel,
+		for (int i = 0; i < ess->_ssid_ids.size(); i++) {
+			if (ess->_ssid_ids[i] == ssid_id) {
+				send_cached_beacon(ess->_sta, ess->_net_bssid, ssid, ess->_channel,
 						ess->_iface_id, true, false, 0, 0, 0);
 				break;
 			}
 		}
 
-		// reply also with all vaps
-		for (VAPIter it = _el->vaps()->begin(); it.live(); it++) {
-			if (it.value()._ssid == ssid) {
-				send_beacon(ess->_sta, it.value()._net_bssid, it.value()._ssid,
-						it.value()._channel, it.value()._iface_id, true, false,
-						0, 0, 0);
-			}
+	}
+
+	// reply also with the vaps of the lvap's interface with that ssid,
+	// all of them for a wildcard probe
+	const Vector<EtherAddress> *bssids = _el->iface_vaps(ess->_iface_id, ssid_id);
+	if (!bssids) {
+		return;
+	}
+	for (int i = 0; i < bssids->size(); i++) {
+		EmpowerVAPState *evs = _el->vaps()->get_pointer((*bssids)[i]);
+		if (evs) {
+			send_cached_beacon(ess->_sta, evs->_net_bssid, evs->_ssid,
+					evs->_channel, evs->_iface_id, true, false, 0, 0, 0);
 		}
+	}
+
+}
 
+bool EmpowerBeaconSource::forward_probe(EtherAddress sta, String ssid, int iface_id, int rssi) {
+
+	if (!_probe_window) {
+		_probes_forwarded++;
+		return true;
 	}
 
+	Timestamp now = Timestamp::now_steady();
+	ProbeEntry &entry = _probes[ProbeKey(sta, ssid, iface_id)];
+
+	// a scan burst repeats the same probe, only a fresh or a moved
+	// station is worth a message to the controller
+	if (entry._last && now - entry._last < Timestamp::make_msec(_probe_window)
+			&& abs(rssi - entry._rssi) < _probe_rssi_delta) {
+		_probes_suppressed++;
+		return false;
+	}
+
+	entry._last = now;
+	entry._rssi = rssi;
+	_probes_forwarded++;
+
+	return true;
+
+}
+
+void EmpowerBeaconSource::expire_probes() {
+	Timestamp now = Timestamp::now_steady();
+	Vector<ProbeKey> expired;
+	for (PCIter it = _probes.begin(); it.live(); it++) {
+		if (now - it.value()._last >= Timestamp::make_msec(_probe_window)) {
+			expired.push_back(it.key());
+		}
+	}
+	for (int i = 0; i < expired.size(); i++) {
+		_probes.erase(expired[i]);
+	}
 }
 
 enum {
 	H_DEBUG,
+	H_SLOTS,
+	H_PROBES,
+	H_CSA,
 };
 
 String EmpowerBeaconSource::read_handler(Element *e, void *thunk) {
@@ -739,6 +1142,32 @@ String EmpowerBeaconSource::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_PROBES: {
+		StringAccum sa;
+		sa << "forwarded " << td->_probes_forwarded
+		   << " suppressed " << td->_probes_suppressed
+		   << " cached " << td->_probes.size() << "\n";
+		return sa.take_string();
+	}
+	case H_CSA: {
+		StringAccum sa;
+		for (CSAGIter it = td->_csa_groups.begin(); it.live(); it++) {
+			sa << "iface " << it.key()._iface_id
+			   << " target " << it.key()._target_hwaddr.unparse()
+			   << " channel " << it.key()._target_channel
+			   << " mode " << it.key()._mode
+			   << " count " << it.value()._count
+			   << " lvaps " << it.value()._stas.size() << "\n";
+		}
+		return sa.take_string();
+	}
+	case H_SLOTS: {
+		StringAccum sa;
+		for (int i = 0; i < td->_slot_load.size(); i++) {
+			sa << i << " " << td->_slot_load[i] << "\n";
+		}
+		return sa.take_string();
+	}
 	default:
 		return String();
 	}
@@ -765,6 +1194,9 @@ int EmpowerBeaconSource::write_handler(const String &in_s, Element *e,
 void EmpowerBeaconSource::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
+	add_read_handler("slots", read_handler, (void *) H_SLOTS);
+	add_read_handler("probes", read_handler, (void *) H_PROBES);
+	add_read_handler("csa", read_handler, (void *) H_CSA);
 }
 
 CLICK_ENDDECLS
@@ -40,6 +40,29 @@ The wireless channel it is operating on.
 =item PERIOD
 How often beacon packets are sent, in milliseconds.
 
+=item SLOTS
+Number of slots the beacon period is divided into, default is 10. Each
+LVAP and VAP is beaconed in the slot its address hashes to, so that the
+beacons are spread over the whole period instead of being sent in one
+burst. The per-slot load of the last period is reported by the C<slots>
+read handler.
+
+=item PROBE_WINDOW
+Probe requests from unknown stations are forwarded to the controller at
+most once per station, SSID and interface within this window (in msec),
+default is 1000. Zero forwards every probe request.
+
+=item PROBE_RSSI_DELTA
+A repeated probe request is forwarded anyway if its RSSI differs from
+the one last forwarded by at least this many dB, default is 6
+
+=item GROUP_CSA
+Boolean. LVAPs moved off the same interface to the same channel share
+one channel switch countdown and one beacon template per SSID, and are
+switched together when it expires, with a single update of the LVAP
+tables. The groups in progress are reported by the C<csa> read handler.
+Default is true. When false every LVAP runs its own countdown.
+
 =item DEBUG
 Turn debug on/off
 
@@ -48,6 +71,165 @@ Turn debug on/off
 =a EmpowerLVAPManager
 */
 
+// Key of a cached beacon: destination, BSSID and SSID
+class BeaconKey {
+public:
+
+	EtherAddress _dst;
+	EtherAddress _bssid;
+	String _ssid;
+
+	BeaconKey() {
+	}
+
+	BeaconKey(EtherAddress dst, EtherAddress bssid, String ssid) :
+			_dst(dst), _bssid(bssid), _ssid(ssid) {
+	}
+
+	inline hashcode_t hashcode() const {
+		return CLICK_NAME(hashcode)(_dst) + CLICK_NAME(hashcode)(_bssid) + CLICK_NAME(hashcode)(_ssid);
+	}
+
+	inline bool operator==(const BeaconKey &b) const {
+		return _dst == b._dst && _bssid == b._bssid && _ssid == b._ssid;
+	}
+
+};
+
+// A prebuilt beacon together with everything it was built from but the
+// CSA countdown, which is patched in at _csa_offset, and the TIM bitmap,
+// patched in at _tim_offset. The beacon is built again whenever any of
+// the other inputs changes. Probe responses are cached the same way,
+// regardless of their destination, which is patched in.
+class BeaconTemplate {
+public:
+
+	Packet *_p;
+	int _channel;
+	int _iface_id;
+	bool _csa_active;
+	int _csa_mode;
+	int _csa_channel;
+	unsigned int _period;
+	TxPolicyRates _rates;
+	int _csa_offset;
+	int _tim_offset;
+	uint32_t _generation;
+
+	BeaconTemplate() : _p(0), _channel(0), _iface_id(-1), _csa_active(false),
+			_csa_mode(0), _csa_channel(0), _period(0), _csa_offset(-1), _tim_offset(-1),
+			_generation(0) {
+	}
+
+	bool matches(int channel, int iface_id, bool csa_active, int csa_mode,
+			int csa_channel, unsigned int period, const TxPolicyRates &rates) const {
+		if (!_p || _channel != channel || _iface_id != iface_id || _csa_active != csa_active
+				|| _period != period || _rates.size() != rates.size()) {
+			return false;
+		}
+		if (csa_active && (_csa_mode != csa_mode || _csa_channel != csa_channel)) {
+			return false;
+		}
+		for (int i = 0; i < rates.size(); i++) {
+			if (_rates[i] != rates[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+};
+
+typedef HashTable<BeaconKey, BeaconTemplate> BeaconCache;
+typedef BeaconCache::iterator BCIter;
+
+// Key of a channel switch group: the interface the LVAPs leave, the
+// resource element they move to and the switch mode
+class CSAKey {
+public:
+
+	int _iface_id;
+	EtherAddress _target_hwaddr;
+	int _target_channel;
+	int _target_band;
+	int _mode;
+
+	CSAKey() : _iface_id(-1), _target_channel(0), _target_band(0), _mode(0) {
+	}
+
+	CSAKey(const EmpowerStationState *ess) :
+			_iface_id(ess->_iface_id), _target_hwaddr(ess->_target_hwaddr),
+			_target_channel(ess->_target_channel), _target_band(ess->_target_band),
+			_mode(ess->_csa_switch_mode) {
+	}
+
+	inline hashcode_t hashcode() const {
+		return CLICK_NAME(hashcode)(_target_hwaddr) + _iface_id + (_target_channel << 8);
+	}
+
+	inline bool operator==(const CSAKey &b) const {
+		return _iface_id == b._iface_id && _target_hwaddr == b._target_hwaddr
+				&& _target_channel == b._target_channel && _target_band == b._target_band
+				&& _mode == b._mode;
+	}
+
+};
+
+// One countdown for all the LVAPs of a group, decremented once per beacon
+// period, and the beacon template of each of their SSIDs, whose
+// destination and BSSID are patched in
+class CSAGroup {
+public:
+
+	int _count;
+	Vector<EtherAddress> _stas;
+	HashTable<String, BeaconTemplate> _templates;
+
+	CSAGroup() : _count(0) {
+	}
+
+};
+
+typedef HashTable<CSAKey, CSAGroup> CSAGroups;
+typedef CSAGroups::iterator CSAGIter;
+
+// Last probe request forwarded to the controller for a station, SSID
+// and interface
+class ProbeKey {
+public:
+
+	EtherAddress _sta;
+	String _ssid;
+	int _iface_id;
+
+	ProbeKey() : _iface_id(-1) {
+	}
+
+	ProbeKey(EtherAddress sta, String ssid, int iface_id) :
+			_sta(sta), _ssid(ssid), _iface_id(iface_id) {
+	}
+
+	inline hashcode_t hashcode() const {
+		return CLICK_NAME(hashcode)(_sta) + CLICK_NAME(hashcode)(_ssid) + _iface_id;
+	}
+
+	inline bool operator==(const ProbeKey &b) const {
+		return _sta == b._sta && _ssid == b._ssid && _iface_id == b._iface_id;
+	}
+
+};
+
+class ProbeEntry {
+public:
+	Timestamp _last;
+	int _rssi;
+	ProbeEntry() : _rssi(0) {
+	}
+};
+
+typedef HashTable<ProbeKey, ProbeEntry> ProbeCache;
+typedef ProbeCache::iterator PCIter;
+
 class EmpowerBeaconSource: public Element {
 public:
 
@@ -64,6 +246,7 @@ public:
 	void run_timer(Timer *);
 
 	void send_beacon(EtherAddress, EtherAddress, String, int, int, bool, bool, int, int, int);
+	void send_cached_beacon(EtherAddress, EtherAddress, String, int, int, bool, bool, int, int, int);
 	void send_lvap_csa_beacon(EmpowerStationState *);
 
 	void send_probe_response(EmpowerStationState *, String);
@@ -77,6 +260,43 @@ private:
 	unsigned int _period; // msecs
 	Timer _timer;
 
+	unsigned int _slots;
+	unsigned int _slot;
+	Vector<uint32_t> _slot_load;
+
+	enum { PROBE_RESPONSE_PERIODS = 16 };
+
+	BeaconCache _beacons;
+	BeaconCache _probe_responses;
+	uint32_t _generation;
+
+	ProbeCache _probes;
+	unsigned int _probe_window; // msecs
+	int _probe_rssi_delta;
+	uint32_t _probes_forwarded;
+	uint32_t _probes_suppressed;
+
+	bool forward_probe(EtherAddress, String, int, int);
+	void expire_probes();
+
+	static void set_tim(uint8_t *, uint16_t);
+
+	bool _group_csa;
+	CSAGroups _csa_groups;
+	HashTable<EtherAddress, CSAKey> _csa_members;
+
+	void send_group_csa_beacon(EmpowerStationState *);
+	void advance_csa_groups();
+	void finish_csa(EmpowerStationState *, int);
+	void kill_templates(CSAGroup &);
+
+	unsigned int slot(EtherAddress addr) const {
+		return addr.hashcode() % _slots;
+	}
+
+	WritablePacket *build_beacon(EtherAddress, EtherAddress, String, int, int, bool, bool, int, int, int, int *, int *);
+	uint16_t tim_aid(EtherAddress, int);
+
 	bool _debug;
 
 	// Read/Write handlers
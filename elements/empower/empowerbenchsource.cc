@@ -0,0 +1,439 @@
+/*
+ * empowerbenchsource.{cc,hh} -- drives the downlink data path with synthetic LVAPs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerbenchsource.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/handlercall.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include <unistd.h>
+#include "empowerlvapmanager.hh"
+#include "empowermessage.hh"
+CLICK_DECLS
+
+EmpowerBenchSource::EmpowerBenchSource() :
+	_el(0), _iface_id(0), _nb_lvaps(64), _nb_slices(1), _nb_dscps(1),
+	_random(false), _hot(0), _length(1000), _burst(32), _limit(1000000),
+	_sink(0), _stop(false), _active(true), _task(this), _installed(false),
+	_next_lvap(0), _next_dscp(0), _count(0), _delivered(0), _delivered_base(0), _rss_before(0),
+	_rss_after(0) {
+}
+
+EmpowerBenchSource::~EmpowerBenchSource() {
+	delete _sink;
+}
+
+int EmpowerBenchSource::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	String mix = "ROUNDROBIN";
+	HandlerCall sink;
+
+	if (Args(conf, this, errh)
+			.read_m("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("IFACE_ID", _iface_id)
+			.read("LVAPS", _nb_lvaps)
+			.read("SLICES", _nb_slices)
+			.read("DSCPS", _nb_dscps)
+			.read("MIX", WordArg(), mix)
+			.read("HOT", _hot)
+			.read("LENGTH", _length)
+			.read("BURST", _burst)
+			.read("LIMIT", _limit)
+			.read("SINK", HandlerCallArg(HandlerCall::readable), sink)
+			.read("STOP", _stop)
+			.read("ACTIVE", _active)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (mix == "ROUNDROBIN") {
+		_random = false;
+	} else if (mix == "RANDOM") {
+		_random = true;
+	} else {
+		return errh->error("MIX must be ROUNDROBIN or RANDOM");
+	}
+
+	if (_nb_lvaps < 1 || _nb_lvaps > 0xFFFFFF) {
+		return errh->error("LVAPS must be between 1 and %d", 0xFFFFFF);
+	}
+
+	if (_nb_slices < 1 || _nb_slices > _nb_lvaps) {
+		return errh->error("SLICES must be between 1 and LVAPS");
+	}
+
+	if (_nb_dscps < 1 || _nb_dscps > MAX_DSCPS) {
+		return errh->error("DSCPS must be between 1 and %d", (int) MAX_DSCPS);
+	}
+
+	if (_hot > 100) {
+		return errh->error("HOT must be a percentage");
+	}
+
+	if (_length < sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp) || _length > 1514) {
+		return errh->error("LENGTH must be between %d and 1514",
+				   (int) (sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp)));
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	if (sink) {
+		_sink = new HandlerCall(sink);
+	}
+
+	return 0;
+
+}
+
+int EmpowerBenchSource::initialize(ErrorHandler *errh) {
+
+	if (!_el->iface_to_element(_iface_id)) {
+		return errh->error("%s has no interface %d", _el->name().c_str(), _iface_id);
+	}
+
+	if (_sink && _sink->initialize_read(this, errh) < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < _nb_lvaps; i++) {
+		_stas.push_back(make_address(0x00, i));
+	}
+
+	// every frame is this template with its own destination and TOS
+	memset(_template, 0, sizeof(_template));
+	click_ether *eh = (click_ether *) _template;
+	memcpy(eh->ether_shost, make_address(0xFF, 0).data(), 6);
+	eh->ether_type = htons(ETHERTYPE_IP);
+	click_ip *ip = (click_ip *) (eh + 1);
+	ip->ip_v = 4;
+	ip->ip_hl = sizeof(click_ip) >> 2;
+	ip->ip_len = htons(_length - sizeof(click_ether));
+	ip->ip_ttl = 64;
+	ip->ip_p = IP_PROTO_UDP;
+	ip->ip_src.s_addr = htonl(0x0A000001);
+	ip->ip_dst.s_addr = htonl(0x0A000002);
+	click_udp *udp = (click_udp *) (ip + 1);
+	udp->uh_sport = htons(1024);
+	udp->uh_dport = htons(5001);
+	udp->uh_ulen = htons(_length - sizeof(click_ether) - sizeof(click_ip));
+
+	ScheduleInfo::initialize_task(this, &_task, _active, errh);
+	return 0;
+
+}
+
+EtherAddress EmpowerBenchSource::make_address(uint8_t kind, uint32_t i) {
+	uint8_t data[6] = { 0x02, kind, 0x00, (uint8_t) (i >> 16), (uint8_t) (i >> 8), (uint8_t) i };
+	return EtherAddress(data);
+}
+
+// The DSCP of traffic rule i: the class selectors first, then the
+// values in between, so that a few rules land in distinct classes.
+uint8_t EmpowerBenchSource::dscp(int i) {
+	return (i * 8) % MAX_DSCPS + i / 8;
+}
+
+uint64_t EmpowerBenchSource::rss_kb() {
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (!f) {
+		return 0;
+	}
+	unsigned long size = 0, resident = 0;
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+		resident = 0;
+	}
+	fclose(f);
+	return (uint64_t) resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Sends the controller messages creating the traffic rules and LVAPs to
+// the LVAP manager.
+void EmpowerBenchSource::install() {
+
+	ResourceElement *re = _el->iface_to_element(_iface_id);
+
+	_rss_before = rss_kb();
+
+	for (int s = 0; s < _nb_slices; s++) {
+		String ssid = "bench-" + String(s);
+		for (int d = 0; d < _nb_dscps; d++) {
+			EmpowerMessage msg;
+			empower_set_traffic_rule *rule = msg.start<empower_set_traffic_rule>(EMPOWER_PT_SET_TRAFFIC_RULE, d, ssid.length());
+			if (!rule) {
+				return;
+			}
+			rule->set_hwaddr(re->_hwaddr);
+			rule->set_channel(re->_channel);
+			rule->set_band(re->_band);
+			rule->set_quantum(12000);
+			rule->set_dscp(dscp(d));
+			rule->set_ssid(ssid);
+			output(1).push(msg.finish());
+		}
+	}
+
+	for (int i = 0; i < _nb_lvaps; i++) {
+		String ssid = "bench-" + String(i % _nb_slices);
+		EmpowerMessage msg;
+		// the LVAP ssid followed by the list of its ssids
+		empower_add_lvap *add = msg.start<empower_add_lvap>(EMPOWER_PT_ADD_LVAP, i, 2 * (ssid.length() + 1));
+		if (!add) {
+			return;
+		}
+		add->set_module_id(i);
+		add->set_flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
+		add->set_flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
+		add->set_flag(EMPOWER_STATUS_LVAP_SET_MASK);
+		add->set_assoc_id(i & 0x7FF);
+		add->set_hwaddr(re->_hwaddr);
+		add->set_channel(re->_channel);
+		add->set_band(re->_band);
+		add->set_supported_band(re->_band);
+		add->set_sta(_stas[i]);
+		add->set_net_bssid(make_address(0x01, i));
+		add->set_lvap_bssid(make_address(0x01, i));
+		uint8_t *ptr = (uint8_t *) (add + 1);
+		for (int e = 0; e < 2; e++) {
+			ssid_entry *entry = (ssid_entry *) ptr;
+			entry->set_length(ssid.length());
+			entry->set_ssid(ssid);
+			ptr += ssid.length() + 1;
+		}
+		output(1).push(msg.finish());
+	}
+
+	_rss_after = rss_kb();
+
+}
+
+Packet *EmpowerBenchSource::make_packet() {
+
+	WritablePacket *p = Packet::make(Packet::default_headroom, 0, _length, 0);
+	if (!p) {
+		return 0;
+	}
+
+	uint32_t lvap;
+	if (_hot && click_random(0, 99) < _hot) {
+		lvap = 0;
+	} else if (_random) {
+		lvap = click_random(0, _nb_lvaps - 1);
+	} else {
+		lvap = _next_lvap;
+		if (++_next_lvap == (uint32_t) _nb_lvaps) {
+			_next_lvap = 0;
+		}
+	}
+
+	uint32_t hlen = sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp);
+	memcpy(p->data(), _template, hlen);
+	memset(p->data() + hlen, 0, _length - hlen);
+
+	click_ether *eh = (click_ether *) p->data();
+	memcpy(eh->ether_dhost, _stas[lvap].data(), 6);
+	click_ip *ip = (click_ip *) (eh + 1);
+	ip->ip_tos = dscp(_next_dscp) << 2;
+	ip->ip_sum = click_in_cksum((const unsigned char *) ip, sizeof(click_ip));
+	if (++_next_dscp == (uint32_t) _nb_dscps) {
+		_next_dscp = 0;
+	}
+
+	return p;
+
+}
+
+// Reads the number of frames delivered. Returns true once it has not
+// moved for DRAIN_MSEC, i.e. the queues have drained or are stuck.
+bool EmpowerBenchSource::drained(const Timestamp &now) {
+	uint64_t delivered = 0;
+	if (!IntArg().parse(cp_uncomment(_sink->call_read()), delivered)) {
+		return true;
+	}
+	if (delivered != _delivered) {
+		_delivered = delivered;
+		_last = now;
+		return false;
+	}
+	return now - _last >= Timestamp::make_msec(DRAIN_MSEC);
+}
+
+bool EmpowerBenchSource::run_task(Task *) {
+
+	if (!_active) {
+		return false;
+	}
+
+	if (!_installed) {
+		install();
+		_installed = true;
+		_task.fast_reschedule();
+		return true;
+	}
+
+	if (_limit < 0 || _count < (uint64_t) _limit) {
+
+		if (!_count) {
+			_start = Timestamp::now_steady();
+			// frames delivered before a reset do not count
+			if (_sink) {
+				drained(_start);
+				_delivered_base = _delivered;
+			}
+		}
+
+		int n = _burst;
+		if (_limit >= 0 && _count + n > (uint64_t) _limit) {
+			n = _limit - _count;
+		}
+
+		for (int i = 0; i < n; i++) {
+			Packet *p = make_packet();
+			if (!p) {
+				break;
+			}
+			_count++;
+			output(0).push(p);
+		}
+
+		_last = Timestamp::now_steady();
+		_task.fast_reschedule();
+		return n > 0;
+
+	}
+
+	// everything was sent, wait for the frames still queued
+	if (_sink && !drained(Timestamp::now_steady())) {
+		_task.fast_reschedule();
+		return false;
+	}
+
+	if (_stop) {
+		router()->please_stop_driver();
+	}
+
+	return false;
+
+}
+
+enum {
+	H_COUNT,
+	H_DELIVERED,
+	H_PPS,
+	H_NS_PER_PACKET,
+	H_MEMORY,
+	H_REPORT,
+	H_ACTIVE,
+	H_RESET
+};
+
+String EmpowerBenchSource::report(int what) {
+
+	StringAccum sa;
+	Timestamp elapsed = _last - _start;
+	uint64_t nsec = _count ? (uint64_t) elapsed.nsecval() : 0;
+	// with a sink, the rates are those of the frames that made it through
+	uint64_t count = _sink ? _delivered - _delivered_base : _count;
+
+	if (what == H_COUNT || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "count ";
+		}
+		sa << _count << "\n";
+	}
+	if (_sink && (what == H_DELIVERED || what == H_REPORT)) {
+		if (what == H_REPORT) {
+			sa << "delivered ";
+		}
+		sa << _delivered - _delivered_base << "\n";
+	}
+	if (what == H_PPS || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "pps ";
+		}
+		sa << (nsec ? count * 1000000000 / nsec : 0) << "\n";
+	}
+	if (what == H_NS_PER_PACKET || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "ns_per_packet ";
+		}
+		sa << (count ? nsec / count : 0) << "\n";
+	}
+	if (what == H_MEMORY || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "memory ";
+		}
+		sa << rss_kb() << " " << (_rss_after - _rss_before) << "\n";
+	}
+
+	return sa.take_string();
+
+}
+
+String EmpowerBenchSource::read_handler(Element *e, void *thunk) {
+	EmpowerBenchSource *s = (EmpowerBenchSource *) e;
+	if ((uintptr_t) thunk == H_ACTIVE) {
+		return String(s->_active) + "\n";
+	}
+	return s->report((uintptr_t) thunk);
+}
+
+int EmpowerBenchSource::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerBenchSource *s = (EmpowerBenchSource *) e;
+	switch ((uintptr_t) thunk) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(cp_uncomment(in_s), active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		s->_active = active;
+		if (active && !s->_task.scheduled()) {
+			s->_task.reschedule();
+		}
+		break;
+	}
+	case H_RESET:
+		s->_count = s->_delivered = 0;
+		s->_start = s->_last = Timestamp();
+		if (!s->_task.scheduled()) {
+			s->_task.reschedule();
+		}
+		break;
+	}
+	return 0;
+}
+
+void EmpowerBenchSource::add_handlers() {
+	add_read_handler("count", read_handler, (void *) H_COUNT);
+	add_read_handler("delivered", read_handler, (void *) H_DELIVERED);
+	add_read_handler("pps", read_handler, (void *) H_PPS);
+	add_read_handler("ns_per_packet", read_handler, (void *) H_NS_PER_PACKET);
+	add_read_handler("memory", read_handler, (void *) H_MEMORY);
+	add_read_handler("report", read_handler, (void *) H_REPORT);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE, Handler::f_checkbox);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::f_button);
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerBenchSource)
+ELEMENT_REQUIRES(userlevel EmpowerLVAPManager)
@@ -0,0 +1,183 @@
+#ifndef CLICK_EMPOWERBENCHSOURCE_HH
+#define CLICK_EMPOWERBENCHSOURCE_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timestamp.hh>
+#include <click/etheraddress.hh>
+CLICK_DECLS
+class HandlerCall;
+
+/*
+=c
+
+EmpowerBenchSource(EL[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Drives the downlink data path with synthetic LVAPs and traffic
+
+=d
+
+Benchmarks the downlink data path of an EmPOWER WTP without radios or an
+Access Controller. When the router starts, EmpowerBenchSource plays the
+controller: it emits on output 1, which must be connected to the
+EmpowerLVAPManager EL, the messages adding LVAPS authenticated and
+associated LVAPs on interface IFACE_ID, spread over SLICES slices, and
+the traffic rules of DSCPS DSCPs for every slice. It then pushes IPv4 UDP
+frames to those LVAPs out output 0, BURST per task run, until LIMIT
+frames have been sent.
+
+Output 0 is meant to feed an EmpowerTee, with the EmpowerQOSManager of
+the interface pulled by a Discard, and a Minstrel standing in for rate
+control. See elements/empower/samples/bench.click.
+
+Keyword arguments are:
+
+=over 8
+
+=item EL
+An EmpowerLVAPManager element
+
+=item IFACE_ID
+Interface the LVAPs are added to. Default is 0.
+
+=item LVAPS
+Number of LVAPs. Default is 64.
+
+=item SLICES
+Number of slices, i.e. SSIDs, the LVAPs are spread over round robin.
+Default is 1.
+
+=item DSCPS
+Number of traffic rules of every slice, at most 64. Frames are spread
+over them round robin. Default is 1.
+
+=item MIX
+How destinations are picked: ROUNDROBIN cycles over the LVAPs, RANDOM
+picks them uniformly at random. Default is ROUNDROBIN.
+
+=item HOT
+Percentage of the frames sent to the first LVAP, the others are picked
+by MIX. Default is 0.
+
+=item LENGTH
+Length of the frames, Ethernet header included. Default is 1000.
+
+=item BURST
+Number of frames pushed per task run. Default is 32.
+
+=item LIMIT
+Number of frames to send, -1 means no limit. Default is 1000000.
+
+=item SINK
+Read handler returning the number of frames delivered, such as the
+I<count> handler of the Discard pulling from the EmpowerQOSManager. If
+given, the run lasts until the queues have drained, and the rates are
+measured on the frames delivered rather than on those sent.
+
+=item STOP
+Stop the driver once LIMIT frames have been sent, and delivered if SINK
+is given. Default is false.
+
+=item ACTIVE
+Start when the router starts. If false, nothing is sent until the
+I<active> handler is set, which lets a script configure the LVAP manager
+first. Default is true.
+
+=back 8
+
+=h count read-only
+Number of frames sent.
+
+=h delivered read-only
+Number of frames delivered, if SINK is given.
+
+=h pps read-only
+Frames per second since the first one was sent.
+
+=h ns_per_packet read-only
+Nanoseconds per frame since the first one was sent.
+
+=h memory read-only
+Resident set size of the process, and its increase while the LVAPs and
+traffic rules were installed, in kilobytes.
+
+=h report read-only
+All of the above.
+
+=h active read/write
+Whether frames are sent.
+
+=h reset write-only
+Reset the counters and the clock.
+
+=a EmpowerLVAPManager, EmpowerTee, EmpowerQOSManager
+*/
+
+class EmpowerBenchSource : public Element {
+
+public:
+
+	EmpowerBenchSource() CLICK_COLD;
+	~EmpowerBenchSource() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerBenchSource"; }
+	const char *port_count() const		{ return "0/2"; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	bool run_task(Task *);
+
+private:
+
+	enum { MAX_DSCPS = 64 };
+	enum { DRAIN_MSEC = 10 };
+
+	class EmpowerLVAPManager *_el;
+	int _iface_id;
+	int _nb_lvaps;
+	int _nb_slices;
+	int _nb_dscps;
+	bool _random;
+	uint32_t _hot;
+	uint32_t _length;
+	int _burst;
+	int _limit;
+	HandlerCall *_sink;
+	bool _stop;
+	bool _active;
+	Task _task;
+
+	bool _installed;
+	uint32_t _next_lvap;
+	uint32_t _next_dscp;
+	Vector<EtherAddress> _stas;
+	unsigned char _template[64];
+
+	uint64_t _count;
+	uint64_t _delivered;
+	uint64_t _delivered_base;
+	Timestamp _start;
+	Timestamp _last;
+	uint64_t _rss_before;
+	uint64_t _rss_after;
+
+	static EtherAddress make_address(uint8_t, uint32_t);
+	static uint8_t dscp(int);
+	static uint64_t rss_kb();
+
+	void install();
+	Packet *make_packet();
+	bool drained(const Timestamp &);
+	String report(int);
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
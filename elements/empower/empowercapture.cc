@@ -0,0 +1,490 @@
+/*
+ * empowercapture.{cc,hh} -- captures frames to a pcapng file
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowercapture.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "empowerlvapmanager.hh"
+CLICK_DECLS
+
+// pcapng blocks, in host byte order as the section header tells readers
+enum {
+	PCAPNG_SHB = 0x0A0D0D0A, PCAPNG_IDB = 1, PCAPNG_EPB = 6,
+	PCAPNG_MAGIC = 0x1A2B3C4D, PCAPNG_EPB_HEADER = 28,
+	PCAPNG_OPT_END = 0, PCAPNG_IF_NAME = 2, PCAPNG_IF_DESCRIPTION = 3,
+	PCAPNG_IF_TSRESOL = 9
+};
+
+// the writer wakes up every WAKEUP_MS and writes whatever is pending
+// after FLUSH_WAKEUPS of them
+enum { WAKEUP_MS = 10, FLUSH_WAKEUPS = 10 };
+
+EmpowerCapture::EmpowerCapture() :
+		_el(0), _snaplen(65535), _chunk(1 << 18), _encap(ENCAP_RADIOTAP),
+		_active(true), _fd(-1), _nifaces(1), _ring(0), _ring_size(1 << 22),
+		_head(0), _tail(0), _count(0), _drops(0), _bytes(0), _write_errors(0),
+		_writer_running(false), _stop(false) {
+	pthread_mutex_init(&_stop_lock, 0);
+	pthread_cond_init(&_stop_cond, 0);
+}
+
+EmpowerCapture::~EmpowerCapture() {
+	delete[] _ring;
+	pthread_cond_destroy(&_stop_cond);
+	pthread_mutex_destroy(&_stop_lock);
+}
+
+static int parse_lvaps(const String &s, Vector<EtherAddress> &lvaps, Element *e) {
+	Vector<String> tokens;
+	cp_spacevec(s, tokens);
+	lvaps.clear();
+	for (int i = 0; i < tokens.size(); i++) {
+		EtherAddress lvap;
+		if (!EtherAddressArg().parse(tokens[i], lvap, e)) {
+			return -1;
+		}
+		lvaps.push_back(lvap);
+	}
+	return 0;
+}
+
+int EmpowerCapture::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	String encap = "RADIOTAP";
+	String lvaps;
+	uint32_t ring = _ring_size;
+	bool active = true;
+
+	if (Args(conf, this, errh)
+			.read_mp("FILENAME", FilenameArg(), _filename)
+			.read("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("SNAPLEN", _snaplen)
+			.read("RING", ring)
+			.read("CHUNK", _chunk)
+			.read("ENCAP", WordArg(), encap)
+			.read("ACTIVE", active)
+			.read("LVAPS", AnyArg(), lvaps)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (encap == "RADIOTAP") {
+		_encap = ENCAP_RADIOTAP;
+	} else if (encap == "802_11") {
+		_encap = ENCAP_802_11;
+	} else if (encap == "ETHER") {
+		_encap = ENCAP_ETHER;
+	} else {
+		return errh->error("ENCAP must be RADIOTAP, 802_11 or ETHER");
+	}
+
+	if (_snaplen == 0 || _snaplen > 0x40000) {
+		return errh->error("SNAPLEN must be between 1 and 262144");
+	}
+
+	if (ring > 0x40000000) {
+		return errh->error("RING too large");
+	}
+	_ring_size = 1;
+	while (_ring_size < ring) {
+		_ring_size <<= 1;
+	}
+	// room for a few of the largest blocks at least
+	if (_ring_size < 4 * (PCAPNG_EPB_HEADER + _snaplen + 8)) {
+		return errh->error("RING too small for SNAPLEN");
+	}
+	if (_chunk > _ring_size / 2) {
+		_chunk = _ring_size / 2;
+	}
+
+	if (parse_lvaps(lvaps, _lvaps, this) < 0) {
+		return errh->error("LVAPS must be a list of Ethernet addresses");
+	}
+
+	_active = active;
+
+	return 0;
+
+}
+
+bool EmpowerCapture::write_out(const void *data, size_t len) {
+	const char *p = (const char *) data;
+	while (len) {
+		ssize_t w = write(_fd, p, len);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			_write_errors++;
+			return false;
+		}
+		p += w;
+		len -= w;
+		_bytes += w;
+	}
+	return true;
+}
+
+static void add_option(StringAccum &sa, uint16_t code, const void *data, uint16_t len) {
+	sa.append((const char *) &code, 2);
+	sa.append((const char *) &len, 2);
+	sa.append((const char *) data, len);
+	while (sa.length() & 3) {
+		sa << '\0';
+	}
+}
+
+void EmpowerCapture::write_header() {
+
+	StringAccum sa;
+
+	uint32_t shb[7] = { PCAPNG_SHB, 28, PCAPNG_MAGIC, 0, 0xFFFFFFFF, 0xFFFFFFFF, 28 };
+	// major 1, minor 0, unknown section length
+	uint16_t version[2] = { 1, 0 };
+	memcpy(&shb[3], version, 4);
+	sa.append((const char *) shb, sizeof(shb));
+
+	for (int i = 0; i < _nifaces; i++) {
+		int start = sa.length();
+		uint32_t idb[4] = { PCAPNG_IDB, 0, 0, _snaplen };
+		uint16_t linktype = _encap;
+		memcpy(&idb[2], &linktype, 2);
+		sa.append((const char *) idb, sizeof(idb));
+		String name = "iface" + String(i);
+		add_option(sa, PCAPNG_IF_NAME, name.data(), name.length());
+		ResourceElement *re = _el ? _el->iface_to_element(i) : 0;
+		if (re) {
+			String description = re->unparse();
+			add_option(sa, PCAPNG_IF_DESCRIPTION, description.data(), description.length());
+		}
+		uint8_t tsresol = 9;
+		add_option(sa, PCAPNG_IF_TSRESOL, &tsresol, 1);
+		add_option(sa, PCAPNG_OPT_END, 0, 0);
+		uint32_t total = sa.length() - start + 4;
+		sa.append((const char *) &total, 4);
+		memcpy(sa.data() + start + 4, &total, 4);
+	}
+
+	write_out(sa.data(), sa.length());
+
+}
+
+int EmpowerCapture::initialize(ErrorHandler *errh) {
+
+	_fd = open(_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (_fd < 0) {
+		return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+	}
+
+	if (_el && _el->num_ifaces() > 0) {
+		_nifaces = _el->num_ifaces();
+	}
+
+	write_header();
+
+	_ring = new unsigned char[_ring_size];
+
+	if (pthread_create(&_writer, 0, writer_main, this) == 0) {
+		_writer_running = true;
+	} else {
+		_active = false;
+		click_chatter("%{element} :: %s :: cannot start the writer thread, not capturing",
+					  this,
+					  __func__);
+	}
+
+	return 0;
+
+}
+
+void EmpowerCapture::cleanup(CleanupStage) {
+	if (_writer_running) {
+		pthread_mutex_lock(&_stop_lock);
+		_stop = true;
+		pthread_cond_signal(&_stop_cond);
+		pthread_mutex_unlock(&_stop_lock);
+		pthread_join(_writer, 0);
+		_writer_running = false;
+	}
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+}
+
+// Write what the producers have committed, if at least a chunk or if
+// all. A pending span that wraps is written in two.
+void EmpowerCapture::drain(bool all) {
+	uint32_t tail = _tail;
+	uint32_t head = _head;
+	click_read_fence();
+	uint32_t pending = head - tail;
+	if (!pending || (!all && pending < _chunk)) {
+		return;
+	}
+	uint32_t offset = tail & (_ring_size - 1);
+	uint32_t first = pending < _ring_size - offset ? pending : _ring_size - offset;
+	write_out(_ring + offset, first);
+	if (first < pending) {
+		write_out(_ring, pending - first);
+	}
+	// the blocks must be read before the producers can reuse their room
+	click_fence();
+	_tail = head;
+}
+
+void *EmpowerCapture::writer_main(void *arg) {
+
+	EmpowerCapture *ec = (EmpowerCapture *) arg;
+
+	// only runs when nothing else wants the CPU
+#ifdef SCHED_IDLE
+	struct sched_param param;
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+	int wakeups = 0;
+
+	pthread_mutex_lock(&ec->_stop_lock);
+
+	while (!ec->_stop) {
+
+		pthread_mutex_unlock(&ec->_stop_lock);
+		uint32_t tail = ec->_tail;
+		ec->drain(++wakeups >= FLUSH_WAKEUPS);
+		if (ec->_tail != tail || wakeups >= FLUSH_WAKEUPS) {
+			wakeups = 0;
+		}
+		pthread_mutex_lock(&ec->_stop_lock);
+
+		struct timeval now;
+		gettimeofday(&now, 0);
+		uint64_t usec = (uint64_t) now.tv_usec + WAKEUP_MS * 1000;
+		struct timespec until;
+		until.tv_sec = now.tv_sec + usec / 1000000;
+		until.tv_nsec = (usec % 1000000) * 1000;
+
+		while (!ec->_stop && pthread_cond_timedwait(&ec->_stop_cond, &ec->_stop_lock, &until) == 0) {
+		}
+
+	}
+
+	pthread_mutex_unlock(&ec->_stop_lock);
+
+	ec->drain(true);
+
+	return 0;
+
+}
+
+bool EmpowerCapture::matches(Packet *p) const {
+
+	if (!_lvaps.size()) {
+		return true;
+	}
+
+	const unsigned char *data = p->data();
+	uint32_t len = p->length();
+	const unsigned char *addrs[2];
+
+	if (_encap == ENCAP_ETHER) {
+		if (len < 12) {
+			return false;
+		}
+		addrs[0] = data;
+		addrs[1] = data + 6;
+	} else {
+		uint32_t offset = 0;
+		if (_encap == ENCAP_RADIOTAP) {
+			if (len < 4) {
+				return false;
+			}
+			offset = data[2] | (data[3] << 8);
+		}
+		// i_addr1 and i_addr2, frames without a transmitter only have the first
+		if (len < offset + 10) {
+			return false;
+		}
+		addrs[0] = data + offset + 4;
+		addrs[1] = len >= offset + 16 ? data + offset + 10 : addrs[0];
+	}
+
+	for (int i = 0; i < _lvaps.size(); i++) {
+		if (memcmp(addrs[0], _lvaps[i].data(), 6) == 0 || memcmp(addrs[1], _lvaps[i].data(), 6) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+
+}
+
+void EmpowerCapture::copy_in(uint32_t at, const void *data, uint32_t len) {
+	uint32_t offset = at & (_ring_size - 1);
+	uint32_t first = len < _ring_size - offset ? len : _ring_size - offset;
+	memcpy(_ring + offset, data, first);
+	if (first < len) {
+		memcpy(_ring, (const unsigned char *) data + first, len - first);
+	}
+}
+
+Packet *EmpowerCapture::simple_action(Packet *p) {
+
+	if (!_active) {
+		return p;
+	}
+
+	uint32_t caplen = p->length() < _snaplen ? p->length() : _snaplen;
+	uint32_t padded = (caplen + 3) & ~3;
+	uint32_t total = PCAPNG_EPB_HEADER + padded + 4;
+
+	uint32_t iface = PAINT_ANNO(p);
+	if (iface >= (uint32_t) _nifaces) {
+		iface = 0;
+	}
+
+	Timestamp ts = p->timestamp_anno();
+	if (!ts) {
+		ts = Timestamp::recent();
+	}
+	uint64_t nsec = ts.nsecval();
+
+	uint32_t epb[7] = { PCAPNG_EPB, total, iface, (uint32_t) (nsec >> 32),
+			(uint32_t) nsec, caplen, p->length() };
+	static const uint32_t zero = 0;
+
+	_lock.acquire();
+
+	if (!matches(p)) {
+		_lock.release();
+		return p;
+	}
+
+	uint32_t head = _head;
+	if (_ring_size - (head - _tail) < total) {
+		_drops++;
+		_lock.release();
+		return p;
+	}
+
+	copy_in(head, epb, PCAPNG_EPB_HEADER);
+	copy_in(head + PCAPNG_EPB_HEADER, p->data(), caplen);
+	copy_in(head + PCAPNG_EPB_HEADER + caplen, &zero, padded - caplen);
+	copy_in(head + PCAPNG_EPB_HEADER + padded, &total, 4);
+	click_write_fence();
+	_head = head + total;
+	_count++;
+
+	_lock.release();
+
+	return p;
+
+}
+
+void EmpowerCapture::set_lvaps(Vector<EtherAddress> &lvaps) {
+	_lock.acquire();
+	_lvaps.swap(lvaps);
+	_lock.release();
+}
+
+String EmpowerCapture::read_handler(Element *e, void *thunk) {
+	EmpowerCapture *ec = (EmpowerCapture *) e;
+	switch ((uintptr_t) thunk) {
+	case H_COUNT:
+		return String(ec->_count) + "\n";
+	case H_BYTES:
+		return String(ec->_bytes) + "\n";
+	case H_DROPS:
+		return String(ec->_drops) + "\n";
+	case H_WRITE_ERRORS:
+		return String(ec->_write_errors) + "\n";
+	case H_ACTIVE:
+		return String(ec->_active) + "\n";
+	case H_LVAPS: {
+		StringAccum sa;
+		ec->_lock.acquire();
+		for (int i = 0; i < ec->_lvaps.size(); i++) {
+			sa << ec->_lvaps[i] << "\n";
+		}
+		ec->_lock.release();
+		return sa.take_string();
+	}
+	default:
+		return String();
+	}
+}
+
+int EmpowerCapture::write_handler(const String &in_s, Element *e, void *vparam, ErrorHandler *errh) {
+
+	EmpowerCapture *ec = (EmpowerCapture *) e;
+	String s = cp_uncomment(in_s);
+
+	switch ((intptr_t) vparam) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(s, active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		if (active && !ec->_writer_running) {
+			return errh->error("no writer thread, cannot capture");
+		}
+		ec->_active = active;
+		break;
+	}
+	case H_START:
+		if (!ec->_writer_running) {
+			return errh->error("no writer thread, cannot capture");
+		}
+		ec->_active = true;
+		break;
+	case H_STOP:
+		ec->_active = false;
+		break;
+	case H_LVAPS: {
+		Vector<EtherAddress> lvaps;
+		if (parse_lvaps(s, lvaps, ec) < 0) {
+			return errh->error("lvaps must be a list of Ethernet addresses");
+		}
+		ec->set_lvaps(lvaps);
+		break;
+	}
+	}
+
+	return 0;
+
+}
+
+void EmpowerCapture::add_handlers() {
+	add_read_handler("count", read_handler, (void *) H_COUNT);
+	add_read_handler("bytes", read_handler, (void *) H_BYTES);
+	add_read_handler("drops", read_handler, (void *) H_DROPS);
+	add_read_handler("write_errors", read_handler, (void *) H_WRITE_ERRORS);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE);
+	add_read_handler("lvaps", read_handler, (void *) H_LVAPS);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("start", write_handler, (void *) H_START, Handler::BUTTON);
+	add_write_handler("stop", write_handler, (void *) H_STOP, Handler::BUTTON);
+	add_write_handler("lvaps", write_handler, (void *) H_LVAPS);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerCapture)
+ELEMENT_REQUIRES(userlevel)
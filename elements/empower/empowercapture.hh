@@ -0,0 +1,170 @@
+#ifndef CLICK_EMPOWERCAPTURE_HH
+#define CLICK_EMPOWERCAPTURE_HH
+#include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/vector.hh>
+#include <click/sync.hh>
+#include <pthread.h>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerCapture(FILENAME, [EL, SNAPLEN, RING, CHUNK, ENCAP, ACTIVE, LVAPS])
+
+=s EmPOWER
+
+Captures frames to a pcapng file from a background thread
+
+=d
+
+Packets go through unchanged. While capturing, each of them is copied,
+truncated to SNAPLEN bytes, into a ring of RING bytes as a pcapng Enhanced
+Packet Block; a background thread, running only when nothing else wants
+the CPU, writes the ring to FILENAME in chunks of at least CHUNK bytes. The
+data path never waits for the disk: frames that find the ring full are
+dropped from the capture and counted.
+
+The interface of a frame is its paint annotation, as set by the
+EmpowerLVAPManager pipelines. With EL, the file describes one interface
+per interface of EL, named after its resource element; frames painted
+beyond them go to interface 0. The time of a frame is its timestamp
+annotation, or the time it was seen if it has none, with nanosecond
+resolution.
+
+Several threads may push frames into the same EmpowerCapture, they take
+turns on a lock held for the copy only.
+
+Arguments are:
+
+=over 8
+
+=item FILENAME
+File to write. It is truncated when the router starts.
+
+=item EL
+An EmpowerLVAPManager element, for the interface descriptions.
+
+=item SNAPLEN
+Bytes of a frame captured at most. Default is 65535.
+
+=item RING
+Size of the ring, in bytes. Rounded up to a power of two. Default is 4 MB.
+
+=item CHUNK
+Pending bytes the writer waits for before writing, unless some have been
+pending for 100 ms. Default is 256 kB.
+
+=item ENCAP
+Link layer of the frames: RADIOTAP, 802_11 or ETHER. Default is RADIOTAP.
+
+=item ACTIVE
+Boolean. Whether to capture from the start. Default is true.
+
+=item LVAPS
+Space separated addresses. If given, only frames to or from one of them
+are captured. Default is every frame.
+
+=back 8
+
+=h count read-only
+Frames captured.
+
+=h bytes read-only
+Bytes written to the file.
+
+=h drops read-only
+Frames not captured because the ring was full.
+
+=h write_errors read-only
+Failed writes. The data of a failed write is lost.
+
+=h active read/write
+Whether frames are captured.
+
+=h start write-only
+Starts capturing.
+
+=h stop write-only
+Stops capturing. What is in the ring is still written.
+
+=h lvaps read/write
+Addresses frames are captured for, all frames if empty.
+
+=e
+
+  wifi_cl[2] -> capture :: EmpowerCapture(/tmp/agent.pcapng, EL el, SNAPLEN 128)
+             -> ...
+
+=a EmpowerMessageRecorder, EmpowerLVAPManager
+*/
+
+class EmpowerCapture : public Element {
+
+public:
+
+	enum { ENCAP_RADIOTAP = 127, ENCAP_802_11 = 105, ENCAP_ETHER = 1 };
+
+	EmpowerCapture() CLICK_COLD;
+	~EmpowerCapture() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerCapture"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	Packet *simple_action(Packet *);
+
+private:
+
+	class EmpowerLVAPManager *_el;
+	String _filename;
+	uint32_t _snaplen;
+	uint32_t _chunk;
+	int _encap;
+	volatile bool _active;
+	int _fd;
+	int _nifaces;
+
+	// producers reserve and fill blocks under _lock, the writer thread
+	// only moves _tail
+	Spinlock _lock;
+	Vector<EtherAddress> _lvaps;
+	unsigned char *_ring;
+	uint32_t _ring_size;
+	volatile uint32_t _head;
+	char _pad[CLICK_CACHE_LINE_SIZE];
+	volatile uint32_t _tail;
+
+	uint32_t _count;
+	uint32_t _drops;
+	uint64_t _bytes;
+	uint32_t _write_errors;
+
+	pthread_t _writer;
+	pthread_mutex_t _stop_lock;
+	pthread_cond_t _stop_cond;
+	bool _writer_running;
+	bool _stop;
+
+	bool matches(Packet *) const;
+	void copy_in(uint32_t, const void *, uint32_t);
+	bool write_out(const void *, size_t);
+	void write_header();
+	void drain(bool);
+	void set_lvaps(Vector<EtherAddress> &);
+
+	static void *writer_main(void *);
+
+	enum { H_COUNT, H_BYTES, H_DROPS, H_WRITE_ERRORS, H_ACTIVE, H_START, H_STOP, H_LVAPS };
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
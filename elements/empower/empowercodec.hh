@@ -0,0 +1,146 @@
+#ifndef CLICK_EMPOWERCODEC_HH
+#define CLICK_EMPOWERCODEC_HH
+#include <click/config.h>
+#include <click/packet.hh>
+#include "empowerpacket.hh"
+CLICK_DECLS
+
+// Typed, zero-copy views over messages from the controller.
+//
+// A message is validated once, when it is dispatched: its length must
+// cover the fixed part of its type, see empower_fixed_size(). Handlers
+// can then read the fixed part through the packed struct directly, and
+// walk the variable-length trailer with an EmpowerCursor, which fails
+// sticky instead of asserting: reads past the end yield 0 and mark the
+// cursor bad, so a handler checks ok() once after parsing. Nothing is
+// copied or allocated. Outgoing messages are built with EmpowerMessage.
+
+// Size of the fixed part of the messages the controller sends, the
+// header alone for the types this agent does not parse.
+inline uint32_t empower_fixed_size(uint8_t type) {
+	switch (type) {
+	case EMPOWER_PT_PROBE_RESPONSE:             return sizeof(struct empower_probe_response);
+	case EMPOWER_PT_AUTH_RESPONSE:              return sizeof(struct empower_auth_response);
+	case EMPOWER_PT_ASSOC_RESPONSE:             return sizeof(struct empower_assoc_response);
+	case EMPOWER_PT_ADD_LVAP:                   return sizeof(struct empower_add_lvap);
+	case EMPOWER_PT_DEL_LVAP:                   return sizeof(struct empower_del_lvap);
+	case EMPOWER_PT_DEL_LVAPS:                  return sizeof(struct empower_del_lvaps);
+	case EMPOWER_PT_ADD_VAP:                    return sizeof(struct empower_add_vap);
+	case EMPOWER_PT_DEL_VAP:                    return sizeof(struct empower_del_vap);
+	case EMPOWER_PT_SET_PORT:                   return sizeof(struct empower_set_port);
+	case EMPOWER_PT_DEL_PORT:                   return sizeof(struct empower_del_port);
+	case EMPOWER_PT_SET_TRAFFIC_RULE:           return sizeof(struct empower_set_traffic_rule);
+	case EMPOWER_PT_DEL_TRAFFIC_RULE:           return sizeof(struct empower_del_traffic_rule);
+	case EMPOWER_PT_TRAFFIC_RULE_STATS_REQUEST: return sizeof(struct empower_traffic_rule_stats_request);
+	case EMPOWER_PT_INCOM_MCAST_RESPONSE:       return sizeof(struct empower_incom_mcast_addr_response);
+	case EMPOWER_PT_DEL_MCAST_ADDR:             return sizeof(struct empower_del_mcast_addr);
+	case EMPOWER_PT_DEL_MCAST_RECEIVER:         return sizeof(struct empower_del_mcast_receiver);
+	case EMPOWER_PT_NIF_STATS_REQUEST:          return sizeof(struct empower_nif_stats_request);
+	case EMPOWER_PT_LVAP_STATS_REQUEST:         return sizeof(struct empower_lvap_stats_request);
+	case EMPOWER_PT_COUNTERS_REQUEST:           return sizeof(struct empower_counters_request);
+	case EMPOWER_PT_TXP_COUNTERS_REQUEST:       return sizeof(struct empower_txp_counters_request);
+	case EMPOWER_PT_WTP_COUNTERS_REQUEST:       return sizeof(struct empower_wtp_counters_request);
+	case EMPOWER_PT_WIFI_STATS_REQUEST:         return sizeof(struct empower_wifi_stats_request);
+	case EMPOWER_PT_HISTORY_REQUEST:            return sizeof(struct empower_history_request);
+	case EMPOWER_PT_UCQM_REQUEST:
+	case EMPOWER_PT_NCQM_REQUEST:               return sizeof(struct empower_cqm_request);
+	case EMPOWER_PT_ADD_RSSI_TRIGGER:           return sizeof(struct empower_add_rssi_trigger);
+	case EMPOWER_PT_DEL_RSSI_TRIGGER:           return sizeof(struct empower_del_rssi_trigger);
+	case EMPOWER_PT_ADD_SUMMARY_TRIGGER:        return sizeof(struct empower_add_summary_trigger);
+	case EMPOWER_PT_DEL_SUMMARY_TRIGGER:        return sizeof(struct empower_del_summary_trigger);
+	case EMPOWER_PT_ADD_STATS_STREAM:           return sizeof(struct empower_add_stats_stream);
+	case EMPOWER_PT_DEL_STATS_STREAM:           return sizeof(struct empower_del_stats_stream);
+	case EMPOWER_PT_SNAPSHOT_SYNC_RESPONSE:     return sizeof(struct empower_snapshot_sync_response);
+	case EMPOWER_PT_SET_LVAP_RATE:              return sizeof(struct empower_set_lvap_rate);
+	case EMPOWER_PT_QUEUE_IMPORT:               return sizeof(struct empower_queue_frames);
+	case EMPOWER_PT_ACTIVATE_LVAP:              return sizeof(struct empower_activate_lvap);
+	case EMPOWER_PT_ADD_MIRROR:                 return sizeof(struct empower_add_mirror);
+	case EMPOWER_PT_DEL_MIRROR:                 return sizeof(struct empower_del_mirror);
+	case EMPOWER_PT_SET_RX_SAMPLE:              return sizeof(struct empower_set_rx_sample);
+	case EMPOWER_PT_SET_SSID_VLAN:              return sizeof(struct empower_set_ssid_vlan);
+	case EMPOWER_PT_ECHO_REQUEST:               return sizeof(struct empower_echo_request);
+	default:                                    return sizeof(struct empower_header);
+	}
+}
+
+// Size of a variable-length trailer entry, specialized for each entry
+// type that carries its own length. Only called once the fixed part of
+// the entry is known to be in bounds.
+template <typename E> struct EmpowerEntrySize {
+	static uint32_t size(E *) { return sizeof(E); }
+};
+
+template <> struct EmpowerEntrySize<ssid_entry> {
+	static uint32_t size(ssid_entry *e) { return 1 + e->length(); }
+};
+
+class EmpowerCursor {
+public:
+
+	EmpowerCursor(const uint8_t *begin, const uint8_t *end) :
+			_ptr(begin), _end(end), _ok(true) {
+	}
+
+	// n raw bytes, 0 if past the end
+	const uint8_t *bytes(uint32_t n) {
+		if (n > (uint32_t) (_end - _ptr)) {
+			_ok = false;
+			_ptr = _end;
+			return 0;
+		}
+		const uint8_t *p = _ptr;
+		_ptr += n;
+		return p;
+	}
+
+	// next entry of type E, 0 if past the end
+	template <typename E> E *next() {
+		uint32_t left = _end - _ptr;
+		if (left < sizeof(E) || left < EmpowerEntrySize<E>::size((E *) _ptr)) {
+			_ok = false;
+			_ptr = _end;
+			return 0;
+		}
+		E *e = (E *) _ptr;
+		_ptr += EmpowerEntrySize<E>::size(e);
+		return e;
+	}
+
+	bool done() const { return _ptr == _end; }
+	bool ok() const { return _ok; }
+
+private:
+
+	const uint8_t *_ptr;
+	const uint8_t *_end;
+	bool _ok;
+
+};
+
+// View of a message of type T, whose fixed part has been validated by
+// dispatch.
+template <typename T> class EmpowerView {
+public:
+
+	enum { FIXED_SIZE = sizeof(T) };
+
+	EmpowerView(Packet *p, uint32_t offset) :
+			_msg((T *) (p->data() + offset)) {
+	}
+
+	T *operator->() const { return _msg; }
+
+	// the variable-length part that follows the fixed one
+	EmpowerCursor trailer() const {
+		const uint8_t *begin = (const uint8_t *) _msg;
+		return EmpowerCursor(begin + FIXED_SIZE, begin + _msg->length());
+	}
+
+private:
+
+	T *_msg;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,128 @@
+#ifndef CLICK_EMPOWERCODEL_HH
+#define CLICK_EMPOWERCODEL_HH
+#include <click/config.h>
+#include <click/packet.hh>
+#include <click/timestamp.hh>
+#include <click/integers.hh>
+CLICK_DECLS
+
+// CoDel sojourn time dropping for the queues of the EmPOWER data path,
+// following elements/aqm/codel.cc. A frame that waited more than the
+// target arms the state machine; if frames keep waiting more than the
+// target for a whole interval the head is dropped, and the next drops
+// are scheduled interval / sqrt(count) apart until the sojourn time is
+// back below the target.
+//
+// The state lives with the queue and is only touched by its consumer.
+// dequeue() pulls frames through q->codel_pop() and kills the ones it
+// drops. The sojourn time is measured on the timestamp annotation, frames
+// without one are never dropped. A zero target disables the dropping.
+class EmpowerCoDel {
+public:
+
+	EmpowerCoDel() : _target(Timestamp::make_msec(0, 5)), _interval(Timestamp::make_msec(0, 100)) {
+		reset();
+	}
+
+	EmpowerCoDel(const Timestamp &target, const Timestamp &interval) : _target(target), _interval(interval) {
+		reset();
+	}
+
+	void reset() {
+		_first_above_time = Timestamp();
+		_drop_next = Timestamp();
+		_count = 0;
+		_dropping = false;
+	}
+
+	bool enabled() const { return _target; }
+	const Timestamp &target() const { return _target; }
+	const Timestamp &interval() const { return _interval; }
+
+	template <typename Q> Packet *dequeue(Q *q, const Timestamp &now, uint32_t &drops) {
+
+		if (!enabled()) {
+			return q->codel_pop();
+		}
+
+		bool ok_to_drop;
+		Packet *p = track(q->codel_pop(), now, ok_to_drop);
+
+		if (!p) {
+			_dropping = false;
+			return 0;
+		}
+
+		if (_dropping) {
+			if (!ok_to_drop) {
+				_dropping = false;
+			}
+			while (_dropping && now >= _drop_next) {
+				p->kill();
+				drops++;
+				_count++;
+				p = track(q->codel_pop(), now, ok_to_drop);
+				if (!p || !ok_to_drop) {
+					_dropping = false;
+				} else {
+					_drop_next = control_law(_drop_next);
+				}
+			}
+		} else if (ok_to_drop) {
+			p->kill();
+			drops++;
+			p = track(q->codel_pop(), now, ok_to_drop);
+			_dropping = true;
+			// start again close to the last drop rate if we were
+			// dropping recently
+			if (now - _drop_next < _interval) {
+				_count = (_count > 2) ? (_count - 2) : 1;
+			} else {
+				_count = 1;
+			}
+			_drop_next = control_law(now);
+		}
+
+		return p;
+
+	}
+
+private:
+
+	Timestamp _target;
+	Timestamp _interval;
+	Timestamp _first_above_time;
+	Timestamp _drop_next;
+	uint32_t _count;
+	bool _dropping;
+
+	Packet *track(Packet *p, const Timestamp &now, bool &ok_to_drop) {
+		ok_to_drop = false;
+		if (!p) {
+			_first_above_time = Timestamp();
+			return 0;
+		}
+		if (!p->timestamp_anno()) {
+			return p;
+		}
+		if (now - p->timestamp_anno() < _target) {
+			_first_above_time = Timestamp();
+		} else if (!_first_above_time) {
+			_first_above_time = now + _interval;
+		} else if (now >= _first_above_time) {
+			ok_to_drop = true;
+		}
+		return p;
+	}
+
+	// interval / sqrt(count), scaled by 16 to keep int_sqrt precise
+	Timestamp control_law(const Timestamp &t) const {
+		uint32_t count = _count < (1 << 20) ? _count : (1 << 20);
+		uint64_t usec = (uint64_t) _interval.usecval() * 16;
+		return t + Timestamp::make_usec((Timestamp::value_type) int_divide(usec, int_sqrt(count * 256)));
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,281 @@
+/*
+ * empowercontrolqueue.{cc,hh} -- prioritised queue of the messages to the
+ * controller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowercontrolqueue.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include "empowerpacket.hh"
+CLICK_DECLS
+
+EmpowerControlQueue::EmpowerControlQueue() :
+	_capacity(262144), _telemetry(0), _bytes(0), _highwater(0) {
+	memset(_bands, 0, sizeof(_bands));
+}
+
+EmpowerControlQueue::~EmpowerControlQueue() {
+}
+
+void *EmpowerControlQueue::cast(const char *n) {
+	if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+		return static_cast<Notifier *>(&_empty_note);
+	else
+		return Element::cast(n);
+}
+
+int EmpowerControlQueue::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	_telemetry = 0;
+
+	if (Args(conf, this, errh)
+			.read_p("CAPACITY", _capacity)
+			.read_p("TELEMETRY", _telemetry)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_capacity < 1024) {
+		return errh->error("CAPACITY must be at least 1024");
+	}
+
+	if (!_telemetry) {
+		_telemetry = _capacity / 4;
+	}
+
+	if (_telemetry > _capacity) {
+		return errh->error("TELEMETRY must not exceed CAPACITY");
+	}
+
+	_empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+
+	return 0;
+
+}
+
+void EmpowerControlQueue::cleanup(CleanupStage) {
+	clear();
+}
+
+int EmpowerControlQueue::band(uint8_t type) {
+	switch (type) {
+	case EMPOWER_PT_HELLO:
+	case EMPOWER_PT_PROBE_REQUEST:
+	case EMPOWER_PT_AUTH_REQUEST:
+	case EMPOWER_PT_ASSOC_REQUEST:
+	case EMPOWER_PT_CAPS_RESPONSE:
+	case EMPOWER_PT_STATUS_LVAP:
+	case EMPOWER_PT_STATUS_VAP:
+	case EMPOWER_PT_STATUS_PORT:
+	case EMPOWER_PT_STATUS_TRAFFIC_RULE:
+	case EMPOWER_PT_STATUS_BULK:
+	case EMPOWER_PT_SNAPSHOT_SYNC:
+	case EMPOWER_PT_QUEUE_EXPORT:
+		return BAND_CONTROL;
+	case EMPOWER_PT_STATS_STREAM:
+	case EMPOWER_PT_SUMMARY_TRIGGER:
+	case EMPOWER_PT_SUMMARY_COMPACT:
+	case EMPOWER_PT_FLOW_SAMPLES:
+	case EMPOWER_PT_LVAP_TIMELINE:
+		return BAND_TELEMETRY;
+	default:
+		return BAND_REPLIES;
+	}
+}
+
+// The first band of the messages in p; messages carry their length, a
+// truncated one is classified by what is there
+int EmpowerControlQueue::classify(Packet *p) {
+	int b = NB_BANDS - 1;
+	uint32_t offset = 0;
+	while (offset + sizeof(struct empower_header) <= p->length()) {
+		struct empower_header *h = (struct empower_header *) (p->data() + offset);
+		int hb = band(h->type());
+		if (hb < b) {
+			b = hb;
+		}
+		if (h->length() < sizeof(struct empower_header)) {
+			break;
+		}
+		offset += h->length();
+	}
+	return b;
+}
+
+void EmpowerControlQueue::drop_oldest(Band &q) {
+	Packet *p = q._head;
+	q._head = p->next();
+	if (!q._head) {
+		q._tail = 0;
+	}
+	q._length--;
+	q._bytes -= p->length();
+	q._drops++;
+	_bytes -= p->length();
+	p->kill();
+}
+
+void EmpowerControlQueue::push(int, Packet *p) {
+
+	uint32_t length = p->length();
+	int b = classify(p);
+	Band &q = _bands[b];
+
+	_lock.acquire();
+
+	if (length > _capacity || (b == BAND_TELEMETRY && length > _telemetry)) {
+		q._drops++;
+		_lock.release();
+		p->kill();
+		return;
+	}
+
+	if (b == BAND_TELEMETRY) {
+		while (q._bytes + length > _telemetry) {
+			drop_oldest(q);
+		}
+	}
+
+	// make room from the bands after this one, the last one first
+	for (int i = NB_BANDS - 1; i > b && _bytes + length > _capacity; i--) {
+		while (_bands[i]._head && _bytes + length > _capacity) {
+			drop_oldest(_bands[i]);
+		}
+	}
+
+	if (_bytes + length > _capacity) {
+		q._drops++;
+		_lock.release();
+		p->kill();
+		return;
+	}
+
+	p->set_next(0);
+	if (q._tail) {
+		q._tail->set_next(p);
+	} else {
+		q._head = p;
+	}
+	q._tail = p;
+	q._length++;
+	q._bytes += length;
+	_bytes += length;
+	if (_bytes > _highwater) {
+		_highwater = _bytes;
+	}
+
+	_lock.release();
+
+	if (!_empty_note.active()) {
+		_empty_note.wake();
+	}
+
+}
+
+Packet *EmpowerControlQueue::pull(int) {
+
+	Packet *p = 0;
+
+	_lock.acquire();
+
+	for (int i = 0; i < NB_BANDS; i++) {
+		Band &q = _bands[i];
+		if (q._head) {
+			p = q._head;
+			q._head = p->next();
+			if (!q._head) {
+				q._tail = 0;
+			}
+			q._length--;
+			q._bytes -= p->length();
+			_bytes -= p->length();
+			p->set_next(0);
+			break;
+		}
+	}
+
+	// asleep only while empty, push() wakes it up again
+	if (!_bytes) {
+		_empty_note.sleep();
+	}
+
+	_lock.release();
+
+	return p;
+
+}
+
+void EmpowerControlQueue::clear() {
+	_lock.acquire();
+	for (int i = 0; i < NB_BANDS; i++) {
+		while (Packet *p = _bands[i]._head) {
+			_bands[i]._head = p->next();
+			p->kill();
+		}
+		_bands[i]._tail = 0;
+		_bands[i]._length = 0;
+		_bands[i]._bytes = 0;
+	}
+	_bytes = 0;
+	_lock.release();
+}
+
+String EmpowerControlQueue::read_handler(Element *e, void *thunk) {
+	EmpowerControlQueue *td = (EmpowerControlQueue *) e;
+	StringAccum sa;
+	switch ((uintptr_t) thunk) {
+	case H_LENGTH:
+		sa << "control " << td->_bands[BAND_CONTROL]._length
+		   << " replies " << td->_bands[BAND_REPLIES]._length
+		   << " telemetry " << td->_bands[BAND_TELEMETRY]._length << "\n";
+		return sa.take_string();
+	case H_BYTES:
+		sa << "control " << td->_bands[BAND_CONTROL]._bytes
+		   << " replies " << td->_bands[BAND_REPLIES]._bytes
+		   << " telemetry " << td->_bands[BAND_TELEMETRY]._bytes << "\n";
+		return sa.take_string();
+	case H_HIGHWATER:
+		return String(td->_highwater) + "\n";
+	case H_DROPS:
+		sa << "control " << td->_bands[BAND_CONTROL]._drops
+		   << " replies " << td->_bands[BAND_REPLIES]._drops
+		   << " telemetry " << td->_bands[BAND_TELEMETRY]._drops << "\n";
+		return sa.take_string();
+	default:
+		return String();
+	}
+}
+
+int EmpowerControlQueue::write_handler(const String &, Element *e, void *thunk, ErrorHandler *) {
+	EmpowerControlQueue *td = (EmpowerControlQueue *) e;
+	switch ((uintptr_t) thunk) {
+	case H_RESET:
+		td->clear();
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+void EmpowerControlQueue::add_handlers() {
+	add_read_handler("length", read_handler, (void *) H_LENGTH);
+	add_read_handler("bytes", read_handler, (void *) H_BYTES);
+	add_read_handler("highwater_bytes", read_handler, (void *) H_HIGHWATER);
+	add_read_handler("drops", read_handler, (void *) H_DROPS);
+	add_write_handler("reset", write_handler, (void *) H_RESET);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerControlQueue)
@@ -0,0 +1,144 @@
+#ifndef CLICK_EMPOWERCONTROLQUEUE_HH
+#define CLICK_EMPOWERCONTROLQUEUE_HH
+#include <click/element.hh>
+#include <click/notifier.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerControlQueue([CAPACITY, TELEMETRY])
+
+=s EmPOWER
+
+Bounded, prioritised queue of the messages to the controller
+
+=d
+
+Sits between an EmpowerLVAPManager and the Socket to the controller,
+which then pulls messages as fast as the connection takes them instead
+of blocking on it. Messages are queued in three bands, and pulled the
+first band first:
+
+=over 8
+
+=item control
+Hello, probe, authentication and association requests, capabilities and
+the status of LVAPs, VAPs, ports and traffic rules: what station
+association and the state of the controller wait for.
+
+=item replies
+Answers to controller requests, triggers and everything else.
+
+=item telemetry
+Periodic statistics: stats streams, summaries and flow samples.
+
+=back 8
+
+A packet holding several messages, as the manager batches them, goes in
+the first band of any of its messages.
+
+At most CAPACITY bytes are queued. When a message does not fit, the
+oldest messages of the bands after its own are dropped to make room,
+telemetry first; if there is still no room, the message is dropped.
+Telemetry never takes more than TELEMETRY bytes, its oldest messages
+are dropped first, so that what the controller gets when the connection
+catches up is recent. Drops are counted per band.
+
+Any thread may push messages, the queue is protected by a lock.
+
+Arguments are:
+
+=over 8
+
+=item CAPACITY
+Bytes queued at most. Default is 262144.
+
+=item TELEMETRY
+Bytes of telemetry queued at most. Default is a quarter of CAPACITY.
+
+=back 8
+
+=h length read-only
+Messages queued, per band.
+
+=h bytes read-only
+Bytes queued, per band.
+
+=h highwater_bytes read-only
+Most bytes ever queued.
+
+=h drops read-only
+Messages dropped, per band.
+
+=h reset write-only
+Drops the queued messages, e.g. when the connection is reset.
+
+=e
+
+  ctrl :: Socket(TCP, 192.168.0.20, 4433, CLIENT true, RECONNECT_CALL el.reconnect)
+    -> el :: EmpowerLVAPManager(...)
+    -> EmpowerControlQueue(CAPACITY 131072)
+    -> ctrl;
+
+=a EmpowerLVAPManager, Socket
+*/
+
+class EmpowerControlQueue : public Element {
+
+public:
+
+	EmpowerControlQueue() CLICK_COLD;
+	~EmpowerControlQueue() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerControlQueue"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+	const char *processing() const		{ return PUSH_TO_PULL; }
+	void *cast(const char *);
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	void push(int, Packet *);
+	Packet *pull(int);
+
+	enum { BAND_CONTROL, BAND_REPLIES, BAND_TELEMETRY, NB_BANDS };
+
+	static int band(uint8_t type);
+
+private:
+
+	struct Band {
+		Packet *_head;
+		Packet *_tail;
+		uint32_t _length;
+		uint32_t _bytes;
+		uint32_t _drops;
+	};
+
+	uint32_t _capacity;
+	uint32_t _telemetry;
+
+	// bands only change under _lock; _bytes is the total of theirs
+	Spinlock _lock;
+	Band _bands[NB_BANDS];
+	uint32_t _bytes;
+	uint32_t _highwater;
+
+	ActiveNotifier _empty_note;
+
+	int classify(Packet *);
+	void drop_oldest(Band &);
+	void clear();
+
+	enum { H_LENGTH, H_BYTES, H_HIGHWATER, H_DROPS, H_RESET };
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
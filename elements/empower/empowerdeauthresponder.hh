@@ -4,6 +4,7 @@
 #include <click/element.hh>
 #include <click/config.h>
 #include <elements/wifi/availablerates.hh>
+#include "empowerloglimit.hh"
 CLICK_DECLS
 
 /*
@@ -29,6 +30,10 @@ Turn debug on/off
 
 =back 8
 
+=h log read-only
+One line per message logged per frame: name, times it was due, times
+it was suppressed. Each message is logged at most 10 times per second.
+
 =a EmpowerLVAPManager
 */
 
@@ -53,6 +58,10 @@ private:
 
 	bool _debug;
 
+	// messages logged per frame, see log_sites
+	enum { LOG_TOO_SMALL, LOG_NOT_MANAGEMENT, LOG_WRONG_SUBTYPE, LOG_UNKNOWN_STATION, LOG_CSA_ACTIVE, LOG_BAD_ADDRESSES, LOG_BSSID_MISMATCH, NB_LOGS };
+	EmpowerLogLimit _log;
+
 	static String read_handler(Element *e, void *user_data);
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 
@@ -30,8 +30,12 @@
 #include "empowerlvapmanager.hh"
 CLICK_DECLS
 
+static const char * const log_sites[] = {
+	"too_small", "not_management", "wrong_subtype", "unknown_station", "csa_active", "bad_addresses", "bssid_mismatch"
+};
+
 EmpowerDisassocResponder::EmpowerDisassocResponder() :
-		_el(0), _debug(false) {
+		_el(0), _debug(false), _log(log_sites, NB_LOGS) {
 }
 
 EmpowerDisassocResponder::~EmpowerDisassocResponder() {
@@ -49,7 +53,7 @@ int EmpowerDisassocResponder::configure(Vector<String> &conf,
 void EmpowerDisassocResponder::push(int, Packet *p) {
 
 	if (p->length() < sizeof(struct click_wifi)) {
-		click_chatter("%{element} :: %s :: Packet too small: %d Vs. %d",
+		empower_chatter_limited(_log, LOG_TOO_SMALL, "%{element} :: %s :: Packet too small: %d Vs. %d",
 				      this,
 				      __func__,
 				      p->length(),
@@ -63,7 +67,7 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 	uint8_t type = w->i_fc[0] & WIFI_FC0_TYPE_MASK;
 
 	if (type != WIFI_FC0_TYPE_MGT) {
-		click_chatter("%{element} :: %s :: Received non-management packet",
+		empower_chatter_limited(_log, LOG_NOT_MANAGEMENT, "%{element} :: %s :: Received non-management packet",
 				      this,
 				      __func__);
 		p->kill();
@@ -73,7 +77,7 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 	uint8_t subtype = w->i_fc[0] & WIFI_FC0_SUBTYPE_MASK;
 
 	if (subtype != WIFI_FC0_SUBTYPE_DISASSOC) {
-		click_chatter("%{element} :: %s :: Received non-disassociation packet",
+		empower_chatter_limited(_log, LOG_WRONG_SUBTYPE, "%{element} :: %s :: Received non-disassociation packet",
 				      this,
 				      __func__);
 		p->kill();
@@ -85,7 +89,7 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 
     //If we're not aware of this LVAP, ignore
 	if (!ess) {
-		click_chatter("%{element} :: %s :: Unknown station %s",
+		empower_chatter_limited(_log, LOG_UNKNOWN_STATION, "%{element} :: %s :: Unknown station %s",
 				      this,
 				      __func__,
 				      src.unparse().c_str());
@@ -94,15 +98,15 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 	}
 
     if (ess->_csa_active) {
-		click_chatter("%{element} :: %s :: lvap %s csa active ignoring request.",
+		empower_chatter_limited(_log, LOG_CSA_ACTIVE, "%{element} :: %s :: lvap %s csa active ignoring request.",
 				      this,
 				      __func__,
 				      ess->_sta.unparse().c_str());
     	return;
     }
 
-	// if this is an uplink only lvap then ignore request
-	if (!ess->_set_mask) {
+	// if this is an uplink only or a staged lvap then ignore request
+	if (!ess->_set_mask || ess->_staged) {
 		p->kill();
 		return;
 	}
@@ -111,7 +115,7 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 	EtherAddress bssid = EtherAddress(w->i_addr3);
 
 	if (dst != bssid) {
-		click_chatter("%{element} :: %s :: Strange dst/bssid combination %s/%s, ignoring",
+		empower_chatter_limited(_log, LOG_BAD_ADDRESSES, "%{element} :: %s :: Strange dst/bssid combination %s/%s, ignoring",
 				      this,
 				      __func__,
 				      dst.unparse().c_str(),
@@ -131,7 +135,7 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 
 	//If the bssid does not match, ignore
 	if (ess->_lvap_bssid != bssid) {
-		click_chatter("%{element} :: %s :: BSSIDs do not match, expected %s received %s",
+		empower_chatter_limited(_log, LOG_BSSID_MISMATCH, "%{element} :: %s :: BSSIDs do not match, expected %s received %s",
 				      this,
 				      __func__,
 				      ess->_lvap_bssid.unparse().c_str(),
@@ -143,6 +147,9 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 	ess->_association_status = false;
 	ess->_assoc_id = 0;
 	ess->_ssid = "";
+	ess->_ssid_id = -1;
+	ess->_slice_id = -1;
+	_el->update_iface_lists();
 
 	_el->send_status_lvap(src);
 
@@ -151,7 +158,8 @@ void EmpowerDisassocResponder::push(int, Packet *p) {
 }
 
 enum {
-	H_DEBUG
+	H_DEBUG,
+	H_LOG
 };
 
 String EmpowerDisassocResponder::read_handler(Element *e, void *thunk) {
@@ -159,6 +167,8 @@ String EmpowerDisassocResponder::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_LOG:
+		return td->_log.unparse();
 	default:
 		return String();
 	}
@@ -184,6 +194,7 @@ int EmpowerDisassocResponder::write_handler(const String &in_s, Element *e,
 
 void EmpowerDisassocResponder::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
+	add_read_handler("log", read_handler, (void *) H_LOG);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
@@ -0,0 +1,94 @@
+#ifndef CLICK_EMPOWEREPOCH_HH
+#define CLICK_EMPOWEREPOCH_HH
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+
+// Epoch based reclamation for structures that the control plane
+// replaces while data-path threads keep reading them without locks.
+//
+// Readers wrap every access in a Guard, which publishes the current
+// epoch in the slot of the calling Click thread. Guards nest, as a push
+// can reach another element reading the same structure. A writer swaps
+// in the new version, calls retire() and tags the old version with the
+// returned epoch. That version may be freed once quiescent() returns
+// true for its tag, i.e. once no reader that could have seen it is
+// still running.
+class EmpowerEpoch {
+public:
+
+	enum { MAX_THREADS = 64 };
+
+	EmpowerEpoch() : _epoch(1) {
+		for (int i = 0; i < MAX_THREADS; i++) {
+			_threads[i]._active = 0;
+			_threads[i]._depth = 0;
+		}
+	}
+
+	void enter() {
+		ThreadSlot &t = _threads[thread_id()];
+		if (t._depth++ == 0) {
+			t._active = _epoch;
+			click_fence();
+		}
+	}
+
+	void exit() {
+		ThreadSlot &t = _threads[thread_id()];
+		if (--t._depth == 0) {
+			click_fence();
+			t._active = 0;
+		}
+	}
+
+	// writers must be serialised by the caller
+	uint32_t retire() {
+		click_fence();
+		return _epoch++;
+	}
+
+	bool quiescent(uint32_t epoch) const {
+		click_fence();
+		for (int i = 0; i < MAX_THREADS; i++) {
+			uint32_t active = _threads[i]._active;
+			if (active && active <= epoch) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	class Guard {
+	public:
+		Guard(EmpowerEpoch *epoch) : _epoch(epoch) {
+			_epoch->enter();
+		}
+		~Guard() {
+			_epoch->exit();
+		}
+	private:
+		EmpowerEpoch *_epoch;
+	};
+
+private:
+
+	struct ThreadSlot {
+		volatile uint32_t _active;
+		uint32_t _depth;
+		char _pad[CLICK_CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+	};
+
+	ThreadSlot _threads[MAX_THREADS];
+	volatile uint32_t _epoch;
+
+	static unsigned thread_id() {
+		unsigned id = click_current_cpu_id();
+		return id < MAX_THREADS ? id : MAX_THREADS - 1;
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
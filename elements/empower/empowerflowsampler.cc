@@ -0,0 +1,474 @@
+/*
+ * empowerflowsampler.{cc,hh} -- samples frame headers and exports them to
+ * the controller or a collector
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerflowsampler.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ether.h>
+#include <clicknet/wifi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "empowerlvapmanager.hh"
+#include "empowermessage.hh"
+CLICK_DECLS
+
+EmpowerFlowSampler::EmpowerFlowSampler() :
+		_el(0), _direction(EMPOWER_FLOW_DOWNLINK), _encap(EMPOWER_FLOW_ETHER),
+		_sample(1000), _snaplen(64), _ring_size(256), _period(1000), _id(0),
+		_port(6343), _fd(-1), _timer(this), _skip(1), _fill(0), _frames(0),
+		_samples(0), _drops(0), _messages(0), _send_errors(0), _frames_sent(0),
+		_drops_sent(0), _seq(0) {
+	_rings[0] = _rings[1] = 0;
+	_used[0] = _used[1] = 0;
+}
+
+EmpowerFlowSampler::~EmpowerFlowSampler() {
+}
+
+int EmpowerFlowSampler::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	String direction = "DOWNLINK";
+	String encap = "ETHER";
+
+	if (Args(conf, this, errh)
+			.read_mp("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("DIRECTION", WordArg(), direction)
+			.read("ENCAP", WordArg(), encap)
+			.read("SAMPLE", _sample)
+			.read("SNAPLEN", _snaplen)
+			.read("RING", _ring_size)
+			.read("PERIOD", _period)
+			.read("ID", _id)
+			.read("COLLECTOR", _collector)
+			.read("PORT", IPPortArg(IP_PROTO_UDP), _port)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (direction == "DOWNLINK") {
+		_direction = EMPOWER_FLOW_DOWNLINK;
+	} else if (direction == "UPLINK") {
+		_direction = EMPOWER_FLOW_UPLINK;
+	} else {
+		return errh->error("DIRECTION must be DOWNLINK or UPLINK");
+	}
+
+	if (encap == "ETHER") {
+		_encap = EMPOWER_FLOW_ETHER;
+	} else if (encap == "802_11") {
+		_encap = EMPOWER_FLOW_802_11;
+	} else {
+		return errh->error("ENCAP must be ETHER or 802_11");
+	}
+
+	if (!_sample) {
+		return errh->error("SAMPLE must be positive");
+	}
+
+	if (_snaplen > MAX_SNAPLEN) {
+		return errh->error("SNAPLEN must be at most %d", (int) MAX_SNAPLEN);
+	}
+
+	if (!_ring_size) {
+		return errh->error("RING must be positive");
+	}
+
+	if (!_period) {
+		return errh->error("PERIOD must be positive");
+	}
+
+	return 0;
+
+}
+
+int EmpowerFlowSampler::initialize(ErrorHandler *errh) {
+
+	_rings[0] = new Sample[_ring_size];
+	_rings[1] = new Sample[_ring_size];
+	if (!_rings[0] || !_rings[1]) {
+		return errh->error("out of memory");
+	}
+
+	if (_collector) {
+		_fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (_fd < 0) {
+			return errh->error("socket: %s", strerror(errno));
+		}
+		struct sockaddr_in sin;
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(_port);
+		sin.sin_addr = _collector.in_addr();
+		// connected, so sendmmsg() needs no address per message
+		if (connect(_fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+			return errh->error("%s:%d: %s", _collector.unparse().c_str(), _port, strerror(errno));
+		}
+		fcntl(_fd, F_SETFL, O_NONBLOCK);
+	}
+
+	_skip = next_skip();
+
+	_timer.initialize(this);
+	_timer.schedule_after_msec(_period);
+
+	return 0;
+
+}
+
+void EmpowerFlowSampler::cleanup(CleanupStage) {
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+	delete[] _rings[0];
+	delete[] _rings[1];
+	_rings[0] = _rings[1] = 0;
+}
+
+// Uniform between 1 and 2 * SAMPLE - 1, so one frame in SAMPLE on average
+int32_t EmpowerFlowSampler::next_skip() const {
+	if (_sample == 1) {
+		return 1;
+	}
+	return click_random(1, 2 * _sample - 1);
+}
+
+Packet *EmpowerFlowSampler::simple_action(Packet *p) {
+
+	_frames++;
+
+	if (--_skip > 0) {
+		return p;
+	}
+
+	_skip = next_skip();
+	take_sample(p);
+
+	return p;
+
+}
+
+void EmpowerFlowSampler::take_sample(Packet *p) {
+
+	EtherAddress sta;
+
+	if (_encap == EMPOWER_FLOW_ETHER) {
+		if (p->length() < sizeof(click_ether)) {
+			return;
+		}
+		const click_ether *eh = (const click_ether *) p->data();
+		sta = EtherAddress(_direction == EMPOWER_FLOW_DOWNLINK ? eh->ether_dhost : eh->ether_shost);
+	} else {
+		if (p->length() < sizeof(struct click_wifi)) {
+			return;
+		}
+		const struct click_wifi *w = (const struct click_wifi *) p->data();
+		sta = EtherAddress(_direction == EMPOWER_FLOW_DOWNLINK ? w->i_addr1 : w->i_addr2);
+	}
+
+	int ssid_id = (int) SLICE_ANNO(p) - 1;
+	int iface_id = -1;
+
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+		const EmpowerStationHotTable *snapshot = _el->snapshot();
+		const EmpowerStationHot *hot = snapshot ? snapshot->get(sta) : 0;
+		if (hot) {
+			iface_id = hot->_iface_id;
+			if (ssid_id < 0) {
+				ssid_id = hot->_ssid_id;
+			}
+		}
+	}
+
+	Timestamp now = Timestamp::recent();
+	uint32_t delay = 0;
+	if (p->timestamp_anno() && p->timestamp_anno() < now) {
+		delay = (now - p->timestamp_anno()).usecval();
+	}
+
+	uint32_t caplen = p->length() < _snaplen ? p->length() : _snaplen;
+
+	_lock.acquire();
+
+	uint32_t &used = _used[_fill];
+	if (used == _ring_size) {
+		_drops++;
+		_lock.release();
+		return;
+	}
+
+	Sample &s = _rings[_fill][used++];
+	s._ts = now;
+	s._sta = sta;
+	s._iface_id = iface_id;
+	s._ssid_id = ssid_id;
+	s._delay = delay;
+	s._length = p->length() < 0xFFFF ? p->length() : 0xFFFF;
+	s._caplen = caplen;
+	memcpy(s._data, p->data(), caplen);
+	_samples++;
+
+	_lock.release();
+
+}
+
+void EmpowerFlowSampler::run_timer(Timer *) {
+
+	_lock.acquire();
+	int ring = _fill;
+	_fill = 1 - _fill;
+	_lock.release();
+
+	export_samples(_rings[ring], _used[ring]);
+	_used[ring] = 0;
+
+	_timer.reschedule_after_msec(_period);
+
+}
+
+static int index_of(const Vector<int> &ids, int id) {
+	for (int i = 0; i < ids.size(); i++) {
+		if (ids[i] == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Sends the samples as messages of at most MAX_DATAGRAM bytes, each with
+// the SSIDs of its own samples. An empty period still sends one message,
+// with the frames seen.
+void EmpowerFlowSampler::export_samples(const Sample *samples, uint32_t n) {
+
+	uint32_t frames = _frames;
+	uint32_t drops = _drops;
+
+	// names of the slices, looked up once for the whole export
+	Vector<String> names;
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+		const EmpowerStationHotTable *snapshot = _el->snapshot();
+		for (uint32_t i = 0; snapshot && i < n; i++) {
+			int id = samples[i]._ssid_id;
+			if (id < 0) {
+				continue;
+			}
+			if (id >= names.size()) {
+				names.resize(id + 1);
+			}
+			if (!names[id]) {
+				names[id] = snapshot->ssid(id);
+			}
+		}
+	}
+
+	Timestamp now = Timestamp::recent();
+	Vector<Packet *> out;
+	uint32_t i = 0;
+
+	do {
+
+		// samples [i, j) and their SSIDs fit in one message
+		Vector<int> ssids;
+		uint32_t len = sizeof(empower_flow_samples);
+		uint32_t j = i;
+		while (j < n && j - i < 0xFFFF) {
+			const Sample &s = samples[j];
+			uint32_t need = sizeof(flow_sample_entry) + s._caplen;
+			bool new_ssid = s._ssid_id >= 0 && s._ssid_id < names.size() && names[s._ssid_id]
+					&& index_of(ssids, s._ssid_id) < 0 && ssids.size() < 0xFF;
+			if (new_ssid) {
+				need += 1 + names[s._ssid_id].length();
+			}
+			if (j > i && len + need > MAX_DATAGRAM) {
+				break;
+			}
+			len += need;
+			if (new_ssid) {
+				ssids.push_back(s._ssid_id);
+			}
+			j++;
+		}
+
+		EmpowerMessage msg;
+		uint32_t seq = _fd >= 0 ? ++_seq : _el->get_next_seq();
+
+		// MAX_DATAGRAM fits in the buffer start() draws, the appends
+		// below never grow the packet
+		if (!msg.start<empower_flow_samples>(EMPOWER_PT_FLOW_SAMPLES, seq)) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+					      this,
+					      __func__);
+			break;
+		}
+
+		bool ok = true;
+
+		for (int k = 0; ok && k < ssids.size(); k++) {
+			const String &name = names[ssids[k]];
+			ssid_entry *entry = msg.append<ssid_entry>(name.length());
+			if (!entry) {
+				ok = false;
+				break;
+			}
+			entry->set_length(name.length());
+			entry->set_ssid(name);
+		}
+
+		for (uint32_t k = i; ok && k < j; k++) {
+			const Sample &s = samples[k];
+			flow_sample_entry *entry = msg.append<flow_sample_entry>(s._caplen);
+			if (!entry) {
+				ok = false;
+				break;
+			}
+			int ssid = s._ssid_id >= 0 ? index_of(ssids, s._ssid_id) : -1;
+			entry->set_age(s._ts < now ? (now - s._ts).usecval() : 0);
+			entry->set_sta(s._sta);
+			entry->set_iface_id(s._iface_id >= 0 && s._iface_id < 0xFF ? s._iface_id : 0xFF);
+			entry->set_ssid(ssid >= 0 ? ssid : 0xFF);
+			entry->set_delay(s._delay);
+			entry->set_length(s._length);
+			entry->set_caplen(s._caplen);
+			memcpy(entry + 1, s._data, s._caplen);
+		}
+
+		if (!ok) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+					      this,
+					      __func__);
+			break;
+		}
+
+		empower_flow_samples *hdr = msg.header<empower_flow_samples>();
+		hdr->set_wtp(_el->wtp());
+		hdr->set_sampler_id(_id);
+		hdr->set_direction(_direction);
+		hdr->set_encap(_encap);
+		hdr->set_rate(_sample);
+		// the counts of the period go with its first message
+		if (i == 0) {
+			hdr->set_frames(frames - _frames_sent);
+			hdr->set_drops(drops - _drops_sent);
+		}
+		hdr->set_nb_ssids(ssids.size());
+		hdr->set_nb_samples(j - i);
+
+		out.push_back(msg.finish());
+		i = j;
+
+	} while (i < n);
+
+	_frames_sent = frames;
+	_drops_sent = drops;
+
+	if (_fd >= 0) {
+		send_datagrams(out);
+		return;
+	}
+
+	for (int k = 0; k < out.size(); k++) {
+		_el->send_flow_samples(out[k]);
+		_messages++;
+	}
+
+}
+
+// One datagram per message, all of them in one system call
+void EmpowerFlowSampler::send_datagrams(Vector<Packet *> &out) {
+
+	Vector<struct mmsghdr> msgs(out.size(), mmsghdr());
+	Vector<struct iovec> iovs(out.size(), iovec());
+
+	for (int i = 0; i < out.size(); i++) {
+		iovs[i].iov_base = (void *) out[i]->data();
+		iovs[i].iov_len = out[i]->length();
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int sent = 0;
+	while (sent < out.size()) {
+		int r = sendmmsg(_fd, msgs.begin() + sent, out.size() - sent, MSG_DONTWAIT);
+		if (r <= 0) {
+			break;
+		}
+		sent += r;
+	}
+
+	_messages += sent;
+	_send_errors += out.size() - sent;
+
+	for (int i = 0; i < out.size(); i++) {
+		out[i]->kill();
+	}
+
+}
+
+String EmpowerFlowSampler::read_handler(Element *e, void *thunk) {
+	EmpowerFlowSampler *td = (EmpowerFlowSampler *) e;
+	switch ((uintptr_t) thunk) {
+	case H_FRAMES:
+		return String(td->_frames) + "\n";
+	case H_SAMPLES:
+		return String(td->_samples) + "\n";
+	case H_DROPS:
+		return String(td->_drops) + "\n";
+	case H_MESSAGES:
+		return String(td->_messages) + "\n";
+	case H_SEND_ERRORS:
+		return String(td->_send_errors) + "\n";
+	case H_SAMPLE:
+		return String(td->_sample) + "\n";
+	default:
+		return String();
+	}
+}
+
+int EmpowerFlowSampler::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerFlowSampler *td = (EmpowerFlowSampler *) e;
+	switch ((uintptr_t) thunk) {
+	case H_SAMPLE: {
+		uint32_t sample;
+		if (!IntArg().parse(cp_uncomment(in_s), sample) || !sample) {
+			return errh->error("sample parameter must be positive");
+		}
+		td->_sample = sample;
+		td->_skip = td->next_skip();
+		break;
+	}
+	}
+	return 0;
+}
+
+void EmpowerFlowSampler::add_handlers() {
+	add_read_handler("frames", read_handler, (void *) H_FRAMES);
+	add_read_handler("samples", read_handler, (void *) H_SAMPLES);
+	add_read_handler("drops", read_handler, (void *) H_DROPS);
+	add_read_handler("messages", read_handler, (void *) H_MESSAGES);
+	add_read_handler("send_errors", read_handler, (void *) H_SEND_ERRORS);
+	add_read_handler("sample", read_handler, (void *) H_SAMPLE);
+	add_write_handler("sample", write_handler, (void *) H_SAMPLE);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerFlowSampler)
+ELEMENT_REQUIRES(userlevel EmpowerLVAPManager)
@@ -0,0 +1,192 @@
+#ifndef CLICK_EMPOWERFLOWSAMPLER_HH
+#define CLICK_EMPOWERFLOWSAMPLER_HH
+#include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/ipaddress.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerFlowSampler(EL, [DIRECTION, ENCAP, SAMPLE, SNAPLEN, RING, PERIOD, ID, COLLECTOR, PORT])
+
+=s EmPOWER
+
+Samples frame headers and exports them to the controller or a collector
+
+=d
+
+Packets go through unchanged. About one frame in SAMPLE is sampled, at
+random intervals so that periodic traffic is not aliased: its first
+SNAPLEN bytes are kept together with its length, its LVAP, the interface
+and the slice (SSID) of the LVAP, and the time since its timestamp
+annotation. Placed after an EmpowerQOSManager, that is the time the frame
+spent queued. Frames not sampled only decrement a counter; the LVAP
+lookup and the copy are paid for sampled frames only.
+
+Samples wait in a ring of RING entries. Every PERIOD the ring is swapped
+for an empty one and its samples are sent as flow samples messages, each
+small enough for a datagram. Samples that find the ring full are lost and
+counted, the messages say how many.
+
+Messages go to the controller through EL, or, with COLLECTOR, as UDP
+datagrams to COLLECTOR:PORT, all the messages of a period in one
+sendmmsg() call. Datagrams carry the same message, header included.
+
+The slice of a frame is its slice annotation, see EmpowerSliceTag, or the
+SSID of its LVAP. Several threads may push frames into the same
+EmpowerFlowSampler, they take turns on a lock held for the copy of a
+sample only.
+
+Arguments are:
+
+=over 8
+
+=item EL
+An EmpowerLVAPManager element.
+
+=item DIRECTION
+DOWNLINK or UPLINK. The LVAP of a frame is its destination on the downlink
+and its source on the uplink. Default is DOWNLINK.
+
+=item ENCAP
+Link layer of the frames: ETHER or 802_11. Default is ETHER.
+
+=item SAMPLE
+One frame sampled out of SAMPLE on average. Default is 1000.
+
+=item SNAPLEN
+Bytes of a frame kept, at most 128. Default is 64.
+
+=item RING
+Samples kept between two exports. Default is 256.
+
+=item PERIOD
+Export period, in msec. Default is 1000.
+
+=item ID
+Sampler id sent in the messages, to tell samplers apart. Default is 0.
+
+=item COLLECTOR
+IP address of a UDP collector. Default is to send to the controller.
+
+=item PORT
+UDP port of the collector. Default is 6343.
+
+=back 8
+
+=h frames read-only
+Frames seen.
+
+=h samples read-only
+Frames sampled.
+
+=h drops read-only
+Samples lost because the ring was full.
+
+=h messages read-only
+Messages sent.
+
+=h send_errors read-only
+Messages the collector socket did not take.
+
+=h sample read/write
+SAMPLE.
+
+=e
+
+  eqm_0
+    -> EmpowerFlowSampler(EL el, ENCAP 802_11, SAMPLE 500)
+    -> epsb_0 :: EmpowerPowerSaveBuffer(EL el, IFACE_ID 0)
+    -> [1] sched_0;
+
+  wifi_decap
+    -> EmpowerFlowSampler(EL el, DIRECTION UPLINK, COLLECTOR 192.168.0.20, ID 1)
+    -> ...
+
+=a EmpowerCapture, EmpowerSliceTag, EmpowerQOSManager
+*/
+
+class EmpowerFlowSampler : public Element {
+
+public:
+
+	EmpowerFlowSampler() CLICK_COLD;
+	~EmpowerFlowSampler() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerFlowSampler"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+	const char *processing() const		{ return AGNOSTIC; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	Packet *simple_action(Packet *);
+	void run_timer(Timer *);
+
+private:
+
+	enum { MAX_SNAPLEN = 128, MAX_DATAGRAM = 1400 };
+
+	struct Sample {
+		Timestamp _ts;
+		EtherAddress _sta;
+		int _iface_id;
+		int _ssid_id;
+		uint32_t _delay;
+		uint16_t _length;
+		uint8_t _caplen;
+		uint8_t _data[MAX_SNAPLEN];
+	};
+
+	class EmpowerLVAPManager *_el;
+	int _direction;
+	int _encap;
+	uint32_t _sample;
+	uint32_t _snaplen;
+	uint32_t _ring_size;
+	uint32_t _period;
+	uint32_t _id;
+	IPAddress _collector;
+	uint16_t _port;
+	int _fd;
+	Timer _timer;
+
+	// frames to go before the next sample
+	int32_t _skip;
+
+	// producers fill _rings[_fill] under _lock, the timer swaps the
+	// rings under _lock and exports the other one without it
+	Spinlock _lock;
+	Sample *_rings[2];
+	uint32_t _used[2];
+	int _fill;
+
+	uint32_t _frames;
+	uint32_t _samples;
+	uint32_t _drops;
+	uint32_t _messages;
+	uint32_t _send_errors;
+	// _frames and _drops as of the last export
+	uint32_t _frames_sent;
+	uint32_t _drops_sent;
+	uint32_t _seq;
+
+	int32_t next_skip() const;
+	void take_sample(Packet *);
+	void export_samples(const Sample *, uint32_t);
+	void send_datagrams(Vector<Packet *> &);
+
+	enum { H_FRAMES, H_SAMPLES, H_DROPS, H_MESSAGES, H_SEND_ERRORS, H_SAMPLE };
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
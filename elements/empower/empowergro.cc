@@ -0,0 +1,332 @@
+/*
+ * empowergro.{cc,hh} -- coalesces consecutive TCP segments into super-frames
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowergro.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include <clicknet/tcp.h>
+CLICK_DECLS
+
+EmpowerGRO::EmpowerGRO() :
+	_nb_flows(0), _max_flows(8), _max_length(65535), _task(this),
+	_merged(0), _flushed(0) {
+}
+
+EmpowerGRO::~EmpowerGRO() {
+}
+
+int EmpowerGRO::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	if (Args(conf, this, errh)
+			.read("FLOWS", _max_flows)
+			.read("MAX_LENGTH", _max_length)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_max_flows < 1 || _max_flows > MAX_FLOWS) {
+		return errh->error("FLOWS must be between 1 and %d", (int) MAX_FLOWS);
+	}
+
+	if (_max_length < 1514 || _max_length > 65535) {
+		return errh->error("MAX_LENGTH must be between 1514 and 65535");
+	}
+
+	return 0;
+
+}
+
+int EmpowerGRO::initialize(ErrorHandler *errh) {
+	ScheduleInfo::initialize_task(this, &_task, false, errh);
+	return 0;
+}
+
+void EmpowerGRO::cleanup(CleanupStage) {
+	for (int i = 0; i < _nb_flows; i++) {
+		_flows[i]._p->kill();
+	}
+	_nb_flows = 0;
+}
+
+// Internet checksum of a TCP segment, pseudo header included. Zero if the
+// checksum field is right.
+uint16_t EmpowerGRO::tcp_cksum(const unsigned char *l3, const unsigned char *l4, int len) {
+	uint32_t csum = click_in_cksum(l4, len);
+	if ((l3[0] >> 4) == 4) {
+		return click_in_cksum_pseudohdr(csum, (const click_ip *) l3, len);
+	}
+	const uint16_t *a = (const uint16_t *) &((const click_ip6 *) l3)->ip6_src;
+	csum = ~csum & 0xFFFF;
+	for (int i = 0; i < 16; i++) {
+		csum += a[i];
+	}
+	csum += htons(len) + htons(IP_PROTO_TCP);
+	csum = (csum & 0xFFFF) + (csum >> 16);
+	return ~(csum + (csum >> 16)) & 0xFFFF;
+}
+
+// Length of the Ethernet, IP and TCP headers of p, or -1 if p is not a TCP
+// segment EmpowerGRO knows about. Sets the offsets of the IP and TCP
+// headers.
+int EmpowerGRO::parse(const Packet *p, int &l3, int &l4) const {
+
+	const unsigned char *data = p->data();
+	int len = p->length();
+
+	l3 = sizeof(click_ether);
+	if (len < l3 + 4) {
+		return -1;
+	}
+	uint16_t ether_type = ((const click_ether *) data)->ether_type;
+	if (ether_type == htons(ETHERTYPE_8021Q)) {
+		ether_type = *(const uint16_t *) (data + l3 + 2);
+		l3 += 4;
+	}
+
+	if (ether_type == htons(ETHERTYPE_IP) && len >= l3 + (int) sizeof(click_ip)) {
+		const click_ip *ip = (const click_ip *) (data + l3);
+		if (ip->ip_v != 4 || ip->ip_hl != 5 || ip->ip_p != IP_PROTO_TCP || IP_ISFRAG(ip)
+				|| ntohs(ip->ip_len) != len - l3) {
+			return -1;
+		}
+		l4 = l3 + sizeof(click_ip);
+	} else if (ether_type == htons(ETHERTYPE_IP6) && len >= l3 + (int) sizeof(click_ip6)) {
+		const click_ip6 *ip6 = (const click_ip6 *) (data + l3);
+		if (ip6->ip6_nxt != IP_PROTO_TCP || ntohs(ip6->ip6_plen) != len - l3 - (int) sizeof(click_ip6)) {
+			return -1;
+		}
+		l4 = l3 + sizeof(click_ip6);
+	} else {
+		return -1;
+	}
+
+	if (len < l4 + (int) sizeof(click_tcp)) {
+		return -1;
+	}
+	int hlen = l4 + (((const click_tcp *) (data + l4))->th_off << 2);
+	if (hlen < l4 + (int) sizeof(click_tcp) || hlen > len) {
+		return -1;
+	}
+	return hlen;
+
+}
+
+// The super-frame of the flow of p. Flows are told apart by their
+// Ethernet addresses and VLAN tag, their IP addresses and their ports.
+EmpowerGRO::GROFlow *EmpowerGRO::lookup(const Packet *p, int l3, int l4) {
+	const unsigned char *data = p->data();
+	int addrs = ((data[l3] >> 4) == 4) ? 8 : 32;
+	int src = ((data[l3] >> 4) == 4) ? 12 : 8;
+	for (int i = 0; i < _nb_flows; i++) {
+		GROFlow *f = &_flows[i];
+		const unsigned char *fdata = f->_p->data();
+		if (f->_l3 == l3 && f->_l4 == l4
+				// the addresses, and the tag of a tagged frame
+				&& memcmp(fdata, data, l3 - 2) == 0
+				&& (fdata[l3] >> 4) == (data[l3] >> 4)
+				&& memcmp(fdata + l3 + src, data + l3 + src, addrs) == 0
+				&& memcmp(fdata + l4, data + l4, 4) == 0) {
+			return f;
+		}
+	}
+	return 0;
+}
+
+// Appends the payload of p to the super-frame of f. Returns false, leaving
+// both untouched, if p does not follow f or does not have the same headers.
+bool EmpowerGRO::merge(GROFlow *f, Packet *p, int l3, int l4, int hlen) {
+
+	const unsigned char *data = p->data();
+	const unsigned char *fdata = f->_p->data();
+	const click_tcp *th = (const click_tcp *) (data + l4);
+	const click_tcp *fth = (const click_tcp *) (fdata + l4);
+	uint32_t payload = p->length() - hlen;
+
+	if (hlen != f->_hlen || ntohl(th->th_seq) != f->_next_seq || payload > f->_mss
+			|| f->_p->length() + payload > _max_length) {
+		return false;
+	}
+
+	if (th->th_ack != fth->th_ack || (th->th_flags & ~TH_PUSH) != (fth->th_flags & ~TH_PUSH)
+			|| memcmp(data + l4 + sizeof(click_tcp), fdata + l4 + sizeof(click_tcp), hlen - l4 - sizeof(click_tcp)) != 0) {
+		return false;
+	}
+
+	if ((data[l3] >> 4) == 4) {
+		const click_ip *ip = (const click_ip *) (data + l3);
+		const click_ip *fip = (const click_ip *) (fdata + l3);
+		if (ip->ip_tos != fip->ip_tos || ip->ip_ttl != fip->ip_ttl || (ip->ip_off ^ fip->ip_off) & htons(IP_DF)) {
+			return false;
+		}
+	} else if (memcmp(data + l3, fdata + l3, 4) != 0 || data[l3 + 7] != fdata[l3 + 7]) {
+		// traffic class, flow label and hop limit
+		return false;
+	}
+
+	if (tcp_cksum(data + l3, data + l4, p->length() - l4) != 0) {
+		return false;
+	}
+
+	if (f->_nb_segs == 1) {
+		// room for the whole super-frame
+		WritablePacket *q = Packet::make(f->_p->headroom(), f->_p->data(), f->_p->length(), _max_length - f->_p->length());
+		if (!q) {
+			return false;
+		}
+		q->copy_annotations(f->_p);
+		f->_p->kill();
+		f->_p = q;
+	}
+
+	WritablePacket *q = f->_p->put(payload);
+	memcpy(q->end_data() - payload, data + hlen, payload);
+	f->_p = q;
+
+	// the latest window and PSH win
+	click_tcp *qth = (click_tcp *) (q->data() + l4);
+	qth->th_win = th->th_win;
+	qth->th_flags |= th->th_flags & TH_PUSH;
+
+	f->_next_seq += payload;
+	f->_nb_segs++;
+	_merged++;
+
+	p->kill();
+	return true;
+
+}
+
+void EmpowerGRO::flush(GROFlow *f) {
+
+	WritablePacket *p = f->_p;
+
+	if (f->_nb_segs > 1) {
+		unsigned char *data = p->data();
+		if ((data[f->_l3] >> 4) == 4) {
+			click_ip *ip = (click_ip *) (data + f->_l3);
+			ip->ip_len = htons(p->length() - f->_l3);
+			ip->ip_sum = 0;
+			ip->ip_sum = click_in_cksum((const unsigned char *) ip, sizeof(click_ip));
+		} else {
+			click_ip6 *ip6 = (click_ip6 *) (data + f->_l3);
+			ip6->ip6_plen = htons(p->length() - f->_l4);
+		}
+		SET_GSO_SIZE_ANNO(p, f->_mss);
+		_flushed++;
+	}
+
+	// the flows stay in the order they started, oldest first
+	_nb_flows--;
+	memmove(f, f + 1, (char *) (_flows + _nb_flows) - (char *) f);
+	output(0).push(p);
+
+}
+
+void EmpowerGRO::push(int, Packet *p) {
+
+	int l3, l4;
+	int hlen = parse(p, l3, l4);
+
+	if (hlen < 0) {
+		output(0).push(p);
+		return;
+	}
+
+	GROFlow *f = lookup(p, l3, l4);
+	const click_tcp *th = (const click_tcp *) (p->data() + l4);
+	uint32_t payload = p->length() - hlen;
+
+	if (f) {
+		uint32_t mss = f->_mss;
+		if (merge(f, p, l3, l4, hlen)) {
+			// a short segment or PSH ends the super-frame
+			const click_tcp *fth = (const click_tcp *) (f->_p->data() + l4);
+			if (payload < mss || (fth->th_flags & TH_PUSH)) {
+				flush(f);
+			}
+			return;
+		}
+		flush(f);
+	}
+
+	if (!payload || th->th_flags != TH_ACK
+			|| tcp_cksum(p->data() + l3, p->data() + l4, p->length() - l4) != 0) {
+		output(0).push(p);
+		return;
+	}
+
+	WritablePacket *q = p->uniqueify();
+	if (!q) {
+		return;
+	}
+
+	if (_nb_flows == _max_flows) {
+		flush(&_flows[0]);
+	}
+
+	f = &_flows[_nb_flows++];
+	f->_p = q;
+	f->_l3 = l3;
+	f->_l4 = l4;
+	f->_hlen = hlen;
+	f->_next_seq = ntohl(th->th_seq) + payload;
+	f->_mss = payload;
+	f->_nb_segs = 1;
+
+	// the super-frames go at the end of this round
+	if (!_task.scheduled()) {
+		_task.reschedule();
+	}
+
+}
+
+bool EmpowerGRO::run_task(Task *) {
+	bool worked = _nb_flows > 0;
+	while (_nb_flows > 0) {
+		flush(&_flows[0]);
+	}
+	return worked;
+}
+
+enum {
+	H_MERGED,
+	H_FLUSHED
+};
+
+String EmpowerGRO::read_handler(Element *e, void *thunk) {
+	EmpowerGRO *g = (EmpowerGRO *) e;
+	switch ((uintptr_t) thunk) {
+	case H_MERGED:
+		return String(g->_merged) + "\n";
+	case H_FLUSHED:
+		return String(g->_flushed) + "\n";
+	default:
+		return "<error>\n";
+	}
+}
+
+void EmpowerGRO::add_handlers() {
+	add_read_handler("merged", read_handler, (void *) H_MERGED);
+	add_read_handler("flushed", read_handler, (void *) H_FLUSHED);
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerGRO)
@@ -0,0 +1,114 @@
+#ifndef CLICK_EMPOWERGRO_HH
+#define CLICK_EMPOWERGRO_HH
+#include <click/element.hh>
+#include <click/task.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerGRO([, I<KEYWORDS>])
+
+=s EmPOWER
+
+Coalesces consecutive TCP segments of a flow into super-frames
+
+=d
+
+Merges the in-order TCP segments of a flow that arrive within one
+scheduling round into a single Ethernet super-frame, the way the Linux
+GRO does. Super-frames carry their segment size in the GSO size
+annotation, and their TCP checksum is left to the receiver: connect
+EmpowerGRO to a KernelTap with VNET_HDR true, which hands them to the
+kernel in one write with a virtio-net header.
+
+Only TCP over IPv4 without IP options, or over IPv6 without extension
+headers, is merged. A segment joins the super-frame of its flow if it
+is the next in sequence, acknowledges the same data, carries the same
+TCP options and no flag but ACK or PSH, and its checksum is right. A
+segment shorter than the first of the super-frame, or with PSH set, ends
+it. Anything else goes out unchanged, after the super-frame of its flow
+if any, so that the order of every flow is kept.
+
+Keyword arguments are:
+
+=over 8
+
+=item FLOWS
+
+Number of flows merged at once. When a segment of yet another flow comes
+in, the oldest super-frame is sent. Default is 8.
+
+=item MAX_LENGTH
+
+Maximum length of a super-frame, Ethernet header included. Default is
+65535.
+
+=back 8
+
+=h merged read-only
+Number of segments merged into a super-frame.
+
+=h flushed read-only
+Number of super-frames sent.
+
+=a KernelTap, EmpowerQOSManager
+*/
+
+class EmpowerGRO : public Element {
+
+public:
+
+	EmpowerGRO() CLICK_COLD;
+	~EmpowerGRO() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerGRO"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	void push(int, Packet *);
+	bool run_task(Task *);
+
+private:
+
+	enum { MAX_FLOWS = 64 };
+
+	// a super-frame being built. Everything up to _hlen is the headers
+	// of its first segment
+	struct GROFlow {
+		WritablePacket *_p;
+		int _l3;
+		int _l4;
+		int _hlen;
+		uint32_t _next_seq;
+		uint32_t _mss;
+		uint32_t _nb_segs;
+	};
+
+	// oldest first
+	GROFlow _flows[MAX_FLOWS];
+	int _nb_flows;
+	int _max_flows;
+	uint32_t _max_length;
+	Task _task;
+
+	uint32_t _merged;
+	uint32_t _flushed;
+
+	int parse(const Packet *, int &, int &) const;
+	static uint16_t tcp_cksum(const unsigned char *, const unsigned char *, int);
+	GROFlow *lookup(const Packet *, int, int);
+	bool merge(GROFlow *, Packet *, int, int, int);
+	void flush(GROFlow *);
+
+	static String read_handler(Element *, void *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,181 @@
+#ifndef CLICK_EMPOWERGSO_HH
+#define CLICK_EMPOWERGSO_HH
+#include <click/config.h>
+#include <click/packet.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include <clicknet/tcp.h>
+CLICK_DECLS
+
+// Late TCP segmentation of the Ethernet super-frames KernelTap emits when
+// started with GSO true and SEGMENT false. Their segment size travels in
+// the GSO size annotation, which is zero for every other frame.
+//
+// Keeping super-frames whole makes each one a single push through the
+// data path; they are cut into wire frames only when a queue hands them
+// out. The first segment is the super-frame itself, trimmed, the others
+// are fresh packets holding a copy of the headers and of their share of
+// the payload. Lengths, sequence numbers, IP IDs and checksums are fixed
+// like the kernel's own TCP segmentation does.
+class EmpowerGSO {
+public:
+
+	// Cuts p and returns its first segment. The other ones are chained
+	// through Packet::next() in rest, nb_rest tells how many. Frames that
+	// are not super-frames, or that cannot be parsed, come back untouched.
+	static Packet *segment(Packet *p, Packet *&rest, uint32_t &nb_rest) {
+
+		rest = 0;
+		nb_rest = 0;
+
+		uint32_t mss = GSO_SIZE_ANNO(p);
+		if (!mss) {
+			return p;
+		}
+
+		int hlen = headers_length(p);
+		int len = p->length();
+		if (hlen < 0 || len <= hlen + (int) mss) {
+			SET_GSO_SIZE_ANNO(p, 0);
+			return payload_fixup(p, hlen, 0, 0, len - hlen, true);
+		}
+
+		WritablePacket *q = p->uniqueify();
+		if (!q) {
+			return 0;
+		}
+
+		Packet *tail = 0;
+		uint32_t index = 1;
+		for (int off = hlen + mss; off < len; off += mss, index++) {
+			int seglen = (len - off < (int) mss) ? len - off : mss;
+			WritablePacket *s = Packet::make(Packet::default_headroom, 0, hlen + seglen, 0);
+			if (!s) {
+				break;
+			}
+			memcpy(s->data(), q->data(), hlen);
+			memcpy(s->data() + hlen, q->data() + off, seglen);
+			s->copy_annotations(q);
+			SET_GSO_SIZE_ANNO(s, 0);
+			payload_fixup(s, hlen, off - hlen, index, seglen, off + seglen >= len);
+			if (tail) {
+				tail->set_next(s);
+			} else {
+				rest = s;
+			}
+			tail = s;
+			nb_rest++;
+		}
+
+		q->take(len - hlen - mss);
+		SET_GSO_SIZE_ANNO(q, 0);
+		return payload_fixup(q, hlen, 0, 0, mss, !rest);
+
+	}
+
+private:
+
+	static int network_offset(const Packet *p) {
+		const click_ether *eh = (const click_ether *) p->data();
+		if (p->length() < sizeof(click_ether) + 4) {
+			return -1;
+		}
+		return eh->ether_type == htons(ETHERTYPE_8021Q) ? sizeof(click_ether) + 4 : sizeof(click_ether);
+	}
+
+	// Ethernet, IP and TCP headers, or -1 if p is not TCP over IPv4 or
+	// over IPv6 without extension headers
+	static int headers_length(const Packet *p) {
+		int l3 = network_offset(p);
+		if (l3 < 0) {
+			return -1;
+		}
+		const unsigned char *data = p->data();
+		int len = p->length();
+		int l4;
+		if ((data[l3] >> 4) == 4 && len >= l3 + (int) sizeof(click_ip)) {
+			const click_ip *ip = (const click_ip *) (data + l3);
+			if (ip->ip_p != IP_PROTO_TCP) {
+				return -1;
+			}
+			l4 = l3 + (ip->ip_hl << 2);
+		} else if ((data[l3] >> 4) == 6 && len >= l3 + (int) sizeof(click_ip6)) {
+			if (((const click_ip6 *) (data + l3))->ip6_nxt != IP_PROTO_TCP) {
+				return -1;
+			}
+			l4 = l3 + sizeof(click_ip6);
+		} else {
+			return -1;
+		}
+		if (len < l4 + (int) sizeof(click_tcp)) {
+			return -1;
+		}
+		int hlen = l4 + (((const click_tcp *) (data + l4))->th_off << 2);
+		return hlen <= len ? hlen : -1;
+	}
+
+	// Fixes the headers of segment index, carrying seglen bytes found
+	// offset bytes into the payload of the super-frame
+	static Packet *payload_fixup(Packet *p, int hlen, uint32_t offset, uint32_t index, int seglen, bool last) {
+
+		if (hlen < 0) {
+			return p;
+		}
+
+		WritablePacket *q = p->uniqueify();
+		if (!q) {
+			return 0;
+		}
+
+		unsigned char *data = q->data();
+		int l3 = network_offset(q);
+		int l4;
+		if ((data[l3] >> 4) == 4) {
+			click_ip *ip = (click_ip *) (data + l3);
+			l4 = l3 + (ip->ip_hl << 2);
+			ip->ip_len = htons(hlen - l3 + seglen);
+			ip->ip_id = htons(ntohs(ip->ip_id) + index);
+			ip->ip_sum = 0;
+			ip->ip_sum = click_in_cksum((const unsigned char *) ip, ip->ip_hl << 2);
+		} else {
+			click_ip6 *ip6 = (click_ip6 *) (data + l3);
+			l4 = l3 + sizeof(click_ip6);
+			ip6->ip6_plen = htons(hlen - l4 + seglen);
+		}
+
+		click_tcp *tcp = (click_tcp *) (data + l4);
+		tcp->th_seq = htonl(ntohl(tcp->th_seq) + offset);
+		if (!last) {
+			tcp->th_flags &= ~(TH_FIN | TH_PUSH);
+		}
+		if (index) {
+			tcp->th_flags &= ~TH_CWR;
+		}
+		tcp->th_sum = 0;
+		tcp->th_sum = l4_cksum(data + l3, data + l4, hlen - l4 + seglen);
+
+		return q;
+
+	}
+
+	static uint16_t l4_cksum(const unsigned char *l3, const unsigned char *l4, int len) {
+		uint32_t csum = click_in_cksum(l4, len);
+		if ((l3[0] >> 4) == 4) {
+			return click_in_cksum_pseudohdr(csum, (const click_ip *) l3, len);
+		}
+		const uint16_t *a = (const uint16_t *) &((const click_ip6 *) l3)->ip6_src;
+		csum = ~csum & 0xFFFF;
+		for (int i = 0; i < 16; i++) {
+			csum += a[i];
+		}
+		csum += htons(len) + htons(IP_PROTO_TCP);
+		csum = (csum & 0xFFFF) + (csum >> 16);
+		return ~(csum + (csum >> 16)) & 0xFFFF;
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -22,6 +22,8 @@
 #include <click/ipaddress.hh>
 #include <clicknet/wifi.h>
 #include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include <clicknet/icmp6.h>
 #include <clicknet/ether.h>
 #include "empowerpacket.hh"
 #include "empowerlvapmanager.hh"
@@ -49,17 +51,42 @@ int EmpowerIgmpMembership::configure(Vector<String> &conf,
 
 }
 
-void EmpowerIgmpMembership::push(int, Packet *p)
-{
+// ICMPv6 checksum, 0 if the message of len bytes at icmp is intact
+static uint16_t mld_checksum(const click_ip6 *ip6, const uint8_t *icmp, uint32_t len) {
+	uint32_t sum = 0;
+	// source and destination addresses are contiguous
+	const uint16_t *words = (const uint16_t *) &ip6->ip6_src;
+	for (int i = 0; i < 16; i++) {
+		sum += words[i];
+	}
+	sum += htons(len >> 16) + htons(len & 0xffff) + htons(IP_PROTO_ICMP6);
+	sum += (uint16_t) ~click_in_cksum(icmp, len);
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum & 0xffff;
+}
 
-	const click_ip *ip = p->ip_header();
+// Whether an IGMPv3 or MLDv2 record of the given type with nsrc sources
+// makes the station a receiver of the group (1), not a receiver (0), or
+// leaves it as it is (-1). Source filters are not kept: a station that
+// wants some sources of a group receives all of it.
+static int record_receives(uint8_t type, uint16_t nsrc) {
+	switch (type) {
+	case 0x01: // MODE_IS_INCLUDE
+	case 0x03: // CHANGE_TO_INCLUDE_MODE
+		return nsrc ? 1 : 0;
+	case 0x02: // MODE_IS_EXCLUDE
+	case 0x04: // CHANGE_TO_EXCLUDE_MODE
+	case 0x05: // ALLOW_NEW_SOURCES
+		return 1;
+	default:   // BLOCK_OLD_SOURCES
+		return -1;
+	}
+}
 
-	void *igmpmessage = (void *) (p->data() + 14 + ip->ip_hl * 4);
-	/* IGMP messages
-	 * RFC 1112 IGMPv1: 11= query 12= join group
-	 * RFC 2236 IGMPv2: 11= query 16= join group 17= leave group
-	 * RFC 3376 IGMPv3: 11= query 22= join or leave group
-	 */
+void EmpowerIgmpMembership::push(int, Packet *p)
+{
 
 	if (p->length() < sizeof(struct click_ether)) {
 		click_chatter("%{element} :: %s :: packet too small: %d vs %d", this,
@@ -70,7 +97,6 @@ void EmpowerIgmpMembership::push(int, Packet *p)
 
 	click_ether *eh = (click_ether *) p->data();
 	EtherAddress src = EtherAddress(eh->ether_shost);
-	//EtherAddress dst = EtherAddress(eh->ether_dhost);
 	Vector<IPAddress> mcast_addresses;
 	Vector<enum empower_igmp_record_type> igmp_types;
 	EmpowerStationState *ess = _el->get_ess(src);
@@ -85,7 +111,27 @@ void EmpowerIgmpMembership::push(int, Packet *p)
 		return;
 	}
 
-	unsigned short grouprecord_counter;
+	if (ntohs(eh->ether_type) == ETHERTYPE_IP6) {
+		push_mld(src, p);
+		p->kill();
+		return;
+	}
+
+	const click_ip *ip = p->ip_header();
+
+	void *igmpmessage = (void *) (p->data() + 14 + ip->ip_hl * 4);
+	/* IGMP messages
+	 * RFC 1112 IGMPv1: 11= query 12= join group
+	 * RFC 2236 IGMPv2: 11= query 16= join group 17= leave group
+	 * RFC 3376 IGMPv3: 11= query 22= join or leave group
+	 */
+
+	if ((uint8_t *) igmpmessage + sizeof(igmpv1andv2message) > p->end_data()) {
+		click_chatter("%{element} :: %s :: IGMP message truncated", this, __func__);
+		p->kill();
+		return;
+	}
+
 	igmpv1andv2message * v1andv2message;
 	igmpv3report * v3report;
 
@@ -149,7 +195,15 @@ void EmpowerIgmpMembership::push(int, Packet *p)
 		}
 		case 0x22:
 		{
-			if (click_in_cksum((unsigned char*) igmpmessage, ((int)(ntohs(ip->ip_len) - (ip->ip_hl * 4)))) != 0)
+			int length = ntohs(ip->ip_len) - (ip->ip_hl * 4);
+			const uint8_t *end = (const uint8_t *) igmpmessage + length;
+			if (length < 8 || end > p->end_data()) {
+				click_chatter("%{element} :: %s :: IGMPv3 report truncated", this,
+						__func__);
+				p->kill();
+				return;
+			}
+			if (click_in_cksum((unsigned char*) igmpmessage, length) != 0)
 			{
 				click_chatter("%{element} :: %s :: IGMPv3 wrong checksum!", this,
 						__func__);
@@ -158,61 +212,42 @@ void EmpowerIgmpMembership::push(int, Packet *p)
 			}
 			v3report = (igmpv3report *) igmpmessage;
 
-			for (grouprecord_counter = 0; grouprecord_counter < ntohs(v3report->no_of_grouprecords); grouprecord_counter++)
+			// records are variable-length, they carry their sources and
+			// auxiliary data
+			const uint8_t *record = (const uint8_t *) v3report->grouprecords;
+			for (int i = 0; i < ntohs(v3report->no_of_grouprecords); i++)
 			{
-				switch (v3report->grouprecords[grouprecord_counter].type)
-				{
-				case 0x01:
-					click_chatter("%{element} :: %s :: IGMPv3 include mode", this,
-							__func__);
-					igmp_types.push_back(V3_MODE_IS_INCLUDE);
-					mcast_addresses.push_back(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					_mtbl->leavegroup(src, IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					break;
-
-				case 0x02:
-					click_chatter("%{element} :: %s :: IGMPv3 exclude mode", this,
-							__func__);
-					igmp_types.push_back(V3_MODE_IS_EXCLUDE);
-					mcast_addresses.push_back(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					_mtbl->addgroup(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					_mtbl->joingroup(src, IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					break;
-
-				case 0x03:
-					click_chatter(
-							"%{element} :: %s :: IGMPv3 change to include mode",
+				if (record + 8 > end) {
+					click_chatter("%{element} :: %s :: Bad group record pointer",
 							this, __func__);
-					igmp_types.push_back(V3_CHANGE_TO_INCLUDE_MODE);
-					mcast_addresses.push_back(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					_mtbl->leavegroup(src, IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
 					break;
-				case 0x04:
-					click_chatter(
-							"%{element} :: %s :: IGMPv3 change to exclude mode",
-							this, __func__);
-					igmp_types.push_back(V3_CHANGE_TO_EXCLUDE_MODE);
-					mcast_addresses.push_back(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					_mtbl->addgroup(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					_mtbl->joingroup(src, IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					break;
-				case 0x05:
-					//TODO: "ALLOW_NEW_SOURCES". Sources management
-					igmp_types.push_back(V3_ALLOW_NEW_SOURCES);
-					mcast_addresses.push_back(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					break;
-				case 0x06:
-					//TODO: "BLOCK_OLD_SOURCES". Sources management
-					igmp_types.push_back(V3_BLOCK_OLD_SOURCES);
-					mcast_addresses.push_back(IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address));
-					break;
-				default:
+				}
+				const struct grouprecord *gr = (const struct grouprecord *) record;
+				IPAddress group = IPAddress(gr->multicast_address);
+				uint16_t nsrc = ntohs(gr->no_of_sources);
+				record += 8 + 4 * nsrc + 4 * gr->aux_data_len;
+
+				if (gr->type < 0x01 || gr->type > 0x06) {
 					click_chatter(
-							"%{element} :: %s :: Unknown type in IGMP grouprecord or bad group record pointer",
+							"%{element} :: %s :: Unknown type in IGMP grouprecord",
 							this, __func__);
 					p->kill();
 					return;
 				}
+
+				// V3_MODE_IS_INCLUDE is 0, the record types start at 1
+				igmp_types.push_back((enum empower_igmp_record_type) (gr->type - 1));
+				mcast_addresses.push_back(group);
+
+				switch (record_receives(gr->type, nsrc)) {
+				case 1:
+					_mtbl->addgroup(group);
+					_mtbl->joingroup(src, group);
+					break;
+				case 0:
+					_mtbl->leavegroup(src, group);
+					break;
+				}
 			}
 			break;
 		}
@@ -243,6 +278,79 @@ void EmpowerIgmpMembership::push(int, Packet *p)
 	return;
 }
 
+// MLD reports (RFC 2710, RFC 3810). They are not reported to the
+// controller, whose messages only carry IPv4 groups.
+void EmpowerIgmpMembership::push_mld(EtherAddress src, Packet *p)
+{
+
+	const uint8_t *ip = p->data() + sizeof(struct click_ether);
+	const click_ip6 *ip6 = (const click_ip6 *) ip;
+
+	if (ip + sizeof(click_ip6) > p->end_data()) {
+		return;
+	}
+
+	const uint8_t *end = ip + sizeof(click_ip6) + ntohs(ip6->ip6_plen);
+	if (end > p->end_data()) {
+		end = p->end_data();
+	}
+
+	// MLD messages come behind a hop-by-hop header with a router alert
+	uint8_t nxt = ip6->ip6_nxt;
+	const uint8_t *icmp = ip + sizeof(click_ip6);
+	if (nxt == 0 && icmp + 2 <= end) {
+		nxt = icmp[0];
+		icmp += (icmp[1] + 1) * 8;
+	}
+
+	if (nxt != IP_PROTO_ICMP6 || icmp + 8 > end) {
+		return;
+	}
+
+	if (mld_checksum(ip6, icmp, end - icmp) != 0) {
+		click_chatter("%{element} :: %s :: MLD wrong checksum!", this, __func__);
+		return;
+	}
+
+	switch (icmp[0]) {
+	case ICMP6_MEMBERSHIPREPORT:
+		if (icmp + 24 <= end) {
+			_mtbl->joingroup6(src, EmpowerMulticastTable::ip6_mcast_addr_to_mac(icmp + 8));
+		}
+		break;
+	case ICMP6_MEMBERSHIPREDUCTION:
+		if (icmp + 24 <= end) {
+			_mtbl->leavegroup6(src, EmpowerMulticastTable::ip6_mcast_addr_to_mac(icmp + 8));
+		}
+		break;
+	case MLD2_REPORT: {
+		const uint8_t *record = icmp + 8;
+		for (int i = 0; i < ((icmp[6] << 8) | icmp[7]); i++) {
+			if (record + 20 > end) {
+				click_chatter("%{element} :: %s :: Bad MLD record pointer",
+						this, __func__);
+				break;
+			}
+			uint16_t nsrc = (record[2] << 8) | record[3];
+			EtherAddress group = EmpowerMulticastTable::ip6_mcast_addr_to_mac(record + 4);
+			switch (record_receives(record[0], nsrc)) {
+			case 1:
+				_mtbl->joingroup6(src, group);
+				break;
+			case 0:
+				_mtbl->leavegroup6(src, group);
+				break;
+			}
+			record += 20 + 16 * nsrc + 4 * record[1];
+		}
+		break;
+	}
+	default:
+		// queries from other routers
+		break;
+	}
+
+}
 
 enum {
 	H_DEBUG
@@ -9,30 +9,36 @@ CLICK_DECLS
 /*
 =c
 
-EmpowerIgmpMembership(RL, EL, [, I<KEYWORDS>])
+EmpowerIgmpMembership(EL, MTBL[, I<KEYWORDS>])
 
 =s EmPOWER
 
-Handle IGMP packets
+Handle IGMP and MLD packets
 
 =d
 
+Takes the IGMP and MLD messages sent by the stations, as Ethernet frames,
+and keeps the receivers of each multicast group in an
+EmpowerMulticastTable. IGMP reports are also forwarded to the controller.
+Records of IGMPv3 and MLDv2 reports that name sources join the whole
+group: source filters are not kept.
+
 Keyword arguments are:
 
 =over 8
 
-=item RT
-An AvailableRates element
-
 =item EL
 An EmpowerLVAPManager element
 
+=item MTBL
+An EmpowerMulticastTable element
+
 =item DEBUG
 Turn debug on/off
 
 =back 8
 
-=a EmpowerLVAPManager
+=a EmpowerLVAPManager, EmpowerMulticastTable
 */
 
 
@@ -52,11 +58,15 @@ public:
 
 private:
 
+	enum { MLD2_REPORT = 143 };
+
 	class EmpowerLVAPManager *_el;
 	class EmpowerMulticastTable * _mtbl;
 
 	bool _debug;
 
+	void push_mld(EtherAddress, Packet *);
+
 	// Read/Write handlers
 	static String read_handler(Element *e, void *user_data);
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
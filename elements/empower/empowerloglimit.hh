@@ -0,0 +1,114 @@
+#ifndef CLICK_EMPOWERLOGLIMIT_HH
+#define CLICK_EMPOWERLOGLIMIT_HH
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include <click/tokenbucket.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+// Rate limits for the messages an element logs on its packet paths, e.g.
+// a frame from an unknown station. Every call site gets a token bucket,
+// RATE messages per second with bursts of BURST, and counts the messages
+// it was asked for. Past the limit a message is not formatted at all: it
+// is only counted, and the next message let through from the same call
+// site reports how many were suppressed.
+//
+// Call sites are indexed by an enum of the element, their names given to
+// the constructor in the same order:
+//
+//   static const char *log_sites[] = { "too_small", "not_authenticated" };
+//   EmpowerLogLimit _log(log_sites, 2);
+//   ...
+//   empower_chatter_limited(_log, LOG_TOO_SMALL,
+//       "%{element} :: %s :: packet too small: %d", this, __func__, p->length());
+//
+// Buckets and counters are not atomic: callers of the same site on
+// several threads may let through, or count, a message more or less,
+// which is fine for diagnostics.
+class EmpowerLogLimit {
+public:
+
+	enum { DEFAULT_RATE = 10, DEFAULT_BURST = 10 };
+
+	EmpowerLogLimit(const char * const *names, int nb_sites,
+			unsigned rate = DEFAULT_RATE, unsigned burst = DEFAULT_BURST) :
+			_names(names), _sites(nb_sites, Site()) {
+		set_rate(rate, burst);
+	}
+
+	void set_rate(unsigned rate, unsigned burst) {
+		for (int i = 0; i < _sites.size(); i++) {
+			_sites[i]._bucket.assign(rate, burst ? burst : 1);
+			_sites[i]._bucket.set_full();
+		}
+	}
+
+	// True if the message of site may be logged, after taking a token
+	inline bool allow(int site) {
+		Site &s = _sites[site];
+		s._count++;
+		s._bucket.refill();
+		if (s._bucket.remove_if(1)) {
+			return true;
+		}
+		s._suppressed++;
+		s._pending++;
+		return false;
+	}
+
+	// Messages of site suppressed since the last one logged
+	inline uint32_t take_pending(int site) {
+		uint32_t pending = _sites[site]._pending;
+		_sites[site]._pending = 0;
+		return pending;
+	}
+
+	// One line per call site: name, messages, messages suppressed
+	String unparse() const {
+		StringAccum sa;
+		for (int i = 0; i < _sites.size(); i++) {
+			sa << _names[i] << " " << _sites[i]._count << " " << _sites[i]._suppressed << "\n";
+		}
+		return sa.take_string();
+	}
+
+	void reset() {
+		for (int i = 0; i < _sites.size(); i++) {
+			_sites[i]._count = 0;
+			_sites[i]._suppressed = 0;
+			_sites[i]._pending = 0;
+		}
+	}
+
+private:
+
+	struct Site {
+		TokenBucket _bucket;
+		uint32_t _count;
+		uint32_t _suppressed;
+		uint32_t _pending;
+		Site() : _count(0), _suppressed(0), _pending(0) {
+		}
+	};
+
+	const char * const *_names;
+	Vector<Site> _sites;
+
+};
+
+// click_chatter() for the call site site of limit, skipped altogether,
+// arguments included, once over the rate limit
+#define empower_chatter_limited(limit, site, fmt, ...) do {						\
+		if ((limit).allow(site)) {													\
+			uint32_t empower_pending = (limit).take_pending(site);					\
+			if (empower_pending) {													\
+				click_chatter(fmt " (%u suppressed)", __VA_ARGS__, empower_pending);	\
+			} else {																\
+				click_chatter(fmt, __VA_ARGS__);									\
+			}																		\
+		}																			\
+	} while (0)
+
+CLICK_ENDDECLS
+#endif /* CLICK_EMPOWERLOGLIMIT_HH */
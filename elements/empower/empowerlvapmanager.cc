@@ -25,6 +25,7 @@
 #include <elements/standard/counter.hh>
 #include <elements/wifi/minstrel.hh>
 #include <elements/wifi/transmissionpolicy.hh>
+#include <elements/json/jsonwriter.hh>
 #include "empowerpacket.hh"
 #include "empowerbeaconsource.hh"
 #include "empoweropenauthresponder.hh"
@@ -34,26 +35,378 @@
 #include "empowerrxstats.hh"
 #include "empowerqosmanager.hh"
 #include "empowerregmon.hh"
+#include "empowerpowersavebuffer.hh"
+#include "empowermessage.hh"
+#include "empowercodec.hh"
+#include "empowerstatefile.hh"
+#include "stats_stream.hh"
+#if CLICK_USERLEVEL
+# include <elements/userlevel/fromdevice.hh>
+# include "empowermirror.hh"
+#endif
 CLICK_DECLS
 
 EmpowerLVAPManager::EmpowerLVAPManager() :
 		_e11k(0), _ebs(0), _eauthr(0), _eassor(0), _edeauthr(0), _ers(0),
-		_mtbl(0), _timer(this), _seq(0), _period(5000), _debug(false) {
+		_mtbl(0), _snapshot(0), _snapshot_generation(0), _mask_timer(this), _mask_period(100),
+		_rx_tail(0), _egress(0), _egress_timer(this), _egress_size(4096), _egress_delay(500), _bulk_status(true), _response_ttl(250), _response_hits(0), _response_misses(0), _mirror(0), _rx_sample(0), _timer(this), _seq(0),
+		_state_slots(1024), _state_file(0), _restoring(false), _sync_pending(false), _sync_version(0), _controller_caps(0), _export_queues(false), _period(5000), _debug(false) {
+	memset(_dispatch, 0, sizeof(_dispatch));
+	_unknown_messages = 0;
+	_queue_usecs = 0;
+	_rtt.clear();
+	_snapshot_lock.set_name(this, "snapshot");
+	_egress_lock.set_name(this, "egress");
+	_rx_filters_lock.set_name(this, "rx_filters");
+	_timeline_lock.set_name(this, "timeline");
+	for (int i = 0; i <= LVAPTimeline::NB_PHASES; i++) {
+		_timeline_histograms[i].clear();
+	}
+	_timelines_completed = 0;
+	_timelines_expired = 0;
+	_timeline_report = false;
+	register_handlers();
 }
 
 EmpowerLVAPManager::~EmpowerLVAPManager() {
+	clear_stats_streams();
+	if (_rx_tail) {
+		_rx_tail->kill();
+	}
+	if (_egress) {
+		_egress->kill();
+	}
+	clear_responses();
+	delete _snapshot;
+	for (int i = 0; i < _retired.size(); i++) {
+		delete _retired[i];
+	}
+	delete _state_file;
+	for (HashTable<EtherAddress, Packet *>::iterator it = _pending_imports.begin(); it.live(); it++) {
+		kill_pending_imports(it.value());
+	}
 }
 
-int EmpowerLVAPManager::initialize(ErrorHandler *) {
+int EmpowerLVAPManager::initialize(ErrorHandler *errh) {
+	// the data path reads the transmission policies under our guard
+	for (int i = 0; i < _rcs.size(); i++) {
+		_rcs[i]->tx_policies()->set_epoch(&_epoch);
+	}
+	update_iface_lists();
 	_timer.initialize(this);
 	_timer.schedule_now();
-	compute_bssid_mask();
+	_mask_timer.initialize(this);
+	_egress_timer.initialize(this);
+	_streams_wheel.initialize(this);
+	if (_state_filename) {
+		_state_file = new EmpowerStateFile;
+		if (_state_file->open(_state_filename, _state_slots, errh) < 0) {
+			return -1;
+		}
+		restore_state();
+	}
+	// no need to wait for the mask timer, restored stations must be
+	// acked right away
+	write_bssid_masks();
 	return 0;
 }
 
-void EmpowerLVAPManager::run_timer(Timer *) {
+void EmpowerLVAPManager::restore_state() {
+
+	// rules come first, so that LVAPs and VAPs find the quantum of their
+	// default rule, ports last, so that they apply to restored LVAPs
+	static const char order[] = { 'R', 'V', 'L', 'P' };
+
+	int restored = 0;
+
+	_restoring = true;
+
+	for (unsigned i = 0; i < sizeof(order); i++) {
+		Vector<String> records;
+		_state_file->records(order[i], records);
+		for (int j = 0; j < records.size(); j++) {
+			Packet *p = Packet::make(records[j].data(), records[j].length());
+			if (!p) {
+				continue;
+			}
+			if (p->length() >= sizeof(struct empower_header)
+					&& ((struct empower_header *) p->data())->length() == p->length()) {
+				dispatch_message(p, 0);
+				restored++;
+			}
+			p->kill();
+		}
+	}
+
+	_restoring = false;
+
+	// forget the records that could not be restored
+	save_iface_lists();
+
+	_sync_version = _state_file->version();
+	_sync_pending = restored > 0;
+
+	click_chatter("%{element} :: %s :: restored %d LVAPs, %d VAPs (version %u)",
+			      this,
+			      __func__,
+			      _lvaps.size(),
+			      _vaps.size(),
+			      _sync_version);
+
+}
+
+void EmpowerLVAPManager::save_iface_lists() {
+
+	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+		EmpowerStationState *ess = &it.value();
+		// the LVAP ssid followed by the list of its ssids
+		uint32_t extra = ess->_ssid.length() + 1;
+		for (int i = 0; i < ess->_ssids.size(); i++) {
+			extra += ess->_ssids[i].length() + 1;
+		}
+		EmpowerMessage msg;
+		empower_add_lvap *add = msg.start<empower_add_lvap>(EMPOWER_PT_ADD_LVAP, 0, extra);
+		if (!add) {
+			continue;
+		}
+		if (ess->_authentication_status) {
+			add->set_flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
+		}
+		if (ess->_association_status) {
+			add->set_flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
+		}
+		if (ess->_set_mask) {
+			add->set_flag(EMPOWER_STATUS_LVAP_SET_MASK);
+		}
+		if (ess->_preauthorized) {
+			add->set_flag(EMPOWER_STATUS_LVAP_PREAUTHORIZED);
+		}
+		if (ess->_staged) {
+			add->set_flag(EMPOWER_STATUS_LVAP_STAGED);
+		}
+		add->set_assoc_id(ess->_assoc_id);
+		add->set_hwaddr(ess->_hwaddr);
+		add->set_channel(ess->_channel);
+		add->set_band(ess->_band);
+		add->set_supported_band(ess->_supported_band);
+		add->set_sta(ess->_sta);
+		add->set_encap(ess->_encap);
+		add->set_net_bssid(ess->_net_bssid);
+		add->set_lvap_bssid(ess->_lvap_bssid);
+		uint8_t *ptr = (uint8_t *) (add + 1);
+		for (int i = -1; i < ess->_ssids.size(); i++) {
+			const String &ssid = i < 0 ? ess->_ssid : ess->_ssids[i];
+			ssid_entry *entry = (ssid_entry *) ptr;
+			entry->set_length(ssid.length());
+			entry->set_ssid(ssid);
+			ptr += ssid.length() + 1;
+		}
+		Packet *p = msg.finish();
+		if (!_state_file->put("L" + ess->_sta.unparse(), p->data(), p->length()) && _debug) {
+			click_chatter("%{element} :: %s :: cannot save lvap %s",
+					      this,
+					      __func__,
+					      ess->_sta.unparse().c_str());
+		}
+		p->kill();
+	}
+
+	for (VAPIter it = _vaps.begin(); it.live(); it++) {
+		EmpowerVAPState *evs = &it.value();
+		EmpowerMessage msg;
+		empower_add_vap *add = msg.start<empower_add_vap>(EMPOWER_PT_ADD_VAP, 0, evs->_ssid.length());
+		if (!add) {
+			continue;
+		}
+		add->set_hwaddr(evs->_hwaddr);
+		add->set_channel(evs->_channel);
+		add->set_band(evs->_band);
+		add->set_net_bssid(evs->_net_bssid);
+		add->set_ssid(evs->_ssid);
+		Packet *p = msg.finish();
+		if (!_state_file->put("V" + evs->_net_bssid.unparse(), p->data(), p->length()) && _debug) {
+			click_chatter("%{element} :: %s :: cannot save vap %s",
+					      this,
+					      __func__,
+					      evs->_net_bssid.unparse().c_str());
+		}
+		p->kill();
+	}
+
+	Vector<String> keys;
+	_state_file->keys('L', keys);
+	_state_file->keys('V', keys);
+
+	for (int i = 0; i < keys.size(); i++) {
+		EtherAddress addr;
+		EtherAddressArg().parse(keys[i].substring(1), addr);
+		if (keys[i][0] == 'L' ? !_lvaps.get_pointer(addr) : !_vaps.get_pointer(addr)) {
+			_state_file->remove(keys[i]);
+		}
+	}
+
+}
+
+void EmpowerLVAPManager::drop_restored_state() {
+
+	Vector<EtherAddress> stas;
+	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+		stas.push_back(it.key());
+	}
+	remove_lvaps(stas);
+
+	Vector<EtherAddress> bssids;
+	for (VAPIter it = _vaps.begin(); it.live(); it++) {
+		bssids.push_back(it.key());
+	}
+	for (int i = 0; i < bssids.size(); i++) {
+		_vaps.erase(_vaps.find(bssids[i]));
+		forget_bssid_mask(_mask_vaps, bssids[i]);
+	}
+	update_iface_lists();
+
+	Vector<String> records;
+	_state_file->records('P', records);
+	for (int i = 0; i < records.size(); i++) {
+		struct empower_set_port *q = (struct empower_set_port *) records[i].data();
+		int iface = element_to_iface(q->hwaddr(), q->channel(), (empower_bands_types) q->band());
+		if (iface >= 0) {
+			_rcs[iface]->tx_policies()->remove(q->addr());
+			_rcs[iface]->forget_station(q->addr());
+		}
+	}
+
+	records.clear();
+	_state_file->records('R', records);
+	for (int i = 0; i < records.size(); i++) {
+		struct empower_set_traffic_rule *q = (struct empower_set_traffic_rule *) records[i].data();
+		int iface = element_to_iface(q->hwaddr(), q->channel(), (empower_bands_types) q->band());
+		if (iface >= 0) {
+			_eqms[iface]->del_traffic_rule(q->ssid(), q->dscp());
+		}
+	}
+
+	Vector<String> keys;
+	_state_file->keys('P', keys);
+	_state_file->keys('R', keys);
+	for (int i = 0; i < keys.size(); i++) {
+		_state_file->remove(keys[i]);
+	}
+
+}
+
+void EmpowerLVAPManager::take_state(Element *e, ErrorHandler *errh) {
+
+	EmpowerLVAPManager *el = (EmpowerLVAPManager *) e->cast("EmpowerLVAPManager");
+
+	if (!el) {
+		return;
+	}
+
+	// the ports are normally written once by the setup script
+	if (_ports.size() == 0) {
+		_ports = el->_ports;
+	}
+
+	_seq = el->_seq;
+
+	// the old router was talking to the controller until now, whatever
+	// was restored from the state file is superseded by its state
+	_sync_pending = false;
+
+	int dropped = 0;
+
+	for (VAPIter it = el->_vaps.begin(); it.live(); it++) {
+		EmpowerVAPState state = it.value();
+		state._iface_id = translate_iface(el, state._iface_id);
+		if (state._iface_id < 0) {
+			dropped++;
+			continue;
+		}
+		state._slice_id = -1;
+		state._ssid_id = _ssid_table.intern(state._ssid);
+		if (state._ssid != "") {
+			_eqms[state._iface_id]->set_traffic_rule(state._ssid, 0, 12000, false, false);
+			state._slice_id = _eqms[state._iface_id]->slice_id(state._ssid);
+		}
+		_vaps.set(state._net_bssid, state);
+		update_bssid_mask(_vaps.get_pointer(state._net_bssid));
+	}
+
+	for (LVAPIter it = el->_lvaps.begin(); it.live(); it++) {
+		EmpowerStationState state = it.value();
+		state._iface_id = translate_iface(el, state._iface_id);
+		if (state._iface_id < 0) {
+			dropped++;
+			continue;
+		}
+		// slice ids are local to each EmpowerQOSManager, and the rule may
+		// not have been carried over yet
+		state._slice_id = -1;
+		// SSID IDs are local to each agent too
+		intern_ssids(&state);
+		// timelines are not carried over
+		state._timeline = 0;
+		if (state._ssid != "") {
+			_eqms[state._iface_id]->set_traffic_rule(state._ssid, 0, 12000, false, false);
+			state._slice_id = _eqms[state._iface_id]->slice_id(state._ssid);
+		}
+		_lvaps.set(state._sta, state);
+		update_bssid_mask(_lvaps.get_pointer(state._sta));
+	}
+
+	if (dropped) {
+		errh->warning("%d LVAPs and VAPs dropped, their resource element is gone", dropped);
+	}
+
+	update_iface_lists();
+
+	// no need to wait for the mask timer, stations must be acked right away
+	write_bssid_masks();
+
+	for (SSIter it = el->_streams.begin(); it != el->_streams.end(); it++) {
+		add_stats_stream((*it)->_stream_id, (*it)->_period, (*it)->_fields);
+	}
+
+	// a partial message from the controller, and messages to it not sent yet
+	if (!_rx_tail) {
+		_rx_tail = el->_rx_tail;
+		el->_rx_tail = 0;
+	}
+
+	if (!_egress && el->_egress) {
+		_egress = el->_egress;
+		el->_egress = 0;
+		_egress_timer.schedule_now();
+	}
+
+}
+
+void EmpowerLVAPManager::run_timer(Timer *timer) {
+	if (timer == &_mask_timer) {
+		write_bssid_masks();
+		return;
+	}
+	if (timer == &_egress_timer) {
+		flush_messages();
+		return;
+	}
+	// free the snapshots retired since the last run
+	_snapshot_lock.acquire();
+	reclaim_snapshots();
+	_snapshot_lock.release();
+	// filters of the interfaces whose socket was not open yet
+	update_rx_filters();
+	// report and forget the timelines done with
+	expire_timelines();
 	// send hello packet
 	send_hello();
+	if (_state_file) {
+		_state_file->sync();
+		if (_sync_pending) {
+			send_snapshot_sync();
+		}
+	}
 	// re-schedule the timer with some jitter
 	unsigned max_jitter = _period / 10;
 	unsigned j = click_random(0, 2 * max_jitter);
@@ -80,6 +433,8 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 	String res_strings;
 	String eqms_strings;
 	String regmon_strings;
+	String epsbs_strings;
+	String rx_devs_strings;
 
 	res = Args(conf, this, errh).read_m("WTP", _wtp)
 						        .read_m("E11K", ElementCastArg("Empower11k"), _e11k)
@@ -92,16 +447,34 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 			                    .read_m("RCS", rcs_strings)
 			                    .read_m("RES", res_strings)
 								.read("REGMONS", regmon_strings)
+								.read("EPSBS", epsbs_strings)
+								.read("MIRROR", ElementCastArg("EmpowerMirror"), _mirror)
+								.read("RX_DEVS", rx_devs_strings)
+								.read("RX_SAMPLE", _rx_sample)
 			                    .read_m("ERS", ElementCastArg("EmpowerRXStats"), _ers)
 								.read("MTBL", ElementCastArg("EmpowerMulticastTable"), _mtbl)
 								.read("PERIOD", _period)
+								.read("MASK_PERIOD", _mask_period)
+								.read("EGRESS_SIZE", _egress_size)
+								.read("EGRESS_DELAY", _egress_delay)
+								.read("BULK_STATUS", _bulk_status)
+								.read("RESPONSE_TTL", _response_ttl)
+								.read("STATE_FILE", FilenameArg(), _state_filename)
+								.read("STATE_SLOTS", _state_slots)
+								.read("EXPORT_QUEUES", _export_queues)
+								.read("TIMELINE_REPORT", _timeline_report)
 			                    .read("DEBUG", _debug)
 			                    .complete();
 
+	// names of the per interface elements are looked up with a single
+	// context: an Args would copy and rescan conf for every name
+	ArgContext context(this, errh);
+
 	cp_spacevec(debugfs_strings, _debugfs_strings);
 
 	for (int i = 0; i < _debugfs_strings.size(); i++) {
 		_masks.push_back(EtherAddress::make_broadcast());
+		_mask_counters.push_back(BssidMaskCounters());
 	}
 
 	Vector<String> tokens;
@@ -109,7 +482,7 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 
 	for (int i = 0; i < tokens.size(); i++) {
 		Minstrel * rc;
-		if (!ElementCastArg("Minstrel").parse(tokens[i], rc, Args(conf, this, errh))) {
+		if (!ElementCastArg("Minstrel").parse(tokens[i], rc, context)) {
 			return errh->error("error param %s: must be a Minstrel element", tokens[i].c_str());
 		}
 		_rcs.push_back(rc);
@@ -119,6 +492,10 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 		return errh->error("rcs has %u values, while masks has %u values", _rcs.size(), _masks.size());
 	}
 
+	if (click_max_cpu_ids() > EmpowerEpoch::MAX_THREADS) {
+		return errh->error("at most %d threads are supported", EmpowerEpoch::MAX_THREADS);
+	}
+
 	tokens.clear();
 	cp_spacevec(res_strings, tokens);
 
@@ -148,7 +525,15 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 		}
 
 		ResourceElement *elm = new ResourceElement(hwaddr, channel, band);
+
+		if (_elements_to_ifaces.get_pointer(*elm)) {
+			delete elm;
+			return errh->error("error param %s: duplicate resource element", tokens[x].c_str());
+		}
+
 		_ifaces_to_elements.set(x, elm);
+		_elements_to_ifaces.set(*elm, x);
+		_iface_elements.push_back(elm);
 
 	}
 
@@ -157,7 +542,7 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 
 	for (int i = 0; i < tokens.size(); i++) {
 		EmpowerQOSManager * eqm;
-		if (!ElementCastArg("EmpowerQOSManager").parse(tokens[i], eqm, Args(conf, this, errh))) {
+		if (!ElementCastArg("EmpowerQOSManager").parse(tokens[i], eqm, context)) {
 			return errh->error("error param %s: must be an EmpowerQOSManager element", tokens[i].c_str());
 		}
 		_eqms.push_back(eqm);
@@ -171,40 +556,74 @@ int EmpowerLVAPManager::configure(Vector<String> &conf,
 	cp_spacevec(regmon_strings, tokens);
 	for (int i = 0; i < tokens.size(); i++) {
 		EmpowerRegmon *regmon;
-		if (!ElementCastArg("EmpowerRegmon").parse(tokens[i], regmon, Args(conf, this, errh))) {
+		if (!ElementCastArg("EmpowerRegmon").parse(tokens[i], regmon, context)) {
 			return errh->error("error param %s: must be a EmpowerRegmon element", tokens[i].c_str());
 		}
 		_regmons.push_back(regmon);
 	}
 
-	if (_regmons.size() != _masks.size()) {
+	if (_regmons.size() && _regmons.size() != _masks.size()) {
 		return errh->error("regmons has %u values, while masks has %u values", _regmons.size(), _masks.size());
 	}
 
+	tokens.clear();
+	cp_spacevec(epsbs_strings, tokens);
+	for (int i = 0; i < tokens.size(); i++) {
+		EmpowerPowerSaveBuffer *epsb;
+		if (!ElementCastArg("EmpowerPowerSaveBuffer").parse(tokens[i], epsb, context)) {
+			return errh->error("error param %s: must be an EmpowerPowerSaveBuffer element", tokens[i].c_str());
+		}
+		_epsbs.push_back(epsb);
+	}
+
+	if (_epsbs.size() && _epsbs.size() != _masks.size()) {
+		return errh->error("epsbs has %u values, while masks has %u values", _epsbs.size(), _masks.size());
+	}
+
+	tokens.clear();
+	cp_spacevec(rx_devs_strings, tokens);
+#if !CLICK_USERLEVEL
+	// in the kernel the frames are not copied to the agent, there is
+	// nothing to filter
+	if (tokens.size()) {
+		return errh->error("RX_DEVS is only supported at user level");
+	}
+#endif
+	for (int i = 0; i < tokens.size(); i++) {
+		FromDevice *fd;
+		if (!ElementCastArg("FromDevice").parse(tokens[i], fd, context)) {
+			return errh->error("error param %s: must be a FromDevice element", tokens[i].c_str());
+		}
+		_rx_devs.push_back(fd);
+	}
+
+	if (_rx_devs.size() && _rx_devs.size() != _masks.size()) {
+		return errh->error("rx_devs has %u values, while masks has %u values", _rx_devs.size(), _masks.size());
+	}
+
+	_rx_filters.resize(_rx_devs.size());
+	for (int i = 0; i < _rx_filters.size(); i++) {
+		_rx_filters[i].set_sample(_rx_sample);
+	}
+
 	return res;
 
 }
 
 void EmpowerLVAPManager::send_rssi_trigger(uint32_t trigger_id, uint32_t iface, uint8_t current) {
 
-	WritablePacket *p = Packet::make(sizeof(empower_rssi_trigger));
-
 	ResourceElement* re = iface_to_element(iface);
 
-	if (!p) {
+	EmpowerMessage msg;
+	empower_rssi_trigger *request = msg.start<empower_rssi_trigger>(EMPOWER_PT_RSSI_TRIGGER, get_next_seq());
+
+	if (!request) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 				      this,
 				      __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_rssi_trigger*request = (struct empower_rssi_trigger *) (p->data());
-	request->set_version(_empower_version);
-	request->set_length(sizeof(empower_rssi_trigger));
-	request->set_type(EMPOWER_PT_RSSI_TRIGGER);
-	request->set_seq(get_next_seq());
 	request->set_trigger_id(trigger_id);
 	request->set_wtp(_wtp);
 	request->set_channel(re->_channel);
@@ -212,28 +631,22 @@ void EmpowerLVAPManager::send_rssi_trigger(uint32_t trigger_id, uint32_t iface,
 	request->set_hwaddr(re->_hwaddr);
 	request->set_current(current);
 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
 void EmpowerLVAPManager::send_association_request(EtherAddress src, EtherAddress bssid, String ssid, EtherAddress hwaddr, int channel, empower_bands_types band, empower_bands_types supported_band) {
 
-	WritablePacket *p = Packet::make(sizeof(empower_assoc_request) + ssid.length());
+	EmpowerMessage msg;
+	empower_assoc_request *request = msg.start<empower_assoc_request>(EMPOWER_PT_ASSOC_REQUEST, get_next_seq(), ssid.length());
 
-	if (!p) {
+	if (!request) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 				      this,
 				      __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_assoc_request *request = (struct empower_assoc_request *) (p->data());
-	request->set_version(_empower_version);
-	request->set_length(sizeof(empower_assoc_request) + ssid.length());
-	request->set_type(EMPOWER_PT_ASSOC_REQUEST);
-	request->set_seq(get_next_seq());
 	request->set_wtp(_wtp);
 	request->set_sta(src);
 	request->set_bssid(bssid);
@@ -243,54 +656,42 @@ void EmpowerLVAPManager::send_association_request(EtherAddress src, EtherAddress
 	request->set_supported_band(supported_band);
 	request->set_hwaddr(hwaddr);
 
-	send_message(p);
+	send_message(msg.finish(), true);
 
 }
 
 void EmpowerLVAPManager::send_auth_request(EtherAddress src, EtherAddress bssid) {
 
-	WritablePacket *p = Packet::make(sizeof(empower_auth_request));
+	EmpowerMessage msg;
+	empower_auth_request *request = msg.start<empower_auth_request>(EMPOWER_PT_AUTH_REQUEST, get_next_seq());
 
-	if (!p) {
+	if (!request) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 				      this,
 				      __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_auth_request *request = (struct empower_auth_request *) (p->data());
-	request->set_version(_empower_version);
-	request->set_length(sizeof(empower_auth_request));
-	request->set_type(EMPOWER_PT_AUTH_REQUEST);
-	request->set_seq(get_next_seq());
 	request->set_wtp(_wtp);
 	request->set_sta(src);
 	request->set_bssid(bssid);
 
-	send_message(p);
+	send_message(msg.finish(), true);
 
 }
 
 void EmpowerLVAPManager::send_probe_request(EtherAddress src, String ssid, EtherAddress hwaddr, int channel, empower_bands_types band, empower_bands_types supported_band) {
 
-	WritablePacket *p = Packet::make(sizeof(empower_probe_request) + ssid.length());
+	EmpowerMessage msg;
+	empower_probe_request *request = msg.start<empower_probe_request>(EMPOWER_PT_PROBE_REQUEST, get_next_seq(), ssid.length());
 
-	if (!p) {
+	if (!request) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_probe_request *request = (struct empower_probe_request *) (p->data());
-	request->set_version(_empower_version);
-	request->set_length(sizeof(empower_probe_request) + ssid.length());
-	request->set_type(EMPOWER_PT_PROBE_REQUEST);
-	request->set_seq(get_next_seq());
 	request->set_wtp(_wtp);
 	request->set_sta(src);
 	request->set_ssid(ssid);
@@ -299,11 +700,18 @@ void EmpowerLVAPManager::send_probe_request(EtherAddress src, String ssid, Ether
 	request->set_channel(channel);
 	request->set_supported_band(supported_band);
 
-	send_message(p);
+	send_message(msg.finish(), true);
 
 }
 
-void EmpowerLVAPManager::send_message(Packet *p) {
+void EmpowerLVAPManager::send_message(Packet *p, bool urgent) {
+
+	// replies to the messages replayed from the state file
+	if (_restoring) {
+		p->kill();
+		return;
+	}
+
 	if (_ports.size() == 0) {
 		click_chatter("%{element} :: %s :: ports not set!",
 				      this,
@@ -311,30 +719,158 @@ void EmpowerLVAPManager::send_message(Packet *p) {
 		p->kill();
 		return;
 	}
-	output(0).push(p);
-}
 
-void EmpowerLVAPManager::send_hello() {
+	// urgent messages leave right away, but not ahead of what is pending
+	if (urgent || !_egress_delay) {
+		flush_messages();
+		output(0).push(p);
+		return;
+	}
 
-	WritablePacket *p = Packet::make(sizeof(empower_hello));
+	// messages are self-delimited by the length in their header, so the
+	// controller reads a batch exactly like back to back messages
+	WritablePacket *out = 0;
 
-	if (!p) {
+	_egress_lock.acquire();
+
+	if (!_egress && p->length() >= _egress_size) {
+		_egress_lock.release();
+		output(0).push(p);
+		return;
+	}
+
+	if (_egress && _egress->tailroom() < p->length()) {
+		out = _egress;
+		_egress = 0;
+	}
+
+	if (!_egress) {
+		uint32_t room = p->length() > _egress_size ? p->length() : _egress_size;
+		_egress = Packet::make(Packet::default_headroom, 0, 0, room);
+	}
+
+	if (_egress) {
+		_egress = _egress->put(p->length());
+	}
+
+	if (!_egress) {
+		_egress_lock.release();
 		click_chatter("%{element} :: %s :: cannot make packet!",
 				      this,
 				      __func__);
+		if (out) {
+			output(0).push(out);
+		}
+		p->kill();
+		return;
+	}
+
+	memcpy(_egress->end_data() - p->length(), p->data(), p->length());
+
+	if (!out && _egress->length() >= _egress_size) {
+		out = _egress;
+		_egress = 0;
+	}
+
+	if (_egress && !_egress_timer.scheduled()) {
+		_egress_timer.schedule_after(Timestamp::make_usec(_egress_delay));
+	}
+
+	_egress_lock.release();
+
+	p->kill();
+
+	if (out) {
+		output(0).push(out);
+	}
+
+}
+
+void EmpowerLVAPManager::flush_messages() {
+	_egress_lock.acquire();
+	WritablePacket *out = _egress;
+	_egress = 0;
+	_egress_lock.release();
+	if (out) {
+		output(0).push(out);
+	}
+}
+
+// A copy of the response cached under key, with a sequence number of its
+// own, or 0 if none is younger than RESPONSE_TTL. The copy shares no data
+// with the cached response, the caller sets the request id in it.
+WritablePacket *EmpowerLVAPManager::cached_response(const String &key) {
+	if (!_response_ttl) {
+		return 0;
+	}
+	CachedResponse *c = _responses.get_pointer(key);
+	if (!c || Timestamp::now_steady() >= c->_expiry) {
+		_response_misses++;
+		return 0;
+	}
+	Packet *q = c->_p->clone();
+	WritablePacket *p = q ? q->uniqueify() : 0;
+	if (!p) {
+		_response_misses++;
+		return 0;
+	}
+	((empower_header *) p->data())->set_seq(get_next_seq());
+	_response_hits++;
+	return p;
+}
+
+// Keeps a clone of response p for the identical requests of the next
+// RESPONSE_TTL
+void EmpowerLVAPManager::cache_response(const String &key, Packet *p) {
+	if (!_response_ttl || !p) {
 		return;
 	}
+	Timestamp now = Timestamp::now_steady();
+	CachedResponse *c = _responses.get_pointer(key);
+	if (!c) {
+		// a new key, the entries of traffic rules or interfaces gone
+		// since are dropped with the other stale ones
+		for (ResponseIter it = _responses.begin(); it.live(); ) {
+			if (now >= it.value()._expiry) {
+				it.value()._p->kill();
+				it = _responses.erase(it);
+			} else {
+				it++;
+			}
+		}
+		c = &_responses[key];
+	} else {
+		c->_p->kill();
+	}
+	c->_p = p->clone();
+	c->_expiry = now + Timestamp::make_msec(_response_ttl);
+	if (!c->_p) {
+		_responses.erase(key);
+	}
+}
+
+void EmpowerLVAPManager::clear_responses() {
+	for (ResponseIter it = _responses.begin(); it.live(); it++) {
+		it.value()._p->kill();
+	}
+	_responses.clear();
+}
+
+void EmpowerLVAPManager::send_hello() {
 
-	memset(p->data(), 0, p->length());
+	EmpowerMessage msg;
+	empower_hello *hello = msg.start<empower_hello>(EMPOWER_PT_HELLO, get_next_seq());
 
-	empower_hello *hello = (struct empower_hello *) (p->data());
+	if (!hello) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+				      this,
+				      __func__);
+		return;
+	}
 
-	hello->set_version(_empower_version);
-	hello->set_length(sizeof(empower_hello));
-	hello->set_type(EMPOWER_PT_HELLO);
-	hello->set_seq(get_next_seq());
 	hello->set_period(_period);
 	hello->set_wtp(_wtp);
+	hello->set_timestamp(Timestamp::now_steady().usecval());
 
 	if (_debug) {
 		click_chatter("%{element} :: %s :: sending hello (%u)!",
@@ -343,7 +879,60 @@ void EmpowerLVAPManager::send_hello() {
 					  hello->seq());
 	}
 
-	send_message(p);
+	send_message(msg.finish());
+
+}
+
+void EmpowerLVAPManager::send_snapshot_sync() {
+
+	EmpowerMessage msg;
+	empower_snapshot_sync *sync = msg.start<empower_snapshot_sync>(EMPOWER_PT_SNAPSHOT_SYNC, get_next_seq());
+
+	if (!sync) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+				      this,
+				      __func__);
+		return;
+	}
+
+	sync->set_wtp(_wtp);
+	sync->set_version(_sync_version);
+	sync->set_nb_lvaps(_lvaps.size());
+	sync->set_nb_vaps(_vaps.size());
+
+	send_message(msg.finish());
+
+}
+
+int EmpowerLVAPManager::handle_snapshot_sync_response(Packet *p, uint32_t offset) {
+
+	struct empower_snapshot_sync_response *q = (struct empower_snapshot_sync_response *) (p->data() + offset);
+
+	if (!_sync_pending) {
+		return 0;
+	}
+
+	_sync_pending = false;
+
+	if (q->status() == EMPOWER_SNAPSHOT_CURRENT && q->version() == _sync_version) {
+		if (_debug) {
+			click_chatter("%{element} :: %s :: restored state is current (version %u)",
+					      this,
+					      __func__,
+					      _sync_version);
+		}
+		return 0;
+	}
+
+	click_chatter("%{element} :: %s :: restored state is stale (version %u, controller %u), dropping it",
+			      this,
+			      __func__,
+			      _sync_version,
+			      q->version());
+
+	drop_restored_state();
+
+	return 0;
 
 }
 
@@ -352,25 +941,18 @@ void EmpowerLVAPManager::send_status_traffic_rule(String ssid, int dscp, int ifa
 	TrafficRule tr = TrafficRule(ssid, dscp);
 	TrafficRuleQueue * queue = _eqms[iface_id]->rules()->find(tr).value();
 
-	int len = sizeof(empower_status_traffic_rule) + ssid.length();
     ResourceElement* re = iface_to_element(iface_id);
 
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_status_traffic_rule *status = msg.start<empower_status_traffic_rule>(EMPOWER_PT_STATUS_TRAFFIC_RULE, get_next_seq(), ssid.length());
 
-	if (!p) {
+	if (!status) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_status_traffic_rule *status = (struct empower_status_traffic_rule *) (p->data());
-	status->set_version(_empower_version);
-	status->set_length(len);
-	status->set_type(EMPOWER_PT_STATUS_TRAFFIC_RULE);
-	status->set_seq(get_next_seq());
 	status->set_wtp(_wtp);
 	status->set_dscp(queue->_tr._dscp);
 	status->set_ssid(queue->_tr._ssid);
@@ -383,7 +965,7 @@ void EmpowerLVAPManager::send_status_traffic_rule(String ssid, int dscp, int ifa
 		status->set_flags(EMPOWER_AMSDU_AGGREGATION);
 	}
 
-	send_message(p);
+	send_message(msg.finish());
 }
 
 int EmpowerLVAPManager::handle_traffic_rule_stats_request(Packet *p, uint32_t offset) {
@@ -410,30 +992,147 @@ int EmpowerLVAPManager::handle_traffic_rule_stats_request(Packet *p, uint32_t of
 
 int EmpowerLVAPManager::handle_traffic_rule_status_request(Packet *, uint32_t) {
 
-	for (REIter it_re = _ifaces_to_elements.begin(); it_re.live(); it_re++) {
-		int iface_id = it_re.key();
-		for (TRIter it = _eqms[iface_id]->rules()->begin(); it.live(); it++) {
-			send_status_traffic_rule(it.key()._ssid, it.key()._dscp, iface_id);
+	if (!_bulk_status) {
+		for (REIter it_re = _ifaces_to_elements.begin(); it_re.live(); it_re++) {
+			int iface_id = it_re.key();
+			for (TRIter it = _eqms[iface_id]->rules()->begin(); it.live(); it++) {
+				send_status_traffic_rule(it.key()._ssid, it.key()._dscp, iface_id);
+			}
 		}
+		return 0;
 	}
 
-	return 0;
+	EmpowerMessage msg;
+	uint16_t nb_entries = 0;
 
-}
+	for (REIter it_re = _ifaces_to_elements.begin(); it_re.live(); it_re++) {
+		int iface_id = it_re.key();
+		ResourceElement *re = it_re.value();
+		for (TRIter it = _eqms[iface_id]->rules()->begin(); it.live(); it++) {
+			TrafficRuleQueue *queue = it.value();
+			const String &ssid = queue->_tr._ssid;
+			traffic_rule_status_entry *entry = (traffic_rule_status_entry *)
+					status_entry(msg, nb_entries, EMPOWER_STATUS_ENTRY_TRAFFIC_RULE, sizeof(struct traffic_rule_status_entry) + ssid.length());
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return 0;
+			}
+			entry->set_hwaddr(re->_hwaddr);
+			entry->set_channel(re->_channel);
+			entry->set_band(re->_band);
+			entry->set_dscp(queue->_tr._dscp);
+			entry->set_quantum(queue->_quantum);
+			if (queue->_amsdu_aggregation) {
+				entry->set_flags(EMPOWER_AMSDU_AGGREGATION);
+			}
+			entry->set_ssid(ssid);
+		}
+	}
+
+	finish_status(msg, nb_entries);
+
+	return 0;
+
+}
 
 int EmpowerLVAPManager::handle_port_status_request(Packet *, uint32_t) {
 
+	if (!_bulk_status) {
+		for (REIter it_re = _ifaces_to_elements.begin(); it_re.live(); it_re++) {
+			int iface_id = it_re.key();
+			for (TxTableIter it = _rcs[iface_id]->tx_policies()->tx_table()->begin(); it.live(); it++) {
+				send_status_port(it.key(), iface_id);
+			}
+		}
+		return 0;
+	}
+
+	EmpowerMessage msg;
+	uint16_t nb_entries = 0;
+
 	for (REIter it_re = _ifaces_to_elements.begin(); it_re.live(); it_re++) {
 		int iface_id = it_re.key();
+		ResourceElement *re = it_re.value();
 		for (TxTableIter it = _rcs[iface_id]->tx_policies()->tx_table()->begin(); it.live(); it++) {
-			send_status_port(it.key(), iface_id);
+			TxPolicyInfo *tx_policy = it.value();
+			port_status_entry *entry = (port_status_entry *)
+					status_entry(msg, nb_entries, EMPOWER_STATUS_ENTRY_PORT,
+							sizeof(struct port_status_entry) + tx_policy->_mcs.size() + tx_policy->_ht_mcs.size());
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return 0;
+			}
+			if (tx_policy->_no_ack) {
+				entry->set_flag(EMPOWER_STATUS_PORT_NOACK);
+			}
+			entry->set_rts_cts(tx_policy->_rts_cts);
+			entry->set_tx_mcast(tx_policy->_tx_mcast);
+			entry->set_ur_mcast_count(tx_policy->_ur_mcast_count);
+			entry->set_sta(it.key());
+			entry->set_hwaddr(re->_hwaddr);
+			entry->set_channel(re->_channel);
+			entry->set_band(re->_band);
+			entry->set_nb_mcs(tx_policy->_mcs.size());
+			entry->set_nb_ht_mcs(tx_policy->_ht_mcs.size());
+			uint8_t *ptr = (uint8_t *) (entry + 1);
+			for (int i = 0; i < tx_policy->_mcs.size(); i++) {
+				*ptr++ = (uint8_t) tx_policy->_mcs[i];
+			}
+			for (int i = 0; i < tx_policy->_ht_mcs.size(); i++) {
+				*ptr++ = (uint8_t) tx_policy->_ht_mcs[i];
+			}
 		}
 	}
 
+	finish_status(msg, nb_entries);
+
 	return 0;
 
 }
 
+// Append an entry of the given type and length to a bulk status message,
+// sending the message first if the entry would take it past EGRESS_SIZE.
+// Returns the entry, 0 if no packet could be made.
+uint8_t *EmpowerLVAPManager::status_entry(EmpowerMessage &msg, uint16_t &nb_entries, uint8_t type, uint32_t length) {
+
+	if (nb_entries && (msg.length() + length > _egress_size || nb_entries == 0xFFFF)) {
+		finish_status(msg, nb_entries);
+	}
+
+	if (!msg.length()) {
+		empower_status_bulk *status = msg.start<empower_status_bulk>(EMPOWER_PT_STATUS_BULK, get_next_seq());
+		if (!status) {
+			return 0;
+		}
+		status->set_wtp(_wtp);
+	}
+
+	status_bulk_entry *entry = (status_bulk_entry *) msg.append(length);
+	if (!entry) {
+		return 0;
+	}
+
+	entry->set_type(type);
+	entry->set_length(length);
+	nb_entries++;
+
+	return (uint8_t *) entry;
+
+}
+
+void EmpowerLVAPManager::finish_status(EmpowerMessage &msg, uint16_t &nb_entries) {
+	if (!nb_entries) {
+		return;
+	}
+	msg.header<empower_status_bulk>()->set_nb_entries(nb_entries);
+	nb_entries = 0;
+	send_message(msg.finish());
+}
+
 void EmpowerLVAPManager:: send_traffic_rule_stats_response(uint32_t tr_stats_id, String ssid, int dscp, int iface_id) {
 
 	TrafficRule tr = TrafficRule(ssid, dscp);
@@ -443,162 +1142,178 @@ void EmpowerLVAPManager:: send_traffic_rule_stats_response(uint32_t tr_stats_id,
 		return;
 	}
 
-	int len = sizeof(empower_traffic_rule_stats_response) + ssid.length();
+	String key = String(EMPOWER_PT_TRAFFIC_RULE_STATS_RESPONSE) + " " + String(iface_id) + " " + String(dscp) + " " + ssid;
+
+	if (WritablePacket *p = cached_response(key)) {
+		((empower_traffic_rule_stats_response *) p->data())->set_tr_stats_id(tr_stats_id);
+		send_message(p);
+		return;
+	}
 
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_traffic_rule_stats_response *stats = msg.start<empower_traffic_rule_stats_response>(EMPOWER_PT_TRAFFIC_RULE_STATS_RESPONSE, get_next_seq());
 
-	if (!p) {
+	if (!stats) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
+	TrafficRuleCounters counters = queue->counters();
 
-	empower_traffic_rule_stats_response *stats = (struct empower_traffic_rule_stats_response *) (p->data());
-	stats->set_version(_empower_version);
-	stats->set_length(len);
-	stats->set_type(EMPOWER_PT_TRAFFIC_RULE_STATS_RESPONSE);
-	stats->set_seq(get_next_seq());
 	stats->set_wtp(_wtp);
-	stats->set_max_queue_length(queue->_max_queue_length);
-	stats->set_deficit_used(queue->_deficit_used);
-	stats->set_transm_pkts(queue->_transm_pkts);
-	stats->set_transm_bytes(queue->_transm_bytes);
+	stats->set_max_queue_length(counters._max_queue_length);
+	stats->set_deficit_used(counters._deficit_used);
+	stats->set_transm_pkts(counters._transm_pkts);
+	stats->set_transm_bytes(counters._transm_bytes);
 	stats->set_tr_stats_id(tr_stats_id);
+	stats->set_drops(counters._drops);
+	stats->set_codel_drops(counters._codel_drops);
+	stats->set_starvations(counters._starvations);
+
+	SojournHistogram sojourn = queue->sojourn();
+	for (int i = 0; i < SojournHistogram::NB_BUCKETS; i++) {
+		stats->set_sojourn(i, sojourn[i]);
+	}
 
 	if (queue->_amsdu_aggregation) {
 		stats->set_flags(EMPOWER_AMSDU_AGGREGATION);
 	}
 
-	send_message(p);
-}
+	uint16_t nb_entries = 0;
 
-void EmpowerLVAPManager::send_status_lvap(EtherAddress sta) {
+	for (AQIter itr = queue->_queues.begin(); itr != queue->_queues.end(); itr++) {
+		AggregationQueue *aq = itr.value();
+		empower_traffic_rule_stats_entry *entry = msg.append<empower_traffic_rule_stats_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
+		entry->set_sta(aq->pair()._ra);
+		entry->set_transm_pkts(aq->transm_pkts());
+		entry->set_max_queue_length(aq->max_nb_pkts());
+		entry->set_drops(aq->drops());
+		entry->set_codel_drops(aq->codel_drops());
+		entry->set_starvations(aq->_starvations);
+		const SojournHistogram &h = aq->sojourn();
+		for (int i = 0; i < SojournHistogram::NB_BUCKETS; i++) {
+			entry->set_sojourn(i, h[i]);
+		}
+		nb_entries++;
+	}
 
-	Vector<String> ssids;
+	msg.header<empower_traffic_rule_stats_response>()->set_nb_entries(nb_entries);
 
-	int len = sizeof(empower_status_lvap);
+	WritablePacket *p = msg.finish();
+	cache_response(key, p);
+	send_message(p);
+}
 
-	EmpowerStationState ess = _lvaps.get(sta);
+void EmpowerLVAPManager::send_status_lvap(EtherAddress sta) {
 
-	len += 1 + ess._ssid.length();
-	ssids.push_back(ess._ssid);
+	EmpowerStationState *ess = _lvaps.get_pointer(sta);
 
-	for (int i = 0; i < ess._ssids.size(); i++) {
-		len += 1 + ess._ssids[i].length();
-		ssids.push_back(ess._ssids[i]);
+	if (!ess) {
+		return;
 	}
 
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_status_lvap *status = msg.start<empower_status_lvap>(EMPOWER_PT_STATUS_LVAP, get_next_seq());
 
-	if (!p) {
+	if (!status) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_status_lvap *status = (struct empower_status_lvap *) (p->data());
-	status->set_version(_empower_version);
-	status->set_length(len);
-	status->set_type(EMPOWER_PT_STATUS_LVAP);
-	status->set_seq(get_next_seq());
-	status->set_assoc_id(ess._assoc_id);
-	if (ess._set_mask)
+	status->set_assoc_id(ess->_assoc_id);
+	if (ess->_set_mask)
 		status->set_flag(EMPOWER_STATUS_LVAP_SET_MASK);
-	if (ess._authentication_status)
+	if (ess->_authentication_status)
 		status->set_flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
-	if (ess._association_status)
+	if (ess->_association_status)
 		status->set_flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
+	if (ess->_preauthorized)
+		status->set_flag(EMPOWER_STATUS_LVAP_PREAUTHORIZED);
+	if (ess->_staged)
+		status->set_flag(EMPOWER_STATUS_LVAP_STAGED);
 	status->set_wtp(_wtp);
-	status->set_sta(ess._sta);
-	status->set_encap(ess._encap);
-	status->set_net_bssid(ess._net_bssid);
-	status->set_lvap_bssid(ess._lvap_bssid);
-	status->set_hwaddr(ess._hwaddr);
-	status->set_channel(ess._channel);
-	status->set_band(ess._band);
-	status->set_supported_band(ess._supported_band);
-
-	uint8_t *ptr = (uint8_t *) status;
-	ptr += sizeof(struct empower_status_lvap);
-	uint8_t *end = ptr + (len - sizeof(struct empower_status_lvap));
-
-	for (int i = 0; i < ssids.size(); i++) {
-		assert (ptr <= end);
-		ssid_entry *entry = (ssid_entry *) ptr;
-		entry->set_length(ssids[i].length());
-		entry->set_ssid(ssids[i]);
-		ptr += entry->length() + 1;
+	status->set_sta(ess->_sta);
+	status->set_encap(ess->_encap);
+	status->set_net_bssid(ess->_net_bssid);
+	status->set_lvap_bssid(ess->_lvap_bssid);
+	status->set_hwaddr(ess->_hwaddr);
+	status->set_channel(ess->_channel);
+	status->set_band(ess->_band);
+	status->set_supported_band(ess->_supported_band);
+
+	// the first entry is the ssid in use, followed by the advertised ones
+	for (int i = -1; i < ess->_ssids.size(); i++) {
+		const String &ssid = (i < 0) ? ess->_ssid : ess->_ssids[i];
+		ssid_entry *entry = msg.append<ssid_entry>(ssid.length());
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
+		entry->set_length(ssid.length());
+		entry->set_ssid(ssid);
 	}
 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
 void EmpowerLVAPManager::send_status_vap(EtherAddress bssid) {
 
-	Vector<String> ssids;
-
-	EmpowerVAPState evs = _vaps.get(bssid);
+	EmpowerVAPState *evs = _vaps.get_pointer(bssid);
 
-	int len = sizeof(empower_status_vap) + evs._ssid.length();
+	if (!evs) {
+		return;
+	}
 
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_status_vap *status = msg.start<empower_status_vap>(EMPOWER_PT_STATUS_VAP, get_next_seq(), evs->_ssid.length());
 
-	if (!p) {
+	if (!status) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_status_vap *status = (struct empower_status_vap *) (p->data());
-	status->set_version(_empower_version);
-	status->set_length(len);
-	status->set_type(EMPOWER_PT_STATUS_VAP);
-	status->set_seq(get_next_seq());
 	status->set_wtp(_wtp);
-	status->set_net_bssid(evs._net_bssid);
-	status->set_hwaddr(evs._hwaddr);
-	status->set_channel(evs._channel);
-	status->set_band(evs._band);
-	status->set_ssid(evs._ssid);
+	status->set_net_bssid(evs->_net_bssid);
+	status->set_hwaddr(evs->_hwaddr);
+	status->set_channel(evs->_channel);
+	status->set_band(evs->_band);
+	status->set_ssid(evs->_ssid);
 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
 void EmpowerLVAPManager::send_status_port(EtherAddress sta, int iface) {
 
-	TxPolicyInfo * tx_policy = _rcs[iface]->tx_policies()->tx_table()->find(sta);
+	TxPolicyInfo * tx_policy = _rcs[iface]->tx_policies()->tx_table()->get(sta);
 
-	int len = sizeof(empower_status_port) + tx_policy->_mcs.size() + tx_policy->_ht_mcs.size();
+	ResourceElement* re = iface_to_element(iface);
 
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_status_port *status = msg.start<empower_status_port>(EMPOWER_PT_STATUS_PORT, get_next_seq(), tx_policy->_mcs.size() + tx_policy->_ht_mcs.size());
 
-	if (!p) {
+	if (!status) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	ResourceElement* re = iface_to_element(iface);
-
-	memset(p->data(), 0, p->length());
-
-	empower_status_port *status = (struct empower_status_port *) (p->data());
-	status->set_version(_empower_version);
-	status->set_length(len);
-	status->set_type(EMPOWER_PT_STATUS_PORT);
-	status->set_seq(get_next_seq());
 	if (tx_policy->_no_ack)
 		status->set_flag(EMPOWER_STATUS_PORT_NOACK);
 	status->set_rts_cts(tx_policy->_rts_cts);
@@ -611,23 +1326,17 @@ void EmpowerLVAPManager::send_status_port(EtherAddress sta, int iface) {
 	status->set_band(re->_band);
 	status->set_ur_mcast_count(tx_policy->_ur_mcast_count);
 
-	uint8_t *ptr = (uint8_t *) status;
-	ptr += sizeof(struct empower_status_port);
-	uint8_t *end = ptr + (len - sizeof(struct empower_status_port));
+	uint8_t *ptr = (uint8_t *) (status + 1);
 
 	for (int i = 0; i < tx_policy->_mcs.size(); i++) {
-		assert (ptr <= end);
-		*ptr = (uint8_t) tx_policy->_mcs[i];
-		ptr++;
+		*ptr++ = (uint8_t) tx_policy->_mcs[i];
 	}
 
 	for (int i = 0; i < tx_policy->_ht_mcs.size(); i++) {
-		assert (ptr <= end);
-		*ptr = (uint8_t) tx_policy->_ht_mcs[i];
-		ptr++;
+		*ptr++ = (uint8_t) tx_policy->_ht_mcs[i];
 	}
 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
@@ -649,73 +1358,60 @@ void EmpowerLVAPManager::send_img_response(int type, uint32_t graph_id,
 		return;
 	}
 
-	// Select stations active on the specified resource element (iface_id)
-	// DstInfo.update should be called here 
- 	Vector<DstInfo> neighbors;
-	_ers->lock.acquire_read();
-
-	if (type == EMPOWER_PT_UCQM_RESPONSE) {
-		for (NTIter iter = _ers->stas.begin(); iter.live(); iter++) {
-			if (iter.value()._iface_id != iface_id) {
-				continue;
-			}
-			// tag_for_nif
-			iter.value().update();
+	String key = String(type) + " " + String(iface_id);
 
-			neighbors.push_back(iter.value());
-		}
-	} else {
-		for (NTIter iter = _ers->aps.begin(); iter.live(); iter++) {
-			if (iter.value()._iface_id != iface_id) {
-				continue;
-			}
-			// tag_for_nif
-			iter.value().update();
-						
-			neighbors.push_back(iter.value());
-		}
+	if (WritablePacket *p = cached_response(key)) {
+		((empower_cqm_response *) p->data())->set_graph_id(graph_id);
+		send_message(p);
+		return;
 	}
 
-	_ers->lock.release_read();
-
-	int len = sizeof(empower_cqm_response) + neighbors.size() * sizeof(cqm_entry);
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
 
-	if (!p) {
+	if (!msg.start<empower_cqm_response>(type, get_next_seq())) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_cqm_response *imgs = (struct empower_cqm_response *) (p->data());
-	imgs->set_version(_empower_version);
-	imgs->set_length(len);
-	imgs->set_type(type);
-	imgs->set_seq(get_next_seq());
-	imgs->set_graph_id(graph_id);
-	imgs->set_wtp(_wtp);
-	imgs->set_nb_entries(neighbors.size());
+	// Stations or access points heard on the specified resource element
+	// (iface_id), from the copy EmpowerRXStats published last: the RX
+	// path does not wait for the report
+	EmpowerEpoch::Guard guard(_ers->epoch());
+	const NeighborSnapshot *neighbors = _ers->neighbors();
 
-	uint8_t *ptr = (uint8_t *) imgs;
-	ptr += sizeof(struct empower_cqm_response);
+	if (!neighbors || iface_id >= neighbors->num_ifaces()) {
+		return;
+	}
 
-	uint8_t *end = ptr + (len - sizeof(struct empower_cqm_response));
+	bool aps = (type != EMPOWER_PT_UCQM_RESPONSE);
+	uint32_t nb_entries = 0;
 
-	for (int i = 0; i < neighbors.size(); i++) {
-		assert (ptr <= end);
-		cqm_entry *entry = (cqm_entry *) ptr;
-		entry->set_sta(neighbors[i]._eth);
-		entry->set_last_rssi_avg(neighbors[i]._last_rssi);
-		entry->set_last_rssi_std(neighbors[i]._last_std);
-		entry->set_last_packets(neighbors[i]._last_packets);
-		entry->set_hist_packets(neighbors[i]._hist_packets);
-		entry->set_mov_rssi(neighbors[i]._sma_rssi->avg());
-		ptr += sizeof(struct cqm_entry);
+	for (const NeighborSample *s = neighbors->begin(iface_id, aps); s != neighbors->end(iface_id, aps); s++) {
+		cqm_entry *entry = msg.append<cqm_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
+		entry->set_sta(s->_eth);
+		entry->set_last_rssi_avg(s->_last_rssi);
+		entry->set_last_rssi_std(s->_last_std);
+		entry->set_last_packets(s->_last_packets);
+		entry->set_hist_packets(s->_hist_packets);
+		entry->set_mov_rssi(s->_sma_rssi);
+		nb_entries++;
 	}
 
+	empower_cqm_response *imgs = msg.header<empower_cqm_response>();
+	imgs->set_graph_id(graph_id);
+	imgs->set_wtp(_wtp);
+	imgs->set_nb_entries(nb_entries);
+
+	WritablePacket *p = msg.finish();
+	cache_response(key, p);
 	send_message(p);
 
 }
@@ -734,111 +1430,178 @@ void EmpowerLVAPManager::send_wifi_stats_response(uint32_t wifi_stats_id, EtherA
 		return;
 	}
 
-	int len = sizeof(empower_wifi_stats_response) + sizeof(wifi_stats_entry) * _regmons[iface_id]->registers(EMPOWER_REGMON_TX)->_size * 3;
-	WritablePacket *p = Packet::make(len);
+	String key = String(EMPOWER_PT_WIFI_STATS_RESPONSE) + " " + String(iface_id);
 
-	if (!p) {
+	if (WritablePacket *p = cached_response(key)) {
+		((empower_wifi_stats_response *) p->data())->set_wifi_stats_id(wifi_stats_id);
+		send_message(p);
+		return;
+	}
+
+	EmpowerMessage msg;
+	empower_wifi_stats_response *stats = msg.start<empower_wifi_stats_response>(EMPOWER_PT_WIFI_STATS_RESPONSE, get_next_seq());
+
+	if (!stats) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
+	static const empower_regmon_types types[] = { EMPOWER_REGMON_TX, EMPOWER_REGMON_RX, EMPOWER_REGMON_ED };
 
+	uint32_t nb_entries = 0;
 
-	memset(p->data(), 0, p->length());
+	// without REGMONS the response carries no samples
+	for (unsigned t = 0; _regmons.size() && t < sizeof(types) / sizeof(types[0]); t++) {
+		RegmonRegister *reg = _regmons[iface_id]->registers(types[t]);
+		for (int i = 0; i < reg->_size; i++) {
+			wifi_stats_entry *entry = msg.append<wifi_stats_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			entry->set_type(reg->_type);
+			entry->set_timestamp(reg->_timestamps[i]);
+			entry->set_sample(reg->_samples[i]);
+			nb_entries++;
+		}
+	}
 
-	empower_wifi_stats_response *stats = (struct empower_wifi_stats_response *) (p->data());
-	stats->set_version(_empower_version);
-	stats->set_length(len);
-	stats->set_type(EMPOWER_PT_WIFI_STATS_RESPONSE);
-	stats->set_seq(get_next_seq());
+	stats = msg.header<empower_wifi_stats_response>();
 	stats->set_wifi_stats_id(wifi_stats_id);
 	stats->set_wtp(_wtp);
-	stats->set_nb_entries(_regmons[iface_id]->registers(EMPOWER_REGMON_TX)->_size * 3);
+	stats->set_nb_entries(nb_entries);
 
-	uint8_t *ptr = (uint8_t *) stats;
-	ptr += sizeof(struct empower_wifi_stats_response);
+	WritablePacket *p = msg.finish();
+	cache_response(key, p);
+	send_message(p);
+
+}
 
-	uint8_t *end = ptr + (len - sizeof(struct empower_wifi_stats_response));
+void EmpowerLVAPManager::send_summary_trigger(SummaryTrigger * summary) {
 
-	for (int i = 0; i < _regmons[iface_id]->registers(EMPOWER_REGMON_TX)->_size; i++) {
-		assert (ptr <= end);
-		wifi_stats_entry *entry = (wifi_stats_entry *) ptr;
-		entry->set_type(_regmons[iface_id]->registers(EMPOWER_REGMON_TX)->_type);
-		entry->set_timestamp(_regmons[iface_id]->registers(EMPOWER_REGMON_TX)->_timestamps[i]);
-		entry->set_sample(_regmons[iface_id]->registers(EMPOWER_REGMON_TX)->_samples[i]);
-		ptr += sizeof(struct wifi_stats_entry);
+	if (_controller_caps & EMPOWER_CAPS_COMPACT_SUMMARY) {
+		send_summary_compact(summary);
+		return;
 	}
 
-	for (int i = 0; i < _regmons[iface_id]->registers(EMPOWER_REGMON_RX)->_size; i++) {
-		assert (ptr <= end);
-		wifi_stats_entry *entry = (wifi_stats_entry *) ptr;
-		entry->set_type(_regmons[iface_id]->registers(EMPOWER_REGMON_RX)->_type);
-		entry->set_timestamp(_regmons[iface_id]->registers(EMPOWER_REGMON_RX)->_timestamps[i]);
-		entry->set_sample(_regmons[iface_id]->registers(EMPOWER_REGMON_RX)->_samples[i]);
-		ptr += sizeof(struct wifi_stats_entry);
+	EmpowerMessage msg;
+
+	if (!msg.start<empower_summary_trigger>(EMPOWER_PT_SUMMARY_TRIGGER, get_next_seq())) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+				      this,
+				      __func__);
+		return;
 	}
 
-	for (int i = 0; i < _regmons[iface_id]->registers(EMPOWER_REGMON_ED)->_size; i++) {
-		assert (ptr <= end);
-		wifi_stats_entry *entry = (wifi_stats_entry *) ptr;
-		entry->set_type(_regmons[iface_id]->registers(EMPOWER_REGMON_ED)->_type);
-		entry->set_timestamp(_regmons[iface_id]->registers(EMPOWER_REGMON_ED)->_timestamps[i]);
-		entry->set_sample(_regmons[iface_id]->registers(EMPOWER_REGMON_ED)->_samples[i]);
-		ptr += sizeof(struct wifi_stats_entry);
+	for (uint32_t i = 0; i < summary->_frames.size(); i++) {
+		summary_entry *entry = msg.append<summary_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
+		const Frame &frame = summary->_frames[i];
+		entry->set_ra(frame._ra);
+		entry->set_ta(frame._ta);
+		entry->set_tsft(frame._tsft);
+		entry->set_flags(frame._flags);
+		entry->set_seq(frame._seq);
+		entry->set_rssi(frame._rssi);
+		entry->set_rate(frame._rate);
+		entry->set_length(frame._length);
+		entry->set_type(frame._type);
+		entry->set_subtype(frame._subtype);
 	}
 
-	send_message(p);
+	empower_summary_trigger *request = msg.header<empower_summary_trigger>();
+	request->set_trigger_id(summary->_trigger_id);
+	request->set_wtp(_wtp);
+	request->set_nb_frames(summary->_frames.size());
+
+	summary->_frames.clear();
+
+	send_message(msg.finish());
 
 }
 
-void EmpowerLVAPManager::send_summary_trigger(SummaryTrigger * summary) {
+static void append_varint(StringAccum &sa, uint64_t v) {
+	while (v >= 0x80) {
+		sa << (char) (v | 0x80);
+		v >>= 7;
+	}
+	sa << (char) v;
+}
+
+static uint64_t zigzag(int64_t v) {
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
 
-	int len = sizeof(empower_summary_trigger) + summary->_frames.size() * sizeof(summary_entry);
-	WritablePacket *p = Packet::make(len);
+// Same frames as send_summary_trigger(), each address pair sent once and
+// the records delta coded against the previous one, see
+// empower_summary_compact
+void EmpowerLVAPManager::send_summary_compact(SummaryTrigger * summary) {
 
-	if (!p) {
+	EmpowerMessage msg;
+
+	if (!msg.start<empower_summary_compact>(EMPOWER_PT_SUMMARY_COMPACT, get_next_seq())) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 				      this,
 				      __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
+	HashTable<EtherPair, int> pairs;
+	StringAccum records;
+	const Frame *last = 0;
+
+	for (uint32_t i = 0; i < summary->_frames.size(); i++) {
+		const Frame &frame = summary->_frames[i];
+		EtherPair pair(frame._ra, frame._ta);
+		HashTable<EtherPair, int>::iterator it = pairs.find(pair);
+		if (it == pairs.end()) {
+			summary_pair_entry *entry = msg.append<summary_pair_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			entry->set_ra(frame._ra);
+			entry->set_ta(frame._ta);
+			it = pairs.find_insert(pair, pairs.size());
+		}
+		append_varint(records, it.value());
+		append_varint(records, zigzag(last ? (int64_t) (frame._tsft - last->_tsft) : (int64_t) frame._tsft));
+		append_varint(records, zigzag(last ? (int16_t) (frame._seq - last->_seq) : (int16_t) frame._seq));
+		append_varint(records, zigzag(last ? (int32_t) frame._length - last->_length : (int32_t) frame._length));
+		append_varint(records, frame._flags);
+		records << (char) frame._rssi << (char) frame._rate << (char) (frame._type | frame._subtype);
+		last = &frame;
+	}
+
+	uint8_t *data = msg.append(records.length());
+	if (!data) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return;
+	}
+	memcpy(data, records.data(), records.length());
 
-	empower_summary_trigger* request = (struct empower_summary_trigger *) (p->data());
-	request->set_version(_empower_version);
-	request->set_length(len);
-	request->set_type(EMPOWER_PT_SUMMARY_TRIGGER);
-	request->set_seq(get_next_seq());
+	empower_summary_compact *request = msg.header<empower_summary_compact>();
 	request->set_trigger_id(summary->_trigger_id);
 	request->set_wtp(_wtp);
 	request->set_nb_frames(summary->_frames.size());
-
-	uint8_t *ptr = (uint8_t *) request;
-	ptr += sizeof(struct empower_summary_trigger);
-	uint8_t *end = ptr + (len - sizeof(struct empower_summary_trigger));
-
-	for (int i = 0; i < summary->_frames.size(); i++) {
-		assert (ptr <= end);
-		summary_entry *entry = (summary_entry *) ptr;
-		entry->set_ra(summary->_frames[i]._ra);
-		entry->set_ta(summary->_frames[i]._ta);
-		entry->set_tsft(summary->_frames[i]._tsft);
-		entry->set_flags(summary->_frames[i]._flags);
-		entry->set_seq(summary->_frames[i]._seq);
-		entry->set_rssi(summary->_frames[i]._rssi);
-		entry->set_rate(summary->_frames[i]._rate);
-		entry->set_length(summary->_frames[i]._length);
-		entry->set_type(summary->_frames[i]._type);
-		entry->set_subtype(summary->_frames[i]._subtype);
-		ptr += sizeof(struct summary_entry);
-	}
+	request->set_nb_pairs(pairs.size());
 
 	summary->_frames.clear();
 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
@@ -846,8 +1609,8 @@ void EmpowerLVAPManager::send_summary_trigger(SummaryTrigger * summary) {
 //tag_for_nif
 // new one added by akhila
 void EmpowerLVAPManager::send_nif_stats_response(EtherAddress lvap, uint32_t nif_stats_id) {
-	EmpowerStationState ess = _lvaps.get(lvap);
-	MinstrelDstInfo *nfo = _rcs.at(ess._iface_id)->neighbors()->findp(lvap);
+	EmpowerStationState *ess = _lvaps.get_pointer(lvap);
+	MinstrelDstInfo *nfo = ess ? _rcs.at(ess->_iface_id)->neighbors()->findp(lvap) : 0;
 
 	if (!nfo) {
 		click_chatter("%{element} :: %s :: no rate information for %s",
@@ -857,34 +1620,29 @@ void EmpowerLVAPManager::send_nif_stats_response(EtherAddress lvap, uint32_t nif
 		return;
 	}
 
-	int len = sizeof(empower_nif_stats_response) + nfo->rates.size() * sizeof(nif_stats_entry);
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_nif_stats_response *nif_stats = msg.start<empower_nif_stats_response>(EMPOWER_PT_NIF_STATS_RESPONSE, get_next_seq());
 
-	if (!p) {
+	if (!nif_stats) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_nif_stats_response *nif_stats = (struct empower_nif_stats_response *) (p->data());
-	nif_stats->set_version(_empower_version);
-	nif_stats->set_length(len);
-	nif_stats->set_type(EMPOWER_PT_NIF_STATS_RESPONSE);
-	nif_stats->set_seq(get_next_seq());
 	nif_stats->set_nif_stats_id(nif_stats_id);
 	nif_stats->set_wtp(_wtp);
-	nif_stats->set_nb_entries(nfo->rates.size());
-
-	uint8_t *ptr = (uint8_t *) nif_stats;
-	ptr += sizeof(struct empower_nif_stats_response);
-	uint8_t *end = ptr + (len - sizeof(struct empower_nif_stats_response));
-	// One entry for each rate for each lvap 
-	for (int i = 0; i < nfo->rates.size(); i++) {
-		assert (ptr <= end);
-		nif_stats_entry *entry = (nif_stats_entry *) ptr;
+	nif_stats->set_nb_entries(nfo->nrates);
+
+	// One entry for each rate for each lvap
+	for (int i = 0; i < nfo->nrates; i++) {
+		nif_stats_entry *entry = msg.append<nif_stats_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
 		entry->set_rate(nfo->rates[i]);
 		entry->set_prob((uint32_t) nfo->probability[i]);
 		entry->set_cur_prob((uint32_t) nfo->cur_prob[i]);
@@ -894,19 +1652,15 @@ void EmpowerLVAPManager::send_nif_stats_response(EtherAddress lvap, uint32_t nif
 		entry->set_succ((uint32_t) nfo->last_successes[i]);
 		entry->set_atmpts((uint32_t) nfo->last_attempts[i]);
 		entry->set_acked_bytes((uint64_t) nfo->last_acked_bytes[i]);
-
-		click_chatter("hist_acked_bytes is %d", nfo->hist_acked_bytes[i]);
-
 		entry->set_hist_acked_bytes((uint64_t) nfo->hist_acked_bytes[i]);
-		ptr += sizeof(struct nif_stats_entry);
 	}
-	send_message(p);
+	send_message(msg.finish());
 }
 
 void EmpowerLVAPManager::send_lvap_stats_response(EtherAddress lvap, uint32_t lvap_stats_id) {
 
-	EmpowerStationState ess = _lvaps.get(lvap);
-	MinstrelDstInfo *nfo = _rcs.at(ess._iface_id)->neighbors()->findp(lvap);
+	EmpowerStationState *ess = _lvaps.get_pointer(lvap);
+	MinstrelDstInfo *nfo = ess ? _rcs.at(ess->_iface_id)->neighbors()->findp(lvap) : 0;
 
 	if (!nfo) {
 		click_chatter("%{element} :: %s :: no rate information for %s",
@@ -916,40 +1670,33 @@ void EmpowerLVAPManager::send_lvap_stats_response(EtherAddress lvap, uint32_t lv
 		return;
 	}
 
-	int len = sizeof(empower_lvap_stats_response) + nfo->rates.size() * sizeof(lvap_stats_entry);
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_lvap_stats_response *lvap_stats = msg.start<empower_lvap_stats_response>(EMPOWER_PT_LVAP_STATS_RESPONSE, get_next_seq());
 
-	if (!p) {
+	if (!lvap_stats) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_lvap_stats_response *lvap_stats = (struct empower_lvap_stats_response *) (p->data());
-	lvap_stats->set_version(_empower_version);
-	lvap_stats->set_length(len);
-	lvap_stats->set_type(EMPOWER_PT_LVAP_STATS_RESPONSE);
-	lvap_stats->set_seq(get_next_seq());
 	lvap_stats->set_lvap_stats_id(lvap_stats_id);
 	lvap_stats->set_wtp(_wtp);
-	lvap_stats->set_nb_entries(nfo->rates.size());
-
-	uint8_t *ptr = (uint8_t *) lvap_stats;
-	ptr += sizeof(struct empower_lvap_stats_response);
-	uint8_t *end = ptr + (len - sizeof(struct empower_lvap_stats_response));
+	lvap_stats->set_nb_entries(nfo->nrates);
 
-	for (int i = 0; i < nfo->rates.size(); i++) {
-		assert (ptr <= end);
-		lvap_stats_entry *entry = (lvap_stats_entry *) ptr;
+	for (int i = 0; i < nfo->nrates; i++) {
+		lvap_stats_entry *entry = msg.append<lvap_stats_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
 		entry->set_rate(nfo->rates[i]);
 		entry->set_prob((uint32_t) nfo->probability[i]);
 		entry->set_cur_prob((uint32_t) nfo->cur_prob[i]);
-		ptr += sizeof(struct lvap_stats_entry);
 	}
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
@@ -970,189 +1717,402 @@ void EmpowerLVAPManager::send_counters_response(EtherAddress sta, uint32_t count
 		return;
 	}
 
-	// Length of the writable pkt ?? Why this length ??
-	int len = sizeof(empower_counters_response);
-	len += txp->_tx.size() * 6; // _tx is a HashTable
- 	len += txp->_rx.size() * 6; // _rx is a HashTable
+	EmpowerMessage msg;
+	empower_counters_response *counters = msg.start<empower_counters_response>(EMPOWER_PT_COUNTERS_RESPONSE, get_next_seq());
 
-	// Create a writable pkt of this length
-	WritablePacket *p = Packet::make(len);
-
-	// If unable to create this writable pkt
-	if (!p) {
+	if (!counters) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	// Set the data portion of the writable pkt to all zeros
-	memset(p->data(), 0, p->length());
-
-	// Typecast the data of the pkt to a structure of type empower_counters_response
-	empower_counters_response *counters = (struct empower_counters_response *) (p->data());
-	counters->set_version(_empower_version);
-	counters->set_length(len);
-	counters->set_type(EMPOWER_PT_COUNTERS_RESPONSE);
-	counters->set_seq(get_next_seq());
 	counters->set_counters_id(counters_id);
 	counters->set_wtp(_wtp);
 	counters->set_sta(sta);
-	counters->set_nb_tx(txp->_tx.size()); // txp->_tx.size() is uint16_t // _tx is a HashTable
-	counters->set_nb_rx(txp->_rx.size()); // txp->_rx.size() is uint16_t // _rx is a HashTable
-
-	uint8_t *ptr = (uint8_t *) counters;
-	ptr += sizeof(struct empower_counters_response);
-
-	uint8_t *end = ptr + (len - sizeof(struct empower_counters_response));
-
-	// Iterate over the HashTable
-	for (CBytesIter iter = txp->_tx.begin(); iter.live(); iter++) {
-		assert (ptr <= end);
-		counters_entry *entry = (counters_entry *) ptr;
-		entry->set_size(iter.key()); // Frame size in bytes
-		entry->set_count(iter.value()); // Num. of frames
-		ptr += sizeof(struct counters_entry);
-	}
-
-	for (CBytesIter iter = txp->_rx.begin(); iter.live(); iter++) {
-		assert (ptr <= end);
-		counters_entry *entry = (counters_entry *) ptr;
-		entry->set_size(iter.key());
-		entry->set_count(iter.value());
-		ptr += sizeof(struct counters_entry);
+	counters->set_nb_tx(txp->_tx.size());
+	counters->set_nb_rx(txp->_rx.size());
+
+	// One entry per non-empty frame size bucket, tx first then rx
+	for (int rx = 0; rx < 2; rx++) {
+		const FrameSizeHistogram &hist = rx ? txp->_rx : txp->_tx;
+		for (int i = hist.next(0); i < FrameSizeHistogram::NBUCKETS; i = hist.next(i + 1)) {
+			counters_entry *entry = msg.append<counters_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			entry->set_size(FrameSizeHistogram::bucket_size(i)); // Frame size in bytes
+			entry->set_count(hist.count(i)); // Num. of frames
+		}
 	}
 
-	// Where is this message sent ? to the controller ? to the station ? 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
-void EmpowerLVAPManager::send_wtp_counters_response(uint32_t counters_id) {
-
-	int len = sizeof(empower_counters_response);
+void EmpowerLVAPManager::send_stats_stream(StatsStream *stream) {
 
-	int nb_tx = 0;
-	int nb_rx = 0;
+	EmpowerMessage msg;
 
-	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
-		TxPolicyInfo * txp = get_txp(it.key());
-		len += txp->_tx.size() * 12; // the tx samples
-		len += txp->_rx.size() * 12; // the rx samples
-		nb_tx += txp->_tx.size();
-		nb_rx += txp->_rx.size();
-	}
-
-	WritablePacket *p = Packet::make(len);
-
-	if (!p) {
+	if (!msg.start<empower_stats_stream>(EMPOWER_PT_STATS_STREAM, get_next_seq())) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_wtp_counters_response *counters = (struct empower_wtp_counters_response *) (p->data());
-	counters->set_version(_empower_version);
-	counters->set_length(len);
-	counters->set_type(EMPOWER_PT_WTP_COUNTERS_RESPONSE);
-	counters->set_seq(get_next_seq());
-	counters->set_counters_id(counters_id);
-	counters->set_wtp(_wtp);
-	counters->set_nb_tx(nb_tx);
-	counters->set_nb_rx(nb_rx);
+	uint16_t nb_entries = 0;
 
-	uint8_t *ptr = (uint8_t *) counters;
-	ptr += sizeof(struct empower_wtp_counters_response);
+	if (stream->_fields & (EMPOWER_STREAM_LVAP_COUNTERS | EMPOWER_STREAM_WTP_COUNTERS)) {
 
-	uint8_t *end = ptr + (len - sizeof(struct empower_counters_response));
+		StreamFrames wtp;
 
-	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
-		TxPolicyInfo * txp = get_txp(it.key());
-		for (CBytesIter iter = txp->_tx.begin(); iter.live(); iter++) {
-			assert (ptr <= end);
-			wtp_counters_entry *entry = (wtp_counters_entry *) ptr;
-			entry->set_size(iter.key());
-			entry->set_count(iter.value());
-			entry->set_sta(it.key());
-			ptr += sizeof(struct wtp_counters_entry);
+		// forget the stations that left since the previous report
+		Vector<EtherAddress> gone;
+		for (SFIter it = stream->_lvaps.begin(); it.live(); it++) {
+			if (!_lvaps.get_pointer(it.key())) {
+				gone.push_back(it.key());
+			}
+		}
+		for (int i = 0; i < gone.size(); i++) {
+			stream->_lvaps.erase(gone[i]);
 		}
-	}
 
-	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
-		TxPolicyInfo * txp = get_txp(it.key());
-		for (CBytesIter iter = txp->_rx.begin(); iter.live(); iter++) {
-			assert (ptr <= end);
-			wtp_counters_entry *entry = (wtp_counters_entry *) ptr;
-			entry->set_size(iter.key());
-			entry->set_count(iter.value());
+		for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+			TxPolicyInfo *txp = get_txp(it.key());
+			if (!txp) {
+				continue;
+			}
+			StreamFrames now(txp->_tx.total(), txp->_rx.total());
+			StreamFrames &last = stream->_lvaps[it.key()];
+			StreamFrames delta(now._tx - last._tx, now._rx - last._rx);
+			last = now;
+			wtp._tx += delta._tx;
+			wtp._rx += delta._rx;
+			if (!(stream->_fields & EMPOWER_STREAM_LVAP_COUNTERS) || (!delta._tx && !delta._rx)) {
+				continue;
+			}
+			lvap_stream_entry *entry = msg.append<lvap_stream_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			entry->set_type(EMPOWER_STREAM_LVAP_COUNTERS);
+			entry->set_length(sizeof(struct lvap_stream_entry));
 			entry->set_sta(it.key());
-			ptr += sizeof(struct wtp_counters_entry);
+			entry->set_tx_frames(delta._tx);
+			entry->set_rx_frames(delta._rx);
+			nb_entries++;
 		}
-	}
-
-	send_message(p);
 
-}
+		if ((stream->_fields & EMPOWER_STREAM_WTP_COUNTERS) && (wtp._tx || wtp._rx)) {
+			wtp_stream_entry *entry = msg.append<wtp_stream_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			entry->set_type(EMPOWER_STREAM_WTP_COUNTERS);
+			entry->set_length(sizeof(struct wtp_stream_entry));
+			entry->set_tx_frames(wtp._tx);
+			entry->set_rx_frames(wtp._rx);
+			nb_entries++;
+		}
 
-void EmpowerLVAPManager::send_incomming_mcast_address(EtherAddress mcast_address, int iface) {
+	}
 
-	int len = sizeof(empower_incom_mcast_addr);
-	WritablePacket *p = Packet::make(len);
+	if (stream->_fields & EMPOWER_STREAM_TRAFFIC_RULES) {
+		for (REIter it_re = _ifaces_to_elements.begin(); it_re.live(); it_re++) {
+			int iface_id = it_re.key();
+			if (iface_id >= stream->_rules.size()) {
+				continue;
+			}
+			ResourceElement *re = it_re.value();
+			StreamTrafficTable &rules = stream->_rules[iface_id];
+			for (TRIter it = _eqms[iface_id]->rules()->begin(); it.live(); it++) {
+				TrafficRuleQueue *queue = it.value();
+				TrafficRuleCounters counters = queue->counters();
+				StreamTraffic now(counters._transm_pkts, counters._transm_bytes);
+				StreamTraffic &last = rules[it.key()];
+				StreamTraffic delta(now._pkts - last._pkts, now._bytes - last._bytes);
+				last = now;
+				if (!delta._pkts && !delta._bytes) {
+					continue;
+				}
+				int ssid_len = it.key()._ssid.length();
+				if (sizeof(struct traffic_rule_stream_entry) + ssid_len > 255) {
+					continue;
+				}
+				traffic_rule_stream_entry *entry = msg.append<traffic_rule_stream_entry>(ssid_len);
+				if (!entry) {
+					click_chatter("%{element} :: %s :: cannot make packet!",
+								  this,
+								  __func__);
+					return;
+				}
+				entry->set_type(EMPOWER_STREAM_TRAFFIC_RULES);
+				entry->set_length(sizeof(struct traffic_rule_stream_entry) + ssid_len);
+				entry->set_hwaddr(re->_hwaddr);
+				entry->set_channel(re->_channel);
+				entry->set_band(re->_band);
+				entry->set_dscp(it.key()._dscp);
+				entry->set_transm_pkts(delta._pkts);
+				entry->set_transm_bytes(delta._bytes);
+				entry->set_ssid(it.key()._ssid);
+				nb_entries++;
+			}
+		}
+	}
 
-	if (!p) {
-		click_chatter("%{element} :: %s :: cannot make packet!",
-					  this,
-					  __func__);
+	// nothing changed, no report
+	if (!nb_entries) {
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
+	empower_stats_stream *report = msg.header<empower_stats_stream>();
+	report->set_stream_id(stream->_stream_id);
+	report->set_wtp(_wtp);
+	report->set_nb_entries(nb_entries);
 
-	struct empower_incom_mcast_addr *mcast_addr = (struct empower_incom_mcast_addr *) (p->data());
+	stream->_sent++;
 
-	mcast_addr->set_version(_empower_version);
-	mcast_addr->set_length(sizeof(empower_incom_mcast_addr));
-	mcast_addr->set_type(EMPOWER_PT_INCOM_MCAST_REQUEST);
-	mcast_addr->set_seq(get_next_seq());
-	mcast_addr->set_mcast_addr(mcast_address);
-	mcast_addr->set_wtp(_wtp);
-	mcast_addr->set_iface(iface);
+	send_message(msg.finish());
 
-	click_chatter("%{element} :: %s :: New mcast address %s address from iface %d in wtp %s",
-				  this,
-				  __func__, mcast_address.unparse().c_str(), iface, _wtp.unparse().c_str());
+}
 
+void EmpowerLVAPManager::send_flow_samples(Packet *p) {
 	send_message(p);
 }
 
-void EmpowerLVAPManager::send_igmp_report(EtherAddress src, Vector<IPAddress>* mcast_addresses, Vector<enum empower_igmp_record_type>* igmp_types) {
+static uint32_t timeline_usecs(const Timestamp &a, const Timestamp &b) {
+	if (b <= a) {
+		return 0;
+	}
+	Timestamp::value_type usecs = (b - a).usecval();
+	return usecs < 0xFFFFFFFFU ? usecs : 0xFFFFFFFFU;
+}
 
-	int grouprecord_counter;
+// PROBE and ADD_LVAP start a timeline if the station has none, or one
+// that is complete or older than TIMEOUT; the other phases only count in
+// an open timeline. A phase counts once, with the time since the last one
+// reached. PROBE and ADD_LVAP come from the router thread, which alone
+// sends messages.
+bool EmpowerLVAPManager::timeline(EtherAddress sta, int phase) {
 
-	for (grouprecord_counter = 0; grouprecord_counter < mcast_addresses->size(); grouprecord_counter++) {
+	Timestamp now = Timestamp::now_steady();
+	bool starts = phase == LVAPTimeline::PROBE || phase == LVAPTimeline::ADD_LVAP;
+	LVAPTimeline done;
+	bool report = false;
 
-		//send message to the controller
-		int len = sizeof(empower_igmp_request);
-		WritablePacket *p = Packet::make(len);
+	_timeline_lock.acquire();
 
-		if (!p) {
+	LVAPTimeline *tl = _timelines.get_pointer(sta);
+
+	if (tl && starts && (tl->complete() || now - tl->_start > Timestamp::make_msec(LVAPTimeline::TIMEOUT))) {
+		if (tl->complete()) {
+			done = *tl;
+			report = _timeline_report;
+		} else if (tl->reached(LVAPTimeline::ADD_LVAP)) {
+			_timelines_expired++;
+		}
+		_timelines.erase(sta);
+		tl = 0;
+	}
+
+	if (!tl) {
+		if (starts && _timelines.size() < LVAPTimeline::MAX_TIMELINES) {
+			LVAPTimeline fresh;
+			fresh._start = fresh._last = now;
+			fresh._first = phase;
+			fresh._reached = 1 << phase;
+			memset(fresh._delta, 0, sizeof(fresh._delta));
+			_timelines.set(sta, fresh);
+			tl = _timelines.get_pointer(sta);
+		}
+	} else if (!tl->reached(phase) && !tl->complete()) {
+		uint32_t usecs = timeline_usecs(tl->_last, now);
+		tl->_delta[phase] = usecs;
+		tl->_reached |= 1 << phase;
+		tl->_last = now;
+		_timeline_histograms[phase].add(usecs);
+		if (tl->complete()) {
+			_timeline_histograms[LVAPTimeline::NB_PHASES].add(timeline_usecs(tl->_start, now));
+			_timelines_completed++;
+		}
+	}
+
+	_timeline_lock.release();
+
+	if (report) {
+		send_lvap_timeline(sta, done);
+	}
+
+	return tl != 0;
+
+}
+
+// Sends the complete timelines if TIMELINE_REPORT, gives up on those
+// older than TIMEOUT, and stops the LVAPs of both awaiting their frames
+void EmpowerLVAPManager::expire_timelines() {
+
+	Timestamp now = Timestamp::now_steady();
+	Vector<EtherAddress> stas;
+	Vector<EtherAddress> done_stas;
+	Vector<LVAPTimeline> done;
+
+	_timeline_lock.acquire();
+	for (Timelines::iterator it = _timelines.begin(); it.live(); ) {
+		if (it.value().complete()) {
+			done_stas.push_back(it.key());
+			done.push_back(it.value());
+		} else if (now - it.value()._start > Timestamp::make_msec(LVAPTimeline::TIMEOUT)) {
+			if (it.value().reached(LVAPTimeline::ADD_LVAP)) {
+				_timelines_expired++;
+			}
+		} else {
+			it++;
+			continue;
+		}
+		stas.push_back(it.key());
+		it = _timelines.erase(it);
+	}
+	_timeline_lock.release();
+
+	for (int i = 0; i < stas.size(); i++) {
+		if (EmpowerStationState *ess = _lvaps.get_pointer(stas[i])) {
+			ess->_timeline = 0;
+		}
+	}
+
+	for (int i = 0; _timeline_report && i < done.size(); i++) {
+		send_lvap_timeline(done_stas[i], done[i]);
+	}
+
+}
+
+void EmpowerLVAPManager::send_lvap_timeline(EtherAddress sta, const LVAPTimeline &tl) {
+
+	EmpowerMessage msg;
+	empower_lvap_timeline *timeline = msg.start<empower_lvap_timeline>(EMPOWER_PT_LVAP_TIMELINE, get_next_seq());
+
+	if (!timeline) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return;
+	}
+
+	timeline->set_wtp(_wtp);
+	timeline->set_sta(sta);
+	timeline->set_total(timeline_usecs(tl._start, tl._last));
+	for (int i = 0; i < LVAPTimeline::NB_PHASES; i++) {
+		timeline->set_phase(i, tl.reached(i) && i != tl._first ? tl._delta[i] : 0xFFFFFFFF);
+	}
+
+	send_message(msg.finish());
+
+}
+
+void EmpowerLVAPManager::send_wtp_counters_response(uint32_t counters_id) {
+
+	String key = String(EMPOWER_PT_WTP_COUNTERS_RESPONSE);
+
+	if (WritablePacket *p = cached_response(key)) {
+		((empower_wtp_counters_response *) p->data())->set_counters_id(counters_id);
+		send_message(p);
+		return;
+	}
+
+	EmpowerMessage msg;
+
+	if (!msg.start<empower_wtp_counters_response>(EMPOWER_PT_WTP_COUNTERS_RESPONSE, get_next_seq())) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return;
+	}
+
+	int nb[2] = { 0, 0 };
+
+	// all the tx samples come first, then the rx ones
+	for (int rx = 0; rx < 2; rx++) {
+		for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+			TxPolicyInfo * txp = get_txp(it.key());
+			const FrameSizeHistogram &hist = rx ? txp->_rx : txp->_tx;
+			for (int i = hist.next(0); i < FrameSizeHistogram::NBUCKETS; i = hist.next(i + 1)) {
+				wtp_counters_entry *entry = msg.append<wtp_counters_entry>();
+				if (!entry) {
+					click_chatter("%{element} :: %s :: cannot make packet!",
+								  this,
+								  __func__);
+					return;
+				}
+				entry->set_size(FrameSizeHistogram::bucket_size(i));
+				entry->set_count(hist.count(i));
+				entry->set_sta(it.key());
+				nb[rx]++;
+			}
+		}
+	}
+
+	empower_wtp_counters_response *counters = msg.header<empower_wtp_counters_response>();
+	counters->set_counters_id(counters_id);
+	counters->set_wtp(_wtp);
+	counters->set_nb_tx(nb[0]);
+	counters->set_nb_rx(nb[1]);
+
+	WritablePacket *p = msg.finish();
+	cache_response(key, p);
+	send_message(p);
+
+}
+
+void EmpowerLVAPManager::send_incomming_mcast_address(EtherAddress mcast_address, int iface) {
+
+	EmpowerMessage msg;
+	struct empower_incom_mcast_addr *mcast_addr = msg.start<empower_incom_mcast_addr>(EMPOWER_PT_INCOM_MCAST_REQUEST, get_next_seq());
+
+	if (!mcast_addr) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return;
+	}
+
+	mcast_addr->set_mcast_addr(mcast_address);
+	mcast_addr->set_wtp(_wtp);
+	mcast_addr->set_iface(iface);
+
+	click_chatter("%{element} :: %s :: New mcast address %s address from iface %d in wtp %s",
+				  this,
+				  __func__, mcast_address.unparse().c_str(), iface, _wtp.unparse().c_str());
+
+	send_message(msg.finish());
+}
+
+void EmpowerLVAPManager::send_igmp_report(EtherAddress src, Vector<IPAddress>* mcast_addresses, Vector<enum empower_igmp_record_type>* igmp_types) {
+
+	int grouprecord_counter;
+
+	for (grouprecord_counter = 0; grouprecord_counter < mcast_addresses->size(); grouprecord_counter++) {
+
+		//send message to the controller
+		EmpowerMessage msg;
+		struct empower_igmp_request *igmp_request = msg.start<empower_igmp_request>(EMPOWER_PT_IGMP_REQUEST, get_next_seq());
+
+		if (!igmp_request) {
 			click_chatter("%{element} :: %s :: cannot make packet!",
 						  this,
 						  __func__);
 			return;
 		}
 
-		memset(p->data(), 0, p->length());
-
-		struct empower_igmp_request *igmp_request = (struct empower_igmp_request *) (p->data());
-
-		igmp_request->set_version(_empower_version);
-		igmp_request->set_length(sizeof(empower_igmp_request));
-		igmp_request->set_type(EMPOWER_PT_IGMP_REQUEST);
-		igmp_request->set_seq(get_next_seq());
 		igmp_request->set_mcast_addr(mcast_addresses->at(grouprecord_counter));
 		igmp_request->set_wtp(_wtp);
 		igmp_request->set_sta(src);
@@ -1166,7 +2126,7 @@ void EmpowerLVAPManager::send_igmp_report(EtherAddress src, Vector<IPAddress>* m
 					  mcast_addresses->at(grouprecord_counter).unparse().c_str(),
 					  _wtp.unparse().c_str());
 
-		send_message(p);
+		send_message(msg.finish());
 	}
 }
 
@@ -1184,80 +2144,46 @@ void EmpowerLVAPManager::send_txp_counters_response(uint32_t counters_id, EtherA
 		return;
 	}
 
-	TxPolicyInfo * tx_policy = _rcs[iface_id]->tx_policies()->tx_table()->find(mcast);
-
-	if (!tx_policy) {
-		int len = sizeof(empower_txp_counters_response);
-		WritablePacket *p = Packet::make(len);
-		if (!p) {
-			click_chatter("%{element} :: %s :: cannot make packet!",
-						  this,
-						  __func__);
-			return;
-		}
-
-		memset(p->data(), 0, p->length());
-		empower_txp_counters_response *counters = (struct empower_txp_counters_response *) (p->data());
-		counters->set_version(_empower_version);
-		counters->set_length(len);
-		counters->set_type(EMPOWER_PT_TXP_COUNTERS_RESPONSE);
-		counters->set_seq(get_next_seq());
-		counters->set_counters_id(counters_id);
-		counters->set_wtp(_wtp);
-		counters->set_nb_tx(0);
-		send_message(p);
-		return;
-	}
-
-	int len = sizeof(empower_txp_counters_response);
-	len += tx_policy->_tx.size() * 6; // the tx samples
+	TxPolicyInfo * tx_policy = _rcs[iface_id]->tx_policies()->tx_table()->get(mcast);
 
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_txp_counters_response *counters = msg.start<empower_txp_counters_response>(EMPOWER_PT_TXP_COUNTERS_RESPONSE, get_next_seq());
 
-	if (!p) {
+	if (!counters) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_txp_counters_response *counters = (struct empower_txp_counters_response *) (p->data());
-	counters->set_version(_empower_version);
-	counters->set_length(len);
-	counters->set_type(EMPOWER_PT_TXP_COUNTERS_RESPONSE);
-	counters->set_seq(get_next_seq());
 	counters->set_counters_id(counters_id);
 	counters->set_wtp(_wtp);
-	counters->set_nb_tx(tx_policy->_tx.size());
-
-	uint8_t *ptr = (uint8_t *) counters;
-	ptr += sizeof(struct empower_txp_counters_response);
+	counters->set_nb_tx(tx_policy ? tx_policy->_tx.size() : 0);
 
-	uint8_t *end = ptr + (len - sizeof(struct empower_txp_counters_response));
-
-	for (CBytesIter iter = tx_policy->_tx.begin(); iter.live(); iter++) {
-		assert (ptr <= end);
-		counters_entry *entry = (counters_entry *) ptr;
-		entry->set_size(iter.key());
-		entry->set_count(iter.value());
-		ptr += sizeof(struct counters_entry);
+	if (tx_policy) {
+		for (int i = tx_policy->_tx.next(0); i < FrameSizeHistogram::NBUCKETS; i = tx_policy->_tx.next(i + 1)) {
+			counters_entry *entry = msg.append<counters_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			entry->set_size(FrameSizeHistogram::bucket_size(i));
+			entry->set_count(tx_policy->_tx.count(i));
+		}
 	}
 
-	send_message(p);
+	send_message(msg.finish());
 
 }
 
 void EmpowerLVAPManager::send_caps() {
 
-	int len = sizeof(empower_caps);
-	len += _ifaces_to_elements.size() * sizeof(struct resource_elements_entry);
-	len += _ports.size() * sizeof(struct port_elements_entry);
-
-	WritablePacket *p = Packet::make(len);
+	EmpowerMessage msg;
+	empower_caps *caps = msg.start<empower_caps>(EMPOWER_PT_CAPS_RESPONSE, get_next_seq());
 
-	if (!p) {
+	if (!caps) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
@@ -1270,65 +2196,157 @@ void EmpowerLVAPManager::send_caps() {
 				      __func__);
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_caps *caps = (struct empower_caps *) (p->data());
-	caps->set_version(_empower_version);
-	caps->set_length(len);
-	caps->set_type(EMPOWER_PT_CAPS_RESPONSE);
-	caps->set_seq(get_next_seq());
 	caps->set_wtp(_wtp);
 	caps->set_nb_resources_elements(_ifaces_to_elements.size());
 	caps->set_nb_ports_elements(_ports.size());
 
-	uint8_t *ptr = (uint8_t *) caps;
-	ptr += sizeof(struct empower_caps);
-
-	uint8_t *end = ptr + (len - sizeof(struct empower_caps));
-
 	for (REIter iter = _ifaces_to_elements.begin(); iter.live(); iter++) {
-		assert (ptr <= end);
 		ResourceElement *elm = iter.value();
-		resource_elements_entry *entry = (resource_elements_entry *) ptr;
+		resource_elements_entry *entry = msg.append<resource_elements_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
 		entry->set_hwaddr(elm->_hwaddr);
 		entry->set_channel(elm->_channel);
 		entry->set_band(elm->_band);
-		ptr += sizeof(struct resource_elements_entry);
 	}
 
 	for (PortsIter iter = _ports.begin(); iter.live(); iter++) {
-		assert (ptr <= end);
-		port_elements_entry *entry = (port_elements_entry *) ptr;
+		port_elements_entry *entry = msg.append<port_elements_entry>();
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return;
+		}
 		entry->set_hwaddr(iter.value()._hwaddr);
 		entry->set_iface(iter.value()._iface);
 		entry->set_port_id(iter.value()._port_id);
-		ptr += sizeof(struct port_elements_entry);
 	}
 
-	send_message(p);
+	// past the entries, controllers that do not know it ignore it
+	caps_flags_entry *flags = msg.append<caps_flags_entry>();
+	if (!flags) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return;
+	}
+	flags->set_flags(EMPOWER_CAPS_COMPACT_SUMMARY);
+
+	send_message(msg.finish());
 
 }
 
-int EmpowerLVAPManager::handle_caps_request(Packet *, uint32_t) {
+int EmpowerLVAPManager::handle_caps_request(Packet *p, uint32_t offset) {
+	// the features of the controller, none if it sends no flags
+	EmpowerCursor trailer = EmpowerView<empower_header>(p, offset).trailer();
+	caps_flags_entry *flags = trailer.next<caps_flags_entry>();
+	_controller_caps = flags ? flags->flags() : 0;
 	// send caps response
 	send_caps();
 	return 0;
 }
 
 int EmpowerLVAPManager::handle_lvap_status_request(Packet *, uint32_t) {
+
 	// send LVAP status update messages
+	if (!_bulk_status) {
+		for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+			send_status_lvap(it.key());
+		}
+		return 0;
+	}
+
+	EmpowerMessage msg;
+	uint16_t nb_entries = 0;
+
 	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
-		send_status_lvap(it.key());
+		EmpowerStationState *ess = &it.value();
+		// the first ssid is the one in use, followed by the advertised ones
+		uint32_t length = sizeof(struct lvap_status_entry) + ess->_ssid.length() + 1;
+		for (int i = 0; i < ess->_ssids.size(); i++) {
+			length += ess->_ssids[i].length() + 1;
+		}
+		lvap_status_entry *entry = (lvap_status_entry *) status_entry(msg, nb_entries, EMPOWER_STATUS_ENTRY_LVAP, length);
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return 0;
+		}
+		entry->set_assoc_id(ess->_assoc_id);
+		if (ess->_set_mask)
+			entry->set_flag(EMPOWER_STATUS_LVAP_SET_MASK);
+		if (ess->_authentication_status)
+			entry->set_flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
+		if (ess->_association_status)
+			entry->set_flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
+		if (ess->_preauthorized)
+			entry->set_flag(EMPOWER_STATUS_LVAP_PREAUTHORIZED);
+		if (ess->_staged)
+			entry->set_flag(EMPOWER_STATUS_LVAP_STAGED);
+		entry->set_sta(ess->_sta);
+		entry->set_encap(ess->_encap);
+		entry->set_net_bssid(ess->_net_bssid);
+		entry->set_lvap_bssid(ess->_lvap_bssid);
+		entry->set_hwaddr(ess->_hwaddr);
+		entry->set_channel(ess->_channel);
+		entry->set_band(ess->_band);
+		entry->set_supported_band(ess->_supported_band);
+		uint8_t *ptr = (uint8_t *) (entry + 1);
+		for (int i = -1; i < ess->_ssids.size(); i++) {
+			const String &ssid = (i < 0) ? ess->_ssid : ess->_ssids[i];
+			ssid_entry *ssid_e = (ssid_entry *) ptr;
+			ssid_e->set_length(ssid.length());
+			ssid_e->set_ssid(ssid);
+			ptr += ssid.length() + 1;
+		}
 	}
+
+	finish_status(msg, nb_entries);
+
 	return 0;
+
 }
 
 int EmpowerLVAPManager::handle_vap_status_request(Packet *, uint32_t) {
+
 	// send VAP status update messages
+	if (!_bulk_status) {
+		for (VAPIter it = _vaps.begin(); it.live(); it++) {
+			send_status_vap(it.key());
+		}
+		return 0;
+	}
+
+	EmpowerMessage msg;
+	uint16_t nb_entries = 0;
+
 	for (VAPIter it = _vaps.begin(); it.live(); it++) {
-		send_status_vap(it.key());
+		EmpowerVAPState *evs = &it.value();
+		vap_status_entry *entry = (vap_status_entry *)
+				status_entry(msg, nb_entries, EMPOWER_STATUS_ENTRY_VAP, sizeof(struct vap_status_entry) + evs->_ssid.length());
+		if (!entry) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+						  this,
+						  __func__);
+			return 0;
+		}
+		entry->set_net_bssid(evs->_net_bssid);
+		entry->set_hwaddr(evs->_hwaddr);
+		entry->set_channel(evs->_channel);
+		entry->set_band(evs->_band);
+		entry->set_ssid(evs->_ssid);
 	}
+
+	finish_status(msg, nb_entries);
+
 	return 0;
+
 }
 
 int EmpowerLVAPManager::handle_add_vap(Packet *p, uint32_t offset) {
@@ -1369,18 +2387,23 @@ int EmpowerLVAPManager::handle_add_vap(Packet *p, uint32_t offset) {
 		state._hwaddr= hwaddr;
 		state._band = band;
 		state._ssid = ssid;
+		state._ssid_id = _ssid_table.intern(ssid);
+		state._slice_id = -1;
 		state._iface_id = iface;
-		_vaps.set(net_bssid, state);
-
-		/* Regenerate the BSSID mask */
-		compute_bssid_mask();
 
 		/* create default traffic rule */
 		if (ssid != "") {
 			// TODO: for the moment assume that at worst a 1500 bytes frame can be sent in 12000 usec
 			_eqms[iface]->set_traffic_rule(ssid, 0, 12000, false);
+			state._slice_id = _eqms[iface]->slice_id(ssid);
 		}
 
+		_vaps.set(net_bssid, state);
+		update_iface_lists();
+
+		/* Regenerate the BSSID mask */
+		update_bssid_mask(_vaps.get_pointer(net_bssid));
+
 		return 0;
 
 	}
@@ -1412,9 +2435,10 @@ int EmpowerLVAPManager::handle_del_vap(Packet *p, uint32_t offset) {
 	}
 
 	_vaps.erase(_vaps.find(net_bssid));
+	update_iface_lists();
 
 	// Remove this VAP's BSSID from the mask
-	compute_bssid_mask();
+	forget_bssid_mask(_mask_vaps, net_bssid);
 
 	return 0;
 
@@ -1422,22 +2446,27 @@ int EmpowerLVAPManager::handle_del_vap(Packet *p, uint32_t offset) {
 
 int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 
-	struct empower_add_lvap *add_lvap = (struct empower_add_lvap *) (p->data() + offset);
+	EmpowerView<empower_add_lvap> add_lvap(p, offset);
 
 	EtherAddress sta = add_lvap->sta();
 	EtherAddress net_bssid = add_lvap->net_bssid();
 	EtherAddress lvap_bssid = add_lvap->lvap_bssid();
-	Vector<String> ssids;
+	SmallVector<String, 3> ssids;
 
-	uint8_t *ptr = (uint8_t *) add_lvap;
-	ptr += sizeof(struct empower_add_lvap);
-	uint8_t *end = ptr + (add_lvap->length() - sizeof(struct empower_add_lvap));
+	EmpowerCursor cursor = add_lvap.trailer();
 
-	while (ptr != end) {
-		assert (ptr <= end);
-		ssid_entry *entry = (ssid_entry *) ptr;
-		ssids.push_back(entry->ssid());
-		ptr += entry->length() + 1;
+	while (!cursor.done()) {
+		ssid_entry *entry = cursor.next<ssid_entry>();
+		if (entry) {
+			ssids.push_back(entry->ssid());
+		}
+	}
+
+	if (!cursor.ok()) {
+		click_chatter("%{element} :: %s :: truncated ssid list",
+				      this,
+				      __func__);
+		return 0;
 	}
 
 	if (ssids.size() < 2) {
@@ -1459,6 +2488,8 @@ int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 	bool authentication_state = add_lvap->flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
 	bool association_state = add_lvap->flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
 	bool set_mask = add_lvap->flag(EMPOWER_STATUS_LVAP_SET_MASK);
+	bool preauthorized = add_lvap->flag(EMPOWER_STATUS_LVAP_PREAUTHORIZED);
+	bool staged = add_lvap->flag(EMPOWER_STATUS_LVAP_STAGED);
 	EtherAddress encap = add_lvap->encap();
 	uint32_t module_id = add_lvap->module_id();
 
@@ -1513,9 +2544,13 @@ int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 		state._set_mask = set_mask;
 		state._authentication_status = authentication_state;
 		state._association_status = association_state;
+		state._preauthorized = preauthorized;
+		state._staged = staged;
 		state._set_mask = set_mask;
 		state._ssid = ssid;
+		state._slice_id = -1;
 		state._iface_id = iface;
+		intern_ssids(&state);
 
 		// set the CSA values to their default
 		state._csa_active = false;
@@ -1529,10 +2564,31 @@ int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 		state._add_lvap_module_id = 0;
 		state._del_lvap_module_id = 0;
 
+		// build the downlink 802.11 header template
+		state._wifi_hdr.build(sta, lvap_bssid);
+
+		// a new LVAP awaits its first frames, on a handover its timeline
+		// starts here
+		state._timeline = 0;
+		if (timeline(sta, LVAPTimeline::ADD_LVAP)) {
+			state._timeline = LVAPTimeline::AWAIT_UL | LVAPTimeline::AWAIT_DL;
+		}
+
 		_lvaps.set(sta, state);
 
+		// a staged LVAP gets its rate control entry now rather than with
+		// its first frame
+		if (staged && !_rcs[iface]->neighbors()->findp(sta)) {
+			_rcs[iface]->insert_neighbor(sta, _rcs[iface]->tx_policies()->lookup(sta));
+		}
+
 		/* Regenerate the BSSID mask */
-		compute_bssid_mask();
+		update_bssid_mask(_lvaps.get_pointer(sta));
+
+		// the mask is in place already unless a write is pending
+		if (set_mask && !_mask_timer.scheduled()) {
+			timeline(sta, LVAPTimeline::MASK);
+		}
 
 		/* send add lvap response message */
 		send_add_del_lvap_response(EMPOWER_PT_ADD_LVAP_RESPONSE, state._sta, module_id, 0);
@@ -1541,8 +2597,13 @@ int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 		if (ssid != "") {
 			// TODO: for the moment assume that at worst a 1500 bytes frame can be sent in 12000 usec
 			_eqms[iface]->set_traffic_rule(ssid, 0, 12000, false);
+			_lvaps.get_pointer(sta)->_slice_id = _eqms[iface]->slice_id(ssid);
 		}
 
+		update_iface_lists();
+
+		seed_pending_imports(_lvaps.get_pointer(sta));
+
 		return 0;
 
 	}
@@ -1596,9 +2657,18 @@ int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 	ess->_assoc_id = assoc_id;
 	ess->_authentication_status = authentication_state;
 	ess->_association_status = association_state;
+	ess->_preauthorized = preauthorized;
+	// an update without the flag activates a staged LVAP
+	ess->_staged = ess->_staged && staged;
 	ess->_supported_band = supported_band;
 	ess->_set_mask = set_mask;
 	ess->_ssid = ssid;
+	ess->_slice_id = -1;
+	intern_ssids(ess);
+	ess->_wifi_hdr.build(ess->_sta, ess->_lvap_bssid);
+
+	/* set mask flag may have changed */
+	update_bssid_mask(ess);
 
 	/* send add lvap response message */
 	send_add_del_lvap_response(EMPOWER_PT_ADD_LVAP_RESPONSE, ess->_sta, module_id, 0);
@@ -1607,43 +2677,42 @@ int EmpowerLVAPManager::handle_add_lvap(Packet *p, uint32_t offset) {
 	if (ssid != "") {
 		// TODO: for the moment assume that at worst a 1500 bytes frame can be sent in 12000 usec
 		_eqms[iface]->set_traffic_rule(ssid, 0, 12000, false);
+		ess->_slice_id = _eqms[iface]->slice_id(ssid);
 	}
 
+	update_iface_lists();
+
+	seed_pending_imports(ess);
+
 	return 0;
 
 }
 
 void EmpowerLVAPManager::send_add_del_lvap_response(uint8_t type, EtherAddress sta, uint32_t module_id, uint32_t status) {
 
-	WritablePacket *p = Packet::make(sizeof(empower_add_del_lvap_response));
+	EmpowerMessage msg;
+	empower_add_del_lvap_response *resp = msg.start<empower_add_del_lvap_response>(type, get_next_seq());
 
-	if (!p) {
+	if (!resp) {
 		click_chatter("%{element} :: %s :: cannot make packet!",
 					  this,
 					  __func__);
 		return;
 	}
 
-	memset(p->data(), 0, p->length());
-
-	empower_add_del_lvap_response *resp = (struct empower_add_del_lvap_response *) (p->data());
-	resp->set_version(_empower_version);
-	resp->set_length(sizeof(empower_add_del_lvap_response));
-	resp->set_type(type);
-	resp->set_seq(get_next_seq());
 	resp->set_sta(sta);
 	resp->set_module_id(module_id);
 	resp->set_status(status);
 	resp->set_wtp(_wtp);
 
-	send_message(p);
+	send_message(msg.finish(), true);
 
 }
 
 
 int EmpowerLVAPManager::handle_set_port(Packet *p, uint32_t offset) {
 
-	struct empower_set_port *q = (struct empower_set_port *) (p->data() + offset);
+	EmpowerView<empower_set_port> q(p, offset);
 
 	EtherAddress addr = q->addr();
 	EtherAddress hwaddr = q->hwaddr();
@@ -1654,29 +2723,28 @@ int EmpowerLVAPManager::handle_set_port(Packet *p, uint32_t offset) {
 	uint16_t rts_cts = q->rts_cts();
 	empower_tx_mcast_type tx_mcast = q->tx_mcast();
 	uint8_t ur = q->ur_mcast_count();
-	Vector<int> mcs;
-	Vector<int> ht_mcs;
+	TxPolicyRates mcs;
+	TxPolicyRates ht_mcs;
 
-	uint8_t *ptr = (uint8_t *) q;
-	ptr += sizeof(struct empower_set_port);
-	uint8_t *end = ptr + (q->length() - sizeof(struct empower_set_port));
+	EmpowerCursor cursor = q.trailer();
+	const uint8_t *rates = cursor.bytes(q->nb_mcs());
+	const uint8_t *ht_rates = cursor.bytes(q->nb_ht_mcs());
 
-	for (int x = 0; x < q->nb_mcs(); x++) {
-		assert (ptr <= end);
-		mcs.push_back(*ptr);
-		ptr++;
+	if (!cursor.ok()) {
+		click_chatter("%{element} :: %s :: truncated rate list",
+				      this,
+				      __func__);
+		return 0;
 	}
 
-	assert(mcs.size() == q->nb_mcs());
+	for (int x = 0; x < q->nb_mcs(); x++) {
+		mcs.push_back(rates[x]);
+	}
 
 	for (int x = 0; x < q->nb_ht_mcs(); x++) {
-		assert (ptr <= end);
-		ht_mcs.push_back(*ptr);
-		ptr++;
+		ht_mcs.push_back(ht_rates[x]);
 	}
 
-	assert(ht_mcs.size() == q->nb_ht_mcs());
-
 	int iface = element_to_iface(hwaddr, channel, band);
 
 	if (iface == -1) {
@@ -1692,16 +2760,20 @@ int EmpowerLVAPManager::handle_set_port(Packet *p, uint32_t offset) {
 	_rcs[iface]->tx_policies()->insert(addr, mcs, ht_mcs, no_ack, tx_mcast, ur, rts_cts);
 	_rcs[iface]->forget_station(addr);
 
+	if (_state_file) {
+		_state_file->put("P" + String(iface) + " " + addr.unparse(), p->data() + offset, q->length());
+	}
+
 	MinstrelDstInfo *nfo = _rcs.at(iface)->neighbors()->findp(addr);
 
-	if (!nfo || !nfo->rates.size()) {
+	if (!nfo || !nfo->nrates) {
 		if (_debug) {
 			click_chatter("%{element} :: %s :: adding %s",
 					      this,
 						  __func__,
 						  addr.unparse().c_str());
 		}
-		TxPolicyInfo * txp = _rcs[iface]->tx_policies()->tx_table()->find(addr);
+		TxPolicyInfo * txp = _rcs[iface]->tx_policies()->tx_table()->get(addr);
 		nfo = _rcs.at(iface)->insert_neighbor(addr, txp);
 	}
 
@@ -1735,10 +2807,43 @@ int EmpowerLVAPManager::handle_del_port(Packet *p, uint32_t offset) {
 	_rcs[iface]->tx_policies()->remove(addr);
 	_rcs[iface]->forget_station(addr);
 
+	if (_state_file) {
+		_state_file->remove("P" + String(iface) + " " + addr.unparse());
+	}
+
 	return 0;
 
 }
 
+int EmpowerLVAPManager::handle_set_lvap_rate(Packet *p, uint32_t offset) {
+
+	struct empower_set_lvap_rate *q = (struct empower_set_lvap_rate *) (p->data() + offset);
+
+	EtherAddress sta = q->sta();
+	EmpowerStationState *ess = _lvaps.get_pointer(sta);
+
+	if (!ess) {
+		click_chatter("%{element} :: %s :: unable to find LVAP %s",
+					  this,
+					  __func__,
+					  sta.unparse().c_str());
+		return 0;
+	}
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: sta %s rate %u burst %u",
+					  this,
+					  __func__,
+					  sta.unparse().c_str(),
+					  q->rate(),
+					  q->burst());
+	}
+
+	_eqms[ess->_iface_id]->set_station_rate(sta, q->rate(), q->burst());
+
+	return 0;
+
+}
 
 int EmpowerLVAPManager::handle_add_rssi_trigger(Packet *p, uint32_t offset) {
 	struct empower_add_rssi_trigger *q = (struct empower_add_rssi_trigger *) (p->data() + offset);
@@ -1768,33 +2873,147 @@ int EmpowerLVAPManager::handle_del_summary_trigger(Packet *p, uint32_t offset) {
 	return 0;
 }
 
-int EmpowerLVAPManager::handle_del_lvap(Packet *p, uint32_t offset) {
-
-	struct empower_del_lvap *q = (struct empower_del_lvap *) (p->data() + offset);
-	EtherAddress sta = q->sta();
-	uint32_t module_id = q->module_id();
+void send_stats_stream_callback(TimerWheelEntry *timer, void *data) {
+	StatsStream *stream = (StatsStream *) data;
+	stream->_el->send_stats_stream(stream);
+	// re-schedule the timer
+	timer->schedule_after_msec(stream->_period);
+}
 
-	if (_debug) {
-		click_chatter("%{element} :: %s :: sta %s",
-				      this,
-				      __func__,
-				      sta.unparse_colon().c_str());
-	}
+int EmpowerLVAPManager::handle_add_stats_stream(Packet *p, uint32_t offset) {
 
-	// First make sure that this LVAP isn't here already, in which
-	// case we'll just ignore the request
-	if (_lvaps.find(sta) == _lvaps.end()) {
-		click_chatter("%{element} :: %s :: Ignoring LVAP delete request because the agent isn't hosting the LVAP",
-				      this,
-				      __func__);
+	struct empower_add_stats_stream *q = (struct empower_add_stats_stream *) (p->data() + offset);
 
+	if (q->period() == 0) {
+		click_chatter("%{element} :: %s :: invalid period for stream %u, ignoring",
+					  this,
+					  __func__,
+					  q->stream_id());
 		return -1;
 	}
 
-	EmpowerStationState *ess = _lvaps.get_pointer(sta);
+	for (SSIter it = _streams.begin(); it != _streams.end(); it++) {
+		if ((*it)->_stream_id == q->stream_id()) {
+			click_chatter("%{element} :: %s :: stream %u already defined, ignoring",
+						  this,
+						  __func__,
+						  q->stream_id());
+			return -1;
+		}
+	}
 
-	// If the BSSIDs are different, this is a shared lvap and a deauth message should be sent before removing the lvap
-	// CSA is not supported for shared LVAPs
+	add_stats_stream(q->stream_id(), q->period(), q->fields());
+
+	return 0;
+
+}
+
+void EmpowerLVAPManager::add_stats_stream(uint32_t stream_id, uint16_t period, uint16_t fields) {
+	StatsStream *stream = new StatsStream(stream_id, period, fields, this);
+	stream->_rules.resize(_eqms.size());
+	stream->_stream_timer->assign(&send_stats_stream_callback, (void *) stream);
+	stream->_stream_timer->schedule_after_msec(&_streams_wheel, stream->_period);
+	_streams.push_back(stream);
+}
+
+int EmpowerLVAPManager::handle_del_stats_stream(Packet *p, uint32_t offset) {
+	struct empower_del_stats_stream *q = (struct empower_del_stats_stream *) (p->data() + offset);
+	for (SSIter it = _streams.begin(); it != _streams.end(); it++) {
+		if ((*it)->_stream_id == q->stream_id()) {
+			// the order of the streams does not matter
+			delete *it;
+			*it = _streams.back();
+			_streams.pop_back();
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int EmpowerLVAPManager::handle_add_mirror(Packet *p, uint32_t offset) {
+
+	struct empower_add_mirror *q = (struct empower_add_mirror *) (p->data() + offset);
+
+#if CLICK_USERLEVEL
+	if (_mirror && _mirror->add_mirror(q->mirror_id(), q->sta(), q->addr(), q->port(), q->snaplen(), q->rate()) == 0) {
+		return 0;
+	}
+#endif
+
+	click_chatter("%{element} :: %s :: cannot add mirror %u for %s, ignoring",
+				  this,
+				  __func__,
+				  q->mirror_id(),
+				  q->sta().unparse_colon().c_str());
+
+	return -1;
+
+}
+
+int EmpowerLVAPManager::handle_del_mirror(Packet *p, uint32_t offset) {
+	struct empower_del_mirror *q = (struct empower_del_mirror *) (p->data() + offset);
+#if CLICK_USERLEVEL
+	if (_mirror && _mirror->del_mirror(q->mirror_id())) {
+		return 0;
+	}
+#else
+	(void) q;
+#endif
+	return -1;
+}
+
+int EmpowerLVAPManager::handle_set_rx_sample(Packet *p, uint32_t offset) {
+	struct empower_set_rx_sample *q = (struct empower_set_rx_sample *) (p->data() + offset);
+	return _ers->set_data_sample(q->data_sample());
+}
+
+int EmpowerLVAPManager::handle_set_ssid_vlan(Packet *p, uint32_t offset) {
+	struct empower_set_ssid_vlan *q = (struct empower_set_ssid_vlan *) (p->data() + offset);
+	int id = _ssid_table.intern(q->ssid());
+	if (id < 0) {
+		return -1;
+	}
+	if (_ssid_table.vlan(id) != q->vlan_tci()) {
+		_ssid_table.set_vlan(id, q->vlan_tci());
+		update_iface_lists();
+	}
+	return 0;
+}
+
+void EmpowerLVAPManager::clear_stats_streams() {
+	for (SSIter it = _streams.begin(); it != _streams.end(); it++) {
+		delete *it;
+	}
+	_streams.clear();
+}
+
+int EmpowerLVAPManager::handle_del_lvap(Packet *p, uint32_t offset) {
+
+	struct empower_del_lvap *q = (struct empower_del_lvap *) (p->data() + offset);
+	EtherAddress sta = q->sta();
+	uint32_t module_id = q->module_id();
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: sta %s",
+				      this,
+				      __func__,
+				      sta.unparse_colon().c_str());
+	}
+
+	// First make sure that this LVAP isn't here already, in which
+	// case we'll just ignore the request
+	if (_lvaps.find(sta) == _lvaps.end()) {
+		click_chatter("%{element} :: %s :: Ignoring LVAP delete request because the agent isn't hosting the LVAP",
+				      this,
+				      __func__);
+
+		return -1;
+	}
+
+	EmpowerStationState *ess = _lvaps.get_pointer(sta);
+
+	// If the BSSIDs are different, this is a shared lvap and a deauth message should be sent before removing the lvap
+	// CSA is not supported for shared LVAPs
 	if (ess->_lvap_bssid != ess->_net_bssid) {
 		// send de-auth
 		_edeauthr->send_deauth_request(ess->_sta, 0x0001, ess->_iface_id);
@@ -1846,6 +3065,11 @@ int EmpowerLVAPManager::handle_del_lvap(Packet *p, uint32_t offset) {
 
 	}
 
+	// hand the frames still queued over to the target WTP
+	if (_export_queues) {
+		export_queues(ess);
+	}
+
 	// remove lvap
 	remove_lvap(ess);
 
@@ -1856,22 +3080,636 @@ int EmpowerLVAPManager::handle_del_lvap(Packet *p, uint32_t offset) {
 
 }
 
-int EmpowerLVAPManager::remove_lvap(EmpowerStationState *ess) {
+static bool match_prefix(const EtherAddress &addr, const EtherAddress &prefix, int len) {
+	const uint8_t *a = addr.data();
+	const uint8_t *b = prefix.data();
+	int i = 0;
+	for (; len >= 8; len -= 8, i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+	}
+	return !len || !((a[i] ^ b[i]) & (0xff << (8 - len)));
+}
+
+int EmpowerLVAPManager::handle_del_lvaps(Packet *p, uint32_t offset) {
+
+	struct empower_del_lvaps *q = (struct empower_del_lvaps *) (p->data() + offset);
+	EtherAddress prefix = q->sta();
+	int prefix_len = q->prefix_len();
+	uint32_t module_id = q->module_id();
+
+	if (prefix_len > 48) {
+		click_chatter("%{element} :: %s :: invalid prefix length %d",
+				      this,
+				      __func__,
+				      prefix_len);
+		return -1;
+	}
+
+	Vector<EtherAddress> stas;
+
+	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+		EmpowerStationState *ess = &it.value();
+		if (!match_prefix(ess->_sta, prefix, prefix_len)) {
+			continue;
+		}
+		// shared LVAPs are told to go away, as in handle_del_lvap()
+		if (ess->_lvap_bssid != ess->_net_bssid) {
+			_edeauthr->send_deauth_request(ess->_sta, 0x0001, ess->_iface_id);
+			if (_mtbl) {
+				_mtbl->leaveallgroups(ess->_sta);
+			}
+		}
+		stas.push_back(ess->_sta);
+	}
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: prefix %s/%d, %d lvaps",
+				      this,
+				      __func__,
+				      prefix.unparse_colon().c_str(),
+				      prefix_len,
+				      stas.size());
+	}
+
+	remove_lvaps(stas);
+
+	for (int i = 0; i < stas.size(); i++) {
+		send_add_del_lvap_response(EMPOWER_PT_DEL_LVAP_RESPONSE, stas[i], module_id, 0);
+	}
+
+	return 0;
+
+}
+
+int EmpowerLVAPManager::handle_echo_request(Packet *p, uint32_t offset) {
+
+	struct empower_echo_request *q = (struct empower_echo_request *) (p->data() + offset);
+
+	// the echo is a timestamp of send_hello(), on this clock
+	if (uint64_t echo = q->echo()) {
+		uint64_t now = Timestamp::now_steady().usecval();
+		if (now >= echo) {
+			_rtt.add(now - echo < 0xFFFFFFFFU ? now - echo : 0xFFFFFFFFU);
+		}
+	}
+
+	EmpowerMessage msg;
+	empower_echo_response *response = msg.start<empower_echo_response>(EMPOWER_PT_ECHO_RESPONSE, get_next_seq());
+
+	if (!response) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return 0;
+	}
+
+	response->set_wtp(_wtp);
+	response->set_timestamp(q->timestamp());
+	response->set_queue(_queue_usecs);
+
+	send_message(msg.finish());
+
+	return 0;
+
+}
+
+int EmpowerLVAPManager::handle_activate_lvap(Packet *p, uint32_t offset) {
+
+	struct empower_activate_lvap *q = (struct empower_activate_lvap *) (p->data() + offset);
+	EtherAddress sta = q->sta();
+	EmpowerStationState *ess = _lvaps.get_pointer(sta);
+
+	if (!ess || !ess->_staged) {
+		click_chatter("%{element} :: %s :: no staged LVAP %s",
+					  this,
+					  __func__,
+					  sta.unparse_colon().c_str());
+		return 0;
+	}
+
+	// everything else is in place since ADD_LVAP, the next snapshot
+	// picks the flag up from ess
+	ess->_staged = false;
+	snapshot()->activate(sta);
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: sta %s",
+					  this,
+					  __func__,
+					  sta.unparse_colon().c_str());
+	}
+
+	send_status_lvap(sta);
+
+	return 0;
+
+}
+
+void EmpowerLVAPManager::export_queues(EmpowerStationState *ess) {
+
+	Vector<Packet *> frames;
+	Vector<int> dscps;
+
+	_eqms[ess->_iface_id]->steal_station(ess->_sta, frames, dscps);
+
+	EmpowerMessage msg;
+	uint16_t nb_frames = 0;
+	uint32_t exported = 0;
+
+	for (int i = 0; i < frames.size(); i++) {
+
+		Packet *p = frames[i];
+		uint32_t length = sizeof(queue_frame_entry) + p->length();
+
+		if (p->length() > 0xFFFF) {
+			p->kill();
+			continue;
+		}
+
+		if (nb_frames && (msg.length() + length > _egress_size || nb_frames == 0xFFFF)) {
+			msg.header<empower_queue_frames>()->set_nb_frames(nb_frames);
+			send_message(msg.finish());
+			nb_frames = 0;
+		}
+
+		if (!msg.length()) {
+			empower_queue_frames *hdr = msg.start<empower_queue_frames>(EMPOWER_PT_QUEUE_EXPORT, get_next_seq());
+			if (!hdr) {
+				p->kill();
+				continue;
+			}
+			hdr->set_wtp(_wtp);
+			hdr->set_sta(ess->_sta);
+		}
+
+		queue_frame_entry *entry = (queue_frame_entry *) msg.append(length);
+		if (!entry) {
+			p->kill();
+			continue;
+		}
+
+		entry->set_dscp(dscps[i]);
+		entry->set_length(p->length());
+		memcpy(entry + 1, p->data(), p->length());
+		nb_frames++;
+		exported++;
+
+		p->kill();
+
+	}
+
+	if (nb_frames) {
+		msg.header<empower_queue_frames>()->set_nb_frames(nb_frames);
+		send_message(msg.finish());
+	}
+
+	if (_debug && frames.size()) {
+		click_chatter("%{element} :: %s :: sta %s exported %u/%u frames",
+					  this,
+					  __func__,
+					  ess->_sta.unparse_colon().c_str(),
+					  exported,
+					  frames.size());
+	}
+
+}
+
+int EmpowerLVAPManager::handle_queue_import(Packet *p, uint32_t offset) {
+
+	struct empower_queue_frames *q = (struct empower_queue_frames *) (p->data() + offset);
+	EtherAddress sta = q->sta();
+	EmpowerStationState *ess = _lvaps.get_pointer(sta);
+
+	if (ess) {
+		seed_queues(ess, p, offset);
+		return 0;
+	}
+
+	// the ADD_LVAP is still on its way, keep a copy for it and forget
+	// those that never got one, a second after their first message
+	Timestamp now = Timestamp::recent();
+	HashTable<EtherAddress, Packet *>::iterator it = _pending_imports.begin();
+	while (it.live()) {
+		if (now - it.value()->timestamp_anno() > Timestamp::make_sec(1)) {
+			kill_pending_imports(it.value());
+			it = _pending_imports.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	WritablePacket *copy = Packet::make(p->data() + offset, q->length());
+	if (!copy) {
+		return 0;
+	}
+	copy->set_timestamp_anno(now);
+
+	// the frames of a station may take several messages, they are
+	// chained in the order they came
+	Packet **pending = _pending_imports.get_pointer(sta);
+	if (pending) {
+		Packet *last = *pending;
+		while (last->next()) {
+			last = last->next();
+		}
+		last->set_next(copy);
+	} else {
+		_pending_imports.set(sta, copy);
+	}
+
+	return 0;
+
+}
+
+void EmpowerLVAPManager::seed_pending_imports(EmpowerStationState *ess) {
+	Packet **pending = _pending_imports.get_pointer(ess->_sta);
+	if (!pending) {
+		return;
+	}
+	Packet *p = *pending;
+	_pending_imports.erase(ess->_sta);
+	while (p) {
+		Packet *next = p->next();
+		p->set_next(0);
+		seed_queues(ess, p, 0);
+		p->kill();
+		p = next;
+	}
+}
+
+void EmpowerLVAPManager::kill_pending_imports(Packet *p) {
+	while (p) {
+		Packet *next = p->next();
+		p->set_next(0);
+		p->kill();
+		p = next;
+	}
+}
+
+// Queue the frames of the QUEUE_IMPORT message at offset of p for ess
+void EmpowerLVAPManager::seed_queues(EmpowerStationState *ess, Packet *p, uint32_t offset) {
+
+	EmpowerView<empower_queue_frames> q(p, offset);
+	EmpowerCursor cursor = q.trailer();
+	uint16_t nb_frames = q->nb_frames();
+	uint16_t seeded = 0;
+
+	if (ess->_slice_id < 0 || !ess->_set_mask) {
+		return;
+	}
+
+	for (uint16_t i = 0; i < nb_frames; i++) {
+		queue_frame_entry *entry = cursor.next<queue_frame_entry>();
+		const uint8_t *data = cursor.bytes(entry ? entry->length() : 0);
+		if (!entry || !data || entry->length() < sizeof(click_ether)) {
+			break;
+		}
+		WritablePacket *frame = Packet::make(data, entry->length());
+		if (!frame) {
+			break;
+		}
+		_eqms[ess->_iface_id]->seed(ess->_slice_id, entry->dscp(), frame, ess->_sta, ess->_lvap_bssid);
+		seeded++;
+	}
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: sta %s imported %u/%u frames",
+					  this,
+					  __func__,
+					  ess->_sta.unparse_colon().c_str(),
+					  seeded,
+					  nb_frames);
+	}
+
+}
+
+EmpowerStationHotTable::EmpowerStationHotTable(LVAP &lvaps, VAP &vaps, const EmpowerSSIDTable &ssids, int nifaces,
+		uint32_t generation) :
+		_generation(generation), _activations(0) {
+
+	for (int i = 0; i < ssids.size(); i++) {
+		_ssids.push_back(ssids.ssid(i));
+	}
+
+	uint32_t size = 16;
+	while (size < 2 * (uint32_t) lvaps.size()) {
+		size <<= 1;
+	}
+
+	_slots = new EmpowerStationHot[size];
+	_hdrs = new EmpowerWifiHeader[size];
+	_mask = size - 1;
+	_lvaps.resize(nifaces);
+	_vaps.resize(nifaces);
+
+	for (LVAPIter it = lvaps.begin(); it.live(); it++) {
+		EmpowerStationState *ess = &it.value();
+		uint32_t i = ess->_sta.hashcode() & _mask;
+		while (_slots[i]._used) {
+			i = (i + 1) & _mask;
+		}
+		EmpowerStationHot *hot = &_slots[i];
+		hot->_sta = ess->_sta;
+		hot->_net_bssid = ess->_net_bssid;
+		hot->_lvap_bssid = ess->_lvap_bssid;
+		hot->_encap = ess->_encap;
+		hot->_used = true;
+		hot->_set_mask = ess->_set_mask;
+		hot->_authentication_status = ess->_authentication_status;
+		hot->_association_status = ess->_association_status;
+		hot->_iface_id = ess->_iface_id;
+		hot->_slice_id = ess->_slice_id;
+		hot->_ssid_id = ess->_ssid_id;
+		hot->_vlan_tci = ssids.vlan(ess->_ssid_id);
+		hot->_staged = ess->_staged;
+		hot->_timeline = ess->_timeline;
+		_hdrs[i] = ess->_wifi_hdr;
+	}
+
+	for (uint32_t i = 0; i < size; i++) {
+		const EmpowerStationHot *hot = &_slots[i];
+		if (!hot->_used || hot->_iface_id < 0 || hot->_iface_id >= nifaces) {
+			continue;
+		}
+		if (!hot->_set_mask || !hot->_authentication_status || !hot->_association_status) {
+			continue;
+		}
+		_lvaps[hot->_iface_id].push_back(hot);
+	}
+
+	for (VAPIter it = vaps.begin(); it.live(); it++) {
+		EmpowerVAPState *evs = &it.value();
+		if (evs->_iface_id < 0 || evs->_iface_id >= nifaces) {
+			continue;
+		}
+		EmpowerVAPHot vap;
+		vap._net_bssid = evs->_net_bssid;
+		vap._slice_id = evs->_slice_id;
+		vap._ssid_id = evs->_ssid_id;
+		_vaps[evs->_iface_id].push_back(vap);
+	}
+
+}
+
+void EmpowerLVAPManager::update_iface_lists() {
+
+	// zero is what empty cache entries hold
+	if (++_snapshot_generation == 0) {
+		++_snapshot_generation;
+	}
+	EmpowerStationHotTable *next = new EmpowerStationHotTable(_lvaps, _vaps, _ssid_table, num_ifaces(), _snapshot_generation);
+
+	update_vap_index();
+
+	_snapshot_lock.acquire();
+
+	// publish the new snapshot, the old one goes away once no reader
+	// can be using it
+	EmpowerStationHotTable *prev = _snapshot;
+	click_write_fence();
+	_snapshot = next;
+
+	if (prev) {
+		_retired.push_back(prev);
+		_retired_epochs.push_back(_epoch.retire());
+	}
+
+	reclaim_snapshots();
+
+	_snapshot_lock.release();
+
+	// replayed records are saved once the whole file has been replayed
+	if (_state_file && !_restoring) {
+		save_iface_lists();
+	}
+
+	update_rx_filters();
+
+}
+
+void EmpowerLVAPManager::update_rx_filters() {
+
+#if CLICK_USERLEVEL
+	if (!_rx_devs.size()) {
+		return;
+	}
+
+	_rx_filters_lock.acquire();
+
+	for (int i = 0; i < _rx_devs.size(); i++) {
+
+		Vector<EtherAddress> tas;
+		bool all = false;
+
+		{
+			EmpowerEpoch::Guard guard(&_epoch);
+			const LVAPList &lvaps = associated_lvaps(i);
+			for (int j = 0; j < lvaps.size(); j++) {
+				tas.push_back(lvaps[j]->_sta);
+			}
+		}
+
+		NeighborShard *shard = _ers->shard(i);
+		if (shard) {
+			shard->lock.acquire_read();
+			for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
+				if ((*qi)->_eth.is_broadcast()) {
+					all = true;
+				} else {
+					tas.push_back((*qi)->_eth);
+				}
+			}
+			shard->lock.release_read();
+		}
+
+		// the socket is opened when the FromDevice is initialized, the
+		// filter is then installed by the next call
+		int err = _rx_filters[i].update(_rx_devs[i]->fd(), tas, all);
+		if (err) {
+			click_chatter("%{element} :: %s :: cannot filter interface %d: %s",
+						  this,
+						  __func__,
+						  i,
+						  strerror(err));
+		}
+
+	}
+
+	_rx_filters_lock.release();
+#endif
+
+}
+
+void EmpowerLVAPManager::update_vap_index() {
+	_vap_index.clear();
+	for (VAPIter it = _vaps.begin(); it.live(); it++) {
+		const EmpowerVAPState &evs = it.value();
+		_vap_index[vap_index_key(evs._iface_id, -1)].push_back(evs._net_bssid);
+		if (evs._ssid_id >= 0) {
+			_vap_index[vap_index_key(evs._iface_id, evs._ssid_id)].push_back(evs._net_bssid);
+		}
+	}
+}
+
+void EmpowerLVAPManager::reclaim_snapshots() {
+	int kept = 0;
+	for (int i = 0; i < _retired.size(); i++) {
+		if (_epoch.quiescent(_retired_epochs[i])) {
+			delete _retired[i];
+		} else {
+			_retired[kept] = _retired[i];
+			_retired_epochs[kept] = _retired_epochs[i];
+			kept++;
+		}
+	}
+	_retired.resize(kept);
+	_retired_epochs.resize(kept);
+}
+
+void EmpowerLVAPManager::intern_ssids(EmpowerStationState *ess) {
+	ess->_ssid_id = _ssid_table.intern(ess->_ssid);
+	ess->_ssid_ids.clear();
+	for (int i = 0; i < ess->_ssids.size(); i++) {
+		ess->_ssid_ids.push_back(_ssid_table.intern(ess->_ssids[i]));
+	}
+}
+
+bool EmpowerLVAPManager::admit_auth(EmpowerStationState *ess, EtherAddress bssid) {
+
+	if (!ess->_preauthorized) {
+		return false;
+	}
+
+	// the LVAP's own BSSID, or a shared one of its SSIDs on its interface
+	if (bssid != ess->_net_bssid) {
+		EmpowerVAPState *evs = _vaps.get_pointer(bssid);
+		if (!evs || evs->_iface_id != ess->_iface_id) {
+			return false;
+		}
+		bool found = false;
+		for (int i = 0; i < ess->_ssid_ids.size() && !found; i++) {
+			found = ess->_ssid_ids[i] == evs->_ssid_id;
+		}
+		if (!found) {
+			return false;
+		}
+	}
+
+	if (ess->_lvap_bssid != bssid) {
+		ess->_lvap_bssid = bssid;
+		ess->_wifi_hdr.build(ess->_sta, ess->_lvap_bssid);
+	}
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: sta %s bssid %s admitted locally",
+					  this,
+					  __func__,
+					  ess->_sta.unparse_colon().c_str(),
+					  bssid.unparse_colon().c_str());
+	}
+
+	return true;
+
+}
+
+bool EmpowerLVAPManager::admit_assoc(EmpowerStationState *ess, String ssid, empower_bands_types supported_band) {
+
+	if (!ess->_preauthorized) {
+		return false;
+	}
+
+	// an SSID no LVAP or VAP has is not served here
+	int ssid_id = _ssid_table.lookup(ssid);
+	if (ssid_id < 0) {
+		return false;
+	}
+
+	// a shared BSSID serves its own SSID only
+	if (ess->_lvap_bssid != ess->_net_bssid) {
+		EmpowerVAPState *evs = _vaps.get_pointer(ess->_lvap_bssid);
+		if (!evs || evs->_ssid_id != ssid_id) {
+			return false;
+		}
+	}
+
+	bool found = false;
+	for (int i = 0; i < ess->_ssid_ids.size() && !found; i++) {
+		found = ess->_ssid_ids[i] == ssid_id;
+	}
+	if (!found) {
+		return false;
+	}
+
+	ess->_ssid = ssid;
+	ess->_ssid_id = ssid_id;
+	ess->_supported_band = supported_band;
+
+	// TODO: for the moment assume that at worst a 1500 bytes frame can be sent in 12000 usec
+	_eqms[ess->_iface_id]->set_traffic_rule(ssid, 0, 12000, false);
+	ess->_slice_id = _eqms[ess->_iface_id]->slice_id(ssid);
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: sta %s ssid %s admitted locally",
+					  this,
+					  __func__,
+					  ess->_sta.unparse_colon().c_str(),
+					  ssid.c_str());
+	}
+
+	return true;
+
+}
+
+int EmpowerLVAPManager::remove_lvap(EmpowerStationState *ess, bool publish) {
 
 	// Forget station
-	_rcs[ess->_iface_id]->tx_policies()->tx_table()->erase(ess->_sta);
+	_rcs[ess->_iface_id]->tx_policies()->remove(ess->_sta);
 	_rcs[ess->_iface_id]->forget_station(ess->_sta);
 
+	if (_state_file) {
+		_state_file->remove("P" + String(ess->_iface_id) + " " + ess->_sta.unparse());
+	}
+
+	// Release its queues
+	_eqms[ess->_iface_id]->remove_station(ess->_sta);
+
+	// Remove this LVAP's BSSID from the mask
+	forget_bssid_mask(_mask_lvaps, ess->_sta);
+
 	// Erase lvap
 	_lvaps.erase(_lvaps.find(ess->_sta));
-
-	// Remove this VAP's BSSID from the mask
-	compute_bssid_mask();
+	if (publish) {
+		update_iface_lists();
+	}
 
 	return 0;
 
 }
 
+// The BSSID mask of each interface is updated as the LVAPs go and written
+// once by the mask timer, the snapshot is rebuilt once at the end.
+int EmpowerLVAPManager::remove_lvaps(const Vector<EtherAddress> &stas) {
+
+	int removed = 0;
+
+	for (int i = 0; i < stas.size(); i++) {
+		EmpowerStationState *ess = _lvaps.get_pointer(stas[i]);
+		if (ess) {
+			remove_lvap(ess, false);
+			removed++;
+		}
+	}
+
+	if (removed) {
+		update_iface_lists();
+	}
+
+	return removed;
+
+}
+
 int EmpowerLVAPManager::handle_probe_response(Packet *p, uint32_t offset) {
 
 	struct empower_probe_response *q = (struct empower_probe_response *) (p->data() + offset);
@@ -1913,6 +3751,7 @@ int EmpowerLVAPManager::handle_auth_response(Packet *p, uint32_t offset) {
 	EmpowerStationState *ess = _lvaps.get_pointer(sta);
 	ess->_authentication_status = true;
 	ess->_association_status = false;
+	update_iface_lists();
 	_eauthr->send_auth_response(ess->_sta, 2, WIFI_STATUS_SUCCESS, ess->_iface_id);
 	return 0;
 }
@@ -1949,6 +3788,67 @@ int EmpowerLVAPManager::handle_counters_request(Packet *p, uint32_t offset) {
 	return 0;
 }
 
+void EmpowerLVAPManager::send_history_response(uint32_t history_id, int iface_id, EtherAddress addr, int level, int nb_buckets) {
+
+	EmpowerMessage msg;
+	empower_history_response *history = msg.start<empower_history_response>(EMPOWER_PT_HISTORY_RESPONSE, get_next_seq());
+
+	if (!history) {
+		click_chatter("%{element} :: %s :: cannot make packet!",
+					  this,
+					  __func__);
+		return;
+	}
+
+	RollupBucket buckets[3][60];
+	uint32_t resolution = 0;
+	int nb_series = 0;
+	int nb = 0;
+
+	if (addr == EtherAddress()) {
+		// without REGMONS the response carries no series
+		static const empower_regmon_types types[] = { EMPOWER_REGMON_TX, EMPOWER_REGMON_RX, EMPOWER_REGMON_ED };
+		for (unsigned t = 0; _regmons.size() && t < sizeof(types) / sizeof(types[0]); t++) {
+			RegmonRegister *reg = _regmons[iface_id]->registers(types[t]);
+			resolution = reg->_rollup.resolution(level);
+			nb = reg->_rollup.history(level, nb_buckets, buckets[nb_series++]);
+		}
+	} else {
+		nb = _ers->rssi_history(iface_id, addr, level, nb_buckets, buckets[0], resolution);
+		if (nb >= 0) {
+			nb_series = 1;
+		}
+	}
+
+	for (int s = 0; s < nb_series; s++) {
+		for (int i = 0; i < nb; i++) {
+			history_entry *entry = msg.append<history_entry>();
+			if (!entry) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+							  this,
+							  __func__);
+				return;
+			}
+			const RollupBucket &b = buckets[s][i];
+			entry->set_count(b._count);
+			entry->set_mean(b.mean());
+			entry->set_min(b._min);
+			entry->set_max(b._max);
+		}
+	}
+
+	history = msg.header<empower_history_response>();
+	history->set_history_id(history_id);
+	history->set_wtp(_wtp);
+	history->set_addr(addr);
+	history->set_resolution(resolution);
+	history->set_nb_series(nb_series);
+	history->set_nb_buckets(nb_series ? nb : 0);
+
+	send_message(msg.finish());
+
+}
+
 int EmpowerLVAPManager::handle_wtp_counters_request(Packet *p, uint32_t offset) {
 	struct empower_wtp_counters_request *q = (struct empower_wtp_counters_request *) (p->data() + offset);
 	send_wtp_counters_response(q->counters_id());
@@ -1964,6 +3864,32 @@ int EmpowerLVAPManager::handle_wifi_stats_request(Packet *p, uint32_t offset) {
 	return 0;
 }
 
+int EmpowerLVAPManager::handle_history_request(Packet *p, uint32_t offset) {
+	struct empower_history_request *q = (struct empower_history_request *) (p->data() + offset);
+	EtherAddress hwaddr = q->hwaddr();
+	empower_bands_types band = (empower_bands_types) q->band();
+	uint8_t channel = q->channel();
+	int iface_id = element_to_iface(hwaddr, channel, band);
+	if (iface_id == -1) {
+		click_chatter("%{element} :: %s :: invalid resource element (%s, %u, %u)!",
+					  this,
+					  __func__,
+					  hwaddr.unparse().c_str(),
+					  channel,
+					  band);
+		return 0;
+	}
+	if (q->level() >= Rollup<1>::LEVELS) {
+		click_chatter("%{element} :: %s :: invalid level %u!",
+					  this,
+					  __func__,
+					  q->level());
+		return 0;
+	}
+	send_history_response(q->history_id(), iface_id, q->addr(), q->level(), q->nb_buckets());
+	return 0;
+}
+
 int EmpowerLVAPManager::handle_uimg_request(Packet *p, uint32_t offset) {
 	struct empower_cqm_request *q = (struct empower_cqm_request *) (p->data() + offset);
 	EtherAddress hwaddr = q->hwaddr();
@@ -2009,10 +3935,10 @@ int EmpowerLVAPManager::handle_incom_mcast_addr_response(Packet *p, uint32_t off
 
 	TxPolicyInfo* def_tx_policy = _rcs[iface]->tx_policies()->default_tx_policy();
 
-	Vector<int> mcs;
+	TxPolicyRates mcs;
 	mcs.push_back(*(def_tx_policy->_mcs.begin()));
 
-	Vector<int> ht_mcs;
+	TxPolicyRates ht_mcs;
 	ht_mcs.push_back(*(def_tx_policy->_ht_mcs.begin()));
 
 	_rcs[iface]->tx_policies()->insert(mcast_addr, mcs, ht_mcs, def_tx_policy->_no_ack, TX_MCAST_LEGACY, def_tx_policy->_ur_mcast_count, def_tx_policy->_rts_cts);
@@ -2036,6 +3962,16 @@ int EmpowerLVAPManager::handle_set_traffic_rule(Packet *p, uint32_t offset) {
 
 	int iface_id = element_to_iface(hwaddr, channel, band);
 
+	if (iface_id == -1) {
+		   click_chatter("%{element} :: %s :: invalid resource element (%s, %u, %u)!",
+									 this,
+									 __func__,
+									 hwaddr.unparse().c_str(),
+									 channel,
+									 band);
+		   return 0;
+	}
+
 	int dscp = add_traffic_rule->dscp();
 	String ssid = add_traffic_rule->ssid();
 	uint32_t quantum = add_traffic_rule->quantum();
@@ -2049,6 +3985,10 @@ int EmpowerLVAPManager::handle_set_traffic_rule(Packet *p, uint32_t offset) {
 
 	_eqms[iface_id]->set_traffic_rule(ssid, dscp, quantum, amsdu_aggregation);
 
+	if (_state_file) {
+		_state_file->put("R" + String(iface_id) + " " + String(dscp) + " " + ssid, p->data() + offset, add_traffic_rule->length());
+	}
+
 	return 0;
 
 }
@@ -2063,6 +4003,16 @@ int EmpowerLVAPManager::handle_del_traffic_rule(Packet *p, uint32_t offset) {
 
 	int iface_id = element_to_iface(hwaddr, channel, band);
 
+	if (iface_id == -1) {
+		   click_chatter("%{element} :: %s :: invalid resource element (%s, %u, %u)!",
+									 this,
+									 __func__,
+									 hwaddr.unparse().c_str(),
+									 channel,
+									 band);
+		   return 0;
+	}
+
 	int dscp = del_traffic_rule->dscp();
 	String ssid = del_traffic_rule->ssid();
 
@@ -2074,6 +4024,10 @@ int EmpowerLVAPManager::handle_del_traffic_rule(Packet *p, uint32_t offset) {
 
 	_eqms[iface_id]->del_traffic_rule(ssid, dscp);
 
+	if (_state_file) {
+		_state_file->remove("R" + String(iface_id) + " " + String(dscp) + " " + ssid);
+	}
+
 	return 0;
 
 }
@@ -2116,127 +4070,231 @@ int EmpowerLVAPManager::handle_del_mcast_receiver(Packet *p, uint32_t offset) {
 void EmpowerLVAPManager::push(int, Packet *p) {
 
 	/* This is a control packet coming from a Socket
-	 * element.
+	 * element. TCP keeps no message boundaries: a read can end in the
+	 * middle of a message, whose start is then kept in _rx_tail until
+	 * the rest arrives. Complete messages are dispatched in place.
 	 */
 
-	if (p->length() < sizeof(struct empower_header)) {
-		click_chatter("%{element} :: %s :: Packet too small: %d Vs. %d",
+	uint32_t offset = 0;
+
+	// finish the message left over by the previous read
+	while (_rx_tail) {
+		uint32_t want = sizeof(struct empower_header);
+		if (_rx_tail->length() >= want) {
+			want = ((struct empower_header *) _rx_tail->data())->length();
+			if (stream_desync(want)) {
+				p->kill();
+				return;
+			}
+			if (_rx_tail->length() == want) {
+				dispatch_message(_rx_tail, 0);
+				_rx_tail->kill();
+				_rx_tail = 0;
+				break;
+			}
+		}
+		if (offset == p->length()) {
+			break;
+		}
+		uint32_t n = want - _rx_tail->length();
+		if (n > p->length() - offset) {
+			n = p->length() - offset;
+		}
+		if (_rx_tail->tailroom() < n) {
+			WritablePacket *q = Packet::make(0, _rx_tail->data(), _rx_tail->length(), want - _rx_tail->length());
+			if (q) {
+				q->set_timestamp_anno(_rx_tail->timestamp_anno());
+			}
+			_rx_tail->kill();
+			_rx_tail = q;
+			if (!q) {
+				click_chatter("%{element} :: %s :: cannot make packet!",
+						      this,
+						      __func__);
+				p->kill();
+				return;
+			}
+		}
+		_rx_tail = _rx_tail->put(n);
+		memcpy(_rx_tail->end_data() - n, p->data() + offset, n);
+		offset += n;
+	}
+
+	while (!_rx_tail && offset < p->length()) {
+		uint32_t left = p->length() - offset;
+		uint32_t want = sizeof(struct empower_header);
+		if (left >= want) {
+			want = ((struct empower_header *) (p->data() + offset))->length();
+			if (stream_desync(want)) {
+				p->kill();
+				return;
+			}
+			if (want <= left) {
+				dispatch_message(p, offset);
+				offset += want;
+				continue;
+			}
+		}
+		// partial message, keep it for the next read
+		_rx_tail = Packet::make(0, p->data() + offset, left, want - left);
+		if (!_rx_tail) {
+			click_chatter("%{element} :: %s :: cannot make packet!",
+					      this,
+					      __func__);
+		} else {
+			// the message waits from its first read
+			_rx_tail->set_timestamp_anno(p->timestamp_anno());
+		}
+		break;
+	}
+
+	p->kill();
+	return;
+
+}
+
+bool EmpowerLVAPManager::stream_desync(uint32_t length) {
+	if (length >= sizeof(struct empower_header) && length <= MAX_MESSAGE_LENGTH) {
+		return false;
+	}
+	// no way to find the next message boundary, drop what is buffered
+	click_chatter("%{element} :: %s :: invalid message length %u, dropping stream data",
+			      this,
+			      __func__,
+			      length);
+	if (_rx_tail) {
+		_rx_tail->kill();
+		_rx_tail = 0;
+	}
+	return true;
+}
+
+#define EMPOWER_HANDLER(type, handler) \
+	register_handler(type, #type + 11, this, call_handler<&EmpowerLVAPManager::handler>)
+
+void EmpowerLVAPManager::register_handlers() {
+	EMPOWER_HANDLER(EMPOWER_PT_ADD_LVAP, handle_add_lvap);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_LVAP, handle_del_lvap);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_LVAPS, handle_del_lvaps);
+	EMPOWER_HANDLER(EMPOWER_PT_ADD_VAP, handle_add_vap);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_VAP, handle_del_vap);
+	EMPOWER_HANDLER(EMPOWER_PT_PROBE_RESPONSE, handle_probe_response);
+	EMPOWER_HANDLER(EMPOWER_PT_AUTH_RESPONSE, handle_auth_response);
+	EMPOWER_HANDLER(EMPOWER_PT_ASSOC_RESPONSE, handle_assoc_response);
+	EMPOWER_HANDLER(EMPOWER_PT_COUNTERS_REQUEST, handle_counters_request);
+	EMPOWER_HANDLER(EMPOWER_PT_WTP_COUNTERS_REQUEST, handle_wtp_counters_request);
+	EMPOWER_HANDLER(EMPOWER_PT_TXP_COUNTERS_REQUEST, handle_txp_counters_request);
+	EMPOWER_HANDLER(EMPOWER_PT_ADD_RSSI_TRIGGER, handle_add_rssi_trigger);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_RSSI_TRIGGER, handle_del_rssi_trigger);
+	EMPOWER_HANDLER(EMPOWER_PT_ADD_SUMMARY_TRIGGER, handle_add_summary_trigger);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_SUMMARY_TRIGGER, handle_del_summary_trigger);
+	EMPOWER_HANDLER(EMPOWER_PT_UCQM_REQUEST, handle_uimg_request);
+	EMPOWER_HANDLER(EMPOWER_PT_NCQM_REQUEST, handle_nimg_request);
+	EMPOWER_HANDLER(EMPOWER_PT_SET_PORT, handle_set_port);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_PORT, handle_del_port);
+	EMPOWER_HANDLER(EMPOWER_PT_LVAP_STATS_REQUEST, handle_lvap_stats_request);
+	EMPOWER_HANDLER(EMPOWER_PT_NIF_STATS_REQUEST, handle_nif_stats_request);
+	EMPOWER_HANDLER(EMPOWER_PT_WIFI_STATS_REQUEST, handle_wifi_stats_request);
+	EMPOWER_HANDLER(EMPOWER_PT_HISTORY_REQUEST, handle_history_request);
+	EMPOWER_HANDLER(EMPOWER_PT_INCOM_MCAST_RESPONSE, handle_incom_mcast_addr_response);
+	EMPOWER_HANDLER(EMPOWER_PT_CAPS_REQUEST, handle_caps_request);
+	EMPOWER_HANDLER(EMPOWER_PT_LVAP_STATUS_REQ, handle_lvap_status_request);
+	EMPOWER_HANDLER(EMPOWER_PT_VAP_STATUS_REQ, handle_vap_status_request);
+	EMPOWER_HANDLER(EMPOWER_PT_SET_TRAFFIC_RULE, handle_set_traffic_rule);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_TRAFFIC_RULE, handle_del_traffic_rule);
+	EMPOWER_HANDLER(EMPOWER_PT_TRAFFIC_RULE_STATS_REQUEST, handle_traffic_rule_stats_request);
+	EMPOWER_HANDLER(EMPOWER_PT_TRAFFIC_RULE_STATUS_REQ, handle_traffic_rule_status_request);
+	EMPOWER_HANDLER(EMPOWER_PT_PORT_STATUS_REQ, handle_port_status_request);
+	EMPOWER_HANDLER(EMPOWER_PT_ADD_STATS_STREAM, handle_add_stats_stream);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_STATS_STREAM, handle_del_stats_stream);
+	EMPOWER_HANDLER(EMPOWER_PT_SNAPSHOT_SYNC_RESPONSE, handle_snapshot_sync_response);
+	EMPOWER_HANDLER(EMPOWER_PT_SET_LVAP_RATE, handle_set_lvap_rate);
+	EMPOWER_HANDLER(EMPOWER_PT_QUEUE_IMPORT, handle_queue_import);
+	EMPOWER_HANDLER(EMPOWER_PT_ACTIVATE_LVAP, handle_activate_lvap);
+	EMPOWER_HANDLER(EMPOWER_PT_ADD_MIRROR, handle_add_mirror);
+	EMPOWER_HANDLER(EMPOWER_PT_DEL_MIRROR, handle_del_mirror);
+	EMPOWER_HANDLER(EMPOWER_PT_SET_RX_SAMPLE, handle_set_rx_sample);
+	EMPOWER_HANDLER(EMPOWER_PT_SET_SSID_VLAN, handle_set_ssid_vlan);
+	EMPOWER_HANDLER(EMPOWER_PT_ECHO_REQUEST, handle_echo_request);
+}
+
+#undef EMPOWER_HANDLER
+
+int EmpowerLVAPManager::register_handler(uint8_t type, const char *name, Element *e, MessageHandler handler, uint32_t min_length) {
+	MessageType *mt = &_dispatch[type];
+	if (mt->_handler) {
+		return -1;
+	}
+	mt->_name = name;
+	mt->_element = e;
+	mt->_handler = handler;
+	mt->_min_length = empower_fixed_size(type);
+	if (min_length > mt->_min_length) {
+		mt->_min_length = min_length;
+	}
+	return 0;
+}
+
+// Bucket of the dispatch histograms, i for less than 8 << i usec
+int EmpowerLVAPManager::dispatch_bucket(uint32_t usecs) {
+	int bucket = 0;
+	while (bucket < DISPATCH_BUCKETS - 1 && usecs >= (8U << bucket)) {
+		bucket++;
+	}
+	return bucket;
+}
+
+void EmpowerLVAPManager::dispatch_message(Packet *p, uint32_t offset) {
+
+	struct empower_header *w = (struct empower_header *) (p->data() + offset);
+
+	MessageType *mt = &_dispatch[w->type()];
+
+	if (!mt->_handler) {
+		_unknown_messages++;
+		click_chatter("%{element} :: %s :: Unknown packet type: %d",
 				      this,
 				      __func__,
-				      p->length(),
-				      sizeof(struct empower_header));
-		p->kill();
+				      w->type());
 		return;
 	}
 
-	uint32_t offset = 0;
+	mt->_messages++;
+	mt->_bytes += w->length();
+
+	// the only length check, handlers rely on the fixed part being there
+	if (w->length() < mt->_min_length) {
+		mt->_errors++;
+		click_chatter("%{element} :: %s :: message type %d too short (%u)",
+				      this,
+				      __func__,
+				      w->type(),
+				      w->length());
+		return;
+	}
+
+	// the socket stamps its reads with the wall clock
+	_queue_usecs = 0;
+	if (p->timestamp_anno()) {
+		Timestamp waited = Timestamp::now() - p->timestamp_anno();
+		if (waited > Timestamp()) {
+			_queue_usecs = waited.usecval() < 0xFFFFFFFFU ? waited.usecval() : 0xFFFFFFFFU;
+		}
+		mt->_queue_usecs[dispatch_bucket(_queue_usecs)]++;
+	}
+
+	Timestamp start = Timestamp::now_steady();
+
+	if (mt->_handler(mt->_element, p, offset) < 0) {
+		mt->_errors++;
+	}
+
+	mt->_usecs[dispatch_bucket((Timestamp::now_steady() - start).usecval())]++;
 
-	while (offset < p->length()) {
-		struct empower_header *w = (struct empower_header *) (p->data() + offset);
-		switch (w->type()) {
-		case EMPOWER_PT_ADD_LVAP:
-			handle_add_lvap(p, offset);
-			break;
-		case EMPOWER_PT_DEL_LVAP:
-			handle_del_lvap(p, offset);
-			break;
-		case EMPOWER_PT_ADD_VAP:
-			handle_add_vap(p, offset);
-			break;
-		case EMPOWER_PT_DEL_VAP:
-			handle_del_vap(p, offset);
-			break;
-		case EMPOWER_PT_PROBE_RESPONSE:
-			handle_probe_response(p, offset);
-			break;
-		case EMPOWER_PT_AUTH_RESPONSE:
-			handle_auth_response(p, offset);
-			break;
-		case EMPOWER_PT_ASSOC_RESPONSE:
-			handle_assoc_response(p, offset);
-			break;
-		case EMPOWER_PT_COUNTERS_REQUEST:
-			handle_counters_request(p, offset);
-			break;
-		case EMPOWER_PT_WTP_COUNTERS_REQUEST:
-			handle_wtp_counters_request(p, offset);
-			break;
-		case EMPOWER_PT_TXP_COUNTERS_REQUEST:
-			handle_txp_counters_request(p, offset);
-			break;
-		case EMPOWER_PT_ADD_RSSI_TRIGGER:
-			handle_add_rssi_trigger(p, offset);
-			break;
-		case EMPOWER_PT_DEL_RSSI_TRIGGER:
-			handle_del_rssi_trigger(p, offset);
-			break;
-		case EMPOWER_PT_ADD_SUMMARY_TRIGGER:
-			handle_add_summary_trigger(p, offset);
-			break;
-		case EMPOWER_PT_DEL_SUMMARY_TRIGGER:
-			handle_del_summary_trigger(p, offset);
-			break;
-		case EMPOWER_PT_UCQM_REQUEST:
-			handle_uimg_request(p, offset);
-			break;
-		case EMPOWER_PT_NCQM_REQUEST:
-			handle_nimg_request(p, offset);
-			break;
-		case EMPOWER_PT_SET_PORT:
-			handle_set_port(p, offset);
-			break;
-		case EMPOWER_PT_DEL_PORT:
-			handle_del_port(p, offset);
-			break;
-		case EMPOWER_PT_LVAP_STATS_REQUEST:
-			handle_lvap_stats_request(p, offset);
-			break;
-		//tag_for_nif
-		case EMPOWER_PT_NIF_STATS_REQUEST:
-			handle_nif_stats_request(p, offset);
-			break;			
-		case EMPOWER_PT_WIFI_STATS_REQUEST:
-			handle_wifi_stats_request(p, offset);
-			break;
-		case EMPOWER_PT_INCOM_MCAST_RESPONSE:
-			handle_incom_mcast_addr_response(p, offset);
-			break;
-		case EMPOWER_PT_CAPS_REQUEST:
-			handle_caps_request(p, offset);
-			break;
-		case EMPOWER_PT_LVAP_STATUS_REQ:
-			handle_lvap_status_request(p, offset);
-			break;
-		case EMPOWER_PT_VAP_STATUS_REQ:
-			handle_vap_status_request(p, offset);
-			break;
-		case EMPOWER_PT_SET_TRAFFIC_RULE:
-			handle_set_traffic_rule(p, offset);
-			break;
-		case EMPOWER_PT_DEL_TRAFFIC_RULE:
-			handle_del_traffic_rule(p, offset);
-			break;
-		case EMPOWER_PT_TRAFFIC_RULE_STATS_REQUEST:
-			handle_traffic_rule_stats_request(p, offset);
-			break;
-		case EMPOWER_PT_TRAFFIC_RULE_STATUS_REQ:
-			handle_traffic_rule_status_request(p, offset);
-			break;
-		case EMPOWER_PT_PORT_STATUS_REQ:
-			handle_port_status_request(p, offset);
-			break;
-		default:
-			click_chatter("%{element} :: %s :: Unknown packet type: %d",
-					      this,
-					      __func__,
-					      w->type());
-		}
-		offset += w->length();
+	if (_state_file && !_restoring) {
+		_state_file->set_version(w->seq());
 	}
 
-	p->kill();
-	return;
-
 }
 
 Vector<EtherAddress>::iterator find(Vector<EtherAddress>::iterator begin, Vector<EtherAddress>::iterator end, EtherAddress element) {
@@ -2255,66 +4313,94 @@ Vector<EtherAddress>::iterator find(Vector<EtherAddress>::iterator begin, Vector
  * using all the BSSIDs of the VAPs, and sets the
  * hardware register accordingly.
  */
-void EmpowerLVAPManager::compute_bssid_mask() {
+void EmpowerLVAPManager::account_bssid_mask(int iface_id, EtherAddress bssid, int delta) {
 
-	// clear _masks vector
-	_masks.clear();
+	ResourceElement *re = _ifaces_to_elements.get(iface_id);
 
-	for (unsigned j = 0; j < _ifaces_to_elements.size(); j++) {
-
-		// start building mask
-		uint8_t bssid_mask[6];
-		int i;
-
-		// Start with a mask of ff:ff:ff:ff:ff:ff
-		for (i = 0; i < 6; i++) {
-			bssid_mask[i] = 0xff;
-		}
+	if (!re || iface_id >= _masks.size()) {
+		return;
+	}
 
-		// For each LVAP, update the bssid mask to include
-		// the common bits of all LVAPs.
-		for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
-			// check iface
-			unsigned iface_id = it.value()._iface_id;
-			if (iface_id != j) {
-				continue;
-			}
-			// check set mask flag
-			bool set_mask = it.value()._set_mask;
-			if (!set_mask) {
-				continue;
+	const uint8_t *hw = (const uint8_t *) re->_hwaddr.data();
+	const uint8_t *addr = (const uint8_t *) bssid.data();
+	uint32_t *bits = _mask_counters[iface_id]._bits;
+	uint8_t bssid_mask[6];
+
+	for (int i = 0; i < 6; i++) {
+		uint8_t diff = hw[i] ^ addr[i];
+		bssid_mask[i] = 0;
+		for (int b = 0; b < 8; b++) {
+			if (diff & (1 << b)) {
+				bits[i * 8 + b] += delta;
 			}
-			// add to mask
-			for (i = 0; i < 6; i++) {
-				const uint8_t *hw = (const uint8_t *) _ifaces_to_elements[iface_id]->_hwaddr.data();
-				const uint8_t *bssid = (const uint8_t *) it.value()._net_bssid.data();
-				bssid_mask[i] &= ~(hw[i] ^ bssid[i]);
+			if (!bits[i * 8 + b]) {
+				bssid_mask[i] |= 1 << b;
 			}
 		}
+	}
 
-		// For each VAP, update the bssid mask to include
-		// the common bits of all VAPs.
-		for (VAPIter it = _vaps.begin(); it.live(); it++) {
-			// check iface
-			unsigned iface_id = it.value()._iface_id;
-			if (iface_id != j) {
-				continue;
-			}
-			// add to mask
-			for (i = 0; i < 6; i++) {
-				const uint8_t *hw = (const uint8_t *) _ifaces_to_elements[iface_id]->_hwaddr.data();
-				const uint8_t *bssid = (const uint8_t *) it.value()._net_bssid.data();
-				bssid_mask[i] &= ~(hw[i] ^ bssid[i]);
-			}
-		}
+	_masks[iface_id] = EtherAddress(bssid_mask);
+
+	// coalesce the debugfs writes
+	if (!_mask_timer.scheduled()) {
+		_mask_timer.schedule_after_msec(_mask_period);
+	}
+
+}
+
+void EmpowerLVAPManager::forget_bssid_mask(BssidMaskEntries &entries, EtherAddress key) {
+	BssidMaskEntry *entry = entries.get_pointer(key);
+	if (!entry) {
+		return;
+	}
+	account_bssid_mask(entry->_iface_id, entry->_bssid, -1);
+	entries.erase(key);
+}
+
+// An LVAP contributes its net BSSID to the mask of its interface as long
+// as it has the set mask flag.
+void EmpowerLVAPManager::update_bssid_mask(EmpowerStationState *ess) {
+
+	BssidMaskEntry *entry = _mask_lvaps.get_pointer(ess->_sta);
+
+	if (entry && ess->_set_mask && entry->_iface_id == ess->_iface_id && entry->_bssid == ess->_net_bssid) {
+		return;
+	}
 
-		_masks.push_back(EtherAddress(bssid_mask));
+	forget_bssid_mask(_mask_lvaps, ess->_sta);
 
+	if (ess->_set_mask) {
+		BssidMaskEntry fresh;
+		fresh._iface_id = ess->_iface_id;
+		fresh._bssid = ess->_net_bssid;
+		_mask_lvaps.set(ess->_sta, fresh);
+		account_bssid_mask(fresh._iface_id, fresh._bssid, 1);
 	}
 
-	// Update bssid masks register through debugfs
+}
+
+void EmpowerLVAPManager::update_bssid_mask(EmpowerVAPState *evs) {
+	forget_bssid_mask(_mask_vaps, evs->_net_bssid);
+	BssidMaskEntry fresh;
+	fresh._iface_id = evs->_iface_id;
+	fresh._bssid = evs->_net_bssid;
+	_mask_vaps.set(evs->_net_bssid, fresh);
+	account_bssid_mask(fresh._iface_id, fresh._bssid, 1);
+}
+
+// Update bssid masks register through debugfs, only for the interfaces
+// whose mask changed since the last write
+void EmpowerLVAPManager::write_bssid_masks() {
+
+	_written_masks.resize(_masks.size(), EtherAddress());
+
 	for (int i = 0; i < _masks.size(); i++) {
 
+		if (_written_masks[i] == _masks[i]) {
+			continue;
+		}
+
+#if CLICK_USERLEVEL
 		FILE *debugfs_file = fopen(_debugfs_strings[i].c_str(), "w");
 
 		if (debugfs_file != NULL) {
@@ -2326,6 +4412,7 @@ void EmpowerLVAPManager::compute_bssid_mask() {
 			}
 			fprintf(debugfs_file, "%s\n", _masks[i].unparse_colon().c_str());
 			fclose(debugfs_file);
+			_written_masks[i] = _masks[i];
 			continue;
 		}
 
@@ -2333,9 +4420,134 @@ void EmpowerLVAPManager::compute_bssid_mask() {
 					  this,
 					  __func__,
 					  _debugfs_strings[i].c_str());
+#else
+		// the companion at user level copies the masks handler to
+		// debugfs, see the EmpowerLVAPManager documentation
+		_written_masks[i] = _masks[i];
+#endif
+
+	}
+
+	mark_masks();
+
+}
+
+// The LVAPs awaiting their mask in their timeline, whose interface has
+// its mask written now
+void EmpowerLVAPManager::mark_masks() {
+
+	Vector<EtherAddress> stas;
+
+	_timeline_lock.acquire();
+	for (Timelines::iterator it = _timelines.begin(); it.live(); it++) {
+		if (it.value().reached(LVAPTimeline::ADD_LVAP) && !it.value().reached(LVAPTimeline::MASK)) {
+			stas.push_back(it.key());
+		}
+	}
+	_timeline_lock.release();
+
+	for (int i = 0; i < stas.size(); i++) {
+		EmpowerStationState *ess = _lvaps.get_pointer(stas[i]);
+		if (ess && ess->_set_mask && ess->_iface_id < _written_masks.size()
+				&& _written_masks[ess->_iface_id] == _masks[ess->_iface_id]) {
+			timeline(stas[i], LVAPTimeline::MASK);
+		}
+	}
+
+}
+
+// Heap bytes of an LVAP, its entry in the table aside
+static size_t station_heap_bytes(const EmpowerStationState &ess) {
+	size_t bytes = 0;
+	if (!ess._ssids.is_inline()) {
+		bytes += ess._ssids.capacity() * sizeof(String);
+	}
+	if (!ess._ssid_ids.is_inline()) {
+		bytes += ess._ssid_ids.capacity() * sizeof(int);
+	}
+	for (int i = 0; i < ess._ssids.size(); i++) {
+		bytes += ess._ssids[i].length();
+	}
+	return bytes + ess._ssid.length();
+}
+
+// true if the interface shares the transmission policies of an earlier one
+static bool shared_tx_policies(const Vector<Minstrel *> &rcs, int iface_id) {
+	for (int i = 0; i < iface_id; i++) {
+		if (rcs[i]->tx_policies() == rcs[iface_id]->tx_policies()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+EmpowerMemoryUsage EmpowerLVAPManager::memory_usage(EtherAddress sta) {
+
+	EmpowerMemoryUsage usage;
+
+	EmpowerStationState *ess = _lvaps.get_pointer(sta);
+	if (ess) {
+		usage._state = sizeof(EtherAddress) + sizeof(EmpowerStationState) + station_heap_bytes(*ess)
+				+ sizeof(EmpowerStationHot) + sizeof(EmpowerWifiHeader);
+	}
+
+	for (int i = 0; i < _rcs.size(); i++) {
+		if (!shared_tx_policies(_rcs, i)) {
+			TxPolicyInfo *txp = _rcs[i]->tx_policies()->tx_table()->get(sta);
+			if (txp) {
+				usage._txp += txp->bytes();
+			}
+		}
+		if (_rcs[i]->neighbors()->get_pointer(sta)) {
+			usage._rc += sizeof(MinstrelDstInfo);
+		}
+	}
+
+	if (_ers) {
+		_ers->station_bytes(sta, usage._neighbors, usage._summaries);
+	}
+
+	for (int i = 0; i < _eqms.size(); i++) {
+		usage._queues += _eqms[i]->station_bytes(sta);
+	}
 
+	return usage;
+
+}
+
+EmpowerMemoryUsage EmpowerLVAPManager::memory_usage() {
+
+	EmpowerMemoryUsage usage;
+
+	usage._state = _lvaps.memory();
+	for (LVAPIter it = _lvaps.begin(); it.live(); it++) {
+		usage._state += station_heap_bytes(it.value());
+	}
+	if (snapshot()) {
+		usage._state += snapshot()->bytes();
+	}
+
+	for (int i = 0; i < _rcs.size(); i++) {
+		if (!shared_tx_policies(_rcs, i)) {
+			const TxTable *table = _rcs[i]->tx_policies()->tx_table();
+			usage._txp += table->memory();
+			for (TxTableIter it = table->begin(); it.live(); it++) {
+				usage._txp += it.value()->bytes();
+			}
+		}
+		usage._rc += _rcs[i]->neighbors()->memory();
+	}
+
+	if (_ers) {
+		_ers->bytes(usage._neighbors, usage._summaries);
+	}
+
+	for (int i = 0; i < _eqms.size(); i++) {
+		usage._queues += _eqms[i]->bytes();
 	}
 
+	return usage;
+
 }
 
 enum {
@@ -2343,12 +4555,20 @@ enum {
 	H_PORTS,
 	H_DEBUG,
 	H_MASKS,
-	H_LVAPS,
 	H_VAPS,
 	H_ADD_LVAP,
 	H_DEL_LVAP,
 	H_RECONNECT,
 	H_INTERFACES,
+	H_DISPATCH,
+	H_LVAPS_JSON,
+	H_RX_FILTERS,
+	H_MEMORY,
+	H_RESPONSE_CACHE,
+	H_TIMELINE,
+	H_TIMELINE_RESET,
+	H_DISPATCH_QUEUE,
+	H_RTT,
 };
 
 String EmpowerLVAPManager::read_handler(Element *e, void *thunk) {
@@ -2371,49 +4591,155 @@ String EmpowerLVAPManager::read_handler(Element *e, void *thunk) {
 	    }
 		return sa.take_string();
 	}
-	case H_LVAPS: {
-	    StringAccum sa;
+	case H_LVAPS_JSON: {
+		StringAccum sa;
+		JsonWriter w(sa);
+		sa.reserve(td->lvaps()->size() * 512);
+		w.begin_array();
 		for (LVAPIter it = td->lvaps()->begin(); it.live(); it++) {
-		    sa << "sta ";
-		    sa << it.key().unparse();
-		    if (it.value()._set_mask) {
-			    sa << " DL+UL";
-		    } else {
-			    sa << " UL";
-		    }
-		    if (it.value()._association_status) {
-			    sa << " ASSOC";
-		    }
-		    if (it.value()._authentication_status) {
-			    sa << " AUTH";
-		    }
-			sa << " net_bssid ";
-		    sa << it.value()._net_bssid.unparse();
-			sa << " lvap_bssid ";
-		    sa << it.value()._lvap_bssid.unparse();
-		    sa << " encap ";
-		    sa << it.value()._encap.unparse();
-		    sa << " ssid ";
-		    sa << it.value()._ssid;
-		    sa << " ssids [ ";
-	    	sa << it.value()._ssids[0];
-		    for (int i = 1; i < it.value()._ssids.size(); i++) {
-		    	sa << ", " << it.value()._ssids[i];
+			const EmpowerStationState &ess = it.value();
+			w.begin_object();
+			w.key("sta").quoted(it.key());
+			w.member("set_mask", ess._set_mask);
+			w.member("association_status", ess._association_status);
+			w.member("authentication_status", ess._authentication_status);
+			w.key("net_bssid").quoted(ess._net_bssid);
+			w.key("lvap_bssid").quoted(ess._lvap_bssid);
+			w.key("encap").quoted(ess._encap);
+			w.member("ssid", ess._ssid);
+			w.key("ssids").begin_array();
+			for (int i = 0; i < ess._ssids.size(); i++) {
+				w.value(ess._ssids[i]);
 			}
-			sa << " ] assoc_id ";
-			sa << it.value()._assoc_id;
-			sa << " hwaddr ";
-			sa << it.value()._hwaddr.unparse();
-			sa << " channel ";
-			sa << it.value()._channel;
-			sa << " band ";
-			sa << it.value()._band;
-			sa << " iface_id ";
-			sa << it.value()._iface_id;
-			sa << " supported_band ";
-			sa << it.value()._supported_band;
+			w.end_array();
+			w.member("assoc_id", ess._assoc_id);
+			w.key("hwaddr").quoted(ess._hwaddr);
+			w.member("channel", ess._channel);
+			w.member("band", (int) ess._band);
+			w.member("iface_id", ess._iface_id);
+			w.member("supported_band", (int) ess._supported_band);
+			TxPolicyInfo *txp = td->get_txp(it.key());
+			w.key("tx_policy");
+			if (txp) {
+				w.begin_object();
+				w.key("mcs").begin_array();
+				for (int i = 0; i < txp->_mcs.size(); i++) {
+					w.value(txp->_mcs[i]);
+				}
+				w.end_array();
+				w.key("ht_mcs").begin_array();
+				for (int i = 0; i < txp->_ht_mcs.size(); i++) {
+					w.value(txp->_ht_mcs[i]);
+				}
+				w.end_array();
+				w.member("no_ack", txp->_no_ack);
+				w.member("tx_mcast", (int) txp->_tx_mcast);
+				w.member("ur_mcast_count", txp->_ur_mcast_count);
+				w.member("rts_cts", txp->_rts_cts);
+				w.end_object();
+			} else {
+				w.null();
+			}
+			w.end_object();
+		}
+		w.end_array();
+		sa << "\n";
+		return sa.take_string();
+	}
+	case H_DISPATCH: {
+		StringAccum sa;
+		for (int i = 0; i < 256; i++) {
+			MessageType *mt = &td->_dispatch[i];
+			if (!mt->_messages) {
+				continue;
+			}
+			sa.snprintf(8, "0x%02x", i);
+			sa << ' ' << mt->_name << ' ' << mt->_messages << ' ' << mt->_bytes << ' ' << mt->_errors;
+			for (int b = 0; b < DISPATCH_BUCKETS; b++) {
+				sa << ' ' << mt->_usecs[b];
+			}
+			sa << "\n";
+		}
+		sa << "unknown " << td->_unknown_messages << "\n";
+		return sa.take_string();
+	}
+	case H_DISPATCH_QUEUE: {
+		StringAccum sa;
+		for (int i = 0; i < 256; i++) {
+			MessageType *mt = &td->_dispatch[i];
+			if (!mt->_messages) {
+				continue;
+			}
+			sa.snprintf(8, "0x%02x", i);
+			sa << ' ' << mt->_name;
+			for (int b = 0; b < DISPATCH_BUCKETS; b++) {
+				sa << ' ' << mt->_queue_usecs[b];
+			}
+			sa << "\n";
+		}
+		return sa.take_string();
+	}
+	case H_RTT: {
+		const LatencyHistogram &h = td->_rtt;
+		StringAccum sa;
+		sa << "count " << h._count
+		   << " mean " << h.mean()
+		   << " p50 " << h.percentile(50)
+		   << " p90 " << h.percentile(90)
+		   << " p99 " << h.percentile(99)
+		   << " max " << h._max << "\n";
+		return sa.take_string();
+	}
+	case H_RX_FILTERS: {
+		StringAccum sa;
+		td->_rx_filters_lock.acquire();
+		for (int i = 0; i < td->_rx_filters.size(); i++) {
+			const EmpowerRxFilter &f = td->_rx_filters[i];
+			sa << i << ' ';
+			if (f.all()) {
+				sa << "all";
+			} else {
+				sa << f.addresses();
+			}
+			sa << ' ' << f.length() << ' ' << f.installs() << "\n";
+		}
+		td->_rx_filters_lock.release();
+		return sa.take_string();
+	}
+	case H_RESPONSE_CACHE: {
+		StringAccum sa;
+		sa << "responses " << td->_responses.size() << " hits " << td->_response_hits
+		   << " misses " << td->_response_misses << "\n";
+		return sa.take_string();
+	}
+	case H_TIMELINE: {
+		StringAccum sa;
+		td->_timeline_lock.acquire();
+		for (int i = 0; i <= LVAPTimeline::NB_PHASES; i++) {
+			const LatencyHistogram &h = td->_timeline_histograms[i];
+			sa << (i < LVAPTimeline::NB_PHASES ? LVAPTimeline::phase_name(i) : "total")
+			   << " count " << h._count
+			   << " mean " << h.mean()
+			   << " p50 " << h.percentile(50)
+			   << " p90 " << h.percentile(90)
+			   << " p99 " << h.percentile(99)
+			   << " max " << h._max << "\n";
+		}
+		sa << "open " << td->_timelines.size() << " completed " << td->_timelines_completed
+		   << " expired " << td->_timelines_expired << "\n";
+		td->_timeline_lock.release();
+		return sa.take_string();
+	}
+	case H_MEMORY: {
+		StringAccum sa;
+		for (LVAPIter it = td->lvaps()->begin(); it.live(); it++) {
+			sa << it.key() << ' ';
+			td->memory_usage(it.key()).unparse(sa);
 			sa << "\n";
 		}
+		sa << "agent ";
+		td->memory_usage().unparse(sa);
+		sa << "\n";
 		return sa.take_string();
 	}
 	case H_INTERFACES: {
@@ -2448,26 +4774,12 @@ String EmpowerLVAPManager::read_handler(Element *e, void *thunk) {
 			TxPolicyInfo *txp = td->get_txp(it.key());
 			sa << "!" << it.key().unparse() << "\n";
 			sa << "!TX\n";
-			CBytes tx = txp->_tx;
-			Vector<int> lens_tx;
-			for (CBytesIter iter = tx.begin(); iter.live(); iter++) {
-				lens_tx.push_back(iter.key());
-			}
-			click_qsort(lens_tx.begin(), lens_tx.size());
-			for (int i = 0; i < lens_tx.size(); i++) {
-				CBytesIter itr = tx.find(lens_tx[i]);
-				sa << itr.key() << " " << itr.value() << "\n";
+			for (int i = txp->_tx.next(0); i < FrameSizeHistogram::NBUCKETS; i = txp->_tx.next(i + 1)) {
+				sa << FrameSizeHistogram::bucket_size(i) << " " << txp->_tx.count(i) << "\n";
 			}
 			sa << "!RX\n";
-			CBytes rx = txp->_rx;
-			Vector<int> lens_rx;
-			for (CBytesIter iter = rx.begin(); iter.live(); iter++) {
-				lens_rx.push_back(iter.key());
-			}
-			click_qsort(lens_rx.begin(), lens_rx.size());
-			for (int i = 0; i < lens_rx.size(); i++) {
-				CBytesIter itr = rx.find(lens_rx[i]);
-				sa << itr.key() << " " << itr.value() << "\n";
+			for (int i = txp->_rx.next(0); i < FrameSizeHistogram::NBUCKETS; i = txp->_rx.next(i + 1)) {
+				sa << FrameSizeHistogram::bucket_size(i) << " " << txp->_rx.count(i) << "\n";
 			}
 		}
 		return sa.take_string();
@@ -2477,6 +4789,63 @@ String EmpowerLVAPManager::read_handler(Element *e, void *thunk) {
 	}
 }
 
+// LVAPs a chunk, the cursor counts those listed already
+int EmpowerLVAPManager::lvaps_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh) {
+	EmpowerLVAPManager *td = (EmpowerLVAPManager *) e;
+	int cursor = 0;
+	if (s && (!IntArg().parse(s, cursor) || cursor < 0)) {
+		return errh->error("bad cursor");
+	}
+	StringAccum sa;
+	int n = 0;
+	LVAPIter it = td->lvaps()->begin();
+	for (; it.live() && n < cursor; it++, n++)
+		/* skip */;
+	for (; it.live() && n < cursor + CHUNK_LVAPS; it++, n++) {
+		    sa << "sta ";
+		    sa << it.key().unparse();
+		    if (it.value()._set_mask) {
+			    sa << " DL+UL";
+		    } else {
+			    sa << " UL";
+		    }
+		    if (it.value()._association_status) {
+			    sa << " ASSOC";
+		    }
+		    if (it.value()._authentication_status) {
+			    sa << " AUTH";
+		    }
+			sa << " net_bssid ";
+		    sa << it.value()._net_bssid.unparse();
+			sa << " lvap_bssid ";
+		    sa << it.value()._lvap_bssid.unparse();
+		    sa << " encap ";
+		    sa << it.value()._encap.unparse();
+		    sa << " ssid ";
+		    sa << it.value()._ssid;
+		    sa << " ssids [ ";
+	    	sa << it.value()._ssids[0];
+		    for (int i = 1; i < it.value()._ssids.size(); i++) {
+		    	sa << ", " << it.value()._ssids[i];
+			}
+			sa << " ] assoc_id ";
+			sa << it.value()._assoc_id;
+			sa << " hwaddr ";
+			sa << it.value()._hwaddr.unparse();
+			sa << " channel ";
+			sa << it.value()._channel;
+			sa << " band ";
+			sa << it.value()._band;
+			sa << " iface_id ";
+			sa << it.value()._iface_id;
+			sa << " supported_band ";
+			sa << it.value()._supported_band;
+			sa << "\n";
+	}
+	s = sa.take_string();
+	return it.live() ? n : 0;
+}
+
 int EmpowerLVAPManager::write_handler(const String &in_s, Element *e,
 		void *vparam, ErrorHandler *errh) {
 
@@ -2528,9 +4897,27 @@ int EmpowerLVAPManager::write_handler(const String &in_s, Element *e,
 		break;
 
 	}
+	case H_TIMELINE_RESET:
+		f->_timeline_lock.acquire();
+		for (int i = 0; i <= LVAPTimeline::NB_PHASES; i++) {
+			f->_timeline_histograms[i].clear();
+		}
+		f->_timelines_completed = 0;
+		f->_timelines_expired = 0;
+		f->_timeline_lock.release();
+		break;
 	case H_RECONNECT: {
-		// clear triggers
+		// clear triggers, streams and mirrors
 		f->_ers->clear_triggers();
+		f->clear_stats_streams();
+#if CLICK_USERLEVEL
+		if (f->_mirror) {
+			f->_mirror->clear_mirrors();
+		}
+#endif
+		// the new controller tells its features in its caps request
+		f->_controller_caps = 0;
+		f->clear_responses();
 		// send hello
 		f->send_hello();
 		break;
@@ -2542,11 +4929,20 @@ int EmpowerLVAPManager::write_handler(const String &in_s, Element *e,
 void EmpowerLVAPManager::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
 	add_read_handler("ports", read_handler, (void *) H_PORTS);
-	add_read_handler("lvaps", read_handler, (void *) H_LVAPS);
+	set_handler("lvaps", Handler::f_read | Handler::f_read_chunked, lvaps_handler);
+	add_read_handler("lvaps_json", read_handler, (void *) H_LVAPS_JSON);
 	add_read_handler("vaps", read_handler, (void *) H_VAPS);
 	add_read_handler("masks", read_handler, (void *) H_MASKS);
 	add_read_handler("bytes", read_handler, (void *) H_BYTES);
 	add_read_handler("interfaces", read_handler, (void *) H_INTERFACES);
+	add_read_handler("dispatch", read_handler, (void *) H_DISPATCH);
+	add_read_handler("dispatch_queue", read_handler, (void *) H_DISPATCH_QUEUE);
+	add_read_handler("rtt", read_handler, (void *) H_RTT);
+	add_read_handler("rx_filters", read_handler, (void *) H_RX_FILTERS);
+	add_read_handler("memory", read_handler, (void *) H_MEMORY);
+	add_read_handler("response_cache", read_handler, (void *) H_RESPONSE_CACHE);
+	add_read_handler("timeline", read_handler, (void *) H_TIMELINE);
+	add_write_handler("timeline_reset", write_handler, (void *) H_TIMELINE_RESET);
 	add_write_handler("reconnect", write_handler, (void *) H_RECONNECT);
 	add_write_handler("ports", write_handler, (void *) H_PORTS);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
@@ -2554,4 +4950,4 @@ void EmpowerLVAPManager::add_handlers() {
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(EmpowerLVAPManager)
-ELEMENT_REQUIRES(userlevel EmpowerRXStats)
+ELEMENT_REQUIRES(EmpowerRXStats StatsStream EmpowerRxFilter EmpowerStateFile FromDevice)
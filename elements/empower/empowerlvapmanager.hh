@@ -3,9 +3,12 @@
 #include <click/config.h>
 #include <click/element.hh>
 #include <click/timer.hh>
+#include <click/timerwheel.hh>
 #include <click/etheraddress.hh>
 #include <click/ipaddress.hh>
 #include <click/hashtable.hh>
+#include <click/flathashtable.hh>
+#include <click/smallvector.hh>
 #include <clicknet/wifi.h>
 #include <click/sync.hh>
 #include <elements/wifi/minstrel.hh>
@@ -13,6 +16,12 @@
 #include "empowerpacket.hh"
 #include "igmppacket.hh"
 #include "empowermulticasttable.hh"
+#include "empowerwifiheader.hh"
+#include "empowerepoch.hh"
+#include "empowerstationcache.hh"
+#include "empowerssidtable.hh"
+#include "empowerrxfilter.hh"
+#include "latencyhistogram.hh"
 CLICK_DECLS
 
 /*
@@ -26,6 +35,54 @@ Handles LVAPs and communication with the Access Controller.
 
 =d
 
+On hot-swap the LVAPs, VAPs, ports, BSSID masks and stats streams are
+carried over from the old EmpowerLVAPManager, so that no station has to
+be set up again by the controller. LVAPs and VAPs are moved to the
+interface serving the same resource element; those whose resource
+element is gone are dropped.
+
+With STATE_FILE, the LVAPs, VAPs, ports and traffic rules installed by
+the controller are also kept in a memory-mapped file, updated as they
+change. A restarted agent replays the file before talking to the
+controller, so the BSSID masks are back and stations are acked right
+away, and then asks the controller whether the state is current with a
+single message carrying the sequence number of the last message it
+applied. State the controller reports stale is dropped, and installed
+again by the controller as after a cold start.
+
+With EXPORT_QUEUES, the frames still queued for an LVAP the controller
+moves away are not dropped: they are sent to the controller in
+QUEUE_EXPORT messages, for it to relay to the target WTP as
+QUEUE_IMPORT. There they are queued in the traffic rules of the LVAP,
+right away if the LVAP is already hosted, or as soon as its ADD_LVAP
+arrives, provided it does within a second of the first of them.
+
+An LVAP added with the PREAUTHORIZED flag is admitted locally: its
+authentication to the LVAP's own BSSID, or to the BSSID of a VAP of
+one of its SSIDs on its interface, and its association to any of its
+SSIDs are answered by the agent right away, and the controller learns
+the outcome from an LVAP status message instead of being asked first.
+Other LVAPs go through the controller as before.
+
+The element, and the data path elements that look up its LVAPs
+(EmpowerTee, EmpowerWifiEncap, EmpowerQOSManager, EmpowerWifiDecap,
+EmpowerRXStats and the responders), also build in the Linux kernel
+module, so that frames go between the monitor interfaces and the
+network stack without a trip to user space. What needs files or
+sockets stays at user level: the controller connection goes through a
+ToUserDevice/FromUserDevice pair that a user-level relay copies to and
+from the controller socket (writing the reconnect handler when it
+reconnects), and that relay, not the element, writes the masks handler
+to the DEBUGFS files. EmpowerRegmon, RX_DEVS and STATE_FILE are user
+level only.
+
+An LVAP added with the STAGED flag is set up in full, BSSID mask, rate
+control entry and traffic rule included, but stays invisible to the
+data path and is ignored by the responders and the beacon source until
+an ACTIVATE_LVAP message for it arrives. The controller can so prepare
+the target WTP of a handover ahead of time; activating it flips a
+single field of the published snapshot.
+
 Keyword arguments are:
 
 =over 8
@@ -45,8 +102,35 @@ An EmpowerAssociationResponder element
 =item DEBUGFS
 The path to the bssid_extra file
 
-=item EPSB
-An EmpowerPowerSaveBuffer element
+=item EPSBS
+The EmpowerPowerSaveBuffer elements, one per interface, optional
+
+=item MIRROR
+An EmpowerMirror element, optional. Without it the add mirror requests
+of the controller are ignored. User level only
+
+=item REGMONS
+The EmpowerRegmon elements, one per interface, optional. Without them
+the WiFi stats requests of the controller are answered with no samples
+
+=item RX_DEVS
+The FromDevice elements the interfaces are read from, one per interface,
+optional. Each must read from a Linux packet socket (METHOD LINUX, or
+PCAP on Linux); their BPF_FILTER, if any, is replaced. When set, the
+kernel only hands whole frames to the agent when the agent looks at
+them: those sent by the interface,
+management frames other than beacons and probe responses, and frames
+sent by the LVAPs associated on the interface or by the targets of its
+summary triggers. Other frames are truncated to their radiotap and
+802.11 headers, which is all EmpowerRXStats and EmpowerRegmon need. The
+filter is rebuilt when LVAPs or summary triggers come and go; a summary
+trigger on the broadcast address disables it on its interface.
+
+=item RX_SAMPLE
+With RX_DEVS, of the frames that are truncated only one in RX_SAMPLE,
+picked at random, reaches the agent, the others are dropped in the
+kernel. Neighbor packet counts then count sampled frames. Default is 0,
+no sampling
 
 =item PERIOD
 Interval between hello messages to the Access Controller (in msec), default is 5000
@@ -57,11 +141,113 @@ An EmpowerDeAuthResponder element
 =item EDISASSOR
 An EmpowerDisassocResponder element
 
+=item MASK_PERIOD
+Minimum interval between two writes of the BSSID mask of an interface
+(in msec), default is 100
+
+=item EGRESS_SIZE
+Messages to the controller are coalesced into a single packet, which is
+emitted once it holds at least this many bytes, default is 4096
+
+=item EGRESS_DELAY
+Maximum time a message may wait for others to be coalesced with (in
+usec), default is 500. Zero disables coalescing. Replies the station
+handshake depends on (probe, authentication, association and LVAP
+add/del responses) are never delayed.
+
+=item BULK_STATUS
+Answer the status requests the controller issues on (re)connection with
+bulk status messages, each carrying up to EGRESS_SIZE bytes of LVAP,
+VAP, port or traffic rule entries, rather than with one message per
+object. Default is true
+
+=item RESPONSE_TTL
+Answers to the requests for UCQM, NCQM, WiFi stats, traffic rule stats
+and WTP counters are kept for this long (in msec), and identical requests
+in the meantime, from other controller applications, get a copy of the
+kept answer instead of a new one. Default is 250. Zero disables it.
+
+=item STATE_FILE
+Path of the file the state installed by the controller is kept in, see
+above. Not set by default, user level only
+
+=item STATE_SLOTS
+Number of records, one per LVAP, VAP, port or traffic rule, the state
+file can hold, default is 1024
+
+=item EXPORT_QUEUES
+Hand the queued frames of a departing LVAP over to its target WTP
+through the controller, see above. Default is false
+
+=item TIMELINE_REPORT
+Send the controller an LVAP_TIMELINE message for every station timeline
+completed, see the timeline handler. Default is false
+
 =item DEBUG
 Turn debug on/off
 
 =back 8
 
+=h lvaps read-only
+One line per LVAP, 64 to a chunk when read with ControlSocket's READSTREAM.
+
+=h lvaps_json read-only
+The LVAPs, with their transmission policy, as a JSON array with one
+object per LVAP. Bands and multicast policies are given by their protocol
+value.
+
+=h dispatch read-only
+One line per controller message type seen: type, name, messages,
+bytes, errors (too short, or refused by the handler), and a histogram of
+handling times, bucket i counting messages handled in less than 8 << i
+usec, the last one everything above. Messages of unknown types are
+counted on a last line.
+
+=h dispatch_queue read-only
+Same as dispatch, with the histograms of the times messages waited from
+their read off the controller socket to their handling, in the same
+buckets. Only messages read by a Socket with TIMESTAMP true count.
+
+=h rtt read-only
+Round trip time to the controller, from the hellos the controller echoes
+back in its ECHO_REQUEST messages: count, mean, 50th, 90th and 99th
+percentiles and maximum, in usec. The ECHO_RESPONSE the agent answers
+with carries the time the request waited in the agent, so the controller
+can tell the two apart as well.
+
+=h rx_filters read-only
+One line per interface of RX_DEVS: interface, transmitters whose frames
+are accepted whole ("all" if the filter accepts every frame), BPF
+instructions, and how many times the filter was installed.
+
+=h timeline read-only
+How long stations take to join the WTP, from their first probe request
+not answered locally, or from the ADD_LVAP that brings their LVAP here
+on a handover, to their first uplink and downlink data frames. One line
+per step: probe, add_lvap, auth, assoc, mask (the BSSID mask with the
+LVAP written), first_ul and first_dl, with the number of timelines that
+reached it and the mean, 50th, 90th and 99th percentiles and maximum of
+the time since the step before, in usec; then the same for the whole
+timeline, and a last line with the timelines still open, completed, and
+given up after 30 s with an LVAP but no traffic in both directions.
+Percentiles are upper bounds, the histograms have a bucket per power of
+two.
+
+=h timeline_reset write-only
+Clears the timeline histograms.
+
+=h response_cache read-only
+Answers kept for RESPONSE_TTL, and the requests answered with and without
+a kept one.
+
+=h memory read-only
+Bytes taken by every LVAP, one line per LVAP, then by the whole agent on
+a last line starting with "agent": station state, transmission policy,
+rate control, RX statistics neighbors, summary triggers and their
+frames, and aggregation queues with their frames, then the total. The
+agent line also counts the tables and the neighbors, policies and queues
+of stations that are not LVAPs. Queued frames are counted as full-sized.
+
 =a EmpowerLVAPManager
 */
 
@@ -73,6 +259,8 @@ enum empower_lvap_flags {
     EMPOWER_STATUS_LVAP_AUTHENTICATED = (1<<0),
     EMPOWER_STATUS_LVAP_ASSOCIATED = (1<<1),
     EMPOWER_STATUS_LVAP_SET_MASK = (1<<2),
+    EMPOWER_STATUS_LVAP_PREAUTHORIZED = (1<<3),
+    EMPOWER_STATUS_LVAP_STAGED = (1<<4),
 };
 
 enum empower_bands_types {
@@ -90,12 +278,14 @@ enum empower_regmon_types {
 	EMPOWER_REGMON_ED = 0x2,
 };
 
-typedef HashTable<uint16_t, uint32_t> CBytes;
-typedef CBytes::iterator CBytesIter;
-
 class Minstrel;
+class StatsStream;
 class EmpowerQOSManager;
 class EmpowerRegmon;
+class EmpowerPowerSaveBuffer;
+class EmpowerStateFile;
+class FromDevice;
+class EmpowerMessage;
 
 class NetworkPort {
 public:
@@ -125,6 +315,9 @@ class EmpowerVAPState {
 public:
 	EtherAddress _net_bssid;
 	String _ssid;
+	// ID of _ssid in the EmpowerSSIDTable of the agent, -1 if blank
+	int _ssid_id;
+	int _slice_id;
 	EtherAddress _hwaddr;
 	int _channel;
 	int _band;
@@ -137,6 +330,40 @@ public:
 // three bytes of the station address. The net_bssid is write
 // only and is used to set the bssid mask. Meaning that frame
 // addressed to net_bssid must be acked by this WTP.
+// Steps of a station joining the WTP, see the timeline handler. Times
+// are steady.
+class LVAPTimeline {
+public:
+
+	// in the order they usually come, as in LVAP_TIMELINE messages
+	enum { PROBE, ADD_LVAP, AUTH, ASSOC, MASK, FIRST_UL, FIRST_DL, NB_PHASES };
+
+	enum {
+		// bits of EmpowerStationHot::_timeline, the frames awaited
+		AWAIT_UL = 1,
+		AWAIT_DL = 2,
+		TIMEOUT = 30000, // msecs
+		MAX_TIMELINES = 1024
+	};
+
+	Timestamp _start;
+	Timestamp _last;
+	int _first; // the phase it started with
+	uint32_t _reached; // bit per phase
+	uint32_t _delta[NB_PHASES]; // usecs since the phase before
+
+	bool reached(int phase) const { return _reached & (1 << phase); }
+	bool complete() const { return reached(FIRST_UL) && reached(FIRST_DL); }
+
+	static const char *phase_name(int phase) {
+		static const char * const names[NB_PHASES] = {
+			"probe", "add_lvap", "auth", "assoc", "mask", "first_ul", "first_dl"
+		};
+		return names[phase];
+	}
+
+};
+
 // The lvap_bssid is the one to which the client is currently
 // attached. The lvap_bssid can be modified only as the result
 // of auth request and assoc request messages. Probe request
@@ -147,8 +374,14 @@ public:
 	EtherAddress _net_bssid;
 	EtherAddress _lvap_bssid;
 	EtherAddress _encap;
-	Vector<String> _ssids;
+	SmallVector<String, 3> _ssids;
 	String _ssid;
+	// IDs of _ssids and _ssid in the EmpowerSSIDTable of the agent, see
+	// EmpowerLVAPManager::intern_ssids()
+	SmallVector<int, 3> _ssid_ids;
+	int _ssid_id;
+	// slice id of _ssid in the EmpowerQOSManager of _iface_id, -1 if none
+	int _slice_id;
 	int _assoc_id;
 	EtherAddress _hwaddr;
 	int _channel;
@@ -159,6 +392,10 @@ public:
 	bool _set_mask;
 	bool _authentication_status;
 	bool _association_status;
+	// auth/assoc are answered locally, see admit_auth()/admit_assoc()
+	bool _preauthorized;
+	// set up but inactive until ACTIVATE_LVAP
+	bool _staged;
 	// CSA entries
 	bool _csa_active;
 	int _csa_switch_mode;
@@ -168,6 +405,11 @@ public:
 	// ADD/DEL LVAP response entries
 	uint32_t _add_lvap_module_id;
 	uint32_t _del_lvap_module_id;
+	// downlink 802.11 header template, rebuild whenever
+	// _sta or _lvap_bssid change
+	EmpowerWifiHeader _wifi_hdr;
+	// LVAPTimeline::AWAIT_* frames of its timeline, copied to the hot record
+	uint8_t _timeline;
 };
 
 // Cross structure mapping bssids to list of associated
@@ -175,19 +417,229 @@ public:
 class InfoBssid {
 public:
 	EtherAddress _bssid;
-	Vector<EtherAddress> _stas;
+	SmallVector<EtherAddress, 4> _stas;
 	int _iface_id;
 };
 
 typedef HashTable<EtherAddress, InfoBssid> InfoBssids;
 typedef InfoBssids::iterator IBIter;
 
-typedef HashTable<EtherAddress, EmpowerVAPState> VAP;
+typedef FlatHashTable<EtherAddress, EmpowerVAPState> VAP;
 typedef VAP::iterator VAPIter;
 
-typedef HashTable<EtherAddress, EmpowerStationState> LVAP;
+typedef FlatHashTable<EtherAddress, EmpowerStationState> LVAP;
 typedef LVAP::iterator LVAPIter;
 
+// Per-packet subset of EmpowerStationState. Data-path elements only
+// need these fields and a record fits in a cache line.
+class EmpowerStationHot {
+public:
+	EtherAddress _sta;
+	EtherAddress _net_bssid;
+	EtherAddress _lvap_bssid;
+	EtherAddress _encap;
+	bool _used;
+	bool _set_mask;
+	bool _authentication_status;
+	bool _association_status;
+	int _iface_id;
+	int _slice_id;
+	// ID of _ssid in the EmpowerSSIDTable of the agent, see SLICE_ANNO
+	int _ssid_id;
+	// 802.1Q TCI of the uplink frames, 0 for none, see
+	// EmpowerSSIDTable::vlan()
+	uint16_t _vlan_tci;
+	// the only fields written after publication, see
+	// EmpowerStationHotTable::activate() and
+	// EmpowerLVAPManager::timeline_frame()
+	mutable volatile bool _staged;
+	mutable volatile uint8_t _timeline;
+
+	EmpowerStationHot() :
+			_used(false), _set_mask(false), _authentication_status(false),
+			_association_status(false), _iface_id(-1), _slice_id(-1), _ssid_id(-1), _vlan_tci(0), _staged(false),
+			_timeline(0) {
+	}
+};
+
+// Per-packet subset of EmpowerVAPState
+class EmpowerVAPHot {
+public:
+	EtherAddress _net_bssid;
+	int _slice_id;
+	int _ssid_id;
+};
+
+typedef Vector<const EmpowerStationHot *> LVAPList;
+typedef Vector<EmpowerVAPHot> VAPList;
+
+// Read-only snapshot of the LVAP and VAP tables for the data path. The
+// hot records sit in a flat open addressing table kept at most half
+// full, the 802.11 header templates in a parallel array. A snapshot
+// never changes once published: the LVAP manager builds a new one on
+// every control-plane event, swaps the pointer and frees the old one
+// when no reader can see it anymore (see EmpowerEpoch). The one
+// exception is the _staged flag of a record, which activate() clears in
+// place; staged records are not found by get() and must be skipped by
+// the users of associated_lvaps().
+class EmpowerStationHotTable {
+public:
+
+	EmpowerStationHotTable(LVAP &, VAP &, const EmpowerSSIDTable &, int, uint32_t);
+
+	~EmpowerStationHotTable() {
+		delete[] _slots;
+		delete[] _hdrs;
+	}
+
+	const EmpowerStationHot *get(EtherAddress sta) const {
+		for (uint32_t i = sta.hashcode() & _mask;; i = (i + 1) & _mask) {
+			const EmpowerStationHot *hot = &_slots[i];
+			if (!hot->_used) {
+				return 0;
+			}
+			if (hot->_sta == sta) {
+				return hot->_staged ? 0 : hot;
+			}
+		}
+	}
+
+	const EmpowerStationHot *get(EtherAddress sta, EmpowerStationCache *cache) const {
+		EmpowerStationCache::Entry &e = cache->_entries[sta.data()[5] & (EmpowerStationCache::SIZE - 1)];
+		if (e._generation == _generation) {
+			const EmpowerStationHot *hot = &_slots[e._slot & _mask];
+			if (hot->_used && hot->_sta == sta && !hot->_staged) {
+				return hot;
+			}
+		}
+		const EmpowerStationHot *hot = get(sta);
+		if (hot) {
+			e._slot = hot - _slots;
+			e._generation = _generation;
+		}
+		return hot;
+	}
+
+	// bytes of the records and of the header templates
+	size_t bytes() const {
+		return (size_t) (_mask + 1) * (sizeof(EmpowerStationHot) + sizeof(EmpowerWifiHeader));
+	}
+
+	// never zero, a new snapshot gets a new generation
+	uint32_t generation() const { return _generation; }
+
+	// number of activate() calls, for readers caching what they derive
+	// from the records
+	uint32_t activations() const { return _activations; }
+
+	// Make the staged record of sta visible to readers, false if there is
+	// none. Everything else in the record was published with the snapshot
+	bool activate(EtherAddress sta) const {
+		for (uint32_t i = sta.hashcode() & _mask;; i = (i + 1) & _mask) {
+			const EmpowerStationHot *hot = &_slots[i];
+			if (!hot->_used) {
+				return false;
+			}
+			if (hot->_sta == sta) {
+				click_write_fence();
+				hot->_staged = false;
+				_activations++;
+				return true;
+			}
+		}
+	}
+
+	const EmpowerWifiHeader &wifi_header(const EmpowerStationHot *hot) const {
+		return _hdrs[hot - _slots];
+	}
+
+	// LVAPs with _set_mask, authenticated and associated, and VAPs, on
+	// the given interface
+	const LVAPList &associated_lvaps(int iface_id) const {
+		return (iface_id >= 0 && iface_id < _lvaps.size()) ? _lvaps[iface_id] : _no_lvaps;
+	}
+
+	const VAPList &iface_vaps(int iface_id) const {
+		return (iface_id >= 0 && iface_id < _vaps.size()) ? _vaps[iface_id] : _no_vaps;
+	}
+
+	// ID of ssid in the EmpowerSSIDTable of the agent as of this
+	// snapshot, -1 if none. IDs never change, callers can keep them
+	int ssid_id(const String &ssid) const {
+		for (int i = 0; i < _ssids.size(); i++) {
+			if (_ssids[i] == ssid) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	// SSID with the given ID, empty if none
+	String ssid(int id) const {
+		return (id >= 0 && id < _ssids.size()) ? _ssids[id] : String();
+	}
+
+private:
+
+	EmpowerStationHot *_slots;
+	EmpowerWifiHeader *_hdrs;
+	uint32_t _mask;
+	uint32_t _generation;
+	mutable volatile uint32_t _activations;
+	Vector<LVAPList> _lvaps;
+	Vector<VAPList> _vaps;
+	Vector<String> _ssids;
+	LVAPList _no_lvaps;
+	VAPList _no_vaps;
+
+};
+
+// BSSID contributing to the BSSID mask of an interface
+// Bytes taken by an LVAP, or by the whole agent, in each subsystem, see
+// EmpowerLVAPManager::memory_usage()
+class EmpowerMemoryUsage {
+public:
+	size_t _state;		// EmpowerStationState and the hot records
+	size_t _txp;		// transmission policies and their histograms
+	size_t _rc;			// Minstrel neighbors
+	size_t _neighbors;	// EmpowerRXStats neighbors
+	size_t _summaries;	// summary triggers and their frames
+	size_t _queues;		// aggregation queues and the frames they hold
+
+	EmpowerMemoryUsage() :
+		_state(0), _txp(0), _rc(0), _neighbors(0), _summaries(0), _queues(0) {
+	}
+
+	size_t total() const {
+		return _state + _txp + _rc + _neighbors + _summaries + _queues;
+	}
+
+	void unparse(StringAccum &sa) const {
+		sa << "state " << _state << " txp " << _txp << " rc " << _rc
+		   << " neighbors " << _neighbors << " summaries " << _summaries
+		   << " queues " << _queues << " total " << total();
+	}
+};
+
+class BssidMaskEntry {
+public:
+	int _iface_id;
+	EtherAddress _bssid;
+};
+
+typedef HashTable<EtherAddress, BssidMaskEntry> BssidMaskEntries;
+
+// For each bit of the BSSID mask of an interface, number of BSSIDs that
+// differ on that bit from the interface address. A bit of the mask is
+// set if and only if its count is zero.
+class BssidMaskCounters {
+public:
+	uint32_t _bits[48];
+	BssidMaskCounters() {
+		memset(_bits, 0, sizeof(_bits));
+	}
+};
+
 typedef HashTable<int, NetworkPort> Ports;
 typedef Ports::iterator PortsIter;
 
@@ -238,6 +690,8 @@ inline bool operator==(const ResourceElement &a, const ResourceElement &b) {
 typedef HashTable<int, ResourceElement *> RETable;
 typedef RETable::const_iterator REIter;
 
+typedef HashTable<ResourceElement, int> REIndex;
+
 class EmpowerLVAPManager: public Element {
 public:
 
@@ -250,14 +704,27 @@ public:
 
 	int initialize(ErrorHandler *);
 	int configure(Vector<String> &, ErrorHandler *);
+	void take_state(Element *, ErrorHandler *);
 	void add_handlers();
 	void run_timer(Timer *);
 	void reset();
 
 	void push(int, Packet *);
 
+	// Handler of a controller message type, called with the element it
+	// was registered for and the message at offset in the packet, whose
+	// length is at least the minimum registered. A negative return value
+	// counts as an error.
+	typedef int (*MessageHandler)(Element *, Packet *, uint32_t);
+
+	// Have other elements handle a message type, from their configure()
+	// or initialize(). min_length is raised to the fixed size of the type
+	// when the manager knows it. Returns -1 if the type is taken.
+	int register_handler(uint8_t, const char *, Element *, MessageHandler, uint32_t min_length = 0);
+
 	int handle_add_lvap(Packet *, uint32_t);
 	int handle_del_lvap(Packet *, uint32_t);
+	int handle_del_lvaps(Packet *, uint32_t);
 	int handle_add_vap(Packet *, uint32_t);
 	int handle_del_vap(Packet *, uint32_t);
 	int handle_probe_response(Packet *, uint32_t);
@@ -278,6 +745,7 @@ public:
 	//tag_for_nif
 	int handle_nif_stats_request(Packet *, uint32_t);
 	int handle_wifi_stats_request(Packet *, uint32_t);
+	int handle_history_request(Packet *, uint32_t);
 	int handle_incom_mcast_addr_response(Packet *, uint32_t);
 	int handle_wtp_counters_request(Packet *, uint32_t);
 	int handle_del_mcast_addr(Packet *, uint32_t);
@@ -290,6 +758,17 @@ public:
 	int handle_traffic_rule_stats_request(Packet *, uint32_t);
 	int handle_traffic_rule_status_request(Packet *, uint32_t);
 	int handle_port_status_request(Packet *, uint32_t);
+	int handle_add_stats_stream(Packet *, uint32_t);
+	int handle_del_stats_stream(Packet *, uint32_t);
+	int handle_snapshot_sync_response(Packet *, uint32_t);
+	int handle_set_lvap_rate(Packet *, uint32_t);
+	int handle_queue_import(Packet *, uint32_t);
+	int handle_activate_lvap(Packet *, uint32_t);
+	int handle_add_mirror(Packet *, uint32_t);
+	int handle_del_mirror(Packet *, uint32_t);
+	int handle_set_rx_sample(Packet *, uint32_t);
+	int handle_set_ssid_vlan(Packet *, uint32_t);
+	int handle_echo_request(Packet *, uint32_t);
 
 	void send_hello();
 	void send_probe_request(EtherAddress, String, EtherAddress, int, empower_bands_types, empower_bands_types);
@@ -303,9 +782,27 @@ public:
 	void send_txp_counters_response(uint32_t, EtherAddress, uint8_t, empower_bands_types, EtherAddress);
 	void send_img_response(int, uint32_t, EtherAddress, uint8_t, empower_bands_types);
 	void send_wifi_stats_response(uint32_t, EtherAddress, uint8_t, empower_bands_types);
+	void send_history_response(uint32_t, int, EtherAddress, int, int);
 	void send_caps();
+	void send_snapshot_sync();
 	void send_rssi_trigger(uint32_t, uint32_t, uint8_t);
 	void send_summary_trigger(SummaryTrigger *);
+	void send_summary_compact(SummaryTrigger *);
+	void send_stats_stream(StatsStream *);
+	// a flow samples message built by EmpowerFlowSampler
+	void send_flow_samples(Packet *);
+
+	// Marks phase in the timeline of sta, see the timeline handler.
+	// False if sta has no open timeline
+	bool timeline(EtherAddress sta, int phase);
+
+	// the first uplink or downlink data frame of a station whose hot
+	// record awaits it, the next ones skip the timeline
+	void timeline_frame(const EmpowerStationHot *hot, int phase) {
+		hot->_timeline &= ~(phase == LVAPTimeline::FIRST_UL ? LVAPTimeline::AWAIT_UL : LVAPTimeline::AWAIT_DL);
+		timeline(hot->_sta, phase);
+	}
+	void clear_stats_streams();
 	//tag_for_nif
 	void send_nif_stats_response(EtherAddress, uint32_t);
 	void send_lvap_stats_response(EtherAddress, uint32_t);
@@ -315,45 +812,133 @@ public:
 	void send_add_del_lvap_response(uint8_t, EtherAddress, uint32_t, uint32_t);
 	void send_traffic_rule_stats_response(uint32_t, String, int, int);
 
-	int remove_lvap(EmpowerStationState *);
+	// publish false leaves update_iface_lists() to the caller, for bulk
+	// removals
+	int remove_lvap(EmpowerStationState *, bool publish = true);
+	// remove many LVAPs, publishing the tables once; returns how many
+	// were hosted here
+	int remove_lvaps(const Vector<EtherAddress> &);
+	void update_bssid_mask(EmpowerStationState *);
+
+	// Local admission of preauthorized LVAPs. true if the request can be
+	// answered without the controller, the LVAP is then updated as the
+	// controller would. The caller sends the response, then
+	// send_status_lvap().
+	bool admit_auth(EmpowerStationState *, EtherAddress);
+	bool admit_assoc(EmpowerStationState *, String, empower_bands_types);
 	LVAP* lvaps() { return &_lvaps; }
 	VAP* vaps() { return &_vaps; }
+
+	// SSIDs of the LVAPs and VAPs, see EmpowerSSIDTable. Call
+	// intern_ssids() after changing the SSIDs of an LVAP.
+	const EmpowerSSIDTable *ssid_table() const { return &_ssid_table; }
+	void intern_ssids(EmpowerStationState *);
+
+	// BSSIDs of the VAPs of interface iface_id with SSID ssid_id, or of
+	// all of them if ssid_id is -1, for the probe responses. Null if
+	// there are none. Rebuilt with the iface lists
+	const Vector<EtherAddress> *iface_vaps(int iface_id, int ssid_id = -1) const {
+		return _vap_index.get_pointer(vap_index_key(iface_id, ssid_id));
+	}
+
+	// Data-path view of the LVAP and VAP tables. Readers must hold an
+	// EmpowerEpoch::Guard on epoch() for as long as they use the snapshot
+	// or anything returned by it. Call update_iface_lists() after
+	// changing any field mirrored by EmpowerStationHot or EmpowerVAPHot,
+	// or the LVAP/VAP tables.
+	EmpowerEpoch *epoch() { return &_epoch; }
+	const EmpowerStationHotTable *snapshot() {
+		const EmpowerStationHotTable *snapshot = _snapshot;
+		click_read_fence();
+		return snapshot;
+	}
+	const LVAPList &associated_lvaps(int iface_id) { return snapshot()->associated_lvaps(iface_id); }
+	const VAPList &iface_vaps(int iface_id) { return snapshot()->iface_vaps(iface_id); }
+	void update_iface_lists();
 	EtherAddress wtp() { return _wtp; }
 
+	// Rebuild the socket filters of RX_DEVS from the associated LVAPs
+	// and the summary triggers, see EmpowerRxFilter. Called by
+	// update_iface_lists() and by EmpowerRXStats when its summary
+	// triggers change; filters that did not change are left alone.
+	void update_rx_filters();
+
 	uint32_t get_next_seq() { return ++_seq; }
 
+	// resource elements never change after configure, both directions
+	// are resolved through indexes built there
 	int element_to_iface(EtherAddress hwaddr, uint8_t channel, empower_bands_types band) {
-		for (REIter iter = _ifaces_to_elements.begin(); iter.live(); iter++) {
-			if (iter.value()->_hwaddr == hwaddr && iter.value()->_channel == channel && iter.value()->_band == band) {
-				return iter.key();
-			}
-		}
-		return -1;
+		const int *iface = _elements_to_ifaces.get_pointer(ResourceElement(hwaddr, channel, band));
+		return iface ? *iface : -1;
 	}
 
 	ResourceElement* iface_to_element(int iface) {
-		return _ifaces_to_elements.get(iface);
+		if (iface < 0 || iface >= _iface_elements.size()) {
+			return 0;
+		}
+		return _iface_elements[iface];
 	}
 
 	int num_ifaces() {
 		return _rcs.size();
 	}
 
+	// interface of this manager serving the resource element of iface in
+	// other, -1 if none. Used to carry state over on hot-swap.
+	int translate_iface(EmpowerLVAPManager *other, int iface) {
+		ResourceElement *re = other->iface_to_element(iface);
+		return re ? element_to_iface(re->_hwaddr, re->_channel, re->_band) : -1;
+	}
+
 	EmpowerStationState * get_ess(EtherAddress sta) {
 		EmpowerStationState *ess = _lvaps.get_pointer(sta);
 		return ess;
 	}
 
+	const EmpowerStationHot * get_hot(EtherAddress sta) {
+		return snapshot()->get(sta);
+	}
+
+	const EmpowerStationHot * get_hot(EtherAddress sta, EmpowerStationCache *cache) {
+		return snapshot()->get(sta, cache);
+	}
+
 	TxPolicyInfo * get_txp(EtherAddress sta) {
-		EmpowerStationState *ess = _lvaps.get_pointer(sta);
-		if (!ess) {
+		return get_txp(get_hot(sta));
+	}
+
+	TxPolicyInfo * get_txp(const EmpowerStationHot *hot) {
+		if (!hot) {
 			return 0;
 		}
-		Minstrel * rc = _rcs[ess->_iface_id];
-		TxPolicyInfo * txp = rc->tx_policies()->lookup(ess->_sta);
+		Minstrel * rc = _rcs[hot->_iface_id];
+		TxPolicyInfo * txp = rc->tx_policies()->lookup(hot->_sta);
 		return txp;
 	}
 
+	EmpowerMulticastTable * mtbl() { return _mtbl; }
+	class EmpowerRXStats * ers() { return _ers; }
+
+	// 0 if the frames of dozing stations are not held on iface_id
+	EmpowerPowerSaveBuffer * epsb(int iface_id) {
+		if (iface_id < 0 || iface_id >= _epsbs.size()) {
+			return 0;
+		}
+		return _epsbs[iface_id];
+	}
+
+	// per interface components, iface_id must be below num_ifaces()
+	Minstrel * rc(int iface_id) { return _rcs[iface_id]; }
+	EmpowerRegmon * regmon(int iface_id) { return _regmons.size() ? _regmons[iface_id] : 0; }
+	EmpowerQOSManager * eqm(int iface_id) { return _eqms[iface_id]; }
+
+	// Bytes sta takes in every subsystem, on all the interfaces, and
+	// the same for the whole agent, tables and entries of stations that
+	// are not LVAPs included. Queued frames are estimated, see
+	// TrafficRuleQueue::frame_bytes()
+	EmpowerMemoryUsage memory_usage(EtherAddress sta);
+	EmpowerMemoryUsage memory_usage();
+
 	TransmissionPolicies * get_tx_policies(int iface_id) {
 		Minstrel * rc = _rcs[iface_id];
 		return rc->tx_policies();
@@ -361,10 +946,65 @@ public:
 
 private:
 
-	RETable _ifaces_to_elements;
+	enum { MAX_MESSAGE_LENGTH = 1 << 20 };
+
+	enum { DISPATCH_BUCKETS = 12 };
+
+	static int dispatch_bucket(uint32_t);
 
-	void compute_bssid_mask();
-	void send_message(Packet *);
+	struct MessageType {
+		const char *_name;
+		Element *_element;
+		MessageHandler _handler;
+		uint32_t _min_length;
+		uint64_t _messages;
+		uint64_t _bytes;
+		uint64_t _errors;
+		uint64_t _usecs[DISPATCH_BUCKETS];
+		uint64_t _queue_usecs[DISPATCH_BUCKETS];
+	};
+
+	template <int (EmpowerLVAPManager::*H)(Packet *, uint32_t)>
+	static int call_handler(Element *e, Packet *p, uint32_t offset) {
+		return (static_cast<EmpowerLVAPManager *>(e)->*H)(p, offset);
+	}
+
+	// indexed by message type
+	MessageType _dispatch[256];
+	uint64_t _unknown_messages;
+	// time the message being handled waited since its read
+	uint32_t _queue_usecs;
+	// from ECHO_REQUEST messages echoing a hello
+	LatencyHistogram _rtt;
+
+	RETable _ifaces_to_elements;
+	REIndex _elements_to_ifaces;
+	Vector<ResourceElement *> _iface_elements;
+
+	void update_bssid_mask(EmpowerVAPState *);
+	void forget_bssid_mask(BssidMaskEntries &, EtherAddress);
+	void account_bssid_mask(int, EtherAddress, int);
+	void write_bssid_masks();
+	void reclaim_snapshots();
+	void send_message(Packet *, bool urgent = false);
+	void flush_messages();
+	WritablePacket *cached_response(const String &);
+	void cache_response(const String &, Packet *);
+	void clear_responses();
+	void dispatch_message(Packet *, uint32_t);
+	void register_handlers();
+	bool stream_desync(uint32_t);
+	void add_stats_stream(uint32_t, uint16_t, uint16_t);
+	uint8_t *status_entry(EmpowerMessage &, uint16_t &, uint8_t, uint32_t);
+	void finish_status(EmpowerMessage &, uint16_t &);
+	void restore_state();
+	void drop_restored_state();
+	void save_iface_lists();
+	void update_vap_index();
+
+	static uint32_t vap_index_key(int iface_id, int ssid_id) {
+		return ((uint32_t) iface_id << 16) | (uint16_t) (ssid_id + 1);
+	}
 
 	class Empower11k *_e11k;
 	class EmpowerBeaconSource *_ebs;
@@ -377,19 +1017,98 @@ private:
 	LVAP _lvaps;
 	Ports _ports;
 	VAP _vaps;
+	EmpowerSSIDTable _ssid_table;
+	HashTable<uint32_t, Vector<EtherAddress> > _vap_index;
+	EmpowerStationHotTable * volatile _snapshot;
+	uint32_t _snapshot_generation;
+	Vector<EmpowerStationHotTable *> _retired;
+	Vector<uint32_t> _retired_epochs;
+	EmpowerEpoch _epoch;
+	Spinlock _snapshot_lock;
 	Vector<EtherAddress> _masks;
+	Vector<EtherAddress> _written_masks;
+	Vector<BssidMaskCounters> _mask_counters;
+	BssidMaskEntries _mask_lvaps;
+	BssidMaskEntries _mask_vaps;
+	Timer _mask_timer;
+	unsigned int _mask_period; // msecs
+	WritablePacket *_rx_tail;
+	WritablePacket *_egress;
+	Spinlock _egress_lock;
+	Timer _egress_timer;
+	unsigned int _egress_size; // bytes
+	unsigned int _egress_delay; // usecs
+	bool _bulk_status;
+
+	// answers to stats requests, by type and parameters, see RESPONSE_TTL
+	struct CachedResponse {
+		Packet *_p;
+		Timestamp _expiry;
+		CachedResponse() : _p(0) {
+		}
+	};
+	typedef HashTable<String, CachedResponse> ResponseCache;
+	typedef ResponseCache::iterator ResponseIter;
+	ResponseCache _responses;
+	unsigned int _response_ttl; // msecs
+	uint32_t _response_hits;
+	uint32_t _response_misses;
 	Vector<Minstrel *> _rcs;
 	Vector<EmpowerRegmon *> _regmons;
 	Vector<EmpowerQOSManager *> _eqms;
+	Vector<EmpowerPowerSaveBuffer *> _epsbs;
+	class EmpowerMirror *_mirror;
+	Vector<FromDevice *> _rx_devs;
+	Vector<EmpowerRxFilter> _rx_filters;
+	uint32_t _rx_sample;
+	Spinlock _rx_filters_lock;
+	Vector<StatsStream *> _streams;
+	TimerWheel _streams_wheel; // one entry per stream
 	Vector<String> _debugfs_strings;
 	Timer _timer;
 	uint32_t _seq;
+	String _state_filename;
+	uint32_t _state_slots;
+	EmpowerStateFile *_state_file;
+	bool _restoring;
+	bool _sync_pending;
+	uint32_t _sync_version;
+	// features of the controller, from its last caps request
+	uint32_t _controller_caps;
+	bool _export_queues;
+	// QUEUE_IMPORT messages waiting for the ADD_LVAP of their station,
+	// chained by next() in the order they came
+	HashTable<EtherAddress, Packet *> _pending_imports;
+
+	// open timelines, and the histograms of the completed ones by phase,
+	// the last one for their total. The data path marks the first frames,
+	// hence the lock
+	typedef HashTable<EtherAddress, LVAPTimeline> Timelines;
+	Timelines _timelines;
+	LatencyHistogram _timeline_histograms[LVAPTimeline::NB_PHASES + 1];
+	uint32_t _timelines_completed;
+	uint32_t _timelines_expired;
+	Spinlock _timeline_lock;
+	bool _timeline_report;
+
+	void expire_timelines();
+	void mark_masks();
+	void send_lvap_timeline(EtherAddress, const LVAPTimeline &);
+
+	void export_queues(EmpowerStationState *);
+	void seed_queues(EmpowerStationState *, Packet *, uint32_t);
+	void seed_pending_imports(EmpowerStationState *);
+	static void kill_pending_imports(Packet *);
 	EtherAddress _wtp;
 	unsigned int _period; // msecs
 	bool _debug;
 
+	// lvaps, CHUNK_LVAPS a chunk
+	enum { CHUNK_LVAPS = 64 };
+
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 	static String read_handler(Element *, void *);
+	static int lvaps_handler(int, String &, Element *, const Handler *, ErrorHandler *);
 
 };
 
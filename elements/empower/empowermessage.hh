@@ -0,0 +1,105 @@
+#ifndef CLICK_EMPOWERMESSAGE_HH
+#define CLICK_EMPOWERMESSAGE_HH
+#include <click/config.h>
+#include <click/packet.hh>
+#include "empowerpacket.hh"
+CLICK_DECLS
+
+// Builder for messages sent to the controller.
+//
+// start() draws a packet sized like the buffers the Click packet pool
+// recycles, so the common case neither hits the allocator nor needs the
+// message length up front. Only the bytes actually handed out by start()
+// and append() are zeroed. Larger messages grow the packet geometrically.
+// finish() stamps the final length in the header and hands the packet
+// over; a builder that is never finished releases its packet.
+//
+// Growing moves the packet, so pointers returned by start() and append()
+// are valid only until the next append(). Use header() to come back to
+// the header once entries have been appended.
+class EmpowerMessage {
+public:
+
+	enum { BUFFER_SIZE = 2048 };
+
+	EmpowerMessage() : _p(0) {
+	}
+
+	~EmpowerMessage() {
+		if (_p) {
+			_p->kill();
+		}
+	}
+
+	template <typename T> T *start(uint8_t type, uint32_t seq, uint32_t extra = 0) {
+		if (_p) {
+			_p->kill();
+		}
+		uint32_t len = sizeof(T) + extra;
+		uint32_t used = Packet::default_headroom + len;
+		_p = Packet::make(Packet::default_headroom, 0, len, used < BUFFER_SIZE ? BUFFER_SIZE - used : 0);
+		if (!_p) {
+			return 0;
+		}
+		memset(_p->data(), 0, len);
+		T *hdr = (T *) _p->data();
+		hdr->set_version(_empower_version);
+		hdr->set_type(type);
+		hdr->set_seq(seq);
+		return hdr;
+	}
+
+	template <typename T> T *header() {
+		return _p ? (T *) _p->data() : 0;
+	}
+
+	template <typename T> T *append(uint32_t extra = 0) {
+		return (T *) append(sizeof(T) + extra);
+	}
+
+	uint8_t *append(uint32_t len) {
+		if (!_p || (_p->tailroom() < len && !grow(len))) {
+			return 0;
+		}
+		uint32_t offset = _p->length();
+		_p = _p->put(len);
+		if (!_p) {
+			return 0;
+		}
+		memset(_p->data() + offset, 0, len);
+		return _p->data() + offset;
+	}
+
+	uint32_t length() const {
+		return _p ? _p->length() : 0;
+	}
+
+	WritablePacket *finish() {
+		WritablePacket *p = _p;
+		if (p) {
+			((empower_header *) p->data())->set_length(p->length());
+		}
+		_p = 0;
+		return p;
+	}
+
+private:
+
+	WritablePacket *_p;
+
+	bool grow(uint32_t len) {
+		uint32_t size = _p->buffer_length() * 2;
+		uint32_t need = _p->headroom() + _p->length() + len;
+		if (size < need) {
+			size = need;
+		}
+		WritablePacket *q = Packet::make(_p->headroom(), _p->data(), _p->length(), size - _p->headroom() - _p->length());
+		_p->kill();
+		_p = q;
+		return q != 0;
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
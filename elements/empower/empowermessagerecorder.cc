@@ -0,0 +1,116 @@
+/*
+ * empowermessagerecorder.{cc,hh} -- records the messages of the controller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowermessagerecorder.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include "empowerpacket.hh"
+CLICK_DECLS
+
+EmpowerMessageRecorder::EmpowerMessageRecorder() : _f(0), _count(0) {
+}
+
+EmpowerMessageRecorder::~EmpowerMessageRecorder() {
+}
+
+int EmpowerMessageRecorder::configure(Vector<String> &conf, ErrorHandler *errh) {
+	return Args(conf, this, errh)
+			.read_mp("FILENAME", FilenameArg(), _filename)
+			.complete();
+}
+
+int EmpowerMessageRecorder::initialize(ErrorHandler *errh) {
+	_f = fopen(_filename.c_str(), "wb");
+	if (!_f) {
+		return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+	}
+	uint32_t magic = htonl(MAGIC);
+	fwrite(&magic, sizeof(magic), 1, _f);
+	return 0;
+}
+
+void EmpowerMessageRecorder::cleanup(CleanupStage) {
+	if (_f) {
+		fclose(_f);
+		_f = 0;
+	}
+}
+
+void EmpowerMessageRecorder::record(const unsigned char *data, uint32_t len, const Timestamp &ts) {
+	empower_record_header rh;
+	rh.set_timestamp(ts);
+	if (fwrite(&rh, sizeof(rh), 1, _f) != 1 || fwrite(data, 1, len, _f) != len) {
+		click_chatter("%{element} :: %s :: %s: %s",
+				      this,
+				      __func__,
+				      _filename.c_str(),
+				      strerror(errno));
+		return;
+	}
+	_count++;
+}
+
+Packet *EmpowerMessageRecorder::simple_action(Packet *p) {
+
+	if (!_f) {
+		return p;
+	}
+
+	// TCP keeps no message boundaries, a message may span reads
+	Timestamp now = Timestamp::now();
+	_pending.append((const char *) p->data(), p->length());
+
+	const unsigned char *data = (const unsigned char *) _pending.data();
+	uint32_t len = _pending.length();
+	uint32_t offset = 0;
+
+	while (len - offset >= sizeof(struct empower_header)) {
+		uint32_t want = ((struct empower_header *) (data + offset))->length();
+		if (want < sizeof(struct empower_header) || want > MAX_MESSAGE_LENGTH) {
+			click_chatter("%{element} :: %s :: invalid message length %u, dropping stream data",
+					      this,
+					      __func__,
+					      want);
+			offset = len;
+			break;
+		}
+		if (len - offset < want) {
+			break;
+		}
+		record(data + offset, want, now);
+		offset += want;
+	}
+
+	if (offset) {
+		_pending = _pending.substring(offset);
+		fflush(_f);
+	}
+
+	return p;
+
+}
+
+String EmpowerMessageRecorder::read_handler(Element *e, void *) {
+	EmpowerMessageRecorder *r = (EmpowerMessageRecorder *) e;
+	return String(r->_count) + "\n";
+}
+
+void EmpowerMessageRecorder::add_handlers() {
+	add_read_handler("count", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerMessageRecorder)
+ELEMENT_REQUIRES(userlevel)
@@ -0,0 +1,91 @@
+#ifndef CLICK_EMPOWERMESSAGERECORDER_HH
+#define CLICK_EMPOWERMESSAGERECORDER_HH
+#include <click/element.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerMessageRecorder(FILENAME)
+
+=s EmPOWER
+
+Records the messages of the Access Controller to a file
+
+=d
+
+Sits between the Socket connected to the Access Controller and the
+EmpowerLVAPManager. Packets go through unchanged; the messages they carry
+are cut out of the TCP stream and written to FILENAME, each with the time
+it was complete, for EmpowerMessageReplay to play back.
+
+The file starts with the 32-bit magic number 0x454D5052, followed by one
+record per message: the seconds and microseconds of the arrival time as
+32-bit integers, then the message exactly as sent by the controller.
+Integers are in network byte order.
+
+Arguments are:
+
+=over 8
+
+=item FILENAME
+File to write. It is truncated when the router starts.
+
+=back 8
+
+=h count read-only
+Number of messages recorded.
+
+=a EmpowerMessageReplay, EmpowerLVAPManager
+*/
+
+// one record of an EmpowerMessageRecorder file, followed by the message
+struct empower_record_header {
+  private:
+	uint32_t _sec;
+	uint32_t _usec;
+  public:
+	Timestamp timestamp() const {
+		return Timestamp::make_usec(ntohl(_sec), ntohl(_usec));
+	}
+	void set_timestamp(const Timestamp &ts) {
+		_sec = htonl(ts.sec());
+		_usec = htonl(ts.usec());
+	}
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+class EmpowerMessageRecorder : public Element {
+
+public:
+
+	enum { MAGIC = 0x454D5052, MAX_MESSAGE_LENGTH = 1 << 20 };
+
+	EmpowerMessageRecorder() CLICK_COLD;
+	~EmpowerMessageRecorder() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerMessageRecorder"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	Packet *simple_action(Packet *);
+
+private:
+
+	String _filename;
+	FILE *_f;
+	String _pending;
+	uint32_t _count;
+
+	void record(const unsigned char *, uint32_t, const Timestamp &);
+
+	static String read_handler(Element *, void *);
+
+};
+
+CLICK_ENDDECLS
+#endif
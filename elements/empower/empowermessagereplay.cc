@@ -0,0 +1,318 @@
+/*
+ * empowermessagereplay.{cc,hh} -- replays recorded controller messages
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowermessagereplay.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/integers.hh>
+#include <click/userutils.hh>
+#include "empowerpacket.hh"
+#include "empowermessagerecorder.hh"
+CLICK_DECLS
+
+EmpowerMessageReplay::EmpowerMessageReplay() :
+	_speed(1), _burst(64), _loop(1), _stop(false), _active(true),
+	_timer(this), _next(0), _loops(0), _count(0) {
+	clear();
+}
+
+EmpowerMessageReplay::~EmpowerMessageReplay() {
+}
+
+int EmpowerMessageReplay::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	int res = Args(conf, this, errh)
+			.read_mp("FILENAME", FilenameArg(), _filename)
+			.read("SPEED", _speed)
+			.read("BURST", _burst)
+			.read("LOOP", _loop)
+			.read("STOP", _stop)
+			.read("ACTIVE", _active)
+			.complete();
+
+	if (_speed < 0) {
+		return errh->error("SPEED must be non-negative");
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	if (_loop < 0) {
+		return errh->error("LOOP must be non-negative");
+	}
+
+	return res;
+
+}
+
+int EmpowerMessageReplay::load(ErrorHandler *errh) {
+
+	_data = file_string(_filename, errh);
+	if (!_data) {
+		return -1;
+	}
+
+	const unsigned char *data = (const unsigned char *) _data.data();
+	uint32_t len = _data.length();
+
+	uint32_t magic;
+	if (len < sizeof(magic)) {
+		return errh->error("%s: not an EmpowerMessageRecorder file", _filename.c_str());
+	}
+	memcpy(&magic, data, sizeof(magic));
+	if (ntohl(magic) != EmpowerMessageRecorder::MAGIC) {
+		return errh->error("%s: not an EmpowerMessageRecorder file", _filename.c_str());
+	}
+
+	uint32_t offset = sizeof(magic);
+	while (offset < len) {
+		if (len - offset < sizeof(struct empower_record_header) + sizeof(struct empower_header)) {
+			return errh->error("%s: truncated record at offset %u", _filename.c_str(), offset);
+		}
+		Record r;
+		r.ts = ((struct empower_record_header *) (data + offset))->timestamp();
+		r.offset = offset + sizeof(struct empower_record_header);
+		r.length = ((struct empower_header *) (data + r.offset))->length();
+		if (r.length < sizeof(struct empower_header) || r.length > len - r.offset) {
+			return errh->error("%s: bad message length %u at offset %u", _filename.c_str(), r.length, offset);
+		}
+		_records.push_back(r);
+		offset = r.offset + r.length;
+	}
+
+	return 0;
+
+}
+
+int EmpowerMessageReplay::initialize(ErrorHandler *errh) {
+
+	if (load(errh) < 0) {
+		return -1;
+	}
+
+	_timer.initialize(this);
+
+	if (_active) {
+		_timer.schedule_now();
+	}
+
+	return 0;
+
+}
+
+void EmpowerMessageReplay::clear() {
+	memset(_latency, 0, sizeof(_latency));
+	memset(_output, 0, sizeof(_output));
+	_count = 0;
+}
+
+void EmpowerMessageReplay::account(uint8_t type, uint64_t ns) {
+	LatencyStats &l = _latency[type];
+	int bucket = ns ? 64 - ffs_msb(ns) : 0;
+	if (bucket >= NBUCKETS) {
+		bucket = NBUCKETS - 1;
+	}
+	l.count++;
+	l.total_ns += ns;
+	if (ns > l.max_ns) {
+		l.max_ns = ns;
+	}
+	l.buckets[bucket]++;
+}
+
+Timestamp EmpowerMessageReplay::due(const Record &r) const {
+	Timestamp elapsed = r.ts - _records[0].ts;
+	return _origin + Timestamp::make_nsec((Timestamp::value_type) (elapsed.nsecval() / _speed));
+}
+
+void EmpowerMessageReplay::run_timer(Timer *) {
+
+	if (!_active || _records.empty()) {
+		return;
+	}
+
+	Timestamp now = Timestamp::now_steady();
+
+	if (!_origin) {
+		_origin = now;
+	}
+
+	for (int sent = 0; _next < _records.size(); sent++) {
+
+		const Record &r = _records[_next];
+
+		if (_speed > 0) {
+			Timestamp when = due(r);
+			if (when > now) {
+				_timer.schedule_at_steady(when);
+				return;
+			}
+		}
+
+		if (sent == _burst) {
+			_timer.schedule_now();
+			return;
+		}
+
+		WritablePacket *p = Packet::make(_data.data() + r.offset, r.length);
+		if (!p) {
+			click_chatter("%{element} :: %s :: cannot allocate packet!",
+					      this,
+					      __func__);
+			_timer.schedule_now();
+			return;
+		}
+
+		uint8_t type = ((struct empower_header *) p->data())->type();
+
+		Timestamp start = Timestamp::now_steady();
+		output(0).push(p);
+		now = Timestamp::now_steady();
+
+		account(type, (now - start).nsecval());
+
+		_next++;
+		_count++;
+
+	}
+
+	if (_loop == 0 || ++_loops < _loop) {
+		_next = 0;
+		_origin = Timestamp();
+		_timer.schedule_now();
+		return;
+	}
+
+	if (_stop) {
+		router()->please_stop_driver();
+	}
+
+}
+
+void EmpowerMessageReplay::push(int, Packet *p) {
+
+	// replies may be coalesced in one packet
+	const unsigned char *data = p->data();
+	uint32_t len = p->length();
+	uint32_t offset = 0;
+
+	while (len - offset >= sizeof(struct empower_header)) {
+		struct empower_header *h = (struct empower_header *) (data + offset);
+		uint32_t msg_len = h->length();
+		if (msg_len < sizeof(struct empower_header) || msg_len > len - offset) {
+			break;
+		}
+		_output[h->type()].count++;
+		_output[h->type()].bytes += msg_len;
+		offset += msg_len;
+	}
+
+	p->kill();
+
+}
+
+enum {
+	H_COUNT,
+	H_LATENCY,
+	H_OUTPUT,
+	H_ACTIVE,
+	H_RESET
+};
+
+String EmpowerMessageReplay::read_handler(Element *e, void *thunk) {
+
+	EmpowerMessageReplay *r = (EmpowerMessageReplay *) e;
+	StringAccum sa;
+
+	switch ((uintptr_t) thunk) {
+	case H_COUNT:
+		sa << r->_count << "\n";
+		break;
+	case H_LATENCY:
+		for (int t = 0; t < NTYPES; t++) {
+			const LatencyStats &l = r->_latency[t];
+			if (!l.count) {
+				continue;
+			}
+			sa.snprintf(8, "0x%02x", t);
+			sa << " " << l.count << " " << (l.total_ns / l.count) << " " << l.max_ns;
+			for (int b = 0; b < NBUCKETS; b++) {
+				if (l.buckets[b]) {
+					sa << " " << b << ":" << l.buckets[b];
+				}
+			}
+			sa << "\n";
+		}
+		break;
+	case H_OUTPUT:
+		for (int t = 0; t < NTYPES; t++) {
+			const OutputStats &o = r->_output[t];
+			if (!o.count) {
+				continue;
+			}
+			sa.snprintf(8, "0x%02x", t);
+			sa << " " << o.count << " " << o.bytes << "\n";
+		}
+		break;
+	case H_ACTIVE:
+		sa << r->_active << "\n";
+		break;
+	}
+
+	return sa.take_string();
+
+}
+
+int EmpowerMessageReplay::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerMessageReplay *r = (EmpowerMessageReplay *) e;
+	switch ((uintptr_t) thunk) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(cp_uncomment(in_s), active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		r->_active = active;
+		if (active && !r->_timer.scheduled()) {
+			r->_timer.schedule_now();
+		}
+		break;
+	}
+	case H_RESET:
+		r->clear();
+		r->_next = r->_loops = 0;
+		r->_origin = Timestamp();
+		if (r->_active && !r->_timer.scheduled()) {
+			r->_timer.schedule_now();
+		}
+		break;
+	}
+	return 0;
+}
+
+void EmpowerMessageReplay::add_handlers() {
+	add_read_handler("count", read_handler, (void *) H_COUNT);
+	add_read_handler("latency", read_handler, (void *) H_LATENCY);
+	add_read_handler("output", read_handler, (void *) H_OUTPUT);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE, Handler::f_checkbox);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerMessageReplay)
+ELEMENT_REQUIRES(userlevel EmpowerMessageRecorder)
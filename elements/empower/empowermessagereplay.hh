@@ -0,0 +1,150 @@
+#ifndef CLICK_EMPOWERMESSAGEREPLAY_HH
+#define CLICK_EMPOWERMESSAGEREPLAY_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerMessageReplay(FILENAME[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Replays recorded controller messages and measures their processing time
+
+=d
+
+Benchmarks the control plane of an EmPOWER WTP without an Access
+Controller. EmpowerMessageReplay reads the messages recorded by an
+EmpowerMessageRecorder in FILENAME and pushes them out output 0, one
+message per packet, at the pace they were recorded at multiplied by
+SPEED. Output 0 must be connected to an EmpowerLVAPManager.
+
+The time spent in each push, that is the processing of the message by the
+LVAP manager and everything it calls synchronously, is measured on the
+steady clock and kept per message type in a histogram of power of two
+nanosecond buckets. The messages the LVAP manager sends back to the
+controller should be connected to input 0, where they are counted per
+type and dropped.
+
+Keyword arguments are:
+
+=over 8
+
+=item FILENAME
+File written by EmpowerMessageRecorder.
+
+=item SPEED
+Replay speed relative to the recording. 0 means as fast as possible.
+Default is 1.
+
+=item BURST
+Number of messages pushed per timer run when SPEED is 0. Default is 64.
+
+=item LOOP
+Number of times the file is replayed, 0 means forever. Default is 1.
+
+=item STOP
+Stop the driver when the replay is over. Default is false.
+
+=item ACTIVE
+Start when the router starts. If false, nothing is replayed until the
+I<active> handler is set. Default is true.
+
+=back 8
+
+=h count read-only
+Number of messages replayed.
+
+=h latency read-only
+One line per message type replayed: the type, the number of messages, the
+mean and the maximum processing time in nanoseconds, then the non-empty
+buckets of the histogram as I<bucket>:I<count>, where bucket I<b> holds
+times from 2^I<b> to 2^(I<b>+1)-1 nanoseconds.
+
+=h output read-only
+One line per message type sent back: the type, the number of messages and
+their total length in bytes.
+
+=h active read/write
+Whether messages are replayed.
+
+=h reset write-only
+Reset the statistics and restart the replay from the beginning.
+
+=a EmpowerMessageRecorder, EmpowerLVAPManager
+*/
+
+class EmpowerMessageReplay : public Element {
+
+public:
+
+	EmpowerMessageReplay() CLICK_COLD;
+	~EmpowerMessageReplay() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerMessageReplay"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	void push(int, Packet *);
+	void run_timer(Timer *);
+
+private:
+
+	enum { NTYPES = 256, NBUCKETS = 32 };
+
+	struct Record {
+		Timestamp ts;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct LatencyStats {
+		uint64_t count;
+		uint64_t total_ns;
+		uint64_t max_ns;
+		uint32_t buckets[NBUCKETS];
+	};
+
+	struct OutputStats {
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	String _filename;
+	double _speed;
+	int _burst;
+	int _loop;
+	bool _stop;
+	bool _active;
+	Timer _timer;
+
+	String _data;
+	Vector<Record> _records;
+
+	int _next;
+	int _loops;
+	uint64_t _count;
+	Timestamp _origin;
+
+	LatencyStats _latency[NTYPES];
+	OutputStats _output[NTYPES];
+
+	int load(ErrorHandler *);
+	void clear();
+	void account(uint8_t, uint64_t);
+	Timestamp due(const Record &) const;
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,439 @@
+/*
+ * empowermirror.{cc,hh} -- mirrors the frames of selected LVAPs to remote
+ * analysers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowermirror.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <clicknet/wifi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "empowerlvapmanager.hh"
+CLICK_DECLS
+
+// datagram and frame headers, in network byte order
+struct mirror_header {
+	uint8_t  _magic[4];
+	uint8_t  _version;
+	uint8_t  _encap;
+	uint16_t _nb_frames;
+	uint32_t _mirror_id;
+	uint8_t  _wtp[6];
+	uint8_t  _sta[6];
+	uint32_t _seq;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+struct mirror_record {
+	uint32_t _sec;
+	uint32_t _usec;
+	uint16_t _caplen;
+	uint16_t _length;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+EmpowerMirror::EmpowerMirror() :
+		_el(0), _encap(ENCAP_RADIOTAP), _burst(16), _latency(20), _fd(-1),
+		_timer(this), _nmirrors(0), _out(0), _nout(0), _msgs(0), _iovs(0),
+		_send_errors(0) {
+	memset(_mirrors, 0, sizeof(_mirrors));
+}
+
+EmpowerMirror::~EmpowerMirror() {
+}
+
+int EmpowerMirror::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	String encap = "RADIOTAP";
+
+	if (Args(conf, this, errh)
+			.read_mp("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("ENCAP", WordArg(), encap)
+			.read("BURST", _burst)
+			.read("LATENCY", _latency)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (encap == "RADIOTAP") {
+		_encap = ENCAP_RADIOTAP;
+	} else if (encap == "802_11") {
+		_encap = ENCAP_802_11;
+	} else {
+		return errh->error("ENCAP must be RADIOTAP or 802_11");
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	if (!_latency) {
+		return errh->error("LATENCY must be positive");
+	}
+
+	return 0;
+
+}
+
+int EmpowerMirror::initialize(ErrorHandler *errh) {
+
+	_out = new Datagram[_burst];
+	_msgs = new struct mmsghdr[_burst];
+	_iovs = new struct iovec[_burst];
+	if (!_out || !_msgs || !_iovs) {
+		return errh->error("out of memory");
+	}
+
+	_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (_fd < 0) {
+		return errh->error("socket: %s", strerror(errno));
+	}
+	fcntl(_fd, F_SETFL, O_NONBLOCK);
+
+	_timer.initialize(this);
+	_timer.schedule_after_msec(_latency);
+
+	return 0;
+
+}
+
+void EmpowerMirror::cleanup(CleanupStage) {
+	clear_mirrors();
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+	delete[] _out;
+	delete[] _msgs;
+	delete[] _iovs;
+	_out = 0;
+	_msgs = 0;
+	_iovs = 0;
+}
+
+int EmpowerMirror::add_mirror(uint32_t id, EtherAddress sta, IPAddress addr, uint16_t port, uint16_t snaplen, uint32_t rate) {
+
+	if (!rate) {
+		return -1;
+	}
+
+	_lock.acquire();
+
+	int free = -1;
+	for (int i = 0; i < MAX_MIRRORS; i++) {
+		if (_mirrors[i] && _mirrors[i]->_id == id) {
+			_lock.release();
+			return -1;
+		}
+		if (!_mirrors[i] && free < 0) {
+			free = i;
+		}
+	}
+
+	if (free < 0) {
+		_lock.release();
+		return -1;
+	}
+
+	Mirror *m = new Mirror;
+	m->_id = id;
+	m->_sta = sta;
+	memset(&m->_dst, 0, sizeof(m->_dst));
+	m->_dst.sin_family = AF_INET;
+	m->_dst.sin_port = htons(port);
+	m->_dst.sin_addr = addr.in_addr();
+	m->_snaplen = snaplen ? snaplen : 0xFFFF;
+	m->_rate = rate;
+	// a tenth of a second of the cap, and at least a full datagram
+	uint32_t bytes_rate = rate * 125;
+	uint32_t capacity = bytes_rate / 10 > MAX_DATAGRAM ? bytes_rate / 10 : (uint32_t) MAX_DATAGRAM;
+	m->_bucket.assign(bytes_rate, capacity);
+	m->_bucket.set_full();
+	m->_seq = 0;
+	m->_open = -1;
+	m->_frames = 0;
+	m->_bytes = 0;
+	m->_drops = 0;
+	m->_datagrams = 0;
+
+	_mirrors[free] = m;
+	if (free >= _nmirrors) {
+		_nmirrors = free + 1;
+	}
+
+	_lock.release();
+
+	return 0;
+
+}
+
+bool EmpowerMirror::del_mirror(uint32_t id) {
+
+	_lock.acquire();
+
+	for (int i = 0; i < _nmirrors; i++) {
+		Mirror *m = _mirrors[i];
+		if (!m || m->_id != id) {
+			continue;
+		}
+		// the pending datagrams may be the mirror's
+		flush();
+		delete m;
+		_mirrors[i] = 0;
+		int n = _nmirrors;
+		while (n > 0 && !_mirrors[n - 1]) {
+			n--;
+		}
+		_nmirrors = n;
+		_lock.release();
+		return true;
+	}
+
+	_lock.release();
+	return false;
+
+}
+
+void EmpowerMirror::clear_mirrors() {
+	_lock.acquire();
+	if (_out) {
+		flush();
+	}
+	for (int i = 0; i < MAX_MIRRORS; i++) {
+		delete _mirrors[i];
+		_mirrors[i] = 0;
+	}
+	_nmirrors = 0;
+	_lock.release();
+}
+
+// The mirror of the 802.11 frame at data, 0 if none. Called with _lock
+// held.
+EmpowerMirror::Mirror *EmpowerMirror::match(const uint8_t *data, uint32_t length) {
+
+	if (length < 10) {
+		return 0;
+	}
+
+	const struct click_wifi *w = (const struct click_wifi *) data;
+
+	for (int i = 0; i < _nmirrors; i++) {
+		Mirror *m = _mirrors[i];
+		if (!m) {
+			continue;
+		}
+		if (m->_sta == EtherAddress(w->i_addr1)) {
+			return m;
+		}
+		if (length >= 16 && m->_sta == EtherAddress(w->i_addr2)) {
+			return m;
+		}
+	}
+
+	return 0;
+
+}
+
+Packet *EmpowerMirror::simple_action(Packet *p) {
+
+	if (!_nmirrors) {
+		return p;
+	}
+
+	const uint8_t *data = p->data();
+	uint32_t length = p->length();
+
+	if (_encap == ENCAP_RADIOTAP) {
+		if (length < 4) {
+			return p;
+		}
+		uint32_t rt_len = data[2] | (data[3] << 8);
+		if (rt_len > length) {
+			return p;
+		}
+		data += rt_len;
+		length -= rt_len;
+	}
+
+	_lock.acquire();
+	Mirror *m = match(data, length);
+	if (m) {
+		copy(m, p);
+	}
+	_lock.release();
+
+	return p;
+
+}
+
+// The datagram being filled for m, a new one if it has none. Called with
+// _lock held.
+EmpowerMirror::Datagram *EmpowerMirror::open(Mirror *m) {
+
+	if (m->_open >= 0) {
+		return &_out[m->_open];
+	}
+
+	if (_nout == _burst) {
+		flush();
+	}
+
+	Datagram *d = &_out[_nout];
+	d->_mirror = m;
+	d->_length = sizeof(mirror_header);
+	memset(d->_data, 0, sizeof(mirror_header));
+	m->_open = _nout++;
+
+	return d;
+
+}
+
+// Copies p into the datagram of m, if the cap allows. Called with _lock
+// held.
+void EmpowerMirror::copy(Mirror *m, Packet *p) {
+
+	uint32_t caplen = p->length() < m->_snaplen ? p->length() : m->_snaplen;
+	if (caplen > MAX_DATAGRAM - sizeof(mirror_header) - sizeof(mirror_record)) {
+		caplen = MAX_DATAGRAM - sizeof(mirror_header) - sizeof(mirror_record);
+	}
+	uint32_t need = sizeof(mirror_record) + caplen;
+
+	m->_bucket.refill();
+	if (!m->_bucket.remove_if(need)) {
+		m->_drops++;
+		return;
+	}
+
+	Datagram *d = open(m);
+	if (d->_length + need > MAX_DATAGRAM) {
+		// full, it waits for the next flush
+		m->_open = -1;
+		d = open(m);
+	}
+
+	Timestamp ts = p->timestamp_anno() ? p->timestamp_anno() : Timestamp::recent();
+
+	mirror_record *r = (mirror_record *) (d->_data + d->_length);
+	r->_sec = htonl(ts.sec());
+	r->_usec = htonl(ts.usec());
+	r->_caplen = htons(caplen);
+	r->_length = htons(p->length() < 0xFFFF ? p->length() : 0xFFFF);
+	memcpy(r + 1, p->data(), caplen);
+	d->_length += need;
+
+	mirror_header *h = (mirror_header *) d->_data;
+	h->_nb_frames = htons(ntohs(h->_nb_frames) + 1);
+
+	m->_frames++;
+	m->_bytes += caplen;
+
+}
+
+// Sends the pending datagrams. Called with _lock held.
+void EmpowerMirror::flush() {
+
+	if (!_nout) {
+		return;
+	}
+
+	struct mmsghdr *msgs = _msgs;
+	struct iovec *iovs = _iovs;
+	EtherAddress wtp = _el->wtp();
+
+	memset(msgs, 0, sizeof(struct mmsghdr) * _nout);
+
+	for (int i = 0; i < _nout; i++) {
+		Datagram *d = &_out[i];
+		Mirror *m = d->_mirror;
+		mirror_header *h = (mirror_header *) d->_data;
+		memcpy(h->_magic, "EMIR", 4);
+		h->_version = 1;
+		h->_encap = _encap;
+		h->_mirror_id = htonl(m->_id);
+		memcpy(h->_wtp, wtp.data(), 6);
+		memcpy(h->_sta, m->_sta.data(), 6);
+		h->_seq = htonl(m->_seq++);
+		m->_datagrams++;
+		m->_open = -1;
+		iovs[i].iov_base = d->_data;
+		iovs[i].iov_len = d->_length;
+		msgs[i].msg_hdr.msg_name = &m->_dst;
+		msgs[i].msg_hdr.msg_namelen = sizeof(m->_dst);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int sent = 0;
+	while (sent < _nout) {
+		int r = sendmmsg(_fd, msgs + sent, _nout - sent, MSG_DONTWAIT);
+		if (r <= 0) {
+			break;
+		}
+		sent += r;
+	}
+
+	_send_errors += _nout - sent;
+	_nout = 0;
+
+}
+
+void EmpowerMirror::run_timer(Timer *) {
+
+	// del_mirror() flushes what the last mirror left behind
+	if (_nmirrors) {
+		_lock.acquire();
+		flush();
+		_lock.release();
+	}
+
+	_timer.reschedule_after_msec(_latency);
+
+}
+
+String EmpowerMirror::read_handler(Element *e, void *thunk) {
+	EmpowerMirror *td = (EmpowerMirror *) e;
+	switch ((uintptr_t) thunk) {
+	case H_MIRRORS: {
+		StringAccum sa;
+		td->_lock.acquire();
+		for (int i = 0; i < td->_nmirrors; i++) {
+			Mirror *m = td->_mirrors[i];
+			if (!m) {
+				continue;
+			}
+			sa << m->_id << " " << m->_sta.unparse() << " "
+			   << IPAddress(m->_dst.sin_addr) << ":" << ntohs(m->_dst.sin_port)
+			   << " snaplen " << m->_snaplen << " rate " << m->_rate
+			   << " frames " << m->_frames << " bytes " << m->_bytes
+			   << " drops " << m->_drops << " datagrams " << m->_datagrams << "\n";
+		}
+		td->_lock.release();
+		return sa.take_string();
+	}
+	case H_SEND_ERRORS:
+		return String(td->_send_errors) + "\n";
+	default:
+		return String();
+	}
+}
+
+void EmpowerMirror::add_handlers() {
+	add_read_handler("mirrors", read_handler, (void *) H_MIRRORS);
+	add_read_handler("send_errors", read_handler, (void *) H_SEND_ERRORS);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerMirror)
+ELEMENT_REQUIRES(userlevel EmpowerLVAPManager)
@@ -0,0 +1,170 @@
+#ifndef CLICK_EMPOWERMIRROR_HH
+#define CLICK_EMPOWERMIRROR_HH
+#include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/ipaddress.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+#include <click/tokenbucket.hh>
+#include <netinet/in.h>
+#include <sys/socket.h>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerMirror(EL, [ENCAP, BURST, LATENCY])
+
+=s EmPOWER
+
+Mirrors the frames of selected LVAPs to remote analysers
+
+=d
+
+Packets go through unchanged, from input I to output I. The controller
+starts and stops mirrors with add mirror and del mirror messages to EL,
+which needs this element as its MIRROR. A mirror names an LVAP, an
+analyser address and UDP port, a snap length and a rate cap. Frames
+whose transmitter or receiver address is the LVAP are copied, truncated
+to the snap length, into UDP datagrams to the analyser.
+
+Each datagram starts with a header: the magic "EMIR", a version (1), the
+link layer (127 radiotap, 105 802.11), the number of frames, the mirror
+id, the WTP, the LVAP and a sequence number, so that the analyser sees
+the datagrams it lost; then, for each frame, its time in seconds and
+microseconds, captured length and length, and the frame, much like a
+pcap record. All fields are in network byte order.
+
+A mirror never sends more than its rate cap: a token bucket holding a
+tenth of a second of it, at least one datagram, pays for every frame
+copied, and frames finding it empty are not copied. Datagrams are sent
+BURST at a time with sendmmsg(), or once the oldest has waited LATENCY.
+With no mirror set, a frame costs a single test.
+
+Put it where frames carry their radiotap header: after the FromDevice of
+an interface, and before its ToDevice. All the taps of a WTP should go
+through the same EmpowerMirror, one port each, so that the cap holds for
+both directions. Several threads may push frames into it, they take turns
+on a lock held while a frame is copied, and while datagrams are sent.
+
+Arguments are:
+
+=over 8
+
+=item EL
+An EmpowerLVAPManager element.
+
+=item ENCAP
+Link layer of the frames: RADIOTAP or 802_11. Default is RADIOTAP.
+
+=item BURST
+Datagrams sent in one call. Default is 16.
+
+=item LATENCY
+Longest time a datagram waits to be sent, in msec. Default is 20.
+
+=back 8
+
+=h mirrors read-only
+One line per mirror: id, LVAP, analyser, snap length, cap, and frames
+copied, bytes copied, frames over the cap and datagrams sent.
+
+=h send_errors read-only
+Datagrams the socket did not take.
+
+=e
+
+  FromDevice(moni0, PROMISC false, OUTBOUND true, SNIFFER false, BURST 1000)
+    -> mirror :: EmpowerMirror(EL el)
+    -> rx_0 :: EmpowerRxFrontEnd(0);
+
+  sched_0 -> WifiSeq() -> rc_0 -> RadiotapEncap()
+    -> [1] mirror [1]
+    -> ToDevice(moni0);
+
+=a EmpowerCapture, EmpowerFlowSampler, EmpowerLVAPManager
+*/
+
+class EmpowerMirror : public Element {
+
+public:
+
+	EmpowerMirror() CLICK_COLD;
+	~EmpowerMirror() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerMirror"; }
+	const char *port_count() const		{ return "1-/="; }
+	const char *processing() const		{ return AGNOSTIC; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	Packet *simple_action(Packet *);
+	void run_timer(Timer *);
+
+	// rate in kbit/s, snaplen 0 for whole frames; -1 if rate is 0, or
+	// if the id is taken or all MAX_MIRRORS are
+	int add_mirror(uint32_t, EtherAddress, IPAddress, uint16_t, uint16_t, uint32_t);
+	bool del_mirror(uint32_t);
+	void clear_mirrors();
+
+private:
+
+	enum { MAX_MIRRORS = 8, MAX_DATAGRAM = 1400, ENCAP_RADIOTAP = 127, ENCAP_802_11 = 105 };
+
+	struct Mirror {
+		uint32_t _id;
+		EtherAddress _sta;
+		struct sockaddr_in _dst;
+		uint16_t _snaplen;
+		uint32_t _rate;
+		TokenBucket _bucket;
+		uint32_t _seq;
+		// datagram being filled in _out, -1 if none
+		int _open;
+		uint32_t _frames;
+		uint64_t _bytes;
+		uint32_t _drops;
+		uint32_t _datagrams;
+	};
+
+	struct Datagram {
+		Mirror *_mirror;
+		uint32_t _length;
+		uint8_t _data[MAX_DATAGRAM];
+	};
+
+	class EmpowerLVAPManager *_el;
+	int _encap;
+	int _burst;
+	uint32_t _latency;
+	int _fd;
+	Timer _timer;
+
+	// mirrors and datagrams only change under _lock; _nmirrors is read
+	// without it to let frames through when no mirror is set
+	Spinlock _lock;
+	Mirror *_mirrors[MAX_MIRRORS];
+	volatile int _nmirrors;
+	Datagram *_out;
+	int _nout;
+	struct mmsghdr *_msgs;
+	struct iovec *_iovs;
+
+	uint32_t _send_errors;
+
+	Mirror *match(const uint8_t *, uint32_t);
+	void copy(Mirror *, Packet *);
+	Datagram *open(Mirror *);
+	void flush();
+
+	enum { H_MIRRORS, H_SEND_ERRORS };
+
+	static String read_handler(Element *, void *);
+
+};
+
+CLICK_ENDDECLS
+#endif
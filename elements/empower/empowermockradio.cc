@@ -0,0 +1,665 @@
+/*
+ * empowermockradio.{cc,hh} -- stands in for a monitor interface and the
+ * stations around it
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowermockradio.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/wifi.h>
+#include <clicknet/llc.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include <clicknet/radiotap.h>
+#include <elements/wifi/bitrate.hh>
+#include "empowerlvapmanager.hh"
+CLICK_DECLS
+
+// the radiotap headers of the frames received and of the transmit status
+// reports, fields in the order of their present bits
+
+#define MOCK_RX_PRESENT ((1 << IEEE80211_RADIOTAP_FLAGS) | \
+			 (1 << IEEE80211_RADIOTAP_RATE) | \
+			 (1 << IEEE80211_RADIOTAP_CHANNEL) | \
+			 (1 << IEEE80211_RADIOTAP_DBM_ANTSIGNAL) | \
+			 (1 << IEEE80211_RADIOTAP_DBM_ANTNOISE))
+
+struct mock_rx_header {
+	struct ieee80211_radiotap_header hdr;
+	uint8_t flags;
+	uint8_t rate;
+	uint16_t chan_freq;
+	uint16_t chan_flags;
+	int8_t signal;
+	int8_t noise;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+#define MOCK_TX_PRESENT ((1 << IEEE80211_RADIOTAP_RATE) | \
+			 (1 << IEEE80211_RADIOTAP_TX_FLAGS) | \
+			 (1 << IEEE80211_RADIOTAP_DATA_RETRIES))
+
+struct mock_tx_header {
+	struct ieee80211_radiotap_header hdr;
+	uint8_t rate;
+	uint8_t pad;
+	uint16_t tx_flags;
+	uint8_t retries;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+#define MOCK_TX_PRESENT_HT ((1 << IEEE80211_RADIOTAP_TX_FLAGS) | \
+			    (1 << IEEE80211_RADIOTAP_DATA_RETRIES) | \
+			    (1 << IEEE80211_RADIOTAP_MCS))
+
+struct mock_tx_header_ht {
+	struct ieee80211_radiotap_header hdr;
+	uint16_t tx_flags;
+	uint8_t retries;
+	uint8_t mcs_known;
+	uint8_t mcs_flags;
+	uint8_t mcs;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+#define MOCK_NOISE -95
+
+EmpowerMockRadio::EmpowerMockRadio() :
+	_el(0), _nb_stations(64), _channel(1), _rssi_min(-85), _rssi_max(-45),
+	_jitter(3), _length(1000), _burst(32), _active(true), _task(this),
+	_next_station(0), _data(0), _probes(0), _auths(0), _tx(0), _tx_failed(0),
+	_tries(0), _airtime(0) {
+}
+
+EmpowerMockRadio::~EmpowerMockRadio() {
+}
+
+int EmpowerMockRadio::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	uint32_t data_rate = 1000, probe_rate = 10, auth_rate = 0;
+	String rates = "2 4 11 22 12 18 24 36 48 72 96 108";
+
+	if (Args(conf, this, errh)
+			.read("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("STATIONS", _nb_stations)
+			.read("BSSID", _bssid)
+			.read("CHANNEL", _channel)
+			.read("RATES", AnyArg(), rates)
+			.read("RSSI_MIN", _rssi_min)
+			.read("RSSI_MAX", _rssi_max)
+			.read("JITTER", _jitter)
+			.read("DATA_RATE", data_rate)
+			.read("PROBE_RATE", probe_rate)
+			.read("AUTH_RATE", auth_rate)
+			.read("LENGTH", _length)
+			.read("BURST", _burst)
+			.read("ACTIVE", _active)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_nb_stations < 1 || _nb_stations > 0xFFFFFF) {
+		return errh->error("STATIONS must be between 1 and %d", 0xFFFFFF);
+	}
+
+	Vector<String> args;
+	cp_spacevec(cp_uncomment(rates), args);
+	_rates.clear();
+	for (int i = 0; i < args.size(); i++) {
+		int rate;
+		if (!IntArg().parse(args[i], rate) || rate <= 0 || rate > 127) {
+			return errh->error("RATES must be rates in units of 500 kbps");
+		}
+		_rates.push_back(rate);
+	}
+	if (!_rates.size()) {
+		return errh->error("RATES is empty");
+	}
+
+	if (_rssi_min > _rssi_max || _rssi_min < -127 || _rssi_max > 0) {
+		return errh->error("RSSI_MIN and RSSI_MAX must be a range of dBm");
+	}
+
+	if (_jitter < 0 || _jitter > 20) {
+		return errh->error("JITTER must be between 0 and 20");
+	}
+
+	uint32_t min_length = sizeof(click_wifi) + sizeof(click_llc) + sizeof(click_ip) + sizeof(click_udp);
+	if (_length < min_length || _length > 2304) {
+		return errh->error("LENGTH must be between %u and 2304", min_length);
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	_data_rate.set_rate(data_rate, errh);
+	_probe_rate.set_rate(probe_rate, errh);
+	_auth_rate.set_rate(auth_rate, errh);
+
+	return 0;
+
+}
+
+int EmpowerMockRadio::initialize(ErrorHandler *errh) {
+
+	// the stations get the addresses of the LVAPs of EmpowerBenchSource,
+	// and the highest rate their RSSI allows
+	_stations.clear();
+	_index.clear();
+	for (int i = 0; i < _nb_stations; i++) {
+		uint8_t data[6] = { 0x02, 0x00, 0x00, (uint8_t) (i >> 16), (uint8_t) (i >> 8), (uint8_t) i };
+		EmpowerMockStation sta;
+		sta._addr = EtherAddress(data);
+		sta._rssi = _rssi_min + (int) click_random(0, _rssi_max - _rssi_min);
+		sta._rate = _rates[0];
+		for (int r = 0; r < _rates.size(); r++) {
+			if (min_rssi(_rates[r], false) <= sta._rssi && min_rssi(_rates[r], false) > min_rssi(sta._rate, false)) {
+				sta._rate = _rates[r];
+			}
+		}
+		_index.set(sta._addr, _stations.size());
+		_stations.push_back(sta);
+	}
+
+	ScheduleInfo::initialize_task(this, &_task, _active, errh);
+
+	return 0;
+
+}
+
+// Sensitivity of a typical 802.11a/b/g/n receiver: the RSSI a rate needs
+// for a 10% frame error rate, in dBm
+int EmpowerMockRadio::min_rssi(int rate, bool ht) {
+	if (ht) {
+		static const int mcs[8] = { -82, -79, -77, -74, -70, -66, -65, -64 };
+		return mcs[rate & 7] + 3 * ((rate >> 3) & 3);
+	}
+	switch (rate) {
+	case 2: return -94;
+	case 4: return -91;
+	case 11: return -87;
+	case 12: return -82;
+	case 18: return -81;
+	case 22: return -82;
+	case 24: return -79;
+	case 36: return -77;
+	case 48: return -74;
+	case 72: return -70;
+	case 96: return -66;
+	case 108: return -65;
+	default: return -82;
+	}
+}
+
+uint16_t EmpowerMockRadio::frequency() const {
+	if (_channel == 14) {
+		return 2484;
+	}
+	return _channel < 14 ? 2407 + 5 * _channel : 5000 + 5 * _channel;
+}
+
+// The channel is busy for usecs more, from now or from the end of the
+// frame before
+void EmpowerMockRadio::occupy(const Timestamp &now, uint32_t usecs) {
+	if (_busy_until < now) {
+		_busy_until = now;
+	}
+	_busy_until += Timestamp::make_usec(usecs);
+	_airtime += usecs;
+}
+
+// A frame of len bytes from sta, with its radiotap header
+WritablePacket *EmpowerMockRadio::make_frame(const EmpowerMockStation &sta, uint32_t len) {
+
+	WritablePacket *p = Packet::make(sizeof(struct mock_rx_header), 0, len, 0);
+
+	if (!p) {
+		return 0;
+	}
+
+	memset(p->data(), 0, len);
+
+	p = p->push(sizeof(struct mock_rx_header));
+
+	struct mock_rx_header *rh = (struct mock_rx_header *) p->data();
+	memset(rh, 0, sizeof(*rh));
+	rh->hdr.it_len = cpu_to_le16(sizeof(*rh));
+	rh->hdr.it_present = cpu_to_le32(MOCK_RX_PRESENT);
+	rh->rate = sta._rate;
+	rh->chan_freq = cpu_to_le16(frequency());
+	rh->chan_flags = cpu_to_le16((_channel > 14 ? IEEE80211_CHAN_5GHZ : IEEE80211_CHAN_2GHZ) | IEEE80211_CHAN_OFDM);
+	rh->signal = sta._rssi + (int) click_random(0, 2 * _jitter) - _jitter;
+	rh->noise = MOCK_NOISE;
+
+	p->timestamp_anno().assign_now();
+
+	return p;
+
+}
+
+Packet *EmpowerMockRadio::make_data() {
+
+	// the next associated station, at most one round
+	const EmpowerMockStation *sta = 0;
+	EtherAddress bssid;
+
+	for (int i = 0; i < _nb_stations && !sta; i++) {
+		const EmpowerMockStation *s = &_stations[_next_station];
+		if (++_next_station == _nb_stations) {
+			_next_station = 0;
+		}
+		if (!_el) {
+			sta = s;
+			bssid = _bssid;
+			break;
+		}
+		EmpowerStationState *ess = _el->get_ess(s->_addr);
+		if (ess && ess->_association_status) {
+			sta = s;
+			bssid = ess->_lvap_bssid;
+		}
+	}
+
+	if (!sta || bssid == EtherAddress()) {
+		return 0;
+	}
+
+	WritablePacket *p = make_frame(*sta, _length);
+
+	if (!p) {
+		return 0;
+	}
+
+	struct click_wifi *w = (struct click_wifi *) (p->data() + sizeof(struct mock_rx_header));
+	w->i_fc[0] = WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_DATA | WIFI_FC0_SUBTYPE_DATA;
+	w->i_fc[1] = WIFI_FC1_DIR_TODS;
+	memcpy(w->i_addr1, bssid.data(), 6);
+	memcpy(w->i_addr2, sta->_addr.data(), 6);
+	memset(w->i_addr3, 0xff, 6);
+	w->i_seq = cpu_to_le16((_data & 0xfff) << WIFI_SEQ_SEQ_SHIFT);
+
+	struct click_llc *llc = (struct click_llc *) (w + 1);
+	llc->llc_dsap = llc->llc_ssap = LLC_SNAP_LSAP;
+	llc->llc_control = LLC_UI;
+	llc->llc_un.type_snap.ether_type = htons(ETHERTYPE_IP);
+
+	click_ip *ip = (click_ip *) (llc + 1);
+	ip->ip_v = 4;
+	ip->ip_hl = sizeof(click_ip) >> 2;
+	ip->ip_len = htons(_length - sizeof(struct click_wifi) - sizeof(struct click_llc));
+	ip->ip_ttl = 64;
+	ip->ip_p = IP_PROTO_UDP;
+	ip->ip_src.s_addr = htonl(0x0A000002);
+	ip->ip_dst.s_addr = htonl(0x0A000001);
+	ip->ip_sum = click_in_cksum((const unsigned char *) ip, sizeof(click_ip));
+
+	click_udp *udp = (click_udp *) (ip + 1);
+	udp->uh_sport = htons(5001);
+	udp->uh_dport = htons(1024);
+	udp->uh_ulen = htons(_length - sizeof(struct click_wifi) - sizeof(struct click_llc) - sizeof(click_ip));
+
+	occupy(p->timestamp_anno(), calc_usecs_wifi_packet(_length, sta->_rate, 0));
+
+	return p;
+
+}
+
+Packet *EmpowerMockRadio::make_probe() {
+
+	const EmpowerMockStation &sta = _stations[click_random(0, _nb_stations - 1)];
+
+	// wildcard SSID, supported rates
+	int nrates = _rates.size() < 8 ? _rates.size() : 8;
+	WritablePacket *p = make_frame(sta, sizeof(struct click_wifi) + 2 + 2 + nrates);
+
+	if (!p) {
+		return 0;
+	}
+
+	struct click_wifi *w = (struct click_wifi *) (p->data() + sizeof(struct mock_rx_header));
+	w->i_fc[0] = WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_MGT | WIFI_FC0_SUBTYPE_PROBE_REQ;
+	w->i_fc[1] = WIFI_FC1_DIR_NODS;
+	memset(w->i_addr1, 0xff, 6);
+	memcpy(w->i_addr2, sta._addr.data(), 6);
+	memset(w->i_addr3, 0xff, 6);
+
+	uint8_t *ptr = (uint8_t *) (w + 1);
+	ptr[0] = WIFI_ELEMID_SSID;
+	ptr[1] = 0;
+	ptr[2] = WIFI_ELEMID_RATES;
+	ptr[3] = nrates;
+	for (int i = 0; i < nrates; i++) {
+		ptr[4 + i] = _rates[i];
+	}
+
+	occupy(p->timestamp_anno(), calc_usecs_wifi_packet(p->length() - sizeof(struct mock_rx_header), 2, 0));
+
+	return p;
+
+}
+
+Packet *EmpowerMockRadio::make_auth() {
+
+	const EmpowerMockStation &sta = _stations[click_random(0, _nb_stations - 1)];
+
+	EtherAddress bssid = _bssid;
+	if (_el) {
+		EmpowerStationState *ess = _el->get_ess(sta._addr);
+		if (ess) {
+			bssid = ess->_lvap_bssid;
+		}
+	}
+
+	if (bssid == EtherAddress()) {
+		return 0;
+	}
+
+	// open system, sequence 1
+	WritablePacket *p = make_frame(sta, sizeof(struct click_wifi) + 6);
+
+	if (!p) {
+		return 0;
+	}
+
+	struct click_wifi *w = (struct click_wifi *) (p->data() + sizeof(struct mock_rx_header));
+	w->i_fc[0] = WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_MGT | WIFI_FC0_SUBTYPE_AUTH;
+	w->i_fc[1] = WIFI_FC1_DIR_NODS;
+	memcpy(w->i_addr1, bssid.data(), 6);
+	memcpy(w->i_addr2, sta._addr.data(), 6);
+	memcpy(w->i_addr3, bssid.data(), 6);
+
+	uint16_t *body = (uint16_t *) (w + 1);
+	body[0] = cpu_to_le16(WIFI_AUTH_ALG_OPEN);
+	body[1] = cpu_to_le16(1);
+	body[2] = cpu_to_le16(WIFI_STATUS_SUCCESS);
+
+	occupy(p->timestamp_anno(), calc_usecs_wifi_packet(p->length() - sizeof(struct mock_rx_header), 2, 0));
+
+	return p;
+
+}
+
+bool EmpowerMockRadio::run_task(Task *) {
+
+	if (!_active) {
+		return false;
+	}
+
+	Timestamp now = Timestamp::now();
+	int n = 0;
+
+	// management frames first, they are rare
+	while (n < _burst && _probe_rate.need_update(now)) {
+		_probe_rate.update();
+		if (Packet *p = make_probe()) {
+			_probes++;
+			n++;
+			output(0).push(p);
+		}
+	}
+
+	while (n < _burst && _auth_rate.need_update(now)) {
+		_auth_rate.update();
+		if (Packet *p = make_auth()) {
+			_auths++;
+			n++;
+			output(0).push(p);
+		}
+	}
+
+	while (n < _burst && _data_rate.need_update(now)) {
+		_data_rate.update();
+		if (Packet *p = make_data()) {
+			_data++;
+			n++;
+			output(0).push(p);
+		}
+	}
+
+	_task.fast_reschedule();
+	return n > 0;
+
+}
+
+void EmpowerMockRadio::transmit(Packet *p) {
+
+	struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
+	struct click_wifi *w = (struct click_wifi *) p->data();
+	bool ht = ceh->flags & WIFI_EXTRA_MCS;
+	int rate = ceh->rate;
+	int max_tries = ceh->max_tries ? ceh->max_tries : 1;
+
+	if (!ht && rate <= 0) {
+		rate = 2;
+	}
+
+	// group frames are sent once and not acknowledged, frames to
+	// stations not modelled always make it
+	int tries = 1;
+	bool success = true;
+	const EmpowerMockStation *sta = 0;
+
+	if (p->length() >= sizeof(struct click_wifi)
+			&& !(ceh->flags & WIFI_EXTRA_TX_NOACK)
+			&& !EtherAddress(w->i_addr1).is_group()) {
+		sta = station(EtherAddress(w->i_addr1));
+	}
+
+	if (sta) {
+		// the chance of a try, in 1/256, from 0 at 4 dB below what the
+		// rate needs to 1 at 4 dB above
+		for (tries = 1; ; tries++) {
+			int rssi = sta->_rssi + (int) click_random(0, 2 * _jitter) - _jitter;
+			int p256 = (rssi - min_rssi(rate, ht)) * 32 + 128;
+			if ((int) click_random(0, 255) < p256) {
+				break;
+			}
+			if (tries == max_tries) {
+				success = false;
+				break;
+			}
+		}
+	}
+
+	Timestamp now = Timestamp::now();
+	uint32_t usecs = ht ? calc_usecs_wifi_packet_ht(p->length(), rate, tries - 1)
+			    : calc_usecs_wifi_packet(p->length(), rate, tries - 1);
+	occupy(now, usecs);
+
+	_tx++;
+	_tries += tries;
+	if (!success) {
+		_tx_failed++;
+	}
+
+	// the transmit status report: the frame, behind a radiotap header
+	// with the rate, the tries and whether it was acknowledged
+	uint16_t tx_flags = success ? 0 : IEEE80211_RADIOTAP_F_TX_FAIL;
+	WritablePacket *q;
+
+	if (ht) {
+		if (!(q = p->push(sizeof(struct mock_tx_header_ht)))) {
+			return;
+		}
+		struct mock_tx_header_ht *th = (struct mock_tx_header_ht *) q->data();
+		memset(th, 0, sizeof(*th));
+		th->hdr.it_len = cpu_to_le16(sizeof(*th));
+		th->hdr.it_present = cpu_to_le32(MOCK_TX_PRESENT_HT);
+		th->tx_flags = cpu_to_le16(tx_flags);
+		th->retries = tries - 1;
+		th->mcs_known = IEEE80211_RADIOTAP_MCS_HAVE_MCS;
+		th->mcs = rate;
+	} else {
+		if (!(q = p->push(sizeof(struct mock_tx_header)))) {
+			return;
+		}
+		struct mock_tx_header *th = (struct mock_tx_header *) q->data();
+		memset(th, 0, sizeof(*th));
+		th->hdr.it_len = cpu_to_le16(sizeof(*th));
+		th->hdr.it_present = cpu_to_le32(MOCK_TX_PRESENT);
+		th->rate = rate;
+		th->tx_flags = cpu_to_le16(tx_flags);
+		th->retries = tries - 1;
+	}
+
+	q->timestamp_anno() = now;
+	output(0).push(q);
+
+}
+
+String EmpowerMockRadio::read_handler(Element *e, void *thunk) {
+	EmpowerMockRadio *r = (EmpowerMockRadio *) e;
+	switch ((uintptr_t) thunk) {
+	case H_STATIONS: {
+		StringAccum sa;
+		for (int i = 0; i < r->_stations.size(); i++) {
+			const EmpowerMockStation &sta = r->_stations[i];
+			sa << sta._addr << " rssi " << sta._rssi << " rate " << sta._rate << "\n";
+		}
+		return sa.take_string();
+	}
+	case H_DATA:
+		return String(r->_data) + "\n";
+	case H_PROBES:
+		return String(r->_probes) + "\n";
+	case H_AUTHS:
+		return String(r->_auths) + "\n";
+	case H_TX:
+		return String(r->_tx) + "\n";
+	case H_TX_FAILED:
+		return String(r->_tx_failed) + "\n";
+	case H_TRIES:
+		return String(r->_tries) + "\n";
+	case H_AIRTIME:
+		return String(r->_airtime) + "\n";
+	case H_ACTIVE:
+		return String(r->_active) + "\n";
+	default:
+		return String();
+	}
+}
+
+int EmpowerMockRadio::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerMockRadio *r = (EmpowerMockRadio *) e;
+	switch ((uintptr_t) thunk) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(cp_uncomment(in_s), active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		r->_active = active;
+		if (active && !r->_task.scheduled()) {
+			r->_data_rate.reset();
+			r->_probe_rate.reset();
+			r->_auth_rate.reset();
+			r->_task.reschedule();
+		}
+		break;
+	}
+	case H_RESET:
+		r->_data = r->_probes = r->_auths = 0;
+		r->_tx = r->_tx_failed = r->_tries = r->_airtime = 0;
+		break;
+	}
+	return 0;
+}
+
+void EmpowerMockRadio::add_handlers() {
+	add_read_handler("stations", read_handler, (void *) H_STATIONS);
+	add_read_handler("data", read_handler, (void *) H_DATA);
+	add_read_handler("probes", read_handler, (void *) H_PROBES);
+	add_read_handler("auths", read_handler, (void *) H_AUTHS);
+	add_read_handler("tx", read_handler, (void *) H_TX);
+	add_read_handler("tx_failed", read_handler, (void *) H_TX_FAILED);
+	add_read_handler("tries", read_handler, (void *) H_TRIES);
+	add_read_handler("airtime", read_handler, (void *) H_AIRTIME);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE, Handler::f_checkbox);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::f_button);
+	add_task_handlers(&_task);
+}
+
+EmpowerMockRadioSink::EmpowerMockRadioSink() :
+	_radio(0), _burst(32), _task(this) {
+}
+
+EmpowerMockRadioSink::~EmpowerMockRadioSink() {
+}
+
+int EmpowerMockRadioSink::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	if (Args(conf, this, errh)
+			.read_mp("RADIO", ElementCastArg("EmpowerMockRadio"), _radio)
+			.read("BURST", _burst)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	return 0;
+
+}
+
+int EmpowerMockRadioSink::initialize(ErrorHandler *errh) {
+	ScheduleInfo::initialize_task(this, &_task, errh);
+	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
+	return 0;
+}
+
+bool EmpowerMockRadioSink::run_task(Task *) {
+
+	int n = 0;
+
+	// nothing else goes on the air while a frame is
+	while (n < _burst && _radio->busy_until() <= Timestamp::now()) {
+
+		Packet *p = input(0).pull();
+
+		if (!p) {
+			break;
+		}
+
+		// the radiotap header RadiotapEncap put in front
+		const struct ieee80211_radiotap_header *th = (const struct ieee80211_radiotap_header *) p->data();
+		if (p->length() < sizeof(*th) || th->it_version || le16_to_cpu(th->it_len) > p->length()) {
+			p->kill();
+			continue;
+		}
+		p->pull(le16_to_cpu(th->it_len));
+
+		_radio->transmit(p);
+		n++;
+
+	}
+
+	if (_signal || _radio->busy_until() > Timestamp::now()) {
+		_task.fast_reschedule();
+	}
+
+	return n > 0;
+
+}
+
+void EmpowerMockRadioSink::add_handlers() {
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerMockRadio)
+EXPORT_ELEMENT(EmpowerMockRadioSink)
+ELEMENT_REQUIRES(EmpowerLVAPManager bitrate)
@@ -0,0 +1,251 @@
+#ifndef CLICK_EMPOWERMOCKRADIO_HH
+#define CLICK_EMPOWERMOCKRADIO_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include <click/gaprate.hh>
+#include <click/timestamp.hh>
+#include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerMockRadio([EL, I<KEYWORDS>])
+
+EmpowerMockRadioSink(RADIO[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Stands in for a monitor interface and the stations around it
+
+=d
+
+EmpowerMockRadio and EmpowerMockRadioSink replace the FromDevice and the
+ToDevice of a monitor interface, so that the whole graph of a WTP can be
+loaded with hundreds of stations on a server without radios.
+
+EmpowerMockRadio models STATIONS stations, 02:00:00:00:00:00,
+02:00:00:00:00:01 and so on, the addresses EmpowerBenchSource gives its
+LVAPs. Each is given a RSSI drawn uniformly between RSSI_MIN and
+RSSI_MAX, and sends at the highest of RATES its RSSI allows. Frames go
+out of output 0 with a radiotap header, as FromDevice would, at DATA_RATE
+uplink data frames, PROBE_RATE probe requests and AUTH_RATE open
+authentication requests per second, all stations together. Probe and
+authentication requests come from stations picked at random, uplink
+frames from the stations associated to one of the LVAPs of EL, round
+robin; without EL, uplink frames are sent by every station to BSSID. The
+RSSI of every frame varies by up to JITTER dB around the one of its
+station.
+
+EmpowerMockRadioSink pulls the frames sent on the interface, radiotap
+header included, as ToDevice would. A frame takes the air for as long as
+its rate, length and retries make it last, and the sink pulls no other
+frame meanwhile; the uplink frames take their airtime on the same
+channel. Each try to a modelled station succeeds with a probability that
+goes from 0 to 1 as the RSSI of the station goes from 4 dB below to 4 dB
+above what the rate needs, up to the number of tries the rate control
+asked for. The transmit status of the frame then comes out of output 0
+of RADIO, as FromDevice with OUTBOUND would report it, for the rate
+control.
+
+Keyword arguments of EmpowerMockRadio are:
+
+=over 8
+
+=item EL
+An EmpowerLVAPManager element.
+
+=item STATIONS
+Number of stations. Default is 64.
+
+=item BSSID
+Destination of the uplink frames of the stations that have no LVAP, and
+of their authentication requests. Default is 00:00:00:00:00:00, no such
+frames are sent.
+
+=item CHANNEL
+Channel of the interface, reported in the radiotap headers. Default is
+1.
+
+=item RATES
+Legacy rates the stations use, in units of 500 kbps. Default is "2 4 11
+22 12 18 24 36 48 72 96 108".
+
+=item RSSI_MIN, RSSI_MAX
+Range of the RSSI of the stations, in dBm. Defaults are -85 and -45.
+
+=item JITTER
+Variation of the RSSI of a frame around the one of its station, in dB.
+Default is 3.
+
+=item DATA_RATE, PROBE_RATE, AUTH_RATE
+Uplink data frames, probe requests and authentication requests sent per
+second. Defaults are 1000, 10 and 0.
+
+=item LENGTH
+Length of the uplink data frames, 802.11 header included. Default is
+1000.
+
+=item BURST
+Frames sent per task run at most. Default is 32.
+
+=item ACTIVE
+Whether frames are sent. Default is true.
+
+=back 8
+
+Keyword arguments of EmpowerMockRadioSink are:
+
+=over 8
+
+=item BURST
+Frames pulled per task run at most. Default is 32.
+
+=back 8
+
+=h stations read-only
+EmpowerMockRadio: address, RSSI and uplink rate of every station.
+
+=h data, probes, auths read-only
+EmpowerMockRadio: frames of each kind sent.
+
+=h tx, tx_failed, tries read-only
+EmpowerMockRadio: frames transmitted on the interface, those that were
+not acknowledged, and the tries they took.
+
+=h airtime read-only
+EmpowerMockRadio: microseconds the channel was busy.
+
+=h active read/write
+EmpowerMockRadio: whether frames are sent.
+
+=h reset write-only
+EmpowerMockRadio: reset the counters.
+
+=e
+
+  radio :: EmpowerMockRadio(EL el, STATIONS 500, DATA_RATE 20000);
+  radio -> rx_0 :: EmpowerRxFrontEnd(0);
+
+  sched_0 :: PrioSched()
+    -> WifiSeq()
+    -> rc_0
+    -> RadiotapEncap()
+    -> EmpowerMockRadioSink(radio);
+
+=a EmpowerBenchSource, EmpowerRxFrontEnd, Minstrel, FromDevice, ToDevice
+*/
+
+struct EmpowerMockStation {
+	EtherAddress _addr;
+	int _rssi;
+	int _rate;
+};
+
+class EmpowerMockRadio : public Element {
+
+public:
+
+	EmpowerMockRadio() CLICK_COLD;
+	~EmpowerMockRadio() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerMockRadio"; }
+	const char *port_count() const		{ return PORTS_0_1; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	bool run_task(Task *);
+
+	// the modelled station with this address, 0 if none
+	const EmpowerMockStation *station(EtherAddress addr) const {
+		const int *i = _index.get_pointer(addr);
+		return i ? &_stations[*i] : 0;
+	}
+
+	// When the channel is free again
+	const Timestamp &busy_until() const	{ return _busy_until; }
+
+	// Transmit the 802.11 frame p, whose annotations carry the rate and
+	// tries asked for, and report its transmit status on output 0
+	void transmit(Packet *p);
+
+	static int min_rssi(int rate, bool ht);
+
+private:
+
+	class EmpowerLVAPManager *_el;
+	int _nb_stations;
+	EtherAddress _bssid;
+	int _channel;
+	Vector<int> _rates;
+	int _rssi_min;
+	int _rssi_max;
+	int _jitter;
+	uint32_t _length;
+	int _burst;
+	bool _active;
+	Task _task;
+	GapRate _data_rate;
+	GapRate _probe_rate;
+	GapRate _auth_rate;
+
+	Vector<EmpowerMockStation> _stations;
+	HashTable<EtherAddress, int> _index;
+	int _next_station;
+	Timestamp _busy_until;
+
+	uint64_t _data;
+	uint64_t _probes;
+	uint64_t _auths;
+	uint64_t _tx;
+	uint64_t _tx_failed;
+	uint64_t _tries;
+	uint64_t _airtime;
+
+	uint16_t frequency() const;
+	void occupy(const Timestamp &, uint32_t);
+	WritablePacket *make_frame(const EmpowerMockStation &, uint32_t);
+	Packet *make_data();
+	Packet *make_probe();
+	Packet *make_auth();
+
+	enum { H_STATIONS, H_DATA, H_PROBES, H_AUTHS, H_TX, H_TX_FAILED, H_TRIES, H_AIRTIME, H_ACTIVE, H_RESET };
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+class EmpowerMockRadioSink : public Element {
+
+public:
+
+	EmpowerMockRadioSink() CLICK_COLD;
+	~EmpowerMockRadioSink() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerMockRadioSink"; }
+	const char *port_count() const		{ return PORTS_1_0; }
+	const char *processing() const		{ return PULL; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	bool run_task(Task *);
+
+private:
+
+	EmpowerMockRadio *_radio;
+	int _burst;
+	Task _task;
+	NotifierSignal _signal;
+
+};
+
+CLICK_ENDDECLS
+#endif
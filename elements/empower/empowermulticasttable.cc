@@ -26,11 +26,12 @@
 #include "empowerpacket.hh"
 #include "igmppacket.hh"
 #include "empowerigmpmembership.hh"
+#include "empowerlvapmanager.hh"
 #include "empowermulticasttable.hh"
 CLICK_DECLS
 
 EmpowerMulticastTable::EmpowerMulticastTable() :
-	_debug(false) {
+	_el(0), _timer(this), _timeout(260), _generation(0), _debug(false) {
 }
 
 EmpowerMulticastTable::~EmpowerMulticastTable() {
@@ -38,16 +39,191 @@ EmpowerMulticastTable::~EmpowerMulticastTable() {
 
 int EmpowerMulticastTable::configure(Vector<String> &conf, ErrorHandler *errh) {
 
-	int ret = Args(conf, this, errh).read("DEBUG", _debug).complete();
+	int ret = Args(conf, this, errh)
+			  .read("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			  .read("TIMEOUT", _timeout)
+			  .read("DEBUG", _debug)
+			  .complete();
 
 	return ret;
 
 }
 
+int EmpowerMulticastTable::initialize(ErrorHandler *) {
+	_timer.initialize(this);
+	if (_timeout) {
+		_timer.schedule_after_sec(EXPIRE_PERIOD);
+	}
+	return 0;
+}
+
+void EmpowerMulticastTable::run_timer(Timer *) {
+
+	Timestamp expired = Timestamp::recent() - Timestamp::make_sec(_timeout);
+
+	// collect first, leaving rewrites the membership lists
+	Vector<EtherAddress> stas;
+	Vector<Membership> memberships;
+	for (Memberships::iterator it = _sta_groups.begin(); it.live(); it++) {
+		for (int i = 0; i < it.value().size(); i++) {
+			if (it.value()[i].reported < expired) {
+				stas.push_back(it.key());
+				memberships.push_back(it.value()[i]);
+			}
+		}
+	}
+
+	for (int i = 0; i < stas.size(); i++) {
+		if (_debug) {
+			click_chatter("%{element} :: %s :: membership of %s to %s timed out",
+						  this,
+						  __func__,
+						  stas[i].unparse().c_str(),
+						  memberships[i].mac.unparse().c_str());
+		}
+		if (!memberships[i].group) {
+			leavegroup6(stas[i], memberships[i].mac);
+			continue;
+		}
+		if (leavegroup(stas[i], memberships[i].group) && _el) {
+			Vector<IPAddress> groups;
+			Vector<enum empower_igmp_record_type> types;
+			groups.push_back(memberships[i].group);
+			types.push_back(V2_LEAVE_GROUP);
+			_el->send_igmp_report(stas[i], &groups, &types);
+		}
+	}
+
+	_timer.schedule_after_sec(EXPIRE_PERIOD);
+
+}
+
+void EmpowerMulticastTable::index_add(GroupsIndex &index, EtherAddress key, IPAddress group) {
+	GroupList *groups = index.get_pointer(key);
+	if (!groups) {
+		index.set(key, GroupList());
+		groups = index.get_pointer(key);
+	}
+	groups->push_back(group);
+}
+
+void EmpowerMulticastTable::index_del(GroupsIndex &index, EtherAddress key, IPAddress group) {
+	GroupList *groups = index.get_pointer(key);
+	if (!groups) {
+		return;
+	}
+	for (GroupList::iterator i = groups->begin(); i != groups->end(); i++) {
+		if (*i == group) {
+			groups->erase(i);
+			break;
+		}
+	}
+	if (groups->empty()) {
+		index.erase(key);
+	}
+}
+
+// dense index of sta, allocated on its first join
+int EmpowerMulticastTable::station_index(EtherAddress sta) {
+	int *index = _sta_index.get_pointer(sta);
+	if (index) {
+		return *index;
+	}
+	int i;
+	if (_free_indices.size()) {
+		i = _free_indices.back();
+		_free_indices.pop_back();
+		_stations[i] = sta;
+	} else {
+		i = _stations.size();
+		_stations.push_back(sta);
+	}
+	_sta_index.set(sta, i);
+	return i;
+}
+
+EmpowerMulticastTable::Membership *EmpowerMulticastTable::membership(EtherAddress sta, EtherAddress mac, IPAddress group) {
+	MembershipList *joined = _sta_groups.get_pointer(sta);
+	for (int i = 0; joined && i < joined->size(); i++) {
+		if ((*joined)[i].mac == mac && (*joined)[i].group == group) {
+			return &(*joined)[i];
+		}
+	}
+	return 0;
+}
+
+// records that sta joined group (mac for IPv6), false if it only
+// refreshed a membership it had
+bool EmpowerMulticastTable::join(EtherAddress sta, EtherAddress mac, IPAddress group) {
+	Membership *m = membership(sta, mac, group);
+	if (m) {
+		m->reported = Timestamp::recent();
+		return false;
+	}
+	Membership nm;
+	nm.mac = mac;
+	nm.group = group;
+	nm.reported = Timestamp::recent();
+	_sta_groups[sta].push_back(nm);
+	if (_mac_receivers[mac].set(station_index(sta))) {
+		_generation++;
+	}
+	return true;
+}
+
+// records that sta left group (mac for IPv6), releasing its index when
+// it is in no group anymore
+bool EmpowerMulticastTable::leave(EtherAddress sta, EtherAddress mac, IPAddress group) {
+	MembershipList *joined = _sta_groups.get_pointer(sta);
+	if (!joined) {
+		return false;
+	}
+	bool same_mac = false;
+	bool found = false;
+	for (MembershipList::iterator i = joined->begin(); i != joined->end(); ) {
+		if (i->mac == mac && i->group == group) {
+			i = joined->erase(i);
+			found = true;
+			continue;
+		}
+		same_mac |= (i->mac == mac);
+		i++;
+	}
+	if (!found) {
+		return false;
+	}
+	int index = _sta_index.get(sta);
+	if (!same_mac) {
+		mac_leave(mac, index);
+	}
+	if (joined->empty()) {
+		_sta_groups.erase(sta);
+		_sta_index.erase(sta);
+		_stations[index] = EtherAddress();
+		_free_indices.push_back(index);
+	}
+	return true;
+}
+
+void EmpowerMulticastTable::mac_leave(EtherAddress mac, int index) {
+	EmpowerMulticastBitmap *bitmap = _mac_receivers.get_pointer(mac);
+	if (!bitmap || !bitmap->clear(index)) {
+		return;
+	}
+	if (!bitmap->count()) {
+		_mac_receivers.erase(mac);
+	}
+	_generation++;
+}
+
 bool EmpowerMulticastTable::addgroup(IPAddress group) {
 
 	const unsigned char *p = group.data();
 
+	if (multicastgroups.get_pointer(group)) {
+		return false;
+	}
+
 	click_chatter("%{element} :: %s :: Adding IGMP group %d.%d.%d.%d",
 				  this,
 				  __func__,
@@ -55,115 +231,120 @@ bool EmpowerMulticastTable::addgroup(IPAddress group) {
 
 	EmpowerMulticastGroup newgroup;
 	newgroup.group = group;
+	newgroup.mac_group = ip_mcast_addr_to_mac(group);
+	multicastgroups.set(group, newgroup);
+
+	index_add(_mac_groups, newgroup.mac_group, group);
+
+	return true;
 
-	Vector<EmpowerMulticastGroup>::iterator i;
-	for (i = multicastgroups.begin(); i != multicastgroups.end(); i++) {
-		if (IPAddress((*i).group) == IPAddress(group))
-			return false;
+}
+
+void EmpowerMulticastTable::delgroup(IPAddress group) {
+
+	EmpowerMulticastGroup *mg = multicastgroups.get_pointer(group);
+
+	if (!mg) {
+		return;
 	}
 
-	newgroup.mac_group = ip_mcast_addr_to_mac(group);
-	multicastgroups.push_back(newgroup);
+	click_chatter("%{element} :: %s :: IGMP group %d.%d.%d.%d is empty. It is about to be deleted",
+				  this,
+				  __func__,
+				  group.data()[0], group.data()[1],
+				  group.data()[2], group.data()[3]);
 
-	return true;
+	index_del(_mac_groups, mg->mac_group, group);
+	multicastgroups.erase(group);
 
 }
 
 bool EmpowerMulticastTable::joingroup(EtherAddress sta, IPAddress group)
 {
 
-	Vector<EmpowerMulticastGroup>::iterator i;
+	EmpowerMulticastGroup *mg = multicastgroups.get_pointer(group);
 
-	for (i = multicastgroups.begin(); i != multicastgroups.end(); i++)
-	{
-		if ((*i).group.addr() == group.addr())
-		{
-			Vector<EmpowerMulticastReceiver>::iterator a;
-			for (a = (*i).receivers.begin(); a != (*i).receivers.end(); a++)
-			{
-				if ((*a).sta == sta)
-				{
-					click_chatter("%{element} :: %s :: Station %s already in IGMP group %d.%d.%d.%d!",
-							this, __func__, sta.unparse().c_str(), (*i).group.data()[0], (*i).group.data()[1],
-							(*i).group.data()[2], (*i).group.data()[3]);
-					return false;
-				}
-			}
-			EmpowerMulticastReceiver new_receiver;
-			new_receiver.sta = sta;
-			(*i).receivers.push_back(new_receiver);
-			click_chatter("%{element} :: %s :: Station %s added to IGMP group %d.%d.%d.%d!",
-					      this,
-						  __func__,
-						  sta.unparse().c_str(),
-						  (*i).group.data()[0],
-						  (*i).group.data()[1],
-						  (*i).group.data()[2],
-						  (*i).group.data()[3]);
+	if (!mg) {
+		return false;
+	}
 
-			return true;
+	if (!join(sta, mg->mac_group, group)) {
+		if (_debug) {
+			click_chatter("%{element} :: %s :: Station %s already in IGMP group %d.%d.%d.%d",
+					this, __func__, sta.unparse().c_str(), group.data()[0], group.data()[1],
+					group.data()[2], group.data()[3]);
 		}
+		return false;
 	}
 
-	return false;
+	mg->receivers.set(station_index(sta));
+
+	click_chatter("%{element} :: %s :: Station %s added to IGMP group %d.%d.%d.%d!",
+			      this,
+				  __func__,
+				  sta.unparse().c_str(),
+				  group.data()[0],
+				  group.data()[1],
+				  group.data()[2],
+				  group.data()[3]);
+
+	return true;
 }
 
 bool EmpowerMulticastTable::leavegroup(EtherAddress sta, IPAddress group)
 {
 
-	Vector<EmpowerMulticastGroup>::iterator i;
-
-	for (i = multicastgroups.begin(); i != multicastgroups.end(); i++)
-	{
-		if ((*i).group.addr() == group.addr())
-		{
-			Vector<EmpowerMulticastReceiver>::iterator a;
-			for (a = (*i).receivers.begin(); a != (*i).receivers.end(); a++)
-			{
-				if ((*a).sta == sta)
-				{
-					(*i).receivers.erase(a);
-					click_chatter("%{element} :: %s :: Station %s added removed from IGMP group %d.%d.%d.%d",
-										this, __func__, sta.unparse().c_str(),
-										(*i).group.data()[0], (*i).group.data()[1],
-										(*i).group.data()[2], (*i).group.data()[3]);
-					// The group is deleted if no more receivers belong to it
-					if ((*i).receivers.begin() == (*i).receivers.end())
-					{
-						multicastgroups.erase(i);
-						click_chatter("%{element} :: %s :: IGMP group %d.%d.%d.%d is empty. It is about to be deleted",
-																this, __func__, (*i).group.data()[0], (*i).group.data()[1],
-																(*i).group.data()[2], (*i).group.data()[3]);
-					}
-					return true;
-				}
-			}
+	EmpowerMulticastGroup *mg = multicastgroups.get_pointer(group);
+	int *index = _sta_index.get_pointer(sta);
 
+	// the group bit goes first, leave() can release the index
+	if (mg && index && mg->receivers.clear(*index)) {
+		leave(sta, mg->mac_group, group);
+		click_chatter("%{element} :: %s :: Station %s removed from IGMP group %d.%d.%d.%d",
+							this, __func__, sta.unparse().c_str(),
+							group.data()[0], group.data()[1],
+							group.data()[2], group.data()[3]);
+		// The group is deleted if no more receivers belong to it
+		if (!mg->receivers.count()) {
+			delgroup(group);
 		}
+		return true;
 	}
+
 	click_chatter("%{element} :: %s :: IGMP leave group request received from station %s not found in group %d.%d.%d.%d",
-														this, __func__, sta.unparse().c_str(), (*i).group.data()[0], (*i).group.data()[1],
-														(*i).group.data()[2], (*i).group.data()[3]);
+				  this, __func__, sta.unparse().c_str(), group.data()[0], group.data()[1],
+				  group.data()[2], group.data()[3]);
 	return false;
 }
 
-Vector<EmpowerMulticastTable::EmpowerMulticastReceiver>* EmpowerMulticastTable::getIGMPreceivers(EtherAddress group)
+bool EmpowerMulticastTable::joingroup6(EtherAddress sta, EtherAddress mac)
 {
-	Vector<struct EmpowerMulticastGroup>::iterator i;
-
-	for (i = multicastgroups.begin(); i != multicastgroups.end(); i++)
-	{
-		if (i->mac_group == group)
-		{
-			return &(i->receivers);
-		}
+	if (!join(sta, mac, IPAddress())) {
+		return false;
 	}
+	if (_debug) {
+		click_chatter("%{element} :: %s :: Station %s added to MLD group %s",
+					  this,
+					  __func__,
+					  sta.unparse().c_str(),
+					  mac.unparse().c_str());
+	}
+	return true;
+}
 
-	click_chatter("%{element} :: %s :: IGMP group %s not found.",
-														  this,
-														  __func__, group.unparse().c_str());
-
-	return NULL;
+bool EmpowerMulticastTable::leavegroup6(EtherAddress sta, EtherAddress mac)
+{
+	if (!leave(sta, mac, IPAddress())) {
+		return false;
+	}
+	if (_debug) {
+		click_chatter("%{element} :: %s :: Station %s removed from MLD group %s",
+					  this,
+					  __func__,
+					  sta.unparse().c_str(),
+					  mac.unparse().c_str());
+	}
+	return true;
 }
 
 bool EmpowerMulticastTable::leaveallgroups(EtherAddress sta)
@@ -173,42 +354,53 @@ bool EmpowerMulticastTable::leaveallgroups(EtherAddress sta)
 										  this,
 										  __func__, sta.unparse().c_str());
 
-	Vector<EmpowerMulticastGroup>::iterator i;
+	MembershipList *joined = _sta_groups.get_pointer(sta);
 
-	for (i = multicastgroups.begin(); i != multicastgroups.end();)
+	if (!joined) {
+		return true;
+	}
+
+	int index = _sta_index.get(sta);
+	MembershipList groups = *joined;
+	_sta_groups.erase(sta);
+
+	for (MembershipList::iterator i = groups.begin(); i != groups.end(); i++)
 	{
-		Vector<EmpowerMulticastReceiver>::iterator a;
-		for (a = (*i).receivers.begin(); a != (*i).receivers.end(); a++)
-		{
-			if ((*a).sta == sta)
-			{
-				(*i).receivers.erase(a);
-				click_chatter("%{element} :: %s :: Station %s removed from  IGMP group %d.%d.%d.%d",
-									this, __func__, sta.unparse().c_str(),
-									(*i).group.data()[0], (*i).group.data()[1],
-									(*i).group.data()[2], (*i).group.data()[3]);
-
-				break;
-			}
+		mac_leave(i->mac, index);
+		EmpowerMulticastGroup *mg = i->group ? multicastgroups.get_pointer(i->group) : 0;
+		if (!mg || !mg->receivers.clear(index)) {
+			continue;
 		}
-
+		click_chatter("%{element} :: %s :: Station %s removed from  IGMP group %s",
+					  this, __func__, sta.unparse().c_str(),
+					  i->group.unparse().c_str());
 		// The group is deleted if no more receivers belong to it
-		if ((*i).receivers.begin() == (*i).receivers.end())
-		{
-			i = multicastgroups.erase(i);
-			click_chatter("%{element} :: %s :: IGMP group %d.%d.%d.%d is empty. It is about to be deleted",
-													this, __func__, (*i).group.data()[0], (*i).group.data()[1],
-													(*i).group.data()[2], (*i).group.data()[3]);
+		if (!mg->receivers.count()) {
+			delgroup(i->group);
 		}
-		else
-			i++;
 	}
 
+	_sta_index.erase(sta);
+	_stations[index] = EtherAddress();
+	_free_indices.push_back(index);
+
 	return true;
 }
 
+String EmpowerMulticastTable::unparse_receivers(const EmpowerMulticastBitmap &bitmap) const {
+	StringAccum sa;
+	sa << "[ ";
+	for (int i = bitmap.next(0); i >= 0; i = bitmap.next(i + 1)) {
+		sa << _stations[i].unparse();
+		if (bitmap.next(i + 1) >= 0)
+			sa << ", ";
+	}
+	sa << " ]";
+	return sa.take_string();
+}
+
 enum {
-	H_DEBUG, H_MULTICAST_TABLE
+	H_DEBUG, H_MULTICAST_TABLE, H_GROUPS
 };
 
 String EmpowerMulticastTable::read_handler(Element *e, void *thunk) {
@@ -218,18 +410,16 @@ String EmpowerMulticastTable::read_handler(Element *e, void *thunk) {
 		return String(td->_debug) + "\n";
 	case H_MULTICAST_TABLE: {
 		StringAccum sa;
-		Vector<EmpowerMulticastGroup>::iterator i;
-		for (i = td->multicastgroups.begin(); i != td->multicastgroups.end(); i++) {
-			sa << i->group.unparse() << " " <<  i->mac_group.unparse();
-
-			Vector<EmpowerMulticastReceiver>::iterator a;
-			sa << " receivers [ ";
-			for (a = (*i).receivers.begin(); a != (*i).receivers.end(); a++) {
-				sa << (*a).sta.unparse();
-				if (a != (*i).receivers.end())
-					sa << ", ";
-			}
-			sa << "]\n";
+		for (MGIter i = td->multicastgroups.begin(); i.live(); i++) {
+			sa << i.value().group.unparse() << " " <<  i.value().mac_group.unparse();
+			sa << " receivers " << td->unparse_receivers(i.value().receivers) << "\n";
+		}
+		return sa.take_string();
+	}
+	case H_GROUPS: {
+		StringAccum sa;
+		for (HashTable<EtherAddress, EmpowerMulticastBitmap>::const_iterator i = td->_mac_receivers.begin(); i.live(); i++) {
+			sa << i.key().unparse() << " receivers " << td->unparse_receivers(i.value()) << "\n";
 		}
 		return sa.take_string();
 	}
@@ -259,6 +449,7 @@ int EmpowerMulticastTable::write_handler(const String &in_s, Element *e,
 void EmpowerMulticastTable::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
 	add_read_handler("multicast_table", read_handler, (void *) H_MULTICAST_TABLE);
+	add_read_handler("groups", read_handler, (void *) H_GROUPS);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
@@ -4,37 +4,130 @@
 #include <click/element.hh>
 #include <click/config.h>
 #include <click/etheraddress.hh>
+#include <click/ipaddress.hh>
+#include <click/hashtable.hh>
+#include <click/smallvector.hh>
+#include <click/integers.hh>
+#include <click/timer.hh>
 CLICK_DECLS
 
 /*
 =c
 
-EmpowerMulticastTable(RL, EL, [, I<KEYWORDS>])
+EmpowerMulticastTable([I<KEYWORDS>])
 
 =s EmPOWER
 
-Handle IGMP packets
+Multicast receivers learnt by IGMP and MLD snooping
 
 =d
 
+Keeps the receivers of every multicast group joined by the stations of
+this WTP, as reported to EmpowerIgmpMembership. Each station that joined
+a group gets a small dense index, and the receivers of each group are a
+bitmap over those indices, so that joins, leaves and membership tests
+are single bit operations and the data path can walk the receivers of a
+group without searching.
+
+IPv4 groups are also tracked by address, since the controller is told
+about them, and several of them can share an Ethernet address. IPv6
+groups are only tracked by their Ethernet address (33:33 followed by the
+low 32 bits of the group): two IPv6 groups that share it are one group
+to snooping, as they are at layer 2 anyway.
+
+A membership that is not reported again within TIMEOUT is dropped, and
+the leave of an IPv4 group is reported to the controller as if the
+station had sent it.
+
 Keyword arguments are:
 
 =over 8
 
-=item RT
-An AvailableRates element
-
 =item EL
-An EmpowerLVAPManager element
+An EmpowerLVAPManager element, told about IPv4 memberships that time
+out. Optional.
+
+=item TIMEOUT
+Memberships not reported again within this many seconds are dropped,
+default is 260 (the IGMP group membership interval). Zero keeps them
+until the station leaves.
 
 =item DEBUG
 Turn debug on/off
 
 =back 8
 
-=a EmpowerLVAPManager
+=h multicast_table read-only
+One line per IPv4 group: address, Ethernet address and receivers
+
+=h groups read-only
+One line per Ethernet group: address and receivers
+
+=a EmpowerIgmpMembership, EmpowerLVAPManager
 */
 
+// A set of stations, one bit per dense station index of an
+// EmpowerMulticastTable
+class EmpowerMulticastBitmap {
+public:
+
+	EmpowerMulticastBitmap() : _count(0) {
+	}
+
+	bool test(int index) const {
+		int word = index >> 5;
+		return word < _words.size() && (_words[word] & (1U << (index & 31)));
+	}
+
+	// false if index was already set
+	bool set(int index) {
+		int word = index >> 5;
+		while (_words.size() <= word) {
+			_words.push_back(0);
+		}
+		uint32_t bit = 1U << (index & 31);
+		if (_words[word] & bit) {
+			return false;
+		}
+		_words[word] |= bit;
+		_count++;
+		return true;
+	}
+
+	// false if index was not set
+	bool clear(int index) {
+		if (!test(index)) {
+			return false;
+		}
+		_words[index >> 5] &= ~(1U << (index & 31));
+		_count--;
+		return true;
+	}
+
+	// first index set at or after index, -1 if none
+	int next(int index) const {
+		int word = index >> 5;
+		if (index < 0 || word >= _words.size()) {
+			return -1;
+		}
+		uint32_t bits = _words[word] & (~0U << (index & 31));
+		while (!bits) {
+			if (++word >= _words.size()) {
+				return -1;
+			}
+			bits = _words[word];
+		}
+		return (word << 5) + ffs_lsb(bits) - 1;
+	}
+
+	int count() const { return _count; }
+
+private:
+
+	Vector<uint32_t> _words;
+	int _count;
+
+};
 
 class EmpowerMulticastTable: public Element {
 public:
@@ -46,21 +139,20 @@ public:
 	const char *port_count() const { return PORTS_0_0; }
 
 	int configure(Vector<String> &, ErrorHandler *);
+	int initialize(ErrorHandler *);
 	void add_handlers();
-
-	struct EmpowerMulticastReceiver {
-		EtherAddress sta;
-		Vector<IPAddress> sources;
-	};
+	void run_timer(Timer *);
 
 	struct EmpowerMulticastGroup {
-		//unsigned int interface_id;
 		IPAddress group; // group address
 		EtherAddress mac_group;
-		Vector<struct EmpowerMulticastReceiver> receivers;
+		EmpowerMulticastBitmap receivers;
 	};
 
-	Vector<struct EmpowerMulticastGroup> multicastgroups;
+	typedef HashTable<IPAddress, EmpowerMulticastGroup> MulticastGroups;
+	typedef MulticastGroups::iterator MGIter;
+
+	MulticastGroups multicastgroups;
 
 	EtherAddress ip_mcast_addr_to_mac(IPAddress ip) {
 
@@ -77,18 +169,106 @@ public:
 
 	}
 
+	static EtherAddress ip6_mcast_addr_to_mac(const uint8_t *ip6) {
+		unsigned char mac_addr[6] = {0x33, 0x33, ip6[12], ip6[13], ip6[14], ip6[15]};
+		return EtherAddress(mac_addr);
+	}
+
+	// true if snooping knows the receivers of mac, i.e. if it is an IPv4
+	// multicast group outside 224.0.0.0/24, or an IPv6 one other than the
+	// solicited-node groups and ff0x::1 to ff0x::ff, which hosts either
+	// never report or need before they can report anything
+	static bool is_snooped(EtherAddress mac) {
+		const unsigned char *p = mac.data();
+		if (p[0] == 0x33 && p[1] == 0x33) {
+			return p[2] != 0xff && (p[2] || p[3] || p[4]);
+		}
+		if (p[0] != 0x01 || p[1] != 0x00 || p[2] != 0x5e) {
+			return false;
+		}
+		return (p[3] & 0x7f) != 0 || p[4] != 0;
+	}
+
 	bool addgroup(IPAddress);
 	bool joingroup(EtherAddress, IPAddress);
-	//bool addsource(IPAddress, IPAddress, IPAddress);
-	//bool delsource(IPAddress, IPAddress, IPAddress);
 	bool leavegroup(EtherAddress, IPAddress);
+	// MLD, IPv6 groups by Ethernet address
+	bool joingroup6(EtherAddress, EtherAddress);
+	bool leavegroup6(EtherAddress, EtherAddress);
 	bool leaveallgroups(EtherAddress);
-	Vector<struct EmpowerMulticastReceiver> *getIGMPreceivers(EtherAddress);
+
+	// Receivers of the Ethernet group mac, 0 if it has none. Walk them
+	// with next() and station().
+	const EmpowerMulticastBitmap *receivers(EtherAddress mac) const {
+		return _mac_receivers.get_pointer(mac);
+	}
+
+	// true if sta receives the Ethernet group mac
+	bool is_receiver(EtherAddress mac, EtherAddress sta) const {
+		const EmpowerMulticastBitmap *bitmap = _mac_receivers.get_pointer(mac);
+		if (!bitmap) {
+			return false;
+		}
+		const int *index = _sta_index.get_pointer(sta);
+		return index && bitmap->test(*index);
+	}
+
+	EtherAddress station(int index) const { return _stations[index]; }
+
+	// changes whenever the receivers of an Ethernet group change
+	uint32_t generation() const { return _generation; }
 
 private:
 
+	// A group joined by a station: an IPv4 group, or an IPv6 one by its
+	// Ethernet address if group is empty
+	struct Membership {
+		EtherAddress mac;
+		IPAddress group;
+		Timestamp reported;
+	};
+
+	// a few groups share a mac address, and a station joins a few, held
+	// in their entries
+	typedef SmallVector<IPAddress, 2> GroupList;
+	typedef SmallVector<Membership, 4> MembershipList;
+
+	typedef HashTable<EtherAddress, GroupList> GroupsIndex;
+	typedef GroupsIndex::iterator GIIter;
+	typedef HashTable<EtherAddress, MembershipList> Memberships;
+
+	class EmpowerLVAPManager *_el;
+
+	// groups by mac address, several ip groups can share the same one
+	GroupsIndex _mac_groups;
+	// receivers by mac address, whatever the ip group they joined
+	HashTable<EtherAddress, EmpowerMulticastBitmap> _mac_receivers;
+	// groups joined by each station
+	Memberships _sta_groups;
+
+	// dense station indices
+	HashTable<EtherAddress, int> _sta_index;
+	Vector<EtherAddress> _stations;
+	Vector<int> _free_indices;
+
+	enum { EXPIRE_PERIOD = 10 }; // secs
+
+	Timer _timer;
+	uint32_t _timeout; // secs
+	uint32_t _generation;
+
 	bool _debug;
 
+	static void index_add(GroupsIndex &, EtherAddress, IPAddress);
+	static void index_del(GroupsIndex &, EtherAddress, IPAddress);
+	void delgroup(IPAddress);
+	int station_index(EtherAddress);
+	Membership *membership(EtherAddress, EtherAddress, IPAddress);
+	bool join(EtherAddress, EtherAddress, IPAddress);
+	bool leave(EtherAddress, EtherAddress, IPAddress);
+	void mac_leave(EtherAddress, int);
+	String unparse_receivers(const EmpowerMulticastBitmap &) const;
+
 	// Read/Write handlers
 	static String read_handler(Element *e, void *user_data);
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
@@ -32,8 +32,12 @@
 #include "empowerlvapmanager.hh"
 CLICK_DECLS
 
+static const char * const log_sites[] = {
+	"too_small", "not_management", "wrong_subtype", "unknown_station", "csa_active", "wrong_iface", "bad_algorithm", "bad_sequence"
+};
+
 EmpowerOpenAuthResponder::EmpowerOpenAuthResponder() :
-		_el(0), _debug(false) {
+		_el(0), _debug(false), _log(log_sites, NB_LOGS) {
 }
 
 EmpowerOpenAuthResponder::~EmpowerOpenAuthResponder() {
@@ -51,7 +55,7 @@ int EmpowerOpenAuthResponder::configure(Vector<String> &conf,
 void EmpowerOpenAuthResponder::push(int, Packet *p) {
 
 	if (p->length() < sizeof(struct click_wifi)) {
-		click_chatter("%{element} :: %s :: Packet too small: %d Vs. %d",
+		empower_chatter_limited(_log, LOG_TOO_SMALL, "%{element} :: %s :: Packet too small: %d Vs. %d",
 				      this,
 				      __func__,
 				      p->length(),
@@ -66,7 +70,7 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 	uint8_t type = w->i_fc[0] & WIFI_FC0_TYPE_MASK;
 
 	if (type != WIFI_FC0_TYPE_MGT) {
-		click_chatter("%{element} :: %s :: Received non-management packet",
+		empower_chatter_limited(_log, LOG_NOT_MANAGEMENT, "%{element} :: %s :: Received non-management packet",
 				      this,
 				      __func__);
 		p->kill();
@@ -76,7 +80,7 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 	uint8_t subtype = w->i_fc[0] & WIFI_FC0_SUBTYPE_MASK;
 
 	if (subtype != WIFI_FC0_SUBTYPE_AUTH) {
-		click_chatter("%{element} :: %s :: Received non-authentication request packet",
+		empower_chatter_limited(_log, LOG_WRONG_SUBTYPE, "%{element} :: %s :: Received non-authentication request packet",
 				      this,
 				      __func__);
 		p->kill();
@@ -100,7 +104,7 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 
     // If we're not aware of this LVAP, ignore
 	if (!ess) {
-		click_chatter("%{element} :: %s :: Unknown station %s",
+		empower_chatter_limited(_log, LOG_UNKNOWN_STATION, "%{element} :: %s :: Unknown station %s",
 				      this,
 				      __func__,
 				      src.unparse().c_str());
@@ -109,22 +113,22 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 	}
 
     if (ess->_csa_active) {
-		click_chatter("%{element} :: %s :: lvap %s csa active ignoring request.",
+		empower_chatter_limited(_log, LOG_CSA_ACTIVE, "%{element} :: %s :: lvap %s csa active ignoring request.",
 				      this,
 				      __func__,
 				      ess->_sta.unparse().c_str());
     	return;
     }
 
-	// if this is an uplink only lvap then ignore request
-	if (!ess->_set_mask) {
+	// if this is an uplink only or a staged lvap then ignore request
+	if (!ess->_set_mask || ess->_staged) {
 		p->kill();
 		return;
 	}
 
     // If auth request is coming from different channel, ignore
 	if (ess->_iface_id != iface_id) {
-		click_chatter("%{element} :: %s :: %s is on iface %u, message coming from %u",
+		empower_chatter_limited(_log, LOG_WRONG_IFACE, "%{element} :: %s :: %s is on iface %u, message coming from %u",
 				      this,
 				      __func__,
 				      src.unparse().c_str(),
@@ -135,7 +139,7 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 	}
 
 	if (algo != WIFI_AUTH_ALG_OPEN) {
-		click_chatter("%{element} :: %s :: Algorithm %d from %s not supported",
+		empower_chatter_limited(_log, LOG_BAD_ALGORITHM, "%{element} :: %s :: Algorithm %d from %s not supported",
 				      this,
 				      __func__,
 				      algo,
@@ -145,7 +149,7 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 	}
 
 	if (seq != 1) {
-		click_chatter("%{element} :: %s :: Algorithm %u weird sequence number %d",
+		empower_chatter_limited(_log, LOG_BAD_SEQUENCE, "%{element} :: %s :: Algorithm %u weird sequence number %d",
 				      this,
 				      __func__,
 				      algo,
@@ -194,6 +198,14 @@ void EmpowerOpenAuthResponder::push(int, Packet *p) {
 
 	}
 
+	// preauthorized LVAPs are admitted here, the controller is told after
+	if (_el->admit_auth(ess, bssid)) {
+		send_auth_response(src, 2, WIFI_STATUS_SUCCESS, ess->_iface_id);
+		_el->send_status_lvap(src);
+		p->kill();
+		return;
+	}
+
 	_el->send_auth_request(src, bssid);
 	p->kill();
 
@@ -204,6 +216,7 @@ void EmpowerOpenAuthResponder::send_auth_response(EtherAddress dst, uint16_t seq
     EmpowerStationState *ess = _el->get_ess(dst);
 
 	ess->_authentication_status = true;
+	_el->timeline(dst, LVAPTimeline::AUTH);
 
 	if (_debug) {
 		click_chatter("%{element} :: %s :: resetting assoc status", this, __func__);
@@ -213,6 +226,9 @@ void EmpowerOpenAuthResponder::send_auth_response(EtherAddress dst, uint16_t seq
 	ess->_association_status = false;
 	ess->_assoc_id = 0;
 	ess->_ssid = "";
+	ess->_ssid_id = -1;
+	ess->_slice_id = -1;
+	_el->update_iface_lists();
 
 	EtherAddress bssid = ess->_lvap_bssid;
 
@@ -269,7 +285,8 @@ void EmpowerOpenAuthResponder::send_auth_response(EtherAddress dst, uint16_t seq
 }
 
 enum {
-	H_DEBUG
+	H_DEBUG,
+	H_LOG
 };
 
 String EmpowerOpenAuthResponder::read_handler(Element *e, void *thunk) {
@@ -277,6 +294,8 @@ String EmpowerOpenAuthResponder::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_LOG:
+		return td->_log.unparse();
 	default:
 		return String();
 	}
@@ -302,6 +321,7 @@ int EmpowerOpenAuthResponder::write_handler(const String &in_s, Element *e,
 
 void EmpowerOpenAuthResponder::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
+	add_read_handler("log", read_handler, (void *) H_LOG);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
@@ -105,6 +105,58 @@ enum empower_packet_types {
     EMPOWER_PT_WTP_COUNTERS_REQUEST = 0x42,         // ac -> wtp
     EMPOWER_PT_WTP_COUNTERS_RESPONSE = 0x43,        // wtp -> ac
 
+    // Stats streams
+    EMPOWER_PT_ADD_STATS_STREAM = 0x63,             // ac -> wtp
+    EMPOWER_PT_DEL_STATS_STREAM = 0x64,             // ac -> wtp
+    EMPOWER_PT_STATS_STREAM = 0x65,                 // wtp -> ac
+
+    // Restored state
+    EMPOWER_PT_SNAPSHOT_SYNC = 0x66,                // wtp -> ac
+    EMPOWER_PT_SNAPSHOT_SYNC_RESPONSE = 0x67,       // ac -> wtp
+
+    // Bulk status
+    EMPOWER_PT_STATUS_BULK = 0x68,                  // wtp -> ac
+
+    // Per-station rate limits
+    EMPOWER_PT_SET_LVAP_RATE = 0x69,                // ac -> wtp
+
+    // Queued frames of a migrating LVAP
+    EMPOWER_PT_QUEUE_EXPORT = 0x6a,                 // wtp -> ac
+    EMPOWER_PT_QUEUE_IMPORT = 0x6b,                 // ac -> wtp
+
+    // Staged LVAPs
+    EMPOWER_PT_ACTIVATE_LVAP = 0x6c,                // ac -> wtp
+
+    // Delta coded summaries, see EMPOWER_CAPS_COMPACT_SUMMARY
+    EMPOWER_PT_SUMMARY_COMPACT = 0x6d,              // wtp -> ac
+
+    // Downsampled history of the channel and of the neighbors
+    EMPOWER_PT_HISTORY_REQUEST = 0x6e,              // ac -> wtp
+    EMPOWER_PT_HISTORY_RESPONSE = 0x6f,             // wtp -> ac
+
+    // Bulk LVAP removal
+    EMPOWER_PT_DEL_LVAPS = 0x70,                    // ac -> wtp
+
+    // Sampled frame headers, see EmpowerFlowSampler
+    EMPOWER_PT_FLOW_SAMPLES = 0x71,                 // wtp -> ac
+
+    // Remote mirroring of LVAP frames, see EmpowerMirror
+    EMPOWER_PT_ADD_MIRROR = 0x72,                   // ac -> wtp
+    EMPOWER_PT_DEL_MIRROR = 0x73,                   // ac -> wtp
+
+    // RSSI sampling of data frames, see EmpowerRXStats
+    EMPOWER_PT_SET_RX_SAMPLE = 0x74,                // ac -> wtp
+
+    // 802.1Q tag of the uplink frames of an SSID, see EmpowerWifiDecap
+    EMPOWER_PT_SET_SSID_VLAN = 0x75,                // ac -> wtp
+
+    // Join and handover timelines of the LVAPs, see EmpowerLVAPManager
+    EMPOWER_PT_LVAP_TIMELINE = 0x76,                // wtp -> ac
+
+    // Control channel round trip time, see EmpowerLVAPManager
+    EMPOWER_PT_ECHO_REQUEST = 0x77,                 // ac -> wtp
+    EMPOWER_PT_ECHO_RESPONSE = 0x78,                // wtp -> ac
+
 
 };
 
@@ -129,11 +181,35 @@ struct empower_header {
 /* hello packet format */
 struct empower_hello : public empower_header {
   private:
-    uint8_t  _wtp[6]; /* EtherAddress */
-    uint32_t _period; /* Hello period (ms) */
+    uint8_t  _wtp[6];    /* EtherAddress */
+    uint32_t _period;    /* Hello period (ms) */
+    uint64_t _timestamp; /* Agent clock when sent (usec), for ECHO_REQUEST */
   public:
-    void set_period(uint32_t period) { _period = htonl(period); }
-    void set_wtp(EtherAddress wtp)   { memcpy(_wtp, wtp.data(), 6); }
+    void set_period(uint32_t period)       { _period = htonl(period); }
+    void set_wtp(EtherAddress wtp)         { memcpy(_wtp, wtp.data(), 6); }
+    void set_timestamp(uint64_t timestamp) { _timestamp = htobe64(timestamp); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* echo request packet format */
+struct empower_echo_request : public empower_header {
+  private:
+    uint64_t _timestamp; /* Controller clock when sent, echoed back (int) */
+    uint64_t _echo;      /* Timestamp of the last hello received, 0 if none (int) */
+  public:
+    uint64_t timestamp() { return be64toh(_timestamp); }
+    uint64_t echo()      { return be64toh(_echo); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* echo response packet format */
+struct empower_echo_response : public empower_header {
+  private:
+    uint8_t  _wtp[6];    /* EtherAddress */
+    uint64_t _timestamp; /* Of the echo request (int) */
+    uint32_t _queue;     /* Usecs the echo request waited in the agent (int) */
+  public:
+    void set_wtp(EtherAddress wtp)         { memcpy(_wtp, wtp.data(), 6); }
+    void set_timestamp(uint64_t timestamp) { _timestamp = htobe64(timestamp); }
+    void set_queue(uint32_t queue)         { _queue = htonl(queue); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
 /* probe request packet format */
@@ -216,6 +292,22 @@ struct empower_assoc_response : public empower_header {
     EtherAddress sta() { return EtherAddress(_sta); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
+/* optional features, a caps request carries those of the controller and
+ * the caps response those of the agent, each in a trailing caps_flags_entry.
+ * A feature is used if both sides have it */
+enum empower_caps_flags {
+    EMPOWER_CAPS_COMPACT_SUMMARY = (1<<0),
+};
+
+/* caps flags entry format */
+struct caps_flags_entry {
+  private:
+    uint32_t _flags;    /* Features (empower_caps_flags) */
+  public:
+    uint32_t flags()                { return ntohl(_flags); }
+    void set_flags(uint32_t flags)  { _flags = htonl(flags); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
 /* caps packet format */
 struct empower_caps : public empower_header {
 private:
@@ -386,6 +478,64 @@ public:
   void set_nb_entries(uint16_t nb_entries)        { _nb_entries = htons(nb_entries); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
+/* history request packet format, the null address asks for the channel
+ * utilisation of the resource element, any other for the RSSI of that
+ * neighbor. Levels 0 to 3 are 100 ms, 1 s, 10 s and 1 min buckets for the
+ * channel, 1 s, 10 s, 100 s and 10 min ones for the neighbors */
+struct empower_history_request : public empower_header {
+private:
+  uint32_t _history_id; /* Module id (int) */
+  uint8_t  _hwaddr[6];  /* EtherAddress */
+  uint8_t  _channel;    /* WiFi Channel (int) */
+  uint8_t  _band;       /* WiFi band (empower_band_types) */
+  uint8_t  _addr[6];    /* EtherAddress */
+  uint8_t  _level;      /* Resolution (int) */
+  uint8_t  _nb_buckets; /* Buckets wanted per series (int) */
+public:
+    uint32_t history_id()   { return ntohl(_history_id); }
+    uint8_t channel()       { return _channel; }
+    uint8_t band()          { return _band; }
+    EtherAddress hwaddr()   { return EtherAddress(_hwaddr); }
+    EtherAddress addr()     { return EtherAddress(_addr); }
+    uint8_t level()         { return _level; }
+    uint8_t nb_buckets()    { return _nb_buckets; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* history response packet format, followed by nb_series series of
+ * nb_buckets history entries each, oldest first. The last bucket holds
+ * the latest sample and may still be filling. The series are tx, rx and
+ * ed (empower_regmon_types) for the channel, the RSSI for a neighbor */
+struct empower_history_response : public empower_header {
+private:
+  uint32_t _history_id; /* Module id (int) */
+  uint8_t  _wtp[6];     /* EtherAddress */
+  uint8_t  _addr[6];    /* EtherAddress */
+  uint32_t _resolution; /* Bucket length in ms (int) */
+  uint8_t  _nb_series;  /* Int */
+  uint8_t  _nb_buckets; /* Int */
+public:
+  void set_history_id(uint32_t history_id)  { _history_id = htonl(history_id); }
+  void set_wtp(EtherAddress wtp)            { memcpy(_wtp, wtp.data(), 6); }
+  void set_addr(EtherAddress addr)          { memcpy(_addr, addr.data(), 6); }
+  void set_resolution(uint32_t resolution)  { _resolution = htonl(resolution); }
+  void set_nb_series(uint8_t nb_series)     { _nb_series = nb_series; }
+  void set_nb_buckets(uint8_t nb_buckets)   { _nb_buckets = nb_buckets; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* history entry format, mean, min and max are 0 if count is */
+struct history_entry {
+  private:
+    uint32_t _count;    /* Samples (int) */
+    int16_t  _mean;     /* Int */
+    int16_t  _min;      /* Int */
+    int16_t  _max;      /* Int */
+  public:
+    void set_count(uint32_t count)  { _count = htonl(count); }
+    void set_mean(int16_t mean)     { _mean = htons(mean); }
+    void set_min(int16_t min)       { _min = htons(min); }
+    void set_max(int16_t max)       { _max = htons(max); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
 /* channel quality map request packet format */
 struct empower_cqm_request : public empower_header {
 private:
@@ -567,6 +717,17 @@ public:
     EtherAddress encap()            { return EtherAddress(_encap); }
     EtherAddress net_bssid()        { return EtherAddress(_net_bssid); }
     EtherAddress lvap_bssid()       { return EtherAddress(_lvap_bssid); }
+    void set_module_id(uint32_t module_id)          { _module_id = htonl(module_id); }
+    void set_band(uint8_t band)                     { _band = band; }
+    void set_supported_band(uint8_t supported_band) { _supported_band = supported_band; }
+    void set_channel(uint8_t channel)               { _channel = channel; }
+    void set_flag(uint16_t f)                       { _flags = htons(ntohs(_flags) | f); }
+    void set_assoc_id(uint16_t assoc_id)            { _assoc_id = htons(assoc_id); }
+    void set_sta(EtherAddress sta)                  { memcpy(_sta, sta.data(), 6); }
+    void set_hwaddr(EtherAddress hwaddr)            { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_encap(EtherAddress encap)              { memcpy(_encap, encap.data(), 6); }
+    void set_net_bssid(EtherAddress bssid)          { memcpy(_net_bssid, bssid.data(), 6); }
+    void set_lvap_bssid(EtherAddress bssid)         { memcpy(_lvap_bssid, bssid.data(), 6); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
 /* del lvap packet format */
@@ -582,6 +743,8 @@ struct empower_del_lvap : public empower_header {
   public:
     uint32_t module_id()            { return ntohl(_module_id); }
     EtherAddress sta()              { return EtherAddress(_sta); }
+    void set_module_id(uint32_t module_id) { _module_id = htonl(module_id); }
+    void set_sta(EtherAddress sta)  { memcpy(_sta, sta.data(), 6); }
     uint8_t csa_switch_mode()       { return _csa_switch_mode; }
     uint8_t csa_switch_count()      { return _csa_switch_count; }
     uint8_t target_band()           { return _target_band; }
@@ -589,6 +752,20 @@ struct empower_del_lvap : public empower_header {
     EtherAddress target_hwaddr()    { return EtherAddress(_target_hwaddr); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
+/* del lvaps packet format, removes the LVAPs whose address starts with the
+ * first prefix_len bits of sta, all of them if prefix_len is 0. No CSA is
+ * run, each removed LVAP is answered with a del lvap response */
+struct empower_del_lvaps : public empower_header {
+  private:
+    uint32_t _module_id;        /* Transaction id */
+    uint8_t _sta[6];            /* EtherAddress */
+    uint8_t _prefix_len;        /* Bits of sta to match (int) */
+  public:
+    uint32_t module_id()            { return ntohl(_module_id); }
+    EtherAddress sta()              { return EtherAddress(_sta); }
+    uint8_t prefix_len()            { return _prefix_len; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
 /* lvap add/del response packet format */
 struct empower_add_del_lvap_response : public empower_header {
 private:
@@ -597,6 +774,10 @@ private:
     uint32_t _module_id;        /* Transaction id */
     uint32_t _status;           /* Status code */
 public:
+    EtherAddress wtp()                      { return EtherAddress(_wtp); }
+    EtherAddress sta()                      { return EtherAddress(_sta); }
+    uint32_t module_id()                    { return ntohl(_module_id); }
+    uint32_t status()                       { return ntohl(_status); }
     void set_sta(EtherAddress sta)          { memcpy(_sta, sta.data(), 6); }
     void set_module_id(uint32_t module_id)  { _module_id = htonl(module_id); }
     void set_status(uint32_t status)        { _status = htonl(status); }
@@ -778,6 +959,376 @@ public:
     void set_nb_frames(uint16_t nb_entries)  { _nb_entries = htons(nb_entries); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
+/* compact summary packet format, followed by nb_pairs address pair entries
+ * and nb_frames records. A record is a sequence of unsigned LEB128
+ * varints: the index of its address pair, the TSFT, sequence control and
+ * length as zigzag coded differences with the previous record (0 for the
+ * first one), and the flags; then one byte each of RSSI, rate and frame
+ * control type and subtype bits */
+struct empower_summary_compact: public empower_header {
+private:
+    uint32_t _trigger_id;   /* Module id (int) */
+    uint8_t _wtp[6];        /* EtherAddress */
+    uint16_t _nb_frames;    /* Number of records (int) */
+    uint16_t _nb_pairs;     /* Number of address pairs (int) */
+public:
+    void set_trigger_id(uint32_t trigger_id) { _trigger_id = htonl(trigger_id); }
+    void set_wtp(EtherAddress wtp)           { memcpy(_wtp, wtp.data(), 6); }
+    void set_nb_frames(uint16_t nb_frames)   { _nb_frames = htons(nb_frames); }
+    void set_nb_pairs(uint16_t nb_pairs)     { _nb_pairs = htons(nb_pairs); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* address pair entry format */
+struct summary_pair_entry {
+  private:
+    uint8_t _ra[6];     /* Receiver address (EtherAddress) */
+    uint8_t _ta[6];     /* Transmitter address (EtherAddress) */
+  public:
+    void set_ra(EtherAddress ra)        { memcpy(_ra, ra.data(), 6); }
+    void set_ta(EtherAddress ta)        { memcpy(_ta, ta.data(), 6); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+enum empower_flow_directions {
+    EMPOWER_FLOW_DOWNLINK = 0x0,
+    EMPOWER_FLOW_UPLINK = 0x1,
+};
+
+enum empower_flow_encaps {
+    EMPOWER_FLOW_ETHER = 0x0,
+    EMPOWER_FLOW_802_11 = 0x1,
+};
+
+/* flow samples packet format, followed by nb_ssids ssid entries and
+ * nb_samples sample entries */
+struct empower_flow_samples: public empower_header {
+private:
+    uint8_t  _wtp[6];           /* EtherAddress */
+    uint32_t _sampler_id;       /* Sampler id (int) */
+    uint8_t  _direction;        /* Direction (empower_flow_directions) */
+    uint8_t  _encap;            /* Link layer of the samples (empower_flow_encaps) */
+    uint32_t _rate;             /* One frame sampled out of rate (int) */
+    uint32_t _frames;           /* Frames seen since the last message (int) */
+    uint32_t _drops;            /* Samples lost since the last message (int) */
+    uint16_t _nb_ssids;         /* Number of ssid entries (int) */
+    uint16_t _nb_samples;       /* Number of sample entries (int) */
+public:
+    void set_wtp(EtherAddress wtp)              { memcpy(_wtp, wtp.data(), 6); }
+    void set_sampler_id(uint32_t sampler_id)    { _sampler_id = htonl(sampler_id); }
+    void set_direction(uint8_t direction)       { _direction = direction; }
+    void set_encap(uint8_t encap)               { _encap = encap; }
+    void set_rate(uint32_t rate)                { _rate = htonl(rate); }
+    void set_frames(uint32_t frames)            { _frames = htonl(frames); }
+    void set_drops(uint32_t drops)              { _drops = htonl(drops); }
+    void set_nb_ssids(uint16_t nb_ssids)        { _nb_ssids = htons(nb_ssids); }
+    void set_nb_samples(uint16_t nb_samples)    { _nb_samples = htons(nb_samples); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* flow sample entry format, followed by the first caplen bytes of the
+ * frame */
+struct flow_sample_entry {
+  private:
+    uint32_t _age;      /* Usecs between sampling and sending (int) */
+    uint8_t  _sta[6];   /* LVAP, destination or source of the frame (EtherAddress) */
+    uint8_t  _iface_id; /* Interface, 0xff if not known (int) */
+    uint8_t  _ssid;     /* Index of the ssid entry of the slice, 0xff if none (int) */
+    uint32_t _delay;    /* Usecs since the timestamp annotation, 0 if none (int) */
+    uint16_t _length;   /* Length of the frame (int) */
+    uint8_t  _caplen;   /* Bytes of the frame following (int) */
+  public:
+    void set_age(uint32_t age)          { _age = htonl(age); }
+    void set_sta(EtherAddress sta)      { memcpy(_sta, sta.data(), 6); }
+    void set_iface_id(uint8_t iface_id) { _iface_id = iface_id; }
+    void set_ssid(uint8_t ssid)         { _ssid = ssid; }
+    void set_delay(uint32_t delay)      { _delay = htonl(delay); }
+    void set_length(uint16_t length)    { _length = htons(length); }
+    void set_caplen(uint8_t caplen)     { _caplen = caplen; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* add mirror packet format, copies of the frames to and from sta go to
+ * the analyser at addr:port, truncated to snaplen bytes, at most rate
+ * kbit/s of them */
+struct empower_add_mirror: public empower_header {
+private:
+    uint32_t _mirror_id;    /* Mirror id (int) */
+    uint8_t  _sta[6];       /* EtherAddress */
+    uint32_t _addr;         /* Analyser (IPAddress) */
+    uint16_t _port;         /* Analyser UDP port (int) */
+    uint16_t _snaplen;      /* Bytes of a frame copied, radiotap included (int) */
+    uint32_t _rate;         /* Cap in kbit/s (int) */
+public:
+    uint32_t mirror_id()  { return ntohl(_mirror_id); }
+    EtherAddress sta()    { return EtherAddress(_sta); }
+    IPAddress addr()      { return IPAddress(_addr); }
+    uint16_t port()       { return ntohs(_port); }
+    uint16_t snaplen()    { return ntohs(_snaplen); }
+    uint32_t rate()       { return ntohl(_rate); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* del mirror packet format */
+struct empower_del_mirror: public empower_header {
+private:
+    uint32_t _mirror_id;    /* Mirror id (int) */
+public:
+    uint32_t mirror_id()  { return ntohl(_mirror_id); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* set rx sample packet format */
+struct empower_set_rx_sample: public empower_header {
+private:
+    uint32_t _data_sample;  /* One data frame in data_sample (int) */
+public:
+    uint32_t data_sample()  { return ntohl(_data_sample); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* set ssid vlan packet format */
+struct empower_set_ssid_vlan : public empower_header {
+private:
+    uint16_t _vlan_tci;     /* Tag control information, 0 for none (int) */
+    char     _ssid[];       /* SSID (String) */
+public:
+    uint16_t vlan_tci()     { return ntohs(_vlan_tci); }
+    String   ssid()         { int len = length() - 12; return String((char *) _ssid, WIFI_MIN(len, WIFI_NWID_MAXSIZE)); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* stats stream fields */
+enum empower_stats_stream_fields {
+    EMPOWER_STREAM_LVAP_COUNTERS = (1<<0),
+    EMPOWER_STREAM_TRAFFIC_RULES = (1<<1),
+    EMPOWER_STREAM_WTP_COUNTERS = (1<<2),
+};
+
+/* add stats stream packet format */
+struct empower_add_stats_stream: public empower_header {
+private:
+    uint32_t _stream_id;    /* Stream id (int) */
+    uint16_t _period;       /* Reporting period in ms (int) */
+    uint16_t _fields;       /* Reported counters (empower_stats_stream_fields) */
+public:
+    uint32_t stream_id()  { return ntohl(_stream_id); }
+    uint16_t period()     { return ntohs(_period); }
+    uint16_t fields()     { return ntohs(_fields); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* del stats stream packet format */
+struct empower_del_stats_stream: public empower_header {
+private:
+    uint32_t _stream_id;    /* Stream id (int) */
+public:
+    uint32_t stream_id()  { return ntohl(_stream_id); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+enum empower_snapshot_status {
+    EMPOWER_SNAPSHOT_CURRENT = 0x0,
+    EMPOWER_SNAPSHOT_STALE = 0x1,
+};
+
+/* snapshot sync packet format, sent after a restart from a state file */
+struct empower_snapshot_sync: public empower_header {
+private:
+    uint8_t  _wtp[6];           /* EtherAddress */
+    uint32_t _version;          /* Seq of the last message applied (int) */
+    uint16_t _nb_lvaps;         /* Number of LVAPs restored (int) */
+    uint16_t _nb_vaps;          /* Number of VAPs restored (int) */
+public:
+    void set_wtp(EtherAddress wtp)          { memcpy(_wtp, wtp.data(), 6); }
+    void set_version(uint32_t version)      { _version = htonl(version); }
+    void set_nb_lvaps(uint16_t nb_lvaps)    { _nb_lvaps = htons(nb_lvaps); }
+    void set_nb_vaps(uint16_t nb_vaps)      { _nb_vaps = htons(nb_vaps); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* snapshot sync response packet format */
+struct empower_snapshot_sync_response: public empower_header {
+private:
+    uint32_t _version;          /* Version the controller compared against (int) */
+    uint8_t  _status;           /* Outcome (empower_snapshot_status) */
+public:
+    uint32_t version()          { return ntohl(_version); }
+    uint8_t  status()           { return _status; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+enum empower_status_entry_types {
+    EMPOWER_STATUS_ENTRY_LVAP = 0x1,
+    EMPOWER_STATUS_ENTRY_VAP = 0x2,
+    EMPOWER_STATUS_ENTRY_PORT = 0x3,
+    EMPOWER_STATUS_ENTRY_TRAFFIC_RULE = 0x4,
+};
+
+/* bulk status format, entries follow. Carries what a burst of status
+ * lvap/vap/port/traffic rule messages would, without repeating the
+ * header and the wtp in each of them */
+struct empower_status_bulk: public empower_header {
+private:
+    uint8_t  _wtp[6];           /* EtherAddress */
+    uint16_t _nb_entries;       /* Number of entries (int) */
+public:
+    void set_wtp(EtherAddress wtp)          { memcpy(_wtp, wtp.data(), 6); }
+    void set_nb_entries(uint16_t nb)        { _nb_entries = htons(nb); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* bulk status entry format */
+struct status_bulk_entry {
+  private:
+    uint8_t  _type;     /* Entry type (empower_status_entry_types) */
+    uint16_t _length;   /* Entry length, including this header */
+  public:
+    void set_type(uint8_t type)         { _type = type; }
+    void set_length(uint16_t length)    { _length = htons(length); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* lvap status entry, followed by the ssid in use and the advertised
+ * ones (ssid_entry) */
+struct lvap_status_entry: public status_bulk_entry {
+  private:
+    uint16_t _flags;            /* Flags (empower_packet_flags) */
+    uint16_t _assoc_id;         /* Association id */
+    uint8_t  _sta[6];           /* EtherAddress */
+    uint8_t  _encap[6];         /* EtherAddress */
+    uint8_t  _hwaddr[6];        /* EtherAddress */
+    uint8_t  _channel;          /* WiFi channel (int) */
+    uint8_t  _band;             /* WiFi band (empower_band_types) */
+    uint8_t  _supported_band;   /* WiFi band supported by client (empower_band_types) */
+    uint8_t  _net_bssid[6];     /* EtherAddress */
+    uint8_t  _lvap_bssid[6];    /* EtherAddress */
+  public:
+    void set_band(uint8_t band)             { _band = band; }
+    void set_channel(uint8_t channel)       { _channel = channel; }
+    void set_flag(uint16_t f)               { _flags = htons(ntohs(_flags) | f); }
+    void set_assoc_id(uint16_t assoc_id)    { _assoc_id = htons(assoc_id); }
+    void set_hwaddr(EtherAddress hwaddr)    { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_sta(EtherAddress sta)          { memcpy(_sta, sta.data(), 6); }
+    void set_encap(EtherAddress encap)      { memcpy(_encap, encap.data(), 6); }
+    void set_net_bssid(EtherAddress bssid)  { memcpy(_net_bssid, bssid.data(), 6); }
+    void set_lvap_bssid(EtherAddress bssid) { memcpy(_lvap_bssid, bssid.data(), 6); }
+    void set_supported_band(uint8_t supported_band) { _supported_band = supported_band; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* vap status entry, followed by the ssid */
+struct vap_status_entry: public status_bulk_entry {
+  private:
+    uint8_t  _hwaddr[6];        /* EtherAddress */
+    uint8_t  _channel;          /* WiFi channel (int) */
+    uint8_t  _band;             /* WiFi band (empower_band_types) */
+    uint8_t  _net_bssid[6];     /* EtherAddress */
+    char     _ssid[];           /* SSID (String) */
+  public:
+    void set_band(uint8_t band)             { _band = band; }
+    void set_hwaddr(EtherAddress hwaddr)    { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_channel(uint8_t channel)       { _channel = channel; }
+    void set_net_bssid(EtherAddress bssid)  { memcpy(_net_bssid, bssid.data(), 6); }
+    void set_ssid(String ssid)              { memcpy(&_ssid, ssid.data(), ssid.length()); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* port status entry, followed by the rates and the HT rates */
+struct port_status_entry: public status_bulk_entry {
+  private:
+    uint16_t _flags;            /* Flags (empower_port_flags) */
+    uint8_t  _sta[6];           /* EtherAddress */
+    uint8_t  _hwaddr[6];        /* EtherAddress */
+    uint8_t  _channel;          /* WiFi channel (int) */
+    uint8_t  _band;             /* WiFi band (empower_band_types) */
+    uint16_t _rts_cts;          /* RTS/CTS threshold */
+    uint8_t  _tx_mcast;         /* multicast mode (tx_mcast_type) */
+    uint8_t  _ur_mcast_count;   /* Number of unsolicited replies (int) */
+    uint8_t  _nb_mcs;           /* Number of rate entries (int) */
+    uint8_t  _nb_ht_mcs;        /* Number of HT rate entries (int) */
+  public:
+    void set_band(uint8_t band)                         { _band = band; }
+    void set_channel(uint8_t channel)                   { _channel = channel; }
+    void set_flag(uint16_t f)                           { _flags = htons(ntohs(_flags) | f); }
+    void set_hwaddr(EtherAddress hwaddr)                { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_sta(EtherAddress sta)                      { memcpy(_sta, sta.data(), 6); }
+    void set_rts_cts(uint16_t rts_cts)                  { _rts_cts = htons(rts_cts); }
+    void set_tx_mcast(empower_tx_mcast_type tx_mcast)   { _tx_mcast = uint8_t(tx_mcast); }
+    void set_nb_mcs(uint8_t nb_mcs)                     { _nb_mcs = nb_mcs; }
+    void set_nb_ht_mcs(uint8_t nb_ht_mcs)               { _nb_ht_mcs = nb_ht_mcs; }
+    void set_ur_mcast_count(uint8_t ur_mcast_count)     { _ur_mcast_count = ur_mcast_count; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* traffic rule status entry, followed by the ssid */
+struct traffic_rule_status_entry: public status_bulk_entry {
+  private:
+    uint16_t _flags;            /* Aggregation flags */
+    uint8_t  _hwaddr[6];        /* EtherAddress */
+    uint8_t  _channel;          /* WiFi channel (int) */
+    uint8_t  _band;             /* WiFi band (empower_band_types) */
+    uint32_t _quantum;          /* Priority of the slice (int) */
+    uint8_t  _dscp;             /* Traffic DSCP (int) */
+    char     _ssid[];           /* SSID (String) */
+  public:
+    void set_band(uint8_t band)             { _band = band; }
+    void set_channel(uint8_t channel)       { _channel = channel; }
+    void set_hwaddr(EtherAddress hwaddr)    { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_dscp(uint8_t dscp)             { _dscp = dscp; }
+    void set_quantum(uint32_t quantum)      { _quantum = htonl(quantum); }
+    void set_flags(uint16_t f)              { _flags = htons(ntohs(_flags) | f); }
+    void set_ssid(String ssid)              { memcpy(&_ssid, ssid.data(), ssid.length()); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* stats stream report format, entries follow */
+struct empower_stats_stream: public empower_header {
+private:
+    uint32_t _stream_id;        /* Stream id (int) */
+    uint8_t  _wtp[6];           /* EtherAddress */
+    uint16_t _nb_entries;       /* Number of entries (int) */
+public:
+    void set_stream_id(uint32_t stream_id)  { _stream_id = htonl(stream_id); }
+    void set_wtp(EtherAddress wtp)          { memcpy(_wtp, wtp.data(), 6); }
+    void set_nb_entries(uint16_t nb)        { _nb_entries = htons(nb); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* stats stream entry format, all the counters are deltas since the
+ * previous report of the stream */
+struct stats_stream_entry {
+  private:
+    uint8_t  _type;     /* Entry type (empower_stats_stream_fields) */
+    uint8_t  _length;   /* Entry length, including this header */
+  public:
+    void set_type(uint8_t type)     { _type = type; }
+    void set_length(uint8_t length) { _length = length; }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* per lvap stats stream entry */
+struct lvap_stream_entry: public stats_stream_entry {
+  private:
+    uint8_t  _sta[6];       /* EtherAddress */
+    uint32_t _tx_frames;    /* Transmitted frames (int) */
+    uint32_t _rx_frames;    /* Received frames (int) */
+  public:
+    void set_sta(EtherAddress sta)     { memcpy(_sta, sta.data(), 6); }
+    void set_tx_frames(uint32_t tx)    { _tx_frames = htonl(tx); }
+    void set_rx_frames(uint32_t rx)    { _rx_frames = htonl(rx); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* per traffic rule stats stream entry, followed by the ssid */
+struct traffic_rule_stream_entry: public stats_stream_entry {
+  private:
+    uint8_t  _hwaddr[6];    /* EtherAddress */
+    uint8_t  _channel;      /* WiFi channel (int) */
+    uint8_t  _band;         /* WiFi band (empower_band_types) */
+    uint8_t  _dscp;         /* Traffic DSCP (int) */
+    uint32_t _transm_pkts;  /* Transmitted packets (int) */
+    uint32_t _transm_bytes; /* Transmitted bytes (int) */
+    char     _ssid[];       /* SSID (String) */
+  public:
+    void set_hwaddr(EtherAddress hwaddr)   { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_channel(uint8_t channel)      { _channel = channel; }
+    void set_band(uint8_t band)            { _band = band; }
+    void set_dscp(uint8_t dscp)            { _dscp = dscp; }
+    void set_transm_pkts(uint32_t pkts)    { _transm_pkts = htonl(pkts); }
+    void set_transm_bytes(uint32_t bytes)  { _transm_bytes = htonl(bytes); }
+    void set_ssid(String ssid)             { memcpy(_ssid, ssid.data(), ssid.length()); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* per wtp stats stream entry */
+struct wtp_stream_entry: public stats_stream_entry {
+  private:
+    uint32_t _tx_frames;    /* Transmitted frames (int) */
+    uint32_t _rx_frames;    /* Received frames (int) */
+  public:
+    void set_tx_frames(uint32_t tx)    { _tx_frames = htonl(tx); }
+    void set_rx_frames(uint32_t rx)    { _rx_frames = htonl(rx); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
 /* summary entry format */
 struct summary_entry {
   private:
@@ -827,6 +1378,11 @@ public:
     EtherAddress hwaddr()    { return EtherAddress(_hwaddr); }
     EtherAddress net_bssid() { return EtherAddress(_net_bssid); }
     String       ssid()      { int len = length() - 24; return String((char *) _ssid, WIFI_MIN(len, WIFI_NWID_MAXSIZE)); }
+    void set_band(uint8_t band)            { _band = band; }
+    void set_hwaddr(EtherAddress hwaddr)   { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_channel(uint8_t channel)      { _channel = channel; }
+    void set_net_bssid(EtherAddress bssid) { memcpy(_net_bssid, bssid.data(), 6); }
+    void set_ssid(String ssid)             { memcpy(&_ssid, ssid.data(), ssid.length()); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
 /* del vap packet format */
@@ -936,6 +1492,13 @@ struct empower_set_traffic_rule : public empower_header {
     bool            flags(int f)    { return ntohs(_flags) & f; }
     uint8_t         dscp()          { return _dscp; }
     String          ssid()          { int len = length() - 25; return String((char *) _ssid, WIFI_MIN(len, WIFI_NWID_MAXSIZE)); }
+    void set_band(uint8_t band)             { _band = band; }
+    void set_channel(uint8_t channel)       { _channel = channel; }
+    void set_hwaddr(EtherAddress hwaddr)    { memcpy(_hwaddr, hwaddr.data(), 6); }
+    void set_quantum(uint32_t quantum)      { _quantum = htonl(quantum); }
+    void set_flag(uint16_t f)               { _flags = htons(ntohs(_flags) | f); }
+    void set_dscp(uint8_t dscp)             { _dscp = dscp; }
+    void set_ssid(String ssid)              { memcpy(&_ssid, ssid.data(), ssid.length()); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
 struct empower_del_traffic_rule : public empower_header {
@@ -975,6 +1538,11 @@ struct empower_status_traffic_rule : public empower_header {
     void set_ssid(String ssid)              { memcpy(&_ssid, ssid.data(), ssid.length()); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
+/* sojourn time histogram buckets: bucket 0 counts the frames that waited
+ * less than 128 usec, bucket i those that waited less than 128 << i usec
+ * but at least 128 << (i - 1), and the last one everything above */
+#define EMPOWER_SOJOURN_BUCKETS 12
+
 /* tr stats request packet format */
 struct empower_traffic_rule_stats_request : public empower_header {
 private:
@@ -1003,6 +1571,11 @@ struct empower_traffic_rule_stats_response : public empower_header {
     uint32_t    _transm_pkts;       /* Total transmitted packets */
     uint32_t    _transm_bytes;      /* Total transmitted bytes */
     uint32_t    _max_queue_length;  /* Maximum queue length reached */
+    uint32_t    _drops;             /* Frames dropped on a full queue */
+    uint32_t    _codel_drops;       /* Frames dropped by CoDel */
+    uint32_t    _starvations;       /* Rounds skipped for lack of deficit */
+    uint32_t    _sojourn[EMPOWER_SOJOURN_BUCKETS]; /* Sojourn time histogram */
+    uint16_t    _nb_entries;        /* Number of stations (int) */
   public:
     void set_wtp(EtherAddress wtp)                          { memcpy(_wtp, wtp.data(), 6); }
     void set_tr_stats_id(uint32_t tr_stats_id)              { _tr_stats_id = htonl(tr_stats_id); }
@@ -1011,6 +1584,94 @@ struct empower_traffic_rule_stats_response : public empower_header {
     void set_transm_pkts(uint32_t transm_pkts)              { _transm_pkts = htonl(transm_pkts); }
     void set_transm_bytes(uint32_t transm_bytes)            { _transm_bytes = htonl(transm_bytes); }
     void set_max_queue_length(uint32_t max_queue_length)    { _max_queue_length = htonl(max_queue_length); }
+    void set_drops(uint32_t drops)                          { _drops = htonl(drops); }
+    void set_codel_drops(uint32_t codel_drops)              { _codel_drops = htonl(codel_drops); }
+    void set_starvations(uint32_t starvations)              { _starvations = htonl(starvations); }
+    void set_sojourn(int i, uint32_t count)                 { _sojourn[i] = htonl(count); }
+    void set_nb_entries(uint16_t nb_entries)                { _nb_entries = htons(nb_entries); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* traffic rule stats entry format, one per station queue */
+struct empower_traffic_rule_stats_entry {
+  private:
+    uint8_t     _sta[6];            /* EtherAddress */
+    uint32_t    _transm_pkts;       /* Total transmitted packets */
+    uint32_t    _max_queue_length;  /* Maximum queue length reached */
+    uint32_t    _drops;             /* Frames dropped on a full queue */
+    uint32_t    _codel_drops;       /* Frames dropped by CoDel */
+    uint32_t    _starvations;       /* Rounds skipped for lack of airtime */
+    uint32_t    _sojourn[EMPOWER_SOJOURN_BUCKETS]; /* Sojourn time histogram */
+  public:
+    void set_sta(EtherAddress sta)                          { memcpy(_sta, sta.data(), 6); }
+    void set_transm_pkts(uint32_t transm_pkts)              { _transm_pkts = htonl(transm_pkts); }
+    void set_max_queue_length(uint32_t max_queue_length)    { _max_queue_length = htonl(max_queue_length); }
+    void set_drops(uint32_t drops)                          { _drops = htonl(drops); }
+    void set_codel_drops(uint32_t codel_drops)              { _codel_drops = htonl(codel_drops); }
+    void set_starvations(uint32_t starvations)              { _starvations = htonl(starvations); }
+    void set_sojourn(int i, uint32_t count)                 { _sojourn[i] = htonl(count); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* set lvap rate packet format, caps the downlink of a station */
+struct empower_set_lvap_rate : public empower_header {
+  private:
+    uint8_t     _sta[6];            /* EtherAddress */
+    uint32_t    _rate;              /* Bytes per second, 0 lifts the cap (int) */
+    uint32_t    _burst;             /* Bucket size in bytes (int) */
+  public:
+    EtherAddress sta()              { return EtherAddress(_sta); }
+    uint32_t rate()                 { return ntohl(_rate); }
+    uint32_t burst()                { return ntohl(_burst); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* activate lvap packet format, for an LVAP added with the staged flag */
+struct empower_activate_lvap : public empower_header {
+  private:
+    uint8_t     _sta[6];            /* EtherAddress */
+  public:
+    EtherAddress sta()              { return EtherAddress(_sta); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* lvap timeline packet format, one completed timeline. Phases not
+ * reached, or where the timeline started, are 0xffffffff */
+struct empower_lvap_timeline : public empower_header {
+  private:
+    uint8_t     _wtp[6];            /* EtherAddress */
+    uint8_t     _sta[6];            /* EtherAddress */
+    uint32_t    _total;             /* Usecs from the first phase to the last (int) */
+    uint32_t    _phases[7];         /* Usecs since the phase before: probe, add_lvap, auth, assoc, mask, first_ul, first_dl (int) */
+  public:
+    void set_wtp(EtherAddress wtp)              { memcpy(_wtp, wtp.data(), 6); }
+    void set_sta(EtherAddress sta)              { memcpy(_sta, sta.data(), 6); }
+    void set_total(uint32_t total)              { _total = htonl(total); }
+    void set_phase(int phase, uint32_t usecs)   { _phases[phase] = htonl(usecs); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* queue frames format, entries follow. The frames queued for an LVAP
+ * leaving a WTP, sent as QUEUE_EXPORT and relayed by the controller to
+ * the target WTP as QUEUE_IMPORT */
+struct empower_queue_frames : public empower_header {
+  private:
+    uint8_t     _wtp[6];            /* EtherAddress */
+    uint8_t     _sta[6];            /* EtherAddress */
+    uint16_t    _nb_frames;         /* Number of frames (int) */
+  public:
+    EtherAddress sta()                      { return EtherAddress(_sta); }
+    uint16_t nb_frames()                    { return ntohs(_nb_frames); }
+    void set_wtp(EtherAddress wtp)          { memcpy(_wtp, wtp.data(), 6); }
+    void set_sta(EtherAddress sta)          { memcpy(_sta, sta.data(), 6); }
+    void set_nb_frames(uint16_t nb_frames)  { _nb_frames = htons(nb_frames); }
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+/* queue frame entry format, followed by the Ethernet frame */
+struct queue_frame_entry {
+  private:
+    uint8_t     _dscp;              /* Traffic rule of the frame (int) */
+    uint16_t    _length;            /* Frame length (int) */
+  public:
+    uint8_t dscp()                          { return _dscp; }
+    uint16_t length()                       { return ntohs(_length); }
+    void set_dscp(uint8_t dscp)             { _dscp = dscp; }
+    void set_length(uint16_t length)        { _length = htons(length); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
 CLICK_ENDDECLS
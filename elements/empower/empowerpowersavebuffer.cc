@@ -0,0 +1,498 @@
+/*
+ * empowerpowersavebuffer.{cc,hh} -- holds the frames of dozing stations (EmPOWER Access Point)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerpowersavebuffer.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <clicknet/wifi.h>
+#include "empowerlvapmanager.hh"
+CLICK_DECLS
+
+EmpowerPowerSaveBuffer::EmpowerPowerSaveBuffer() :
+		_el(0), _iface_id(-1), _capacity(64), _lifetime(2000), _uapsd(false),
+		_nb_dozing(0), _nb_parked(0), _release_head(0), _release_tail(0),
+		_timer(this), _parked(0), _released(0), _dropped(0), _expired(0),
+		_pspolls(0), _triggers(0), _debug(false) {
+	_lock.set_name(this, "stations");
+}
+
+EmpowerPowerSaveBuffer::~EmpowerPowerSaveBuffer() {
+}
+
+void *EmpowerPowerSaveBuffer::cast(const char *n) {
+	if (strcmp(n, "EmpowerPowerSaveBuffer") == 0)
+		return (EmpowerPowerSaveBuffer *) this;
+	else if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+		return static_cast<Notifier *>(&_notifier);
+	else
+		return Element::cast(n);
+}
+
+int EmpowerPowerSaveBuffer::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	_notifier.initialize(Notifier::EMPTY_NOTIFIER, router());
+
+	int ret = Args(conf, this, errh)
+			.read_m("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read_m("IFACE_ID", _iface_id)
+			.read("CAPACITY", _capacity)
+			.read("LIFETIME", _lifetime)
+			.read("UAPSD", _uapsd)
+			.read("DEBUG", _debug)
+			.complete();
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (_capacity == 0) {
+		return errh->error("CAPACITY must be positive");
+	}
+
+	return 0;
+
+}
+
+int EmpowerPowerSaveBuffer::initialize(ErrorHandler *) {
+	_upstream_signal = Notifier::upstream_empty_signal(this, 0, &_notifier);
+	_timer.initialize(this);
+	if (_lifetime) {
+		_timer.schedule_after_msec(_lifetime / 2 + 1);
+	}
+	return 0;
+}
+
+void EmpowerPowerSaveBuffer::cleanup(CleanupStage) {
+	for (PSIter it = _stations.begin(); it.live(); it++) {
+		while (Packet *p = it.value()._head) {
+			it.value()._head = p->next();
+			p->kill();
+		}
+	}
+	_stations.clear();
+	while (Packet *p = _release_head) {
+		_release_head = p->next();
+		p->kill();
+	}
+	_release_tail = 0;
+}
+
+void EmpowerPowerSaveBuffer::run_timer(Timer *) {
+	expire();
+	_timer.reschedule_after_msec(_lifetime / 2 + 1);
+}
+
+Packet *EmpowerPowerSaveBuffer::pull(int) {
+
+	if (_release_head) {
+		_lock.acquire();
+		Packet *p = _release_head;
+		if (p) {
+			_release_head = p->next();
+			if (!_release_head) {
+				_release_tail = 0;
+			}
+			p->set_next(0);
+		}
+		_lock.release();
+		if (p) {
+			return p;
+		}
+	}
+
+	// bounded, so that parking a burst does not hold the scheduler
+	for (int i = 0; i < PULL_BURST; i++) {
+		Packet *p = input(0).pull();
+		if (!p) {
+			if (!_upstream_signal) {
+				_notifier.sleep();
+			}
+			return 0;
+		}
+		if (!_nb_dozing || !hold(p)) {
+			return p;
+		}
+	}
+
+	_notifier.wake();
+	return 0;
+
+}
+
+Packet *EmpowerPowerSaveBuffer::pull_batch(int, unsigned max) {
+
+	PacketBatch batch;
+
+	// released frames first, under a single lock
+	if (_release_head) {
+		_lock.acquire();
+		while (_release_head && batch.count() < max) {
+			Packet *p = _release_head;
+			_release_head = p->next();
+			batch.append(p);
+		}
+		if (!_release_head) {
+			_release_tail = 0;
+		}
+		_lock.release();
+	}
+
+	if (batch.count() == max) {
+		return batch.take();
+	}
+
+	Packet *head = input(0).pull_batch(max - batch.count());
+	if (!head) {
+		if (batch.empty() && !_upstream_signal) {
+			_notifier.sleep();
+		}
+		return batch.take();
+	}
+
+	while (Packet *p = PacketBatch::pop(head)) {
+		if (!_nb_dozing || !hold(p)) {
+			batch.append(p);
+		}
+	}
+
+	// everything was parked, there may be more upstream
+	if (batch.empty()) {
+		_notifier.wake();
+	}
+
+	return batch.take();
+
+}
+
+// PS-Poll
+void EmpowerPowerSaveBuffer::push(int, Packet *p) {
+
+	// frame control, AID, BSSID, TA
+	if (p->length() < 16) {
+		p->kill();
+		return;
+	}
+
+	const click_wifi *w = (const click_wifi *) p->data();
+	EtherAddress ta = EtherAddress(w->i_addr2);
+	p->kill();
+
+	_lock.acquire();
+	_pspolls++;
+	PowerSaveStation *st = _stations.get_pointer(ta);
+	uint32_t released = st ? release(st, 1, false) : 0;
+	_lock.release();
+
+	// nothing parked, the station is told so and can doze again
+	if (!released) {
+		Packet *q = make_null(ta);
+		if (!q) {
+			return;
+		}
+		_lock.acquire();
+		append(q);
+		_lock.release();
+	}
+
+	_notifier.wake();
+
+}
+
+void EmpowerPowerSaveBuffer::power_save(EtherAddress sta, bool pm, bool trigger) {
+
+	_lock.acquire();
+
+	PowerSaveStation *st = _stations.get_pointer(sta);
+
+	if (!st) {
+		_lock.release();
+		if (!pm) {
+			return;
+		}
+		// only the LVAPs sent to from this interface
+		{
+			EmpowerEpoch::Guard guard(_el->epoch());
+			const EmpowerStationHot *hot = _el->get_hot(sta, &_hot_cache);
+			if (!hot || hot->_iface_id != _iface_id) {
+				return;
+			}
+		}
+		_lock.acquire();
+		st = &_stations[sta];
+	}
+
+	uint32_t released = 0;
+
+	if (pm && !st->_dozing) {
+		st->_dozing = true;
+		_nb_dozing++;
+		if (_debug) {
+			click_chatter("%{element} :: %s :: sta %s dozing",
+						  this,
+						  __func__,
+						  sta.unparse_colon().c_str());
+		}
+	} else if (pm && trigger && _uapsd) {
+		_triggers++;
+		released = release(st, st->_size, true);
+	} else if (!pm && st->_dozing) {
+		st->_dozing = false;
+		_nb_dozing--;
+		released = release(st, st->_size, false);
+		if (_debug) {
+			click_chatter("%{element} :: %s :: sta %s awake, %u frames released",
+						  this,
+						  __func__,
+						  sta.unparse_colon().c_str(),
+						  released);
+		}
+	}
+
+	// an awake station with nothing parked is not worth an entry
+	if (!st->_dozing && !st->_size) {
+		_stations.erase(sta);
+	}
+
+	_lock.release();
+
+	if (released) {
+		_notifier.wake();
+	}
+
+}
+
+bool EmpowerPowerSaveBuffer::hold(Packet *p) {
+
+	if (p->length() < sizeof(struct click_wifi)) {
+		return false;
+	}
+
+	const click_wifi *w = (const click_wifi *) p->data();
+	EtherAddress dst = EtherAddress(w->i_addr1);
+
+	if (dst.is_group()) {
+		return false;
+	}
+
+	_lock.acquire();
+	PowerSaveStation *st = _stations.get_pointer(dst);
+	bool held = st && st->_dozing;
+	if (held) {
+		park(st, p);
+	}
+	_lock.release();
+
+	return held;
+
+}
+
+// Called with the lock held
+void EmpowerPowerSaveBuffer::park(PowerSaveStation *st, Packet *p) {
+
+	if (st->_size >= _capacity) {
+		Packet *oldest = st->_head;
+		st->_head = oldest->next();
+		if (!st->_head) {
+			st->_tail = 0;
+		}
+		oldest->set_next(0);
+		oldest->kill();
+		st->_size--;
+		_nb_parked--;
+		_dropped++;
+	}
+
+	p->timestamp_anno() = Timestamp::now_steady();
+	p->set_next(0);
+
+	if (st->_tail) {
+		st->_tail->set_next(p);
+	} else {
+		st->_head = p;
+	}
+	st->_tail = p;
+	st->_size++;
+	_nb_parked++;
+	_parked++;
+
+}
+
+// Move up to n frames of st to the release list, the More Data bit set on
+// all but the last one st has, the end of the service period marked on
+// the last one released if eosp. Called with the lock held.
+uint32_t EmpowerPowerSaveBuffer::release(PowerSaveStation *st, uint32_t n, bool eosp) {
+
+	uint32_t released = 0;
+
+	while (st->_head && released < n) {
+
+		Packet *p = st->_head;
+		st->_head = p->next();
+		if (!st->_head) {
+			st->_tail = 0;
+		}
+		p->set_next(0);
+		st->_size--;
+		_nb_parked--;
+
+		WritablePacket *q = p->uniqueify();
+		if (!q) {
+			continue;
+		}
+
+		struct click_wifi *w = (struct click_wifi *) q->data();
+		if (st->_size) {
+			w->i_fc[1] |= WIFI_FC1_MORE_DATA;
+		}
+		if (eosp && (!st->_size || released + 1 == n) && WIFI_QOS_HAS_SEQ(w)
+				&& q->length() >= sizeof(struct click_wifi) + 2) {
+			q->data()[sizeof(struct click_wifi)] |= 0x10;
+		}
+
+		append(q);
+		released++;
+		_released++;
+
+	}
+
+	return released;
+
+}
+
+// Called with the lock held
+void EmpowerPowerSaveBuffer::append(Packet *p) {
+	if (_release_tail) {
+		_release_tail->set_next(p);
+	} else {
+		_release_head = p;
+	}
+	_release_tail = p;
+}
+
+Packet *EmpowerPowerSaveBuffer::make_null(EtherAddress sta) {
+
+	EtherAddress bssid;
+
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+		const EmpowerStationHot *hot = _el->get_hot(sta, &_hot_cache);
+		if (!hot || hot->_iface_id != _iface_id) {
+			return 0;
+		}
+		bssid = hot->_lvap_bssid;
+	}
+
+	WritablePacket *q = Packet::make(sizeof(struct click_wifi));
+
+	if (!q) {
+		return 0;
+	}
+
+	memset(q->data(), 0, q->length());
+
+	struct click_wifi *w = (struct click_wifi *) q->data();
+	w->i_fc[0] = WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_DATA | WIFI_FC0_SUBTYPE_NODATA;
+	w->i_fc[1] = WIFI_FC1_DIR_FROMDS;
+	memcpy(w->i_addr1, sta.data(), 6);
+	memcpy(w->i_addr2, bssid.data(), 6);
+	memcpy(w->i_addr3, bssid.data(), 6);
+
+	return q;
+
+}
+
+// Drop the frames parked for longer than the lifetime, and the stations
+// whose LVAP is gone from this interface
+void EmpowerPowerSaveBuffer::expire() {
+
+	Timestamp now = Timestamp::now_steady();
+	Timestamp lifetime = Timestamp::make_msec(_lifetime);
+	Vector<EtherAddress> gone;
+
+	EmpowerEpoch::Guard guard(_el->epoch());
+
+	_lock.acquire();
+
+	for (PSIter it = _stations.begin(); it.live(); it++) {
+		PowerSaveStation *st = &it.value();
+		const EmpowerStationHot *hot = _el->get_hot(it.key(), &_hot_cache);
+		bool lost = !hot || hot->_iface_id != _iface_id;
+		while (st->_head && (lost || now - st->_head->timestamp_anno() >= lifetime)) {
+			Packet *p = st->_head;
+			st->_head = p->next();
+			p->set_next(0);
+			p->kill();
+			st->_size--;
+			_nb_parked--;
+			_expired++;
+		}
+		if (!st->_head) {
+			st->_tail = 0;
+		}
+		if (lost || (!st->_dozing && !st->_size)) {
+			gone.push_back(it.key());
+		}
+	}
+
+	for (int i = 0; i < gone.size(); i++) {
+		if (_stations.get_pointer(gone[i])->_dozing) {
+			_nb_dozing--;
+		}
+		_stations.erase(gone[i]);
+	}
+
+	_lock.release();
+
+}
+
+enum {
+	H_STATIONS,
+	H_STATS,
+};
+
+String EmpowerPowerSaveBuffer::read_handler(Element *e, void *thunk) {
+	EmpowerPowerSaveBuffer *td = (EmpowerPowerSaveBuffer *) e;
+	StringAccum sa;
+	switch ((uintptr_t) thunk) {
+	case H_STATIONS:
+		td->_lock.acquire();
+		for (PSIter it = td->_stations.begin(); it.live(); it++) {
+			sa << it.key().unparse_colon()
+			   << " dozing " << it.value()._dozing
+			   << " parked " << it.value()._size << "\n";
+		}
+		td->_lock.release();
+		return sa.take_string();
+	case H_STATS:
+		sa << "parked " << td->_parked
+		   << " released " << td->_released
+		   << " dropped " << td->_dropped
+		   << " expired " << td->_expired
+		   << " pspolls " << td->_pspolls
+		   << " triggers " << td->_triggers << "\n";
+		return sa.take_string();
+	default:
+		return String();
+	}
+}
+
+void EmpowerPowerSaveBuffer::add_handlers() {
+	add_read_handler("stations", read_handler, (void *) H_STATIONS);
+	add_read_handler("stats", read_handler, (void *) H_STATS);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerPowerSaveBuffer)
@@ -0,0 +1,178 @@
+#ifndef CLICK_EMPOWERPOWERSAVEBUFFER_HH
+#define CLICK_EMPOWERPOWERSAVEBUFFER_HH
+#include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+#include <click/notifier.hh>
+#include <click/sync.hh>
+#include <click/timer.hh>
+#include "empowerstationcache.hh"
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerPowerSaveBuffer(EL, IFACE_ID[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Holds the frames of dozing stations until they ask for them
+
+=d
+
+Sits between the EmpowerQOSManager of an interface and the scheduler
+feeding the radio. Frames pulled from input 0 for a station in power
+save mode are parked in a bounded per-station queue instead of being
+sent into a sleeping radio; any other frame goes straight through.
+
+EmpowerRXStats reports the power management bit of every frame a
+station of this interface sends: a station that sets it is dozing, a
+station that clears it is awake again and gets all its parked frames at
+once. A PS-Poll on input 1 releases one parked frame, with the More Data
+bit set if others are left, or a null frame if there is none. With UAPSD
+a QoS data or QoS null frame sent while dozing is taken as a trigger and
+releases every parked frame, the last one marked as the end of the
+service period.
+
+The beacon source sets the bit of a station in the TIM of its beacons
+while frames are parked for it, see buffered(). Every beacon is a DTIM
+and group frames are never parked: beacons are unicast, one per LVAP,
+so there is no group traffic to hold.
+
+Keyword arguments are:
+
+=over 8
+
+=item EL
+An EmpowerLVAPManager element
+
+=item IFACE_ID
+The interface the frames are sent on
+
+=item CAPACITY
+Frames parked per station, default is 64. The oldest one is dropped to
+make room for a new one.
+
+=item LIFETIME
+Parked frames older than this are dropped (in msec), default is 2000
+
+=item UAPSD
+Boolean. Release the parked frames on a U-APSD trigger, default is
+false. The WTP does not track what each station negotiated, so this
+holds for all the stations of the interface.
+
+=item DEBUG
+Turn debug on/off
+
+=back 8
+
+=h stations read-only
+One line per station tracked: address, dozing, frames parked
+
+=h stats read-only
+Frames parked, released, dropped for lack of room, expired, and the
+PS-Polls and triggers received
+
+=a EmpowerLVAPManager, EmpowerQOSManager, EmpowerRXStats,
+EmpowerBeaconSource
+*/
+
+class PowerSaveStation {
+public:
+
+	bool _dozing;
+	Packet *_head;
+	Packet *_tail;
+	uint32_t _size;
+
+	PowerSaveStation() : _dozing(false), _head(0), _tail(0), _size(0) {
+	}
+
+};
+
+typedef HashTable<EtherAddress, PowerSaveStation> PowerSaveStations;
+typedef PowerSaveStations::iterator PSIter;
+
+class EmpowerPowerSaveBuffer : public Element {
+public:
+
+	EmpowerPowerSaveBuffer() CLICK_COLD;
+	~EmpowerPowerSaveBuffer() CLICK_COLD;
+
+	const char *class_name() const { return "EmpowerPowerSaveBuffer"; }
+	const char *port_count() const { return "1-2/1"; }
+	const char *processing() const { return "lh/l"; }
+
+	void *cast(const char *);
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+	void run_timer(Timer *);
+
+	Packet *pull(int);
+	Packet *pull_batch(int, unsigned);
+	void push(int, Packet *);
+
+	// Power management bit of a frame sent by sta, trigger if the frame
+	// can start a U-APSD service period
+	void power_save(EtherAddress sta, bool pm, bool trigger);
+
+	// frames are parked for sta
+	bool buffered(EtherAddress sta) {
+		if (!_nb_parked) {
+			return false;
+		}
+		_lock.acquire();
+		PowerSaveStation *st = _stations.get_pointer(sta);
+		bool buffered = st && st->_size;
+		_lock.release();
+		return buffered;
+	}
+
+private:
+
+	class EmpowerLVAPManager *_el;
+	int _iface_id;
+	uint32_t _capacity;
+	uint32_t _lifetime; // msecs
+	bool _uapsd;
+
+	Spinlock _lock;
+	PowerSaveStations _stations;
+	EmpowerStationCache _hot_cache;
+	uint32_t _nb_dozing;
+	uint32_t _nb_parked;
+
+	// frames released and not pulled yet
+	Packet *_release_head;
+	Packet *_release_tail;
+
+	ActiveNotifier _notifier;
+	NotifierSignal _upstream_signal;
+	Timer _timer;
+
+	uint32_t _parked;
+	uint32_t _released;
+	uint32_t _dropped;
+	uint32_t _expired;
+	uint32_t _pspolls;
+	uint32_t _triggers;
+
+	bool _debug;
+
+	enum { PULL_BURST = 16 };
+
+	bool hold(Packet *);
+	void park(PowerSaveStation *, Packet *);
+	uint32_t release(PowerSaveStation *, uint32_t, bool);
+	void append(Packet *);
+	Packet *make_null(EtherAddress);
+	void expire();
+
+	static String read_handler(Element *, void *);
+
+};
+
+CLICK_ENDDECLS
+#endif
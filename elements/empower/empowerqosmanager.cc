@@ -31,25 +31,246 @@
 #include <elements/wifi/minstrel.hh>
 #include <elements/wifi/bitrate.hh>
 #include "empowerlvapmanager.hh"
+#include "empowerregmon.hh"
+#include "empowerrxstats.hh"
 CLICK_DECLS
 
+static const char * const log_sites[] = {
+	"too_small", "not_authenticated", "not_associated"
+};
+
 EmpowerQOSManager::EmpowerQOSManager() :
-		_el(0), _rc(0), _sleepiness(0), _capacity(500), _quantum(1470), _iface_id(0), _debug(false) {
+		_el(0), _rc(0), _slice_ids(-1), _capacity(500), _quantum(1470), _station_quantum(1000),
+		_station_burst(0), _station_burst_airtime(4000),
+		_priority(false), _prio_rate(125000), _prio_burst(15140), _prio_pkts(0), _nb_flows(32),
+		_codel_target(Timestamp::make_msec(0, 5)), _codel_interval(Timestamp::make_msec(0, 100)),
+		_queue_delay(Timestamp::make_msec(0, 20)), _idle_timeout(Timestamp::make_sec(60)),
+		_reclaim_timer(this), _regmon(0), _adapt_interval(Timestamp::make_msec(0, 100)), _adapt_timer(this),
+		_scale(SCALE_ONE), _ed_busy(0), _tx_busy(0), _iface_id(0), _burst(1), _ac_ports(false), _lockfree(false), _hugepages(false), _mcast_auto(false), _debug(false), _log(log_sites, NB_LOGS) {
+	_slice_drops = 0;
+	_rules_lock.set_name(this, "rules");
+	_headroom = EmpowerWifiHeader::QOS_LEN - sizeof(struct click_ether);
+	// CS0 to CS7, but for PCP 5 (voice) which maps to EF
+	for (int i = 0; i < 8; i++) {
+		_pcp_dscp[i] = i == 5 ? 46 : i << 3;
+	}
+	for (int i = 0; i < NB_ACS; i++) {
+		_sleepiness[i] = 0;
+		_batch[i] = 0;
+	}
 }
 
 EmpowerQOSManager::~EmpowerQOSManager() {
+	for (int i = 0; i < NB_ACS; i++) {
+		while (Packet *p = PacketBatch::pop(_batch[i])) {
+			p->kill();
+		}
+	}
+	for (int i = 0; i < _slices.size(); i++) {
+		delete _slices[i];
+	}
 }
 
 int EmpowerQOSManager::configure(Vector<String> &conf,
 		ErrorHandler *errh) {
 
-	return Args(conf, this, errh)
+	String pcp_dscp;
+
+	if (Args(conf, this, errh)
 			.read_m("EL", ElementCastArg("EmpowerLVAPManager"), _el)
 			.read_m("RC", ElementCastArg("Minstrel"), _rc)
 			.read_m("IFACE_ID", _iface_id)
 			.read("QUANTUM", _quantum)
+			.read("STATION_QUANTUM", _station_quantum)
+			.read("STATION_BURST", _station_burst)
+			.read("STATION_BURST_AIRTIME", _station_burst_airtime)
+			.read("PRIORITY", _priority)
+			.read("PRIORITY_RATE", _prio_rate)
+			.read("PRIORITY_BURST", _prio_burst)
+			.read("FLOWS", _nb_flows)
+			.read("CODEL_TARGET", _codel_target)
+			.read("CODEL_INTERVAL", _codel_interval)
+			.read("QUEUE_DELAY", _queue_delay)
+			.read("IDLE_TIMEOUT", _idle_timeout)
+			.read("BURST", _burst)
+			.read("AC_PORTS", _ac_ports)
+			.read("LOCKFREE", _lockfree)
+			.read("HUGEPAGES", _hugepages)
+			.read("REGMON", ElementCastArg("EmpowerRegmon"), _regmon)
+			.read("ADAPT_INTERVAL", _adapt_interval)
+			.read("MCAST_AUTO", _mcast_auto)
+			.read("PCP_DSCP", AnyArg(), pcp_dscp)
 			.read("DEBUG", _debug)
-			.complete();
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_nb_flows < 1) {
+		return errh->error("FLOWS must be at least 1");
+	}
+
+	if (noutputs() != (_ac_ports ? NB_ACS : 1)) {
+		return errh->error("%d outputs required", _ac_ports ? NB_ACS : 1);
+	}
+
+	if (_priority && (!_prio_rate || _prio_burst < AggregationQueue::FLOW_QUANTUM)) {
+		return errh->error("PRIORITY_RATE must be positive and PRIORITY_BURST at least %d", (int) AggregationQueue::FLOW_QUANTUM);
+	}
+
+	if (_codel_target && !_codel_interval) {
+		return errh->error("CODEL_INTERVAL must be positive");
+	}
+
+	if (_regmon && !_adapt_interval) {
+		return errh->error("ADAPT_INTERVAL must be positive");
+	}
+
+	if (pcp_dscp) {
+		Vector<String> tokens;
+		cp_spacevec(pcp_dscp, tokens);
+		if (tokens.size() != 8) {
+			return errh->error("PCP_DSCP must give 8 DSCPs, one per PCP");
+		}
+		for (int i = 0; i < 8; i++) {
+			int dscp;
+			if (!IntArg().parse(tokens[i], dscp) || dscp < 0 || dscp >= SliceQueues::NB_DSCPS) {
+				return errh->error("error param %s: must be a DSCP", tokens[i].c_str());
+			}
+			_pcp_dscp[i] = dscp;
+		}
+	}
+
+	return 0;
+
+}
+
+int EmpowerQOSManager::initialize(ErrorHandler *) {
+	_reclaim_timer.initialize(this);
+	if (_idle_timeout) {
+		_reclaim_timer.schedule_after(_idle_timeout);
+	}
+	_adapt_timer.initialize(this);
+	if (_regmon) {
+		_adapt_timer.schedule_after(_adapt_interval);
+	}
+	return 0;
+}
+
+void EmpowerQOSManager::take_state(Element *e, ErrorHandler *errh) {
+
+	EmpowerQOSManager *eqm = (EmpowerQOSManager *) e->cast("EmpowerQOSManager");
+
+	if (!eqm) {
+		return;
+	}
+
+	// frames already pulled from the rules go out first, on the output
+	// of their category if both have one output per category
+	for (int i = 0; i < NB_ACS; i++) {
+		Packet **tail = &_batch[_ac_ports && eqm->_ac_ports ? i : 0];
+		while (*tail) {
+			tail = &(*tail)->next();
+		}
+		*tail = eqm->_batch[i];
+		eqm->_batch[i] = 0;
+	}
+
+	uint32_t lost = 0;
+
+	// before the rules, so that the station queues come up capped
+	_rates = eqm->_rates;
+
+	// slices in the order they were created, so that slice ids carry over
+	// unless the LVAP manager took its state first
+	for (int i = 0; i < eqm->_slices.size(); i++) {
+		for (TRIter itr = eqm->_rules.begin(); itr != eqm->_rules.end(); itr++) {
+			TrafficRuleQueue *old = itr.value();
+			if (old->_tr._ssid != eqm->_slices[i]->_ssid) {
+				continue;
+			}
+			set_traffic_rule(old->_tr._ssid, old->_tr._dscp, old->_quantum, old->_amsdu_aggregation, false);
+			TrafficRuleQueue *trq = _rules.get(old->_tr);
+			lost += trq->take(old);
+			if (trq->size() || trq->_head_pkt) {
+				_active_lists[trq->_ac].push_back(trq);
+			}
+		}
+	}
+
+	if (lost) {
+		errh->warning("%u frames lost (new capacity %u)", lost, _capacity);
+	}
+
+	for (int i = 0; i < NB_ACS; i++) {
+		if (!_active_lists[i].empty() || _batch[i]) {
+			_empty_notes[i].wake();
+		}
+	}
+
+}
+
+void EmpowerQOSManager::run_timer(Timer *t) {
+	if (t == &_adapt_timer) {
+		adapt_quanta();
+		_adapt_timer.reschedule_after(_adapt_interval);
+		return;
+	}
+	Timestamp now = Timestamp::now();
+	uint32_t released = 0;
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		released += itr.value()->reclaim(now, _idle_timeout);
+	}
+	if (released && _debug) {
+		click_chatter("%{element} :: %s :: released %u idle aggregation queues",
+					  this,
+					  __func__,
+					  released);
+	}
+	// an idle queue is released at most 1.5 timeouts after its last frame
+	_reclaim_timer.reschedule_after(Timestamp::make_usec(_idle_timeout.usecval() / 2));
+}
+
+// Scale the quanta to the airtime the channel leaves us: what energy
+// detect reports busy, less our own transmissions, is taken by others.
+void EmpowerQOSManager::adapt_quanta() {
+
+	RegmonWindow ed, tx;
+#if CLICK_USERLEVEL
+	bool sampled = _regmon->window(EMPOWER_REGMON_ED, _adapt_interval.usecval(), ed)
+			&& _regmon->window(EMPOWER_REGMON_TX, _adapt_interval.usecval(), tx);
+#else
+	// EmpowerRegmon reads debugfs, it only exists at user level
+	bool sampled = false;
+#endif
+	if (!sampled) {
+		// no samples, assume a clear channel
+		_ed_busy = _tx_busy = 0;
+		_scale = SCALE_ONE;
+		return;
+	}
+
+	_ed_busy = ed._busy;
+	_tx_busy = tx._busy;
+
+	uint32_t others = (_ed_busy > _tx_busy) ? _ed_busy - _tx_busy : 0;
+	uint32_t available = (others < 10000) ? 10000 - others : 0;
+	uint32_t scale = available * SCALE_ONE / 10000;
+	if (scale < SCALE_MIN) {
+		scale = SCALE_MIN;
+	}
+
+	if (scale != _scale && _debug) {
+		click_chatter("%{element} :: %s :: ed %u tx %u (1/10000), quantum scale %u -> %u (1/%u)",
+					  this,
+					  __func__,
+					  _ed_busy,
+					  _tx_busy,
+					  _scale,
+					  scale,
+					  SCALE_ONE);
+	}
+
+	_scale = scale;
 
 }
 
@@ -57,16 +278,87 @@ void * EmpowerQOSManager::cast(const char *n) {
 	if (strcmp(n, "EmpowerQOSManager") == 0)
 		return (EmpowerQOSManager *) this;
 	else if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
-		return static_cast<Notifier *>(&_empty_note);
+		return static_cast<Notifier *>(&_empty_notes[0]);
+	else if (strcmp(n, "Headroom") == 0)
+		return &_headroom;
 	else
 		return Element::cast(n);
 }
 
+void * EmpowerQOSManager::port_cast(bool isoutput, int port, const char *n) {
+	if (isoutput && port >= 0 && port < NB_ACS && strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+		return static_cast<Notifier *>(&_empty_notes[port]);
+	else
+		return Element::port_cast(isoutput, port, n);
+}
+
 void
 EmpowerQOSManager::push(int, Packet *p) {
+	uint32_t wake = 0;
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+		admit(p, Timestamp::recent(), wake);
+	}
+	wake_outputs(wake);
+}
+
+// One epoch guard, one timestamp and one wake up per output for the
+// whole batch, so that the puller runs once the batch is queued
+void
+EmpowerQOSManager::push_batch(int, Packet *head) {
+	uint32_t wake = 0;
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+		Timestamp now = Timestamp::recent();
+		while (Packet *p = PacketBatch::pop(head)) {
+			admit(p, now, wake);
+		}
+	}
+	wake_outputs(wake);
+}
+
+// DSCP of an Ethernet frame, read in place: that of its IPv4 or IPv6
+// header, behind an 802.1Q tag if any. Tagged frames with no DSCP, or not
+// IP, take that of their PCP. The network header need not be set.
+int
+EmpowerQOSManager::frame_dscp(const Packet *p) const {
+
+	const unsigned char *data = p->data();
+	uint32_t offset = sizeof(struct click_ether);
+	uint16_t ether_type = ntohs(((const click_ether *) data)->ether_type);
+	int pcp = -1;
+
+	if (ether_type == ETHERTYPE_8021Q && p->length() >= offset + 4) {
+		pcp = data[offset] >> 5;
+		ether_type = (data[offset + 2] << 8) | data[offset + 3];
+		offset += 4;
+	}
+
+	int dscp = 0;
+	if (p->length() >= offset + 2) {
+		if (ether_type == ETHERTYPE_IP) {
+			dscp = data[offset + 1] >> 2;
+		} else if (ether_type == ETHERTYPE_IP6) {
+			// traffic class across the first two bytes, after the version
+			dscp = ((data[offset] & 0x0F) << 2) | (data[offset + 1] >> 6);
+		}
+	}
+
+	if (!dscp && pcp >= 0) {
+		dscp = _pcp_dscp[pcp];
+	}
+
+	return dscp;
+
+}
+
+// Queues frame p, or its copies for a group address; the caller holds
+// the epoch guard. Outputs to wake up are added to wake.
+void
+EmpowerQOSManager::admit(Packet *p, const Timestamp &now, uint32_t &wake) {
 
 	if (p->length() < sizeof(struct click_ether)) {
-		click_chatter("%{element} :: %s :: packet too small: %d vs %d",
+		empower_chatter_limited(_log, LOG_TOO_SMALL, "%{element} :: %s :: packet too small: %d vs %d",
 				      this,
 				      __func__,
 				      p->length(),
@@ -75,26 +367,22 @@ EmpowerQOSManager::push(int, Packet *p) {
 		return;
 	}
 
-	Timestamp now = Timestamp::now();
 	p->set_timestamp_anno(now);
 
-	int dscp = 0;
+	int dscp = frame_dscp(p);
 	uint8_t iface_id = PAINT_ANNO(p);
+	// tenant the frame came in for, 0 if any, see EmpowerSliceTag
+	int slice = SLICE_ANNO(p);
 
 	click_ether *eh = (click_ether *) p->data();
 
-	if (ntohs(eh->ether_type) == 0x0800) {
-		const click_ip *ip = p->ip_header();
-		dscp = ip->ip_tos >> 2;
-	}
-
 	EtherAddress dst = EtherAddress(eh->ether_dhost);
 
 	// If traffic is unicast we need to check if the lvap is active and if it is on the same interface of
 	// this element, then we lookup the traffic rule queue and enqueue the Ethernet packet with all the info
 	// necessary later to build the wifi frame.
 	if (!dst.is_broadcast() && !dst.is_group()) {
-		EmpowerStationState *ess = _el->get_ess(dst);
+		const EmpowerStationHot *ess = _el->get_hot(dst, &_stations);
 		if (!ess) {
 			p->kill();
 			return;
@@ -107,8 +395,13 @@ EmpowerQOSManager::push(int, Packet *p) {
 			p->kill();
 			return;
 		}
+		if (!in_slice(slice, ess->_ssid_id)) {
+			_slice_drops++;
+			p->kill();
+			return;
+		}
         if (!ess->_authentication_status) {
-			click_chatter("%{element} :: %s :: station %s not authenticated",
+			empower_chatter_limited(_log, LOG_NOT_AUTHENTICATED, "%{element} :: %s :: station %s not authenticated",
 						  this,
 						  __func__,
 						  dst.unparse().c_str());
@@ -116,22 +409,53 @@ EmpowerQOSManager::push(int, Packet *p) {
 			return;
 		}
         if (!ess->_association_status) {
-			click_chatter("%{element} :: %s :: station %s not associated",
+			empower_chatter_limited(_log, LOG_NOT_ASSOCIATED, "%{element} :: %s :: station %s not associated",
 						  this,
 						  __func__,
 						  dst.unparse().c_str());
 			p->kill();
 			return;
 		}
+        if (unlikely(ess->_timeline & LVAPTimeline::AWAIT_DL)) {
+            _el->timeline_frame(ess, LVAPTimeline::FIRST_DL);
+        }
         TxPolicyInfo * txp = _el->get_txp(ess->_sta);
         txp->update_tx(p->length());
-        store(ess->_ssid, dscp, p, dst, ess->_lvap_bssid);
+        store(ess->_slice_id, dscp, p, dst, ess->_lvap_bssid, wake);
 		return;
 	}
 
 	// broadcast and multicast traffic, we need to transmit one frame for each unique
 	// bssid. this is due to the fact that we can have the same bssid for multiple LVAPs.
-	if (_rc->tx_policies()->lookup(dst)->_tx_mcast == TX_MCAST_DMS) {
+	TxPolicyInfo *txp = _rc->tx_policies()->lookup(dst);
+	int mode = txp->_tx_mcast;
+
+	// if snooping tracks the group only its receivers get a copy, and
+	// the VAPs only if there is one
+	EmpowerMulticastTable *mtbl = _el->mtbl();
+	bool snooped = mtbl && EmpowerMulticastTable::is_snooped(dst);
+	int copies = 1;
+
+	if (_mcast_auto || mode == TX_MCAST_UR) {
+		McastGroup *group = _mcast_groups.get_pointer(dst);
+		if (!group || now - group->_refreshed > Timestamp::make_msec(0, MCAST_REFRESH_MSEC)) {
+			if (!group) {
+				if (_mcast_groups.size() >= MCAST_MAX_GROUPS) {
+					_mcast_groups.clear();
+				}
+				group = &_mcast_groups[dst];
+			}
+			refresh_mcast_group(dst, iface_id, group, txp);
+			group->_refreshed = now;
+		}
+		mode = group->_mode;
+		copies = group->_copies;
+	} else if (_mcast_groups.size() && _mcast_groups.erase(dst)) {
+		// the policy moved away from UR, back to the policy rate
+		_rc->set_group_rate(dst, -1, false);
+	}
+
+	if (mode == TX_MCAST_DMS) {
 
 		// DMS mcast policy, duplicate the frame for each station in
 		// each bssid and use unicast destination addresses. note that
@@ -139,21 +463,76 @@ EmpowerQOSManager::push(int, Packet *p) {
 		// track if the frame has already been delivered to a given
 		// station.
 
-		for (LVAPIter it = _el->lvaps()->begin(); it.live(); it++) {
-			if (it.value()._iface_id != iface_id) {
+		if (snooped) {
+			const EmpowerMulticastBitmap *receivers = mtbl->receivers(dst);
+			for (int i = receivers ? receivers->next(0) : -1; i >= 0; i = receivers->next(i + 1)) {
+				const EmpowerStationHot *ess = _el->get_hot(mtbl->station(i), &_stations);
+				if (!ess) {
+					continue;
+				}
+				if (ess->_iface_id != iface_id) {
+					continue;
+				}
+				if (!ess->_set_mask) {
+					continue;
+				}
+				if (!ess->_authentication_status) {
+					continue;
+				}
+				if (!ess->_association_status) {
+					continue;
+				}
+				if (!in_slice(slice, ess->_ssid_id)) {
+					continue;
+				}
+				Packet *q = p->clone();
+				store(ess->_slice_id, dscp, q, ess->_sta, ess->_lvap_bssid, wake);
+			}
+			p->kill();
+			return;
+		}
+
+		const LVAPList &lvaps = _el->associated_lvaps(iface_id);
+		for (int i = 0; i < lvaps.size(); i++) {
+			if (lvaps[i]->_staged || !in_slice(slice, lvaps[i]->_ssid_id)) {
 				continue;
 			}
-			if (!it.value()._set_mask) {
+			Packet *q = p->clone();
+			store(lvaps[i]->_slice_id, dscp, q, lvaps[i]->_sta, lvaps[i]->_lvap_bssid, wake);
+		}
+
+	} else if (mode == TX_MCAST_UR) {
+
+		// UR mcast policy, unique LVAPs have a single receiver behind
+		// their bssid, an acked unicast copy is cheaper than repeating
+		// the frame for it.
+		const LVAPList &lvaps = _el->associated_lvaps(iface_id);
+		for (int i = 0; i < lvaps.size(); i++) {
+			if (lvaps[i]->_staged || lvaps[i]->_lvap_bssid != lvaps[i]->_net_bssid) {
 				continue;
 			}
-			if (!it.value()._authentication_status) {
+			if (!in_slice(slice, lvaps[i]->_ssid_id)) {
 				continue;
 			}
-			if (!it.value()._association_status) {
+			if (snooped && !mtbl->is_receiver(dst, lvaps[i]->_sta)) {
 				continue;
 			}
 			Packet *q = p->clone();
-			store(it.value()._ssid, dscp, q, it.value()._sta, it.value()._lvap_bssid);
+			store(lvaps[i]->_slice_id, dscp, q, lvaps[i]->_sta, lvaps[i]->_lvap_bssid, wake);
+		}
+
+		// the VAPs get the frame a few times back to back at the rate
+		// of their slowest receiver, each copy is charged to the
+		// deficit of the slice
+		const VAPList &vaps = _el->iface_vaps(iface_id);
+		for (int i = 0; (!snooped || mtbl->receivers(dst)) && i < vaps.size(); i++) {
+			if (!in_slice(slice, vaps[i]._ssid_id)) {
+				continue;
+			}
+			for (int j = 0; j < copies; j++) {
+				Packet *q = p->clone();
+				store(vaps[i]._slice_id, dscp, q, dst, vaps[i]._net_bssid, wake);
+			}
 		}
 
 	} else {
@@ -163,33 +542,29 @@ EmpowerQOSManager::push(int, Packet *p) {
 		// shared tenants
 
 		// handle unique LVAPs
-		for (LVAPIter it = _el->lvaps()->begin(); it.live(); it++) {
-			if (it.value()._iface_id != iface_id) {
-				continue;
-			}
-			if (!it.value()._set_mask) {
-				continue;
-			}
-			if (!it.value()._authentication_status) {
+		const LVAPList &lvaps = _el->associated_lvaps(iface_id);
+		for (int i = 0; i < lvaps.size(); i++) {
+			if (lvaps[i]->_staged || lvaps[i]->_lvap_bssid != lvaps[i]->_net_bssid) {
 				continue;
 			}
-			if (!it.value()._association_status) {
+			if (!in_slice(slice, lvaps[i]->_ssid_id)) {
 				continue;
 			}
-			if (it.value()._lvap_bssid != it.value()._net_bssid) {
+			if (snooped && !mtbl->is_receiver(dst, lvaps[i]->_sta)) {
 				continue;
 			}
 			Packet *q = p->clone();
-			store(it.value()._ssid, dscp, q, it.value()._sta, it.value()._lvap_bssid);
+			store(lvaps[i]->_slice_id, dscp, q, lvaps[i]->_sta, lvaps[i]->_lvap_bssid, wake);
 		}
 
 		// handle VAPs
-		for (VAPIter it = _el->vaps()->begin(); it.live(); it++) {
-			if (it.value()._iface_id != iface_id) {
+		const VAPList &vaps = _el->iface_vaps(iface_id);
+		for (int i = 0; (!snooped || mtbl->receivers(dst)) && i < vaps.size(); i++) {
+			if (!in_slice(slice, vaps[i]._ssid_id)) {
 				continue;
 			}
 			Packet *q = p->clone();
-			store(it.value()._ssid, dscp, q, dst, it.value()._net_bssid);
+			store(vaps[i]._slice_id, dscp, q, dst, vaps[i]._net_bssid, wake);
 		}
 
 	}
@@ -199,81 +574,350 @@ EmpowerQOSManager::push(int, Packet *p) {
 
 }
 
-void EmpowerQOSManager::store(String ssid, int dscp, Packet *q, EtherAddress ra, EtherAddress ta) {
+// Sets the policy, the UR rate and the number of UR copies of the frames
+// sent to the group dst. Receivers are the stations of the VAPs of
+// iface_id, or only those that joined the group if IGMP snooping tracks
+// it. The UR rate is the most robust one of the slowest receiver; the
+// policy rate is kept while a receiver has no rate yet, or when legacy
+// and HT receivers are mixed. The copies follow the RSSI of the weakest
+// receiver, a receiver that was never heard counting as the weakest.
+// The policy is the one of txp, unless MCAST_AUTO picks it.
+void EmpowerQOSManager::refresh_mcast_group(EtherAddress dst, int iface_id, McastGroup *group, TxPolicyInfo *txp) {
 
-	TrafficRule tr = TrafficRule(ssid, dscp);
-	TrafficRuleQueue *trq = 0;
+	int max_copies = txp->_ur_mcast_count;
 
-	if (_rules.find(tr) == _rules.end()) {
-		tr = TrafficRule(ssid, 0);
-		trq = (_rules.get(tr));
+	Vector<EtherAddress> receivers;
+	EmpowerMulticastTable *mtbl = _el->mtbl();
+
+	if (mtbl && EmpowerMulticastTable::is_snooped(dst)) {
+		const EmpowerMulticastBitmap *snooped = mtbl->receivers(dst);
+		for (int i = snooped ? snooped->next(0) : -1; i >= 0; i = snooped->next(i + 1)) {
+			const EmpowerStationHot *ess = _el->get_hot(mtbl->station(i), &_stations);
+			if (!ess || ess->_iface_id != iface_id || !ess->_association_status) {
+				continue;
+			}
+			if (ess->_lvap_bssid != ess->_net_bssid) {
+				receivers.push_back(ess->_sta);
+			}
+		}
 	} else {
-		trq = _rules.get(tr);
+		const LVAPList &lvaps = _el->associated_lvaps(iface_id);
+		for (int i = 0; i < lvaps.size(); i++) {
+			if (!lvaps[i]->_staged && lvaps[i]->_lvap_bssid != lvaps[i]->_net_bssid) {
+				receivers.push_back(lvaps[i]->_sta);
+			}
+		}
+	}
+
+	// rate of the slowest receiver, compared on the airtime of a
+	// full-sized frame
+	int rate = -1;
+	bool ht = false;
+	uint32_t slowest = 0;
+	for (int i = 0; i < receivers.size(); i++) {
+		MinstrelDstInfo *nfo = _rc->neighbors()->findp(receivers[i]);
+		if (!nfo || !nfo->nrates || (rate >= 0 && nfo->ht != ht)) {
+			rate = -1;
+			break;
+		}
+		int r = nfo->rates[nfo->max_prob_rate];
+		uint32_t usecs = nfo->ht ? calc_usecs_wifi_packet_ht(MCAST_FRAME_LENGTH, r, 0) : calc_usecs_wifi_packet(MCAST_FRAME_LENGTH, r, 0);
+		if (rate < 0 || usecs > slowest) {
+			rate = r;
+			ht = nfo->ht;
+			slowest = usecs;
+		}
+	}
+	// copies needed by the weakest receiver
+	int copies = receivers.size() ? 1 : 0;
+	EmpowerRXStats *ers = _el->ers();
+	for (int i = 0; ers && i < receivers.size() && copies < max_copies; i++) {
+		EmpowerEpoch::Guard guard(ers->epoch());
+		const NeighborSnapshot *neighbors = ers->neighbors();
+		if (!neighbors || iface_id >= neighbors->num_ifaces()) {
+			copies = max_copies;
+			break;
+		}
+		const NeighborSample *sample = neighbors->begin(iface_id, false);
+		const NeighborSample *end = neighbors->end(iface_id, false);
+		while (sample != end && sample->_eth != receivers[i]) {
+			sample++;
+		}
+		int rssi = (sample != end) ? (int8_t) sample->_sma_rssi : -128;
+		if (rssi < UR_RSSI_TWO) {
+			copies = max_copies;
+		} else if (rssi < UR_RSSI_ONE && copies < 2) {
+			copies = 2;
+		}
+	}
+	if (receivers.size() && !ers) {
+		copies = max_copies;
+	}
+
+	if (copies > max_copies) {
+		copies = max_copies;
+	}
+	group->_copies = copies > 0 ? copies : 1;
+	group->_receivers = receivers.size();
+
+	// airtime of a full-sized frame to the receivers of the VAPs, unique
+	// LVAPs get a unicast copy under every policy
+	uint32_t nb_vaps = _el->iface_vaps(iface_id).size();
+	uint32_t policy = txp->_ht_mcs.size()
+			? calc_usecs_wifi_packet_ht(MCAST_FRAME_LENGTH, txp->_ht_mcs[0], 0)
+			: calc_usecs_wifi_packet(MCAST_FRAME_LENGTH, txp->_mcs.size() ? txp->_mcs[0] : 2, 0);
+	group->_airtime[TX_MCAST_LEGACY] = nb_vaps * policy;
+	group->_airtime[TX_MCAST_UR] = nb_vaps * group->_copies * (rate >= 0 ? slowest : policy);
+	group->_airtime[TX_MCAST_DMS] = 0;
+	for (int i = 0; i < receivers.size(); i++) {
+		group->_airtime[TX_MCAST_DMS] += _rc->estimate_usecs_wifi_length(receivers[i], MCAST_FRAME_LENGTH);
+	}
+
+	int mode = txp->_tx_mcast;
+	if (_mcast_auto) {
+		int best = TX_MCAST_LEGACY;
+		if (group->_airtime[TX_MCAST_DMS] < group->_airtime[best]) {
+			best = TX_MCAST_DMS;
+		}
+		if (group->_airtime[TX_MCAST_UR] < group->_airtime[best]) {
+			best = TX_MCAST_UR;
+		}
+		// stay put unless the cheapest policy saves enough airtime, so
+		// that a group does not flap as its receivers come and go
+		mode = group->_mode;
+		if (mode < 0) {
+			mode = best;
+		} else if (best != mode) {
+			uint32_t current = group->_airtime[mode];
+			if (group->_airtime[best] + current / MCAST_HYSTERESIS < current) {
+				mode = best;
+			}
+		}
+	}
+
+	if (_debug && mode != group->_mode) {
+		click_chatter("%{element} :: %s :: group %s receivers %d rate %d%s copies %d airtime %u/%u/%u policy %d",
+				      this,
+				      __func__,
+				      dst.unparse().c_str(),
+				      receivers.size(),
+				      rate,
+				      ht ? " (HT)" : "",
+				      group->_copies,
+				      group->_airtime[TX_MCAST_LEGACY],
+				      group->_airtime[TX_MCAST_DMS],
+				      group->_airtime[TX_MCAST_UR],
+				      mode);
+	}
+
+	group->_mode = mode;
+	_rc->set_group_rate(dst, mode == TX_MCAST_UR ? rate : -1, ht);
+
+}
+
+// Queues q. An output is added to wake only if its notifier sleeps: the
+// notifier stays awake as long as frames are queued, so waking it on every
+// frame would only cost an atomic operation per frame.
+void EmpowerQOSManager::store(int slice_id, int dscp, Packet *q, EtherAddress ra, EtherAddress ta, uint32_t &wake) {
+
+	// slice ids are handed out by set_traffic_rule and never reused
+	if (slice_id < 0 || slice_id >= _slices.size()) {
+		q->kill();
+		return;
+	}
+
+	TrafficRuleQueue *trq = _slices[slice_id]->lookup(dscp);
+
+	if (!trq) {
+		q->kill();
+		return;
 	}
 
 	if (trq->enqueue(q, ra, ta)) {
 		// check if tr is in active list
 		if (trq->size() == 0) {
 			trq->_deficit = 0;
-			_active_list.push_back(tr);
 		}
+		_active_lists[trq->_ac].push_back(trq);
 		trq->update_size();
-		// wake up queue
-		_empty_note.wake();
-		// reset sleepiness
-		_sleepiness = 0;
+		if (!_empty_notes[trq->_ac].active()) {
+			wake |= 1 << trq->_ac;
+		}
 	} else {
 		q->kill();
 	}
 
 }
 
-Packet * EmpowerQOSManager::pull(int) {
-
-	if (_active_list.empty()) {
-		if (++_sleepiness == SLEEPINESS_TRIGGER) {
-			_empty_note.sleep();
+// Wakes up the outputs in mask, once the frames that made them
+// non-empty are queued
+void EmpowerQOSManager::wake_outputs(uint32_t mask) {
+	for (int i = 0; mask; i++, mask >>= 1) {
+		if (mask & 1) {
+			_sleepiness[i] = 0;
+			_empty_notes[i].wake();
 		}
-		return 0;
 	}
+}
 
-	TrafficRule tr = _active_list[0];
-	_active_list.pop_front();
+// One DRR step on the active ring of output port: returns the next frame
+// of the queue at the head of the ring, or 0 if that queue has drained or
+// needs more quantum.
+Packet * EmpowerQOSManager::dequeue_drr(int port) {
 
-	TRIter active = _rules.find(tr);
-	HItr head = _head_table.find(tr);
-	TrafficRuleQueue* queue = active.value();
+	ActiveRing<TrafficRuleQueue> &active_list = _active_lists[port];
+	TrafficRuleQueue* queue = active_list.head();
 
 	Packet *p = 0;
-	if (head.value()) {
-		p = head.value();
-		_head_table.set(tr, 0);
+	uint32_t deficit = 0;
+	if (queue->_head_pkt) {
+		p = queue->_head_pkt;
+		queue->_head_pkt = 0;
 	} else {
-		p = queue->dequeue();
+		p = queue->dequeue(_rc, queue->_deficit);
 	}
 
-	if (!p) {
+	if (!p && queue->_throttled) {
+		// frames left but their stations are capped, keep the deficit
+		// and come back next round
+		active_list.advance();
+	} else if (!p) {
 		queue->_deficit = 0;
-	} else if (_rc->estimate_usecs_wifi_packet(p) <= queue->_deficit) {
-		uint32_t deficit = _rc->estimate_usecs_wifi_packet(p);
+		active_list.remove(queue);
+	} else if ((deficit = _rc->estimate_usecs_wifi_packet(p)) <= queue->_deficit) {
 		queue->_deficit -= deficit;
+		queue->_tx_seq.write_begin();
 		queue->_deficit_used += deficit;
 		queue->_transm_bytes += p->length();
 		queue->_transm_pkts += 1;
-		if (queue->size() > 0) {
-			_active_list.push_front(tr);
+		queue->_tx_seq.write_end();
+		// keep serving this queue while it has packets
+		if (queue->size() == 0) {
+			active_list.remove(queue);
 		}
 		return p;
 	} else {
-		_head_table.set(tr, p);
-		_active_list.push_back(tr);
-		queue->_deficit += queue->_quantum;
+		queue->_head_pkt = p;
+		queue->_tx_seq.write_begin();
+		queue->_starvations++;
+		queue->_tx_seq.write_end();
+		active_list.advance();
+		queue->_deficit += scaled_quantum(queue);
+	}
+
+	return 0;
+
+}
+
+// Next frame of the first priority rule of output port that has frames
+// and tokens for a full-sized one, or 0. The rule is left in the active
+// ring, which drops it once it finds it drained.
+Packet * EmpowerQOSManager::dequeue_prio(int port) {
+
+	Vector<TrafficRuleQueue *> &rules = _prio_rules[port];
+
+	for (int i = 0; i < rules.size(); i++) {
+		TrafficRuleQueue *queue = rules[i];
+		if (!queue->size() && !queue->_head_pkt) {
+			continue;
+		}
+		queue->_prio_bucket.refill();
+		if (!queue->_prio_bucket.contains(AggregationQueue::FLOW_QUANTUM)) {
+			continue;
+		}
+		Packet *p = queue->_head_pkt;
+		if (p) {
+			queue->_head_pkt = 0;
+		} else if (!(p = queue->dequeue(_rc, scaled_quantum(queue)))) {
+			continue;
+		}
+		queue->_prio_bucket.remove(p->length());
+		queue->_tx_seq.write_begin();
+		queue->_transm_bytes += p->length();
+		queue->_transm_pkts += 1;
+		queue->_tx_seq.write_end();
+		_prio_pkts++;
+		if (p->timestamp_anno()) {
+			_prio_sojourn.add(Timestamp::recent() - p->timestamp_anno());
+		}
+		return p;
+	}
+
+	return 0;
+
+}
+
+void EmpowerQOSManager::unlist_prio(TrafficRuleQueue *queue) {
+	Vector<TrafficRuleQueue *> &rules = _prio_rules[queue->_ac];
+	for (int i = 0; i < rules.size(); i++) {
+		if (rules[i] == queue) {
+			rules[i] = rules.back();
+			rules.pop_back();
+			return;
+		}
+	}
+}
+
+Packet * EmpowerQOSManager::pull_batch(int port, unsigned max) {
+
+	ActiveRing<TrafficRuleQueue> &active_list = _active_lists[port];
+	PacketBatch batch;
+	uint32_t misses = 0;
+
+	// frames left over from a burst of pull() go first
+	while (_batch[port] && batch.count() < max) {
+		batch.append(PacketBatch::pop(_batch[port]));
+	}
+
+	// stop after a full round of the active ring without a frame, the
+	// remaining queues are waiting for quantum
+	while (batch.count() < max && !active_list.empty() && misses <= active_list.size()) {
+		Packet *p = dequeue_prio(port);
+		if (!p) {
+			p = dequeue_drr(port);
+		}
+		if (!p) {
+			misses++;
+			continue;
+		}
+		misses = 0;
+		batch.append(p);
+	}
+
+	if (batch.empty() && active_list.empty()) {
+		if (++_sleepiness[port] == SLEEPINESS_TRIGGER) {
+			_empty_notes[port].sleep();
+		}
+	}
+
+	return batch.take();
+
+}
+
+Packet * EmpowerQOSManager::pull(int port) {
+
+	if (_burst > 1) {
+		if (!_batch[port]) {
+			_batch[port] = pull_batch(port, _burst);
+		}
+		return PacketBatch::pop(_batch[port]);
+	}
+
+	if (!_active_lists[port].empty()) {
+		if (Packet *p = dequeue_prio(port)) {
+			return p;
+		}
+		return dequeue_drr(port);
+	}
+
+	if (++_sleepiness[port] == SLEEPINESS_TRIGGER) {
+		_empty_notes[port].sleep();
 	}
 
 	return 0;
 }
 
-void EmpowerQOSManager::set_traffic_rule(String ssid, int dscp, uint32_t quantum, bool amsdu_aggregation) {
+void EmpowerQOSManager::set_traffic_rule(String ssid, int dscp, uint32_t quantum, bool amsdu_aggregation, bool notify) {
 	TrafficRule tr = TrafficRule(ssid, dscp);
 	if (_rules.find(tr) == _rules.end()) {
 		click_chatter("%{element} :: %s :: creating new traffic rule queue for ssid %s dscp %u quantum %u A-MSDU %s",
@@ -284,11 +928,42 @@ void EmpowerQOSManager::set_traffic_rule(String ssid, int dscp, uint32_t quantum
 					  quantum,
 					  amsdu_aggregation ? "yes." : "no");
 		uint32_t tr_quantum = (quantum == 0) ? _quantum : quantum;
-		TrafficRuleQueue *queue = new TrafficRuleQueue(tr, _capacity, tr_quantum, amsdu_aggregation);
+		TrafficRuleQueue *queue = new TrafficRuleQueue(tr, _capacity, tr_quantum, amsdu_aggregation, _lockfree, _station_quantum,
+				_nb_flows, EmpowerCoDel(_codel_target, _codel_interval), _queue_delay.usecval(), _hugepages);
+		queue->_rates = &_rates;
+		queue->_owner = this;
+		queue->_queues_lock.set_name(this, "station queues");
+		queue->_burst_frames = _station_burst;
+		queue->_burst_usecs = _station_burst_airtime;
+		if (_ac_ports) {
+			queue->_ac = dscp_ac(dscp);
+		}
+		// aggregation needs QoS data frames
+		if (_ac_ports || _station_burst) {
+			queue->_tid = ac_tid(dscp_ac(dscp));
+		}
+		if (_priority && priority_dscp(dscp)) {
+			queue->_priority = true;
+			queue->_prio_bucket.assign(_prio_rate, _prio_burst);
+			queue->_prio_bucket.set_full();
+			_prio_rules[queue->_ac].push_back(queue);
+		}
+		_rules_lock.acquire();
 		_rules.set(tr, queue);
-		_head_table.set(tr, 0);
-		_active_list.push_back(tr);
-		_el->send_status_traffic_rule(ssid, dscp, _iface_id);
+		_rules_lock.release();
+		_active_lists[queue->_ac].push_back(queue);
+		int slice_id = _slice_ids.get(ssid);
+		if (slice_id < 0) {
+			slice_id = _slices.size();
+			_slices.push_back(new SliceQueues(ssid, slice_id));
+			_slice_ids.set(ssid, slice_id);
+		}
+		if (dscp >= 0 && dscp < SliceQueues::NB_DSCPS) {
+			_slices[slice_id]->_queues[dscp] = queue;
+		}
+		if (notify) {
+			_el->send_status_traffic_rule(ssid, dscp, _iface_id);
+		}
 	}
 }
 
@@ -304,37 +979,136 @@ void EmpowerQOSManager::del_traffic_rule(String ssid, int dscp) {
 		return;
 	}
 	TrafficRuleQueue *trq = itr.value();
+	_active_lists[trq->_ac].remove(trq);
+	if (trq->_priority) {
+		unlist_prio(trq);
+	}
+	int slice_id = _slice_ids.get(ssid);
+	if (slice_id >= 0 && dscp >= 0 && dscp < SliceQueues::NB_DSCPS) {
+		_slices[slice_id]->_queues[dscp] = 0;
+	}
+	_rules_lock.acquire();
 	delete trq;
 	_rules.erase(itr);
+	_rules_lock.release();
+}
+
+void EmpowerQOSManager::remove_station(EtherAddress sta) {
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		itr.value()->remove_station(sta);
+	}
+	_rates.erase(sta);
+}
+
+// The frames queued for sta, with their dscp, to be moved to another WTP
+void EmpowerQOSManager::steal_station(EtherAddress sta, Vector<Packet *> &frames, Vector<int> &dscps) {
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		uint32_t stolen = itr.value()->steal_station(sta, frames);
+		for (uint32_t i = 0; i < stolen; i++) {
+			dscps.push_back(itr.key()._dscp);
+		}
+	}
+}
+
+size_t EmpowerQOSManager::station_bytes(EtherAddress sta) {
+	size_t bytes = 0;
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		bytes += itr.value()->station_bytes(sta);
+	}
+	return bytes;
+}
+
+size_t EmpowerQOSManager::bytes() {
+	size_t bytes = 0;
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		bytes += itr.value()->bytes();
+	}
+	return bytes;
+}
+
+// Queue a frame moved from another WTP, as push() would have
+void EmpowerQOSManager::seed(int slice_id, int dscp, Packet *p, EtherAddress ra, EtherAddress ta) {
+	uint32_t wake = 0;
+	p->set_timestamp_anno(Timestamp::recent());
+	store(slice_id, dscp, p, ra, ta, wake);
+	wake_outputs(wake);
+}
+
+void EmpowerQOSManager::set_station_rate(EtherAddress sta, uint32_t rate, uint32_t burst) {
+	if (rate) {
+		_rates.set(sta, StationRate(rate, burst));
+	} else {
+		_rates.erase(sta);
+	}
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		itr.value()->set_station_rate(sta, rate, burst);
+	}
 }
 
 String EmpowerQOSManager::list_queues() {
 	StringAccum result;
+	_rules_lock.acquire();
 	TRIter itr = _rules.begin();
 	while (itr != _rules.end()) {
 		TrafficRuleQueue *trq = itr.value();
 		result << trq->unparse();
 		itr++;
 	} // end while
+	_rules_lock.release();
+	return result.take_string();
+}
+
+String EmpowerQOSManager::list_stats() {
+	StringAccum result;
+	_rules_lock.acquire();
+	for (TRIter itr = _rules.begin(); itr != _rules.end(); itr++) {
+		result << itr.value()->unparse_stats();
+	}
+	_rules_lock.release();
+	return result.take_string();
+}
+
+String EmpowerQOSManager::list_mcast() {
+	static const char *modes[] = { "legacy", "dms", "ur" };
+	StringAccum result;
+	for (HashTable<EtherAddress, McastGroup>::const_iterator it = _mcast_groups.begin(); it.live(); it++) {
+		const McastGroup &group = it.value();
+		result << it.key() << " " << (group._mode >= 0 && group._mode <= TX_MCAST_UR ? modes[group._mode] : "?")
+			   << " receivers " << group._receivers
+			   << " copies " << group._copies
+			   << " airtime " << group._airtime[TX_MCAST_LEGACY]
+			   << " " << group._airtime[TX_MCAST_DMS]
+			   << " " << group._airtime[TX_MCAST_UR] << "\n";
+	}
 	return result.take_string();
 }
 
 void EmpowerQOSManager::clear() {
+	_rules_lock.acquire();
 	TRIter itr = _rules.begin();
 	while (itr != _rules.end()) {
 		TrafficRuleQueue *trq = itr.value();
 		if (trq->_tr._dscp == 0) {
 			itr++;
 		} else {
+			_active_lists[trq->_ac].remove(trq);
+			if (trq->_priority) {
+				unlist_prio(trq);
+			}
+			int slice_id = _slice_ids.get(trq->_tr._ssid);
+			if (slice_id >= 0 && trq->_tr._dscp < SliceQueues::NB_DSCPS) {
+				_slices[slice_id]->_queues[trq->_tr._dscp] = 0;
+			}
 			delete trq;
 			itr = _rules.erase(itr);
 		}
 	} // end while
 	_rules.clear();
+	_rules_lock.release();
 }
 
 enum {
-	H_DEBUG, H_QUEUES
+	H_DEBUG, H_QUEUES, H_STATS, H_AIRTIME, H_MCAST, H_QUEUES_JSON, H_LOG, H_PRIORITY, H_SLICE_DROPS
 };
 
 String EmpowerQOSManager::read_handler(Element *e, void *thunk) {
@@ -342,8 +1116,40 @@ String EmpowerQOSManager::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_QUEUES:
 		return (td->list_queues());
+	case H_STATS:
+		return (td->list_stats());
+	case H_MCAST:
+		return (td->list_mcast());
+	case H_QUEUES_JSON: {
+		StringAccum sa;
+		JsonWriter w(sa);
+		td->_rules_lock.acquire();
+		sa.reserve(td->_rules.size() * 512);
+		w.begin_array();
+		for (TRIter itr = td->_rules.begin(); itr != td->_rules.end(); itr++) {
+			itr.value()->unparse_json(w);
+		}
+		w.end_array();
+		td->_rules_lock.release();
+		sa << "\n";
+		return sa.take_string();
+	}
+	case H_AIRTIME: {
+		StringAccum sa;
+		sa << "ed " << td->_ed_busy << " tx " << td->_tx_busy << " scale " << td->_scale << "\n";
+		return sa.take_string();
+	}
+	case H_PRIORITY: {
+		StringAccum sa;
+		sa << "pkts " << td->_prio_pkts << " sojourn " << td->_prio_sojourn.unparse() << "\n";
+		return sa.take_string();
+	}
+	case H_SLICE_DROPS:
+		return String(td->_slice_drops.value()) + "\n";
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_LOG:
+		return td->_log.unparse();
 	default:
 		return String();
 	}
@@ -366,10 +1172,20 @@ int EmpowerQOSManager::write_handler(const String &in_s, Element *e, void *vpara
 
 void EmpowerQOSManager::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
-	add_read_handler("queues", read_handler, (void *) H_QUEUES);
+	add_read_handler("log", read_handler, (void *) H_LOG);
+	// the queue tables are walked under _rules_lock and _queues_lock, the
+	// counters read under their SeqLock: these can run off the router
+	// thread, see ControlSocket's HANDLER_THREAD
+	add_read_handler("queues", read_handler, (void *) H_QUEUES, Handler::h_nonexclusive);
+	add_read_handler("stats", read_handler, (void *) H_STATS, Handler::h_nonexclusive);
+	add_read_handler("airtime", read_handler, (void *) H_AIRTIME);
+	add_read_handler("mcast", read_handler, (void *) H_MCAST);
+	add_read_handler("priority", read_handler, (void *) H_PRIORITY);
+	add_read_handler("slice_drops", read_handler, (void *) H_SLICE_DROPS);
+	add_read_handler("queues_json", read_handler, (void *) H_QUEUES_JSON, Handler::h_nonexclusive);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(EmpowerQOSManager)
-ELEMENT_REQUIRES(userlevel)
+ELEMENT_REQUIRES(EmpowerLVAPManager)
@@ -4,15 +4,26 @@
 #include <click/config.h>
 #include <click/element.hh>
 #include <clicknet/ether.h>
+#include <clicknet/ip.h>
 #include <click/notifier.hh>
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
 #include <click/hashmap.hh>
 #include <click/hashtable.hh>
+#include <click/hashallocator.hh>
 #include <click/straccum.hh>
+#include <click/tokenbucket.hh>
 #include <clicknet/wifi.h>
 #include <clicknet/llc.h>
 #include <elements/standard/simplequeue.hh>
+#include <elements/wifi/minstrel.hh>
+#include <elements/json/jsonwriter.hh>
+#include "empowerwifiheader.hh"
+#include "empowercodel.hh"
+#include "empowergso.hh"
+#include "empowerpacket.hh"
+#include "empowerstationcache.hh"
+#include "empowerloglimit.hh"
 CLICK_DECLS
 
 /*
@@ -32,16 +43,210 @@ Also maintains a dedicated queue for each pair tenant/dscp.
 Strips the Ethernet header off the front of the packet and pushes
 an 802.11 frame header and LLC header onto the packet.
 
+TCP super-frames, i.e. frames with a nonzero GSO size annotation such as
+those of a KernelTap with GSO true and SEGMENT false, are queued whole and
+cut into MSS-sized frames only when they are dequeued.
+
+On hot-swap the traffic rules are carried over from the old
+EmpowerQOSManager together with their deficits and queued frames. Frames
+that do not fit the new capacity are dropped.
+
+The controller can cap the downlink of an LVAP with a SET_LVAP_RATE
+message. The station queues are then paced by a token bucket: a capped
+station whose bucket cannot take a full-sized frame is passed over,
+neither granted nor charged airtime, and the other stations of its
+traffic rule are served in the meantime.
+
+Group frames follow the multicast policy of their transmission policy.
+Legacy sends one copy to each unique LVAP and one to each VAP. DMS sends
+a unicast copy to each station. UR (unsolicited retry) sends unique
+LVAPs a unicast copy, as DMS, and each VAP a few back-to-back copies at
+the most robust rate of its slowest receiver. The number of copies
+follows the RSSI of its weakest receiver, as seen by EmpowerRXStats, up
+to the ur_mcast_count of the policy. Receivers, rate and copies are
+refreshed every 100 ms; the copies are charged to the airtime deficit
+of their slice like any other frame.
+
+With MCAST_AUTO the policy of each group is picked by the element
+instead: at every refresh it estimates the airtime a full-sized frame
+takes to reach the receivers of the VAPs under DMS (one unicast per
+receiver at its Minstrel rate), legacy (one copy per VAP at the policy
+rate) and UR (the copies at the rate of the slowest receiver), and
+moves to the cheapest one once it saves at least a quarter of the
+airtime of the current one. Unique LVAPs are served alike by all three.
+
+Frames go to the traffic rule of the DSCP of their IPv4 or IPv6 header,
+also behind an 802.1Q tag; a tagged frame without one takes the DSCP its
+PCP maps to, see PCP_DSCP. Headers are read in place, no MarkIPHeader
+is needed upstream.
+
+Frames tagged with a slice by EmpowerSliceTag only reach the LVAPs and
+VAPs of its SSID: unicast frames to a station of another SSID are
+dropped, and group frames are only copied to the stations and VAPs of
+the SSID. Untagged frames reach every SSID.
+
 Arguments are:
 
 =item EL
 An EmpowerLVAPManager element
 
+=item BURST
+Number of frames dequeued per DRR pass. Frames beyond the first are
+kept in a small chain and handed out by the following pulls. Elements
+that pull in batches get up to their own batch size per pull, whatever
+BURST is. An output only wakes its puller up when it stops being empty,
+once per pushed batch, so a puller woken up finds the whole batch
+queued. Default is 1.
+
+=item STATION_QUANTUM
+Airtime, in microseconds, every station of a traffic rule is granted
+per round. Inside each traffic rule stations are served by a deficit
+round robin on their estimated airtime, so slow stations cannot take
+the medium from fast ones. Default is 1000.
+
+=item STATION_BURST
+Number of frames a station is sent back to back once its turn comes, so
+that the driver can aggregate them in one A-MPDU, which it only builds
+from consecutive frames of the same station and TID. The burst goes on
+past the end of the airtime of the station, which pays the debt off in
+the following rounds, and then the next station is served. Frames go out
+as QoS data frames, with the TID of the category of their traffic rule
+(see AC_PORTS). Zero disables bursts. Default is 0.
+
+=item STATION_BURST_AIRTIME
+Bound on the airtime of a burst, in microseconds. Zero bounds bursts by
+STATION_BURST only. Default is 4000, the longest A-MPDU.
+
+=item FLOWS
+Number of flows of each station queue. Frames are hashed to a flow on
+their IP 5-tuple and flows are served FQ-CoDel style, so the sparse
+flows of a station are not stuck behind its bulk transfers. 1 keeps a
+single FIFO per station. Ignored in LOCKFREE mode. Default is 32.
+
+=item CODEL_TARGET
+CoDel target sojourn time of every flow. Frames are dropped once they
+have waited more than this for CODEL_INTERVAL. Zero disables CoDel.
+Default is 5 ms.
+
+=item CODEL_INTERVAL
+CoDel interval. Default is 100 ms.
+
+=item QUEUE_DELAY
+Target queueing delay of each station queue. The number of frames a
+station may queue follows its drain rate, i.e. the airtime of its frames
+at the rates picked by RC, so that a full queue drains in about this
+time. Stations can always queue 16 frames and never more than the queue
+capacity. Zero gives every station the full capacity. Default is 20 ms.
+
+=item IDLE_TIMEOUT
+Station queues that stayed empty this long are released, so that the
+queues of stations that left do not pile up. Queues are also released as
+soon as an LVAP is removed. Zero keeps idle queues. Default is 60 s.
+
+=item LOCKFREE
+Use single-producer/single-consumer lock-free rings instead of locked
+aggregation queues. Only safe when push and pull are each confined to a
+single thread. Default is false.
+
+=item AC_PORTS
+Boolean. If true, the element has four pull outputs, one for each
+802.11 access category: output 0 is best effort, 1 background, 2 video
+and 3 voice. Traffic rules are mapped to a category by their DSCP
+(RFC 8325: CS1 is background, CS3 to CS5 and the AF3x and AF4x classes
+video, VOICE-ADMIT, EF and above voice, the rest best effort), and each
+output runs its own DRR over its rules, with its own empty notifier.
+Frames go out as QoS data frames whose TID is that of their category
+(0, 1, 5 and 6), which is what the driver reads to put an injected frame
+in its hardware queue. Default is false: a single output, and plain data
+frames unless STATION_BURST is set.
+
+=item PRIORITY
+Boolean. If true, the EF and CS6 traffic rules of every slice are
+strict priority: their frames are sent ahead of the DRR rounds of all
+the other rules of their output, as long as the token bucket of the rule
+allows. Past that rate they wait for their turn in the DRR like any
+other rule, so they cannot starve the others. The time their frames
+spend queued is reported on its own by the priority handler. Default is
+false.
+
+=item PRIORITY_RATE
+Rate, in bytes per second, each priority rule can send ahead of the DRR.
+Default is 125000, 1 Mbps.
+
+=item PRIORITY_BURST
+Burst, in bytes, each priority rule can send ahead of the DRR. Default
+is 15140, ten full-sized frames.
+
+=item HUGEPAGES
+Allocate the aggregation queues from hugepages when the system has some
+free. Each queue takes one slot of a per-rule slab, together with its
+ring or flows. Default is false.
+
+=item REGMON
+An EmpowerRegmon element watching the channel of this interface. When
+set, the quanta of all the traffic rules are scaled by the share of
+airtime the channel leaves to this interface, i.e. the time it is
+neither busy with the transmissions of others (energy detect minus own
+transmissions), so that slices keep their airtime ratios without the
+scheduler granting more airtime per round than the channel has.
+Quanta never go below 1/8 of their configured value. Unset by default,
+and user level only.
+
+=item ADAPT_INTERVAL
+Period of the quantum adaptation, and the regmon window it looks at.
+Default is 100 ms.
+
+=item MCAST_AUTO
+Boolean. Pick the multicast policy of each group from the airtime it
+takes, ignoring the one set by the controller. Default is false.
+
+=item PCP_DSCP
+Eight DSCPs, space separated, for the 802.1p priorities 0 to 7 of
+tagged frames whose IP header carries no DSCP, or that are not IP.
+Default is "0 8 16 24 32 46 48 56".
+
 =item DEBUG
 Turn debug on/off
 
 =back 8
 
+=h queues read-only
+Occupancy of the queues of every traffic rule. Like stats and queues_json,
+ControlSocket can call it off the router thread, see its HANDLER_THREAD.
+
+=h stats read-only
+Per traffic rule and per station telemetry: frames sent, maximum queue
+length, drops on a full queue, CoDel drops, rounds skipped for lack of
+deficit and the sojourn time histogram. Bucket 0 counts the frames that
+waited less than 128 us, bucket i those that waited less than 128 << i us.
+
+=h mcast read-only
+One line per group tracked: address, policy in use, receivers, UR copies
+and the airtime of a full-sized frame (in usecs) under legacy, DMS and UR.
+
+=h queues_json read-only
+The queues and the stats of every traffic rule, as a JSON array with one
+object per rule. Reallocs are the frames copied because they had no room
+for the 802.11 header: the element declares that room as the headroom it
+needs, see HeadroomTracker, so a source that sizes its headroom from it
+sends none.
+
+=h priority read-only
+Frames sent ahead of the DRR by the priority rules, and the histogram of
+the time they spent queued.
+
+=h slice_drops read-only
+Unicast frames dropped because their slice tag did not match the SSID of
+their station.
+
+=h airtime read-only
+Channel busy time seen by REGMON over the last ADAPT_INTERVAL, in 1/10000,
+and the current quantum scale, in 1/1024.
+
+=h log read-only
+One line per message logged per frame: name, times it was due, times
+it was suppressed. Each message is logged at most 10 times per second.
+
 =a EmpowerWifiDecap
 */
 
@@ -77,67 +282,510 @@ class EtherPair {
 
 };
 
+// Intrusive round-robin ring of active queues. T must provide the
+// _active flag and the _active_next/_active_prev links. Activation,
+// removal and round-robin advance are all O(1).
+template <typename T>
+class ActiveRing {
+
+public:
+
+	ActiveRing() : _head(0), _size(0) {
+	}
+
+	T *head() const { return _head; }
+	bool empty() const { return _head == 0; }
+	uint32_t size() const { return _size; }
+
+	// append e at the tail of the ring (just before the head), no-op if
+	// e is already active
+	void push_back(T *e) {
+		if (e->_active) {
+			return;
+		}
+		e->_active = true;
+		if (!_head) {
+			e->_active_next = e;
+			e->_active_prev = e;
+			_head = e;
+		} else {
+			e->_active_next = _head;
+			e->_active_prev = _head->_active_prev;
+			_head->_active_prev->_active_next = e;
+			_head->_active_prev = e;
+		}
+		_size++;
+	}
+
+	void remove(T *e) {
+		if (!e->_active) {
+			return;
+		}
+		if (e->_active_next == e) {
+			_head = 0;
+		} else {
+			e->_active_prev->_active_next = e->_active_next;
+			e->_active_next->_active_prev = e->_active_prev;
+			if (_head == e) {
+				_head = e->_active_next;
+			}
+		}
+		e->_active = false;
+		e->_active_next = 0;
+		e->_active_prev = 0;
+		_size--;
+	}
+
+	// move the head to the next active entry
+	void advance() {
+		if (_head) {
+			_head = _head->_active_next;
+		}
+	}
+
+	void clear() {
+		while (_head) {
+			remove(_head);
+		}
+	}
+
+private:
+
+	T *_head;
+	uint32_t _size;
+
+};
+
+// Histogram of the time frames spent queued, on log2 buckets of
+// BASE_USEC << i microseconds (see EMPOWER_SOJOURN_BUCKETS).
+class SojournHistogram {
+
+public:
+
+	enum { NB_BUCKETS = EMPOWER_SOJOURN_BUCKETS, BASE_USEC = 128 };
+
+	SojournHistogram() {
+		clear();
+	}
+
+	void clear() {
+		memset(_buckets, 0, sizeof(_buckets));
+		_max_usec = 0;
+	}
+
+	void add(const Timestamp &sojourn) {
+		Timestamp::value_type v = sojourn.usecval();
+		uint32_t usec = (v < 0) ? 0 : (v > 0xFFFFFFFF) ? 0xFFFFFFFF : v;
+		int b = bucket(usec);
+		// the layout of EMPOWER_SOJOURN_BUCKETS
+		assert(b == 0 || usec >= ((uint32_t) BASE_USEC << (b - 1)));
+		assert(b == NB_BUCKETS - 1 || usec < ((uint32_t) BASE_USEC << b));
+		_buckets[b]++;
+		if (usec > _max_usec) {
+			_max_usec = usec;
+		}
+	}
+
+	// 1 + floor(log2(usec / BASE_USEC)), 0 below BASE_USEC
+	static int bucket(uint32_t usec) {
+		uint32_t x = usec / BASE_USEC;
+		int b = x ? 33 - ffs_msb(x) : 0;
+		return b < NB_BUCKETS ? b : NB_BUCKETS - 1;
+	}
+
+	void add(const SojournHistogram &h) {
+		for (int i = 0; i < NB_BUCKETS; i++) {
+			_buckets[i] += h._buckets[i];
+		}
+		if (h._max_usec > _max_usec) {
+			_max_usec = h._max_usec;
+		}
+	}
+
+	uint32_t operator[](int i) const { return _buckets[i]; }
+	uint32_t max_usec() const { return _max_usec; }
+
+	String unparse() const {
+		StringAccum result;
+		result << "max " << _max_usec << "us hist";
+		for (int i = 0; i < NB_BUCKETS; i++) {
+			result << " " << _buckets[i];
+		}
+		return result.take_string();
+	}
+
+	void unparse_json(JsonWriter &w) const {
+		w.begin_object();
+		w.member("max_usecs", _max_usec);
+		w.key("hist").begin_array();
+		for (int i = 0; i < NB_BUCKETS; i++) {
+			w.value(_buckets[i]);
+		}
+		w.end_array();
+		w.end_object();
+	}
+
+private:
+
+	uint32_t _buckets[NB_BUCKETS];
+	uint32_t _max_usec;
+
+};
+
+// One flow of an AggregationQueue: a FIFO of the frames hashing to it,
+// chained through Packet::next(), with its own byte deficit and CoDel
+// state.
+class AggregationFlow {
+
+public:
+
+	// active ring links, owned by the AggregationQueue
+	bool _active;
+	AggregationFlow *_active_next;
+	AggregationFlow *_active_prev;
+
+	Packet *_head;
+	Packet *_tail;
+	uint32_t _nb_pkts;
+	int32_t _deficit;
+	EmpowerCoDel _codel;
+
+	AggregationFlow() : _active(false), _active_next(0), _active_prev(0), _head(0), _tail(0), _nb_pkts(0), _deficit(0) {
+	}
+
+	~AggregationFlow() {
+		while (Packet *p = codel_pop()) {
+			p->kill();
+		}
+	}
+
+	void push(Packet *p) {
+		p->set_next(0);
+		if (_tail) {
+			_tail->set_next(p);
+		} else {
+			_head = p;
+		}
+		_tail = p;
+		_nb_pkts++;
+	}
+
+	Packet *codel_pop() {
+		Packet *p = _head;
+		if (p) {
+			_head = p->next();
+			if (!_head) {
+				_tail = 0;
+			}
+			p->set_next(0);
+			_nb_pkts--;
+		}
+		return p;
+	}
+
+};
+
+// Per (RA, TA) packet queue.
+//
+// By default every access is serialized by a ReadWriteLock and frames
+// are spread over a fixed number of flows by hashing their IP 5-tuple
+// (the ethertype for non IP traffic). Flows are served FQ-CoDel style:
+// a deficit round robin on bytes where flows that just became active go
+// first, and CoDel drops frames that waited too long at the head of each
+// flow. A bulk transfer to a station then no longer delays its sparse
+// flows (DNS, VoIP, TCP acks) by the whole queue.
+//
+// In lock-free mode the queue is a single-producer, single-consumer
+// ring: the capacity is rounded up to a power of two, _head and _tail
+// are free-running indices living on separate cache lines, and only the
+// consumer writes _head while only the producer writes _tail. The
+// producer cannot maintain the flow rings without a lock, so this mode
+// keeps a single FIFO with CoDel applied by the consumer.
+//
+// A station can be capped with set_rate(). Its queue is then paced by a
+// token bucket on bytes, consumer side only: throttled() tells the
+// scheduler to pass it over until the bucket holds a full frame again.
+//
+// The queue admits at most limit() frames, BQL style: as many frames as
+// the station drains in the target delay given to the constructor, based
+// on an average of the airtime the consumer reports with update_limit().
+// Slow stations then queue a few frames only, fast ones up to the
+// capacity. A zero target delay keeps the limit at the capacity.
+//
+// dequeue() picks the next frame and applies CoDel. top() and pull()
+// then give access to the frames that follow it in the same flow, e.g.
+// to build an A-MSDU, without dropping any. unpull() gives back the last
+// frame pulled, which the next dequeue() or pull() hands out again.
+//
+// TCP super-frames (see EmpowerGSO) count as one frame while queued and
+// are segmented once picked by dequeue() or pull(). The segments after
+// the first are handed out before anything else, consumer side only.
 class AggregationQueue {
 
 public:
 
-	AggregationQueue(uint32_t capacity, EtherPair pair) {
-		_q = new Packet*[capacity];
+	enum { FLOW_QUANTUM = 1514, MIN_LIMIT = 16 };
+
+	// active ring links, owned by the TrafficRuleQueue
+	bool _active;
+	AggregationQueue *_active_next;
+	AggregationQueue *_active_prev;
+
+	// airtime left in this round, may go negative as the cost of a
+	// frame is only known once it is sent. owned by the TrafficRuleQueue
+	int32_t _airtime_deficit;
+	// rounds this queue was skipped for lack of airtime
+	uint32_t _starvations;
+	// rounds this queue was skipped by its rate cap
+	uint32_t _throttles;
+	// when the last frame was queued. owned by the TrafficRuleQueue
+	Timestamp _last_active;
+
+	// storage, if not null, holds the ring or the flows, see make()
+	AggregationQueue(uint32_t capacity, EtherPair pair, bool lockfree = false,
+			uint32_t nb_flows = 1, const EmpowerCoDel &codel = EmpowerCoDel(), uint32_t limit_usecs = 0,
+			void *storage = 0) :
+			_active(false), _active_next(0), _active_prev(0), _airtime_deficit(0), _starvations(0), _throttles(0),
+			_capped(false) {
+		_lockfree = lockfree;
+		_storage = storage != 0;
+		_q = 0;
+		_flows = 0;
+		_nb_flows = 0;
+		_current = 0;
+		if (_lockfree) {
+			capacity = ring_size(capacity);
+			_q = storage ? reinterpret_cast<Packet **>(storage) : new Packet*[capacity];
+			for (unsigned i = 0; i < capacity; i++) {
+				_q[i] = 0;
+			}
+		} else {
+			_nb_flows = nb_flows ? nb_flows : 1;
+			if (storage) {
+				_flows = reinterpret_cast<AggregationFlow *>(storage);
+				for (unsigned i = 0; i < _nb_flows; i++) {
+					new((void *) &_flows[i]) AggregationFlow();
+				}
+			} else {
+				_flows = new AggregationFlow[_nb_flows];
+			}
+			for (unsigned i = 0; i < _nb_flows; i++) {
+				_flows[i]._codel = codel;
+			}
+		}
+		_codel = codel;
+		_perturbation = click_random();
 		_capacity = capacity;
+		_mask = capacity - 1;
+		_limit = capacity;
+		_limit_usecs = limit_usecs;
+		_frame_usecs = 0;
 		_pair = pair;
+		_wifi_hdr.build(pair._ra, pair._ta);
 		_nb_pkts = 0;
 		_drops = 0;
+		_codel_drops = 0;
+		_max_nb_pkts = 0;
+		_transm_pkts = 0;
 		_head = 0;
 		_tail = 0;
-		for (unsigned i = 0; i < _capacity; i++) {
-			_q[i] = 0;
-		}
+		_segments = 0;
+		_nb_segments = 0;
+		_gso_segments = 0;
+		_held = 0;
 	}
 
 	String unparse() {
 		StringAccum result;
+		if (_lockfree) {
+			result << _pair.unparse() << " -> status: " << nb_pkts() << "/" << _limit << "/" << _capacity
+				   << " codel drops: " << _codel_drops << " (lockfree)\n";
+			return result.take_string();
+		}
 		_queue_lock.acquire_read();
-		result << _pair.unparse() << " -> status: " << _nb_pkts << "/" << _capacity << "\n";
+		result << _pair.unparse() << " -> status: " << _nb_pkts << "/" << _limit << "/" << _capacity
+			   << " flows: " << (_new_flows.size() + _old_flows.size()) << "/" << _nb_flows
+			   << " codel drops: " << _codel_drops << "\n";
 		_queue_lock.release_read();
 		return result.take_string();
 	}
 
 	~AggregationQueue() {
+		if (_held) {
+			_held->kill();
+		}
+		while (Packet *p = pop_segment()) {
+			p->kill();
+		}
 		_queue_lock.acquire_write();
-		for (uint32_t i = 0; i < _capacity; i++) {
-			if (_q[i]) {
-				_q[i]->kill();
+		if (_q) {
+			for (uint32_t i = 0; i < _capacity; i++) {
+				if (_q[i]) {
+					_q[i]->kill();
+				}
+			}
+			if (!_storage) {
+				delete[] _q;
+			}
+		}
+		if (_storage) {
+			for (uint32_t i = 0; i < _nb_flows; i++) {
+				_flows[i].~AggregationFlow();
 			}
+		} else {
+			delete[] _flows;
 		}
-		delete[] _q;
 		_queue_lock.release_write();
 	}
 
-	Packet* pull() {
+	// Size of an allocator slot holding a queue with its ring or flows
+	static size_t slot_size(uint32_t capacity, bool lockfree, uint32_t nb_flows) {
+		if (lockfree) {
+			return header_size() + ring_size(capacity) * sizeof(Packet *);
+		}
+		return header_size() + (nb_flows ? nb_flows : 1) * sizeof(AggregationFlow);
+	}
+
+	// Build a queue in a single slot of alloc, so that all its state is
+	// contiguous and goes away with one deallocation, see destroy()
+	static AggregationQueue *make(HashAllocator &alloc, uint32_t capacity, EtherPair pair, bool lockfree,
+			uint32_t nb_flows, const EmpowerCoDel &codel, uint32_t limit_usecs) {
+		void *slot = alloc.allocate();
+		if (!slot) {
+			return 0;
+		}
+		return new(slot) AggregationQueue(capacity, pair, lockfree, nb_flows, codel, limit_usecs,
+				reinterpret_cast<char *>(slot) + header_size());
+	}
+
+	static void destroy(HashAllocator &alloc, AggregationQueue *q) {
+		q->~AggregationQueue();
+		alloc.deallocate(q);
+	}
+
+	// Next frame to send, after CoDel had its say. Adds the frames it
+	// dropped to drops.
+	Packet* dequeue(const Timestamp &now, uint32_t &drops) {
+		uint32_t dropped = 0;
 		Packet* p = 0;
+		_now = now;
+		if (_held) {
+			return pop_held();
+		}
+		if (_segments) {
+			p = pop_segment();
+			account(p);
+			return p;
+		}
+		if (_lockfree) {
+			p = _codel.dequeue(this, now, dropped);
+			_codel_drops += dropped;
+			drops += dropped;
+			if (p && (p = split(p))) {
+				account(p);
+			}
+			return p;
+		}
 		_queue_lock.acquire_write();
-		if (_nb_pkts > 0) {
-			p = _q[_head];
-			_q[_head] = 0;
-			_head++;
-			_head %= _capacity;
-			_nb_pkts--;
+		_current = 0;
+		while (true) {
+			bool is_new = !_new_flows.empty();
+			ActiveRing<AggregationFlow> &ring = is_new ? _new_flows : _old_flows;
+			AggregationFlow *flow = ring.head();
+			if (!flow) {
+				break;
+			}
+			if (flow->_deficit <= 0) {
+				// out of quantum, to the back of the old flows
+				flow->_deficit += FLOW_QUANTUM;
+				if (is_new) {
+					_new_flows.remove(flow);
+					_old_flows.push_back(flow);
+				} else {
+					_old_flows.advance();
+				}
+				continue;
+			}
+			uint32_t before = flow->_nb_pkts;
+			p = flow->_codel.dequeue(flow, now, dropped);
+			_nb_pkts -= before - flow->_nb_pkts;
+			if (p) {
+				flow->_deficit -= p->length();
+				_current = flow;
+				break;
+			}
+			// drained. a new flow goes through the old flows once more,
+			// or a flow could stay new forever by sending one frame at
+			// a time
+			ring.remove(flow);
+			if (is_new && !_old_flows.empty()) {
+				_old_flows.push_back(flow);
+			}
 		}
+		_codel_drops += dropped;
+		drops += dropped;
 		_queue_lock.release_write();
+		if (p && (p = split(p))) {
+			account(p);
+		}
 		return p;
 	}
 
+	// next frame of the flow served by the last dequeue(), without AQM
+	Packet* pull() {
+		Packet* p = 0;
+		if (_held) {
+			return pop_held();
+		}
+		if (_segments) {
+			p = pop_segment();
+		} else if (_lockfree) {
+			p = pull_lockfree();
+		} else {
+			_queue_lock.acquire_write();
+			if (_current) {
+				p = _current->codel_pop();
+				if (p) {
+					_current->_deficit -= p->length();
+					_nb_pkts--;
+				}
+			}
+			_queue_lock.release_write();
+		}
+		if (p && (p = split(p))) {
+			account(p);
+		}
+		return p;
+	}
+
+	// give back p, the frame the last pull() returned
+	void unpull(Packet* p) {
+		assert(!_held);
+		_held = p;
+		_transm_pkts--;
+	}
+
 	bool push(Packet* p) {
+		if (_lockfree) {
+			return push_lockfree(p);
+		}
 		bool result = false;
+		uint32_t index = flow_hash(p) % _nb_flows;
 		_queue_lock.acquire_write();
-		if (_nb_pkts == _capacity) {
+		if (_nb_pkts >= _limit) {
 			_drops++;
 			result = false;
 		} else {
-			_q[_tail] = p;
-			_tail++;
-			_tail %= _capacity;
+			AggregationFlow *flow = &_flows[index];
+			flow->push(p);
+			if (!flow->_active) {
+				flow->_deficit = FLOW_QUANTUM;
+				_new_flows.push_back(flow);
+			}
 			_nb_pkts++;
+			if (_nb_pkts > _max_nb_pkts) {
+				_max_nb_pkts = _nb_pkts;
+			}
 			result = true;
 		}
 		_queue_lock.release_write();
@@ -146,9 +794,23 @@ public:
 
     const Packet* top() {
       Packet* p = 0;
+      if (_held) {
+        return _held;
+      }
+      if (_segments) {
+        return _segments;
+      }
+      if (_lockfree) {
+        uint32_t h = _head;
+        if (h != _tail) {
+          click_read_fence();
+          p = _q[h & _mask];
+        }
+        return p;
+      }
       _queue_lock.acquire_write();
-      if(_head != _tail) {
-        p = _q[(_head+1) % _capacity];
+      if (_current) {
+        p = _current->_head;
       }
       _queue_lock.release_write();
       return p;
@@ -158,26 +820,267 @@ public:
 		return top()->length();
 	}
 
-    uint32_t nb_pkts() { return _nb_pkts; }
+    uint32_t nb_pkts() { return (_lockfree ? _tail - _head : _nb_pkts) + _nb_segments + (_held ? 1 : 0); }
+    uint32_t drops() { return _drops; }
+    uint32_t codel_drops() { return _codel_drops; }
+    uint32_t max_nb_pkts() { return _max_nb_pkts; }
+    uint32_t limit() { return _limit; }
+
+	// consumer side: nb_frames frames took usecs of airtime
+	void update_limit(uint32_t usecs, uint32_t nb_frames) {
+		if (!_limit_usecs || !usecs || !nb_frames) {
+			return;
+		}
+		uint32_t frame_usecs = usecs / nb_frames;
+		_frame_usecs = _frame_usecs ? (_frame_usecs * 7 + frame_usecs) / 8 : frame_usecs;
+		uint32_t limit = _limit_usecs / (_frame_usecs ? _frame_usecs : 1);
+		if (limit < MIN_LIMIT) {
+			limit = MIN_LIMIT;
+		}
+		if (limit > _capacity) {
+			limit = _capacity;
+		}
+		_limit = limit;
+	}
+    uint32_t transm_pkts() { return _transm_pkts; }
+    // frames added by segmenting super-frames, consumer side
+    uint32_t gso_segments() { return _gso_segments; }
+    const SojournHistogram &sojourn() { return _sojourn; }
+    bool lockfree() { return _lockfree; }
+
+    // names the lock in the lock statistics, see LockStats
+    void set_lock_name(const Element *owner, const char *name) { _queue_lock.set_name(owner, name); }
     EtherPair pair() { return _pair; }
+    const EmpowerWifiHeader &wifi_header() { return _wifi_hdr; }
+    // send QoS data frames with TID tid
+    void set_tid(int tid) { _wifi_hdr.build(_pair._ra, _pair._ta, tid); }
+
+	// Cap the frames handed out to rate bytes per second, with bursts of
+	// up to burst bytes. A zero rate lifts the cap.
+	void set_rate(uint32_t rate, uint32_t burst) {
+		_capped = rate != 0;
+		if (_capped) {
+			_bucket.assign(rate, burst > FLOW_QUANTUM ? burst : (uint32_t) FLOW_QUANTUM);
+			_bucket.set_full();
+		}
+	}
+
+	bool capped() const { return _capped; }
+	uint32_t rate() const { return _capped ? _bucket.rate() : 0; }
+
+	// true while the cap holds the queue back. The next frame is not
+	// known yet, so a full-sized one must fit
+	bool throttled() {
+		if (!_capped) {
+			return false;
+		}
+		_bucket.refill();
+		return !_bucket.contains(FLOW_QUANTUM);
+	}
+
+	// charge a frame handed out, an A-MSDU may empty the bucket
+	void charge(uint32_t length) {
+		if (_capped) {
+			_bucket.remove(length);
+		}
+	}
+
+	// consumer side of the lock-free ring, for EmpowerCoDel
+	Packet* codel_pop() {
+		return pull_lockfree();
+	}
+
+	// next queued frame, bypassing the AQM and the flow scheduler, flow
+	// by flow. Only for handing the frames over to another queue, with
+	// both the producer and the consumer stopped
+	Packet* steal() {
+		Packet* p = _held;
+		if (p) {
+			_held = 0;
+			return p;
+		}
+		p = pop_segment();
+		if (p || _lockfree) {
+			return p ? p : pull_lockfree();
+		}
+		_queue_lock.acquire_write();
+		for (uint32_t i = 0; i < _nb_flows && !p; i++) {
+			p = _flows[i].codel_pop();
+		}
+		if (p) {
+			_nb_pkts--;
+		}
+		_queue_lock.release_write();
+		return p;
+	}
 
 private:
 
+	static uint32_t ring_size(uint32_t capacity) {
+		uint32_t size = 1;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		return size;
+	}
+
+	static size_t header_size() {
+		return (sizeof(AggregationQueue) + CLICK_CACHE_LINE_SIZE - 1) & ~(size_t) (CLICK_CACHE_LINE_SIZE - 1);
+	}
+
 	ReadWriteLock _queue_lock;
 	Packet** _q;
+	// _q or _flows live right after the queue, see make()
+	bool _storage;
+
+	AggregationFlow *_flows;
+	uint32_t _nb_flows;
+	ActiveRing<AggregationFlow> _new_flows;
+	ActiveRing<AggregationFlow> _old_flows;
+	// flow of the frame returned by the last dequeue()
+	AggregationFlow *_current;
+	uint32_t _perturbation;
+	// lock-free mode only
+	EmpowerCoDel _codel;
 
 	uint32_t _capacity;
+	uint32_t _mask;
+	// written by the consumer, read by the producer
+	volatile uint32_t _limit;
+	uint32_t _limit_usecs;
+	uint32_t _frame_usecs;
 	EtherPair _pair;
+	EmpowerWifiHeader _wifi_hdr;
 	uint32_t _nb_pkts;
 	uint32_t _drops;
-	uint32_t _head;
-	uint32_t _tail;
+	uint32_t _codel_drops;
+	uint32_t _max_nb_pkts;
+	uint32_t _transm_pkts;
+	bool _lockfree;
+
+	bool _capped;
+	TokenBucket _bucket;
+
+	// consumer side telemetry, _now is the time of the last dequeue()
+	Timestamp _now;
+	SojournHistogram _sojourn;
+
+	// segments of the last super-frame not handed out yet
+	Packet *_segments;
+	uint32_t _nb_segments;
+	uint32_t _gso_segments;
+	// given back by unpull(), its sojourn time is already counted
+	Packet *_held;
+
+	Packet *split(Packet *p) {
+		if (!GSO_SIZE_ANNO(p)) {
+			return p;
+		}
+		p = EmpowerGSO::segment(p, _segments, _nb_segments);
+		_gso_segments += _nb_segments;
+		return p;
+	}
+
+	Packet *pop_segment() {
+		Packet *p = _segments;
+		if (p) {
+			_segments = p->next();
+			p->set_next(0);
+			_nb_segments--;
+		}
+		return p;
+	}
+
+	Packet *pop_held() {
+		Packet *p = _held;
+		_held = 0;
+		_transm_pkts++;
+		return p;
+	}
+
+	void account(const Packet *p) {
+		if (p->timestamp_anno()) {
+			_sojourn.add(_now - p->timestamp_anno());
+		}
+		_transm_pkts++;
+	}
+
+	// consumer index, written by pull() only
+	volatile uint32_t _head CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+	// producer index, written by push() only
+	volatile uint32_t _tail CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+	// hash of the IP 5-tuple of an Ethernet frame, or of its ethertype
+	uint32_t flow_hash(const Packet *p) const {
+		const unsigned char *data = p->data();
+		const click_ether *eh = (const click_ether *) data;
+		uint32_t h = _perturbation ^ eh->ether_type;
+		if (ntohs(eh->ether_type) == ETHERTYPE_IP && p->length() >= sizeof(click_ether) + sizeof(click_ip)) {
+			const click_ip *ip = (const click_ip *) (data + sizeof(click_ether));
+			uint32_t hlen = ip->ip_hl << 2;
+			h = h * 0x9E3779B1 ^ ip->ip_src.s_addr;
+			h = h * 0x9E3779B1 ^ ip->ip_dst.s_addr;
+			h = h * 0x9E3779B1 ^ ip->ip_p;
+			if ((ip->ip_p == IP_PROTO_TCP || ip->ip_p == IP_PROTO_UDP)
+					&& !IP_ISFRAG(ip)
+					&& p->length() >= sizeof(click_ether) + hlen + 4) {
+				uint32_t ports;
+				memcpy(&ports, data + sizeof(click_ether) + hlen, 4);
+				h = h * 0x9E3779B1 ^ ports;
+			}
+		}
+		h ^= h >> 16;
+		return h * 0x9E3779B1 >> 8;
+	}
+
+	bool push_lockfree(Packet* p) {
+		uint32_t t = _tail;
+		if (t - _head >= _limit) {
+			_drops++;
+			return false;
+		}
+		_q[t & _mask] = p;
+		// publish the slot before the new tail
+		click_write_fence();
+		_tail = t + 1;
+		if (t + 1 - _head > _max_nb_pkts) {
+			_max_nb_pkts = t + 1 - _head;
+		}
+		return true;
+	}
+
+	Packet* pull_lockfree() {
+		uint32_t h = _head;
+		if (h == _tail) {
+			return 0;
+		}
+		// read the slot only after observing the tail
+		click_read_fence();
+		Packet* p = _q[h & _mask];
+		_q[h & _mask] = 0;
+		// release the slot only after it has been read
+		click_fence();
+		_head = h + 1;
+		return p;
+	}
 
 };
 
 typedef HashTable<EtherPair, AggregationQueue*> AggregationQueues;
 typedef AggregationQueues::iterator AQIter;
 
+// rate cap of a station, see AggregationQueue::set_rate()
+struct StationRate {
+	uint32_t _rate;
+	uint32_t _burst;
+	StationRate() : _rate(0), _burst(0) {
+	}
+	StationRate(uint32_t rate, uint32_t burst) : _rate(rate), _burst(burst) {
+	}
+};
+
+typedef HashTable<EtherAddress, StationRate> StationRates;
+
 class TrafficRule {
   public:
 
@@ -210,17 +1113,40 @@ class TrafficRule {
 
 };
 
+// Counters of a traffic rule queue, as copied out by
+// TrafficRuleQueue::counters()
+struct TrafficRuleCounters {
+	uint32_t _transm_pkts;
+	uint32_t _transm_bytes;
+	uint32_t _deficit_used;
+	uint32_t _starvations;
+	uint32_t _codel_drops;
+	uint32_t _drops;
+	uint32_t _max_queue_length;
+};
+
 class TrafficRuleQueue {
 
 public:
 
     AggregationQueues _queues;
-	Vector<EtherPair> _active_list;
+    // taken to add or release a station queue, and by the handlers that
+    // walk _queues, which may run on a ControlSocket handler thread
+    Spinlock _queues_lock;
+	ActiveRing<AggregationQueue> _active_list;
+
+	// active ring links, owned by the EmpowerQOSManager
+	bool _active;
+	TrafficRuleQueue *_active_next;
+	TrafficRuleQueue *_active_prev;
 
 	TrafficRule _tr;
     uint32_t _capacity;
     uint32_t _size;
     uint32_t _drops;
+    uint32_t _codel_drops;
+    // rounds skipped because the next frame did not fit the deficit
+    uint32_t _starvations;
     uint32_t _deficit;
     uint32_t _quantum;
     bool _amsdu_aggregation;
@@ -229,18 +1155,72 @@ public:
     uint32_t _transm_pkts;
     uint32_t _transm_bytes;
     uint32_t _max_queue_length;
-
-	TrafficRuleQueue(TrafficRule tr, uint32_t capacity, uint32_t quantum, bool amsdu_aggregation) :
-			_tr(tr), _capacity(capacity), _size(0), _drops(0), _deficit(0),
+    // frames copied on encapsulation for lack of headroom, see
+    // EmpowerQOSManager::cast()
+    uint32_t _reallocs;
+    // guards the counters written on dequeue, _transm_pkts and
+    // _transm_bytes above all: the stats of the controller take their
+    // difference between two reports
+    SeqLock _tx_seq;
+    bool _lockfree;
+    // set by dequeue() when every station with frames was held back by
+    // its rate cap, the rule then stays active
+    bool _throttled;
+    // frame that did not fit the deficit, sent first next round
+    Packet *_head_pkt;
+    // airtime granted to each station per round
+    int32_t _station_quantum;
+    // flows and AQM of the aggregation queues
+    uint32_t _nb_flows;
+    EmpowerCoDel _codel;
+    // target queueing delay of the aggregation queues, in usecs
+    uint32_t _limit_usecs;
+    // slots of the aggregation queues, see AggregationQueue::make()
+    HashAllocator _slab;
+    // rate caps of the stations, owned by the EmpowerQOSManager
+    const StationRates *_rates;
+    // the EmpowerQOSManager, names the locks of the aggregation queues
+    const Element *_owner;
+    // output of the EmpowerQOSManager serving this rule, and the TID of
+    // its QoS data frames, -1 for plain data frames
+    int _ac;
+    int _tid;
+    // strict priority rule, sent ahead of the DRR within _prio_bucket
+    bool _priority;
+    TokenBucket _prio_bucket;
+    // A-MPDU bursts: a station that starts sending keeps the head of the
+    // ring for up to _burst_frames frames, or _burst_usecs of airtime,
+    // going into debt if its deficit runs out. 0 frames disables them
+    uint32_t _burst_frames;
+    uint32_t _burst_usecs;
+    // frames and airtime of the burst of the station at the head
+    uint32_t _burst_sent;
+    uint32_t _burst_airtime;
+
+	TrafficRuleQueue(TrafficRule tr, uint32_t capacity, uint32_t quantum, bool amsdu_aggregation, bool lockfree = false, uint32_t station_quantum = 1000,
+			uint32_t nb_flows = 1, const EmpowerCoDel &codel = EmpowerCoDel(), uint32_t limit_usecs = 0, bool hugepages = false) :
+			_active(false), _active_next(0), _active_prev(0),
+			_tr(tr), _capacity(capacity), _size(0), _drops(0), _codel_drops(0), _starvations(0), _deficit(0),
 			_quantum(quantum), _amsdu_aggregation(amsdu_aggregation), _max_aggr_length(7935),
-			_deficit_used(0), _transm_pkts(0), _transm_bytes(0), _max_queue_length(0) {
+			_deficit_used(0), _transm_pkts(0), _transm_bytes(0), _max_queue_length(0), _reallocs(0),
+			_lockfree(lockfree), _throttled(false), _head_pkt(0), _station_quantum(station_quantum ? station_quantum : 1),
+			_nb_flows(nb_flows), _codel(codel), _limit_usecs(limit_usecs),
+			_slab(AggregationQueue::slot_size(capacity, lockfree, nb_flows)),
+			_rates(0), _owner(0), _ac(0), _tid(-1), _priority(false), _burst_frames(0), _burst_usecs(0),
+			_burst_sent(0), _burst_airtime(0) {
+		// the indices of an AggregationQueue sit on cache lines of their own
+		_slab.set_alignment(CLICK_CACHE_LINE_SIZE);
+		_slab.set_hugepages(hugepages);
 	}
 
 	~TrafficRuleQueue() {
+		_active_list.clear();
+		if (_head_pkt) {
+			_head_pkt->kill();
+		}
 		AQIter itr = _queues.begin();
 		while (itr != _queues.end()) {
-			AggregationQueue *aq = itr.value();
-			delete aq;
+			AggregationQueue::destroy(_slab, itr.value());
 			itr++;
 		}
 		_queues.clear();
@@ -248,55 +1228,138 @@ public:
 
 	uint32_t size() { return _size; }
 
+	// Consistent copy of the counters, from any thread
+	TrafficRuleCounters counters() const {
+		TrafficRuleCounters c;
+		unsigned seq;
+		do {
+			seq = _tx_seq.read_begin();
+			c._transm_pkts = _transm_pkts;
+			c._transm_bytes = _transm_bytes;
+			c._deficit_used = _deficit_used;
+			c._starvations = _starvations;
+			c._codel_drops = _codel_drops;
+		} while (_tx_seq.read_retry(seq));
+		// written on enqueue, one at a time
+		c._drops = _drops;
+		c._max_queue_length = _max_queue_length;
+		return c;
+	}
+
 	void update_size() {
 		// update size
 		_size++;
 	}
 
-    Packet * wifi_encap(Packet *p, EtherAddress ra, EtherAddress sa, EtherAddress ta) {
-
-        WritablePacket *q = p->uniqueify();
-
-		if (!q) {
-			return 0;
-		}
-
-		uint8_t mode = WIFI_FC1_DIR_FROMDS;
-		uint16_t ethtype;
+    // the 802.11 header takes the place of the ethernet one, a shared
+    // frame is copied anyway
+    inline void count_realloc(const Packet *p, AggregationQueue *queue) {
+    	if (!p->shared() && p->headroom() + sizeof(struct click_ether) < queue->wifi_header().length()) {
+    		_reallocs++;
+    	}
+    }
 
-		memcpy(&ethtype, q->data() + 12, 2);
+    // Bytes taken by p as an A-MSDU subframe: subframe header, LLC/SNAP
+    // header and the Ethernet payload
+    static inline uint32_t amsdu_subframe_length(const Packet *p) {
+    	return sizeof(struct click_wifi_amsdu_subframe_header) + sizeof(struct click_llc)
+    			+ p->length() - sizeof(struct click_ether);
+    }
 
-		q->pull(sizeof(struct click_ether));
-		q = q->push(sizeof(struct click_llc));
+    // Append p to the A-MSDU q as a subframe padded to 4 bytes, q has
+    // the tailroom for it. Kills p.
+    static WritablePacket *amsdu_append(WritablePacket *q, Packet *p) {
 
-		if (!q) {
-			q->kill();
-			return 0;
-		}
+    	uint32_t pad = ((q->length() + 3) & ~3) - q->length();
+    	if (pad) {
+    		q = q->put(pad);
+    		memset(q->end_data() - pad, 0, pad);
+    	}
 
-		memcpy(q->data(), WIFI_LLC_HEADER, WIFI_LLC_HEADER_LEN);
-		memcpy(q->data() + 6, &ethtype, 2);
+    	click_ether *eh = (click_ether *) p->data();
+    	uint32_t payload = p->length() - sizeof(struct click_ether);
+    	uint32_t offset = q->length();
 
-		q = q->push(sizeof(struct click_wifi));
+    	q = q->put(amsdu_subframe_length(p));
 
-		if (!q) {
-			q->kill();
-			return 0;
-		}
+    	uint8_t *ptr = q->data() + offset;
+    	struct click_wifi_amsdu_subframe_header *sh = (struct click_wifi_amsdu_subframe_header *) ptr;
+    	memcpy(sh->da, eh->ether_dhost, 6);
+    	memcpy(sh->sa, eh->ether_shost, 6);
+    	sh->len = htons(sizeof(struct click_llc) + payload);
+    	ptr += sizeof(struct click_wifi_amsdu_subframe_header);
 
-		struct click_wifi *w = (struct click_wifi *) q->data();
+    	memcpy(ptr, WIFI_LLC_HEADER, WIFI_LLC_HEADER_LEN);
+    	memcpy(ptr + 6, &eh->ether_type, 2);
+    	ptr += sizeof(struct click_llc);
 
-		memset(q->data(), 0, sizeof(click_wifi));
+    	memcpy(ptr, p->data() + sizeof(struct click_ether), payload);
 
-		w->i_fc[0] = (uint8_t) (WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_DATA);
-		w->i_fc[1] = 0;
-		w->i_fc[1] |= (uint8_t) (WIFI_FC1_DIR_MASK & mode);
+    	p->kill();
+    	return q;
 
-		memcpy(w->i_addr1, ra.data(), 6);
-		memcpy(w->i_addr2, ta.data(), 6);
-		memcpy(w->i_addr3, sa.data(), 6);
+    }
 
-		return q;
+    // Coalesce p and the consecutive frames waiting in queue into a single
+    // QoS data frame carrying an A-MSDU. Frames are added as long as the
+    // A-MSDU stays within _max_aggr_length and its estimated airtime within
+    // deficit. Falls back to plain encapsulation if nothing can be aggregated.
+    Packet * amsdu_encap(Packet *p, AggregationQueue *queue, Minstrel *rc, uint32_t deficit) {
+
+    	uint32_t hdr_len = sizeof(struct click_wifi) + sizeof(struct click_qos_control);
+    	uint32_t amsdu_len = amsdu_subframe_length(p);
+    	WritablePacket *q = 0;
+
+    	// frames are pulled as the A-MSDU is built, the first one that
+    	// does not fit goes back to the queue
+    	while (Packet *next = queue->pull()) {
+    		_size--;
+    		uint32_t len = ((amsdu_len + 3) & ~3) + amsdu_subframe_length(next);
+    		if (len > _max_aggr_length
+    				|| (rc && rc->estimate_usecs_wifi_length(queue->pair()._ra, hdr_len + len) > deficit)) {
+    			queue->unpull(next);
+    			_size++;
+    			break;
+    		}
+    		if (!q) {
+    			// room for the largest A-MSDU, so that it is never copied
+    			q = Packet::make(Packet::default_headroom + hdr_len, 0, 0, _max_aggr_length);
+    			if (!q) {
+    				queue->unpull(next);
+    				_size++;
+    				break;
+    			}
+    			q->copy_annotations(p);
+    			q = amsdu_append(q, p);
+    		}
+    		q = amsdu_append(q, next);
+    		amsdu_len = len;
+    	}
+
+    	if (!q) {
+    		count_realloc(p, queue);
+    		return queue->wifi_header().encap(p);
+    	}
+
+    	q = q->push(hdr_len);
+
+    	struct click_wifi *w = (struct click_wifi *) q->data();
+
+    	memset(q->data(), 0, hdr_len);
+
+    	w->i_fc[0] = (uint8_t) (WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_DATA | WIFI_FC0_SUBTYPE_QOS);
+    	w->i_fc[1] = (uint8_t) (WIFI_FC1_DIR_MASK & WIFI_FC1_DIR_FROMDS);
+
+    	// with an A-MSDU the source address travels in the subframe
+    	// headers, address 3 is the BSSID
+    	memcpy(w->i_addr1, queue->pair()._ra.data(), 6);
+    	memcpy(w->i_addr2, queue->pair()._ta.data(), 6);
+    	memcpy(w->i_addr3, queue->pair()._ta.data(), 6);
+
+    	struct click_qos_control *qos = (struct click_qos_control *) (q->data() + sizeof(struct click_wifi));
+    	qos->qos_control = cpu_to_le16(WIFI_QOS_CONTROL_AMSDU_PRESENT | (_tid > 0 ? _tid : 0));
+
+    	return q;
 
     }
 
@@ -304,26 +1367,42 @@ public:
 
     	EtherPair pair = EtherPair(ra, ta);
 
-		if (_queues.find(pair) == _queues.end()) {
+		AggregationQueue *queue = _queues.get(pair);
+
+		if (!queue) {
 
 			click_chatter("%s :: creating new aggregation queue for %s",
 					      _tr.unparse().c_str(),
 						  pair.unparse().c_str());
 
-			AggregationQueue *queue = new AggregationQueue(_capacity, pair);
+			queue = AggregationQueue::make(_slab, _capacity, pair, _lockfree, _nb_flows, _codel, _limit_usecs);
+			if (!queue) {
+				_drops++;
+				return false;
+			}
+			queue->set_lock_name(_owner, "aggregation queue");
+			if (_tid >= 0) {
+				queue->set_tid(_tid);
+			}
+			_queues_lock.acquire();
 			_queues.set(pair, queue);
-			_active_list.push_back(pair);
+			_queues_lock.release();
+
+			if (_rates) {
+				const StationRate *rate = _rates->get_pointer(ra);
+				if (rate) {
+					queue->set_rate(rate->_rate, rate->_burst);
+				}
+			}
 
 		}
 
-		AggregationQueue *queue = _queues.get(pair);
 		if (queue->push(p)) {
-			// check if ra is in active list
-			if (find(_active_list.begin(), _active_list.end(), pair) == _active_list.end()) {
-				_active_list.push_back(pair);
-			}
+			queue->_last_active = p->timestamp_anno();
+			// no-op if the queue is already in the active ring
+			_active_list.push_back(queue);
 			if (queue->nb_pkts() > _max_queue_length) {
-				_max_queue_length = _queues.get(pair)->nb_pkts();
+				_max_queue_length = queue->nb_pkts();
 			}
 			return true;
 		}
@@ -333,44 +1412,343 @@ public:
 
     }
 
-    Packet *dequeue() {
+    // Forget the queues of station ra together with the frames they hold.
+    // Returns the number of queues released.
+    uint32_t remove_station(EtherAddress ra) {
+		uint32_t released = 0;
+		AQIter itr = _queues.begin();
+		while (itr != _queues.end()) {
+			if (itr.key()._ra == ra) {
+				itr = release(itr);
+				released++;
+			} else {
+				itr++;
+			}
+		}
+		return released;
+    }
 
-		if (_active_list.empty()) {
-			return 0;
+    // Forget the queues that have been empty for more than timeout.
+    // Returns the number of queues released.
+    uint32_t reclaim(const Timestamp &now, const Timestamp &timeout) {
+		uint32_t released = 0;
+		AQIter itr = _queues.begin();
+		while (itr != _queues.end()) {
+			AggregationQueue *aq = itr.value();
+			if (aq->nb_pkts() == 0 && now - aq->_last_active > timeout) {
+				itr = release(itr);
+				released++;
+			} else {
+				itr++;
+			}
+		}
+		return released;
+    }
+
+    // Take the frames queued for station ra out of its queues, in queue
+    // order, for another WTP. Returns their number.
+    uint32_t steal_station(EtherAddress ra, Vector<Packet *> &frames) {
+		uint32_t stolen = 0;
+		for (AQIter itr = _queues.begin(); itr != _queues.end(); itr++) {
+			if (itr.key()._ra != ra) {
+				continue;
+			}
+			while (Packet *p = itr.value()->steal()) {
+				frames.push_back(p);
+				stolen++;
+			}
+		}
+		_size = (_size > stolen) ? _size - stolen : 0;
+		return stolen;
+    }
+
+    // Apply a rate cap to the queues of station ra
+    void set_station_rate(EtherAddress ra, uint32_t rate, uint32_t burst) {
+		for (AQIter itr = _queues.begin(); itr != _queues.end(); itr++) {
+			if (itr.key()._ra == ra) {
+				itr.value()->set_rate(rate, burst);
+			}
 		}
+    }
 
-		EtherPair pair = _active_list[0];
-		_active_list.pop_front();
+    // True while the station at the head of the ring has a burst to finish
+    bool bursting() const {
+		return _burst_sent && _burst_sent < _burst_frames
+				&& (!_burst_usecs || _burst_airtime < _burst_usecs);
+    }
 
-		AQIter active = _queues.find(pair);
-		AggregationQueue* queue = active.value();
-		Packet *p = queue->pull();
+    // Move on from the station at the head of the ring, ending its burst
+    void advance() {
+		_burst_sent = 0;
+		_burst_airtime = 0;
+		_active_list.advance();
+    }
+
+    // Deficit round robin on airtime across the stations of this rule. A
+    // station is served while it has airtime left, and is charged the
+    // estimated airtime of each frame once it is built. Without a rate
+    // control the frame length stands in for its airtime. Stations held
+    // back by their rate cap are passed over without being granted or
+    // charged airtime; if nothing else is left, _throttled is set.
+    //
+    // With bursts on, a station is served in bursts of back-to-back
+    // frames, which the driver can aggregate in one A-MPDU: the burst
+    // goes on past the end of the deficit, the debt being paid off in the
+    // following rounds, and the station is passed over once it is done.
+    Packet *dequeue(Minstrel *rc = 0, uint32_t deficit = 0) {
+
+		AggregationQueue* queue = 0;
+		Packet *p = 0;
+		Timestamp now = Timestamp::recent();
+		uint32_t dropped = 0;
+		uint32_t throttled = 0;
+
+		_throttled = false;
+
+		while (!_active_list.empty()) {
+			if (throttled == _active_list.size()) {
+				_throttled = true;
+				break;
+			}
+			queue = _active_list.head();
+			if (queue->throttled()) {
+				queue->_throttles++;
+				throttled++;
+				advance();
+				continue;
+			}
+			throttled = 0;
+			if (queue->_airtime_deficit <= 0 && !bursting()) {
+				queue->_airtime_deficit += _station_quantum;
+				queue->_starvations++;
+				advance();
+				continue;
+			}
+			uint32_t segments = queue->gso_segments();
+			p = queue->dequeue(now, dropped);
+			_size += queue->gso_segments() - segments;
+			if (p) {
+				break;
+			}
+			// drained, drop it from the active ring. unused airtime is
+			// not kept but debt is, or a slow station could clear it by
+			// going idle for a moment
+			if (queue->_airtime_deficit > 0) {
+				queue->_airtime_deficit = 0;
+			}
+			_burst_sent = 0;
+			_burst_airtime = 0;
+			_active_list.remove(queue);
+		}
+
+		_size -= dropped;
+		if (dropped) {
+			_tx_seq.write_begin();
+			_codel_drops += dropped;
+			_tx_seq.write_end();
+		}
 
 		if (!p) {
-			return dequeue();
+			return 0;
 		}
 
+		_throttled = false;
+
 		_size--;
 
-		click_ether *eh = (click_ether *) p->data();
-		EtherAddress src = EtherAddress(eh->ether_shost);
-		p = wifi_encap(p, queue->pair()._ra, src, queue->pair()._ta);
+		uint32_t transm_pkts = queue->transm_pkts();
 
-		_active_list.push_back(pair);
+		if (_amsdu_aggregation) {
+			uint32_t segments = queue->gso_segments();
+			p = amsdu_encap(p, queue, rc, deficit);
+			_size += queue->gso_segments() - segments;
+		} else {
+			count_realloc(p, queue);
+			p = queue->wifi_header().encap(p);
+		}
+
+		if (p) {
+			uint32_t usecs = p->length();
+			if (rc) {
+				usecs = rc->estimate_usecs_wifi_length(queue->pair()._ra, p->length());
+				queue->update_limit(usecs, queue->transm_pkts() - transm_pkts);
+			}
+			queue->_airtime_deficit -= usecs;
+			queue->charge(p->length());
+			if (_burst_frames) {
+				_burst_sent++;
+				_burst_airtime += usecs;
+				if (!bursting()) {
+					advance();
+				}
+			}
+		}
 
 		return p;
 
     }
 
+	// Move the frames and the scheduling state of old, a rule of a
+	// hot-swapped EmpowerQOSManager, to this rule. Returns the number of
+	// frames that did not fit.
+	uint32_t take(TrafficRuleQueue *old) {
+		uint32_t lost = 0;
+		for (AQIter itr = old->_queues.begin(); itr != old->_queues.end(); itr++) {
+			AggregationQueue *aq = itr.value();
+			EtherPair pair = aq->pair();
+			while (Packet *p = aq->steal()) {
+				if (enqueue(p, pair._ra, pair._ta)) {
+					_size++;
+				} else {
+					p->kill();
+					lost++;
+				}
+			}
+			AggregationQueue *queue = _queues.get(pair);
+			if (queue) {
+				queue->_airtime_deficit = aq->_airtime_deficit;
+			}
+		}
+		old->_size = 0;
+		// already encapsulated, goes out first as it would have
+		if (!_head_pkt) {
+			_head_pkt = old->_head_pkt;
+			old->_head_pkt = 0;
+		}
+		_deficit = old->_deficit;
+		_quantum = old->_quantum;
+		_amsdu_aggregation = old->_amsdu_aggregation;
+		return lost;
+	}
+
+	AQIter release(AQIter itr) {
+		AggregationQueue *aq = itr.value();
+		if (_active_list.head() == aq) {
+			_burst_sent = 0;
+			_burst_airtime = 0;
+		}
+		_active_list.remove(aq);
+		_size -= aq->nb_pkts();
+		_queues_lock.acquire();
+		AggregationQueue::destroy(_slab, aq);
+		itr = _queues.erase(itr);
+		_queues_lock.release();
+		return itr;
+	}
+
+	// Queued frames are not walked, the consumer may be freeing them:
+	// each one is taken to fill a buffer of a full-sized frame
+	static size_t frame_bytes() {
+		return sizeof(Packet) + Packet::default_headroom + AggregationQueue::FLOW_QUANTUM;
+	}
+
+	// Bytes of the queues of sta, and of the frames they hold
+	size_t station_bytes(EtherAddress sta) {
+		size_t bytes = 0;
+		size_t slot = AggregationQueue::slot_size(_capacity, _lockfree, _nb_flows);
+		for (AQIter itr = _queues.begin(); itr != _queues.end(); itr++) {
+			if (itr.key()._ra == sta) {
+				bytes += slot + itr.value()->nb_pkts() * frame_bytes();
+			}
+		}
+		return bytes;
+	}
+
+	// Same, for all the stations
+	size_t bytes() {
+		size_t slot = AggregationQueue::slot_size(_capacity, _lockfree, _nb_flows);
+		return sizeof(*this) + _queues.size() * slot + _size * frame_bytes();
+	}
+
+	// sojourn times of all the stations of this rule
+	SojournHistogram sojourn() {
+		SojournHistogram result;
+		_queues_lock.acquire();
+		for (AQIter itr = _queues.begin(); itr != _queues.end(); itr++) {
+			result.add(itr.value()->sojourn());
+		}
+		_queues_lock.release();
+		return result;
+	}
+
+	// Capacity, unparse_stats() and the occupancy of each station queue, as
+	// a JSON object
+	void unparse_json(JsonWriter &w) {
+		TrafficRuleCounters c = counters();
+		w.begin_object();
+		w.member("ssid", _tr._ssid);
+		w.member("dscp", _tr._dscp);
+		w.member("capacity", _capacity);
+		w.member("size", _size);
+		w.member("transm_pkts", c._transm_pkts);
+		w.member("transm_bytes", c._transm_bytes);
+		w.member("max_queue_length", c._max_queue_length);
+		w.member("drops", c._drops);
+		w.member("codel_drops", c._codel_drops);
+		w.member("starvations", c._starvations);
+		w.member("deficit_used", c._deficit_used);
+		w.member("reallocs", _reallocs);
+		w.key("sojourn");
+		sojourn().unparse_json(w);
+		w.key("stations").begin_array();
+		_queues_lock.acquire();
+		for (AQIter itr = _queues.begin(); itr != _queues.end(); itr++) {
+			AggregationQueue *aq = itr.value();
+			w.begin_object();
+			w.key("ra").quoted(aq->pair()._ra);
+			w.key("ta").quoted(aq->pair()._ta);
+			w.member("pkts", aq->nb_pkts());
+			w.member("limit", aq->limit());
+			w.member("transm_pkts", aq->transm_pkts());
+			w.member("max_length", aq->max_nb_pkts());
+			w.member("drops", aq->drops());
+			w.member("codel_drops", aq->codel_drops());
+			w.member("starvations", aq->_starvations);
+			if (aq->capped()) {
+				w.member("rate", aq->rate());
+				w.member("throttles", aq->_throttles);
+			}
+			w.key("sojourn");
+			aq->sojourn().unparse_json(w);
+			w.end_object();
+		}
+		_queues_lock.release();
+		w.end_array();
+		w.end_object();
+	}
+
+	String unparse_stats() {
+		StringAccum result;
+		TrafficRuleCounters c = counters();
+		result << _tr.unparse() << " -> pkts: " << c._transm_pkts << " max length: " << c._max_queue_length
+			   << " drops: " << c._drops << " codel drops: " << c._codel_drops
+			   << " starvations: " << c._starvations << " sojourn " << sojourn().unparse() << "\n";
+		_queues_lock.acquire();
+		for (AQIter itr = _queues.begin(); itr != _queues.end(); itr++) {
+			AggregationQueue *aq = itr.value();
+			result << "  " << aq->pair().unparse() << " -> pkts: " << aq->transm_pkts()
+				   << " max length: " << aq->max_nb_pkts() << " drops: " << aq->drops()
+				   << " codel drops: " << aq->codel_drops() << " starvations: " << aq->_starvations;
+			if (aq->capped()) {
+				result << " rate: " << aq->rate() << " throttles: " << aq->_throttles;
+			}
+			result << " sojourn " << aq->sojourn().unparse() << "\n";
+		}
+		_queues_lock.release();
+		return result.take_string();
+	}
+
 	String unparse() {
 		StringAccum result;
 		result << _tr.unparse() << " -> capacity: " << _capacity << "\n";
+		_queues_lock.acquire();
 		AQIter itr = _queues.begin();
 		while (itr != _queues.end()) {
 			AggregationQueue *aq = itr.value();
 			result << "  " << aq->unparse();
 			itr++;
 		}
+		_queues_lock.release();
 		return result.take_string();
 	}
 
@@ -379,8 +1757,46 @@ public:
 typedef HashTable<TrafficRule, TrafficRuleQueue*> TrafficRules;
 typedef TrafficRules::iterator TRIter;
 
-typedef HashTable<TrafficRule, Packet*> HeadTable;
-typedef HeadTable::iterator HItr;
+// How the frames sent to a group go out, see
+// EmpowerQOSManager::refresh_mcast_group(). _copies is the number of UR
+// copies, _airtime the airtime of a full-sized frame under each
+// multicast policy at the last refresh.
+class McastGroup {
+  public:
+
+    Timestamp _refreshed;
+    int _mode;
+    int _copies;
+    int _receivers;
+    uint32_t _airtime[3];
+
+    McastGroup() : _mode(-1), _copies(1), _receivers(0) {
+    	memset(_airtime, 0, sizeof(_airtime));
+    }
+
+};
+
+// The traffic rule queues of a slice (SSID), indexed by DSCP. The DSCP 0
+// rule catches every DSCP value without a dedicated rule.
+class SliceQueues {
+  public:
+
+    enum { NB_DSCPS = 64 };
+
+    String _ssid;
+    int _slice_id;
+    TrafficRuleQueue *_queues[NB_DSCPS];
+
+    SliceQueues(String ssid, int slice_id) : _ssid(ssid), _slice_id(slice_id) {
+    	memset(_queues, 0, sizeof(_queues));
+    }
+
+    inline TrafficRuleQueue *lookup(int dscp) const {
+    	TrafficRuleQueue *trq = _queues[dscp & (NB_DSCPS - 1)];
+    	return trq ? trq : _queues[0];
+    }
+
+};
 
 class EmpowerQOSManager: public Element {
 
@@ -390,44 +1806,163 @@ public:
 	~EmpowerQOSManager();
 
 	const char *class_name() const { return "EmpowerQOSManager"; }
-	const char *port_count() const { return PORTS_1_1; }
+	const char *port_count() const { return "1/1-4"; }
 	const char *processing() const { return PUSH_TO_PULL; }
     void *cast(const char *);
+    void *port_cast(bool, int, const char *);
 
 	int configure(Vector<String> &, ErrorHandler *);
+	int initialize(ErrorHandler *);
+	void take_state(Element *, ErrorHandler *);
+	void run_timer(Timer *);
 
 	void push(int, Packet *);
 	Packet *pull(int);
+	void push_batch(int, Packet *);
+	Packet *pull_batch(int, unsigned);
 
 	void add_handlers();
-	void set_traffic_rule(String, int, uint32_t, bool);
+	void set_traffic_rule(String, int, uint32_t, bool, bool notify = true);
 	void del_traffic_rule(String, int);
+	void remove_station(EtherAddress);
+	void set_station_rate(EtherAddress, uint32_t, uint32_t);
+	void steal_station(EtherAddress, Vector<Packet *> &, Vector<int> &);
+	// bytes of the queues of a station, and of all the queues, see
+	// TrafficRuleQueue::station_bytes()
+	size_t station_bytes(EtherAddress);
+	size_t bytes();
+	void seed(int, int, Packet *, EtherAddress, EtherAddress);
+
+	// one output per access category in AC_PORTS mode, in the order of
+	// the AC_* constants of <clicknet/wifi.h>
+	enum { NB_ACS = AC_COUNT };
 
 	TrafficRules * rules() { return &_rules; }
+	int slice_id(String ssid) { return _slice_ids.get(ssid); }
 	void clear();
 
 private:
 
     enum { SLEEPINESS_TRIGGER = 9 };
-
-    ActiveNotifier _empty_note;
+    // quantum scale, in 1/1024
+    enum { SCALE_ONE = 1024, SCALE_MIN = SCALE_ONE / 8 };
+    // group receivers are looked up again after this long
+    enum { MCAST_REFRESH_MSEC = 100, MCAST_MAX_GROUPS = 256 };
+    // MCAST_AUTO switches policy when it saves 1/MCAST_HYSTERESIS of the airtime
+    enum { MCAST_HYSTERESIS = 4, MCAST_FRAME_LENGTH = 1500 };
+    // weakest receiver RSSI (dBm) for 1 and 2 UR copies
+    enum { UR_RSSI_ONE = -65, UR_RSSI_TWO = -75 };
+
+    // one per output, the first one only unless AC_PORTS
+    ActiveNotifier _empty_notes[NB_ACS];
 	class EmpowerLVAPManager *_el;
+	EmpowerStationCache _stations;
 	class Minstrel * _rc;
 
 	TrafficRules _rules;
-    HeadTable _head_table;
-	Vector<TrafficRule> _active_list;
-
-    int _sleepiness;
+	// taken to add or delete a rule, and by the handlers that walk
+	// _rules, see add_handlers()
+	Spinlock _rules_lock;
+	HashTable<String, int> _slice_ids;
+	Vector<SliceQueues *> _slices;
+	ActiveRing<TrafficRuleQueue> _active_lists[NB_ACS];
+	// priority rules of each output, also in its active ring
+	Vector<TrafficRuleQueue *> _prio_rules[NB_ACS];
+	StationRates _rates;
+	HashTable<EtherAddress, McastGroup> _mcast_groups;
+
+    // empty pulls since the output last woke up
+    int _sleepiness[NB_ACS];
     uint32_t _capacity;
     uint32_t _quantum;
+    uint32_t _station_quantum;
+    uint32_t _station_burst;
+    uint32_t _station_burst_airtime;
+    bool _priority;
+    uint32_t _prio_rate;
+    uint32_t _prio_burst;
+    // frames sent by the priority rules, and their sojourn times
+    uint32_t _prio_pkts;
+    SojournHistogram _prio_sojourn;
+    // tagged frames for a station of another slice, pushed from the
+    // threads of every ingress
+    atomic_uint32_t _slice_drops;
+    // bytes the longest 802.11 header adds to a frame, see cast()
+    unsigned _headroom;
+    uint32_t _nb_flows;
+    Timestamp _codel_target;
+    Timestamp _codel_interval;
+    Timestamp _queue_delay;
+    Timestamp _idle_timeout;
+    Timer _reclaim_timer;
+
+    class EmpowerRegmon *_regmon;
+    Timestamp _adapt_interval;
+    Timer _adapt_timer;
+    uint32_t _scale;
+    uint32_t _ed_busy;
+    uint32_t _tx_busy;
 
     int _iface_id;
+    int _burst;
+    Packet *_batch[NB_ACS];
 
+    bool _ac_ports;
+    bool _lockfree;
+    bool _hugepages;
+    bool _mcast_auto;
     bool _debug;
+    uint8_t _pcp_dscp[8];
+
+    // messages logged per frame, see log_sites
+    enum { LOG_TOO_SMALL, LOG_NOT_AUTHENTICATED, LOG_NOT_ASSOCIATED, NB_LOGS };
+    EmpowerLogLimit _log;
+
+	int frame_dscp(const Packet *) const;
+	void admit(Packet *, const Timestamp &, uint32_t &);
+	void store(int, int, Packet *, EtherAddress, EtherAddress, uint32_t &);
+	void wake_outputs(uint32_t);
+	Packet *dequeue_drr(int);
+	Packet *dequeue_prio(int);
+	void unlist_prio(TrafficRuleQueue *);
+	void adapt_quanta();
+	void refresh_mcast_group(EtherAddress, int, McastGroup *, TxPolicyInfo *);
+
+	// true if a frame with SLICE_ANNO slice may reach the SSID ssid_id
+	static bool in_slice(int slice, int ssid_id) {
+		return !slice || slice == ssid_id + 1;
+	}
+
+	// access category of the frames of a traffic rule, after the DSCP to
+	// user priority mapping of RFC 8325
+	static int dscp_ac(int dscp) {
+		if (dscp == 8) {
+			return AC_BK;
+		} else if (dscp >= 24 && dscp < 44) {
+			return AC_VI;
+		} else if (dscp >= 44) {
+			return AC_VO;
+		}
+		return AC_BE;
+	}
+
+	// EF and CS6, the rules served ahead of the DRR with PRIORITY
+	static bool priority_dscp(int dscp) {
+		return dscp == 46 || dscp == 48;
+	}
 
-	void store(String, int, Packet *, EtherAddress, EtherAddress);
+	// TID, i.e. user priority, the frames of an access category are sent with
+	static int ac_tid(int ac) {
+		static const int tids[NB_ACS] = { 0, 1, 5, 6 };
+		return tids[ac];
+	}
+	uint32_t scaled_quantum(const TrafficRuleQueue *queue) const {
+		uint32_t quantum = ((uint64_t) queue->_quantum * _scale) / SCALE_ONE;
+		return quantum ? quantum : 1;
+	}
 	String list_queues();
+	String list_stats();
+	String list_mcast();
 
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 	static String read_handler(Element *, void *);
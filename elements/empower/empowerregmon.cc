@@ -16,6 +16,10 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/time.h>
 #include <click/config.h>
 #include "empowerregmon.hh"
 #include <click/args.hh>
@@ -27,10 +31,21 @@ CLICK_DECLS
 
 EmpowerRegmon::EmpowerRegmon() :
 		_el(0), _iface_id(0), _elem_period(4000), _reg_period(1000),
-		_timer(this), _debug(false), _register_log_file(0), _last_mac_ticks(0) {
+		_timer(this), _debug(false), _binary(false), _register_log_file(0), _last_mac_ticks(0),
+		_raw_fd(-1), _raw_length(0), _reader_running(false), _stop(false), _dropped(0) {
+	pthread_mutex_init(&_stop_lock, 0);
+	pthread_cond_init(&_stop_cond, 0);
 }
 
 EmpowerRegmon::~EmpowerRegmon() {
+	if (_register_log_file) {
+		fclose(_register_log_file);
+	}
+	if (_raw_fd >= 0) {
+		close(_raw_fd);
+	}
+	pthread_cond_destroy(&_stop_cond);
+	pthread_mutex_destroy(&_stop_lock);
 }
 
 
@@ -66,16 +81,38 @@ int EmpowerRegmon::initialize(ErrorHandler *) {
 	// it is also likely that the read handler reports lines instead of bytes
 	String register_log_file_path = _debugfs + "/register_log";
 	_register_log_file = fopen(register_log_file_path.c_str(), "r");
-	char* buffer[8192];
-	int nread;
 
-	do {
-		nread = fread(&buffer, 1, sizeof buffer, _register_log_file);
-	} while (nread > 0); // fixme, read operation could be slower than kernel measurements writing
+	if (_register_log_file) {
+		char buffer[8192];
+		int nread;
+		do {
+			nread = fread(&buffer, 1, sizeof buffer, _register_log_file);
+		} while (nread > 0); // fixme, read operation could be slower than kernel measurements writing
+	}
+
+	// binary mode keeps the raw log open and reads whole samples from it
+	if (_binary) {
+		String raw_file_path = _debugfs + "/register_log_bin";
+		_raw_fd = open(raw_file_path.c_str(), O_RDONLY | O_NONBLOCK);
+		if (_raw_fd < 0) {
+			click_chatter("%{element} :: %s :: unable to open file %s, falling back to text samples",
+						  this,
+						  __func__,
+						  raw_file_path.c_str());
+		}
+	}
 
 	_timer.initialize(this);
 	_timer.schedule_now();
 
+	if (pthread_create(&_reader, 0, reader_main, this) == 0) {
+		_reader_running = true;
+	} else {
+		click_chatter("%{element} :: %s :: cannot start the reader thread, reading samples from the timer",
+					  this,
+					  __func__);
+	}
+
 	if (_debug) {
 		click_chatter("%{element} :: %s :: iface_id %d initialised",
 					  this,
@@ -86,6 +123,76 @@ int EmpowerRegmon::initialize(ErrorHandler *) {
 	return 0;
 }
 
+void EmpowerRegmon::cleanup(CleanupStage) {
+	if (!_reader_running) {
+		return;
+	}
+	pthread_mutex_lock(&_stop_lock);
+	_stop = true;
+	pthread_cond_signal(&_stop_cond);
+	pthread_mutex_unlock(&_stop_lock);
+	pthread_join(_reader, 0);
+	_reader_running = false;
+}
+
+void *EmpowerRegmon::reader_main(void *arg) {
+
+	EmpowerRegmon *eg = (EmpowerRegmon *) arg;
+
+	// only runs when nothing else wants the CPU
+#ifdef SCHED_IDLE
+	struct sched_param param;
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+	pthread_mutex_lock(&eg->_stop_lock);
+
+	while (!eg->_stop) {
+
+		pthread_mutex_unlock(&eg->_stop_lock);
+		eg->read_samples();
+		pthread_mutex_lock(&eg->_stop_lock);
+
+		struct timeval now;
+		gettimeofday(&now, 0);
+		uint64_t usec = (uint64_t) now.tv_usec + (uint64_t) eg->_elem_period * 1000;
+		struct timespec until;
+		until.tv_sec = now.tv_sec + usec / 1000000;
+		until.tv_nsec = (usec % 1000000) * 1000;
+
+		while (!eg->_stop && pthread_cond_timedwait(&eg->_stop_cond, &eg->_stop_lock, &until) == 0) {
+		}
+
+	}
+
+	pthread_mutex_unlock(&eg->_stop_lock);
+
+	return 0;
+
+}
+
+void EmpowerRegmon::read_samples() {
+
+	Timestamp start = Timestamp::now();
+
+	if (_raw_fd >= 0) {
+		read_raw_samples();
+	} else {
+		read_text_samples();
+	}
+
+	Timestamp delta = Timestamp::now() - start;
+
+	if (delta.msec() > _elem_period) {
+		click_chatter("%{element} :: %s :: processing samples took too much time %s",
+				      this,
+					  __func__,
+					  delta.unparse().c_str());
+	}
+
+}
+
 int EmpowerRegmon::configure(Vector<String> &conf, ErrorHandler *errh) {
 
 	int ret = Args(conf, this, errh)
@@ -94,20 +201,112 @@ int EmpowerRegmon::configure(Vector<String> &conf, ErrorHandler *errh) {
 			  .read("ELEM_PERIOD", _elem_period)
 			  .read("REG_PERIOD", _reg_period)
 			  .read_m("DEBUGFS", _debugfs)
+			  .read("BINARY", _binary)
 			  .read("DEBUG", _debug).complete();
 
 	return ret;
 
 }
 
-void EmpowerRegmon::run_timer(Timer *) {
+// Contiguous run of samples, written so that the compiler can vectorise
+// the loop.
+static inline void scan_samples(const uint32_t *samples, int n, uint32_t &min, uint32_t &max, uint64_t &sum) {
+	uint32_t lo = min, hi = max;
+	uint64_t total = 0;
+	for (int i = 0; i < n; i++) {
+		uint32_t v = samples[i];
+		lo = v < lo ? v : lo;
+		hi = v > hi ? v : hi;
+		total += v;
+	}
+	min = lo;
+	max = hi;
+	sum += total;
+}
 
-	Timestamp start = Timestamp::now();
+static int compare_samples(const void *a, const void *b, void *) {
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+bool RegmonRegister::window(uint32_t usecs, RegmonWindow &w) {
+
+	memset(&w, 0, sizeof(w));
+
+	if (!_nb_samples) {
+		return false;
+	}
+
+	// timestamps only grow, so the window is the tail of the ring
+	int newest = (_index + _size - 1) % _size;
+	uint32_t last = _timestamps[newest];
+	int count = 0;
+	while (count < _nb_samples) {
+		int i = (newest + _size - count) % _size;
+		if (last - _timestamps[i] >= usecs && count) {
+			break;
+		}
+		count++;
+	}
+
+	// at most two contiguous runs, the second one wrapping around
+	int start = (_index + _size - count) % _size;
+	int first = count < _size - start ? count : _size - start;
+
+	uint32_t min = 0xffffffff, max = 0;
+	uint64_t sum = 0;
+	scan_samples(_samples + start, first, min, max, sum);
+	scan_samples(_samples, count - first, min, max, sum);
+
+	memcpy(_scratch, _samples + start, first * sizeof(uint32_t));
+	memcpy(_scratch + first, _samples, (count - first) * sizeof(uint32_t));
+	click_qsort(_scratch, count, sizeof(uint32_t), compare_samples);
+
+	w._count = count;
+	w._min = min;
+	w._max = max;
+	w._mean = sum / count;
+	w._p50 = _scratch[(count - 1) * 50 / 100];
+	w._p90 = _scratch[(count - 1) * 90 / 100];
+	w._p99 = _scratch[(count - 1) * 99 / 100];
+	w._busy = (sum * 10000) / ((uint64_t) count * FULL_SCALE);
+
+	return true;
+
+}
+
+// reader side
+void EmpowerRegmon::produce_sample(uint32_t sec, uint32_t nsec, uint64_t mac_ticks, uint64_t tx, uint64_t rx, uint64_t ed) {
+	struct regmon_raw_sample sample;
+	sample.sec = sec;
+	sample.nsec = nsec;
+	sample.mac_ticks = mac_ticks;
+	sample.tx = tx;
+	sample.rx = rx;
+	sample.ed = ed;
+	if (!_ring.push(sample)) {
+		_dropped++;
+	}
+}
+
+// timer side
+void EmpowerRegmon::add_sample(const struct regmon_raw_sample &sample) {
+	int mac_ticks_delta = sample.mac_ticks - _last_mac_ticks;
+	_last_mac_ticks = sample.mac_ticks;
+	if (mac_ticks_delta < 0) {
+		return;
+	}
+	Timestamp timestamp = Timestamp(sample.sec, sample.nsec);
+	_registers[EMPOWER_REGMON_TX].add_sample(timestamp, sample.tx, mac_ticks_delta);
+	_registers[EMPOWER_REGMON_RX].add_sample(timestamp, sample.rx, mac_ticks_delta);
+	_registers[EMPOWER_REGMON_ED].add_sample(timestamp, sample.ed, mac_ticks_delta);
+}
+
+void EmpowerRegmon::read_text_samples() {
 
 	FILE * fp;
 	char * line = NULL;
 	size_t len = 0;
-	ssize_t read;
 
 	String register_log_file_path = _debugfs + "/register_log";
 	fp = fopen(register_log_file_path.c_str(), "r");
@@ -117,53 +316,76 @@ void EmpowerRegmon::run_timer(Timer *) {
 					  this,
 					  __func__,
 					  register_log_file_path.c_str());
-		_timer.schedule_after_msec(_elem_period);
 		return;
 	}
 
-	while ((read = getline(&line, &len, fp)) != -1) {
-		Vector<String> values;
-		char* token = strtok(line, ",");
-		while (token != NULL) {
-			values.push_back(String(token));
-			token = strtok(NULL, ",");
+	// lines are "sec,nsec,mac_ticks,tx,rx,ed", the last four in hex
+	while (getline(&line, &len, fp) != -1) {
+		char *ptr = line;
+		uint32_t sec = strtoul(ptr, &ptr, 10);
+		uint32_t nsec = strtoul(ptr + (*ptr == ','), &ptr, 10);
+		uint64_t mac_ticks = strtoull(ptr + (*ptr == ','), &ptr, 16);
+		uint64_t tx = strtoull(ptr + (*ptr == ','), &ptr, 16);
+		uint64_t rx = strtoull(ptr + (*ptr == ','), &ptr, 16);
+		uint64_t ed = strtoull(ptr + (*ptr == ','), &ptr, 16);
+		produce_sample(sec, nsec, mac_ticks, tx, rx, ed);
+	}
+
+	free(line);
+	fclose(fp);
+
+}
+
+void EmpowerRegmon::read_raw_samples() {
+
+	while (true) {
+
+		ssize_t nread = read(_raw_fd, _raw_buffer + _raw_length, sizeof(_raw_buffer) - _raw_length);
+
+		if (nread <= 0) {
+			if (nread < 0 && errno != EAGAIN && errno != EINTR) {
+				click_chatter("%{element} :: %s :: read failed: %s",
+							  this,
+							  __func__,
+							  strerror(errno));
+			}
+			return;
 		}
-		uint32_t sec = strtoul(values[0].c_str(), NULL, 10);
-		uint32_t nsec = strtoul(values[1].c_str(), NULL, 10);
-		uint64_t mac_ticks = strtoull(values[2].c_str(), NULL, 16);
-		uint64_t tx = strtoull(values[3].c_str(), NULL, 16);
-		uint64_t rx = strtoull(values[4].c_str(), NULL, 16);
-		uint64_t ed = strtoull(values[5].c_str(), NULL, 16);
-		int mac_ticks_delta = mac_ticks - _last_mac_ticks;
-		_last_mac_ticks = mac_ticks;
-		if (mac_ticks_delta < 0) {
-			continue;
+
+		_raw_length += nread;
+
+		uint32_t offset = 0;
+		while (_raw_length - offset >= sizeof(struct regmon_raw_sample)) {
+			const struct regmon_raw_sample *raw = (const struct regmon_raw_sample *) (_raw_buffer + offset);
+			produce_sample(raw->sec, raw->nsec, raw->mac_ticks, raw->tx, raw->rx, raw->ed);
+			offset += sizeof(struct regmon_raw_sample);
 		}
-		Timestamp timestamp = Timestamp(sec, nsec);
-		_registers[EMPOWER_REGMON_TX].add_sample(timestamp.usecval(), tx, mac_ticks_delta);
-		_registers[EMPOWER_REGMON_RX].add_sample(timestamp.usecval(), rx, mac_ticks_delta);
-		_registers[EMPOWER_REGMON_ED].add_sample(timestamp.usecval(), ed, mac_ticks_delta);
+
+		// keep a partial sample for the next read
+		_raw_length -= offset;
+		memmove(_raw_buffer, _raw_buffer + offset, _raw_length);
+
 	}
 
-	fclose(fp);
+}
 
-	Timestamp delta = Timestamp::now() -start;
+void EmpowerRegmon::run_timer(Timer *) {
 
-	if (delta.msec() > _elem_period) {
-		click_chatter("%{element} :: %s :: processing samples took too much time %s",
-				      this,
-					  __func__,
-					  delta.unparse().c_str());
+	if (!_reader_running) {
+		read_samples();
 	}
 
-	_timer.schedule_after_msec(_elem_period - delta.msec());
-	return;
+	struct regmon_raw_sample sample;
+	while (_ring.pop(sample)) {
+		add_sample(sample);
+	}
+
+	_timer.schedule_after_msec(_elem_period);
 
 }
 
 enum {
 	H_STATUS,
-	H_FULL,
 };
 
 String EmpowerRegmon::read_handler(Element *e, void *thunk) {
@@ -174,15 +396,7 @@ String EmpowerRegmon::read_handler(Element *e, void *thunk) {
 		for (RegistersIter iter = eg->_registers.begin(); iter != eg->_registers.end(); iter++) {
 			sa << iter->unparse() << "\n";
 		}
-		return sa.take_string();
-	}
-	case H_FULL: {
-		for (RegistersIter iter = eg->_registers.begin(); iter != eg->_registers.end(); iter++) {
-			sa << iter->unparse() << "\n";
-			for (int i = 0; i < 100; i++) {
-				sa << iter->_timestamps[i] << " " << iter->_samples[i] << '\n';
-			}
-		}
+		sa << "Dropped=" << eg->_dropped << "\n";
 		return sa.take_string();
 	}
 	default:
@@ -190,10 +404,61 @@ String EmpowerRegmon::read_handler(Element *e, void *thunk) {
 	}
 }
 
+// One register a chunk, the cursor is its index
+int EmpowerRegmon::full_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh) {
+	EmpowerRegmon *eg = (EmpowerRegmon *) e;
+	int cursor = 0;
+	if (s && (!IntArg().parse(s, cursor) || cursor < 0)) {
+		return errh->error("bad cursor");
+	}
+	StringAccum sa;
+	if (cursor < eg->_registers.size()) {
+		RegmonRegister &reg = eg->_registers[cursor];
+		uint32_t timestamps[100], samples[100];
+		int n = reg._size < 100 ? reg._size : 100;
+		reg.copy_samples(timestamps, samples, n);
+		sa << reg.unparse() << "\n";
+		for (int i = 0; i < n; i++) {
+			sa << timestamps[i] << " " << samples[i] << '\n';
+		}
+	}
+	s = sa.take_string();
+	return cursor + 1 < eg->_registers.size() ? cursor + 1 : 0;
+}
+
+int EmpowerRegmon::window_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh) {
+	EmpowerRegmon *eg = (EmpowerRegmon *) e;
+	uint32_t usecs = 100000;
+	if (s && !IntArg().parse(cp_uncomment(s), usecs)) {
+		return errh->error("argument should be a window in usec");
+	}
+	static const char * const names[] = { "tx", "rx", "ed" };
+	StringAccum sa;
+	for (int i = 0; i < eg->_registers.size(); i++) {
+		RegmonWindow w;
+		eg->_registers[i].window(usecs, w);
+		sa << names[eg->_registers[i]._type]
+		   << " count " << w._count
+		   << " min " << w._min
+		   << " max " << w._max
+		   << " mean " << w._mean
+		   << " p50 " << w._p50
+		   << " p90 " << w._p90
+		   << " p99 " << w._p99
+		   << " busy " << w._busy << "\n";
+	}
+	s = sa.take_string();
+	return 0;
+}
+
 void EmpowerRegmon::add_handlers() {
-	add_read_handler("status", read_handler, (void *) H_STATUS);
-	add_read_handler("full", read_handler, (void *) H_FULL);
+	// the registers are copied out under their SeqLock, these can run
+	// off the router thread, see ControlSocket's HANDLER_THREAD
+	add_read_handler("status", read_handler, (void *) H_STATUS, Handler::h_nonexclusive);
+	set_handler("full", Handler::f_read | Handler::f_read_chunked | Handler::h_nonexclusive, full_handler);
+	set_handler("window", Handler::f_read | Handler::f_read_param, window_handler);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(EmpowerRegmon)
+ELEMENT_REQUIRES(userlevel Rollup)
@@ -5,20 +5,39 @@
 #include <click/timer.hh>
 #include <click/vector.hh>
 #include <click/straccum.hh>
+#include <click/sync.hh>
 #include <unistd.h>
+#include <pthread.h>
 #include "empowerlvapmanager.hh"
+#include "rollup.hh"
 CLICK_DECLS
 
+// Aggregates of the samples of a register over a time window
+struct RegmonWindow {
+	uint32_t _count;
+	uint32_t _min;
+	uint32_t _max;
+	uint32_t _mean;
+	uint32_t _p50;
+	uint32_t _p90;
+	uint32_t _p99;
+	uint32_t _busy; // mean over FULL_SCALE, in 1/10000
+};
 
 class RegmonRegister {
 public:
 
+	// a sample is the busy share of the elapsed MAC ticks, scaled to this
+	enum { FULL_SCALE = 18000 };
+
 	RegmonRegister(empower_regmon_types type, int iface_id, uint32_t size) {
 		_type = type;
 		_iface_id = iface_id;
 		_size = size;
 		_samples = new uint32_t[size]();
 		_timestamps = new uint32_t[size]();
+		_scratch = new uint32_t[size]();
+		_nb_samples = 0;
 		_index = 0;
 		_last_value = 0;
 		_skipped = 0;
@@ -28,15 +47,18 @@ public:
 		memset(_samples, 0, _size);
 	}
 
-	void add_sample(uint32_t timestamp, uint32_t value, uint32_t mac_ticks_delta) {
+	void add_sample(const Timestamp &timestamp, uint32_t value, uint32_t mac_ticks_delta) {
+
+		_seq.write_begin();
 
 		if (_first_run) {
 			_first_run = false;
 			_samples[_index] = 0;
-			_timestamps[_index] = timestamp;
+			_timestamps[_index] = timestamp.usecval();
 		} else {
 			_samples[_index] = ((value - _last_value) * 18000) / mac_ticks_delta;
-			_timestamps[_index] = timestamp;
+			_timestamps[_index] = timestamp.usecval();
+			_rollup.add(timestamp.msecval(), _samples[_index]);
 		}
 
 		_last_value = value;
@@ -50,11 +72,41 @@ public:
 		_index++;
 		_index %= _size;
 
+		if (_nb_samples < _size) {
+			_nb_samples++;
+		}
+
+		_seq.write_end();
+
+	}
+
+	// Copy the first n samples and their timestamps out, from any thread
+	void copy_samples(uint32_t *timestamps, uint32_t *samples, int n) const {
+		unsigned seq;
+		do {
+			seq = _seq.read_begin();
+			memcpy(timestamps, _timestamps, n * sizeof(uint32_t));
+			memcpy(samples, _samples, n * sizeof(uint32_t));
+		} while (_seq.read_retry(seq));
 	}
 
+	// Aggregate the samples taken in the usecs before the last one,
+	// false if there is none
+	bool window(uint32_t usecs, RegmonWindow &w);
+
 	String unparse() {
 
 		StringAccum sa;
+		int index, skipped;
+		uint32_t min_value, max_value;
+		unsigned seq;
+		do {
+			seq = _seq.read_begin();
+			index = _index;
+			skipped = _skipped;
+			min_value = _min_value;
+			max_value = _max_value;
+		} while (_seq.read_retry(seq));
 
 		if (_type == EMPOWER_REGMON_TX) {
 			sa << "Register=tx\t";
@@ -66,10 +118,10 @@ public:
 
 		sa << "Id=" << _iface_id << "\t";
 		sa << "Size=" << _size << "\t";
-		sa << "Index=" << _index << "\t";
-		sa << "Skipped=" << _skipped << "\t";
-		sa << "MinValue=" << _min_value << "\t\t";
-		sa << "MaxValue=" << _max_value;
+		sa << "Index=" << index << "\t";
+		sa << "Skipped=" << skipped << "\t";
+		sa << "MinValue=" << min_value << "\t\t";
+		sa << "MaxValue=" << max_value;
 
 		return sa.take_string();
 
@@ -81,11 +133,78 @@ public:
 	uint32_t *_samples;
 	uint32_t *_timestamps;
 	int _index;
+	int _nb_samples;
+	uint32_t *_scratch; // percentiles are taken on a sorted copy
 	uint32_t _last_value;
 	int _skipped;
 	uint32_t _min_value;
 	uint32_t _max_value;
 	bool _first_run;
+	// minutes of history past the raw ring, in the clock of the samples
+	Rollup<60> _rollup;
+	// add_sample() runs on the router thread, the status and full
+	// handlers may not
+	SeqLock _seq;
+
+};
+
+// Raw sample as exported by the register_log_bin debugfs file when the
+// element runs with BINARY true. The file comes from the same regmon
+// patch of the ath9k driver as register_log, and holds one packed record
+// per sample with the six fields of a register_log line, in the same
+// order: the kernel time of the sample, the MAC clock ticks and the TX
+// busy, RX busy and energy detect busy counters, all in host byte order.
+// read_samples() relies on this layout, it must follow the driver's.
+struct regmon_raw_sample {
+	uint32_t sec;
+	uint32_t nsec;
+	uint64_t mac_ticks;
+	uint64_t tx;
+	uint64_t rx;
+	uint64_t ed;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+// Samples read by the reader thread of EmpowerRegmon, waiting for its
+// timer. Single producer, single consumer, no locks.
+class RegmonSampleRing {
+public:
+
+	enum { SIZE = 1024 }; // a power of two
+
+	RegmonSampleRing() : _head(0), _tail(0) {
+	}
+
+	// false if full, the sample is then dropped
+	bool push(const struct regmon_raw_sample &sample) {
+		uint32_t head = _head;
+		if (head - _tail == SIZE) {
+			return false;
+		}
+		_ring[head & (SIZE - 1)] = sample;
+		click_write_fence();
+		_head = head + 1;
+		return true;
+	}
+
+	bool pop(struct regmon_raw_sample &sample) {
+		uint32_t tail = _tail;
+		if (tail == _head) {
+			return false;
+		}
+		click_read_fence();
+		sample = _ring[tail & (SIZE - 1)];
+		// the slot must be read before the producer can reuse it
+		click_fence();
+		_tail = tail + 1;
+		return true;
+	}
+
+private:
+
+	struct regmon_raw_sample _ring[SIZE];
+	volatile uint32_t _head;
+	char _pad[CLICK_CACHE_LINE_SIZE];
+	volatile uint32_t _tail;
 
 };
 
@@ -103,8 +222,12 @@ public:
 	int configure(Vector<String> &, ErrorHandler *);
 	void add_handlers();
 	int initialize(ErrorHandler *);
+	void cleanup(CleanupStage);
 	void run_timer(Timer *);
 	RegmonRegister * registers(int i) { return &_registers.at(i); }
+	bool window(empower_regmon_types type, uint32_t usecs, RegmonWindow &w) {
+		return _registers.at(type).window(usecs, w);
+	}
 
 private:
 
@@ -116,16 +239,41 @@ private:
 	Timer _timer;
 
 	bool _debug;
+	bool _binary;
 
 	String _debugfs;
 
 	FILE *_register_log_file;
 	uint32_t _last_mac_ticks;
 
+	// binary mode, persistent descriptor and leftover of a partial sample
+	int _raw_fd;
+	uint8_t _raw_buffer[64 * sizeof(struct regmon_raw_sample)];
+	uint32_t _raw_length;
+
+	// debugfs is read by a thread of its own, which never holds up the
+	// Click threads, and samples reach the registers through _ring
+	pthread_t _reader;
+	bool _reader_running;
+	volatile bool _stop;
+	pthread_mutex_t _stop_lock;
+	pthread_cond_t _stop_cond;
+	RegmonSampleRing _ring;
+	uint32_t _dropped;
+
+	static void *reader_main(void *);
+	void read_samples();
+	void produce_sample(uint32_t, uint32_t, uint64_t, uint64_t, uint64_t, uint64_t);
+	void add_sample(const struct regmon_raw_sample &);
+	void read_text_samples();
+	void read_raw_samples();
+
 	Registers _registers;
 
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 	static String read_handler(Element *, void *);
+	static int window_handler(int, String &, Element *, const Handler *, ErrorHandler *);
+	static int full_handler(int, String &, Element *, const Handler *, ErrorHandler *);
 
 };
 
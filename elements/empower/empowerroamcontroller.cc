@@ -0,0 +1,622 @@
+/*
+ * empowerroamcontroller.{cc,hh} -- scripted controller moving LVAPs between WTPs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerroamcontroller.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/handlercall.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include "empowerlvapmanager.hh"
+#include "empowermessage.hh"
+CLICK_DECLS
+
+EmpowerRoamController::EmpowerRoamController() :
+	_iface_id(0), _nb_lvaps(64), _ssid("roam"), _period(1000), _nb_handovers(1),
+	_limit(-1), _stop(false), _downlink_rate(0), _length(200), _active(true), _task(this), _timer(this),
+	_fresh_head(0), _next_sta(0), _next_dl(0), _seq(0), _next_module_id(0),
+	_installed(false), _start_cycles(0) {
+}
+
+EmpowerRoamController::~EmpowerRoamController() {
+}
+
+int EmpowerRoamController::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	String els;
+	uint32_t downlink_rate = 0;
+
+	if (Args(conf, this, errh)
+			.read_mp("ELS", els)
+			.read("IFACE_ID", _iface_id)
+			.read("LVAPS", _nb_lvaps)
+			.read("SSID", _ssid)
+			.read("PERIOD", _period)
+			.read("HANDOVERS", _nb_handovers)
+			.read("LIMIT", _limit)
+			.read("STOP", _stop)
+			.read("DOWNLINK_RATE", downlink_rate)
+			.read("LENGTH", _length)
+			.read("ACTIVE", _active)
+			.complete() < 0) {
+		return -1;
+	}
+
+	Vector<String> tokens;
+	cp_spacevec(els, tokens);
+
+	for (int i = 0; i < tokens.size(); i++) {
+		EmpowerLVAPManager *el;
+		if (!ElementCastArg("EmpowerLVAPManager").parse(tokens[i], el, ArgContext(this, errh))) {
+			return errh->error("error param %s: must be an EmpowerLVAPManager element", tokens[i].c_str());
+		}
+		_els.push_back(el);
+	}
+
+	if (_els.size() < 2) {
+		return errh->error("ELS must list at least two WTPs");
+	}
+
+	if (ninputs() != _els.size()) {
+		return errh->error("%d WTPs, but %d inputs", _els.size(), ninputs());
+	}
+
+	if (noutputs() != _els.size() && noutputs() != _els.size() + 1) {
+		return errh->error("%d WTPs, but %d outputs", _els.size(), noutputs());
+	}
+
+	if (_nb_lvaps < 1 || _nb_lvaps > 0xFFFFFF) {
+		return errh->error("LVAPS must be between 1 and %d", 0xFFFFFF);
+	}
+
+	if (_period < 1) {
+		return errh->error("PERIOD must be positive");
+	}
+
+	if (_nb_handovers < 0) {
+		return errh->error("HANDOVERS must not be negative");
+	}
+
+	if (_length < sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp) || _length > 1514) {
+		return errh->error("LENGTH must be between %d and 1514",
+				   (int) (sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp)));
+	}
+
+	if (downlink_rate && noutputs() == _els.size()) {
+		errh->warning("DOWNLINK_RATE given, but no downlink output");
+		downlink_rate = 0;
+	}
+
+	_rate.set_rate(downlink_rate, errh);
+	_downlink_rate = downlink_rate;
+
+	return 0;
+
+}
+
+int EmpowerRoamController::initialize(ErrorHandler *errh) {
+
+	for (int w = 0; w < _els.size(); w++) {
+		if (!_els[w]->iface_to_element(_iface_id)) {
+			return errh->error("%s has no interface %d", _els[w]->name().c_str(), _iface_id);
+		}
+	}
+
+	_sent.resize(_els.size());
+	_received.resize(_els.size());
+	reset();
+
+	for (int i = 0; i < _nb_lvaps; i++) {
+		Station s;
+		s._sta = make_address(0x00, i);
+		s._wtp = -1;
+		s._target = i % _els.size();
+		s._state = S_IDLE;
+		s._module_id = 0;
+		_stations.push_back(s);
+	}
+
+	// the elements of a WTP share the prefix of its LVAP manager
+	for (int w = 0; w < _els.size(); w++) {
+		String name = _els[w]->name();
+		int slash = name.find_right('/');
+		if (slash < 0) {
+			errh->warning("%s is not in a compound element, its CPU time is not reported", name.c_str());
+			continue;
+		}
+		String prefix = name.substring(0, slash + 1);
+		for (int i = 0; i < router()->nelements(); i++) {
+			Element *e = router()->element(i);
+			if (e->name().starts_with(prefix)) {
+				Stage s;
+				s.e = e;
+				s.wtp = w;
+				s.packets = s.cycles = 0;
+				_stages.push_back(s);
+			}
+		}
+	}
+
+	// every downlink frame is this template with its own destination
+	memset(_template, 0, sizeof(_template));
+	click_ether *eh = (click_ether *) _template;
+	memcpy(eh->ether_shost, make_address(0xFF, 0).data(), 6);
+	eh->ether_type = htons(ETHERTYPE_IP);
+	click_ip *ip = (click_ip *) (eh + 1);
+	ip->ip_v = 4;
+	ip->ip_hl = sizeof(click_ip) >> 2;
+	ip->ip_len = htons(_length - sizeof(click_ether));
+	ip->ip_ttl = 64;
+	ip->ip_p = IP_PROTO_UDP;
+	ip->ip_src.s_addr = htonl(0x0A000001);
+	ip->ip_dst.s_addr = htonl(0x0A000002);
+	ip->ip_sum = click_in_cksum((const unsigned char *) ip, sizeof(click_ip));
+	click_udp *udp = (click_udp *) (ip + 1);
+	udp->uh_sport = htons(1024);
+	udp->uh_dport = htons(5001);
+	udp->uh_ulen = htons(_length - sizeof(click_ether) - sizeof(click_ip));
+
+	_timer.initialize(this);
+	ScheduleInfo::initialize_task(this, &_task, _active, errh);
+	return 0;
+
+}
+
+EtherAddress EmpowerRoamController::make_address(uint8_t kind, uint32_t i) {
+	uint8_t data[6] = { 0x02, kind, 0x00, (uint8_t) (i >> 16), (uint8_t) (i >> 8), (uint8_t) i };
+	return EtherAddress(data);
+}
+
+int EmpowerRoamController::station_index(EtherAddress sta) const {
+	const uint8_t *data = sta.data();
+	if (data[0] != 0x02 || data[1] != 0x00 || data[2] != 0x00) {
+		return -1;
+	}
+	int i = (data[3] << 16) | (data[4] << 8) | data[5];
+	return i < _nb_lvaps ? i : -1;
+}
+
+void EmpowerRoamController::send(int wtp, Packet *p) {
+	_sent[wtp]._messages++;
+	_sent[wtp]._bytes += p->length();
+	_types_sent[((empower_header *) p->data())->type()]++;
+	output(wtp).push(p);
+}
+
+// The WTP may answer before send() returns, so the station is updated
+// before the message leaves, in this and in send_del_lvap()
+void EmpowerRoamController::send_add_lvap(int i) {
+
+	Station &s = _stations[i];
+	ResourceElement *re = _els[s._target]->iface_to_element(_iface_id);
+
+	EmpowerMessage msg;
+	// the LVAP ssid followed by the list of its ssids
+	empower_add_lvap *add = msg.start<empower_add_lvap>(EMPOWER_PT_ADD_LVAP, _seq++, 2 * (_ssid.length() + 1));
+	if (!add) {
+		return;
+	}
+
+	s._module_id = ++_next_module_id;
+	s._state = S_ADDING;
+	s._sent = Timestamp::now_steady();
+
+	add->set_module_id(s._module_id);
+	add->set_flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
+	add->set_flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
+	add->set_flag(EMPOWER_STATUS_LVAP_SET_MASK);
+	add->set_assoc_id(i & 0x7FF);
+	add->set_hwaddr(re->_hwaddr);
+	add->set_channel(re->_channel);
+	add->set_band(re->_band);
+	add->set_supported_band(re->_band);
+	add->set_sta(s._sta);
+	add->set_net_bssid(make_address(0x01, i));
+	add->set_lvap_bssid(make_address(0x01, i));
+	uint8_t *ptr = (uint8_t *) (add + 1);
+	for (int e = 0; e < 2; e++) {
+		ssid_entry *entry = (ssid_entry *) ptr;
+		entry->set_length(_ssid.length());
+		entry->set_ssid(_ssid);
+		ptr += _ssid.length() + 1;
+	}
+
+	send(s._target, msg.finish());
+
+}
+
+// No target block is given, the LVAP leaves without a CSA
+void EmpowerRoamController::send_del_lvap(int i) {
+
+	Station &s = _stations[i];
+
+	EmpowerMessage msg;
+	empower_del_lvap *del = msg.start<empower_del_lvap>(EMPOWER_PT_DEL_LVAP, _seq++);
+	if (!del) {
+		return;
+	}
+
+	s._module_id = ++_next_module_id;
+	s._state = S_DELETING;
+	s._sent = Timestamp::now_steady();
+
+	del->set_module_id(s._module_id);
+	del->set_sta(s._sta);
+
+	send(s._wtp, msg.finish());
+
+}
+
+void EmpowerRoamController::handle_response(int wtp, uint8_t type, Packet *p, uint32_t offset) {
+
+	empower_add_del_lvap_response *resp = (empower_add_del_lvap_response *) (p->data() + offset);
+	int i = station_index(resp->sta());
+
+	if (i < 0) {
+		return;
+	}
+
+	Station &s = _stations[i];
+
+	// a late answer to an earlier request
+	if (resp->module_id() != s._module_id || s._state == S_IDLE) {
+		return;
+	}
+
+	Timestamp now = Timestamp::now_steady();
+	uint32_t usecs = (now - s._sent).usecval();
+
+	if (type == EMPOWER_PT_DEL_LVAP_RESPONSE && s._state == S_DELETING && wtp == s._wtp) {
+		if (resp->status()) {
+			_refused++;
+			s._target = -1;
+			s._state = S_IDLE;
+			return;
+		}
+		_del_lvap.add(usecs);
+		s._wtp = -1;
+		send_add_lvap(i);
+		return;
+	}
+
+	if (type == EMPOWER_PT_ADD_LVAP_RESPONSE && s._state == S_ADDING && wtp == s._target) {
+		s._target = -1;
+		s._state = S_IDLE;
+		if (resp->status()) {
+			_refused++;
+			return;
+		}
+		_add_lvap.add(usecs);
+		s._wtp = wtp;
+		if (!s._start) {
+			_joined++;
+			return;
+		}
+		_handover.add((now - s._start).usecval());
+		_completed++;
+		if (_downlink_rate) {
+			_fresh.push_back(i);
+		}
+		if (_stop && _limit >= 0 && _completed >= (uint32_t) _limit) {
+			router()->please_stop_driver();
+		}
+	}
+
+}
+
+void EmpowerRoamController::push(int port, Packet *p) {
+
+	// a packet may hold several messages, see EmpowerLVAPManager::send_message()
+	uint32_t offset = 0;
+
+	while (offset + sizeof(empower_header) <= p->length()) {
+
+		empower_header *hdr = (empower_header *) (p->data() + offset);
+		uint32_t len = hdr->length();
+
+		if (len < sizeof(empower_header) || offset + len > p->length()) {
+			break;
+		}
+
+		_received[port]._messages++;
+		_received[port]._bytes += len;
+		_types_received[hdr->type()]++;
+
+		if ((hdr->type() == EMPOWER_PT_ADD_LVAP_RESPONSE || hdr->type() == EMPOWER_PT_DEL_LVAP_RESPONSE)
+				&& len >= sizeof(empower_add_del_lvap_response)) {
+			handle_response(port, hdr->type(), p, offset);
+		}
+
+		offset += len;
+
+	}
+
+	p->kill();
+
+}
+
+Packet *EmpowerRoamController::make_packet() {
+
+	int i;
+	if (_fresh_head < _fresh.size()) {
+		i = _fresh[_fresh_head++];
+		if (_fresh_head == _fresh.size()) {
+			_fresh.clear();
+			_fresh_head = 0;
+		}
+	} else {
+		i = _next_dl;
+		if (++_next_dl == _nb_lvaps) {
+			_next_dl = 0;
+		}
+	}
+
+	WritablePacket *p = Packet::make(Packet::default_headroom, 0, _length, 0);
+	if (!p) {
+		return 0;
+	}
+
+	uint32_t hlen = sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp);
+	memcpy(p->data(), _template, hlen);
+	memset(p->data() + hlen, 0, _length - hlen);
+
+	click_ether *eh = (click_ether *) p->data();
+	memcpy(eh->ether_dhost, _stations[i]._sta.data(), 6);
+
+	return p;
+
+}
+
+void EmpowerRoamController::start() {
+
+#if HAVE_CYCLE_ACCOUNTING
+	HandlerCall::call_write("cycle_accounting", "true", this);
+#endif
+
+	reset();
+
+	for (int i = 0; i < _nb_lvaps; i++) {
+		send_add_lvap(i);
+	}
+
+	_timer.schedule_after_msec(_period);
+
+}
+
+void EmpowerRoamController::reset() {
+
+	_started = _completed = _joined = _refused = 0;
+	_downlink = 0;
+	_handover.clear();
+	_del_lvap.clear();
+	_add_lvap.clear();
+	for (int w = 0; w < _sent.size(); w++) {
+		_sent[w]._messages = _sent[w]._bytes = 0;
+		_received[w]._messages = _received[w]._bytes = 0;
+	}
+	memset(_types_sent, 0, sizeof(_types_sent));
+	memset(_types_received, 0, sizeof(_types_received));
+
+#if HAVE_CYCLE_ACCOUNTING
+	for (int i = 0; i < _stages.size(); i++) {
+		_stages[i].e->cycle_totals(_stages[i].packets, _stages[i].cycles);
+	}
+#endif
+
+	_start = Timestamp::now_steady();
+	_start_cycles = click_get_cycles();
+
+}
+
+bool EmpowerRoamController::run_task(Task *) {
+
+	if (!_active) {
+		return false;
+	}
+
+	if (!_installed) {
+		_installed = true;
+		start();
+	}
+
+	if (!_downlink_rate) {
+		return false;
+	}
+
+	Timestamp now = Timestamp::now();
+	int n = 0;
+
+	while (n < BURST && _rate.need_update(now)) {
+		_rate.update();
+		if (Packet *p = make_packet()) {
+			_downlink++;
+			n++;
+			output(_els.size()).push(p);
+		}
+	}
+
+	_task.fast_reschedule();
+	return n > 0;
+
+}
+
+void EmpowerRoamController::run_timer(Timer *) {
+
+	if (!_active) {
+		return;
+	}
+
+	for (int h = 0; h < _nb_handovers; h++) {
+
+		if (_limit >= 0 && _started >= (uint32_t) _limit) {
+			break;
+		}
+
+		// the next station that is not moving already
+		int i = -1;
+		for (int k = 0; k < _nb_lvaps; k++) {
+			int j = _next_sta;
+			if (++_next_sta == _nb_lvaps) {
+				_next_sta = 0;
+			}
+			if (_stations[j]._state == S_IDLE && _stations[j]._wtp >= 0) {
+				i = j;
+				break;
+			}
+		}
+
+		if (i < 0) {
+			break;
+		}
+
+		Station &s = _stations[i];
+		s._target = (s._wtp + 1) % _els.size();
+		s._start = Timestamp::now_steady();
+		_started++;
+		send_del_lvap(i);
+
+	}
+
+	_timer.reschedule_after_msec(_period);
+
+}
+
+enum {
+	H_HANDOVERS,
+	H_MESSAGES,
+	H_CPU,
+	H_REPORT,
+	H_ACTIVE,
+	H_RESET
+};
+
+static void unparse_histogram(StringAccum &sa, const char *name, const LatencyHistogram &h) {
+	sa << name
+	   << " count " << h._count
+	   << " mean " << h.mean()
+	   << " p50 " << h.percentile(50)
+	   << " p90 " << h.percentile(90)
+	   << " p99 " << h.percentile(99)
+	   << " max " << h._max << "\n";
+}
+
+String EmpowerRoamController::report(int what) {
+
+	StringAccum sa;
+
+	if (what == H_HANDOVERS || what == H_REPORT) {
+		sa << "started " << _started << " completed " << _completed
+		   << " pending " << (_started - _completed) << " joined " << _joined
+		   << " refused " << _refused << " downlink " << _downlink << "\n";
+		unparse_histogram(sa, "handover", _handover);
+		unparse_histogram(sa, "del_lvap", _del_lvap);
+		unparse_histogram(sa, "add_lvap", _add_lvap);
+	}
+
+	if (what == H_MESSAGES || what == H_REPORT) {
+		for (int w = 0; w < _els.size(); w++) {
+			sa << _els[w]->name()
+			   << " sent " << _sent[w]._messages << ' ' << _sent[w]._bytes
+			   << " received " << _received[w]._messages << ' ' << _received[w]._bytes << "\n";
+		}
+		for (int t = 0; t < 256; t++) {
+			if (_types_sent[t] || _types_received[t]) {
+				sa.snprintf(8, "0x%02x", t);
+				sa << " sent " << _types_sent[t] << " received " << _types_received[t] << "\n";
+			}
+		}
+	}
+
+#if HAVE_CYCLE_ACCOUNTING
+	if (what == H_CPU || what == H_REPORT) {
+		// cycles are converted with the rate measured since the start
+		uint64_t nsec = (Timestamp::now_steady() - _start).nsecval();
+		click_cycles_t cycles = click_get_cycles() - _start_cycles;
+		for (int w = 0; w < _els.size(); w++) {
+			double total = 0;
+			for (int i = 0; i < _stages.size(); i++) {
+				const Stage &s = _stages[i];
+				uint64_t packets;
+				click_cycles_t own;
+				if (s.wtp != w || !s.e->cycle_totals(packets, own)) {
+					continue;
+				}
+				double usecs = cycles ? (double) (own - s.cycles) * nsec / cycles / 1000 : 0;
+				total += usecs;
+				sa << s.e->name() << ' ' << (packets - s.packets) << ' ';
+				sa.snprintf(32, "%.1f", usecs);
+				sa << "\n";
+			}
+			sa << _els[w]->name() << " total ";
+			sa.snprintf(32, "%.1f", total);
+			sa << "\n";
+		}
+	}
+#endif
+
+	return sa.take_string();
+
+}
+
+String EmpowerRoamController::read_handler(Element *e, void *thunk) {
+	EmpowerRoamController *c = (EmpowerRoamController *) e;
+	if ((uintptr_t) thunk == H_ACTIVE) {
+		return String(c->_active) + "\n";
+	}
+	return c->report((uintptr_t) thunk);
+}
+
+int EmpowerRoamController::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerRoamController *c = (EmpowerRoamController *) e;
+	switch ((uintptr_t) thunk) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(cp_uncomment(in_s), active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		c->_active = active;
+		if (active && !c->_task.scheduled()) {
+			c->_task.reschedule();
+		}
+		if (active && c->_installed && !c->_timer.scheduled()) {
+			c->_timer.schedule_after_msec(c->_period);
+		}
+		break;
+	}
+	case H_RESET:
+		c->reset();
+		break;
+	}
+	return 0;
+}
+
+void EmpowerRoamController::add_handlers() {
+	add_read_handler("handovers", read_handler, (void *) H_HANDOVERS);
+	add_read_handler("messages", read_handler, (void *) H_MESSAGES);
+	add_read_handler("cpu", read_handler, (void *) H_CPU);
+	add_read_handler("report", read_handler, (void *) H_REPORT);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE, Handler::f_checkbox);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::f_button);
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerRoamController)
+ELEMENT_REQUIRES(userlevel EmpowerLVAPManager)
@@ -0,0 +1,225 @@
+#ifndef CLICK_EMPOWERROAMCONTROLLER_HH
+#define CLICK_EMPOWERROAMCONTROLLER_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+#include <click/gaprate.hh>
+#include <click/timestamp.hh>
+#include <click/etheraddress.hh>
+#include "latencyhistogram.hh"
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerRoamController(ELS[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Plays a scripted Access Controller moving LVAPs between WTPs
+
+=d
+
+Stands in for the Access Controller of several WTPs loaded in the same
+router, so that handovers can be studied at scale without a controller
+or radios. ELS lists the EmpowerLVAPManager of every WTP; input I and
+output I carry the messages from and to the I-th of them.
+
+When the router starts, EmpowerRoamController adds LVAPS authenticated
+and associated LVAPs on interface IFACE_ID of the WTPs, for stations
+02:00:00:00:00:00, 02:00:00:00:00:01 and so on, station I on WTP I
+modulo the number of WTPs. Those are the addresses EmpowerMockRadio gives
+the stations it models. Every PERIOD, it then moves HANDOVERS stations,
+round robin, each to the WTP after the one hosting it: a DEL_LVAP goes to
+the WTP hosting the station, and the ADD_LVAP to the next one once the
+first answers. The handover is over when the new WTP answers the
+ADD_LVAP. No station is moved again before its handover is over.
+
+If there is an output past those of the WTPs, IPv4 UDP frames of LENGTH
+bytes are pushed out of it, DOWNLINK_RATE per second, to the stations
+round robin, except that the stations just handed over are served first.
+It is meant to feed the EmpowerTee of every WTP, so that the LVAP
+timelines of the WTPs see the first downlink frames after a handover.
+
+Every message received from a WTP is counted, by WTP and by type, as is
+every message sent. The time every element of a WTP takes is measured
+with cycle accounting, which is turned on when the router starts; the
+elements of a WTP are those whose name starts with the compound element
+prefix of its EmpowerLVAPManager, so every WTP should be a compound
+element of its own. See elements/empower/samples/roaming.click.
+
+Keyword arguments are:
+
+=over 8
+
+=item ELS
+Space separated list of EmpowerLVAPManager elements, one per WTP.
+
+=item IFACE_ID
+Interface the LVAPs are added to on every WTP. Default is 0.
+
+=item LVAPS
+Number of stations. Default is 64.
+
+=item SSID
+SSID of the LVAPs. Default is "roam".
+
+=item PERIOD
+Milliseconds between rounds of handovers. Default is 1000.
+
+=item HANDOVERS
+Handovers started every round. Default is 1.
+
+=item LIMIT
+Number of handovers to run, -1 means no limit. Default is -1.
+
+=item STOP
+Stop the driver once LIMIT handovers are over. Default is false.
+
+=item DOWNLINK_RATE
+Downlink frames per second. Default is 0.
+
+=item LENGTH
+Length of the downlink frames, Ethernet header included. Default is 200.
+
+=item ACTIVE
+Start when the router starts. If false, nothing is sent until the
+I<active> handler is set, which lets a script set the ports of the WTPs
+first. Default is true.
+
+=back 8
+
+=h handovers read-only
+Handovers started, over and still pending, LVAPs added at start, and
+requests the WTPs refused; then the histograms of the handover times,
+from the DEL_LVAP to the answer to the ADD_LVAP, and of the time each
+WTP took to answer the DEL_LVAP and the ADD_LVAP, in microseconds.
+
+=h messages read-only
+Messages and bytes sent to and received from every WTP, then the number
+of messages of every type sent and received.
+
+=h cpu read-only
+For every element of every WTP, the packets it handled and the
+microseconds it took, then the total of the WTP. Empty unless Click was
+built with cycle accounting.
+
+=h report read-only
+All of the above.
+
+=h active read/write
+Whether handovers are started and downlink frames sent.
+
+=h reset write-only
+Reset the counters, the histograms and the clock.
+
+=a EmpowerLVAPManager, EmpowerMockRadio, EmpowerBenchSource
+*/
+
+class EmpowerRoamController : public Element {
+
+public:
+
+	EmpowerRoamController() CLICK_COLD;
+	~EmpowerRoamController() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerRoamController"; }
+	const char *port_count() const		{ return "1-/1-"; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	void push(int, Packet *);
+	bool run_task(Task *);
+	void run_timer(Timer *);
+
+private:
+
+	enum { S_IDLE, S_DELETING, S_ADDING };
+	enum { BURST = 32 };
+
+	struct Station {
+		EtherAddress _sta;
+		int _wtp; // hosting it, -1 if none
+		int _target; // WTP it is moving to, -1 if none
+		int _state;
+		uint32_t _module_id; // of the pending request
+		Timestamp _start; // of the handover, zero while joining
+		Timestamp _sent; // of the pending request
+	};
+
+	struct Counters {
+		uint64_t _messages;
+		uint64_t _bytes;
+	};
+
+	struct Stage {
+		Element *e;
+		int wtp;
+		uint64_t packets;
+		click_cycles_t cycles;
+	};
+
+	Vector<class EmpowerLVAPManager *> _els;
+	int _iface_id;
+	int _nb_lvaps;
+	String _ssid;
+	uint32_t _period;
+	int _nb_handovers;
+	int _limit;
+	bool _stop;
+	uint32_t _downlink_rate;
+	uint32_t _length;
+	bool _active;
+	Task _task;
+	Timer _timer;
+	GapRate _rate;
+
+	Vector<Station> _stations;
+	Vector<int> _fresh; // handed over, awaiting their first downlink frame
+	int _fresh_head;
+	int _next_sta;
+	int _next_dl;
+	uint32_t _seq;
+	uint32_t _next_module_id;
+	bool _installed;
+	unsigned char _template[64];
+
+	uint32_t _started;
+	uint32_t _completed;
+	uint32_t _joined;
+	uint32_t _refused;
+	uint64_t _downlink;
+	LatencyHistogram _handover;
+	LatencyHistogram _del_lvap;
+	LatencyHistogram _add_lvap;
+	Vector<Counters> _sent;
+	Vector<Counters> _received;
+	uint64_t _types_sent[256];
+	uint64_t _types_received[256];
+
+	Vector<Stage> _stages;
+	Timestamp _start;
+	click_cycles_t _start_cycles;
+
+	static EtherAddress make_address(uint8_t, uint32_t);
+	int station_index(EtherAddress) const;
+
+	void send(int, Packet *);
+	void send_add_lvap(int);
+	void send_del_lvap(int);
+	void handle_response(int, uint8_t, Packet *, uint32_t);
+	Packet *make_packet();
+	void start();
+	void reset();
+	String report(int);
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,424 @@
+/*
+ * empowerrxbench.{cc,hh} -- loops a radiotap trace through the receive path
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerrxbench.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/handlercall.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/radiotap.h>
+#include <clicknet/wifi.h>
+#include "empowerrxstats.hh"
+#include "empowerlvapmanager.hh"
+#include "empowermessage.hh"
+CLICK_DECLS
+
+EmpowerRxBench::EmpowerRxBench() :
+	_el(0), _ers(0), _iface_id(0), _nb_rssi_triggers(0), _nb_summary_triggers(0),
+	_burst(32), _limit(1000000), _stop(false), _active(false), _task(this),
+	_installed(false), _next(0), _count(0), _start_cycles(0), _last_cycles(0) {
+}
+
+EmpowerRxBench::~EmpowerRxBench() {
+}
+
+int EmpowerRxBench::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	String stages;
+
+	if (Args(conf, this, errh)
+			.read("STAGES", stages)
+			.read("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("ERS", ElementCastArg("EmpowerRXStats"), _ers)
+			.read("IFACE_ID", _iface_id)
+			.read("RSSI_TRIGGERS", _nb_rssi_triggers)
+			.read("SUMMARY_TRIGGERS", _nb_summary_triggers)
+			.read("BURST", _burst)
+			.read("LIMIT", _limit)
+			.read("STOP", _stop)
+			.read("ACTIVE", _active)
+			.complete() < 0) {
+		return -1;
+	}
+
+	Vector<String> tokens;
+	cp_spacevec(stages, tokens);
+
+	for (int i = 0; i < tokens.size(); i++) {
+		Stage s;
+		if (!ElementArg().parse(tokens[i], s.e, ArgContext(this, errh))) {
+			return -1;
+		}
+		s.packets = s.cycles = 0;
+		_stages.push_back(s);
+	}
+
+#if !HAVE_CYCLE_ACCOUNTING
+	if (_stages.size()) {
+		errh->warning("cycle accounting not compiled in, STAGES will not be timed");
+	}
+#endif
+
+	if ((_nb_rssi_triggers || _nb_summary_triggers) && !_ers) {
+		return errh->error("triggers need an ERS element");
+	}
+
+	if (noutputs() > 1 && !_el) {
+		return errh->error("output 1 needs an EL element");
+	}
+
+	if (_nb_rssi_triggers < 0 || _nb_summary_triggers < 0) {
+		return errh->error("the number of triggers must be non-negative");
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	return 0;
+
+}
+
+int EmpowerRxBench::initialize(ErrorHandler *errh) {
+	ScheduleInfo::initialize_task(this, &_task, _active, errh);
+	return 0;
+}
+
+void EmpowerRxBench::cleanup(CleanupStage) {
+	for (int i = 0; i < _trace.size(); i++) {
+		_trace[i]->kill();
+	}
+	_trace.clear();
+}
+
+void EmpowerRxBench::learn(Packet *p) {
+
+	if (_addresses.size() >= MAX_ADDRESSES || p->length() < sizeof(struct ieee80211_radiotap_header)) {
+		return;
+	}
+
+	struct ieee80211_radiotap_header *th = (struct ieee80211_radiotap_header *) p->data();
+	uint32_t offset = le16_to_cpu(th->it_len);
+
+	if (p->length() < offset + sizeof(struct click_wifi)) {
+		return;
+	}
+
+	struct click_wifi *w = (struct click_wifi *) (p->data() + offset);
+
+	// control frames may have no transmitter address
+	if ((w->i_fc[0] & WIFI_FC0_TYPE_MASK) == WIFI_FC0_TYPE_CTL) {
+		return;
+	}
+
+	EtherAddress ta(w->i_addr2);
+	if (ta.is_group()) {
+		return;
+	}
+
+	bool known = false;
+	for (int i = 0; i < _addresses.size() && !known; i++) {
+		known = _addresses[i] == ta;
+	}
+
+	if (known) {
+		return;
+	}
+
+	_addresses.push_back(ta);
+
+	// uplink data, the transmitter is a station of the BSSID
+	if ((w->i_fc[0] & WIFI_FC0_TYPE_MASK) == WIFI_FC0_TYPE_DATA &&
+	    (w->i_fc[1] & WIFI_FC1_DIR_MASK) == WIFI_FC1_DIR_TODS) {
+		_stas.push_back(ta);
+		_bssids.push_back(EtherAddress(w->i_addr1));
+	}
+
+}
+
+void EmpowerRxBench::push(int, Packet *p) {
+	learn(p);
+	_trace.push_back(p);
+}
+
+void EmpowerRxBench::install_lvaps() {
+
+	ResourceElement *re = _el->iface_to_element(_iface_id);
+	if (!re) {
+		click_chatter("%{element} :: %s :: invalid interface %d!",
+				      this,
+				      __func__,
+				      _iface_id);
+		return;
+	}
+
+	String ssid = "bench";
+
+	for (int i = 0; i < _stas.size(); i++) {
+		EmpowerMessage msg;
+		// the LVAP ssid followed by the list of its ssids
+		empower_add_lvap *add = msg.start<empower_add_lvap>(EMPOWER_PT_ADD_LVAP, i, 2 * (ssid.length() + 1));
+		if (!add) {
+			return;
+		}
+		add->set_module_id(i);
+		add->set_flag(EMPOWER_STATUS_LVAP_AUTHENTICATED);
+		add->set_flag(EMPOWER_STATUS_LVAP_ASSOCIATED);
+		add->set_flag(EMPOWER_STATUS_LVAP_SET_MASK);
+		add->set_assoc_id((i + 1) & 0x7FF);
+		add->set_hwaddr(re->_hwaddr);
+		add->set_channel(re->_channel);
+		add->set_band(re->_band);
+		add->set_supported_band(re->_band);
+		add->set_sta(_stas[i]);
+		add->set_net_bssid(_bssids[i]);
+		add->set_lvap_bssid(_bssids[i]);
+		uint8_t *ptr = (uint8_t *) (add + 1);
+		for (int e = 0; e < 2; e++) {
+			ssid_entry *entry = (ssid_entry *) ptr;
+			entry->set_length(ssid.length());
+			entry->set_ssid(ssid);
+			ptr += ssid.length() + 1;
+		}
+		output(1).push(msg.finish());
+	}
+
+}
+
+void EmpowerRxBench::install_triggers() {
+
+	int naddrs = _addresses.size();
+
+	for (int i = 0; i < _nb_rssi_triggers; i++) {
+		// different values, so that triggers on the same address add up
+		EtherAddress eth = naddrs ? _addresses[i % naddrs] : EtherAddress::make_broadcast();
+		int val = -1 - (naddrs ? i / naddrs : i);
+		_ers->add_rssi_trigger(eth, i, GT, val, 2000);
+	}
+
+	for (int i = 0; i < _nb_summary_triggers; i++) {
+		EtherAddress eth;
+		if (i < naddrs) {
+			eth = _addresses[i];
+		} else {
+			// locally administered, never in the trace
+			uint8_t addr[6] = { 0x02, 0x00, (uint8_t) (i >> 24), (uint8_t) (i >> 16), (uint8_t) (i >> 8), (uint8_t) i };
+			eth = EtherAddress(addr);
+		}
+		_ers->add_summary_trigger(_iface_id, eth, _nb_rssi_triggers + i, -1, 2000);
+	}
+
+}
+
+void EmpowerRxBench::start() {
+
+#if HAVE_CYCLE_ACCOUNTING
+	HandlerCall::call_write("cycle_accounting", "true", this);
+
+	for (int i = 0; i < _stages.size(); i++) {
+		_stages[i].e->cycle_totals(_stages[i].packets, _stages[i].cycles);
+	}
+#endif
+
+	_start = _last = Timestamp::now_steady();
+	_start_cycles = _last_cycles = click_get_cycles();
+
+}
+
+bool EmpowerRxBench::run_task(Task *) {
+
+	if (!_active) {
+		return false;
+	}
+
+	if (_trace.empty()) {
+		click_chatter("%{element} :: %s :: empty trace!",
+				      this,
+				      __func__);
+		_active = false;
+		return false;
+	}
+
+	if (!_installed) {
+		if (noutputs() > 1) {
+			install_lvaps();
+		}
+		if (_ers) {
+			install_triggers();
+		}
+		_installed = true;
+	}
+
+	if (_count >= _limit) {
+		if (_stop) {
+			router()->please_stop_driver();
+		}
+		return false;
+	}
+
+	if (!_count) {
+		start();
+	}
+
+	int n = _burst;
+	if (_count + n > _limit) {
+		n = _limit - _count;
+	}
+
+	for (int i = 0; i < n; i++) {
+		Packet *src = _trace[_next];
+		WritablePacket *p = Packet::make(src->headroom(), src->data(), src->length(), src->tailroom());
+		if (!p) {
+			break;
+		}
+		p->copy_annotations(src);
+		if (++_next == _trace.size()) {
+			_next = 0;
+		}
+		_count++;
+		output(0).push(p);
+	}
+
+	_last = Timestamp::now_steady();
+	_last_cycles = click_get_cycles();
+
+	_task.fast_reschedule();
+	return n > 0;
+
+}
+
+enum {
+	H_COUNT,
+	H_TRACE,
+	H_PPS,
+	H_NS_PER_PACKET,
+	H_STAGES,
+	H_REPORT,
+	H_ACTIVE,
+	H_RESET
+};
+
+String EmpowerRxBench::report(int what) {
+
+	StringAccum sa;
+	uint64_t nsec = _count ? (uint64_t) (_last - _start).nsecval() : 0;
+	click_cycles_t cycles = _last_cycles - _start_cycles;
+
+	if (what == H_COUNT || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "count ";
+		}
+		sa << _count << "\n";
+	}
+	if (what == H_TRACE || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "trace ";
+		}
+		sa << _trace.size() << "\n";
+	}
+	if (what == H_PPS || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "pps ";
+		}
+		sa << (nsec ? _count * 1000000000 / nsec : 0) << "\n";
+	}
+	if (what == H_NS_PER_PACKET || what == H_REPORT) {
+		if (what == H_REPORT) {
+			sa << "ns_per_packet ";
+		}
+		sa << (_count ? nsec / _count : 0) << "\n";
+	}
+#if HAVE_CYCLE_ACCOUNTING
+	if (what == H_STAGES || what == H_REPORT) {
+		for (int i = 0; i < _stages.size(); i++) {
+			const Stage &s = _stages[i];
+			uint64_t packets;
+			click_cycles_t own;
+			if (!s.e->cycle_totals(packets, own)) {
+				continue;
+			}
+			packets -= s.packets;
+			own -= s.cycles;
+			if (what == H_REPORT) {
+				sa << "stage ";
+			}
+			sa << s.e->name() << " " << packets << " ";
+			if (packets && cycles) {
+				sa.snprintf(32, "%.1f", (double) own * nsec / cycles / packets);
+			} else {
+				sa << "0";
+			}
+			sa << "\n";
+		}
+	}
+#endif
+
+	return sa.take_string();
+
+}
+
+String EmpowerRxBench::read_handler(Element *e, void *thunk) {
+	EmpowerRxBench *b = (EmpowerRxBench *) e;
+	if ((uintptr_t) thunk == H_ACTIVE) {
+		return String(b->_active) + "\n";
+	}
+	return b->report((uintptr_t) thunk);
+}
+
+int EmpowerRxBench::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerRxBench *b = (EmpowerRxBench *) e;
+	switch ((uintptr_t) thunk) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(cp_uncomment(in_s), active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		b->_active = active;
+		if (active && !b->_task.scheduled()) {
+			b->_task.reschedule();
+		}
+		break;
+	}
+	case H_RESET:
+		b->_count = 0;
+		b->_next = 0;
+		b->_start = b->_last = Timestamp();
+		b->_start_cycles = b->_last_cycles = 0;
+		if (b->_active && !b->_task.scheduled()) {
+			b->_task.reschedule();
+		}
+		break;
+	}
+	return 0;
+}
+
+void EmpowerRxBench::add_handlers() {
+	add_read_handler("count", read_handler, (void *) H_COUNT);
+	add_read_handler("trace", read_handler, (void *) H_TRACE);
+	add_read_handler("pps", read_handler, (void *) H_PPS);
+	add_read_handler("ns_per_packet", read_handler, (void *) H_NS_PER_PACKET);
+	add_read_handler("stages", read_handler, (void *) H_STAGES);
+	add_read_handler("report", read_handler, (void *) H_REPORT);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE, Handler::f_checkbox);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::f_button);
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerRxBench)
+ELEMENT_REQUIRES(userlevel EmpowerLVAPManager EmpowerRXStats)
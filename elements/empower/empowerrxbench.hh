@@ -0,0 +1,177 @@
+#ifndef CLICK_EMPOWERRXBENCH_HH
+#define CLICK_EMPOWERRXBENCH_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timestamp.hh>
+#include <click/etheraddress.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerRxBench([I<KEYWORDS>])
+
+=s EmPOWER
+
+Loops a radiotap trace through the receive path and times its stages
+
+=d
+
+Benchmarks the receive path of an EmPOWER WTP on recorded traffic. Frames
+arriving on input 0, typically from a FromDump reading a pcap captured
+on a monitor interface, are kept in memory. Once the I<active> handler is
+set, normally by the END_CALL of the FromDump, EmpowerRxBench pushes
+copies of them out output 0, in order and as fast as possible, looping
+over the trace until LIMIT frames have been sent. Each copy is a fresh
+packet, as it would be coming from a device.
+
+The time spent in every element named in STAGES is measured with cycle
+accounting, which is turned on when the loop starts, and reported in
+nanoseconds per frame entering the stage. Cycles are converted to
+nanoseconds with the rate measured over the run.
+
+If ERS is given, RSSI_TRIGGERS RSSI triggers and SUMMARY_TRIGGERS summary
+triggers are installed on it before the loop starts. They target the
+transmitter addresses found in the trace, round robin, then made up
+addresses once every trace address has a summary trigger.
+
+If output 1 is connected to the EmpowerLVAPManager EL, an authenticated
+and associated LVAP is added on interface IFACE_ID, before the loop
+starts, for every station sending data frames to a BSSID in the trace,
+so that EmpowerWifiDecap handles their frames as it would in service.
+
+Note that frames with the retry bit set are dropped by WifiDupeFilter
+from the second loop on, as their sequence numbers repeat.
+
+Keyword arguments are:
+
+=over 8
+
+=item STAGES
+Space separated list of the elements to time.
+
+=item EL
+An EmpowerLVAPManager element
+
+=item ERS
+An EmpowerRXStats element
+
+=item IFACE_ID
+Interface the LVAPs and the summary triggers are installed on. Default
+is 0.
+
+=item RSSI_TRIGGERS
+Number of RSSI triggers. Default is 0.
+
+=item SUMMARY_TRIGGERS
+Number of summary triggers. Default is 0.
+
+=item BURST
+Number of frames pushed per task run. Default is 32.
+
+=item LIMIT
+Number of frames to send. Default is 1000000.
+
+=item STOP
+Stop the driver once LIMIT frames have been sent. Default is false.
+
+=item ACTIVE
+Whether frames are sent. Default is false.
+
+=back 8
+
+=h count read-only
+Number of frames sent.
+
+=h trace read-only
+Number of frames in the trace.
+
+=h pps read-only
+Frames per second since the loop started.
+
+=h ns_per_packet read-only
+Nanoseconds per frame since the loop started.
+
+=h stages read-only
+One line per stage: its name, the number of frames it received and the
+nanoseconds it spent per frame.
+
+=h report read-only
+All of the above.
+
+=h active read/write
+Whether frames are sent.
+
+=h reset write-only
+Reset the counters, the clock and the cycle statistics of the stages.
+
+=a FromDump, EmpowerRXStats, EmpowerRxFrontEnd, EmpowerBenchSource
+*/
+
+class EmpowerRxBench : public Element {
+
+public:
+
+	EmpowerRxBench() CLICK_COLD;
+	~EmpowerRxBench() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerRxBench"; }
+	const char *port_count() const		{ return "1/1-2"; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	void push(int, Packet *);
+	bool run_task(Task *);
+
+private:
+
+	enum { MAX_ADDRESSES = 4096 };
+
+	struct Stage {
+		Element *e;
+		uint64_t packets;
+		click_cycles_t cycles;
+	};
+
+	class EmpowerLVAPManager *_el;
+	class EmpowerRXStats *_ers;
+	int _iface_id;
+	int _nb_rssi_triggers;
+	int _nb_summary_triggers;
+	int _burst;
+	uint64_t _limit;
+	bool _stop;
+	bool _active;
+	Task _task;
+
+	Vector<Stage> _stages;
+	Vector<Packet *> _trace;
+	Vector<EtherAddress> _addresses;
+	Vector<EtherAddress> _stas;
+	Vector<EtherAddress> _bssids;
+	bool _installed;
+	int _next;
+
+	uint64_t _count;
+	Timestamp _start;
+	Timestamp _last;
+	click_cycles_t _start_cycles;
+	click_cycles_t _last_cycles;
+
+	void learn(Packet *);
+	void install_lvaps();
+	void install_triggers();
+	void start();
+	String report(int);
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,181 @@
+/*
+ * empowerrxfilter.{cc,hh} -- kernel side filter of the frames received by
+ * an EmPOWER agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerrxfilter.hh"
+#include <click/glue.hh>
+#include <clicknet/wifi.h>
+#if CLICK_USERLEVEL
+# include <errno.h>
+#endif
+#if CLICK_USERLEVEL && defined(__linux__)
+# include <sys/socket.h>
+# include <linux/if_packet.h>
+# include <linux/filter.h>
+#endif
+CLICK_DECLS
+
+#if CLICK_USERLEVEL && defined(__linux__)
+
+// snap length of the frames accepted whole
+#define RXF_ACCEPT 0x40000
+
+static int compare_addresses(const void *a, const void *b, void *) {
+	return memcmp(a, b, 6);
+}
+
+static bool same_addresses(const Vector<EtherAddress> &a, const Vector<EtherAddress> &b) {
+	return a.size() == b.size() && (!a.size() || memcmp(a.begin(), b.begin(), a.size() * sizeof(EtherAddress)) == 0);
+}
+
+static void compile(Vector<struct sock_filter> &code, const Vector<EtherAddress> &tas, uint32_t sample) {
+
+	struct sock_filter head[] = {
+		// frames the interface sent, for the tx status
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) (SKF_AD_OFF + SKF_AD_PKTTYPE)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, RXF_ACCEPT),
+		// x = radiotap length, little endian
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),
+		BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 2),
+		BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		// no transmitter address, e.g. ACK and CTS
+		BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+		BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 16, 1, 0),
+		BPF_STMT(BPF_JMP | BPF_JA, 0), // to the other frames, set below
+		// management frames but beacons and probe responses
+		BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+		BPF_STMT(BPF_ALU | BPF_AND | BPF_K, WIFI_FC0_TYPE_MASK),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, WIFI_FC0_TYPE_MGT, 0, 6),
+		BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+		BPF_STMT(BPF_ALU | BPF_AND | BPF_K, WIFI_FC0_SUBTYPE_MASK),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, WIFI_FC0_SUBTYPE_BEACON, 2, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, WIFI_FC0_SUBTYPE_PROBE_RESP, 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, RXF_ACCEPT),
+		BPF_STMT(BPF_JMP | BPF_JA, 0), // to the other frames, set below
+	};
+	enum { HEAD = sizeof(head) / sizeof(head[0]), BLOCK = 5 };
+
+	code.clear();
+	for (int i = 0; i < HEAD; i++) {
+		code.push_back(head[i]);
+	}
+
+	// the transmitter, i_addr2, is loaded as a word and a half word,
+	// both in network byte order
+	for (int i = 0; i < tas.size(); i++) {
+		const unsigned char *ta = tas[i].data();
+		uint32_t w = (ta[0] << 24) | (ta[1] << 16) | (ta[2] << 8) | ta[3];
+		uint32_t h = (ta[4] << 8) | ta[5];
+		struct sock_filter block[BLOCK] = {
+			BPF_STMT(BPF_LD | BPF_W | BPF_IND, 10),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, w, 0, 3),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 14),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, h, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, RXF_ACCEPT),
+		};
+		for (int j = 0; j < BLOCK; j++) {
+			code.push_back(block[j]);
+		}
+	}
+
+	// the other frames
+	int other = code.size();
+	code[12].k = other - 13;
+	code[HEAD - 1].k = other - HEAD;
+
+	if (sample > 1) {
+		struct sock_filter draw[] = {
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) (SKF_AD_OFF + SKF_AD_RANDOM)),
+			BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, sample),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 3),
+		};
+		for (unsigned j = 0; j < sizeof(draw) / sizeof(draw[0]); j++) {
+			code.push_back(draw[j]);
+		}
+	}
+
+	struct sock_filter tail[] = {
+		BPF_STMT(BPF_MISC | BPF_TXA, 0),
+		BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, EmpowerRxFilter::SNAP_LENGTH),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	for (unsigned j = 0; j < sizeof(tail) / sizeof(tail[0]); j++) {
+		code.push_back(tail[j]);
+	}
+
+}
+
+int EmpowerRxFilter::update(int fd, Vector<EtherAddress> &tas, bool all) {
+
+	if (fd < 0) {
+		return 0;
+	}
+
+	if (tas.size() > MAX_ADDRESSES) {
+		all = true;
+	}
+
+	if (all) {
+		tas.clear();
+	} else {
+		click_qsort(tas.begin(), tas.size(), sizeof(EtherAddress), compare_addresses);
+	}
+
+	if (fd == _fd && all == _all && same_addresses(tas, _tas)) {
+		return 0;
+	}
+
+	Vector<struct sock_filter> code;
+	if (all) {
+		struct sock_filter accept = BPF_STMT(BPF_RET | BPF_K, RXF_ACCEPT);
+		code.push_back(accept);
+	} else {
+		compile(code, tas, _sample);
+	}
+
+	struct sock_fprog prog;
+	prog.len = code.size();
+	prog.filter = code.begin();
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+		return errno;
+	}
+
+	_fd = fd;
+	_all = all;
+	_tas.swap(tas);
+	_length = code.size();
+	_installs++;
+
+	return 0;
+
+}
+
+#else
+
+int EmpowerRxFilter::update(int fd, Vector<EtherAddress> &, bool) {
+	return fd < 0 ? 0 : EOPNOTSUPP;
+}
+
+#endif
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(EmpowerRxFilter)
@@ -0,0 +1,54 @@
+#ifndef CLICK_EMPOWERRXFILTER_HH
+#define CLICK_EMPOWERRXFILTER_HH
+#include <click/etheraddress.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+// Socket filter of the packet socket an interface is read from (see
+// EmpowerLVAPManager RX_DEVS), so that the kernel only copies to the
+// agent what it looks at. Frames sent by the interface, management
+// frames other than beacons and probe responses, and frames whose
+// transmitter is in the list given to update() are accepted whole. Any
+// other frame only feeds the neighbor tables, which need the radiotap
+// header and the 802.11 one: it is truncated to SNAP_LENGTH bytes past
+// the radiotap header, and with a sample of N only one in N of them,
+// picked at random, is accepted at all.
+//
+// The program is a classic BPF one, the transmitters are matched one
+// by one. Past MAX_ADDRESSES of them, or if update() is told to, every
+// frame is accepted whole.
+class EmpowerRxFilter {
+public:
+
+	// 24 bytes of 802.11 header plus the FCS, which RadiotapDecap strips
+	// from the end of the frame if the radiotap header says it is there
+	enum { SNAP_LENGTH = 28, MAX_ADDRESSES = 768 };
+
+	EmpowerRxFilter() : _fd(-1), _sample(0), _all(false), _installs(0), _length(0) {}
+
+	void set_sample(uint32_t sample) { _sample = sample; }
+
+	// Attach to fd the filter accepting the frames of tas whole, or
+	// every frame if all. Does nothing if fd already has that filter.
+	// Returns 0 or an errno; tas is left unspecified.
+	int update(int fd, Vector<EtherAddress> &tas, bool all);
+
+	uint32_t installs() const { return _installs; }
+	// instructions of the attached program, 0 if none
+	int length() const { return _length; }
+	int addresses() const { return _tas.size(); }
+	bool all() const { return _all; }
+
+private:
+
+	int _fd;
+	uint32_t _sample;
+	Vector<EtherAddress> _tas;
+	bool _all;
+	uint32_t _installs;
+	int _length;
+
+};
+
+CLICK_ENDDECLS
+#endif /* CLICK_EMPOWERRXFILTER_HH */
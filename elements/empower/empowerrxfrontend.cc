@@ -0,0 +1,201 @@
+/*
+ * empowerrxfrontend.{cc,hh} -- receive path of a monitor interface
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerrxfrontend.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+EmpowerRxFrontEnd::EmpowerRxFrontEnd() :
+	_iface_id(-1), _phy_errors(0), _dupes(0), _feedback(0) {
+}
+
+EmpowerRxFrontEnd::~EmpowerRxFrontEnd() {
+}
+
+int EmpowerRxFrontEnd::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	if (Args(conf, this, errh)
+			.read_mp("IFACE_ID", _iface_id)
+			.read("DEBUG", _debug)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_iface_id < 0 || _iface_id > 255) {
+		return errh->error("IFACE_ID must be between 0 and 255");
+	}
+
+	return 0;
+
+}
+
+// Same rules as WifiDupeFilter: a retry carrying a sequence number heard
+// recently from the same transmitter is a duplicate
+bool EmpowerRxFrontEnd::dupe(const click_wifi *w) {
+
+	if (EtherAddress(w->i_addr1).is_group()) {
+		return false;
+	}
+
+	uint16_t seq = le16_to_cpu(w->i_seq) >> WIFI_SEQ_SEQ_SHIFT;
+	uint8_t frag = le16_to_cpu(w->i_seq) & WIFI_SEQ_FRAG_MASK;
+	bool is_frag = frag || (w->i_fc[1] & WIFI_FC1_MORE_FRAG);
+
+	WifiSeqWindow &window = _seqs[EtherAddress(w->i_addr2)];
+
+	if (window.add(seq, frag, is_frag) && (w->i_fc[1] & WIFI_FC1_RETRY)) {
+		if (_debug) {
+			click_chatter("%{element} :: %s :: dup seq %d frag %d src %s",
+						  this,
+						  __func__,
+						  seq,
+						  frag,
+						  EtherAddress(w->i_addr2).unparse().c_str());
+		}
+		return true;
+	}
+
+	return false;
+
+}
+
+// Output of frame p, or -1 if p was consumed
+int EmpowerRxFrontEnd::classify(Packet *&p) {
+
+	p = RadiotapDecap::simple_action(p);
+
+	if (!p) {
+		return -1;
+	}
+
+	struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
+
+	if (ceh->flags & WIFI_EXTRA_RX_ERR) {
+		_phy_errors++;
+		p->kill();
+		return -1;
+	}
+
+	if (ceh->flags & WIFI_EXTRA_TX) {
+		_feedback++;
+		return 2;
+	}
+
+	// a PS-Poll is shorter than a data or management header
+	if (p->length() < PS_POLL_LENGTH) {
+		p->kill();
+		return -1;
+	}
+
+	const click_wifi *w = (const click_wifi *) p->data();
+	int type = w->i_fc[0] & WIFI_FC0_TYPE_MASK;
+
+	if (type == WIFI_FC0_TYPE_CTL && (w->i_fc[0] & WIFI_FC0_SUBTYPE_MASK) == WIFI_FC0_SUBTYPE_PS_POLL
+			&& noutputs() > 3) {
+		SET_PAINT_ANNO(p, _iface_id);
+		return 3;
+	}
+
+	if (p->length() < sizeof(struct click_wifi)
+			|| (type != WIFI_FC0_TYPE_DATA && type != WIFI_FC0_TYPE_MGT)) {
+		p->kill();
+		return -1;
+	}
+
+	if (dupe(w)) {
+		_dupes++;
+		p->kill();
+		return -1;
+	}
+
+	SET_PAINT_ANNO(p, _iface_id);
+
+	return type == WIFI_FC0_TYPE_DATA ? 0 : 1;
+
+}
+
+void EmpowerRxFrontEnd::push(int, Packet *p) {
+	int port = classify(p);
+	if (port >= 0) {
+		output(port).push(p);
+	}
+}
+
+void EmpowerRxFrontEnd::push_batch(int, Packet *head) {
+
+	PacketBatch out[4];
+
+	while (Packet *p = PacketBatch::pop(head)) {
+		int port = classify(p);
+		if (port >= 0) {
+			out[port].append(p);
+		}
+	}
+
+	for (int i = 0; i < 4; i++) {
+		if (!out[i].empty()) {
+			output(i).push_batch(out[i].take());
+		}
+	}
+
+}
+
+enum {
+	H_PHY_ERRORS,
+	H_DUPES,
+	H_FEEDBACK,
+	H_RESET
+};
+
+String EmpowerRxFrontEnd::read_handler(Element *e, void *thunk) {
+	EmpowerRxFrontEnd *fe = (EmpowerRxFrontEnd *) e;
+	switch ((uintptr_t) thunk) {
+	case H_PHY_ERRORS:
+		return String(fe->_phy_errors) + "\n";
+	case H_DUPES:
+		return String(fe->_dupes) + "\n";
+	case H_FEEDBACK:
+		return String(fe->_feedback) + "\n";
+	default:
+		return "<error>\n";
+	}
+}
+
+int EmpowerRxFrontEnd::write_handler(const String &, Element *e, void *thunk, ErrorHandler *) {
+	EmpowerRxFrontEnd *fe = (EmpowerRxFrontEnd *) e;
+	switch ((uintptr_t) thunk) {
+	case H_RESET:
+		fe->_seqs.clear();
+		fe->_phy_errors = 0;
+		fe->_dupes = 0;
+		fe->_feedback = 0;
+		break;
+	}
+	return 0;
+}
+
+void EmpowerRxFrontEnd::add_handlers() {
+	RadiotapDecap::add_handlers();
+	add_read_handler("phy_errors", read_handler, (void *) H_PHY_ERRORS);
+	add_read_handler("dupes", read_handler, (void *) H_DUPES);
+	add_read_handler("feedback", read_handler, (void *) H_FEEDBACK);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(RadiotapDecap)
+EXPORT_ELEMENT(EmpowerRxFrontEnd)
@@ -0,0 +1,107 @@
+#ifndef CLICK_EMPOWERRXFRONTEND_HH
+#define CLICK_EMPOWERRXFRONTEND_HH
+#include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/flathashtable.hh>
+#include <clicknet/wifi.h>
+#include <elements/wifi/radiotapdecap.hh>
+#include <elements/wifi/wifiseqwindow.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerRxFrontEnd(IFACE_ID[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Receive path of a monitor interface in one element
+
+=d
+
+Does in one pass what RadiotapDecap, FilterPhyErr, FilterTX,
+WifiDupeFilter and Paint do, in this order, to the frames coming from a
+monitor interface. Input frames start with a radiotap header.
+
+Data frames go out on output 0, management frames on output 1 and the
+transmit status reports of the frames sent from this interface on output
+2, which is meant for the rate control. PS-Poll frames go out on output
+3, if there is one, which is meant for an EmpowerPowerSaveBuffer. Frames
+received with a PHY error, duplicates and other control frames are
+dropped. Received frames have their paint annotation set to IFACE_ID.
+
+The frames of a batch, such as a burst read by FromDevice, leave as one
+batch per output.
+
+Keyword arguments are:
+
+=over 8
+
+=item IFACE_ID
+
+Interface the frames are received from.
+
+=item DEBUG
+
+Turn debug on/off.
+
+=back 8
+
+=h phy_errors read-only
+Number of frames dropped because of a PHY error.
+
+=h dupes read-only
+Number of duplicate frames dropped.
+
+=h feedback read-only
+Number of transmit status reports.
+
+=h reset write-only
+Clears the duplicate detection state and the counters.
+
+=a RadiotapDecap, FilterPhyErr, FilterTX, WifiDupeFilter, Paint,
+EmpowerRXStats, EmpowerPowerSaveBuffer
+*/
+
+class EmpowerRxFrontEnd : public RadiotapDecap {
+
+public:
+
+	EmpowerRxFrontEnd() CLICK_COLD;
+	~EmpowerRxFrontEnd() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerRxFrontEnd"; }
+	const char *port_count() const		{ return "1/3-4"; }
+	const char *processing() const		{ return PUSH; }
+
+	bool can_live_reconfigure() const	{ return false; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	void push(int, Packet *);
+	void push_batch(int, Packet *);
+
+private:
+
+	typedef FlatHashTable<EtherAddress, WifiSeqWindow> SeqTable;
+
+	enum { PS_POLL_LENGTH = 16 };
+
+	SeqTable _seqs;
+	int _iface_id;
+
+	uint32_t _phy_errors;
+	uint32_t _dupes;
+	uint32_t _feedback;
+
+	bool dupe(const click_wifi *);
+	int classify(Packet *&);
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -26,15 +26,17 @@
 #include <elements/wifi/bitrate.hh>
 #include "empowerlvapmanager.hh"
 #include "empowerrxstats.hh"
+#include "empowerpowersavebuffer.hh"
 CLICK_DECLS
 
-void send_summary_trigger_callback(Timer *timer, void *data) {
+void send_summary_trigger_callback(TimerWheelEntry *timer, void *data) {
 	// send summary
 	SummaryTrigger *summary = (SummaryTrigger *) data;
-	summary->_ers->lock.acquire_write();
+	NeighborShard *shard = summary->_ers->shard(summary->_iface);
+	shard->lock.acquire_write();
 	summary->_el->send_summary_trigger(summary);
 	summary->_sent++;
-	summary->_ers->lock.release_write();
+	shard->lock.release_write();
 	if (summary->_limit > 0 && summary->_sent >= (unsigned) summary->_limit) {
 		summary->_ers->del_summary_trigger(summary->_trigger_id);
 		return;
@@ -43,41 +45,63 @@ void send_summary_trigger_callback(Timer *timer, void *data) {
 	timer->schedule_after_msec(summary->_period);
 }
 
-void send_rssi_trigger_callback(Timer *timer, void *data) {
-	// process triggers
+void send_rssi_trigger_callback(TimerWheelEntry *timer, void *data) {
+	// process triggers, the windowed rssi only moves when the neighbor
+	// is updated so skip the ones that did not change since last time
 	RssiTrigger *rssi = (RssiTrigger *) data;
-	rssi->_ers->lock.acquire_write();
-	for (NTIter iter = rssi->_ers->stas.begin(); iter.live(); iter++) {
-		DstInfo *nfo = &iter.value();
-		// not matching the address
-		if (nfo->_eth != rssi->_eth) {
-			continue;
-		}
-		// check if condition matches
-		if (rssi->matches(nfo) && !rssi->_dispatched) {
-			rssi->_el->send_rssi_trigger(rssi->_trigger_id, nfo->_iface_id, nfo->_sma_rssi->avg());
-			rssi->_dispatched = true;
-		} else if (!rssi->matches(nfo) && rssi->_dispatched) {
-			rssi->_dispatched = false;
+	for (int i = 0; i < rssi->_ers->num_shards(); i++) {
+		NeighborShard *shard = rssi->_ers->shard(i);
+		shard->lock.acquire_read();
+		DstInfo *nfo = shard->stas.get_pointer(rssi->_eth);
+		if (nfo && rssi->changed(i, nfo)) {
+			// check if condition matches
+			bool match = rssi->matches(nfo);
+			if (match && !rssi->_dispatched) {
+				rssi->_el->send_rssi_trigger(rssi->_trigger_id, nfo->_iface_id, nfo->_sma_rssi.avg());
+				rssi->_dispatched = true;
+			} else if (!match && rssi->_dispatched) {
+				rssi->_dispatched = false;
+			}
 		}
+		shard->lock.release_read();
 	}
-	rssi->_ers->lock.release_write();
 	// re-schedule the timer
 	timer->schedule_after_msec(rssi->_period);
 }
 
 EmpowerRXStats::EmpowerRXStats() :
-		_el(0), _timer(this), _signal_offset(0), _period(500),
-		_sma_period(13), _max_silent_window_count(50), _debug(false) {
+		_el(0), _timer(this), _neighbors(0), _signal_offset(0), _period(500),
+		_sma_period(13), _max_silent_window_count(50), _max_neighbors(1024),
+		_evictions(0), _summary_length(1024), _summary_sample(1), _data_sample(1), _debug(false) {
 
 }
 
 EmpowerRXStats::~EmpowerRXStats() {
+	for (int i = 0; i < _shards.size(); i++) {
+		delete _shards[i];
+	}
+	delete _neighbors;
+	for (int i = 0; i < _retired.size(); i++) {
+		delete _retired[i];
+	}
 }
 
 int EmpowerRXStats::initialize(ErrorHandler *) {
+	// one shard per interface, frames from unknown interfaces are ignored
+	for (int i = 0; i < _el->num_ifaces(); i++) {
+		_shards.push_back(new NeighborShard());
+		_shards.back()->lock.set_name(this, "neighbor shard");
+	}
+	// reports find every interface, with no neighbor yet
+	NeighborSnapshot *neighbors = new NeighborSnapshot();
+	for (int i = 0; i < _shards.size(); i++) {
+		neighbors->add(_shards[i]->stas);
+		neighbors->add(_shards[i]->aps);
+	}
+	publish(neighbors);
 	_timer.initialize(this);
 	_timer.schedule_now();
+	_triggers_wheel.initialize(this);
 	return 0;
 }
 
@@ -88,46 +112,163 @@ int EmpowerRXStats::configure(Vector<String> &conf, ErrorHandler *errh) {
 			.read("SMA_PERIOD", _sma_period)
 			.read("SIGNAL_OFFSET", _signal_offset)
 			.read("PERIOD", _period)
+			.read("SILENT_WINDOWS", _max_silent_window_count)
+			.read("MAX_NEIGHBORS", _max_neighbors)
+			.read("SUMMARY_LENGTH", _summary_length)
+			.read("SUMMARY_SAMPLE", _summary_sample)
+			.read("DATA_SAMPLE", _data_sample)
 			.read("DEBUG", _debug)
 			.complete();
 
-	return ret;
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (_sma_period < 1 || _sma_period > SMA::MAX_PERIOD) {
+		return errh->error("SMA_PERIOD must be between 1 and %d", SMA::MAX_PERIOD);
+	}
+
+	if (_max_neighbors < 1) {
+		return errh->error("MAX_NEIGHBORS must be positive");
+	}
+
+	if (_data_sample < 1) {
+		return errh->error("DATA_SAMPLE must be positive");
+	}
+
+	return 0;
 
 }
 
-void EmpowerRXStats::run_timer(Timer *) {
-	// process stations
-	lock.acquire_write();
-	for (NTIter iter = stas.begin(); iter.live();) {
-		// Update stats
-		DstInfo *nfo = &iter.value();
-
-		// tag_for_nif
-		//nfo->update();
-
-		// Delete stale entries
-		if (nfo->_silent_window_count > _max_silent_window_count) {
-			iter = stas.erase(iter);
-		} else {
-			++iter;
+void EmpowerRXStats::take_state(Element *e, ErrorHandler *) {
+
+	EmpowerRXStats *ers = (EmpowerRXStats *) e->cast("EmpowerRXStats");
+
+	if (!ers || !_el || !ers->_el) {
+		return;
+	}
+
+	for (int i = 0; i < ers->_shards.size(); i++) {
+		int iface_id = _el->translate_iface(ers->_el, i);
+		NeighborShard *shard = this->shard(iface_id);
+		if (!shard) {
+			continue;
+		}
+		NeighborTable *tables[2] = { &ers->_shards[i]->stas, &ers->_shards[i]->aps };
+		NeighborTable *ours[2] = { &shard->stas, &shard->aps };
+		for (int t = 0; t < 2; t++) {
+			for (NTIter iter = tables[t]->begin(); iter.live(); iter++) {
+				if (ours[t]->size() >= _max_neighbors) {
+					break;
+				}
+				DstInfo &nfo = (*ours[t])[iter.key()];
+				nfo = iter.value();
+				nfo._iface_id = iface_id;
+				if (ers->_sma_period != _sma_period) {
+					nfo._sma_rssi = SMA(_sma_period);
+				}
+			}
+		}
+		for (DTIter qi = ers->_shards[i]->summary_triggers.begin(); qi != ers->_shards[i]->summary_triggers.end(); qi++) {
+			SummaryTrigger *summary = *qi;
+			int16_t limit = summary->_limit > 0 ? summary->_limit - summary->_sent : summary->_limit;
+			add_summary_trigger(iface_id, summary->_eth, summary->_trigger_id, limit, summary->_period);
 		}
 	}
-	// process access points
-	for (NTIter iter = aps.begin(); iter.live();) {
-		// Update aps
-		DstInfo *nfo = &iter.value();
 
-		// tag_for_nif
-		//nfo->update();
+	for (RTIter qi = ers->_rssi_triggers.begin(); qi != ers->_rssi_triggers.end(); qi++) {
+		RssiTrigger *rssi = *qi;
+		add_rssi_trigger(rssi->_eth, rssi->_trigger_id, rssi->_rel, rssi->_val, rssi->_period);
+	}
 
-		// Delete stale entries
-		if (nfo->_silent_window_count > _max_silent_window_count) {
-			iter = aps.erase(iter);
+	_evictions = ers->_evictions;
+
+}
+
+// Only called from initialize() and run_timer(), which never overlap.
+void EmpowerRXStats::publish(NeighborSnapshot *neighbors) {
+	NeighborSnapshot *prev = _neighbors;
+	click_write_fence();
+	_neighbors = neighbors;
+	if (prev) {
+		_retired.push_back(prev);
+		_retired_epochs.push_back(_epoch.retire());
+	}
+	int kept = 0;
+	for (int i = 0; i < _retired.size(); i++) {
+		if (_epoch.quiescent(_retired_epochs[i])) {
+			delete _retired[i];
 		} else {
-			++iter;
+			_retired[kept] = _retired[i];
+			_retired_epochs[kept] = _retired_epochs[i];
+			kept++;
 		}
 	}
-	lock.release_write();
+	_retired.resize(kept);
+	_retired_epochs.resize(kept);
+}
+
+bool EmpowerRXStats::stale(const DstInfo *nfo, const Timestamp &now) const {
+	// neighbors rolled over in the middle of a burst of frames still
+	// count as silent, so also look at the time since the last frame
+	if (nfo->_silent_window_count > _max_silent_window_count) {
+		return true;
+	}
+	return now - nfo->_last_received > Timestamp::make_msec(_period * _max_silent_window_count);
+}
+
+void EmpowerRXStats::make_room(NeighborTable &table) {
+	// evict the neighbor we have not heard from for the longest time
+	DstInfo *victim = 0;
+	for (NTIter iter = table.begin(); iter.live(); iter++) {
+		if (!victim || iter.value()._last_received < victim->_last_received) {
+			victim = &iter.value();
+		}
+	}
+	if (victim) {
+		EtherAddress eth = victim->_eth;
+		table.erase(eth);
+		_evictions++;
+	}
+}
+
+void EmpowerRXStats::run_timer(Timer *) {
+	Timestamp now = Timestamp::now();
+	NeighborSnapshot *neighbors = new NeighborSnapshot();
+	for (int i = 0; i < _shards.size(); i++) {
+		NeighborShard *shard = _shards[i];
+		shard->lock.acquire_write();
+		// process stations
+		for (NTIter iter = shard->stas.begin(); iter.live();) {
+			// Update stats
+			DstInfo *nfo = &iter.value();
+			nfo->update();
+
+			// Delete stale entries
+			if (stale(nfo, now)) {
+				iter = shard->stas.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+		// process access points
+		for (NTIter iter = shard->aps.begin(); iter.live();) {
+			// Update aps
+			DstInfo *nfo = &iter.value();
+			nfo->update();
+
+			// Delete stale entries
+			if (stale(nfo, now)) {
+				iter = shard->aps.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+		neighbors->add(shard->stas);
+		neighbors->add(shard->aps);
+		shard->lock.release_write();
+	}
+	publish(neighbors);
 	// process reg mon info
 	/* read from debugfs and copy data in circular array */
 	// rescheduler
@@ -216,81 +357,146 @@ EmpowerRXStats::simple_action(Packet *p) {
 
 	uint8_t iface_id = PAINT_ANNO(p);
 
-	lock.acquire_write();
+	NeighborShard *shard = this->shard(iface_id);
+
+	if (!shard) {
+		return p;
+	}
+
+	// the receive time FromDevice stamped the frame with, if any
+	const Timestamp &received = p->timestamp_anno() ? p->timestamp_anno() : Timestamp::recent();
 
-	update_neighbor(ta, station, iface_id, rssi);
+	shard->lock.acquire_write();
+
+	update_neighbor(shard, ta, station, type == WIFI_FC0_TYPE_DATA, iface_id, rssi, received);
 
 	// check if frame meta-data should be saved
-	for (DTIter qi = _summary_triggers.begin(); qi != _summary_triggers.end(); qi++) {
-		if ((*qi)->_iface != iface_id) {
-			continue;
-		}
+	for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
 		if ((*qi)->_eth == ta || (*qi)->_eth.is_broadcast()) {
-			Frame frame = Frame(ra, ta, ceh->tsft, ceh->flags, w->i_seq, rssi, ceh->rate, type, subtype, p->length(), retry, station, iface_id);
-			(*qi)->_frames.push_back(frame);
+			Frame *frame = (*qi)->_frames.reserve();
+			if (frame) {
+				*frame = Frame(ra, ta, ceh->tsft, ceh->flags, w->i_seq, rssi, ceh->rate, type, subtype, p->length(), retry, station, iface_id);
+			}
 		}
 	}
 
-	lock.release_write();
+	shard->lock.release_write();
+
+	// power management bit of the stations served from this interface
+	if (station) {
+		EmpowerPowerSaveBuffer *epsb = _el->epsb(iface_id);
+		if (epsb) {
+			bool trigger = type == WIFI_FC0_TYPE_DATA && (subtype & WIFI_FC0_SUBTYPE_QOS);
+			epsb->power_save(ta, w->i_fc[1] & WIFI_FC1_PWR_MGT, trigger);
+		}
+	}
 
 	return p;
 
 }
 
-void EmpowerRXStats::update_neighbor(EtherAddress ta, bool station, uint8_t iface_id, uint8_t rssi) {
+void EmpowerRXStats::update_neighbor(NeighborShard *shard, EtherAddress ta, bool station, bool data, uint8_t iface_id, uint8_t rssi, const Timestamp &received) {
 
-	DstInfo *nfo;
+	NeighborTable &table = station ? shard->stas : shard->aps;
 
-	if (station) {
-		nfo = stas.get_pointer(ta);
-	} else {
-		nfo = aps.get_pointer(ta);
-	}
+	DstInfo *nfo = table.get_pointer(ta);
 
 	if (!nfo) {
-		if (station) {
-			stas[ta] = DstInfo();
-			nfo = stas.get_pointer(ta);
-			nfo->_sma_rssi = new SMA(_sma_period);
-			nfo->_iface_id = iface_id;
-			nfo->_eth = ta;
-		} else {
-			aps[ta] = DstInfo();
-			nfo = aps.get_pointer(ta);
-			nfo->_sma_rssi = new SMA(_sma_period);
-			nfo->_iface_id = iface_id;
-			nfo->_eth = ta;
+		if (table.size() >= _max_neighbors) {
+			make_room(table);
 		}
+		nfo = &table[ta];
+		nfo->_sma_rssi = SMA(_sma_period);
+		nfo->_sma_changed = Timestamp::now_steady();
+		nfo->_iface_id = iface_id;
+		nfo->_eth = ta;
 	}
 
-	// Add sample
-	nfo->add_sample(rssi);
+	// data frames of a neighbor with a sample in this window are counted
+	// only, but one in _data_sample
+	if (data && nfo->_window_rssi.count() && nfo->_skip > 1) {
+		nfo->_skip--;
+		nfo->add_frame(received);
+		return;
+	}
+
+	nfo->_skip = _data_sample;
+	nfo->add_sample(rssi, received);
+
+}
+
+int EmpowerRXStats::set_data_sample(uint32_t data_sample) {
+	if (!data_sample) {
+		return -1;
+	}
+	_data_sample = data_sample;
+	return 0;
+}
+
+int EmpowerRXStats::rssi_history(int iface_id, EtherAddress addr, int level, int n, RollupBucket *out, uint32_t &resolution) {
+
+	NeighborShard *shard = this->shard(iface_id);
+
+	if (!shard) {
+		return -1;
+	}
+
+	shard->lock.acquire_read();
+
+	DstInfo *nfo = shard->stas.get_pointer(addr);
+	if (!nfo) {
+		nfo = shard->aps.get_pointer(addr);
+	}
+
+	int nb = -1;
+	if (nfo) {
+		resolution = nfo->_rssi_rollup.resolution(level);
+		nb = nfo->_rssi_rollup.history(level, n, out);
+	}
+
+	shard->lock.release_read();
+
+	return nb;
 
 }
 
 void EmpowerRXStats::add_rssi_trigger(EtherAddress eth, uint32_t trigger_id, empower_trigger_relation rel, int val, uint16_t period) {
-	RssiTrigger * rssi = new RssiTrigger(eth, trigger_id, rel, val, false, period, _el, this);
-	for (RTIter qi = _rssi_triggers.begin(); qi != _rssi_triggers.end(); qi++) {
-		if (*rssi== **qi) {
+	RssiTriggersList &triggers = _rssi_index[eth];
+	for (RTIter qi = triggers.begin(); qi != triggers.end(); qi++) {
+		if ((*qi)->_rel == rel && (*qi)->_val == val) {
 			click_chatter("%{element} :: %s :: trigger already defined (%s), setting sent to false",
 						  this,
 						  __func__,
-						  rssi->unparse().c_str());
-			(*qi)->_dispatched = false;
+						  (*qi)->unparse().c_str());
+			(*qi)->rearm();
 			return;
 		}
 	}
+	RssiTrigger * rssi = new RssiTrigger(eth, trigger_id, rel, val, false, period, _el, this);
 	rssi->_trigger_timer->assign(&send_rssi_trigger_callback, (void *) rssi);
-	rssi->_trigger_timer->initialize(this);
-	rssi->_trigger_timer->schedule_now();
+	rssi->_trigger_timer->schedule_now(&_triggers_wheel);
 	_rssi_triggers.push_back(rssi);
+	triggers.push_back(rssi);
 }
 
 void EmpowerRXStats::del_rssi_trigger(uint32_t trigger_id) {
 	for (RTIter qi = _rssi_triggers.begin(); qi != _rssi_triggers.end(); qi++) {
 		if ((*qi)->_trigger_id == trigger_id) {
-			(*qi)->_trigger_timer->clear();
+			RssiTrigger *rssi = *qi;
+			RssiTriggersList *triggers = _rssi_index.get_pointer(rssi->_eth);
+			if (triggers) {
+				for (RTIter ti = triggers->begin(); ti != triggers->end(); ti++) {
+					if (*ti == rssi) {
+						triggers->erase(ti);
+						break;
+					}
+				}
+				if (triggers->empty()) {
+					_rssi_index.erase(rssi->_eth);
+				}
+			}
 			_rssi_triggers.erase(qi);
+			delete rssi;
 			break;
 		}
 	}
@@ -299,53 +505,129 @@ void EmpowerRXStats::del_rssi_trigger(uint32_t trigger_id) {
 void EmpowerRXStats::clear_triggers() {
 	// clear rssi triggers
 	for (RTIter qi = _rssi_triggers.begin(); qi != _rssi_triggers.end(); qi++) {
-		(*qi)->_trigger_timer->clear();
+		delete *qi;
 	}
 	_rssi_triggers.clear();
+	_rssi_index.clear();
 	// clear summary triggers
-	for (DTIter qi = _summary_triggers.begin(); qi != _summary_triggers.end(); qi++) {
-		(*qi)->_trigger_timer->clear();
-		delete *qi;
+	for (int i = 0; i < _shards.size(); i++) {
+		NeighborShard *shard = _shards[i];
+		shard->lock.acquire_write();
+		for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
+			delete *qi;
+		}
+		shard->summary_triggers.clear();
+		shard->lock.release_write();
+	}
+	if (_el) {
+		_el->update_rx_filters();
 	}
-	_summary_triggers.clear();
 }
 
 void EmpowerRXStats::add_summary_trigger(int iface, EtherAddress addr, uint32_t summary_id, int16_t limit, uint16_t period) {
-	SummaryTrigger * summary = new SummaryTrigger(iface, addr, summary_id, limit, period, _el, this);
-	for (DTIter qi = _summary_triggers.begin(); qi != _summary_triggers.end(); qi++) {
+	NeighborShard *shard = this->shard(iface);
+	if (!shard) {
+		click_chatter("%{element} :: %s :: invalid interface %d, ignoring",
+					  this,
+					  __func__,
+					  iface);
+		return;
+	}
+	SummaryTrigger * summary = new SummaryTrigger(iface, addr, summary_id, limit, period, _el, this, _summary_length, _summary_sample);
+	shard->lock.acquire_write();
+	for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
 		if (*summary == **qi) {
+			shard->lock.release_write();
 			click_chatter("%{element} :: %s :: summary already defined (%s), ignoring",
 						  this,
 						  __func__,
 						  summary->unparse().c_str());
+			delete summary;
 			return;
 		}
 	}
+	shard->summary_triggers.push_back(summary);
+	shard->lock.release_write();
+	if (_el) {
+		_el->update_rx_filters();
+	}
 	summary->_trigger_timer->assign(&send_summary_trigger_callback, (void *) summary);
-	summary->_trigger_timer->initialize(this);
-	summary->_trigger_timer->schedule_now();
-	_summary_triggers.push_back(summary);
+	summary->_trigger_timer->schedule_now(&_triggers_wheel);
 }
 
 void EmpowerRXStats::del_summary_trigger(uint32_t summary_id) {
-	for (DTIter qi = _summary_triggers.begin(); qi != _summary_triggers.end(); qi++) {
-		if ((*qi)->_trigger_id == summary_id) {
-			(*qi)->_trigger_timer->clear();
-			_summary_triggers.erase(qi);
-			delete *qi;
-			break;
+	for (int i = 0; i < _shards.size(); i++) {
+		NeighborShard *shard = _shards[i];
+		shard->lock.acquire_write();
+		for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
+			if ((*qi)->_trigger_id == summary_id) {
+				SummaryTrigger *summary = *qi;
+				shard->summary_triggers.erase(qi);
+				shard->lock.release_write();
+				delete summary;
+				if (_el) {
+					_el->update_rx_filters();
+				}
+				return;
+			}
+		}
+		shard->lock.release_write();
+	}
+}
+
+void EmpowerRXStats::station_bytes(EtherAddress addr, size_t &neighbors, size_t &summaries) {
+
+	neighbors = 0;
+	summaries = 0;
+
+	for (int i = 0; i < _shards.size(); i++) {
+		NeighborShard *shard = _shards[i];
+		shard->lock.acquire_read();
+		if (shard->stas.get_pointer(addr)) {
+			neighbors += sizeof(DstInfo);
+		}
+		if (shard->aps.get_pointer(addr)) {
+			neighbors += sizeof(DstInfo);
 		}
+		for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
+			if ((*qi)->_eth == addr) {
+				summaries += sizeof(SummaryTrigger) + (*qi)->_frames.bytes();
+			}
+		}
+		shard->lock.release_read();
+	}
+
+}
+
+void EmpowerRXStats::bytes(size_t &neighbors, size_t &summaries) {
+
+	neighbors = 0;
+	summaries = 0;
+
+	for (int i = 0; i < _shards.size(); i++) {
+		NeighborShard *shard = _shards[i];
+		shard->lock.acquire_read();
+		neighbors += shard->stas.memory() + shard->aps.memory();
+		summaries += shard->summary_triggers.capacity() * sizeof(SummaryTrigger *);
+		for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
+			summaries += sizeof(SummaryTrigger) + (*qi)->_frames.bytes();
+		}
+		shard->lock.release_read();
 	}
+
 }
 
 enum {
 	H_DEBUG,
-	H_NEIGHBORS,
 	H_RESET,
 	H_SIGNAL_OFFSET,
 	H_RSSI_MATCHES,
 	H_RSSI_TRIGGERS,
-	H_SUMMARY_TRIGGERS
+	H_SUMMARY_TRIGGERS,
+	H_EVICTIONS,
+	H_NEIGHBORS_JSON,
+	H_DATA_SAMPLE,
+	H_SAMPLES
 };
 
 String EmpowerRXStats::read_handler(Element *e, void *thunk) {
@@ -355,17 +637,18 @@ String EmpowerRXStats::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_RSSI_MATCHES: {
 		StringAccum sa;
-		for (RTIter qi = td->_rssi_triggers.begin(); qi != td->_rssi_triggers.end(); qi++) {
-			for (NTIter iter = td->stas.begin(); iter.live(); iter++) {
-				DstInfo *nfo = &iter.value();
-				if (!nfo)
-					continue;
-				if ((*qi)->matches(nfo)) {
+		for (int i = 0; i < td->_shards.size(); i++) {
+			NeighborShard *shard = td->_shards[i];
+			shard->lock.acquire_read();
+			for (RTIter qi = td->_rssi_triggers.begin(); qi != td->_rssi_triggers.end(); qi++) {
+				DstInfo *nfo = shard->stas.get_pointer((*qi)->_eth);
+				if (nfo && (*qi)->matches(nfo)) {
 					sa << (*qi)->unparse();
-					sa << " current " << nfo->_sma_rssi->avg();
+					sa << " current " << nfo->_sma_rssi.avg();
 					sa << "\n";
 				}
 			}
+			shard->lock.release_read();
 		}
 		return sa.take_string();
 	}
@@ -378,25 +661,63 @@ String EmpowerRXStats::read_handler(Element *e, void *thunk) {
 	}
 	case H_SUMMARY_TRIGGERS: {
 		StringAccum sa;
-		for (DTIter qi = td->_summary_triggers.begin(); qi != td->_summary_triggers.end(); qi++) {
-			sa << (*qi)->unparse() << "\n";
+		for (int i = 0; i < td->_shards.size(); i++) {
+			NeighborShard *shard = td->_shards[i];
+			shard->lock.acquire_read();
+			for (DTIter qi = shard->summary_triggers.begin(); qi != shard->summary_triggers.end(); qi++) {
+				sa << (*qi)->unparse() << "\n";
+			}
+			shard->lock.release_read();
 		}
 		return sa.take_string();
 	}
-	case H_NEIGHBORS: {
+	case H_NEIGHBORS_JSON: {
 		StringAccum sa;
-		for (NTIter iter = td->stas.begin(); iter.live(); iter++) {
-			DstInfo *nfo = &iter.value();
-			sa << nfo->unparse();
+		JsonWriter w(sa);
+		Timestamp now = Timestamp::now();
+		w.begin_array();
+		for (int i = 0; i < td->_shards.size(); i++) {
+			NeighborShard *shard = td->_shards[i];
+			shard->lock.acquire_read();
+			sa.reserve((shard->stas.size() + shard->aps.size()) * 224);
+			for (NTIter iter = shard->stas.begin(); iter.live(); iter++) {
+				iter.value().unparse_json(w, now);
+			}
+			for (NTIter iter = shard->aps.begin(); iter.live(); iter++) {
+				iter.value().unparse_json(w, now);
+			}
+			shard->lock.release_read();
 		}
-		for (NTIter iter = td->aps.begin(); iter.live(); iter++) {
-			DstInfo *nfo = &iter.value();
-			sa << nfo->unparse();
+		w.end_array();
+		sa << "\n";
+		return sa.take_string();
+	}
+	case H_SAMPLES: {
+		// the copy published last, as neighbor reports: the live
+		// tables are written by the RX threads without waiting
+		StringAccum sa;
+		EmpowerEpoch::Guard guard(td->epoch());
+		const NeighborSnapshot *neighbors = td->neighbors();
+		for (int i = 0; neighbors && i < neighbors->num_ifaces(); i++) {
+			for (int aps = 0; aps < 2; aps++) {
+				for (const NeighborSample *s = neighbors->begin(i, aps); s != neighbors->end(i, aps); s++) {
+					sa << i << (aps ? " ap " : " sta ") << s->_eth
+					   << " last_rssi " << s->_last_rssi
+					   << " last_std " << s->_last_std
+					   << " last_packets " << s->_last_packets
+					   << " hist_packets " << s->_hist_packets
+					   << " sma_rssi " << s->_sma_rssi << "\n";
+				}
+			}
 		}
 		return sa.take_string();
 	}
 	case H_SIGNAL_OFFSET:
 		return String(td->_signal_offset) + "\n";
+	case H_EVICTIONS:
+		return String(td->_evictions) + "\n";
+	case H_DATA_SAMPLE:
+		return String(td->_data_sample) + "\n";
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
 	default:
@@ -404,6 +725,41 @@ String EmpowerRXStats::read_handler(Element *e, void *thunk) {
 	}
 }
 
+// The cursor counts the neighbors listed by the previous chunks, in the
+// order of the shards, stations first
+int EmpowerRXStats::neighbors_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh) {
+
+	EmpowerRXStats *td = (EmpowerRXStats *) e;
+	int cursor = 0;
+	if (s && (!IntArg().parse(s, cursor) || cursor < 0)) {
+		return errh->error("bad cursor");
+	}
+
+	StringAccum sa;
+	int n = 0, end = cursor + CHUNK_NEIGHBORS;
+	for (int i = 0; i < td->_shards.size() && n < end; i++) {
+		NeighborShard *shard = td->_shards[i];
+		shard->lock.acquire_read();
+		for (int aps = 0; aps < 2 && n < end; aps++) {
+			NeighborTable &table = aps ? shard->aps : shard->stas;
+			if (n + (int) table.size() <= cursor) {
+				n += table.size();
+				continue;
+			}
+			for (NTIter iter = table.begin(); iter.live() && n < end; iter++, n++) {
+				if (n >= cursor) {
+					sa << iter.value().unparse();
+				}
+			}
+		}
+		shard->lock.release_read();
+	}
+
+	s = sa.take_string();
+	return n == end ? end : 0;
+
+}
+
 int EmpowerRXStats::write_handler(const String &in_s, Element *e, void *vparam,
 		ErrorHandler *errh) {
 
@@ -412,8 +768,13 @@ int EmpowerRXStats::write_handler(const String &in_s, Element *e, void *vparam,
 
 	switch ((intptr_t) vparam) {
 	case H_RESET: {
-		f->stas.clear();
-		f->aps.clear();
+		for (int i = 0; i < f->_shards.size(); i++) {
+			NeighborShard *shard = f->_shards[i];
+			shard->lock.acquire_write();
+			shard->stas.clear();
+			shard->aps.clear();
+			shard->lock.release_write();
+		}
 		break;
 	}
 	case H_SIGNAL_OFFSET: {
@@ -423,6 +784,12 @@ int EmpowerRXStats::write_handler(const String &in_s, Element *e, void *vparam,
 		f->_signal_offset = signal_offset;
 		break;
 	}
+	case H_DATA_SAMPLE: {
+		uint32_t data_sample;
+		if (!IntArg().parse(s, data_sample) || f->set_data_sample(data_sample) < 0)
+			return errh->error("data sample parameter must be positive");
+		break;
+	}
 	case H_DEBUG: {
 		bool debug;
 		if (!BoolArg().parse(s, debug))
@@ -435,16 +802,23 @@ int EmpowerRXStats::write_handler(const String &in_s, Element *e, void *vparam,
 }
 
 void EmpowerRXStats::add_handlers() {
-	add_read_handler("neighbors", read_handler, (void *) H_NEIGHBORS);
+	set_handler("neighbors", Handler::f_read | Handler::f_read_chunked, neighbors_handler);
+	add_read_handler("neighbors_json", read_handler, (void *) H_NEIGHBORS_JSON);
+	// read-only copies and counters, these can run off the router thread,
+	// see ControlSocket's HANDLER_THREAD
+	add_read_handler("samples", read_handler, (void *) H_SAMPLES, Handler::h_nonexclusive);
 	add_read_handler("summary_triggers", read_handler, (void *) H_SUMMARY_TRIGGERS);
+	add_read_handler("evictions", read_handler, (void *) H_EVICTIONS, Handler::h_nonexclusive);
 	add_read_handler("rssi_matches", read_handler, (void *) H_RSSI_MATCHES);
 	add_read_handler("rssi_triggers", read_handler, (void *) H_RSSI_TRIGGERS);
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
 	add_read_handler("signal_offset", read_handler, (void *) H_SIGNAL_OFFSET);
 	add_write_handler("signal_offset", write_handler, (void *) H_SIGNAL_OFFSET);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
+	add_read_handler("data_sample", read_handler, (void *) H_DATA_SAMPLE);
+	add_write_handler("data_sample", write_handler, (void *) H_DATA_SAMPLE);
 }
 
 EXPORT_ELEMENT(EmpowerRXStats)
-ELEMENT_REQUIRES(bitrate DstInfo Trigger SummaryTrigger RssiTrigger)
+ELEMENT_REQUIRES(bitrate DstInfo Trigger SummaryTrigger RssiTrigger Rollup)
 CLICK_ENDDECLS
@@ -4,8 +4,10 @@
 #include <click/element.hh>
 #include <click/etheraddress.hh>
 #include <click/hashtable.hh>
+#include <click/flathashtable.hh>
 #include <click/glue.hh>
 #include <click/timer.hh>
+#include <click/timerwheel.hh>
 #include <click/straccum.hh>
 #include <clicknet/wifi.h>
 #include <click/sync.hh>
@@ -13,6 +15,7 @@
 #include "rssi_trigger.hh"
 #include "dstinfo.hh"
 #include "empowerpacket.hh"
+#include "empowerepoch.hh"
 CLICK_DECLS
 
 /*
@@ -26,6 +29,14 @@ CLICK_DECLS
 
  =d
 
+ Frames received on input N go out unchanged on output N, so that data and
+ management frames already told apart, e.g. by EmpowerRxFrontEnd, can go
+ through the same element.
+
+ The power management bit of the frames sent by stations is passed on to
+ the EmpowerPowerSaveBuffer of the interface, if the EmpowerLVAPManager
+ has one.
+
  Keyword arguments are:
 
  =over 8
@@ -33,23 +44,136 @@ CLICK_DECLS
  =item EL
  An EmpowerLVAPManager element
 
+ =item SMA_PERIOD
+ Number of windows the moving RSSI average spans, at most 32. Default 13.
+
+ =item SILENT_WINDOWS
+ Neighbors are dropped after SILENT_WINDOWS windows without frames.
+ Default 50.
+
+ =item MAX_NEIGHBORS
+ Maximum number of stations and of access points tracked on each
+ interface. Once a table is full the neighbor heard least recently makes
+ room for the new one. Default 1024.
+
+ =item DATA_SAMPLE
+ Only one data frame in DATA_SAMPLE from a neighbor adds to its RSSI
+ statistics, the first one of each window always does. Management frames
+ always add to them. Frames are counted whether sampled or not. Default
+ 1, every frame.
+
+ =item SUMMARY_LENGTH
+ Number of frames a summary trigger can hold between two reports.
+ Default 1024.
+
+ =item SUMMARY_SAMPLE
+ Once a summary trigger is full, only one frame every SUMMARY_SAMPLE
+ replaces the oldest one and the others are dropped. Default 1, i.e.
+ always drop the oldest frame.
+
  =item DEBUG
  Turn debug on/off
 
  =back 8
 
+ Every PERIOD the statistics of each neighbor are rolled over and a
+ read-only copy of all of them is published, which neighbor reports are
+ built from without stopping the RX path.
+
+ On hot-swap the neighbors and the triggers are carried over from the old
+ EmpowerRXStats, following each interface to the one of the new
+ EmpowerLVAPManager serving the same resource element.
+
+ =h data_sample read/write
+ DATA_SAMPLE. The controller sets it with a set rx sample message too.
+
+ =h neighbors read-only
+ One line per station and access point heard. Chunked: ControlSocket's
+ READSTREAM sends it 64 lines at a time.
+
+ =h neighbors_json read-only
+ Same as neighbors, as a JSON array of objects. The time since the last
+ frame, last_received_msecs, is in msecs.
+
+ =h samples read-only
+ The copy published last, which neighbor reports carry: one line per
+ neighbor with its interface, sta or ap, its address and its RSSI
+ statistics as of the last PERIOD. Unlike neighbors, it does not read the
+ tables the RX path writes, and ControlSocket can call it off the router
+ thread.
+
  =a EmpowerLVAPManager
  */
 
-typedef HashTable<EtherAddress, DstInfo> NeighborTable;
+typedef FlatHashTable<EtherAddress, DstInfo> NeighborTable;
 typedef NeighborTable::iterator NTIter;
 
 typedef Vector<RssiTrigger *> RssiTriggersList;
 typedef RssiTriggersList::iterator RTIter;
+typedef HashTable<EtherAddress, RssiTriggersList> RssiTriggersIndex;
 
 typedef Vector<SummaryTrigger *> SummaryTriggersList;
 typedef SummaryTriggersList::iterator DTIter;
 
+// Neighbor tables and summary triggers of a single interface. Frames
+// are painted with the interface id and every interface is served by
+// its own thread, so the RX path only contends with the timers and the
+// handlers touching the same interface.
+class NeighborShard {
+public:
+	ReadWriteLock lock;
+	NeighborTable aps;
+	NeighborTable stas;
+	SummaryTriggersList summary_triggers;
+};
+
+// What neighbor reports carry about a neighbor, as of the last
+// run_timer() of EmpowerRXStats.
+struct NeighborSample {
+	EtherAddress _eth;
+	int _last_rssi;
+	int _last_std;
+	int _last_packets;
+	int _hist_packets;
+	int _sma_rssi;
+};
+
+// Immutable copy of the neighbor tables of every interface: the
+// stations, then the access points, of interface 0, then of interface
+// 1, and so on.
+class NeighborSnapshot {
+public:
+	NeighborSnapshot() {
+		_begin.push_back(0);
+	}
+	const NeighborSample *begin(int iface_id, bool aps) const {
+		return _samples.begin() + _begin[2 * iface_id + aps];
+	}
+	const NeighborSample *end(int iface_id, bool aps) const {
+		return _samples.begin() + _begin[2 * iface_id + aps + 1];
+	}
+	int num_ifaces() const {
+		return _begin.size() / 2;
+	}
+	// append the samples of the next table
+	void add(const NeighborTable &table) {
+		for (NeighborTable::const_iterator it = table.begin(); it.live(); it++) {
+			const DstInfo &nfo = it.value();
+			NeighborSample sample;
+			sample._eth = nfo._eth;
+			sample._last_rssi = nfo._last_rssi;
+			sample._last_std = nfo._last_std;
+			sample._last_packets = nfo._last_packets;
+			sample._hist_packets = nfo._hist_packets;
+			sample._sma_rssi = nfo._sma_rssi.avg();
+			_samples.push_back(sample);
+		}
+		_begin.push_back(_samples.size());
+	}
+private:
+	Vector<NeighborSample> _samples;
+	Vector<int> _begin;
+};
 
 class EmpowerLVAPManager;
 
@@ -60,11 +184,12 @@ public:
 	~EmpowerRXStats();
 
 	const char *class_name() const { return "EmpowerRXStats"; }
-	const char *port_count() const { return PORTS_1_1; }
+	const char *port_count() const { return "1-/="; }
 	const char *processing() const { return AGNOSTIC; }
 
 	int initialize(ErrorHandler *);
 	int configure(Vector<String> &, ErrorHandler *);
+	void take_state(Element *, ErrorHandler *);
 	void run_timer(Timer *);
 
 	Packet *simple_action(Packet *);
@@ -79,30 +204,74 @@ public:
 
 	void clear_triggers();
 
-	ReadWriteLock lock;
-
-	NeighborTable aps;
-	NeighborTable stas;
+	// -1 if data_sample is 0
+	int set_data_sample(uint32_t data_sample);
+
+	// The last n RSSI buckets of level of the neighbor addr of iface_id,
+	// see Rollup::history(), -1 if there is no such neighbor
+	int rssi_history(int iface_id, EtherAddress addr, int level, int n, RollupBucket *out, uint32_t &resolution);
+
+	// Bytes of the neighbor entries of addr and of the summary triggers
+	// on addr, over all the interfaces
+	void station_bytes(EtherAddress addr, size_t &neighbors, size_t &summaries);
+	// Same, for all the neighbors and summary triggers, tables included
+	void bytes(size_t &neighbors, size_t &summaries);
+
+	int num_shards() { return _shards.size(); }
+	NeighborShard *shard(int iface_id) {
+		if (iface_id < 0 || iface_id >= _shards.size()) {
+			return 0;
+		}
+		return _shards[iface_id];
+	}
+
+	// Last published copy of the neighbor tables. Readers must hold an
+	// EmpowerEpoch::Guard on epoch() for as long as they use it.
+	EmpowerEpoch *epoch() { return &_epoch; }
+	const NeighborSnapshot *neighbors() {
+		const NeighborSnapshot *neighbors = _neighbors;
+		click_read_fence();
+		return neighbors;
+	}
 
 private:
 
 	EmpowerLVAPManager *_el;
 	Timer _timer;
+	TimerWheel _triggers_wheel; // one entry per trigger
+
+	Vector<NeighborShard *> _shards;
+
+	NeighborSnapshot * volatile _neighbors;
+	Vector<NeighborSnapshot *> _retired;
+	Vector<uint32_t> _retired_epochs;
+	EmpowerEpoch _epoch;
 
 	RssiTriggersList _rssi_triggers;
-	SummaryTriggersList _summary_triggers;
+	RssiTriggersIndex _rssi_index; // same triggers, by target address
 
 	int _signal_offset;
 	unsigned _period; // in ms
 	unsigned _sma_period;
 	unsigned _max_silent_window_count; // in number of windows
+	uint32_t _max_neighbors; // per table and interface
+	uint32_t _evictions;
+	unsigned _summary_length;
+	unsigned _summary_sample;
+	uint32_t _data_sample;
 
 	bool _debug;
 
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 	static String read_handler(Element *, void *);
-
-	void update_neighbor(EtherAddress, bool, uint8_t, uint8_t);
+	// neighbors, CHUNK_NEIGHBORS a chunk
+	enum { CHUNK_NEIGHBORS = 64 };
+	static int neighbors_handler(int, String &, Element *, const Handler *, ErrorHandler *);
+
+	void update_neighbor(NeighborShard *, EtherAddress, bool, bool, uint8_t, uint8_t, const Timestamp &);
+	bool stale(const DstInfo *, const Timestamp &) const;
+	void make_room(NeighborTable &);
+	void publish(NeighborSnapshot *);
 
 };
 
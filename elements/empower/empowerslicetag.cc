@@ -0,0 +1,91 @@
+/*
+ * empowerslicetag.{cc,hh} -- tags the frames of a tenant with its slice
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerslicetag.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include "empowerlvapmanager.hh"
+CLICK_DECLS
+
+EmpowerSliceTag::EmpowerSliceTag() :
+	_el(0), _ssid_id(-1), _count(0), _drops(0) {
+}
+
+EmpowerSliceTag::~EmpowerSliceTag() {
+}
+
+int EmpowerSliceTag::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	if (Args(conf, this, errh)
+			.read_mp("SSID", AnyArg(), _ssid)
+			.read_mp("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.complete() < 0) {
+		return -1;
+	}
+
+	_ssid = cp_unquote(_ssid);
+	if (!_ssid) {
+		return errh->error("SSID must not be empty");
+	}
+
+	return 0;
+
+}
+
+Packet *EmpowerSliceTag::simple_action(Packet *p) {
+
+	int ssid_id = _ssid_id;
+
+	// looked up in the snapshot until an LVAP or a VAP brings the SSID
+	// in, the ID then stays the same
+	if (ssid_id < 0) {
+		EmpowerEpoch::Guard guard(_el->epoch());
+		const EmpowerStationHotTable *snapshot = _el->snapshot();
+		ssid_id = snapshot ? snapshot->ssid_id(_ssid) : -1;
+		if (ssid_id < 0) {
+			_drops++;
+			p->kill();
+			return 0;
+		}
+		_ssid_id = ssid_id;
+	}
+
+	SET_SLICE_ANNO(p, ssid_id + 1);
+	_count++;
+	return p;
+
+}
+
+String EmpowerSliceTag::read_handler(Element *e, void *thunk) {
+	EmpowerSliceTag *td = (EmpowerSliceTag *) e;
+	switch ((uintptr_t) thunk) {
+	case H_COUNT:
+		return String(td->_count) + "\n";
+	case H_DROPS:
+		return String(td->_drops) + "\n";
+	default:
+		return String();
+	}
+}
+
+void EmpowerSliceTag::add_handlers() {
+	add_read_handler("count", read_handler, (void *) H_COUNT);
+	add_read_handler("drops", read_handler, (void *) H_DROPS);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerSliceTag)
+ELEMENT_REQUIRES(EmpowerLVAPManager)
@@ -0,0 +1,96 @@
+#ifndef CLICK_EMPOWERSLICETAG_HH
+#define CLICK_EMPOWERSLICETAG_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerSliceTag(SSID, EL)
+
+=s EmPOWER
+
+Tags the frames of a tenant with its slice
+
+=d
+
+Sets the slice annotation of every frame to the SSID given, so that
+EmpowerQOSManager only queues it for the LVAPs and VAPs of that SSID:
+unicast frames for a station of another SSID are dropped, and group
+frames are copied to the stations and VAPs of the SSID only.
+
+Give each tenant its own ingress, e.g. a KernelTap on a tap device of its
+own, and tag its frames as they come in. Every KernelTap is drained by its
+own task with its own BURST, so a busy tenant cannot hold up the ingress
+of the others, and the taps can run on different threads. Each ingress
+needs its own EmpowerTee, which caches lookups and is not shared between
+threads; all of them can feed the same EmpowerQOSManager elements.
+
+The SSID is resolved once the LVAP manager has an LVAP or a VAP with it;
+frames received until then are dropped.
+
+Arguments are:
+
+=over 8
+
+=item SSID
+The SSID of the tenant.
+
+=item EL
+An EmpowerLVAPManager element.
+
+=back 8
+
+=h count read-only
+Frames tagged.
+
+=h drops read-only
+Frames dropped because the SSID was not known yet.
+
+=e
+
+  KernelTap(10.0.1.1/24, DEV_NAME tenant1, BURST 64)
+    -> EmpowerSliceTag(tenant1, EL el)
+    -> EmpowerTee(2, EL el);
+
+  KernelTap(10.0.2.1/24, DEV_NAME tenant2, BURST 16)
+    -> EmpowerSliceTag(tenant2, EL el)
+    -> EmpowerTee(2, EL el);
+
+=a EmpowerQOSManager, EmpowerTee, KernelTap
+*/
+
+class EmpowerSliceTag : public Element {
+
+public:
+
+	EmpowerSliceTag() CLICK_COLD;
+	~EmpowerSliceTag() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerSliceTag"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+	const char *processing() const		{ return AGNOSTIC; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	Packet *simple_action(Packet *);
+
+private:
+
+	class EmpowerLVAPManager *_el;
+	String _ssid;
+	// ID of _ssid in the EmpowerSSIDTable of the agent, -1 until known
+	int _ssid_id;
+
+	uint32_t _count;
+	uint32_t _drops;
+
+	enum { H_COUNT, H_DROPS };
+
+	static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
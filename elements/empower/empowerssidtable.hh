@@ -0,0 +1,73 @@
+#ifndef CLICK_EMPOWERSSIDTABLE_HH
+#define CLICK_EMPOWERSSIDTABLE_HH
+#include <click/config.h>
+#include <click/string.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+// Small integer IDs for the SSIDs of the LVAPs and VAPs of an agent, so
+// that management frames are matched against them with integer compares.
+// An SSID is interned when an ADD_LVAP or ADD_VAP brings it in and keeps
+// its ID for the life of the table: the SSIDs served by an agent are few,
+// and an LVAP may well come back with the same ones. The blank SSID has
+// no ID, it is always -1.
+class EmpowerSSIDTable {
+public:
+
+	// ID of ssid, allocated on first use
+	int intern(const String &ssid) {
+		if (!ssid) {
+			return -1;
+		}
+		HashTable<String, int>::iterator it = _ids.find(ssid);
+		if (it != _ids.end()) {
+			return it.value();
+		}
+		int id = _ssids.size();
+		_ssids.push_back(ssid);
+		_vlans.push_back(0);
+		_ids.set(ssid, id);
+		return id;
+	}
+
+	// ID of ssid, or -1 if no LVAP or VAP ever had it. Does not copy
+	// ssid, it can point into a frame
+	int lookup(const char *ssid, int len) const {
+		if (len <= 0) {
+			return -1;
+		}
+		HashTable<String, int>::const_iterator it = _ids.find(String::make_stable(ssid, len));
+		return it != _ids.end() ? it.value() : -1;
+	}
+
+	int lookup(const String &ssid) const {
+		return lookup(ssid.data(), ssid.length());
+	}
+
+	const String &ssid(int id) const {
+		return _ssids[id];
+	}
+
+	int size() const { return _ssids.size(); }
+
+	// 802.1Q tag control information of the uplink frames of the
+	// stations on the SSID with the given ID, 0 if they go untagged
+	uint16_t vlan(int id) const {
+		return (id >= 0 && id < _vlans.size()) ? _vlans[id] : 0;
+	}
+
+	void set_vlan(int id, uint16_t tci) {
+		_vlans[id] = tci;
+	}
+
+private:
+
+	HashTable<String, int> _ids;
+	Vector<String> _ssids;
+	Vector<uint16_t> _vlans;
+
+};
+
+CLICK_ENDDECLS
+#endif /* CLICK_EMPOWERSSIDTABLE_HH */
@@ -0,0 +1,219 @@
+/*
+ * empowerstatefile.{cc,hh} -- persistent state of an EmPOWER agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerstatefile.hh"
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/machine.hh>
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+CLICK_DECLS
+
+EmpowerStateFile::EmpowerStateFile() :
+		_fd(-1), _map(0), _map_size(0), _header(0), _slots(0), _nb_slots(0),
+		_dirty_min(0), _dirty_max(0) {
+}
+
+#if CLICK_USERLEVEL
+
+EmpowerStateFile::~EmpowerStateFile() {
+	if (_map) {
+		sync();
+		munmap(_map, _map_size);
+	}
+	if (_fd >= 0) {
+		close(_fd);
+	}
+}
+
+int EmpowerStateFile::open(const String &filename, uint32_t nb_slots, ErrorHandler *errh) {
+
+	_fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0600);
+	if (_fd < 0) {
+		return errh->error("%s: %s", filename.c_str(), strerror(errno));
+	}
+
+	// the header takes the first slot
+	_map_size = (size_t) (nb_slots + 1) * SLOT_SIZE;
+
+	struct stat st;
+	if (fstat(_fd, &st) < 0) {
+		return errh->error("%s: %s", filename.c_str(), strerror(errno));
+	}
+
+	bool fresh = (size_t) st.st_size != _map_size;
+	if (fresh && ftruncate(_fd, _map_size) < 0) {
+		return errh->error("%s: %s", filename.c_str(), strerror(errno));
+	}
+
+	void *map = mmap(0, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (map == MAP_FAILED) {
+		_map = 0;
+		return errh->error("%s: mmap: %s", filename.c_str(), strerror(errno));
+	}
+
+	_map = (uint8_t *) map;
+	_header = (Header *) _map;
+	_slots = (Slot *) (_map + SLOT_SIZE);
+	_nb_slots = nb_slots;
+
+	if (fresh || _header->magic != MAGIC || _header->format != FORMAT
+			|| _header->slot_size != SLOT_SIZE || _header->nb_slots != nb_slots) {
+		if (!fresh) {
+			errh->warning("%s: not a state file for %u slots, starting afresh", filename.c_str(), nb_slots);
+		}
+		memset(_map, 0, _map_size);
+		_header->magic = MAGIC;
+		_header->format = FORMAT;
+		_header->slot_size = SLOT_SIZE;
+		_header->nb_slots = nb_slots;
+		_header->version = 0;
+		_dirty_min = 0;
+		_dirty_max = nb_slots + 1;
+		sync();
+	}
+
+	for (uint32_t i = nb_slots; i > 0; i--) {
+		Slot *slot = &_slots[i - 1];
+		if (slot->used && slot->key_length + slot->length <= sizeof(slot->data)) {
+			_index.set(String((const char *) slot->data, slot->key_length), i - 1);
+		} else {
+			slot->used = 0;
+			_free.push_back(i - 1);
+		}
+	}
+
+	return 0;
+
+}
+
+#else
+
+// There is no file to map in the kernel. Nothing below is reached
+// without a map.
+
+EmpowerStateFile::~EmpowerStateFile() {
+}
+
+int EmpowerStateFile::open(const String &filename, uint32_t, ErrorHandler *errh) {
+	return errh->error("%s: state files are only supported at user level", filename.c_str());
+}
+
+#endif
+
+bool EmpowerStateFile::put(const String &key, const uint8_t *data, uint32_t length) {
+
+	if (!_map || !key.length() || key.length() > 255 || key.length() + length > sizeof(_slots[0].data)) {
+		return false;
+	}
+
+	uint32_t *index = _index.get_pointer(key);
+	Slot *slot;
+
+	if (index) {
+		slot = &_slots[*index];
+		if (slot->length == length && memcmp(slot->data + slot->key_length, data, length) == 0) {
+			return true;
+		}
+	} else {
+		if (_free.empty()) {
+			return false;
+		}
+		_index.set(key, _free.back());
+		index = _index.get_pointer(key);
+		_free.pop_back();
+		slot = &_slots[*index];
+	}
+
+	slot->used = 0;
+	click_write_fence();
+	slot->key_length = key.length();
+	slot->length = length;
+	memcpy(slot->data, key.data(), key.length());
+	memcpy(slot->data + key.length(), data, length);
+	click_write_fence();
+	slot->used = 1;
+
+	dirty(*index + 1);
+
+	return true;
+
+}
+
+void EmpowerStateFile::remove(const String &key) {
+	uint32_t *index = _index.get_pointer(key);
+	if (!index) {
+		return;
+	}
+	_slots[*index].used = 0;
+	dirty(*index + 1);
+	_free.push_back(*index);
+	_index.erase(key);
+}
+
+void EmpowerStateFile::keys(char prefix, Vector<String> &keys) const {
+	for (HashTable<String, uint32_t>::const_iterator it = _index.begin(); it.live(); it++) {
+		if (it.key()[0] == prefix) {
+			keys.push_back(it.key());
+		}
+	}
+}
+
+void EmpowerStateFile::records(char prefix, Vector<String> &records) const {
+	for (uint32_t i = 0; i < _nb_slots; i++) {
+		const Slot *slot = &_slots[i];
+		if (slot->used && slot->key_length && slot->data[0] == prefix) {
+			records.push_back(String((const char *) slot->data + slot->key_length, slot->length));
+		}
+	}
+}
+
+// index is in slots from the start of the file, the header is slot 0
+void EmpowerStateFile::dirty(uint32_t index) {
+	if (_dirty_min == _dirty_max) {
+		_dirty_min = index;
+		_dirty_max = index + 1;
+		return;
+	}
+	if (index < _dirty_min) {
+		_dirty_min = index;
+	}
+	if (index + 1 > _dirty_max) {
+		_dirty_max = index + 1;
+	}
+}
+
+void EmpowerStateFile::sync() {
+	if (!_map) {
+		return;
+	}
+#if CLICK_USERLEVEL
+	// the header changes with every controller message
+	msync(_map, SLOT_SIZE, MS_ASYNC);
+	if (_dirty_max > _dirty_min) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t start = ((size_t) _dirty_min * SLOT_SIZE) & ~(page - 1);
+		msync(_map + start, (size_t) _dirty_max * SLOT_SIZE - start, MS_ASYNC);
+	}
+#endif
+	_dirty_min = _dirty_max = 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(EmpowerStateFile)
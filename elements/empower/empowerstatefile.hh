@@ -0,0 +1,90 @@
+#ifndef CLICK_EMPOWERSTATEFILE_HH
+#define CLICK_EMPOWERSTATEFILE_HH
+#include <click/string.hh>
+#include <click/vector.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+class ErrorHandler;
+
+// Persistent copy of the state the controller installed on a WTP, kept
+// in a memory-mapped file so that a restarted agent can restore it
+// without waiting for the controller (see EmpowerLVAPManager STATE_FILE).
+//
+// The file is an array of fixed-size slots. The first one holds the
+// header, every other one either nothing or a record: a key naming what
+// the record describes, e.g. the LVAP of a station, and the record
+// proper, a controller message that recreates it. put() only writes a
+// slot when its content changes, so keeping the file current costs a
+// memcmp() per record in the common case. The kernel writes the pages
+// back; a crash of the agent loses nothing, sync() bounds what a crash
+// of the host can lose.
+//
+// A slot is invalidated before it is rewritten and validated after, so
+// an interrupted write loses that record only. Integers are in host byte
+// order: the file is not meant to move between hosts.
+class EmpowerStateFile {
+public:
+
+	enum { MAGIC = 0x454D5346, FORMAT = 1, SLOT_SIZE = 512 };
+
+	EmpowerStateFile();
+	~EmpowerStateFile();
+
+	// Map filename, created with nb_slots records if it does not exist or
+	// does not match. Records already in the file are kept.
+	int open(const String &filename, uint32_t nb_slots, ErrorHandler *errh);
+
+	// sequence number of the last controller message applied
+	uint32_t version() const { return _header->version; }
+	void set_version(uint32_t version) { _header->version = version; }
+
+	// Store the record of key, false if it does not fit or the file is full
+	bool put(const String &key, const uint8_t *data, uint32_t length);
+	bool put(const String &key, const String &data) {
+		return put(key, (const uint8_t *) data.data(), data.length());
+	}
+	void remove(const String &key);
+
+	// keys starting with prefix, and the records of those keys in slot
+	// order
+	void keys(char prefix, Vector<String> &keys) const;
+	void records(char prefix, Vector<String> &records) const;
+	int size() const { return _index.size(); }
+
+	// schedule the write back of the slots changed since the last call
+	void sync();
+
+private:
+
+	struct Header {
+		uint32_t magic;
+		uint32_t format;
+		uint32_t slot_size;
+		uint32_t nb_slots;
+		uint32_t version;
+	};
+
+	struct Slot {
+		volatile uint8_t used;
+		uint8_t key_length;
+		uint16_t length;
+		uint8_t data[SLOT_SIZE - 4]; // key, then record
+	};
+
+	int _fd;
+	uint8_t *_map;
+	size_t _map_size;
+	Header *_header;
+	Slot *_slots;
+	uint32_t _nb_slots;
+	HashTable<String, uint32_t> _index;
+	Vector<uint32_t> _free;
+	uint32_t _dirty_min;
+	uint32_t _dirty_max;
+
+	void dirty(uint32_t);
+
+};
+
+CLICK_ENDDECLS
+#endif
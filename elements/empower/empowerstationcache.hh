@@ -0,0 +1,36 @@
+#ifndef CLICK_EMPOWERSTATIONCACHE_HH
+#define CLICK_EMPOWERSTATIONCACHE_HH
+#include <click/config.h>
+#include <click/glue.hh>
+CLICK_DECLS
+
+// Direct mapped cache of station lookups, one per data-path element and
+// indexed by the last byte of the address. An entry is the slot a
+// station was found in and the generation of the snapshot it was found
+// in; it is only trusted if that snapshot is still the current one and
+// the slot still holds the station, so a torn or stale entry is merely
+// a miss.
+class EmpowerStationCache {
+public:
+
+	enum { SIZE = 64 };
+
+	EmpowerStationCache() {
+		memset(_entries, 0, sizeof(_entries));
+	}
+
+private:
+
+	struct Entry {
+		uint32_t _generation;
+		uint32_t _slot;
+	};
+
+	Entry _entries[SIZE];
+
+	friend class EmpowerStationHotTable;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,341 @@
+/*
+ * empowerstatsregion.{cc,hh} -- counters of an EmPOWER agent in shared memory
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerstatsregion.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/machine.hh>
+#include <click/straccum.hh>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "empowerlvapmanager.hh"
+#include "empowerqosmanager.hh"
+#include "empowerregmon.hh"
+CLICK_DECLS
+
+EmpowerStatsRegion::EmpowerStatsRegion() :
+		_el(0), _filename("/dev/shm/empower_stats"), _nb_records(4096), _period(1000),
+		_fd(-1), _map(0), _map_size(0), _header(0), _records(0), _timer(this),
+		_refreshes(0), _overflows(0), _debug(false) {
+	static_assert(sizeof(Record) == RECORD_SIZE, "stats record size");
+	static_assert(sizeof(Header) <= RECORD_SIZE, "stats header size");
+}
+
+EmpowerStatsRegion::~EmpowerStatsRegion() {
+}
+
+int EmpowerStatsRegion::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	int ret = Args(conf, this, errh)
+			.read_m("EL", ElementCastArg("EmpowerLVAPManager"), _el)
+			.read("FILE", FilenameArg(), _filename)
+			.read("RECORDS", _nb_records)
+			.read("PERIOD", _period)
+			.read("DEBUG", _debug)
+			.complete();
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (_nb_records == 0) {
+		return errh->error("RECORDS must be positive");
+	}
+
+	if (_period == 0) {
+		return errh->error("PERIOD must be positive");
+	}
+
+	return 0;
+
+}
+
+int EmpowerStatsRegion::initialize(ErrorHandler *errh) {
+
+	_fd = open(_filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (_fd < 0) {
+		return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+	}
+
+	// the header takes the first record
+	_map_size = (size_t) (_nb_records + 1) * RECORD_SIZE;
+
+	// a reader may hold the old mapping, so the file is resized rather
+	// than recreated
+	if (ftruncate(_fd, _map_size) < 0) {
+		return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+	}
+
+	void *map = mmap(0, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (map == MAP_FAILED) {
+		return errh->error("%s: mmap: %s", _filename.c_str(), strerror(errno));
+	}
+
+	_map = (uint8_t *) map;
+	_header = (Header *) _map;
+	_records = (Record *) (_map + RECORD_SIZE);
+
+	memset(_map, 0, _map_size);
+	_header->magic = MAGIC;
+	_header->format = FORMAT;
+	_header->record_size = RECORD_SIZE;
+	_header->nb_records = _nb_records;
+	_header->period = _period;
+
+	for (uint32_t i = _nb_records; i > 0; i--) {
+		_free.push_back(i - 1);
+	}
+	_refreshed.resize(_nb_records, 0);
+
+	_timer.initialize(this);
+	_timer.schedule_now();
+
+	return 0;
+
+}
+
+void EmpowerStatsRegion::cleanup(CleanupStage) {
+	if (_map) {
+		munmap(_map, _map_size);
+		_map = 0;
+	}
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+}
+
+void EmpowerStatsRegion::run_timer(Timer *) {
+	refresh();
+	_timer.reschedule_after_msec(_period);
+}
+
+// Write the counters of an entity in its record, taking a free one the
+// first time the entity is seen
+void EmpowerStatsRegion::publish(uint16_t schema, int iface, const uint8_t *key, uint32_t key_length,
+		const uint64_t *values, int nb_values) {
+
+	if (key_length > KEY_SIZE) {
+		key_length = KEY_SIZE;
+	}
+
+	StringAccum sa;
+	sa.append((const char *) &schema, sizeof(schema));
+	sa.append((const char *) &iface, sizeof(iface));
+	sa.append((const char *) key, key_length);
+	String name = sa.take_string();
+
+	uint32_t *index = _index.get_pointer(name);
+	Record *record;
+
+	if (index) {
+		record = &_records[*index];
+	} else {
+		if (_free.empty()) {
+			_overflows++;
+			return;
+		}
+		_index.set(name, _free.back());
+		index = _index.get_pointer(name);
+		_free.pop_back();
+		record = &_records[*index];
+	}
+
+	record->seq++;
+	click_write_fence();
+	record->schema = schema;
+	record->iface = iface;
+	memset(record->key, 0, KEY_SIZE);
+	if (key_length) {
+		memcpy(record->key, key, key_length);
+	}
+	memset(record->values, 0, sizeof(record->values));
+	memcpy(record->values, values, nb_values * sizeof(uint64_t));
+	click_write_fence();
+	record->seq++;
+
+	_refreshed[*index] = _refreshes;
+
+}
+
+void EmpowerStatsRegion::release(uint32_t index) {
+	Record *record = &_records[index];
+	record->seq++;
+	click_write_fence();
+	record->schema = SCHEMA_FREE;
+	click_write_fence();
+	record->seq++;
+	_free.push_back(index);
+}
+
+void EmpowerStatsRegion::refresh() {
+
+	_refreshes++;
+
+	int nb_ifaces = _el->num_ifaces();
+
+	Vector<uint64_t> lvaps(nb_ifaces, 0);
+	Vector<uint64_t> vaps(nb_ifaces, 0);
+	Vector<uint64_t> neighbors(nb_ifaces, 0);
+
+	for (LVAPIter it = _el->lvaps()->begin(); it.live(); it++) {
+		int iface = it.value()._iface_id;
+		if (iface >= 0 && iface < nb_ifaces) {
+			lvaps[iface]++;
+		}
+	}
+
+	for (VAPIter it = _el->vaps()->begin(); it.live(); it++) {
+		int iface = it.value()._iface_id;
+		if (iface >= 0 && iface < nb_ifaces) {
+			vaps[iface]++;
+		}
+	}
+
+	// neighbors, from the copy EmpowerRXStats published last
+	{
+		EmpowerEpoch::Guard guard(_el->ers()->epoch());
+		const NeighborSnapshot *snapshot = _el->ers()->neighbors();
+		for (int iface = 0; snapshot && iface < snapshot->num_ifaces() && iface < nb_ifaces; iface++) {
+			for (int aps = 0; aps < 2; aps++) {
+				for (const NeighborSample *s = snapshot->begin(iface, aps); s != snapshot->end(iface, aps); s++) {
+					uint64_t values[] = {
+						(uint64_t) (int64_t) s->_sma_rssi,
+						(uint64_t) (int64_t) s->_last_rssi,
+						(uint64_t) s->_last_std,
+						(uint64_t) s->_last_packets,
+						(uint64_t) s->_hist_packets,
+						(uint64_t) aps,
+					};
+					publish(SCHEMA_NEIGHBOR, iface, s->_eth.data(), 6, values, sizeof(values) / sizeof(values[0]));
+					neighbors[iface]++;
+				}
+			}
+		}
+	}
+
+	static const empower_regmon_types types[] = { EMPOWER_REGMON_TX, EMPOWER_REGMON_RX, EMPOWER_REGMON_ED };
+
+	for (int iface = 0; iface < nb_ifaces; iface++) {
+
+		uint64_t counts[] = { lvaps[iface], vaps[iface], neighbors[iface] };
+		publish(SCHEMA_IFACE, iface, 0, 0, counts, sizeof(counts) / sizeof(counts[0]));
+
+		EmpowerRegmon *regmon = _el->regmon(iface);
+		for (unsigned t = 0; regmon && t < sizeof(types) / sizeof(types[0]); t++) {
+			RegmonWindow w;
+			if (!regmon->window(types[t], _period * 1000, w)) {
+				continue;
+			}
+			uint8_t key = types[t];
+			uint64_t values[] = { w._count, w._min, w._max, w._mean, w._p50, w._p90, w._p99, w._busy };
+			publish(SCHEMA_CHANNEL, iface, &key, 1, values, sizeof(values) / sizeof(values[0]));
+		}
+
+		EmpowerQOSManager *eqm = _el->eqm(iface);
+		for (TRIter it = eqm->rules()->begin(); it != eqm->rules()->end(); it++) {
+			TrafficRuleQueue *trq = it.value();
+			TrafficRuleCounters c = trq->counters();
+			uint8_t key[KEY_SIZE];
+			uint32_t ssid_length = trq->_tr._ssid.length() < KEY_SIZE - 2 ? trq->_tr._ssid.length() : KEY_SIZE - 2;
+			key[0] = trq->_tr._dscp;
+			key[1] = ssid_length;
+			memcpy(key + 2, trq->_tr._ssid.data(), ssid_length);
+			uint64_t values[] = {
+				trq->size(),
+				c._transm_pkts,
+				c._transm_bytes,
+				c._drops,
+				c._codel_drops,
+				c._starvations,
+				c._deficit_used,
+				c._max_queue_length,
+			};
+			publish(SCHEMA_QUEUE, iface, key, 2 + ssid_length, values, sizeof(values) / sizeof(values[0]));
+		}
+
+		MinstrelNeighborTable *table = _el->rc(iface)->neighbors();
+		for (MinstrelIter it = table->begin(); it.live(); it++) {
+			const MinstrelDstInfo &nfo = it.value();
+			if (!nfo.nrates) {
+				continue;
+			}
+			uint64_t values[] = {
+				(uint64_t) nfo.rates[nfo.max_tp_rate],
+				(uint64_t) nfo.rates[nfo.max_tp_rate2],
+				(uint64_t) nfo.rates[nfo.max_prob_rate],
+				(uint64_t) nfo.probability[nfo.max_tp_rate],
+				(uint64_t) nfo.packet_count,
+				(uint64_t) nfo.sample_count,
+				(uint64_t) nfo.ht,
+			};
+			publish(SCHEMA_RATE, iface, nfo.eth.data(), 6, values, sizeof(values) / sizeof(values[0]));
+		}
+
+	}
+
+	// free the records of the entities that are gone
+	Vector<String> gone;
+	for (HashTable<String, uint32_t>::iterator it = _index.begin(); it.live(); it++) {
+		if (_refreshed[it.value()] != _refreshes) {
+			release(it.value());
+			gone.push_back(it.key());
+		}
+	}
+	for (int i = 0; i < gone.size(); i++) {
+		_index.erase(gone[i]);
+	}
+
+	_header->timestamp = Timestamp::now().msecval();
+	click_write_fence();
+	_header->generation++;
+
+	if (_debug) {
+		click_chatter("%{element} :: %s :: records %d free %d",
+					  this,
+					  __func__,
+					  _index.size(),
+					  _free.size());
+	}
+
+}
+
+enum {
+	H_STATS,
+};
+
+String EmpowerStatsRegion::read_handler(Element *e, void *thunk) {
+	EmpowerStatsRegion *td = (EmpowerStatsRegion *) e;
+	StringAccum sa;
+	switch ((uintptr_t) thunk) {
+	case H_STATS:
+		sa << "records " << td->_index.size()
+		   << " free " << td->_free.size()
+		   << " refreshes " << td->_refreshes
+		   << " overflows " << td->_overflows << "\n";
+		return sa.take_string();
+	default:
+		return String();
+	}
+}
+
+void EmpowerStatsRegion::add_handlers() {
+	add_read_handler("stats", read_handler, (void *) H_STATS);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerStatsRegion)
+ELEMENT_REQUIRES(userlevel EmpowerLVAPManager)
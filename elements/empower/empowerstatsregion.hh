@@ -0,0 +1,185 @@
+#ifndef CLICK_EMPOWERSTATSREGION_HH
+#define CLICK_EMPOWERSTATSREGION_HH
+#include <click/element.hh>
+#include <click/hashtable.hh>
+#include <click/string.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerStatsRegion(EL[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Publishes the counters of an EmPOWER agent in shared memory
+
+=d
+
+Maps FILE, by default in /dev/shm, and keeps a binary copy of the
+counters the text handlers of EmpowerRXStats, EmpowerRegmon,
+EmpowerQOSManager and Minstrel report, refreshed every PERIOD. A
+monitoring tool maps the same file read-only and polls it at whatever
+rate it likes: nothing it does reaches the router threads, and nothing
+is formatted or parsed on either side.
+
+The file starts with a header of RECORD_SIZE bytes: magic 0x454D5352,
+format, record size, number of records, period in msec, generation and
+the time of the last refresh in msec since the epoch. Fixed-size
+records follow, each one a sequence number, a schema, an interface, a
+key of 40 bytes and 10 counters of 64 bits. Integers are in host byte
+order.
+
+The sequence number of a record is odd while it is being written. A
+reader copies the record, then reads the sequence number again and
+retries if it was odd or has changed. The generation of the header goes
+up by one after every refresh.
+
+Schemas, with the key and the counters of each one, are:
+
+=over 8
+
+=item 1, neighbor
+Station or access point heard on the interface, as of the last report
+of EmpowerRXStats. Key: address. Counters: moving average of the RSSI,
+RSSI, its standard deviation, frames in the last period, frames since
+the start (RSSIs are signed dBm), 1 for an access point.
+
+=item 2, channel
+Register of the interface over the last PERIOD. Key: register type, 0
+for TX, 1 for RX, 2 for ED. Counters: samples, minimum, maximum, mean,
+50th, 90th and 99th percentiles, busy share in 1/10000.
+
+=item 3, queue
+Traffic rule queue of the interface. Key: DSCP, length of the SSID, SSID.
+Counters: frames queued, frames sent, bytes sent, drops, CoDel drops,
+starved rounds, deficit used, longest queue.
+
+=item 4, rate
+Rate control of a station of the interface. Key: address. Counters:
+best throughput rate, second best, best probability rate (in 500 kbps
+units, MCS index for HT), probability of the best throughput rate in
+1/18000, frames sent, frames sampled, 1 for HT.
+
+=item 5, interface
+Counters: LVAPs, VAPs, neighbors heard.
+
+=back 8
+
+A record whose entity is gone, e.g. a station that left, is freed at
+the next refresh: its schema becomes 0. The region is rewritten from
+scratch when the element is initialized.
+
+Keyword arguments are:
+
+=over 8
+
+=item EL
+An EmpowerLVAPManager element
+
+=item FILE
+The file to map, default is /dev/shm/empower_stats
+
+=item RECORDS
+Number of records, default is 4096. Entities beyond that are not
+published.
+
+=item PERIOD
+Refresh period (in msec), default is 1000
+
+=item DEBUG
+Turn debug on/off
+
+=back 8
+
+=h stats read-only
+Records used, records free, refreshes, entities not published for lack
+of records
+
+=a EmpowerLVAPManager, EmpowerRXStats, EmpowerRegmon, EmpowerQOSManager,
+Minstrel
+*/
+
+class EmpowerStatsRegion : public Element {
+public:
+
+	enum { MAGIC = 0x454D5352, FORMAT = 1, RECORD_SIZE = 128, KEY_SIZE = 40, NB_VALUES = 10 };
+
+	enum {
+		SCHEMA_FREE = 0,
+		SCHEMA_NEIGHBOR = 1,
+		SCHEMA_CHANNEL = 2,
+		SCHEMA_QUEUE = 3,
+		SCHEMA_RATE = 4,
+		SCHEMA_IFACE = 5,
+	};
+
+	EmpowerStatsRegion() CLICK_COLD;
+	~EmpowerStatsRegion() CLICK_COLD;
+
+	const char *class_name() const { return "EmpowerStatsRegion"; }
+	const char *port_count() const { return PORTS_0_0; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+	void run_timer(Timer *);
+
+private:
+
+	struct Header {
+		uint32_t magic;
+		uint32_t format;
+		uint32_t record_size;
+		uint32_t nb_records;
+		uint32_t period;
+		volatile uint32_t generation;
+		volatile uint64_t timestamp;
+	};
+
+	struct Record {
+		volatile uint32_t seq;
+		uint16_t schema;
+		uint16_t iface;
+		uint8_t key[KEY_SIZE];
+		uint64_t values[NB_VALUES];
+	};
+
+	class EmpowerLVAPManager *_el;
+	String _filename;
+	uint32_t _nb_records;
+	uint32_t _period; // msecs
+
+	int _fd;
+	uint8_t *_map;
+	size_t _map_size;
+	Header *_header;
+	Record *_records;
+
+	// record of schema, interface and key
+	HashTable<String, uint32_t> _index;
+	Vector<uint32_t> _free;
+	// refresh that last wrote each record
+	Vector<uint32_t> _refreshed;
+
+	Timer _timer;
+
+	uint32_t _refreshes;
+	uint32_t _overflows;
+
+	bool _debug;
+
+	void refresh();
+	void publish(uint16_t schema, int iface, const uint8_t *key, uint32_t key_length,
+			const uint64_t *values, int nb_values);
+	void release(uint32_t);
+
+	static String read_handler(Element *, void *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -24,7 +24,7 @@
 #include "empowerlvapmanager.hh"
 CLICK_DECLS
 
-EmpowerTee::EmpowerTee() : _el(0) {
+EmpowerTee::EmpowerTee() : _el(0), _generation(0), _activations(0), _mtbl_generation(0) {
 }
 
 int EmpowerTee::configure(Vector<String> &conf, ErrorHandler *errh) {
@@ -63,7 +63,8 @@ void EmpowerTee::push(int, Packet *p) {
 
 	// frame is unicast then send only to the correct interface
 	if (!dst.is_broadcast() && !dst.is_group()) {
-		EmpowerStationState *ess = _el->get_ess(dst);
+		EmpowerEpoch::Guard guard(_el->epoch());
+		const EmpowerStationHot *ess = _el->get_hot(dst, &_stations);
 		if (!ess) {
 			p->kill();
 			return;
@@ -72,17 +73,144 @@ void EmpowerTee::push(int, Packet *p) {
 		return;
 	}
 
-	// if multicast or broadcast then send to all ports
-	int n = noutputs();
-	for (int i = 0; i < n - 1; i++) {
-		if (Packet *q = p->clone()) {
-			output(i).push(q);
+	// if multicast or broadcast then send to the ports that have a receiver
+	uint32_t ports;
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+		ports = receiving_ports(dst);
+	}
+
+	int last = -1;
+	for (int i = 0; i < noutputs(); i++) {
+		if (i < MAX_MASKED_PORTS && !(ports & (1U << i))) {
+			continue;
+		}
+		if (last >= 0) {
+			if (Packet *q = p->clone()) {
+				output(last).push(q);
+			}
+		}
+		last = i;
+	}
+
+	if (last < 0) {
+		p->kill();
+		return;
+	}
+
+	output(last).push(p);
+
+}
+
+void EmpowerTee::push_batch(int, Packet *head) {
+
+	PacketBatch out[MAX_MASKED_PORTS];
+
+	{
+		EmpowerEpoch::Guard guard(_el->epoch());
+
+		while (Packet *p = PacketBatch::pop(head)) {
+
+			if (p->length() < sizeof(struct click_ether)) {
+				click_chatter("%{element} :: %s :: packet too small: %d vs %d",
+							  this,
+							  __func__,
+							  p->length(),
+							  sizeof(struct click_ether));
+				p->kill();
+				continue;
+			}
+
+			click_ether *eh = (click_ether *) p->data();
+			EtherAddress dst = EtherAddress(eh->ether_dhost);
+
+			if (!dst.is_broadcast() && !dst.is_group()) {
+				const EmpowerStationHot *ess = _el->get_hot(dst, &_stations);
+				if (!ess) {
+					p->kill();
+				} else {
+					batch_append(out, ess->_iface_id, p);
+				}
+				continue;
+			}
+
+			uint32_t ports = receiving_ports(dst);
+
+			int last = -1;
+			for (int i = 0; i < noutputs(); i++) {
+				if (i < MAX_MASKED_PORTS && !(ports & (1U << i))) {
+					continue;
+				}
+				if (last >= 0) {
+					if (Packet *q = p->clone()) {
+						batch_append(out, last, q);
+					}
+				}
+				last = i;
+			}
+
+			if (last < 0) {
+				p->kill();
+			} else {
+				batch_append(out, last, p);
+			}
+
+		}
+	}
+
+	for (int i = 0; i < MAX_MASKED_PORTS; i++) {
+		if (!out[i].empty()) {
+			checked_output_push_batch(i, out[i].take());
+		}
+	}
+
+}
+
+// Outputs (bit i for output i) whose interface has a station that can
+// receive dst.
+uint32_t EmpowerTee::receiving_ports(EtherAddress dst) {
+
+	const EmpowerStationHotTable *snapshot = _el->snapshot();
+	EmpowerMulticastTable *mtbl = _el->mtbl();
+
+	// any associated LVAP can receive broadcast and unsnooped groups
+	if (!mtbl || !EmpowerMulticastTable::is_snooped(dst)) {
+		uint32_t ports = 0;
+		for (int i = 0; i < noutputs() && i < MAX_MASKED_PORTS; i++) {
+			if (snapshot->associated_lvaps(i).size()) {
+				ports |= 1U << i;
+			}
 		}
+		return ports;
 	}
-	output(n - 1).push(p);
+
+	if (_generation != snapshot->generation() || _activations != snapshot->activations()
+			|| _mtbl_generation != mtbl->generation() || _ports.size() >= PORT_CACHE_SIZE) {
+		_ports.clear();
+		_generation = snapshot->generation();
+		_activations = snapshot->activations();
+		_mtbl_generation = mtbl->generation();
+	}
+
+	uint32_t *cached = _ports.get_pointer(dst);
+	if (cached) {
+		return *cached;
+	}
+
+	uint32_t ports = 0;
+	const EmpowerMulticastBitmap *receivers = mtbl->receivers(dst);
+	for (int i = receivers ? receivers->next(0) : -1; i >= 0; i = receivers->next(i + 1)) {
+		const EmpowerStationHot *ess = snapshot->get(mtbl->station(i), &_stations);
+		if (ess && ess->_iface_id >= 0 && ess->_iface_id < MAX_MASKED_PORTS) {
+			ports |= 1U << ess->_iface_id;
+		}
+	}
+
+	_ports.set(dst, ports);
+	return ports;
 
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(EmpowerTee)
-ELEMENT_REQUIRES(userlevel)
+ELEMENT_REQUIRES(EmpowerLVAPManager)
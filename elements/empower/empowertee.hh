@@ -1,6 +1,9 @@
 #ifndef CLICK_EMPOWERTEE_HH
 #define CLICK_EMPOWERTEE_HH
 #include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+#include "empowerstationcache.hh"
 CLICK_DECLS
 
 /*
@@ -9,7 +12,14 @@ CLICK_DECLS
  * =s basictransfer
  * duplicates packets
  * =d
- * EmpowerTee sends a copy of each incoming packet out each output.N.
+ * EmpowerTee sends a unicast packet out the output of the interface of
+ * its LVAP, and a copy of a broadcast or multicast packet out the output
+ * of each interface that has a station to receive it: any associated
+ * LVAP, or a member of the group if snooping tracks it. Output i is
+ * interface i.
+ *
+ * A batch of frames is looked up under a single epoch guard, and the
+ * frames bound for each output are pushed to it together.
  */
 
 class EmpowerTee : public Element {
@@ -25,10 +35,30 @@ public:
 	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 
 	void push(int, Packet *);
+	void push_batch(int, Packet *);
 
 private:
 
+	// the masks of the outputs of snooped groups are cached until the
+	// snapshot or the multicast receivers change
+	enum { PORT_CACHE_SIZE = 256, MAX_MASKED_PORTS = 32 };
+
 	class EmpowerLVAPManager *_el;
+	EmpowerStationCache _stations;
+	HashTable<EtherAddress, uint32_t> _ports;
+	uint32_t _generation;
+	uint32_t _activations;
+	uint32_t _mtbl_generation;
+
+	uint32_t receiving_ports(EtherAddress);
+	// frames of a batch for outputs past MAX_MASKED_PORTS go one by one
+	inline void batch_append(PacketBatch *out, int port, Packet *p) {
+		if (port < MAX_MASKED_PORTS) {
+			out[port].append(p);
+		} else {
+			checked_output_push(port, p);
+		}
+	}
 
 };
 
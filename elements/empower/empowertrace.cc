@@ -0,0 +1,244 @@
+/*
+ * empowertrace.{cc,hh} -- per-hop latency of sampled packets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowertrace.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+EmpowerTrace::EmpowerTrace() :
+	_sample(1000), _mask(0), _slots(0), _nhops(0), _completed(0) {
+	for (int i = 0; i <= MAX_HOPS; i++) {
+		_histograms[i].clear();
+	}
+}
+
+EmpowerTrace::~EmpowerTrace() {
+}
+
+int EmpowerTrace::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	uint32_t slots = 1024;
+
+	if (Args(conf, this, errh)
+			.read("SAMPLE", _sample)
+			.read("SLOTS", slots)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (_sample < 1) {
+		return errh->error("SAMPLE must be positive");
+	}
+
+	if (slots < 1 || slots > 65536) {
+		return errh->error("SLOTS must be between 1 and 65536");
+	}
+
+	uint32_t size = 1;
+	while (size < slots) {
+		size <<= 1;
+	}
+
+	_slots = new Slot[size];
+	for (uint32_t i = 0; i < size; i++) {
+		_slots[i]._id = 0;
+		_slots[i]._hops = 0;
+	}
+	_mask = size - 1;
+
+	return 0;
+
+}
+
+void EmpowerTrace::cleanup(CleanupStage) {
+	delete[] _slots;
+	_slots = 0;
+}
+
+int EmpowerTrace::add_hop(const String &name) {
+	for (int i = 0; i < _nhops; i++) {
+		if (_names[i] == name) {
+			return i;
+		}
+	}
+	if (_nhops == MAX_HOPS) {
+		return -1;
+	}
+	_names[_nhops] = name;
+	return _nhops++;
+}
+
+// nsec from a to b, 0 if b is earlier
+uint32_t EmpowerTrace::elapsed(const Timestamp &a, const Timestamp &b) {
+	if (b <= a) {
+		return 0;
+	}
+	Timestamp::value_type nsec = (b - a).nsecval();
+	return nsec < 0xFFFFFFFFU ? nsec : 0xFFFFFFFFU;
+}
+
+void EmpowerTrace::start(Packet *p, int hop) {
+
+	// 0 marks the packets not traced, that ID is skipped
+	uint32_t id = _next.fetch_and_add(1) + 1;
+	if (!id) {
+		return;
+	}
+
+	Slot &s = _slots[id & _mask];
+	Timestamp now = Timestamp::now();
+
+	// the slot is taken over from whatever trace it held, that trace
+	// no longer finds its ID in it
+	s._id = 0;
+	click_write_fence();
+
+	s._start = now;
+	if (p->timestamp_anno() && p->timestamp_anno() < now) {
+		s._start = p->timestamp_anno();
+	}
+	s._last = now;
+	memset(s._delta, 0, sizeof(s._delta));
+	s._delta[hop] = elapsed(s._start, now);
+	s._hops = 1 << hop;
+
+	click_write_fence();
+	s._id = id;
+
+	SET_TRACE_ANNO(p, id);
+
+}
+
+void EmpowerTrace::stamp(Packet *p, int hop, bool end) {
+
+	uint32_t id = TRACE_ANNO(p);
+	Slot &s = _slots[id & _mask];
+
+	if (s._id != id) {
+		SET_TRACE_ANNO(p, 0);
+		return;
+	}
+
+	Timestamp now = Timestamp::now();
+	s._delta[hop] += elapsed(s._last, now);
+	s._hops |= 1 << hop;
+	s._last = now;
+
+	if (end) {
+		// copied out before the slot is released
+		Slot done = s;
+		s._id = 0;
+		SET_TRACE_ANNO(p, 0);
+		complete(done, now);
+	}
+
+}
+
+void EmpowerTrace::complete(const Slot &s, const Timestamp &now) {
+	_lock.acquire();
+	for (int i = 0; i < _nhops; i++) {
+		if (s._hops & (1 << i)) {
+			_histograms[i].add(s._delta[i]);
+		}
+	}
+	_histograms[MAX_HOPS].add(elapsed(s._start, now));
+	_completed++;
+	_lock.release();
+}
+
+String EmpowerTrace::read_handler(Element *e, void *thunk) {
+
+	EmpowerTrace *td = (EmpowerTrace *) e;
+	StringAccum sa;
+
+	td->_lock.acquire();
+
+	switch ((uintptr_t) thunk) {
+	case H_LATENCY:
+		for (int i = 0; i <= td->_nhops; i++) {
+			const LatencyHistogram &h = td->_histograms[i < td->_nhops ? i : MAX_HOPS];
+			sa << (i < td->_nhops ? td->_names[i] : String("total"))
+			   << " traces " << h._count
+			   << " mean " << h.mean()
+			   << " p50 " << h.percentile(50)
+			   << " p90 " << h.percentile(90)
+			   << " p99 " << h.percentile(99)
+			   << " max " << h._max << "\n";
+		}
+		break;
+	case H_HISTOGRAM:
+		for (int i = 0; i <= td->_nhops; i++) {
+			const LatencyHistogram &h = td->_histograms[i < td->_nhops ? i : MAX_HOPS];
+			sa << (i < td->_nhops ? td->_names[i] : String("total")) << "\n";
+			for (int b = 0; b < LatencyHistogram::NBUCKETS; b++) {
+				if (h._buckets[b]) {
+					sa << "  " << (b ? 1U << b : 0) << " " << h._buckets[b] << "\n";
+				}
+			}
+		}
+		break;
+	case H_TRACES:
+		sa << "started " << td->_next.value() << " completed " << td->_completed << "\n";
+		break;
+	case H_SAMPLE:
+		sa << td->_sample << "\n";
+		break;
+	}
+
+	td->_lock.release();
+
+	return sa.take_string();
+
+}
+
+int EmpowerTrace::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+
+	EmpowerTrace *td = (EmpowerTrace *) e;
+	String s = cp_uncomment(in_s);
+
+	switch ((uintptr_t) thunk) {
+	case H_SAMPLE: {
+		uint32_t sample;
+		if (!IntArg().parse(s, sample) || sample < 1)
+			return errh->error("sample parameter must be positive");
+		td->_sample = sample;
+		break;
+	}
+	case H_RESET:
+		td->_lock.acquire();
+		for (int i = 0; i <= MAX_HOPS; i++) {
+			td->_histograms[i].clear();
+		}
+		td->_lock.release();
+		break;
+	}
+
+	return 0;
+
+}
+
+void EmpowerTrace::add_handlers() {
+	add_read_handler("latency", read_handler, (void *) H_LATENCY);
+	add_read_handler("histogram", read_handler, (void *) H_HISTOGRAM);
+	add_read_handler("traces", read_handler, (void *) H_TRACES);
+	add_read_handler("sample", read_handler, (void *) H_SAMPLE);
+	add_write_handler("sample", write_handler, (void *) H_SAMPLE);
+	add_write_handler("reset", write_handler, (void *) H_RESET);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerTrace)
@@ -0,0 +1,167 @@
+#ifndef CLICK_EMPOWERTRACE_HH
+#define CLICK_EMPOWERTRACE_HH
+#include <click/element.hh>
+#include <click/atomic.hh>
+#include <click/packet_anno.hh>
+#include <click/sync.hh>
+#include <click/timestamp.hh>
+#include "latencyhistogram.hh"
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerTrace([SAMPLE, SLOTS])
+
+=s EmPOWER
+
+Per-hop latency of sampled packets through the graph
+
+=d
+
+Collects the traces of the EmpowerTracePoint elements that name it. The
+first point of a path, with START set, starts a trace for one packet in
+SAMPLE: the trace ID goes in the packet's TRACE_ANNO, the trace itself
+in one of SLOTS slots. Every point the packet then goes through adds the
+time since the last one to the trace, under its HOP. The point with END
+set completes the trace: its hops, and their total, go into a latency
+histogram each.
+
+The time a packet spent before the first point is counted too, under
+the first hop, if the element the packet comes from set its timestamp
+annotation, as KernelTap and FromDevice do.
+
+A packet that is not sampled costs every point one annotation test. The
+traces of packets dropped on the way are never completed; their slots
+are taken over later by new traces. Traces whose slot was taken over
+before they completed are lost, so SLOTS should be larger than the
+number of sampled packets on the way at once.
+
+Arguments are:
+
+=over 8
+
+=item SAMPLE
+One packet in SAMPLE is traced. Default is 1000.
+
+=item SLOTS
+Traces on the way at once. Rounded up to a power of two. Default is 1024.
+
+=back 8
+
+=h latency read-only
+One line per hop, in the order of the path, and one for the total:
+traces, mean, 50th, 90th and 99th percentiles and maximum, in nsec.
+Percentiles are upper bounds, the histograms have a bucket per power of
+two.
+
+=h histogram read-only
+For each hop, the number of traces in each bucket, by its smallest
+latency in nsec.
+
+=h traces read-only
+Traces started and completed.
+
+=h sample read/write
+One packet in SAMPLE is traced.
+
+=h reset write-only
+Clears the histograms.
+
+=e
+
+  trace :: EmpowerTrace(SAMPLE 500);
+
+  kt :: KernelTap(10.0.0.1/24, BURST 500, DEV_NAME empower0)
+    -> EmpowerTracePoint(trace, HOP tap, START true)
+    -> tee;
+
+  tee[0] -> MarkIPHeader(14) -> Paint(0)
+    -> EmpowerTracePoint(trace, HOP tee)
+    -> eqm_0
+    -> EmpowerTracePoint(trace, HOP queue)
+    -> [1] sched_0;
+
+  sched_0 :: PrioSched()
+    -> EmpowerTracePoint(trace, HOP sched)
+    -> WifiSeq() -> rc_0
+    -> EmpowerTracePoint(trace, HOP rate_control)
+    -> RadiotapEncap()
+    -> EmpowerTracePoint(trace, HOP encap, END true)
+    -> ToDevice(moni0);
+
+=a EmpowerTracePoint
+*/
+
+// bytes 8-11, on the layer 2 paths of EmPOWER only, where DST_IP6_ANNO
+// is not used. 0 for packets not traced
+#define TRACE_ANNO_OFFSET		8
+#define TRACE_ANNO(p)			((p)->anno_u32(TRACE_ANNO_OFFSET))
+#define SET_TRACE_ANNO(p, v)		((p)->set_anno_u32(TRACE_ANNO_OFFSET, (v)))
+
+class EmpowerTrace : public Element {
+
+public:
+
+	enum { MAX_HOPS = 8 };
+
+	EmpowerTrace() CLICK_COLD;
+	~EmpowerTrace() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerTrace"; }
+	const char *port_count() const		{ return PORTS_0_0; }
+	int configure_phase() const		{ return CONFIGURE_PHASE_INFO; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	uint32_t sample() const { return _sample; }
+
+	// index of the hop with the given name, -1 if there are MAX_HOPS
+	// already. Points with the same hop share it
+	int add_hop(const String &);
+
+	// starts a trace for p at hop
+	void start(Packet *p, int hop);
+
+	// adds hop to the trace of p, and completes it if end
+	void stamp(Packet *p, int hop, bool end);
+
+private:
+
+	// written by the points a packet goes through, one at a time
+	struct Slot {
+		volatile uint32_t _id;
+		uint32_t _hops;
+		Timestamp _start;
+		Timestamp _last;
+		uint32_t _delta[MAX_HOPS];
+	};
+
+	uint32_t _sample;
+	uint32_t _mask;
+	Slot *_slots;
+	atomic_uint32_t _next;
+
+	String _names[MAX_HOPS];
+	int _nhops;
+
+	// histograms only change under _lock, the last one is the total
+	Spinlock _lock;
+	// in nsec
+	LatencyHistogram _histograms[MAX_HOPS + 1];
+	uint32_t _completed;
+
+	static uint32_t elapsed(const Timestamp &, const Timestamp &);
+	void complete(const Slot &, const Timestamp &);
+
+	enum { H_LATENCY, H_HISTOGRAM, H_TRACES, H_SAMPLE, H_RESET };
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,69 @@
+/*
+ * empowertracepoint.{cc,hh} -- time stamps sampled packets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowertracepoint.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include "empowertrace.hh"
+CLICK_DECLS
+
+EmpowerTracePoint::EmpowerTracePoint() :
+	_trace(0), _hop(-1), _start(false), _end(false), _count(0) {
+}
+
+EmpowerTracePoint::~EmpowerTracePoint() {
+}
+
+int EmpowerTracePoint::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	_name = name();
+
+	if (Args(conf, this, errh)
+			.read_mp("TRACE", ElementCastArg("EmpowerTrace"), _trace)
+			.read_p("HOP", _name)
+			.read("START", _start)
+			.read("END", _end)
+			.complete() < 0) {
+		return -1;
+	}
+
+	return 0;
+
+}
+
+int EmpowerTracePoint::initialize(ErrorHandler *errh) {
+	_hop = _trace->add_hop(_name);
+	if (_hop < 0) {
+		return errh->error("%s has %d hops already", _trace->name().c_str(), EmpowerTrace::MAX_HOPS);
+	}
+	return 0;
+}
+
+Packet *EmpowerTracePoint::simple_action(Packet *p) {
+
+	if (_start && ++_count >= _trace->sample()) {
+		_count = 0;
+		_trace->start(p, _hop);
+	} else if (TRACE_ANNO(p)) {
+		_trace->stamp(p, _hop, _end);
+	}
+
+	return p;
+
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(EmpowerTrace)
+EXPORT_ELEMENT(EmpowerTracePoint)
@@ -0,0 +1,75 @@
+#ifndef CLICK_EMPOWERTRACEPOINT_HH
+#define CLICK_EMPOWERTRACEPOINT_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerTracePoint(TRACE, [HOP, START, END])
+
+=s EmPOWER
+
+Time stamps sampled packets for an EmpowerTrace
+
+=d
+
+Packets go through unchanged. A packet TRACE traces spent the time since
+the previous point in HOP, which is what the latency of HOP in TRACE
+adds up. With START, one packet in the SAMPLE of TRACE starts a trace
+here; with END, traces are complete here.
+
+Arguments are:
+
+=over 8
+
+=item TRACE
+An EmpowerTrace element.
+
+=item HOP
+Name of the hop ending at this point. Points of the same path in
+parallel, e.g. one per interface, can share a hop. Default is the name
+of the element.
+
+=item START
+Boolean. Start traces. Default is false.
+
+=item END
+Boolean. Complete traces. Default is false.
+
+=back 8
+
+=a EmpowerTrace
+*/
+
+class EmpowerTracePoint : public Element {
+
+public:
+
+	EmpowerTracePoint() CLICK_COLD;
+	~EmpowerTracePoint() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerTracePoint"; }
+	const char *port_count() const		{ return PORTS_1_1; }
+	const char *processing() const		{ return AGNOSTIC; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+
+	Packet *simple_action(Packet *);
+
+private:
+
+	class EmpowerTrace *_trace;
+	String _name;
+	int _hop;
+	bool _start;
+	bool _end;
+
+	// packets since the last one traced, START only
+	uint32_t _count;
+
+};
+
+CLICK_ENDDECLS
+#endif
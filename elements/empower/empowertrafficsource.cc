@@ -0,0 +1,344 @@
+/*
+ * empowertrafficsource.{cc,hh} -- generates a mix of downlink flows for
+ * benchmarks
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowertrafficsource.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/heap.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+EmpowerTrafficSource::EmpowerTrafficSource() :
+	_src_ip(htonl(0x0A000001)), _dst_ip(htonl(0x0A000100)), _burst(32), _limit(-1),
+	_stop(false), _active(true), _task(this), _count(0) {
+	uint8_t src[6] = { 0x02, 0xFF, 0x00, 0x00, 0x00, 0x00 };
+	_src = EtherAddress(src);
+}
+
+EmpowerTrafficSource::~EmpowerTrafficSource() {
+}
+
+// "DST RATE DSCP SIZE[/WEIGHT]..."
+int EmpowerTrafficSource::parse_flow(const String &in_s, Flow &flow, ErrorHandler *errh) {
+
+	Vector<String> tokens;
+	cp_spacevec(in_s, tokens);
+
+	if (tokens.size() < 4) {
+		return errh->error("FLOW %<%s%>: expected DST RATE DSCP SIZE...", in_s.c_str());
+	}
+
+	if (!EtherAddressArg().parse(tokens[0], flow._dst)) {
+		return errh->error("FLOW %<%s%>: bad destination", in_s.c_str());
+	}
+
+	if (!IntArg().parse(tokens[1], flow._rate) || !flow._rate) {
+		return errh->error("FLOW %<%s%>: RATE must be positive", in_s.c_str());
+	}
+
+	int dscp;
+	if (!IntArg().parse(tokens[2], dscp) || dscp < 0 || dscp > 63) {
+		return errh->error("FLOW %<%s%>: DSCP must be between 0 and 63", in_s.c_str());
+	}
+	flow._dscp = dscp;
+
+	if (tokens.size() - 3 > MAX_SIZES) {
+		return errh->error("FLOW %<%s%>: at most %d sizes", in_s.c_str(), (int) MAX_SIZES);
+	}
+
+	uint32_t min_length = sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp);
+	uint32_t total = 0;
+
+	for (int i = 3; i < tokens.size(); i++) {
+		String size = tokens[i], weight = "1";
+		int slash = size.find_left('/');
+		if (slash >= 0) {
+			weight = size.substring(slash + 1);
+			size = size.substring(0, slash);
+		}
+		uint32_t s, w;
+		if (!IntArg().parse(size, s) || s < min_length || s > 1514) {
+			return errh->error("FLOW %<%s%>: sizes must be between %u and 1514", in_s.c_str(), min_length);
+		}
+		if (!IntArg().parse(weight, w) || !w) {
+			return errh->error("FLOW %<%s%>: weights must be positive", in_s.c_str());
+		}
+		flow._sizes.push_back(s);
+		flow._weights.push_back(w);
+		total += w;
+	}
+
+	// spread the odds over the pick table
+	uint32_t acc = 0;
+	int t = 0;
+	for (int i = 0; i < PICKS; i++) {
+		while (t < flow._weights.size() - 1 && (uint64_t) i * total >= (uint64_t) (acc + flow._weights[t]) * PICKS) {
+			acc += flow._weights[t];
+			t++;
+		}
+		flow._pick[i] = t;
+	}
+
+	flow._interval = 1000000000ULL / flow._rate;
+	flow._count = 0;
+
+	return 0;
+
+}
+
+int EmpowerTrafficSource::configure(Vector<String> &conf, ErrorHandler *errh) {
+
+	Vector<String> flows;
+
+	if (Args(conf, this, errh)
+			.read_all("FLOW", AnyArg(), flows)
+			.read("SRC", _src)
+			.read("SRC_IP", _src_ip)
+			.read("DST_IP", _dst_ip)
+			.read("BURST", _burst)
+			.read("LIMIT", _limit)
+			.read("STOP", _stop)
+			.read("ACTIVE", _active)
+			.complete() < 0) {
+		return -1;
+	}
+
+	if (!flows.size()) {
+		return errh->error("no FLOW given");
+	}
+
+	if (_burst < 1) {
+		return errh->error("BURST must be positive");
+	}
+
+	_flows.resize(flows.size());
+	for (int i = 0; i < flows.size(); i++) {
+		if (parse_flow(cp_uncomment(flows[i]), _flows[i], errh) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+
+}
+
+// The frame of flow i with length bytes
+Packet *EmpowerTrafficSource::make_template(int i, uint32_t length) {
+
+	WritablePacket *p = Packet::make(Packet::default_headroom, 0, length, 0);
+	if (!p) {
+		return 0;
+	}
+
+	memset(p->data(), 0, length);
+
+	click_ether *eh = (click_ether *) p->data();
+	memcpy(eh->ether_dhost, _flows[i]._dst.data(), 6);
+	memcpy(eh->ether_shost, _src.data(), 6);
+	eh->ether_type = htons(ETHERTYPE_IP);
+
+	click_ip *ip = (click_ip *) (eh + 1);
+	ip->ip_v = 4;
+	ip->ip_hl = sizeof(click_ip) >> 2;
+	ip->ip_tos = _flows[i]._dscp << 2;
+	ip->ip_len = htons(length - sizeof(click_ether));
+	ip->ip_ttl = 64;
+	ip->ip_p = IP_PROTO_UDP;
+	ip->ip_src = _src_ip;
+	ip->ip_dst.s_addr = htonl(ntohl(_dst_ip.addr()) + i);
+	ip->ip_sum = click_in_cksum((const unsigned char *) ip, sizeof(click_ip));
+
+	click_udp *udp = (click_udp *) (ip + 1);
+	udp->uh_sport = htons(1024);
+	udp->uh_dport = htons(5001 + _flows[i]._dscp);
+	udp->uh_ulen = htons(length - sizeof(click_ether) - sizeof(click_ip));
+
+	return p;
+
+}
+
+int EmpowerTrafficSource::initialize(ErrorHandler *errh) {
+
+	for (int i = 0; i < _flows.size(); i++) {
+		Flow &flow = _flows[i];
+		for (int s = 0; s < flow._sizes.size(); s++) {
+			Packet *p = make_template(i, flow._sizes[s]);
+			if (!p) {
+				return errh->error("out of memory");
+			}
+			flow._templates.push_back(p);
+		}
+	}
+
+	restart();
+
+	ScheduleInfo::initialize_task(this, &_task, _active, errh);
+	return 0;
+
+}
+
+void EmpowerTrafficSource::cleanup(CleanupStage) {
+	for (int i = 0; i < _flows.size(); i++) {
+		for (int s = 0; s < _flows[i]._templates.size(); s++) {
+			_flows[i]._templates[s]->kill();
+		}
+		_flows[i]._templates.clear();
+	}
+}
+
+// Every flow is due now, staggered by a fraction of its interval so that
+// flows of the same rate do not go in lockstep
+void EmpowerTrafficSource::restart() {
+	int64_t now = Timestamp::now_steady().nsecval();
+	_heap.clear();
+	for (int i = 0; i < _flows.size(); i++) {
+		int64_t offset = _flows[i]._interval * click_random(0, 1023) / 1024;
+		_heap.push_back(Due(now + offset, i));
+		push_heap(_heap.begin(), _heap.end(), DueLess());
+	}
+}
+
+bool EmpowerTrafficSource::run_task(Task *) {
+
+	if (!_active) {
+		return false;
+	}
+
+	if (_limit >= 0 && _count >= (uint64_t) _limit) {
+		if (_stop) {
+			router()->please_stop_driver();
+		}
+		return false;
+	}
+
+	Timestamp ts = Timestamp::now_steady();
+	int64_t now = ts.nsecval();
+	int n = 0;
+
+	if (!_count) {
+		_start = ts;
+	}
+
+	while (n < _burst && _heap[0].first <= now) {
+
+		Due &due = _heap[0];
+		Flow &flow = _flows[due.second];
+
+		Packet *p = flow._templates[flow._pick[click_random() & (PICKS - 1)]]->clone();
+		if (!p) {
+			break;
+		}
+
+		flow._count++;
+		_count++;
+		n++;
+		output(0).push(p);
+
+		due.first += flow._interval;
+		if (due.first < now - MAX_LAG_NSEC) {
+			due.first = now;
+		}
+		change_heap(_heap.begin(), _heap.end(), _heap.begin(), DueLess());
+
+		if (_limit >= 0 && _count >= (uint64_t) _limit) {
+			break;
+		}
+
+	}
+
+	if (n) {
+		_last = ts;
+	}
+
+	_task.fast_reschedule();
+	return n > 0;
+
+}
+
+String EmpowerTrafficSource::read_handler(Element *e, void *thunk) {
+	EmpowerTrafficSource *s = (EmpowerTrafficSource *) e;
+	switch ((uintptr_t) thunk) {
+	case H_COUNT:
+		return String(s->_count) + "\n";
+	case H_FLOWS: {
+		StringAccum sa;
+		for (int i = 0; i < s->_flows.size(); i++) {
+			const Flow &flow = s->_flows[i];
+			sa << flow._dst << " rate " << flow._rate << " dscp " << (int) flow._dscp
+			   << " count " << flow._count << "\n";
+		}
+		return sa.take_string();
+	}
+	case H_PPS: {
+		uint64_t nsec = s->_count ? (uint64_t) (s->_last - s->_start).nsecval() : 0;
+		return String(nsec ? s->_count * 1000000000 / nsec : 0) + "\n";
+	}
+	case H_ACTIVE:
+		return String(s->_active) + "\n";
+	default:
+		return String();
+	}
+}
+
+int EmpowerTrafficSource::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh) {
+	EmpowerTrafficSource *s = (EmpowerTrafficSource *) e;
+	switch ((uintptr_t) thunk) {
+	case H_ACTIVE: {
+		bool active;
+		if (!BoolArg().parse(cp_uncomment(in_s), active)) {
+			return errh->error("active parameter must be boolean");
+		}
+		if (active && !s->_active) {
+			s->restart();
+		}
+		s->_active = active;
+		if (active && !s->_task.scheduled()) {
+			s->_task.reschedule();
+		}
+		break;
+	}
+	case H_RESET:
+		s->_count = 0;
+		for (int i = 0; i < s->_flows.size(); i++) {
+			s->_flows[i]._count = 0;
+		}
+		s->_start = s->_last = Timestamp();
+		s->restart();
+		if (s->_active && !s->_task.scheduled()) {
+			s->_task.reschedule();
+		}
+		break;
+	}
+	return 0;
+}
+
+void EmpowerTrafficSource::add_handlers() {
+	add_read_handler("count", read_handler, (void *) H_COUNT);
+	add_read_handler("flows", read_handler, (void *) H_FLOWS);
+	add_read_handler("pps", read_handler, (void *) H_PPS);
+	add_read_handler("active", read_handler, (void *) H_ACTIVE, Handler::f_checkbox);
+	add_write_handler("active", write_handler, (void *) H_ACTIVE);
+	add_write_handler("reset", write_handler, (void *) H_RESET, Handler::f_button);
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(EmpowerTrafficSource)
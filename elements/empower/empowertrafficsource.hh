@@ -0,0 +1,166 @@
+#ifndef CLICK_EMPOWERTRAFFICSOURCE_HH
+#define CLICK_EMPOWERTRAFFICSOURCE_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timestamp.hh>
+#include <click/etheraddress.hh>
+#include <click/ipaddress.hh>
+#include <click/pair.hh>
+CLICK_DECLS
+
+/*
+=c
+
+EmpowerTrafficSource(FLOW, ...[, I<KEYWORDS>])
+
+=s EmPOWER
+
+Generates a mix of downlink flows for benchmarks
+
+=d
+
+Emits IPv4 UDP Ethernet frames to many destinations, each one at its
+own rate, with its own frame sizes and DSCP, for benchmarking the
+downlink data path (EmpowerTee, EmpowerQOSManager and what follows)
+with a realistic traffic mix.
+
+Every FLOW argument is a destination: "DST RATE DSCP SIZE...", where
+DST is the Ethernet address frames are sent to, RATE the frames per
+second, DSCP the DSCP of the frames, and each SIZE a frame length,
+Ethernet header included, with an optional weight, as in "1500/6". The
+size of every frame is drawn at random, with the weights as odds.
+
+The frames of every flow and size are built when the router starts; a
+frame sent is a clone of its template, so the cost of the generator
+hardly depends on the mix. Flows are served in the order their next
+frame is due, BURST frames per task run at most. A flow that falls
+behind by more than 10 ms skips the frames it missed rather than
+bursting them.
+
+Keyword arguments are:
+
+=over 8
+
+=item FLOW
+A flow, as above. Can be given many times.
+
+=item SRC
+Source Ethernet address of the frames. Default is 02:FF:00:00:00:00.
+
+=item SRC_IP, DST_IP
+Source address of the frames, and destination address of the first
+flow; flow I is sent to DST_IP + I. Defaults are 10.0.0.1 and 10.0.1.0.
+
+=item BURST
+Number of frames pushed per task run at most. Default is 32.
+
+=item LIMIT
+Number of frames to send, -1 means no limit. Default is -1.
+
+=item STOP
+Stop the driver once LIMIT frames have been sent. Default is false.
+
+=item ACTIVE
+Whether frames are sent. Default is true.
+
+=back 8
+
+=h count read-only
+Number of frames sent.
+
+=h flows read-only
+Destination, rate, DSCP and frames sent of every flow.
+
+=h pps read-only
+Frames per second since the first one was sent.
+
+=h active read/write
+Whether frames are sent.
+
+=h reset write-only
+Reset the counters and the clock.
+
+=e
+
+  EmpowerTrafficSource(FLOW 02:00:00:00:00:00 1000 46 200,
+                       FLOW 02:00:00:00:00:01 5000 0 64/4 576/2 1500/4,
+                       FLOW 02:00:00:00:00:02 2000 10 1500)
+    -> tee :: EmpowerTee(1, EL el)
+    -> ...
+
+=a EmpowerBenchSource, EmpowerTee, EmpowerQOSManager, FastUDPSrc
+*/
+
+class EmpowerTrafficSource : public Element {
+
+public:
+
+	EmpowerTrafficSource() CLICK_COLD;
+	~EmpowerTrafficSource() CLICK_COLD;
+
+	const char *class_name() const		{ return "EmpowerTrafficSource"; }
+	const char *port_count() const		{ return PORTS_0_1; }
+	const char *processing() const		{ return PUSH; }
+
+	int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+	int initialize(ErrorHandler *) CLICK_COLD;
+	void cleanup(CleanupStage) CLICK_COLD;
+	void add_handlers() CLICK_COLD;
+
+	bool run_task(Task *);
+
+private:
+
+	enum { MAX_SIZES = 16, PICKS = 256 };
+	enum { MAX_LAG_NSEC = 10000000 };
+
+	struct Flow {
+		EtherAddress _dst;
+		uint32_t _rate;
+		uint8_t _dscp;
+		uint64_t _interval;	// nanoseconds between two frames
+		Vector<uint32_t> _sizes;
+		Vector<uint32_t> _weights;
+		Vector<Packet *> _templates;
+		// template of every 1/PICKS of the odds
+		uint8_t _pick[PICKS];
+		uint64_t _count;
+	};
+
+	// when the next frame of a flow is due, and the flow
+	typedef Pair<int64_t, int> Due;
+
+	struct DueLess {
+		bool operator()(const Due &a, const Due &b) const {
+			return a.first < b.first;
+		}
+	};
+
+	Vector<Flow> _flows;
+	Vector<Due> _heap;
+	EtherAddress _src;
+	IPAddress _src_ip;
+	IPAddress _dst_ip;
+	int _burst;
+	int64_t _limit;
+	bool _stop;
+	bool _active;
+	Task _task;
+
+	uint64_t _count;
+	Timestamp _start;
+	Timestamp _last;
+
+	int parse_flow(const String &, Flow &, ErrorHandler *);
+	Packet *make_template(int, uint32_t);
+	void restart();
+
+	enum { H_COUNT, H_FLOWS, H_PPS, H_ACTIVE, H_RESET };
+
+	static String read_handler(Element *, void *);
+	static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
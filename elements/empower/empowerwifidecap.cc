@@ -29,8 +29,12 @@
 #include "empowerlvapmanager.hh"
 CLICK_DECLS
 
+static const char * const log_sites[] = {
+	"too_small", "invalid_dir", "not_authenticated", "not_associated"
+};
+
 EmpowerWifiDecap::EmpowerWifiDecap() :
-		_el(0), _debug(false) {
+		_el(0), _debug(false), _log(log_sites, NB_LOGS) {
 }
 
 EmpowerWifiDecap::~EmpowerWifiDecap() {
@@ -50,7 +54,7 @@ void
 EmpowerWifiDecap::push(int, Packet *p) {
 
 	if (p->length() < sizeof(struct click_wifi)) {
-		click_chatter("%{element} :: %s :: packet too small: %d vs %d",
+		empower_chatter_limited(_log, LOG_TOO_SMALL, "%{element} :: %s :: packet too small: %d vs %d",
 				      this,
 				      __func__,
 				      p->length(),
@@ -66,8 +70,16 @@ EmpowerWifiDecap::push(int, Packet *p) {
 	if ((w->i_fc[1] & WIFI_FC1_DIR_MASK) == WIFI_FC1_DIR_DSTODS)
 		wifi_header_size += WIFI_ADDR_LEN;
 
-	if (WIFI_QOS_HAS_SEQ(w))
+	bool amsdu = false;
+
+	if (WIFI_QOS_HAS_SEQ(w)) {
+		if (p->length() >= wifi_header_size + sizeof(uint16_t)) {
+			uint16_t qos;
+			memcpy(&qos, p->data() + wifi_header_size, sizeof(qos));
+			amsdu = le16_to_cpu(qos) & WIFI_QOS_CONTROL_AMSDU_PRESENT;
+		}
 		wifi_header_size += sizeof(uint16_t);
+	}
 
 	struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
 
@@ -93,33 +105,31 @@ EmpowerWifiDecap::push(int, Packet *p) {
 
 	uint8_t dir = w->i_fc[1] & WIFI_FC1_DIR_MASK;
 
-	EtherAddress dst;
-	EtherAddress src;
-	EtherAddress bssid;
+	// where the addresses are in the header, the Ethernet header is
+	// made out of them in place
+	const uint8_t *dst_p;
+	const uint8_t *src_p;
+	const uint8_t *bssid_p;
 
 	switch (dir) {
 	case WIFI_FC1_DIR_NODS:
-		dst = EtherAddress(w->i_addr1);
-		src = EtherAddress(w->i_addr2);
-		bssid = EtherAddress(w->i_addr3);
+	case WIFI_FC1_DIR_DSTODS:
+		dst_p = w->i_addr1;
+		src_p = w->i_addr2;
+		bssid_p = w->i_addr3;
 		break;
 	case WIFI_FC1_DIR_TODS:
-		bssid = EtherAddress(w->i_addr1);
-		src = EtherAddress(w->i_addr2);
-		dst = EtherAddress(w->i_addr3);
+		bssid_p = w->i_addr1;
+		src_p = w->i_addr2;
+		dst_p = w->i_addr3;
 		break;
 	case WIFI_FC1_DIR_FROMDS:
-		dst = EtherAddress(w->i_addr1);
-		bssid = EtherAddress(w->i_addr2);
-		src = EtherAddress(w->i_addr3);
-		break;
-	case WIFI_FC1_DIR_DSTODS:
-		dst = EtherAddress(w->i_addr1);
-		src = EtherAddress(w->i_addr2);
-		bssid = EtherAddress(w->i_addr3);
+		dst_p = w->i_addr1;
+		bssid_p = w->i_addr2;
+		src_p = w->i_addr3;
 		break;
 	default:
-		click_chatter("%{element} :: %s :: invalid dir %d",
+		empower_chatter_limited(_log, LOG_INVALID_DIR, "%{element} :: %s :: invalid dir %d",
 				      this,
 				      __func__,
 				      dir);
@@ -127,20 +137,26 @@ EmpowerWifiDecap::push(int, Packet *p) {
 		return;
 	}
 
-    EmpowerStationState *ess = _el->get_ess(src);
+	EtherAddress dst = EtherAddress(dst_p);
+	EtherAddress src = EtherAddress(src_p);
+	unsigned dst_off = dst_p - p->data();
+	unsigned src_off = src_p - p->data();
+
+	EmpowerEpoch::Guard guard(_el->epoch());
+	const EmpowerStationHot *ess = _el->get_hot(src, &_stations);
 
-    if (!ess) {
+	if (!ess) {
 		p->kill();
 		return;
 	}
 
-	if (ess->_lvap_bssid != bssid) {
+	if (ess->_lvap_bssid != EtherAddress(bssid_p)) {
 		p->kill();
 		return;
 	}
 
 	if (!ess->_authentication_status) {
-		click_chatter("%{element} :: %s :: station %s not authenticated",
+		empower_chatter_limited(_log, LOG_NOT_AUTHENTICATED, "%{element} :: %s :: station %s not authenticated",
 				      this,
 				      __func__,
 				      src.unparse().c_str());
@@ -149,7 +165,7 @@ EmpowerWifiDecap::push(int, Packet *p) {
 	}
 
 	if (!ess->_association_status) {
-		click_chatter("%{element} :: %s :: station %s not associated",
+		empower_chatter_limited(_log, LOG_NOT_ASSOCIATED, "%{element} :: %s :: station %s not associated",
 				      this,
 				      __func__,
 				      src.unparse().c_str());
@@ -163,12 +179,16 @@ EmpowerWifiDecap::push(int, Packet *p) {
 		return;
 	}
 
+	if (unlikely(ess->_timeline & LVAPTimeline::AWAIT_UL)) {
+		_el->timeline_frame(ess, LVAPTimeline::FIRST_UL);
+	}
+
 	WritablePacket *p_out = p->uniqueify();
 	if (!p_out) {
 		return;
 	}
 
-	TxPolicyInfo * txp = _el->get_txp(src);
+	TxPolicyInfo * txp = lookup_txp(ess);
 
 	// frame must be encapsulated in another Ethernet frame
 	if (ess->_encap) {
@@ -187,47 +207,170 @@ EmpowerWifiDecap::push(int, Packet *p) {
 
 		txp->update_rx(p_out->length());
 
-		if (Packet *clone = p->clone())
+		if (Packet *clone = p_out->clone())
 			output(1).push(clone);
 
-		output(0).push(p);
+		output(0).push(p_out);
 
 		return;
 
 	}
 
+	if (amsdu) {
+		push_amsdu(p_out, wifi_header_size, src, ess->_set_mask, ess->_vlan_tci, txp);
+		return;
+	}
+
 	// normal wifi decap
-	uint16_t ether_type;
-	if (!memcmp(WIFI_LLC_HEADER, p_out->data() + wifi_header_size, WIFI_LLC_HEADER_LEN)) {
-		memcpy(&ether_type, p_out->data() + wifi_header_size + sizeof(click_llc) - 2, 2);
-	} else {
+	if (memcmp(WIFI_LLC_HEADER, p_out->data() + wifi_header_size, WIFI_LLC_HEADER_LEN)) {
 		p_out->kill();
 		return;
 	}
 
-	p_out->pull(wifi_header_size + sizeof(struct click_llc));
-
-	p_out = p_out->push_mac_header(14);
-
-	if (!p_out) {
-		return;
+	// the Ethernet header ends where the LLC header does, with its type
+	// already there: only the addresses move, forward, into the tail of
+	// the 802.11 header. The source goes first, it lands past any
+	// address; if the two addresses are in Ethernet order, one move does
+	unsigned start = wifi_header_size + sizeof(struct click_llc) - sizeof(struct click_ether);
+	unsigned char *data = p_out->data();
+	if (ess->_vlan_tci) {
+		// the tag goes between the addresses and the type, which then
+		// start 4 bytes earlier, over either address: they are saved
+		// first
+		uint8_t addrs[2 * WIFI_ADDR_LEN];
+		memcpy(addrs, data + dst_off, WIFI_ADDR_LEN);
+		memcpy(addrs + WIFI_ADDR_LEN, data + src_off, WIFI_ADDR_LEN);
+		start -= 4;
+		click_ether_vlan *vlan = (click_ether_vlan *) (data + start);
+		memcpy(vlan, addrs, sizeof(addrs));
+		vlan->ether_vlan_proto = htons(ETHERTYPE_8021Q);
+		vlan->ether_vlan_tci = htons(ess->_vlan_tci);
+	} else if (src_off == dst_off + WIFI_ADDR_LEN) {
+		memmove(data + start, data + dst_off, 2 * WIFI_ADDR_LEN);
+	} else {
+		memmove(data + start + WIFI_ADDR_LEN, data + src_off, WIFI_ADDR_LEN);
+		memmove(data + start, data + dst_off, WIFI_ADDR_LEN);
 	}
 
-	memcpy(p_out->data(), dst.data(), 6);
-	memcpy(p_out->data() + 6, src.data(), 6);
-	memcpy(p_out->data() + 12, &ether_type, 2);
+	p_out->pull(start);
+	p_out->set_mac_header(p_out->data(), ess->_vlan_tci ? sizeof(struct click_ether_vlan) : sizeof(struct click_ether));
 
 	txp->update_rx(p_out->length());
 
-	if (Packet *clone = p->clone())
+	if (Packet *clone = p_out->clone())
 		output(1).push(clone);
 
-	output(0).push(p);
+	output(0).push(p_out);
+
+}
+
+// The TX policy of the station of hot. The caller holds the epoch guard,
+// a policy found under an earlier one is still alive if the policies of
+// the interface have not changed since.
+TxPolicyInfo *EmpowerWifiDecap::lookup_txp(const EmpowerStationHot *hot) {
+	TransmissionPolicies *policies = _el->rc(hot->_iface_id)->tx_policies();
+	uint32_t generation = policies->generation();
+	TxpEntry &e = _txps[hot->_sta.data()[5] % TXP_CACHE_SIZE];
+	if (e._txp && e._sta == hot->_sta && e._iface_id == hot->_iface_id && e._generation == generation) {
+		return e._txp;
+	}
+	e._sta = hot->_sta;
+	e._iface_id = hot->_iface_id;
+	e._generation = generation;
+	e._txp = policies->lookup(hot->_sta);
+	return e._txp;
+}
+
+// Splits an A-MSDU into its MSDUs. Every subframe is turned into an
+// Ethernet frame in place: the destination and source addresses of its
+// header are moved next to the ethertype of its LLC/SNAP header. Only
+// then is the buffer shared, each frame being a clone of the A-MSDU
+// trimmed to its own bytes, so that no payload is copied. The frames are
+// chained through Packet::next() and emitted in order.
+void EmpowerWifiDecap::push_amsdu(WritablePacket *p, unsigned offset, EtherAddress src, bool group, uint16_t vlan_tci, TxPolicyInfo *txp) {
+
+	typedef struct click_wifi_amsdu_subframe_header subframe_header;
+
+	unsigned char *data = p->data();
+	uint32_t length = p->length();
+	uint32_t headroom = p->headroom();
+
+	Packet *head = 0;
+	Packet *tail = 0;
+
+	while (offset + sizeof(subframe_header) <= length) {
+
+		subframe_header *sh = (subframe_header *) (data + offset);
+		uint32_t msdu_len = ntohs(sh->len);
+		uint32_t next = offset + sizeof(subframe_header) + msdu_len;
+
+		if (next > length) {
+			if (_debug) {
+				click_chatter("%{element} :: %s :: truncated subframe: %u > %u",
+						      this,
+						      __func__,
+						      next,
+						      length);
+			}
+			break;
+		}
+
+		EtherAddress da = EtherAddress(sh->da);
+		bool ok = msdu_len >= sizeof(struct click_llc)
+				&& !memcmp(WIFI_LLC_HEADER, data + offset + sizeof(subframe_header), WIFI_LLC_HEADER_LEN)
+				// a station only sends its own frames
+				&& EtherAddress(sh->sa) == src
+				&& (group || (!da.is_broadcast() && !da.is_group()));
+
+		if (ok) {
+			uint32_t start = offset + sizeof(subframe_header) + sizeof(struct click_llc) - sizeof(struct click_ether);
+			uint32_t mac_length = sizeof(struct click_ether);
+			if (vlan_tci) {
+				// the tag takes the first bytes of the LLC header
+				start -= 4;
+				mac_length = sizeof(struct click_ether_vlan);
+			}
+			memmove(data + start, data + offset, 2 * WIFI_ADDR_LEN);
+			if (vlan_tci) {
+				click_ether_vlan *vlan = (click_ether_vlan *) (data + start);
+				vlan->ether_vlan_proto = htons(ETHERTYPE_8021Q);
+				vlan->ether_vlan_tci = htons(vlan_tci);
+			}
+			Packet *q = p->clone();
+			if (!q) {
+				break;
+			}
+			q->change_headroom_and_length(headroom + start, next - start);
+			q->set_mac_header(q->data(), mac_length);
+			if (tail) {
+				tail->set_next(q);
+			} else {
+				head = q;
+			}
+			tail = q;
+		}
+
+		// subframes but the last are padded to a multiple of 4 bytes
+		offset = (next + 3) & ~3;
+
+	}
+
+	p->kill();
+
+	while (Packet *q = head) {
+		head = q->next();
+		q->set_next(0);
+		txp->update_rx(q->length());
+		if (Packet *clone = q->clone())
+			output(1).push(clone);
+		output(0).push(q);
+	}
 
 }
 
 enum {
-	H_DEBUG
+	H_DEBUG,
+	H_LOG
 };
 
 String EmpowerWifiDecap::read_handler(Element *e, void *thunk) {
@@ -235,6 +378,8 @@ String EmpowerWifiDecap::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_LOG:
+		return td->_log.unparse();
 	default:
 		return String();
 	}
@@ -260,9 +405,10 @@ int EmpowerWifiDecap::write_handler(const String &in_s, Element *e,
 
 void EmpowerWifiDecap::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
+	add_read_handler("log", read_handler, (void *) H_LOG);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(EmpowerWifiDecap)
-ELEMENT_REQUIRES(userlevel)
+ELEMENT_REQUIRES(EmpowerLVAPManager)
@@ -3,6 +3,9 @@
 #define CLICK_EMPOWERWIFIDECAP_HH
 #include <click/config.h>
 #include <click/element.hh>
+#include <click/etheraddress.hh>
+#include "empowerstationcache.hh"
+#include "empowerloglimit.hh"
 CLICK_DECLS
 
 /*
@@ -23,6 +26,22 @@ than the length of the 802.11 frame header and LLC header and packets
 that do not have a LVAP or packets coming from station that have not
 completed the authentication and the association procedure.
 
+The LVAP state of the transmitter is found with one lookup, its
+transmission policy, whose counters the frame is added to, is remembered
+until the policies of its interface change. The Ethernet header is made
+in place, out of the addresses of the 802.11 header and the type of the
+LLC header.
+
+A-MSDUs are split into one Ethernet frame per subframe. The frames share
+the buffer of the A-MSDU, no payload is copied. Subframes with a source
+address other than the station's are discarded.
+
+The frames of a station on an SSID the controller has given a VLAN, with
+a set SSID VLAN message to EL, carry its 802.1Q tag. The tag is written
+in place too, over the LLC header, so that tagging costs no copy nor
+extra headroom. Frames encapsulated for the station's ENCAP address go
+untagged.
+
 =over 8
 
 =item EL
@@ -33,6 +52,10 @@ Turn debug on/off
 
 =back
 
+=h log read-only
+One line per message logged per frame: name, times it was due, times
+it was suppressed. Each message is logged at most 10 times per second.
+
 =a EmpowerWifiEncap
 */
 
@@ -55,9 +78,31 @@ public:
 private:
 
 	class EmpowerLVAPManager *_el;
+	EmpowerStationCache _stations;
+
+	// TX policy of a station, indexed by the last byte of its address
+	// and looked up again only once the policies of its interface have
+	// changed, see TransmissionPolicies::generation()
+	struct TxpEntry {
+		EtherAddress _sta;
+		int _iface_id;
+		uint32_t _generation;
+		class TxPolicyInfo *_txp;
+		TxpEntry() : _iface_id(0), _generation(0), _txp(0) {
+		}
+	};
+	enum { TXP_CACHE_SIZE = 64 };
+	TxpEntry _txps[TXP_CACHE_SIZE];
 
 	bool _debug;
 
+	// messages logged per frame, see log_sites
+	enum { LOG_TOO_SMALL, LOG_INVALID_DIR, LOG_NOT_AUTHENTICATED, LOG_NOT_ASSOCIATED, NB_LOGS };
+	EmpowerLogLimit _log;
+
+	class TxPolicyInfo *lookup_txp(const class EmpowerStationHot *);
+	void push_amsdu(WritablePacket *, unsigned, EtherAddress, bool, uint16_t, class TxPolicyInfo *);
+
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 	static String read_handler(Element *, void *);
 
@@ -30,10 +30,15 @@
 #include <elements/wifi/transmissionpolicy.hh>
 #include <elements/wifi/minstrel.hh>
 #include "empowerlvapmanager.hh"
+#include "empowerwifiheader.hh"
 CLICK_DECLS
 
+static const char * const log_sites[] = {
+	"too_small", "not_authenticated", "not_associated"
+};
+
 EmpowerWifiEncap::EmpowerWifiEncap() :
-		_el(0), _debug(false) {
+		_el(0), _debug(false), _log(log_sites, NB_LOGS) {
 }
 
 EmpowerWifiEncap::~EmpowerWifiEncap() {
@@ -53,7 +58,7 @@ void
 EmpowerWifiEncap::push(int, Packet *p) {
 
 	if (p->length() < sizeof(struct click_ether)) {
-		click_chatter("%{element} :: %s :: packet too small: %d vs %d",
+		empower_chatter_limited(_log, LOG_TOO_SMALL, "%{element} :: %s :: packet too small: %d vs %d",
 				      this,
 				      __func__,
 				      p->length(),
@@ -67,10 +72,13 @@ EmpowerWifiEncap::push(int, Packet *p) {
 	EtherAddress src = EtherAddress(eh->ether_shost);
 	EtherAddress dst = EtherAddress(eh->ether_dhost);
 
+	EmpowerEpoch::Guard guard(_el->epoch());
+
 	// unicast traffic
 	if (!dst.is_broadcast() && !dst.is_group()) {
-        EmpowerStationState *ess = _el->get_ess(dst);
-        TxPolicyInfo *txp = _el->get_txp(dst);
+        const EmpowerStationHotTable *snapshot = _el->snapshot();
+        const EmpowerStationHot *ess = snapshot->get(dst, &_stations);
+        TxPolicyInfo *txp = _el->get_txp(ess);
         if (!ess) {
 			p->kill();
 			return;
@@ -80,7 +88,7 @@ EmpowerWifiEncap::push(int, Packet *p) {
 			return;
 		}
         if (!ess->_authentication_status) {
-			click_chatter("%{element} :: %s :: station %s not authenticated",
+			empower_chatter_limited(_log, LOG_NOT_AUTHENTICATED, "%{element} :: %s :: station %s not authenticated",
 						  this,
 						  __func__,
 						  dst.unparse().c_str());
@@ -88,7 +96,7 @@ EmpowerWifiEncap::push(int, Packet *p) {
 			return;
 		}
         if (!ess->_association_status) {
-			click_chatter("%{element} :: %s :: station %s not associated",
+			empower_chatter_limited(_log, LOG_NOT_ASSOCIATED, "%{element} :: %s :: station %s not associated",
 						  this,
 						  __func__,
 						  dst.unparse().c_str());
@@ -96,7 +104,10 @@ EmpowerWifiEncap::push(int, Packet *p) {
 			return;
 		}
 		txp->update_tx(p->length());
-		Packet * p_out = wifi_encap(p, dst, src, ess->_lvap_bssid);
+		Packet * p_out = snapshot->wifi_header(ess).encap(p);
+		if (!p_out) {
+			return;
+		}
 		SET_PAINT_ANNO(p_out, ess->_iface_id);
 		output(0).push(p_out);
 		return;
@@ -108,6 +119,10 @@ EmpowerWifiEncap::push(int, Packet *p) {
 
 		TxPolicyInfo * tx_policy = _el->get_tx_policies(i)->lookup(dst);
 
+		// if snooping tracks the group only its receivers get a copy
+		EmpowerMulticastTable *mtbl = _el->mtbl();
+		bool snooped = mtbl && EmpowerMulticastTable::is_snooped(dst);
+
 		if (tx_policy->_tx_mcast == TX_MCAST_DMS) {
 
 			// dms mcast policy, duplicate the frame for each station in
@@ -118,20 +133,38 @@ EmpowerWifiEncap::push(int, Packet *p) {
 
 			Vector<EtherAddress> sent;
 
-			for (LVAPIter it = _el->lvaps()->begin(); it.live(); it++) {
-				EtherAddress sta = it.value()._sta;
-				if (it.value()._iface_id != i) {
-					continue;
-				}
-				if (!it.value()._set_mask) {
-					continue;
+			if (snooped) {
+				const EmpowerMulticastBitmap *receivers = mtbl->receivers(dst);
+				for (int j = receivers ? receivers->next(0) : -1; j >= 0; j = receivers->next(j + 1)) {
+					const EmpowerStationHot *ess = _el->get_hot(mtbl->station(j), &_stations);
+					if (!ess || ess->_iface_id != i) {
+						continue;
+					}
+					if (!ess->_set_mask || !ess->_authentication_status || !ess->_association_status) {
+						continue;
+					}
+					Packet *q = p->clone();
+					if (!q) {
+						continue;
+					}
+					Packet * p_out = wifi_encap(q, ess->_sta, src, ess->_lvap_bssid);
+					if (!p_out) {
+						continue;
+					}
+					tx_policy->update_tx(p->length());
+					SET_PAINT_ANNO(p_out, i);
+					output(0).push(p_out);
 				}
-				if (!it.value()._authentication_status) {
-					continue;
-				}
-				if (!it.value()._association_status) {
+				continue;
+			}
+
+			const LVAPList &lvaps = _el->associated_lvaps(i);
+
+			for (int j = 0; j < lvaps.size(); j++) {
+				if (lvaps[j]->_staged) {
 					continue;
 				}
+				EtherAddress sta = lvaps[j]->_sta;
 				if (find(sent.begin(), sent.end(), sta) != sent.end()) {
 					continue;
 				}
@@ -140,7 +173,10 @@ EmpowerWifiEncap::push(int, Packet *p) {
 				if (!q) {
 					continue;
 				}
-				Packet * p_out = wifi_encap(q, sta, src, it.value()._lvap_bssid);
+				Packet * p_out = wifi_encap(q, sta, src, lvaps[j]->_lvap_bssid);
+				if (!p_out) {
+					continue;
+				}
 				tx_policy->update_tx(p->length());
 				SET_PAINT_ANNO(p_out, i);
 				output(0).push(p_out);
@@ -157,20 +193,17 @@ EmpowerWifiEncap::push(int, Packet *p) {
 
 			Vector<EtherAddress> sent;
 
-			for (LVAPIter it = _el->lvaps()->begin(); it.live(); it++) {
-				EtherAddress bssid = it.value()._lvap_bssid;
-				if (it.value()._iface_id != i) {
-					continue;
-				}
-				if (!it.value()._set_mask) {
-					continue;
-				}
-				if (!it.value()._authentication_status) {
+			const LVAPList &lvaps = _el->associated_lvaps(i);
+
+			for (int j = 0; j < lvaps.size(); j++) {
+				if (lvaps[j]->_staged) {
 					continue;
 				}
-				if (!it.value()._association_status) {
+				// a bssid gets the frame if one of its stations joined
+				if (snooped && !mtbl->is_receiver(dst, lvaps[j]->_sta)) {
 					continue;
 				}
+				EtherAddress bssid = lvaps[j]->_lvap_bssid;
 				if (find(sent.begin(), sent.end(), bssid) != sent.end()) {
 					continue;
 				}
@@ -180,6 +213,9 @@ EmpowerWifiEncap::push(int, Packet *p) {
 					continue;
 				}
 				Packet * p_out = wifi_encap(q, dst, src, bssid);
+				if (!p_out) {
+					continue;
+				}
 				tx_policy->update_tx(p->length());
 				SET_PAINT_ANNO(p_out, i);
 				output(0).push(p_out);
@@ -194,75 +230,19 @@ EmpowerWifiEncap::push(int, Packet *p) {
 
 }
 
+// Encapsulation of the copies of a group frame: the copies are clones,
+// so EmpowerWifiHeader gives each a private, right-sized buffer but the
+// last one, see EmpowerWifiHeader::encap(). src is the Ethernet source.
 Packet *
-EmpowerWifiEncap::wifi_encap(Packet *q, EtherAddress dst, EtherAddress src, EtherAddress bssid) {
-
-    WritablePacket *p_out = q->uniqueify();
-
-	if (!p_out) {
-		p_out->kill();
-		return 0;
-	}
-
-	uint8_t mode = WIFI_FC1_DIR_FROMDS;
-	uint16_t ethtype;
-
-    memcpy(&ethtype, p_out->data() + 12, 2);
-
-	p_out->pull(sizeof(struct click_ether));
-	p_out = p_out->push(sizeof(struct click_llc));
-
-	if (!p_out) {
-		p_out->kill();
-		return 0;
-	}
-
-	memcpy(p_out->data(), WIFI_LLC_HEADER, WIFI_LLC_HEADER_LEN);
-	memcpy(p_out->data() + 6, &ethtype, 2);
-
-	if (!(p_out = p_out->push(sizeof(struct click_wifi)))) {
-		p_out->kill();
-		return 0;
-	}
-
-	struct click_wifi *w = (struct click_wifi *) p_out->data();
-
-	memset(p_out->data(), 0, sizeof(click_wifi));
-	w->i_fc[0] = (uint8_t) (WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_DATA);
-	w->i_fc[1] = 0;
-	w->i_fc[1] |= (uint8_t) (WIFI_FC1_DIR_MASK & mode);
-
-	switch (mode) {
-	case WIFI_FC1_DIR_NODS:
-		memcpy(w->i_addr1, dst.data(), 6);
-		memcpy(w->i_addr2, src.data(), 6);
-		memcpy(w->i_addr3, bssid.data(), 6);
-		break;
-	case WIFI_FC1_DIR_TODS:
-		memcpy(w->i_addr1, bssid.data(), 6);
-		memcpy(w->i_addr2, src.data(), 6);
-		memcpy(w->i_addr3, dst.data(), 6);
-		break;
-	case WIFI_FC1_DIR_FROMDS:
-		memcpy(w->i_addr1, dst.data(), 6);
-		memcpy(w->i_addr2, bssid.data(), 6);
-		memcpy(w->i_addr3, src.data(), 6);
-		break;
-	default:
-		click_chatter("%{element} :: %s :: invalid mode %d",
-				      this,
-				      __func__,
-				      mode);
-		p_out->kill();
-		return 0;
-	}
-
-	return p_out;
-
+EmpowerWifiEncap::wifi_encap(Packet *q, EtherAddress dst, EtherAddress, EtherAddress bssid) {
+	EmpowerWifiHeader hdr;
+	hdr.build(dst, bssid);
+	return hdr.encap(q);
 }
 
 enum {
-	H_DEBUG
+	H_DEBUG,
+	H_LOG
 };
 
 String EmpowerWifiEncap::read_handler(Element *e, void *thunk) {
@@ -270,6 +250,8 @@ String EmpowerWifiEncap::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_LOG:
+		return td->_log.unparse();
 	default:
 		return String();
 	}
@@ -295,9 +277,10 @@ int EmpowerWifiEncap::write_handler(const String &in_s, Element *e,
 
 void EmpowerWifiEncap::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
+	add_read_handler("log", read_handler, (void *) H_LOG);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(EmpowerWifiEncap)
-ELEMENT_REQUIRES(userlevel)
+ELEMENT_REQUIRES(EmpowerLVAPManager)
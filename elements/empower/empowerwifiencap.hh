@@ -5,6 +5,8 @@
 #include <click/element.hh>
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
+#include "empowerstationcache.hh"
+#include "empowerloglimit.hh"
 CLICK_DECLS
 
 /*
@@ -33,6 +35,10 @@ Turn debug on/off
 
 =back 8
 
+=h log read-only
+One line per message logged per frame: name, times it was due, times
+it was suppressed. Each message is logged at most 10 times per second.
+
 =a EmpowerWifiDecap
 */
 
@@ -53,9 +59,14 @@ public:
 private:
 
 	class EmpowerLVAPManager *_el;
+	EmpowerStationCache _stations;
 
 	bool _debug;
 
+	// messages logged per frame, see log_sites
+	enum { LOG_TOO_SMALL, LOG_NOT_AUTHENTICATED, LOG_NOT_ASSOCIATED, NB_LOGS };
+	EmpowerLogLimit _log;
+
 	Packet *wifi_encap(Packet *, EtherAddress, EtherAddress, EtherAddress);
 
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
@@ -0,0 +1,128 @@
+#ifndef CLICK_EMPOWERWIFIHEADER_HH
+#define CLICK_EMPOWERWIFIHEADER_HH
+#include <click/config.h>
+#include <click/packet.hh>
+#include <click/etheraddress.hh>
+#include <clicknet/ether.h>
+#include <clicknet/wifi.h>
+#include <clicknet/llc.h>
+CLICK_DECLS
+
+// Ready-made FROMDS 802.11 data header followed by the LLC/SNAP header
+// for a given (RA, TA) pair. Only addr3 (SA) and the ethertype change
+// from frame to frame, so encapsulating an Ethernet frame boils down to
+// a single push and memcpy. The packet is copied only if it is shared
+// or lacks headroom.
+//
+// Shared packets are the clones made for the receivers of a group frame
+// (DMS copies, VAP copies). Pushing a header onto one of them would
+// duplicate the whole shared buffer, headroom and tailroom included;
+// instead the header and the payload alone are written into a private
+// buffer of the right size. The last clone standing is no longer shared
+// and is encapsulated in place. The frame has to end up contiguous
+// anyway: rate control, the radiotap encapsulation and the device all
+// read it as one buffer.
+//
+// Frames received by FromDPDKDevice live in mbufs, whose headroom
+// (RTE_PKTMBUF_HEADROOM, 128 bytes unless DPDK was built otherwise) takes
+// the 802.11 and LLC headers plus the radiotap one: they are encapsulated
+// in place too, and only the clones of a group frame are copied.
+//
+// With a TID the header is that of a QoS data frame, whose QoS control
+// field carries the TID.
+class EmpowerWifiHeader {
+public:
+
+	enum { LEN = sizeof(struct click_wifi) + sizeof(struct click_llc),
+		   QOS_LEN = LEN + sizeof(struct click_qos_control) };
+
+	EmpowerWifiHeader() : _len(LEN) {
+		memset(_hdr, 0, QOS_LEN);
+	}
+
+	void build(EtherAddress ra, EtherAddress ta, int tid = -1) {
+		memset(_hdr, 0, QOS_LEN);
+		struct click_wifi *w = (struct click_wifi *) _hdr;
+		w->i_fc[0] = (uint8_t) (WIFI_FC0_VERSION_0 | WIFI_FC0_TYPE_DATA);
+		w->i_fc[1] = (uint8_t) (WIFI_FC1_DIR_MASK & WIFI_FC1_DIR_FROMDS);
+		memcpy(w->i_addr1, ra.data(), 6);
+		memcpy(w->i_addr2, ta.data(), 6);
+		_len = LEN;
+		if (tid >= 0) {
+			w->i_fc[0] |= WIFI_FC0_SUBTYPE_QOS;
+			struct click_qos_control *qos = (struct click_qos_control *) (_hdr + sizeof(struct click_wifi));
+			qos->qos_control = cpu_to_le16(tid & 0xf);
+			_len = QOS_LEN;
+		}
+		memcpy(_hdr + _len - sizeof(struct click_llc), WIFI_LLC_HEADER, WIFI_LLC_HEADER_LEN);
+	}
+
+	uint32_t length() const {
+		return _len;
+	}
+
+	WritablePacket *encap(Packet *p) const {
+
+		if (p->shared()) {
+			return encap_copy(p);
+		}
+
+		uint8_t sa[6];
+		uint16_t ethtype;
+
+		// the new header overlaps the ethernet one, save what we need
+		const click_ether *eh = (const click_ether *) p->data();
+		memcpy(sa, eh->ether_shost, 6);
+		memcpy(&ethtype, &eh->ether_type, 2);
+
+		p->pull(sizeof(struct click_ether));
+
+		WritablePacket *q = p->push(_len);
+
+		if (!q) {
+			return 0;
+		}
+
+		memcpy(q->data(), _hdr, _len);
+
+		struct click_wifi *w = (struct click_wifi *) q->data();
+		memcpy(w->i_addr3, sa, 6);
+		memcpy(q->data() + _len - 2, &ethtype, 2);
+
+		return q;
+
+	}
+
+private:
+
+	uint8_t _hdr[QOS_LEN];
+	uint32_t _len;
+
+	WritablePacket *encap_copy(Packet *p) const {
+
+		uint32_t payload = p->length() - sizeof(struct click_ether);
+		WritablePacket *q = Packet::make(Packet::default_headroom, 0, _len + payload, 0);
+
+		if (!q) {
+			p->kill();
+			return 0;
+		}
+
+		q->copy_annotations(p);
+
+		const click_ether *eh = (const click_ether *) p->data();
+		memcpy(q->data(), _hdr, _len);
+		struct click_wifi *w = (struct click_wifi *) q->data();
+		memcpy(w->i_addr3, eh->ether_shost, 6);
+		memcpy(q->data() + _len - 2, &eh->ether_type, 2);
+		memcpy(q->data() + _len, p->data() + sizeof(struct click_ether), payload);
+
+		p->kill();
+		return q;
+
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
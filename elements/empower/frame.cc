@@ -19,5 +19,7 @@
 #include "frame.hh"
 CLICK_DECLS
 
+static_assert(sizeof(Frame) == 32, "frame record size");
+
 CLICK_ENDDECLS
 ELEMENT_PROVIDES(Frame)
@@ -7,33 +7,38 @@
 #include <click/vector.hh>
 CLICK_DECLS
 
+// Metadata of a captured frame, kept by the summary triggers. Laid out
+// to fit 32 bytes: lengths past 64 kB do not occur in 802.11, and the
+// retry and station bits share a byte.
 class Frame {
 public:
 
+	uint64_t _tsft;
 	EtherAddress _ra;
 	EtherAddress _ta;
-	uint64_t _tsft;
 	uint16_t _flags;
 	uint16_t _seq;
+	uint16_t _length;
 	int8_t _rssi;
 	uint8_t _rate;
 	uint8_t _type;
 	uint8_t _subtype;
-	uint32_t _length;
-	uint8_t _retry;
-	bool _station;
 	uint8_t _iface_id;
+	uint8_t _retry : 1;
+	uint8_t _station : 1;
 
 	Frame() :
-			_ra(EtherAddress()), _ta(EtherAddress()), _tsft(0), _flags(0),
-			_seq(0), _rssi(0), _rate(0), _type(0), _subtype(0), _length(0),
-			_retry(0), _station(false), _iface_id(0) {
+			_tsft(0), _ra(EtherAddress()), _ta(EtherAddress()), _flags(0),
+			_seq(0), _length(0), _rssi(0), _rate(0), _type(0), _subtype(0),
+			_iface_id(0), _retry(0), _station(0) {
 	}
 
 	Frame(EtherAddress ra, EtherAddress ta, uint64_t tsft, uint16_t flags, uint16_t seq, int8_t rssi,
 			uint8_t rate, uint8_t type, uint8_t subtype, uint32_t length, uint8_t retry, bool station, int iface_id) :
-			_ra(ra), _ta(ta), _tsft(tsft), _flags(flags), _seq(seq), _rssi(rssi),
-			_rate(rate), _type(type), _subtype(subtype), _length(length), _retry(retry), _station(station), _iface_id(iface_id) {
+			_tsft(tsft), _ra(ra), _ta(ta), _flags(flags), _seq(seq),
+			_length(length < 0xFFFF ? length : 0xFFFF), _rssi(rssi), _rate(rate),
+			_type(type), _subtype(subtype), _iface_id(iface_id), _retry(retry ? 1 : 0),
+			_station(station) {
 	}
 
 	String unparse() {
@@ -45,5 +50,69 @@ public:
 	}
 };
 
+// Fixed-size ring of frame records. Storage is allocated once, so
+// recording a frame on the RX path never touches the allocator. When
+// the ring is full one overflowing frame every _sample replaces the
+// oldest record and the others are dropped; _sample == 1 means always
+// drop the oldest record.
+class FrameRing {
+public:
+
+	FrameRing(uint32_t capacity, uint32_t sample) :
+			_capacity(capacity ? capacity : 1), _sample(sample ? sample : 1),
+			_head(0), _size(0), _overflows(0), _drops(0) {
+		_frames = new Frame[_capacity];
+	}
+
+	~FrameRing() {
+		delete[] _frames;
+	}
+
+	// slot to write the next frame into, 0 if the frame must be dropped
+	Frame *reserve() {
+		if (_size < _capacity) {
+			return &_frames[(_head + _size++) % _capacity];
+		}
+		_drops++;
+		if (++_overflows % _sample) {
+			return 0;
+		}
+		Frame *slot = &_frames[_head];
+		_head = (_head + 1) % _capacity;
+		return slot;
+	}
+
+	// i-th oldest record
+	const Frame &operator[](uint32_t i) const {
+		return _frames[(_head + i) % _capacity];
+	}
+
+	void clear() {
+		_head = 0;
+		_size = 0;
+		_overflows = 0;
+	}
+
+	uint32_t size() const { return _size; }
+	uint32_t capacity() const { return _capacity; }
+	// bytes allocated for the records
+	size_t bytes() const { return _capacity * sizeof(Frame); }
+	uint32_t drops() const { return _drops; }
+
+private:
+
+	Frame *_frames;
+	uint32_t _capacity;
+	uint32_t _sample;
+	uint32_t _head;
+	uint32_t _size;
+	uint32_t _overflows;
+	uint32_t _drops;
+
+	FrameRing(const FrameRing &);
+	FrameRing &operator=(const FrameRing &);
+
+};
+
 CLICK_ENDDECLS
 #endif /* CLICK_EMPOWER_FRAME_HH */
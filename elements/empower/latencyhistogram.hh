@@ -0,0 +1,57 @@
+#ifndef CLICK_EMPOWER_LATENCYHISTOGRAM_HH
+#define CLICK_EMPOWER_LATENCYHISTOGRAM_HH
+#include <click/glue.hh>
+#include <click/integers.hh>
+CLICK_DECLS
+
+// Latencies in a bucket per power of two: bucket b holds those in
+// [2^b, 2^(b+1)), 0 and 1 share the first one. The unit is the caller's.
+struct LatencyHistogram {
+
+	enum { NBUCKETS = 32 };
+
+	uint32_t _buckets[NBUCKETS];
+	uint32_t _count;
+	uint64_t _sum;
+	uint32_t _max;
+
+	void clear() {
+		memset(_buckets, 0, sizeof(_buckets));
+		_count = 0;
+		_sum = 0;
+		_max = 0;
+	}
+
+	void add(uint32_t v) {
+		// floor(log2(v))
+		int b = v ? 32 - ffs_msb(v) : 0;
+		_buckets[b]++;
+		_count++;
+		_sum += v;
+		if (v > _max) {
+			_max = v;
+		}
+	}
+
+	uint32_t mean() const {
+		return _count ? _sum / _count : 0;
+	}
+
+	// upper bound of the p-th percentile, the top of its bucket
+	uint32_t percentile(int p) const {
+		uint32_t rank = ((uint64_t) _count * p + 99) / 100;
+		uint32_t n = 0;
+		for (int b = 0; b < NBUCKETS; b++) {
+			n += _buckets[b];
+			if (n >= rank && n) {
+				uint64_t upper = ((uint64_t) 2 << b) - 1;
+				return upper < _max ? upper : _max;
+			}
+		}
+		return _max;
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
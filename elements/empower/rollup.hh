@@ -0,0 +1,125 @@
+#ifndef CLICK_EMPOWER_ROLLUP_HH
+#define CLICK_EMPOWER_ROLLUP_HH
+#include <click/glue.hh>
+CLICK_DECLS
+
+// Samples of a time period: how many, their sum, and the extremes
+struct RollupBucket {
+	uint32_t _count;
+	int32_t _sum;
+	int16_t _min;
+	int16_t _max;
+
+	void clear() {
+		_count = 0;
+		_sum = 0;
+		_min = 0;
+		_max = 0;
+	}
+
+	void add(int32_t sum, uint32_t count, int min, int max) {
+		if (!count) {
+			return;
+		}
+		if (!_count || min < _min) {
+			_min = clamp(min);
+		}
+		if (!_count || max > _max) {
+			_max = clamp(max);
+		}
+		_count += count;
+		_sum += sum;
+	}
+
+	int mean() const {
+		return _count ? _sum / (int32_t) _count : 0;
+	}
+
+	static int16_t clamp(int v) {
+		return v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+	}
+};
+
+// History of a value at LEVELS resolutions, base, 10, 100 and 600 times
+// base msecs, e.g. 100 ms, 1 s, 10 s and 1 min, with the last SLOTS
+// buckets of each. Every sample goes into the bucket of each level it
+// falls in, so that all levels are up to date. Buckets are numbered by
+// their start time over the resolution of their level, bucket n lives
+// in slot n % SLOTS; the storage is inline and fixed.
+template <int SLOTS> class Rollup {
+public:
+
+	enum { LEVELS = 4, MAX_SLOTS = SLOTS };
+
+	Rollup(uint32_t base = 100) : _base(base ? base : 1), _latest(0) {
+		memset(_levels, 0, sizeof(_levels));
+	}
+
+	uint32_t resolution(int level) const {
+		static const uint32_t factors[LEVELS] = { 1, 10, 100, 600 };
+		return _base * factors[level];
+	}
+
+	// count samples summing to sum taken at msec
+	void add(uint64_t msec, int32_t sum, uint32_t count, int min, int max) {
+		if (!count) {
+			return;
+		}
+		if (msec > _latest) {
+			_latest = msec;
+		}
+		for (int i = 0; i < LEVELS; i++) {
+			Level &l = _levels[i];
+			uint64_t n = msec / resolution(i);
+			// late samples go to the current bucket
+			if (n > l._number) {
+				// clear the slots of the buckets nothing fell in
+				uint64_t from = n - l._number > SLOTS ? n - SLOTS : l._number + 1;
+				for (uint64_t k = from; k <= n; k++) {
+					l._slots[k % SLOTS].clear();
+				}
+				l._number = n;
+			}
+			l._slots[l._number % SLOTS].add(sum, count, min, max);
+		}
+	}
+
+	void add(uint64_t msec, int value) {
+		add(msec, value, 1, value, value);
+	}
+
+	// The last n buckets of level, oldest first, the last one holding the
+	// latest sample and possibly still filling. Returns how many, at most
+	// SLOTS.
+	int history(int level, int n, RollupBucket *out) const {
+		const Level &l = _levels[level];
+		if (n > SLOTS) {
+			n = SLOTS;
+		}
+		if ((uint64_t) n > l._number + 1) {
+			n = l._number + 1;
+		}
+		for (int i = 0; i < n; i++) {
+			out[i] = l._slots[(l._number - n + 1 + i) % SLOTS];
+		}
+		return n;
+	}
+
+	// time of the latest sample, in msecs
+	uint64_t latest() const { return _latest; }
+
+private:
+
+	struct Level {
+		RollupBucket _slots[SLOTS];
+		uint64_t _number; // of the newest bucket
+	};
+
+	uint32_t _base;
+	uint64_t _latest;
+	Level _levels[LEVELS];
+
+};
+
+CLICK_ENDDECLS
+#endif /* CLICK_EMPOWER_ROLLUP_HH */
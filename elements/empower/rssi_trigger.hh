@@ -16,6 +16,7 @@ public:
 	empower_trigger_relation _rel;
 	int _val;
 	bool _dispatched;
+	Vector<Timestamp> _evaluated; // per interface, see DstInfo::_sma_changed
 
 	RssiTrigger(EtherAddress, uint32_t, empower_trigger_relation, int, bool, uint16_t, EmpowerLVAPManager *, EmpowerRXStats *);
 	~RssiTrigger();
@@ -24,6 +25,23 @@ public:
 
 	bool matches(const DstInfo* nfo);
 
+	// true if the windowed rssi of nfo moved since the last evaluation
+	bool changed(int iface_id, const DstInfo *nfo) {
+		if (_evaluated.size() <= iface_id) {
+			_evaluated.resize(iface_id + 1, Timestamp());
+		}
+		if (_evaluated[iface_id] == nfo->_sma_changed) {
+			return false;
+		}
+		_evaluated[iface_id] = nfo->_sma_changed;
+		return true;
+	}
+
+	void rearm() {
+		_dispatched = false;
+		_evaluated.clear();
+	}
+
 	inline bool operator==(const RssiTrigger &b) {
 		return (_eth == b._eth) && (_rel == b._rel) && (_val == b._val);
 	}
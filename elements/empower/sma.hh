@@ -5,79 +5,130 @@
 #include <click/hashcode.hh>
 #include <click/timer.hh>
 #include <click/vector.hh>
+#include <click/integers.hh>
 CLICK_DECLS
 
+// Simple moving average over the last period values. The window is
+// stored inline, so an SMA can be copied around by value and a neighbor
+// entry holding one needs no extra allocation.
 class SMA {
 public:
-	SMA(unsigned int period) :
-		period(period), head(NULL), tail(NULL), total(0) {
-		window = new int[period];
-		assert(period >= 1);
-	}
-	~SMA() {
-		delete[] window;
+
+	enum { MAX_PERIOD = 32 };
+
+	SMA(unsigned int period = 1) :
+		_period(period), _head(0), _size(0), _total(0) {
+		assert(period >= 1 && period <= MAX_PERIOD);
 	}
+
 	// Adds a value to the average, pushing one out if necessary
 	void add(int val) {
-		// Special case: Initialisation
-		if (head == NULL) {
-			head = window;
-			*head = val;
-			tail = head;
-			inc(tail);
-			total = val;
-			return;
+		// no modulo, a division costs tens of cycles on the small cores
+		// of the APs
+		unsigned int tail = _head + _size;
+		if (tail >= _period) {
+			tail -= _period;
 		}
-		// Were we already full?
-		if (head == tail) {
-			// Fix total-cache
-			total -= *head;
-			// Make room
-			inc(head);
+		if (_size == _period) {
+			// full, the oldest value lives where the new one goes
+			_total -= _window[tail];
+			if (++_head == _period) {
+				_head = 0;
+			}
+		} else {
+			_size++;
 		}
-		// Write the value in the next spot.
-		*tail = val;
-		inc(tail);
-		// Update our total-cache
-		total += val;
+		_window[tail] = val;
+		_total += val;
 	}
 
-	// Returns the average of the last P elements added to this SMA.
-	// If no elements have been added yet, returns 0.0
+	// Returns the average of the last period elements added to this SMA.
+	// If no elements have been added yet, returns 0
 	int avg() const {
-		ptrdiff_t size = this->size();
-		if (size == 0) {
+		if (_size == 0) {
 			return 0; // No entries => 0 average
 		}
-		return (total / (double) size);
+		return _total / (int) _size;
 	}
 
 private:
-	unsigned int period;
-	int * window; // Holds the values to calculate the average of.
 
-	// Logically, head is before tail
-	int * head; // Points at the oldest element we've stored.
-	int * tail; // Points at the newest element we've stored.
+	unsigned int _period;
+	unsigned int _head; // index of the oldest element we've stored
+	unsigned int _size; // number of elements we've stored
+	int _total; // Cache the total so we don't sum everything each time.
+	int _window[MAX_PERIOD]; // Holds the values to calculate the average of.
+
+};
+
+// Count, sum, minimum, maximum and standard deviation of a window of
+// samples, in integers. Values are kept as offsets from the first sample
+// of the window, so the sum of squares stays small and exact, and adding
+// a sample costs no division; the mean and deviation are computed once
+// per window. Neither needs floating point, which the APs only emulate.
+class WindowStats {
+public:
 
-	int total; // Cache the total so we don't sum everything each time.
+	WindowStats() {
+		clear();
+	}
 
-	// Bumps the given pointer up by one.
-	// Wraps to the start of the array if needed.
-	void inc(int * & p) {
-		if (++p >= window + period) {
-			p = window;
+	void add(int val) {
+		if (_count == 0) {
+			_base = _min = _max = val;
+		} else if (val < _min) {
+			_min = val;
+		} else if (val > _max) {
+			_max = val;
 		}
+		int32_t d = val - _base;
+		_count++;
+		_sum += d;
+		_squares += (uint64_t) (d * d);
+	}
+
+	void clear() {
+		_count = 0;
+		_base = _min = _max = 0;
+		_sum = 0;
+		_squares = 0;
 	}
 
-	// Returns how many numbers we have stored.
-	ptrdiff_t size() const {
-		if (head == NULL)
+	uint32_t count() const		{ return _count; }
+	int min() const			{ return _min; }
+	int max() const			{ return _max; }
+
+	int32_t sum() const {
+		return _sum + _base * (int32_t) _count;
+	}
+
+	// Truncated like the sum divided by the count; 0 with no sample
+	int mean() const {
+		return _count ? sum() / (int32_t) _count : 0;
+	}
+
+	// Population standard deviation, rounded down
+	int stddev() const {
+		if (_count < 2) {
+			return 0;
+		}
+		// n * variance = squares - sum^2 / n, exact
+		int64_t nvar = (int64_t) _squares - ((int64_t) _sum * _sum) / _count;
+		if (nvar <= 0) {
 			return 0;
-		if (head == tail)
-			return period;
-		return (period + tail - head) % period;
+		}
+		return int_sqrt((uint64_t) nvar / _count);
 	}
+
+private:
+
+	uint32_t _count;
+	int _base;
+	int _min;
+	int _max;
+	int32_t _sum; // of the offsets from _base
+	uint64_t _squares; // of the offsets from _base
+
 };
 
 CLICK_ENDDECLS
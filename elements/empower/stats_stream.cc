@@ -0,0 +1,46 @@
+/*
+ * stats_stream.{cc,hh}
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "empowerlvapmanager.hh"
+#include "stats_stream.hh"
+CLICK_DECLS
+
+StatsStream::StatsStream(uint32_t stream_id, uint16_t period, uint16_t fields, EmpowerLVAPManager * el) :
+		_stream_id(stream_id), _period(period), _fields(fields), _sent(0), _el(el) {
+
+	_stream_timer = new TimerWheelEntry();
+
+}
+
+StatsStream::~StatsStream() {
+	delete _stream_timer;
+}
+
+String StatsStream::unparse() {
+	StringAccum sa;
+	sa << _stream_id;
+	sa << " period ";
+	sa << _period;
+	sa << " fields ";
+	sa << _fields;
+	sa << " lvaps ";
+	sa << _lvaps.size();
+	sa << " sent ";
+	sa << _sent;
+	return sa.take_string();
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(StatsStream)
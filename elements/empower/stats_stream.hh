@@ -0,0 +1,68 @@
+#ifndef CLICK_EMPOWER_STATSSTREAM_HH
+#define CLICK_EMPOWER_STATSSTREAM_HH
+#include <click/straccum.hh>
+#include <click/hashtable.hh>
+#include <click/timerwheel.hh>
+#include <click/vector.hh>
+#include <click/etheraddress.hh>
+#include "empowerqosmanager.hh"
+CLICK_DECLS
+
+class EmpowerLVAPManager;
+
+class StreamFrames {
+public:
+	uint32_t _tx;
+	uint32_t _rx;
+	StreamFrames() : _tx(0), _rx(0) {
+	}
+	StreamFrames(uint32_t tx, uint32_t rx) : _tx(tx), _rx(rx) {
+	}
+};
+
+class StreamTraffic {
+public:
+	uint32_t _pkts;
+	uint32_t _bytes;
+	StreamTraffic() : _pkts(0), _bytes(0) {
+	}
+	StreamTraffic(uint32_t pkts, uint32_t bytes) : _pkts(pkts), _bytes(bytes) {
+	}
+};
+
+typedef HashTable<EtherAddress, StreamFrames> StreamFramesTable;
+typedef StreamFramesTable::iterator SFIter;
+
+typedef HashTable<TrafficRule, StreamTraffic> StreamTrafficTable;
+typedef StreamTrafficTable::iterator STIter;
+
+// A periodic statistics report registered by the controller. Every
+// period the counters selected by _fields are sampled and only what
+// changed since the previous report is sent, as deltas. The totals last
+// reported are kept here for that purpose.
+class StatsStream {
+
+public:
+
+	uint32_t _stream_id;
+	uint16_t _period;
+	uint16_t _fields;
+	uint32_t _sent;
+	TimerWheelEntry * _stream_timer;
+	EmpowerLVAPManager * _el;
+
+	StreamFramesTable _lvaps;
+	Vector<StreamTrafficTable> _rules;
+
+	StatsStream(uint32_t, uint16_t, uint16_t, EmpowerLVAPManager *);
+	~StatsStream();
+
+	String unparse();
+
+};
+
+typedef Vector<StatsStream *> StatsStreams;
+typedef StatsStreams::iterator SSIter;
+
+CLICK_ENDDECLS
+#endif /* CLICK_EMPOWER_STATSSTREAM_HH */
@@ -22,8 +22,9 @@
 CLICK_DECLS
 
 SummaryTrigger::SummaryTrigger(int iface, EtherAddress eth, uint32_t trigger_id, int16_t limit,
-		uint16_t period, EmpowerLVAPManager * el, EmpowerRXStats * ers) :
-		Trigger(trigger_id, period, el, ers), _eth(eth), _iface(iface), _sent(0), _limit(limit) {
+		uint16_t period, EmpowerLVAPManager * el, EmpowerRXStats * ers, uint32_t capacity, uint32_t sample) :
+		Trigger(trigger_id, period, el, ers), _eth(eth), _iface(iface), _sent(0), _limit(limit),
+		_frames(capacity, sample) {
 
 }
 
@@ -42,6 +43,8 @@ String SummaryTrigger::unparse() {
 	sa << _period;
 	sa << " frames ";
 	sa << _frames.size();
+	sa << " drops ";
+	sa << _frames.drops();
 	sa << " sent ";
 	sa << _sent;
 	return sa.take_string();
@@ -8,9 +8,6 @@
 #include "frame.hh"
 CLICK_DECLS
 
-typedef Vector<Frame> FramesList;
-typedef FramesList::iterator FIter;
-
 class SummaryTrigger: public Trigger {
 
 public:
@@ -19,9 +16,9 @@ public:
 	int _iface;
 	uint32_t _sent;
 	int16_t _limit;
-	FramesList _frames;
+	FrameRing _frames;
 
-	SummaryTrigger(int, EtherAddress, uint32_t, int16_t, uint16_t, EmpowerLVAPManager *, EmpowerRXStats *);
+	SummaryTrigger(int, EtherAddress, uint32_t, int16_t, uint16_t, EmpowerLVAPManager *, EmpowerRXStats *, uint32_t, uint32_t);
 	~SummaryTrigger();
 
 	String unparse();
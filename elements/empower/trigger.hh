@@ -2,7 +2,7 @@
 #define CLICK_EMPOWER_TRIGGER_HH
 #include <click/straccum.hh>
 #include <click/hashcode.hh>
-#include <click/timer.hh>
+#include <click/timerwheel.hh>
 #include <click/vector.hh>
 #include <click/etheraddress.hh>
 #include "dstinfo.hh"
@@ -24,7 +24,7 @@ class Trigger {
 public:
 
 	uint32_t _trigger_id;
-	Timer * _trigger_timer;
+	TimerWheelEntry * _trigger_timer;
 	uint16_t _period;
 	EmpowerLVAPManager * _el;
 	EmpowerRXStats * _ers;
@@ -32,11 +32,11 @@ public:
 	Trigger(uint32_t trigger_id, uint16_t period, EmpowerLVAPManager * el, EmpowerRXStats * ers) :
 			_trigger_id(trigger_id), _period(period), _el(el), _ers(ers) {
 
-		_trigger_timer = new Timer();
+		_trigger_timer = new TimerWheelEntry();
 
 	}
 	~Trigger() {
-		_trigger_timer->clear();
+		delete _trigger_timer;
 	}
 
 	String unparse() {
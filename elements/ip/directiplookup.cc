@@ -525,6 +525,13 @@ DirectIPLookup::push(int, Packet *p)
         p->kill();
 }
 
+void
+DirectIPLookup::push_batch(int, Packet *head)
+{
+    // discard routes go without a word, as in push()
+    route_batch(head, true);
+}
+
 int
 DirectIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
 {
@@ -538,6 +545,41 @@ DirectIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
     return _t._vport[vport_i].port;
 }
 
+// The lookups of the batch go one table at a time, each pass prefetching
+// what the next one reads, so that the cache misses of the batch overlap
+// instead of following one another.
+void
+DirectIPLookup::lookup_routes(const IPAddress *dests, int n, int *ports, IPAddress *gws) const
+{
+    uint32_t addrs[LOOKUP_BATCH];
+    uint16_t vports[LOOKUP_BATCH];
+
+    for (int i = 0; i < n; i++) {
+	addrs[i] = ntohl(dests[i].addr());
+	prefetch(&_t._tbl_0_23[addrs[i] >> 8]);
+    }
+
+    for (int i = 0; i < n; i++) {
+	uint16_t vport_i = _t._tbl_0_23[addrs[i] >> 8];
+	if (vport_i & 0x8000)
+	    prefetch(&_t._tbl_24_31[((vport_i & 0x7fff) << 8) | (addrs[i] & 0xff)]);
+	else
+	    prefetch(&_t._vport[vport_i]);
+	vports[i] = vport_i;
+    }
+
+    for (int i = 0; i < n; i++)
+	if (vports[i] & 0x8000) {
+	    vports[i] = _t._tbl_24_31[((vports[i] & 0x7fff) << 8) | (addrs[i] & 0xff)];
+	    prefetch(&_t._vport[vports[i]]);
+	}
+
+    for (int i = 0; i < n; i++) {
+	gws[i] = _t._vport[vports[i]].gw;
+	ports[i] = _t._vport[vports[i]].port;
+    }
+}
+
 int
 DirectIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_route, ErrorHandler *errh)
 {
@@ -98,10 +98,12 @@ class DirectIPLookup : public IPRouteTable { public:
     void add_handlers() CLICK_COLD;
 
     void push(int port, Packet* p);
+    void push_batch(int port, Packet* head);
 
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
+    void lookup_routes(const IPAddress*, int, int*, IPAddress*) const;
     String dump_routes();
 
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
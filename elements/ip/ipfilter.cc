@@ -1392,6 +1392,23 @@ IPFilter::push(int, Packet *p)
     checked_output_push(match(_zprog, p), p);
 }
 
+void
+IPFilter::push_batch(int, Packet *head)
+{
+    // runs of packets bound for the same output are pushed together
+    PacketBatch run;
+    int port = -1;
+    while (Packet *p = PacketBatch::pop(head)) {
+	int o = match(_zprog, p);
+	if (o != port && !run.empty())
+	    checked_output_push_batch(port, run.take());
+	port = o;
+	run.append(p);
+    }
+    if (!run.empty())
+	checked_output_push_batch(port, run.take());
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(Classification)
 EXPORT_ELEMENT(IPFilter)
@@ -126,6 +126,7 @@ class IPFilter : public Element { public:
     void add_handlers() CLICK_COLD;
 
     void push(int port, Packet *);
+    void push_batch(int port, Packet *head);
 
     typedef Classification::Wordwise::CompressedProgram IPFilterProgram;
     static void parse_program(IPFilterProgram &zprog,
@@ -28,6 +28,7 @@
 #include <clicknet/tcp.h>
 #include <clicknet/udp.h>
 #include <click/llrpc.h>
+#include <click/master.hh>
 #include <click/args.hh>
 #include <click/straccum.hh>
 #include <click/error.hh>
@@ -68,7 +69,8 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
 //
 
 IPRewriterBase::IPRewriterBase()
-    : _map(0), _heap(new IPRewriterHeap), _gc_timer(gc_timer_hook, this)
+    : _map(0), _heap(new IPRewriterHeap), _sharded(false),
+      _gc_timer(gc_timer_hook, this)
 {
     _timeouts[0] = default_timeout;
     _timeouts[1] = default_guarantee;
@@ -81,6 +83,12 @@ IPRewriterBase::~IPRewriterBase()
 	_heap->unuse();
 }
 
+IPRewriterShard *
+IPRewriterBase::make_shard(int, int)
+{
+    return 0;
+}
+
 
 int
 IPRewriterBase::parse_input_spec(const String &line, IPRewriterInput &is,
@@ -197,9 +205,29 @@ IPRewriterBase::initialize(ErrorHandler *errh)
 	PrefixErrorHandler cerrh(errh, "input spec " + String(i) + ": ");
 	if (_input_specs[i].reply_element->_heap != _heap)
 	    cerrh.error("reply element %<%s%> must share this MAPPING_CAPACITY", i, _input_specs[i].reply_element->name().c_str());
+	if (_sharded && (_input_specs[i].reply_element != this
+			 || _heap->_use_count != 1))
+	    cerrh.error("a sharded rewriter must be its own reply element");
 	if (_input_specs[i].kind == IPRewriterInput::i_mapper)
 	    _input_specs[i].u.mapper->notify_rewriter(this, &_input_specs[i], &cerrh);
     }
+    if (_sharded && !errh->nerrors()) {
+	int n = master()->nthreads();
+	for (int i = 0; i < n; ++i) {
+	    IPRewriterShard *s = make_shard(i, n);
+	    if (!s)
+		return errh->error("SHARDED is not supported by %s", class_name());
+	    s->_heap->_capacity = _heap->_capacity;
+	    s->_inputs = _input_specs;
+	    for (int j = 0; j < s->_inputs.size(); ++j) {
+		s->_inputs[j].shard = s;
+		s->_inputs[j].count = s->_inputs[j].failures = 0;
+		if (s->_inputs[j].kind == IPRewriterInput::i_pattern)
+		    s->_inputs[j].u.pattern->use();
+	    }
+	    _shards.push_back(s);
+	}
+    }
     _gc_timer.initialize(this);
     if (_gc_interval_sec)
 	_gc_timer.schedule_after_sec(_gc_interval_sec);
@@ -210,6 +238,14 @@ void
 IPRewriterBase::cleanup(CleanupStage)
 {
     shrink_heap(true);
+    for (int i = 0; i < _shards.size(); ++i) {
+	IPRewriterShard *s = _shards[i];
+	for (int j = 0; j < s->_inputs.size(); ++j)
+	    if (s->_inputs[j].kind == IPRewriterInput::i_pattern)
+		s->_inputs[j].u.pattern->unuse();
+	delete s;
+    }
+    _shards.clear();
     for (int i = 0; i < _input_specs.size(); ++i)
 	if (_input_specs[i].kind == IPRewriterInput::i_pattern)
 	    _input_specs[i].u.pattern->unuse();
@@ -235,7 +271,10 @@ IPRewriterEntry *
 IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 			   Map &map, Map *reply_map_ptr)
 {
-    IPRewriterBase *reply_element = _input_specs[input].reply_element;
+    // the input spec of the shard the flow was created in, if any
+    IPRewriterInput *is = flow->owner();
+    IPRewriterHeap *h = heap(is);
+    IPRewriterBase *reply_element = is->reply_element;
     if ((unsigned) flow->entry(false).output() >= (unsigned) noutputs()
 	|| (unsigned) flow->entry(true).output() >= (unsigned) reply_element->noutputs()) {
 	flow->owner()->owner->destroy_flow(flow);
@@ -250,16 +289,16 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
     old = reply_map_ptr->set(&flow->entry(true));
     if (unlikely(old)) {		// Assume every map has the same heap.
 	if (likely(old->flow() != flow))
-	    old->flow()->destroy(_heap);
+	    old->flow()->destroy(h);
     }
 
-    Vector<IPRewriterFlow *> &myheap = _heap->_heaps[flow->guaranteed()];
+    Vector<IPRewriterFlow *> &myheap = h->_heaps[flow->guaranteed()];
     myheap.push_back(flow);
     push_heap(myheap.begin(), myheap.end(),
 	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
-    ++_input_specs[input].count;
+    ++is->count;
 
-    if (unlikely(_heap->size() > _heap->capacity())) {
+    if (unlikely(h->size() > h->capacity())) {
 	// This may destroy the newly added mapping, if it has the lowest
 	// expiration time.  How can we tell?  If (1) flows are added to the
 	// heap one at a time, so the heap was formerly no bigger than the
@@ -267,9 +306,9 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	// destroy 'flow' if it's the top of the heap.
 	click_jiffies_t now_j = click_jiffies();
 	assert(click_jiffies_less(now_j, flow->expiry())
-	       && _heap->size() == _heap->capacity() + 1);
-	if (shrink_heap_for_new_flow(flow, now_j)) {
-	    ++_input_specs[input].failures;
+	       && h->size() == h->capacity() + 1);
+	if (shrink_heap_for_new_flow(h, flow, now_j)) {
+	    ++is->failures;
 	    return 0;
 	}
     }
@@ -282,50 +321,64 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 }
 
 void
-IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j)
+IPRewriterBase::shift_heap_best_effort(IPRewriterHeap *heap, click_jiffies_t now_j)
 {
     // Shift flows with expired guarantees to the best-effort heap.
-    Vector<IPRewriterFlow *> &guaranteed_heap = _heap->_heaps[1];
+    Vector<IPRewriterFlow *> &guaranteed_heap = heap->_heaps[1];
     while (guaranteed_heap.size() && guaranteed_heap[0]->expired(now_j)) {
 	IPRewriterFlow *mf = guaranteed_heap[0];
 	click_jiffies_t new_expiry = mf->owner()->owner->best_effort_expiry(mf);
-	mf->change_expiry(_heap, false, new_expiry);
+	mf->change_expiry(heap, false, new_expiry);
     }
 }
 
 bool
-IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
+IPRewriterBase::shrink_heap_for_new_flow(IPRewriterHeap *heap,
+					 IPRewriterFlow *flow,
 					 click_jiffies_t now_j)
 {
-    shift_heap_best_effort(now_j);
+    shift_heap_best_effort(heap, now_j);
     // At this point, all flows in the guarantee heap expire in the future.
     // So remove the next-to-expire best-effort flow, unless there are none.
     // In that case we always remove the current flow to honor previous
     // guarantees (= admission control).
     IPRewriterFlow *deadf;
-    if (_heap->_heaps[0].empty()) {
+    if (heap->_heaps[0].empty()) {
 	assert(flow->guaranteed());
 	deadf = flow;
     } else
-	deadf = _heap->_heaps[0][0];
-    deadf->destroy(_heap);
+	deadf = heap->_heaps[0][0];
+    deadf->destroy(heap);
     return deadf == flow;
 }
 
 void
-IPRewriterBase::shrink_heap(bool clear_all)
+IPRewriterBase::shrink_heap(IPRewriterHeap *heap, bool clear_all)
 {
     click_jiffies_t now_j = click_jiffies();
-    shift_heap_best_effort(now_j);
-    Vector<IPRewriterFlow *> &best_effort_heap = _heap->_heaps[0];
+    shift_heap_best_effort(heap, now_j);
+    Vector<IPRewriterFlow *> &best_effort_heap = heap->_heaps[0];
     while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
-	best_effort_heap[0]->destroy(_heap);
+	best_effort_heap[0]->destroy(heap);
 
-    int32_t capacity = clear_all ? 0 : _heap->_capacity;
-    while (_heap->size() > capacity) {
-	IPRewriterFlow *deadf = _heap->_heaps[_heap->_heaps[0].empty()][0];
-	deadf->destroy(_heap);
+    int32_t capacity = clear_all ? 0 : heap->_capacity;
+    while (heap->size() > capacity) {
+	IPRewriterFlow *deadf = heap->_heaps[heap->_heaps[0].empty()][0];
+	deadf->destroy(heap);
+    }
+}
+
+void
+IPRewriterBase::shrink_heap(bool clear_all)
+{
+    for (int i = 0; i < _shards.size(); ++i) {
+	IPRewriterShard *s = _shards[i];
+	s->_lock.acquire();
+	s->_heap->_capacity = _heap->_capacity;
+	shrink_heap(s->_heap, clear_all);
+	s->_lock.release();
     }
+    shrink_heap(_heap, clear_all);
 }
 
 void
@@ -348,20 +401,27 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
     case h_nmappings: {
 	uint32_t count = 0;
 	for (int i = 0; i < rw->_input_specs.size(); ++i)
-	    count += rw->_input_specs[i].count;
+	    count += rw->input_count(i);
 	sa << count;
 	break;
     }
     case h_mapping_failures: {
 	uint32_t count = 0;
-	for (int i = 0; i < rw->_input_specs.size(); ++i)
+	for (int i = 0; i < rw->_input_specs.size(); ++i) {
 	    count += rw->_input_specs[i].failures;
+	    for (int j = 0; j < rw->_shards.size(); ++j)
+		count += rw->_shards[j]->_inputs[i].failures;
+	}
 	sa << count;
 	break;
     }
-    case h_size:
-	sa << rw->_heap->size();
+    case h_size: {
+	uint32_t size = rw->_heap->size();
+	for (int j = 0; j < rw->_shards.size(); ++j)
+	    size += rw->_shards[j]->_heap->size();
+	sa << size;
 	break;
+    }
     case h_capacity:
 	sa << rw->_heap->_capacity;
 	break;
@@ -386,8 +446,8 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
 		sa << "<mapper>";
 		break;
 	    }
-	    if (rw->_input_specs[i].count)
-		sa << " [" << rw->_input_specs[i].count << ']';
+	    if (uint32_t count = rw->input_count(i))
+		sa << " [" << count << ']';
 	    sa << '\n';
 	}
 	break;
@@ -425,14 +485,19 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
 	IPRewriterInput *spec = &rw->_input_specs[what];
 
 	// remove all existing flows created by this input
-	for (int which_heap = 0; which_heap < 2; ++which_heap) {
-	    Vector<IPRewriterFlow *> &myheap = rw->_heap->_heaps[which_heap];
-	    for (int i = myheap.size() - 1; i >= 0; --i)
-		if (myheap[i]->owner() == spec) {
-		    myheap[i]->destroy(rw->_heap);
-		    if (i < myheap.size())
-			++i;
-		}
+	rw->destroy_input_flows(rw->_heap, spec);
+	for (int j = 0; j < rw->_shards.size(); ++j) {
+	    IPRewriterShard *s = rw->_shards[j];
+	    IPRewriterInput *sspec = &s->_inputs[what];
+	    s->_lock.acquire();
+	    rw->destroy_input_flows(s->_heap, sspec);
+	    if (sspec->kind == IPRewriterInput::i_pattern)
+		sspec->u.pattern->unuse();
+	    *sspec = is;
+	    sspec->shard = s;
+	    if (sspec->kind == IPRewriterInput::i_pattern)
+		sspec->u.pattern->use();
+	    s->_lock.release();
 	}
 
 	// change pattern
@@ -443,6 +508,29 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     return 0;
 }
 
+void
+IPRewriterBase::destroy_input_flows(IPRewriterHeap *heap, IPRewriterInput *spec)
+{
+    for (int which_heap = 0; which_heap < 2; ++which_heap) {
+	Vector<IPRewriterFlow *> &myheap = heap->_heaps[which_heap];
+	for (int i = myheap.size() - 1; i >= 0; --i)
+	    if (myheap[i]->owner() == spec) {
+		myheap[i]->destroy(heap);
+		if (i < myheap.size())
+		    ++i;
+	    }
+    }
+}
+
+uint32_t
+IPRewriterBase::input_count(int input) const
+{
+    uint32_t count = _input_specs[input].count;
+    for (int j = 0; j < _shards.size(); ++j)
+	count += _shards[j]->_inputs[input].count;
+    return count;
+}
+
 void
 IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
 {
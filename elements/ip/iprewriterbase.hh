@@ -4,9 +4,11 @@
 #include <click/timer.hh>
 #include "elements/ip/iprwmapping.hh"
 #include <click/bitvector.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 class IPMapper;
 class IPRewriterPattern;
+class IPRewriterShard;
 
 class IPRewriterInput { public:
     enum {
@@ -24,9 +26,11 @@ class IPRewriterInput { public:
 	IPRewriterPattern *pattern;
 	IPMapper *mapper;
     } u;
+    IPRewriterShard *shard;	// set on the copies held by a shard
 
     IPRewriterInput()
-	: kind(i_drop), foutput(-1), routput(-1), count(0), failures(0) {
+	: kind(i_drop), foutput(-1), routput(-1), count(0), failures(0),
+	  shard(0) {
 	u.pattern = 0;
     }
 
@@ -78,6 +82,56 @@ class IPRewriterHeap { public:
 
 };
 
+/** @class IPRewriterShard
+  @brief Flow tables of one thread of a sharded rewriter.
+
+  In sharded mode a rewriter keeps one shard per Click thread, picked by
+  the thread processing the packet. A flow lives in the shard of the
+  thread that created it: both its map entries, its place in the heap
+  and its memory. Shards share nothing but the patterns, which are read
+  only on the data path, so threads never contend as long as both
+  directions of a flow are handled by the same thread, e.g. when flows
+  are spread over threads by a symmetric hash. The lock only guards
+  against handlers and the reaping timer. */
+class IPRewriterShard { public:
+
+    IPRewriterShard(int index, int count)
+	: _map(0), _udp_map(0), _heap(new IPRewriterHeap),
+	  _index(index), _count(count) {
+    }
+    virtual ~IPRewriterShard() {
+	_heap->unuse();
+    }
+
+    HashContainer<IPRewriterEntry> *map(int mapid) {
+	if (mapid == IPRewriterInput::mapid_default)
+	    return &_map;
+	else if (mapid == IPRewriterInput::mapid_iprewriter_udp)
+	    return &_udp_map;
+	else
+	    return 0;
+    }
+
+    int index() const {
+	return _index;
+    }
+    int count() const {
+	return _count;
+    }
+
+    HashContainer<IPRewriterEntry> _map;
+    HashContainer<IPRewriterEntry> _udp_map;
+    IPRewriterHeap *_heap;
+    Vector<IPRewriterInput> _inputs;
+    Spinlock _lock;
+
+  private:
+
+    int _index;
+    int _count;
+
+};
+
 class IPRewriterBase : public Element { public:
 
     typedef HashContainer<IPRewriterEntry> Map;
@@ -111,9 +165,22 @@ class IPRewriterBase : public Element { public:
 	return _input_specs[input].reply_element;
     }
     virtual HashContainer<IPRewriterEntry> *get_map(int mapid) {
+	if (_shards.size())
+	    return mapid == IPRewriterInput::mapid_default ? &shard()->_map : 0;
 	return likely(mapid == IPRewriterInput::mapid_default) ? &_map : 0;
     }
 
+    /** @brief Return true iff the rewriter keeps one flow table per
+     * thread. */
+    bool sharded() const {
+	return _shards.size();
+    }
+    /** @brief Return the shard of the calling thread.
+     * @pre sharded() */
+    IPRewriterShard *shard() const {
+	return _shards.unchecked_at(click_current_cpu_id() % _shards.size());
+    }
+
     enum {
 	get_entry_check = -1, get_entry_reply = -2
     };
@@ -136,6 +203,8 @@ class IPRewriterBase : public Element { public:
     Vector<IPRewriterInput> _input_specs;
 
     IPRewriterHeap *_heap;
+    bool _sharded;
+    Vector<IPRewriterShard *> _shards;
     uint32_t _timeouts[2];
     uint32_t _gc_interval_sec;
     Timer _gc_timer;
@@ -150,6 +219,16 @@ class IPRewriterBase : public Element { public:
 	return timeouts[1] ? timeouts[1] : timeouts[0];
     }
 
+    /** @brief Return the heap of the flows created by @a is. */
+    IPRewriterHeap *heap(const IPRewriterInput *is) const {
+	return is->shard ? is->shard->_heap : _heap;
+    }
+
+    /** @brief Create the shard @a index of @a count for sharded mode.
+     *
+     * Returns null, the default, if the rewriter does not support it. */
+    virtual IPRewriterShard *make_shard(int index, int count);
+
     IPRewriterEntry *store_flow(IPRewriterFlow *flow, int input,
 				Map &map, Map *reply_map_ptr = 0);
     inline void unmap_flow(IPRewriterFlow *flow,
@@ -173,9 +252,13 @@ class IPRewriterBase : public Element { public:
 
   private:
 
-    void shift_heap_best_effort(click_jiffies_t now_j);
-    bool shrink_heap_for_new_flow(IPRewriterFlow *flow, click_jiffies_t now_j);
+    void shift_heap_best_effort(IPRewriterHeap *heap, click_jiffies_t now_j);
+    bool shrink_heap_for_new_flow(IPRewriterHeap *heap, IPRewriterFlow *flow,
+				  click_jiffies_t now_j);
+    void shrink_heap(IPRewriterHeap *heap, bool clear_all);
     void shrink_heap(bool clear_all);
+    void destroy_input_flows(IPRewriterHeap *heap, IPRewriterInput *spec);
+    uint32_t input_count(int input) const;
 
     friend class IPRewriterFlow;
 
@@ -211,7 +294,13 @@ IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 	return IPRewriterBase::rw_addmap;
     case i_pattern: {
 	HashContainer<IPRewriterEntry> *reply_map;
-	if (likely(mapid == mapid_default))
+	if (shard) {
+	    // a sharded rewriter is its own reply element
+	    reply_map = shard->map(mapid);
+	    i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map,
+					  shard->index(), shard->count());
+	    goto check_for_failure;
+	} else if (likely(mapid == mapid_default))
 	    reply_map = &reply_element->_map;
 	else
 	    reply_map = reply_element->get_map(mapid);
@@ -139,6 +139,13 @@ IPRouteTable::lookup_route(IPAddress, IPAddress&) const
     return -1;			// by default, route lookups fail
 }
 
+void
+IPRouteTable::lookup_routes(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const
+{
+    for (int i = 0; i < n; i++)
+	ports[i] = lookup_route(addrs[i], gws[i]);
+}
+
 String
 IPRouteTable::dump_routes()
 {
@@ -164,6 +171,55 @@ IPRouteTable::push(int, Packet *p)
     }
 }
 
+void
+IPRouteTable::push_batch(int, Packet* head)
+{
+    route_batch(head, false);
+}
+
+void
+IPRouteTable::route_batch(Packet* head, bool quiet)
+{
+    Packet* ps[LOOKUP_BATCH];
+    IPAddress addrs[LOOKUP_BATCH];
+    IPAddress gws[LOOKUP_BATCH];
+    int ports[LOOKUP_BATCH];
+
+    while (head) {
+	int n = 0;
+	while (n < LOOKUP_BATCH && head) {
+	    ps[n] = PacketBatch::pop(head);
+	    addrs[n] = ps[n]->dst_ip_anno();
+	    n++;
+	}
+
+	lookup_routes(addrs, n, ports, gws);
+
+	// runs of packets bound for the same output are pushed together
+	PacketBatch run;
+	int port = -1;
+	for (int i = 0; i < n; i++) {
+	    Packet* p = ps[i];
+	    if (ports[i] < 0) {
+		static int complained = 0;
+		if (!quiet && ++complained <= 5)
+		    click_chatter("IPRouteTable: no route for %s", p->dst_ip_anno().unparse().c_str());
+		p->kill();
+		continue;
+	    }
+	    assert(ports[i] < noutputs());
+	    if (gws[i])
+		p->set_dst_ip_anno(gws[i]);
+	    if (ports[i] != port && !run.empty())
+		output(port).push_batch(run.take());
+	    port = ports[i];
+	    run.append(p);
+	}
+	if (!run.empty())
+	    output(port).push_batch(run.take());
+    }
+}
+
 
 int
 IPRouteTable::run_command(int command, const String &str, Vector<IPRoute>* old_routes, ErrorHandler *errh)
@@ -108,6 +108,14 @@ Looks up the route associated with address C<dst>. Should set C<gw_return> to
 the resulting gateway and return the relevant output port (or negative if
 there is no route). The default implementation returns -1.
 
+=item C<void B<lookup_routes>(const IPAddress *dst, int n, int *ports, IPAddress *gws) const>
+
+Looks up the routes of the C<n> addresses C<dst>, at most LOOKUP_BATCH of
+them, as B<lookup_route> would, storing the output ports in C<ports> and the
+gateways in C<gws>. Tables override it to overlap the memory accesses of
+the lookups. The default implementation calls B<lookup_route> for each
+address.
+
 =item C<String B<dump_routes>()>
 
 Returns a textual description of the current routing table. The default
@@ -132,6 +140,13 @@ The default implementation of B<push> uses B<lookup_route> to perform IP
 routing lookup. Normally, subclasses implement their own B<push> methods,
 avoiding virtual function call overhead.
 
+=item C<void B<push_batch>(int port, Packet *head)>
+
+The default implementation of B<push_batch> looks the destination address
+annotations of up to LOOKUP_BATCH packets of the batch up at a time with
+B<lookup_routes>, and pushes runs of packets bound for the same output
+together. Subclasses with their own B<push> call B<route_batch> instead.
+
 =item C<static int B<add_route_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback parses its input as an add-route request
@@ -194,9 +209,11 @@ class IPRouteTable : public Element { public:
     virtual int add_route(const IPRoute& route, bool allow_replace, IPRoute* replaced_route, ErrorHandler* errh);
     virtual int remove_route(const IPRoute& route, IPRoute* removed_route, ErrorHandler* errh);
     virtual int lookup_route(IPAddress addr, IPAddress& gw) const = 0;
+    virtual void lookup_routes(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const;
     virtual String dump_routes();
 
     void push(int port, Packet* p);
+    void push_batch(int port, Packet* head);
 
     static int add_route_handler(const String&, Element*, void*, ErrorHandler*);
     static int remove_route_handler(const String&, Element*, void*, ErrorHandler*);
@@ -204,6 +221,22 @@ class IPRouteTable : public Element { public:
     static int lookup_handler(int operation, String&, Element*, const Handler*, ErrorHandler*);
     static String table_handler(Element*, void*);
 
+    enum { LOOKUP_BATCH = 32 };
+
+  protected:
+
+    // Routes a batch, LOOKUP_BATCH packets per lookup_routes() call.
+    // Packets without a route are killed, with a complaint unless quiet.
+    void route_batch(Packet* head, bool quiet);
+
+    static inline void prefetch(const void* p) {
+#if defined(__GNUC__)
+	__builtin_prefetch(p);
+#else
+	(void) p;
+#endif
+    }
+
   private:
 
     enum { CMD_ADD, CMD_SET, CMD_REMOVE };
@@ -219,7 +219,8 @@ IPRewriterPattern::parse_with_ports(const String &conf, IPRewriterInput *input,
 int
 IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 				  IPFlowID &rewritten_flowid,
-				  const HashContainer<IPRewriterEntry> &reply_map)
+				  const HashContainer<IPRewriterEntry> &reply_map,
+				  int shard, int nshards)
 {
     rewritten_flowid = flowid;
     if (_saddr)
@@ -235,9 +236,12 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	IPFlowID lookup = rewritten_flowid.reverse();
 	uint32_t base = (_is_napt ? ntohs(_sport) : ntohl(_saddr.addr()));
 
+	// shards of a rewriter only see their own flows, so each picks
+	// from its own slice of the variations
 	uint32_t val;
 	if (_same_first
-	    && (val = ntohs(flowid.sport()) - base) <= _variation_top) {
+	    && (val = ntohs(flowid.sport()) - base) <= _variation_top
+	    && val % nshards == (uint32_t) shard) {
 	    lookup.set_dport(flowid.sport());
 	    if (!reply_map.find(lookup))
 		goto found_variation;
@@ -250,6 +254,8 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 
 	for (uint32_t count = 0; count <= _variation_top;
 	     ++count, val = (val == _variation_top ? 0 : val + 1)) {
+	    if (nshards > 1 && val % nshards != (uint32_t) shard)
+		continue;
 	    if (_is_napt)
 		lookup.set_dport(htons(base + val));
 	    else
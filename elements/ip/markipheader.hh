@@ -33,6 +33,8 @@ class MarkIPHeader : public Element {
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, Packet *head)	{ simple_action_push_batch(port, head); }
+  Packet *pull_batch(int port, unsigned max) { return simple_action_pull_batch(port, max); }
 
 };
 
@@ -0,0 +1,155 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * portsetclassifier.{cc,hh} -- classifies IP packets by transport protocol
+ * and port set
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "portsetclassifier.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/nameinfo.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+PortSetClassifier::PortSetClassifier()
+    : _proto(IP_PROTO_UDP), _direction(DIR_DST)
+{
+    memset(_ports, 0, sizeof(_ports));
+}
+
+int
+PortSetClassifier::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int proto;
+    String ports, direction = "dst";
+
+    if (Args(conf, this, errh)
+	.read_mp("PROTO", NamedIntArg(NameInfo::T_IP_PROTO), proto)
+	.read_mp("PORTS", AnyArg(), ports)
+	.read("DIRECTION", WordArg(), direction)
+	.complete() < 0)
+	return -1;
+
+    if (proto != IP_PROTO_TCP && proto != IP_PROTO_UDP
+	&& proto != IP_PROTO_DCCP && proto != IP_PROTO_SCTP)
+	return errh->error("PROTO must be a protocol with ports");
+    _proto = proto;
+
+    if (direction == "dst")
+	_direction = DIR_DST;
+    else if (direction == "src")
+	_direction = DIR_SRC;
+    else if (direction == "either")
+	_direction = DIR_EITHER;
+    else
+	return errh->error("DIRECTION must be dst, src or either");
+
+    Vector<String> words;
+    cp_spacevec(cp_unquote(ports), words);
+    if (!words.size())
+	return errh->error("PORTS is empty");
+
+    memset(_ports, 0, sizeof(_ports));
+    for (int i = 0; i < words.size(); i++) {
+	String first = words[i], last = words[i];
+	int dash = words[i].find_left('-');
+	if (dash > 0) {
+	    first = words[i].substring(0, dash);
+	    last = words[i].substring(dash + 1);
+	}
+	uint16_t lo, hi;
+	if (!IPPortArg(_proto).parse(first, lo, this)
+	    || !IPPortArg(_proto).parse(last, hi, this) || lo > hi)
+	    return errh->error("PORTS: bad port %<%s%>", words[i].c_str());
+	for (uint32_t p = lo; p <= hi; p++)
+	    _ports[p >> 5] |= 1U << (p & 31);
+    }
+
+    return 0;
+}
+
+// 0 if p matches, 1 if not
+inline int
+PortSetClassifier::match(Packet *p) const
+{
+    const click_ip *iph = p->ip_header();
+    // TCP, UDP, DCCP and SCTP all start with the source and destination
+    // ports
+    if (iph->ip_p != _proto || !IP_FIRSTFRAG(iph)
+	|| p->transport_length() < (int) sizeof(click_udp))
+	return 1;
+    const click_udp *udph = p->udp_header();
+    if ((_direction & DIR_DST) && has(ntohs(udph->uh_dport)))
+	return 0;
+    if ((_direction & DIR_SRC) && has(ntohs(udph->uh_sport)))
+	return 0;
+    return 1;
+}
+
+void
+PortSetClassifier::push(int, Packet *p)
+{
+    checked_output_push(match(p), p);
+}
+
+void
+PortSetClassifier::push_batch(int, Packet *head)
+{
+    // runs of packets bound for the same output are pushed together
+    PacketBatch run;
+    int port = -1;
+    while (Packet *p = PacketBatch::pop(head)) {
+	int o = match(p);
+	if (o != port && !run.empty())
+	    checked_output_push_batch(port, run.take());
+	port = o;
+	run.append(p);
+    }
+    if (!run.empty())
+	checked_output_push_batch(port, run.take());
+}
+
+String
+PortSetClassifier::read_handler(Element *e, void *)
+{
+    PortSetClassifier *c = static_cast<PortSetClassifier *>(e);
+    StringAccum sa;
+    for (uint32_t p = 0; p < 65536; p++) {
+	if (!c->has(p))
+	    continue;
+	uint32_t q = p;
+	while (q < 65535 && c->has(q + 1))
+	    q++;
+	if (sa.length())
+	    sa << ' ';
+	sa << p;
+	if (q > p)
+	    sa << '-' << q;
+	p = q;
+    }
+    sa << '\n';
+    return sa.take_string();
+}
+
+void
+PortSetClassifier::add_handlers()
+{
+    add_read_handler("ports", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(PortSetClassifier)
+ELEMENT_MT_SAFE(PortSetClassifier)
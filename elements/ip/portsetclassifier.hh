@@ -0,0 +1,95 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PORTSETCLASSIFIER_HH
+#define CLICK_PORTSETCLASSIFIER_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+PortSetClassifier(PROTO, PORTS, [I<keywords> DIRECTION])
+
+=s ip
+
+classifies IP packets by transport protocol and port set
+
+=d
+
+Sends IP packets of protocol PROTO whose port is in PORTS to output 0, and
+all other packets to output 1. It does what
+
+  IPClassifier(dst udp port 7007 or dst udp port 7008, -)
+
+does, with a single check of the headers and a bitmap test on the port
+instead of a classifier program, so the cost does not grow with the number
+of ports.
+
+As with IPClassifier, the input packets must have their IP header
+annotation set, and only first fragments with a complete transport header
+(the ports, at least) can match.
+
+Keyword arguments are:
+
+=over 8
+
+=item PROTO
+
+IP protocol name or number, such as C<udp> or C<tcp>. Must be a protocol
+with ports: TCP, UDP, DCCP or SCTP.
+
+=item PORTS
+
+Space-separated port numbers or names and ranges (C<8000-8010>).
+
+=item DIRECTION
+
+Which port is looked at: C<dst>, C<src>, or C<either>. Default is C<dst>.
+
+=back
+
+=h ports read-only
+
+The port set, as ranges.
+
+=e
+
+  PortSetClassifier(udp, 7007 7008)
+
+is equivalent to the IPClassifier above.
+
+=a IPClassifier, IPFilter */
+
+class PortSetClassifier : public Element { public:
+
+    PortSetClassifier() CLICK_COLD;
+
+    const char *class_name() const		{ return "PortSetClassifier"; }
+    const char *port_count() const		{ return "1/2"; }
+    const char *processing() const		{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    void push_batch(int, Packet *);
+
+  private:
+
+    enum { DIR_DST = 1, DIR_SRC = 2, DIR_EITHER = 3 };
+
+    uint8_t _proto;
+    int _direction;
+    uint32_t _ports[65536 / 32];
+
+    bool has(uint16_t port) const {
+	return _ports[port >> 5] & (1U << (port & 31));
+    }
+
+    inline int match(Packet *) const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
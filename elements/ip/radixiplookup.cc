@@ -47,7 +47,33 @@ class RadixIPLookup::Radix { public:
 	}
 	return cur;
     }
-    
+
+    // Walks the trie for n addresses a level at a time, prefetching the
+    // child each address goes to next, so the misses of one level overlap.
+    static void lookup_batch(const Radix *r, int dflt, const uint32_t *addrs, int n, int *keys) {
+	const Radix *cur[IPRouteTable::LOOKUP_BATCH];
+	int live = 0;
+	for (int i = 0; i < n; i++) {
+	    keys[i] = dflt;
+	    cur[i] = r;
+	    live += (r != 0);
+	}
+	for (int level = 0; live; level++) {
+	    live = 0;
+	    for (int i = 0; i < n; i++)
+		if (const Radix *x = cur[i]) {
+		    int i1 = (addrs[i] >> _bitshift[level]) & (_nbuckets[level] - 1);
+		    const Child &c = x->_children[i1];
+		    if (c.key)
+			keys[i] = c.key;
+		    if ((cur[i] = c.child)) {
+			prefetch(&c.child->_children[(addrs[i] >> _bitshift[level + 1]) & (_nbuckets[level + 1] - 1)]);
+			live++;
+		    }
+		}
+	}
+    }
+
 private:
 
 
@@ -291,6 +317,25 @@ RadixIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
     }
 }
 
+void
+RadixIPLookup::lookup_routes(const IPAddress *addrs, int n, int *ports, IPAddress *gws) const
+{
+    uint32_t a[LOOKUP_BATCH];
+    int keys[LOOKUP_BATCH];
+    assert(n <= LOOKUP_BATCH);
+    for (int i = 0; i < n; i++)
+	a[i] = ntohl(addrs[i].addr());
+    Radix::lookup_batch(_radix, _default_key, a, n, keys);
+    for (int i = 0; i < n; i++)
+	if (int lookup_key = get_lookup_key(keys[i])) {
+	    gws[i] = _lookup[lookup_key - 1].gw;
+	    ports[i] = _lookup[lookup_key - 1].port;
+	} else {
+	    gws[i] = 0;
+	    ports[i] = -1;
+	}
+}
+
 void
 RadixIPLookup::flush_table()
 {
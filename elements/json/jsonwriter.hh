@@ -0,0 +1,306 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_JSONWRITER_HH
+#define CLICK_JSONWRITER_HH 1
+#include <click/straccum.hh>
+#include <click/string.hh>
+#include <click/glue.hh>
+CLICK_DECLS
+
+/** @class JsonWriter
+    @brief Streaming JSON output into a StringAccum.
+
+    Json builds the whole document in memory before unparse() turns it
+    into text, which doubles the work for handlers that only report state.
+    JsonWriter appends the text as values are handed to it, with no
+    intermediate representation: the only allocations are those of the
+    StringAccum, which the caller may reserve() up front.
+
+    @code
+    StringAccum sa;
+    JsonWriter w(sa);
+    w.begin_object();
+    w.member("name", "x").key("values").begin_array();
+    for (int i = 0; i < 3; i++)
+        w.value(i);
+    w.end_array().end_object();
+    // sa is {"name":"x","values":[0,1,2]}
+    @endcode
+
+    The writer checks neither that keys are given inside objects only nor
+    that every container is closed; it tracks commas for up to 64 nested
+    containers. */
+class JsonWriter { public:
+
+    enum { max_depth = 64 };
+
+    inline explicit JsonWriter(StringAccum &sa);
+
+    inline JsonWriter &begin_object();
+    inline JsonWriter &end_object();
+    inline JsonWriter &begin_array();
+    inline JsonWriter &end_array();
+
+    inline JsonWriter &key(const char *k);
+    inline JsonWriter &key(const String &k);
+
+    inline JsonWriter &value(int x);
+    inline JsonWriter &value(unsigned x);
+    inline JsonWriter &value(long x);
+    inline JsonWriter &value(unsigned long x);
+#if HAVE_LONG_LONG
+    inline JsonWriter &value(long long x);
+    inline JsonWriter &value(unsigned long long x);
+#endif
+#if HAVE_FLOAT_TYPES
+    inline JsonWriter &value(double x);
+#endif
+    inline JsonWriter &value(bool x);
+    inline JsonWriter &value(const char *x);
+    inline JsonWriter &value(const String &x);
+    inline JsonWriter &null();
+
+    /** @brief Append "k": x in the current object. */
+    template <typename T> JsonWriter &member(const char *k, const T &x) {
+	key(k);
+	return value(x);
+    }
+
+    /** @brief Append x as a string, through StringAccum's operator<<.
+
+	Meant for addresses and similar types whose text never needs
+	escaping: EtherAddress, IPAddress, Timestamp. The text goes straight
+	into the StringAccum, with no temporary String. */
+    template <typename T> JsonWriter &quoted(const T &x) {
+	separate();
+	_sa << '\"' << x << '\"';
+	return *this;
+    }
+
+    /** @brief Return the depth of the container being written, 0 at top
+	level. */
+    int depth() const {
+	return _depth;
+    }
+
+    StringAccum &sa() const {
+	return _sa;
+    }
+
+  private:
+
+    StringAccum &_sa;
+    int _depth;
+    // bit d is set once the container at depth d has an element
+    uint64_t _nonempty;
+    bool _after_key;
+
+    inline void separate();
+    inline void open(char c);
+    inline void close(char c);
+    void append_string(const char *s, int len);
+
+};
+
+inline JsonWriter::JsonWriter(StringAccum &sa)
+    : _sa(sa), _depth(0), _nonempty(0), _after_key(false) {
+}
+
+inline void JsonWriter::separate() {
+    if (_after_key)
+	_after_key = false;
+    else if (_depth > 0 && _depth <= max_depth) {
+	uint64_t bit = (uint64_t) 1 << (_depth - 1);
+	if (_nonempty & bit)
+	    _sa << ',';
+	else
+	    _nonempty |= bit;
+    }
+}
+
+inline void JsonWriter::open(char c) {
+    separate();
+    _sa << c;
+    ++_depth;
+    if (_depth <= max_depth)
+	_nonempty &= ~((uint64_t) 1 << (_depth - 1));
+}
+
+inline void JsonWriter::close(char c) {
+    _sa << c;
+    if (_depth > 0)
+	--_depth;
+}
+
+/** @brief Open an object. */
+inline JsonWriter &JsonWriter::begin_object() {
+    open('{');
+    return *this;
+}
+
+/** @brief Close the current object. */
+inline JsonWriter &JsonWriter::end_object() {
+    close('}');
+    return *this;
+}
+
+/** @brief Open an array. */
+inline JsonWriter &JsonWriter::begin_array() {
+    open('[');
+    return *this;
+}
+
+/** @brief Close the current array. */
+inline JsonWriter &JsonWriter::end_array() {
+    close(']');
+    return *this;
+}
+
+/** @brief Append the key of the next member of the current object. */
+inline JsonWriter &JsonWriter::key(const char *k) {
+    separate();
+    append_string(k, strlen(k));
+    _sa << ':';
+    _after_key = true;
+    return *this;
+}
+
+/** @overload */
+inline JsonWriter &JsonWriter::key(const String &k) {
+    separate();
+    append_string(k.data(), k.length());
+    _sa << ':';
+    _after_key = true;
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(int x) {
+    separate();
+    _sa << x;
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(unsigned x) {
+    separate();
+    _sa << x;
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(long x) {
+    separate();
+    _sa << x;
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(unsigned long x) {
+    separate();
+    _sa << x;
+    return *this;
+}
+
+#if HAVE_LONG_LONG
+inline JsonWriter &JsonWriter::value(long long x) {
+    separate();
+    _sa << x;
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(unsigned long long x) {
+    separate();
+    _sa << x;
+    return *this;
+}
+#endif
+
+#if HAVE_FLOAT_TYPES
+/** @brief Append a number, or null if @a x is not finite since JSON has
+    no representation for it. */
+inline JsonWriter &JsonWriter::value(double x) {
+    separate();
+    if (x != x || x - x != 0)
+	_sa << "null";
+    else
+	_sa << x;
+    return *this;
+}
+#endif
+
+inline JsonWriter &JsonWriter::value(bool x) {
+    separate();
+    if (x)
+	_sa.append("true", 4);
+    else
+	_sa.append("false", 5);
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(const char *x) {
+    separate();
+    append_string(x, strlen(x));
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::value(const String &x) {
+    separate();
+    append_string(x.data(), x.length());
+    return *this;
+}
+
+inline JsonWriter &JsonWriter::null() {
+    separate();
+    _sa.append("null", 4);
+    return *this;
+}
+
+/** @brief Append @a s in double quotes, escaped as String::encode_json()
+    does, straight into the StringAccum. */
+inline void JsonWriter::append_string(const char *s, int len) {
+    const char *last = s, *end = s + len;
+    _sa << '\"';
+    for (; s != end; ++s) {
+	int c = (unsigned char) *s;
+
+	// U+2028 and U+2029 can't appear in Javascript strings
+	if (unlikely(c == 0xE2)
+	    && s + 2 < end && (unsigned char) s[1] == 0x80
+	    && (unsigned char) (s[2] | 1) == 0xA9)
+	    c = 0x2028 + (s[2] & 1);
+	else if (likely(c >= 32 && c != '\\' && c != '\"' && c != '/'))
+	    continue;
+
+	_sa.append(last, s);
+	_sa << '\\';
+	switch (c) {
+	case '\b':
+	    _sa << 'b';
+	    break;
+	case '\f':
+	    _sa << 'f';
+	    break;
+	case '\n':
+	    _sa << 'n';
+	    break;
+	case '\r':
+	    _sa << 'r';
+	    break;
+	case '\t':
+	    _sa << 't';
+	    break;
+	case '\\':
+	case '\"':
+	case '/':
+	    _sa.append((char) c);
+	    break;
+	default: // c is a control character, 0x2028, or 0x2029
+	    _sa.snprintf(5, "u%04X", c);
+	    if (c > 255)	// skip rest of encoding of U+202[89]
+		s += 2;
+	    break;
+	}
+	last = s + 1;
+    }
+    _sa.append(last, end);
+    _sa << '\"';
+}
+
+CLICK_ENDDECLS
+#endif
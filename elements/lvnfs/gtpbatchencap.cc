@@ -0,0 +1,209 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  gtpbatchencap.cc
+ *
+ *    Description:  Element encapsulates bursts of IP packets in GTP-U tunnels.
+ *
+ * =====================================================================================
+ */
+
+#include <click/config.h>
+#include "gtpbatchencap.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/standard/scheduleinfo.hh>
+#include "gtpsessiontable.hh"
+CLICK_DECLS
+
+GTPBatchEncap::GTPBatchEncap()
+  : _burst(32), _active(true), _task(this)
+{
+}
+
+GTPBatchEncap::~GTPBatchEncap()
+{
+}
+
+int
+GTPBatchEncap::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Args(conf, this, errh)
+      .read_p("BURST", _burst)
+      .read("ACTIVE", _active)
+      .complete() < 0)
+    return -1;
+  if (_burst <= 0)
+    return errh->error("BURST must be positive");
+  return 0;
+}
+
+int
+GTPBatchEncap::initialize(ErrorHandler *errh)
+{
+  ScheduleInfo::initialize_task(this, &_task, _active, errh);
+  _signal = Notifier::upstream_empty_signal(this, 0, &_task);
+  return 0;
+}
+
+bool
+GTPBatchEncap::run_task(Task *)
+{
+  if (!_active)
+    return false;
+
+  Packet *head = 0, *tail = 0;
+  int n = 0;
+  while (n < _burst) {
+    Packet *p = input(0).pull();
+    if (!p)
+      break;
+    if (tail)
+      tail->set_next(p);
+    else
+      head = p;
+    tail = p;
+    n++;
+  }
+
+  if (!n) {
+    if (_signal)
+      _task.fast_reschedule();
+    return false;
+  }
+  tail->set_next(0);
+
+  Packet *out = 0, *out_tail = 0;
+  uint32_t drops = 0;
+
+  {
+    EmpowerEpoch::Guard guard(gtp_sessions.epoch());
+    const GTPSessionIndex *index = gtp_sessions.index();
+
+    // result of the last lookup, a run of packets between the same two
+    // hosts resolves to the same tunnel headers
+    bool cached = false;
+    uint32_t last_src = 0, last_dst = 0;
+    const click_gtp_outer *tmpl = 0;
+    uint16_t sum = 0;
+
+    for (Packet *p = head, *next; p; p = next) {
+      next = p->next();
+      p->set_next(0);
+
+      if (p->length() < sizeof(click_ip)) {
+        drops++;
+        p->kill();
+        continue;
+      }
+
+      const click_ip *ip = reinterpret_cast<const click_ip *>(p->data());
+      uint32_t src = ip->ip_src.s_addr, dst = ip->ip_dst.s_addr;
+
+      if (!cached || src != last_src || dst != last_dst) {
+        const GTPSession *session = index->by_UE_IP.get(IPAddress(src));
+        bool uplink = session;
+        if (!session)
+          session = index->by_UE_IP.get(IPAddress(dst));
+        if (session && session->complete()) {
+          tmpl = uplink ? &session->UE2EPC_header : &session->EPC2UE_header;
+          sum = uplink ? session->UE2EPC_sum : session->EPC2UE_sum;
+        } else
+          tmpl = 0;
+        last_src = src;
+        last_dst = dst;
+        cached = true;
+      }
+
+      if (!tmpl) {
+        drops++;
+        p->kill();
+        continue;
+      }
+
+      WritablePacket *q = p->push(sizeof(click_gtp_outer));
+      if (!q)
+        continue;
+
+      click_gtp_outer *h = reinterpret_cast<click_gtp_outer *>(q->data());
+      memcpy(h, tmpl, sizeof(*h));
+      GTPSessionTable::patch(h, q->length(), sum);
+      const click_ip *outer = reinterpret_cast<const click_ip *>(q->data() + offsetof(click_gtp_outer, ip));
+      q->set_ip_header(outer, sizeof(click_ip));
+
+      if (out_tail)
+        out_tail->set_next(q);
+      else
+        out = q;
+      out_tail = q;
+    }
+  }
+
+  _drops += drops;
+
+  while (out) {
+    Packet *next = out->next();
+    out->set_next(0);
+    _count++;
+    output(0).push(out);
+    out = next;
+  }
+
+  _task.fast_reschedule();
+  return true;
+}
+
+enum { H_COUNT, H_DROPS, H_ACTIVE, H_RESET };
+
+String
+GTPBatchEncap::read_handler(Element *e, void *thunk)
+{
+  GTPBatchEncap *g = static_cast<GTPBatchEncap *>(e);
+  switch ((intptr_t) thunk) {
+  case H_COUNT:
+    return String(g->_count) + "\n";
+  case H_DROPS:
+    return String(g->_drops) + "\n";
+  case H_ACTIVE:
+    return String(g->_active) + "\n";
+  default:
+    return String();
+  }
+}
+
+int
+GTPBatchEncap::write_handler(const String &in_s, Element *e, void *thunk, ErrorHandler *errh)
+{
+  GTPBatchEncap *g = static_cast<GTPBatchEncap *>(e);
+  String s = cp_uncomment(in_s);
+  switch ((intptr_t) thunk) {
+  case H_ACTIVE:
+    if (!BoolArg().parse(s, g->_active))
+      return errh->error("active parameter must be boolean");
+    if (g->_active && !g->_task.scheduled())
+      g->_task.reschedule();
+    break;
+  case H_RESET:
+    g->_count = 0;
+    g->_drops = 0;
+    break;
+  }
+  return 0;
+}
+
+void
+GTPBatchEncap::add_handlers()
+{
+  add_read_handler("count", read_handler, H_COUNT);
+  add_read_handler("drops", read_handler, H_DROPS);
+  add_read_handler("active", read_handler, H_ACTIVE);
+  add_write_handler("active", write_handler, H_ACTIVE);
+  add_write_handler("reset", write_handler, H_RESET, Handler::f_button);
+  add_task_handlers(&_task, &_signal);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(GTPBatchEncap)
+ELEMENT_REQUIRES(GTPSessionTable)
+ELEMENT_MT_SAFE(GTPBatchEncap)
@@ -0,0 +1,67 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  gtpbatchencap.hh
+ *
+ *    Description:  Element encapsulates bursts of IP packets in GTP-U tunnels.
+ *
+ * =====================================================================================
+ */
+
+#ifndef CLICK_GTPBATCHENCAP_HH
+#define CLICK_GTPBATCHENCAP_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+
+/*
+ * GTPBatchEncap([BURST, I<keywords> ACTIVE])
+ *
+ * Pulls IP packets, up to BURST (default 32) per task run, and pushes
+ * them out encapsulated in the GTP-U tunnel of their UE, outer IP and
+ * UDP headers included, like GTPEncap(OUTER true). Packets of UEs without
+ * a complete session are dropped.
+ *
+ * The burst is pulled into a chain first and encapsulated in one pass:
+ * the session table is entered once per burst, consecutive packets of
+ * the same UE and direction reuse its session without a lookup, and each
+ * packet only gets a copy of the tunnel headers with its lengths and the
+ * incremental update of their precomputed checksum. No IPEncap or
+ * UDPIPEncap is needed downstream.
+ *
+ * Handlers: count (packets sent), drops, active (read/write), reset.
+ */
+
+class GTPBatchEncap : public Element { public:
+
+  GTPBatchEncap();
+  ~GTPBatchEncap();
+
+  const char *class_name() const    { return "GTPBatchEncap"; }
+  const char *port_count() const    { return PORTS_1_1; }
+  const char *processing() const    { return PULL_TO_PUSH; }
+
+  int configure(Vector<String> &, ErrorHandler *);
+  int initialize(ErrorHandler *);
+  void add_handlers();
+
+  bool run_task(Task *);
+
+  private:
+
+  int _burst;
+  bool _active;
+  Task _task;
+  NotifierSignal _signal;
+  atomic_uint32_t _count;
+  atomic_uint32_t _drops;
+
+  static String read_handler(Element *, void *);
+  static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -18,18 +18,19 @@
 #include "gtpencap.hh"
 #include "gtp.h"
 #include <click/ipaddress.hh>
+#include <click/args.hh>
 #include <click/confparse.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/standard/alignmentinfo.hh>
 #include <click/string.hh>
-#include <click/ipaddress.hh>
-#include <arpa/inet.h>
-#include "scyllas1monitor.hh"
+#include "gtpsessiontable.hh"
 CLICK_DECLS
 
 GTPEncap::GTPEncap()
+  : _outer(false)
 {
+  _drops = 0;
 }
 
 GTPEncap::~GTPEncap()
@@ -45,37 +46,82 @@ GTPEncap::configure(Vector<String> &conf, ErrorHandler *errh)
   _gtph.flags |= GTP_VERSION;
   _gtph.flags |= GTP_PROTOCOL_TYPE;  
 
-  return 0;
+  return Args(conf, this, errh)
+      .read_p("OUTER", _outer)
+      .complete();
 }
 
 Packet *
 GTPEncap::simple_action(Packet *p_in)
 {
-  click_chatter("Number of UEs monitored: %d",S1APMonElelist.size());
-  struct click_ip *ip = (struct click_ip *) (p_in->data());
-  for (int i = 0; i != S1APMonElelist.size() ; i++) {
-    unsigned int temp;
-    if (!strcmp(inet_ntoa(ip->ip_src),S1APMonElelist[i].UE_IP.c_str())) {
-      sscanf(S1APMonElelist[i].UE2EPC_teid.c_str(),"%X",&temp);
-      _gtph.teid = ntohl(temp);
+  const click_ip *ip = reinterpret_cast<const click_ip *>(p_in->data());
+  bool uplink = true;
+  const GTPSession *session = 0;
+
+  // the session stays valid while the guard is held, however the
+  // monitor updates the table meanwhile
+  EmpowerEpoch::Guard guard(gtp_sessions.epoch());
+
+  if (p_in->length() >= sizeof(click_ip)) {
+    const GTPSessionIndex *index = gtp_sessions.index();
+    session = index->by_UE_IP.get(IPAddress(ip->ip_src));
+    if (!session) {
+      session = index->by_UE_IP.get(IPAddress(ip->ip_dst));
+      uplink = false;
     }
-    else if (!strcmp(inet_ntoa(ip->ip_dst),S1APMonElelist[i].UE_IP.c_str())) { 
-      sscanf(S1APMonElelist[i].EPC2UE_teid.c_str(),"%X",&temp); 
-      _gtph.teid = ntohl(temp);
+  }
+
+  if (_outer) {
+    if (!session || !session->complete()) {
+      _drops++;
+      p_in->kill();
+      return 0;
+    }
+
+    WritablePacket *p = p_in->push(sizeof(click_gtp_outer));
+    if (!p)
+      return 0;
+
+    click_gtp_outer *h = reinterpret_cast<click_gtp_outer *>(p->data());
+    if (uplink) {
+      memcpy(h, &session->UE2EPC_header, sizeof(*h));
+      GTPSessionTable::patch(h, p->length(), session->UE2EPC_sum);
+    } else {
+      memcpy(h, &session->EPC2UE_header, sizeof(*h));
+      GTPSessionTable::patch(h, p->length(), session->EPC2UE_sum);
     }
+    const click_ip *outer = reinterpret_cast<const click_ip *>(p->data() + offsetof(click_gtp_outer, ip));
+    p->set_ip_header(outer, sizeof(click_ip));
+    return p;
   }
 
   WritablePacket *p = p_in->push(GTP_HEADER_LEN);
   if (!p) 
     return 0;
 
-  _gtph.message_length = htons(p->length() - GTP_HEADER_LEN); 
   click_gtp *gtph = reinterpret_cast<click_gtp *>(p->data());  
   memcpy(gtph, &_gtph,GTP_HEADER_LEN);
+  gtph->message_length = htons(p->length() - GTP_HEADER_LEN); 
+  if (session)
+    gtph->teid = htonl(uplink ? session->UE2EPC_teid : session->EPC2UE_teid);
   return p;
 }
 
+String
+GTPEncap::read_handler(Element *e, void *)
+{
+  GTPEncap *g = static_cast<GTPEncap *>(e);
+  return String(g->_drops) + "\n";
+}
+
+void
+GTPEncap::add_handlers()
+{
+  add_read_handler("drops", read_handler, 0);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(GTPEncap)
+ELEMENT_REQUIRES(GTPSessionTable)
 ELEMENT_MT_SAFE(GTPEncap)
 
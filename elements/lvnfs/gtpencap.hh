@@ -22,6 +22,16 @@
 #include "gtp.h"
 CLICK_DECLS
 
+/*
+ * GTPEncap([OUTER])
+ *
+ * Encapsulates IP packets in GTP-U. The TEID comes from the session of the
+ * UE the packet is from (uplink) or to (downlink), as learned by
+ * ScyllaS1Monitor, or is 0 if there is none. If OUTER is true, the outer
+ * IP and UDP headers of the tunnel are added too, and packets of UEs
+ * without a complete session are dropped. Default is false.
+ */
+
 class GTPEncap : public Element { public:
   
   GTPEncap();
@@ -33,11 +43,15 @@ class GTPEncap : public Element { public:
   const char *flags() const      { return "0"; }
   
   int configure(Vector<String> &, ErrorHandler *);
+  void add_handlers();
   
   private:
   
   click_gtp _gtph; // GTP header to append to each packet
+  bool _outer;
+  atomic_uint32_t _drops;
   Packet *simple_action(Packet *);
+  static String read_handler(Element *, void *);
                  
 };
 
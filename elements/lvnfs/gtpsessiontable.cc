@@ -0,0 +1,185 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  gtpsessiontable.cc
+ *
+ *    Description:  GTP-U sessions learned from S1AP, indexed by TEID and UE IP.
+ *
+ * =====================================================================================
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include "gtpsessiontable.hh"
+CLICK_DECLS
+
+GTPSessionTable gtp_sessions;
+
+String
+GTPSession::unparse() const
+{
+	StringAccum sa;
+	sa << "eNB_UE_S1AP_ID " << eNB_UE_S1AP_ID
+	   << " MME_UE_S1AP_ID " << MME_UE_S1AP_ID
+	   << " e_RAB_ID " << (int) e_RAB_ID
+	   << " EPC_IP " << EPC_IP
+	   << " eNB_IP " << eNB_IP
+	   << " UE_IP " << UE_IP;
+	sa.snprintf(64, " UE2EPC_teid %08x EPC2UE_teid %08x", UE2EPC_teid, EPC2UE_teid);
+	return sa.take_string();
+}
+
+GTPSessionTable::GTPSessionTable()
+	: _index(new GTPSessionIndex)
+{
+}
+
+GTPSessionTable::~GTPSessionTable()
+{
+	for (int i = 0; i < _retired.size(); i++) {
+		for (int j = 0; j < _retired[i].sessions.size(); j++)
+			delete _retired[i].sessions[j];
+		delete _retired[i].index;
+	}
+	for (int i = 0; i < _index->sessions.size(); i++)
+		delete _index->sessions[i];
+	delete _index;
+}
+
+void
+GTPSessionTable::publish(GTPSessionIndex *index, const Vector<GTPSession *> &replaced)
+{
+	// swap in the new index, the old one and the sessions it alone
+	// pointed to go away once no reader can be using them
+	Retired retired;
+	retired.index = _index;
+	retired.sessions = replaced;
+	click_write_fence();
+	_index = index;
+	retired.epoch = _epoch.retire();
+	_retired.push_back(retired);
+	reclaim();
+}
+
+void
+GTPSessionTable::reclaim()
+{
+	int kept = 0;
+	for (int i = 0; i < _retired.size(); i++) {
+		if (_epoch.quiescent(_retired[i].epoch)) {
+			for (int j = 0; j < _retired[i].sessions.size(); j++)
+				delete _retired[i].sessions[j];
+			delete _retired[i].index;
+		} else
+			_retired[kept++] = _retired[i];
+	}
+	_retired.resize(kept);
+}
+
+void
+GTPSessionTable::collect()
+{
+	_lock.acquire();
+	reclaim();
+	_lock.release();
+}
+
+void
+GTPSessionTable::clear()
+{
+	_lock.acquire();
+	publish(new GTPSessionIndex, _index->sessions);
+	_lock.release();
+}
+
+uint16_t
+GTPSessionTable::build(click_gtp_outer *h, IPAddress src, IPAddress dst, uint32_t teid)
+{
+	memset(h, 0, sizeof(*h));
+	h->ip.ip_v = 4;
+	h->ip.ip_hl = sizeof(click_ip) >> 2;
+	h->ip.ip_off = htons(IP_DF);
+	h->ip.ip_ttl = 64;
+	h->ip.ip_p = IP_PROTO_UDP;
+	h->ip.ip_src = src.in_addr();
+	h->ip.ip_dst = dst.in_addr();
+	h->ip.ip_sum = click_in_cksum((const unsigned char *) &h->ip, sizeof(click_ip));
+	h->udp.uh_sport = htons(GTP_U_PORT);
+	h->udp.uh_dport = htons(GTP_U_PORT);
+	h->gtp.flags = GTP_VERSION | GTP_PROTOCOL_TYPE;
+	h->gtp.message_type = GPDU_TYPE;
+	h->gtp.teid = htonl(teid);
+	return ~h->ip.ip_sum;
+}
+
+const GTPSession *
+GTPSessionTable::add(uint32_t enb_ue_s1ap_id, uint32_t mme_ue_s1ap_id, uint8_t e_rab_id,
+		     IPAddress epc_ip, IPAddress ue_ip, uint32_t ue2epc_teid)
+{
+	GTPSession *s = new GTPSession;
+	memset(&s->UE2EPC_header, 0, sizeof(s->UE2EPC_header));
+	memset(&s->EPC2UE_header, 0, sizeof(s->EPC2UE_header));
+	s->UE2EPC_sum = s->EPC2UE_sum = 0;
+	s->eNB_UE_S1AP_ID = enb_ue_s1ap_id;
+	s->MME_UE_S1AP_ID = mme_ue_s1ap_id;
+	s->e_RAB_ID = e_rab_id;
+	s->EPC_IP = epc_ip;
+	s->UE_IP = ue_ip;
+	s->UE2EPC_teid = ue2epc_teid;
+	s->EPC2UE_teid = 0;
+
+	_lock.acquire();
+	GTPSessionIndex *next = new GTPSessionIndex(*_index);
+	next->sessions.push_back(s);
+	// a later setup for the same UE or TEID replaces the earlier one
+	next->by_UE2EPC_teid.set(ue2epc_teid, s);
+	next->by_UE_IP.set(ue_ip, s);
+	publish(next, Vector<GTPSession *>());
+	_lock.release();
+	return s;
+}
+
+const GTPSession *
+GTPSessionTable::complete(uint32_t enb_ue_s1ap_id, uint32_t mme_ue_s1ap_id, uint8_t e_rab_id,
+			  IPAddress enb_ip, uint32_t epc2ue_teid)
+{
+	_lock.acquire();
+	const Vector<GTPSession *> &sessions = _index->sessions;
+	int i = sessions.size() - 1;
+	while (i >= 0 && !(sessions[i]->eNB_UE_S1AP_ID == enb_ue_s1ap_id &&
+			   sessions[i]->MME_UE_S1AP_ID == mme_ue_s1ap_id &&
+			   sessions[i]->e_RAB_ID == e_rab_id))
+		i--;
+	if (i < 0) {
+		_lock.release();
+		return 0;
+	}
+
+	// readers may be using the session, complete a copy
+	GTPSession *old = sessions[i];
+	GTPSession *s = new GTPSession(*old);
+	s->eNB_IP = enb_ip;
+	s->EPC2UE_teid = epc2ue_teid;
+	s->UE2EPC_sum = build(&s->UE2EPC_header, enb_ip, s->EPC_IP, s->UE2EPC_teid);
+	s->EPC2UE_sum = build(&s->EPC2UE_header, s->EPC_IP, enb_ip, epc2ue_teid);
+
+	GTPSessionIndex *next = new GTPSessionIndex(*_index);
+	next->sessions[i] = s;
+	if (next->by_UE2EPC_teid.get(s->UE2EPC_teid) == old)
+		next->by_UE2EPC_teid.set(s->UE2EPC_teid, s);
+	if (next->by_UE_IP.get(s->UE_IP) == old)
+		next->by_UE_IP.set(s->UE_IP, s);
+	if (old->EPC2UE_teid && next->by_EPC2UE_teid.get(old->EPC2UE_teid) == old)
+		next->by_EPC2UE_teid.erase(old->EPC2UE_teid);
+	next->by_EPC2UE_teid.set(epc2ue_teid, s);
+
+	Vector<GTPSession *> replaced;
+	replaced.push_back(old);
+	publish(next, replaced);
+	_lock.release();
+	return s;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(GTPSessionTable)
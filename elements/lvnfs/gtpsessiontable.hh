@@ -0,0 +1,173 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  gtpsessiontable.hh
+ *
+ *    Description:  GTP-U sessions learned from S1AP, indexed by TEID and UE IP.
+ *
+ * =====================================================================================
+ */
+
+#ifndef CLICK_GTPSESSIONTABLE_HH
+#define CLICK_GTPSESSIONTABLE_HH
+#include <click/hashtable.hh>
+#include <click/ipaddress.hh>
+#include <click/vector.hh>
+#include <click/string.hh>
+#include <click/sync.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include <elements/empower/empowerepoch.hh>
+#include "gtp.h"
+CLICK_DECLS
+
+#define GTP_U_PORT 2152
+
+/* Outer IPv4, UDP and GTP headers of a tunnel, in network order. */
+struct click_gtp_outer {
+	click_ip ip;
+	click_udp udp;
+	click_gtp gtp;
+} CLICK_SIZE_PACKED_ATTRIBUTE;
+
+struct GTPSession {
+	/* eNB UE S1AP Id. */
+	uint32_t eNB_UE_S1AP_ID;
+	/* MME UE S1AP Id. */
+	uint32_t MME_UE_S1AP_ID;
+	/* eRAB Id. */
+	uint8_t e_RAB_ID;
+	/* EPC IP address. */
+	IPAddress EPC_IP;
+	/* eNB IP address, unset until the eNB answered. */
+	IPAddress eNB_IP;
+	/* UE IP address. */
+	IPAddress UE_IP;
+	/* Tunnel End Point Id used for GTP traffic from UE to EPC. */
+	uint32_t UE2EPC_teid;
+	/* Tunnel End Point Id used for GTP traffic from EPC to UE. */
+	uint32_t EPC2UE_teid;
+	/* Headers of the packets sent to the EPC and to the eNB, with zero
+	 * lengths; the IP checksum is that of the zero length header. */
+	click_gtp_outer UE2EPC_header;
+	click_gtp_outer EPC2UE_header;
+	/* One's complement sums of the IP headers above, for patch(). */
+	uint16_t UE2EPC_sum;
+	uint16_t EPC2UE_sum;
+
+	bool complete() const {
+		return eNB_IP;
+	}
+
+	String unparse() const;
+
+};
+
+/* One version of the session table. Published versions, and the sessions
+ * they point to, are never modified. */
+struct GTPSessionIndex {
+	Vector<GTPSession *> sessions;
+	HashTable<uint32_t, GTPSession *> by_UE2EPC_teid;
+	HashTable<uint32_t, GTPSession *> by_EPC2UE_teid;
+	HashTable<IPAddress, GTPSession *> by_UE_IP;
+};
+
+/* Sessions of the UEs seen by ScyllaS1Monitor. Uplink TEID, downlink
+ * TEID and UE IP lookups are each a hash table probe.
+ *
+ * The table is read-copy-update: add(), complete() and clear() build a
+ * new GTPSessionIndex, with copies of the sessions they change, and swap
+ * it in. Readers never lock; they must hold an EmpowerEpoch::Guard on
+ * epoch() for as long as they use the index or a session, and the old
+ * versions are freed once no reader can see them anymore. Writers are
+ * serialised by a lock. */
+class GTPSessionTable {
+
+public:
+
+	GTPSessionTable();
+	~GTPSessionTable();
+
+	EmpowerEpoch *epoch() {
+		return &_epoch;
+	}
+
+	const GTPSessionIndex *index() const {
+		const GTPSessionIndex *index = _index;
+		click_read_fence();
+		return index;
+	}
+
+	const GTPSession *find_UE2EPC_teid(uint32_t teid) const {
+		return index()->by_UE2EPC_teid.get(teid);
+	}
+
+	const GTPSession *find_EPC2UE_teid(uint32_t teid) const {
+		return index()->by_EPC2UE_teid.get(teid);
+	}
+
+	const GTPSession *find_UE(IPAddress ue) const {
+		return index()->by_UE_IP.get(ue);
+	}
+
+	/* InitialContextSetupRequest: the EPC side of the session. */
+	const GTPSession *add(uint32_t enb_ue_s1ap_id, uint32_t mme_ue_s1ap_id, uint8_t e_rab_id,
+			      IPAddress epc_ip, IPAddress ue_ip, uint32_t ue2epc_teid);
+
+	/* InitialContextSetupResponse: the eNB side of the session. */
+	const GTPSession *complete(uint32_t enb_ue_s1ap_id, uint32_t mme_ue_s1ap_id, uint8_t e_rab_id,
+				   IPAddress enb_ip, uint32_t epc2ue_teid);
+
+	void clear();
+
+	/* Free the old versions no reader can see anymore. Writers free
+	 * them as they publish, except those a writer holding a guard
+	 * still sees: such a writer calls this once it released it. */
+	void collect();
+
+	/* Fill in the lengths and the checksum of the headers copied from a
+	 * template to the front of a packet LEN bytes long. SUM is the
+	 * partial sum of the template, UE2EPC_sum or EPC2UE_sum. */
+	static inline void patch(click_gtp_outer *h, uint32_t len, uint16_t sum);
+
+private:
+
+	/* A replaced index and the sessions only it pointed to. */
+	struct Retired {
+		GTPSessionIndex *index;
+		Vector<GTPSession *> sessions;
+		uint32_t epoch;
+	};
+
+	GTPSessionIndex *volatile _index;
+	Vector<Retired> _retired;
+	Spinlock _lock;
+	EmpowerEpoch _epoch;
+
+	void publish(GTPSessionIndex *, const Vector<GTPSession *> &);
+	void reclaim();
+
+	static uint16_t build(click_gtp_outer *h, IPAddress src, IPAddress dst, uint32_t teid);
+
+	GTPSessionTable(const GTPSessionTable &);
+	GTPSessionTable &operator=(const GTPSessionTable &);
+
+};
+
+inline void
+GTPSessionTable::patch(click_gtp_outer *h, uint32_t len, uint16_t sum0)
+{
+	h->ip.ip_len = htons(len);
+	// the template checksum covers a zero length (RFC 1624)
+	uint32_t sum = sum0 + h->ip.ip_len;
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	h->ip.ip_sum = ~(sum + (sum >> 16));
+	h->udp.uh_ulen = htons(len - sizeof(click_ip));
+	h->gtp.message_length = htons(len - sizeof(click_gtp_outer));
+}
+
+/* The sessions of all elements, filled by ScyllaS1Monitor. */
+extern GTPSessionTable gtp_sessions;
+
+CLICK_ENDDECLS
+#endif
@@ -12,214 +12,410 @@
 #include "liblte_mme.h"
 CLICK_DECLS
 
-/* Array of UE S1AP monitored elements. */
-Vector <struct S1APMonitorElement> S1APMonElelist;
+static inline uint32_t teid(const uint8_t *buffer) {
+	return (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+}
 
 ScyllaS1Monitor::ScyllaS1Monitor() :
-		_debug(false), _offset(12) {
+		_debug(false), _offset(12), _queue(1024), _task(this), _q(0),
+		_capacity(0), _mask(0), _drops(0), _chunks(0), _head(0), _tail(0) {
+	// the decoders may read past the slack of expand()
+	memset(_bits, 0, sizeof(_bits));
+	memset(&_req_item, 0, sizeof(_req_item));
+	memset(&_res_item, 0, sizeof(_res_item));
 }
 
 ScyllaS1Monitor::~ScyllaS1Monitor() {
 }
 
 int ScyllaS1Monitor::configure(Vector<String> &conf, ErrorHandler *errh) {
+	// the ring is sized once, QUEUE is ignored on live reconfiguration
 	return Args(conf, this, errh).read("DEBUG", _debug)
 								 .read("OFFSET", _offset)
+								 .read("QUEUE", _queue)
 								 .complete();
 }
 
+int ScyllaS1Monitor::initialize(ErrorHandler *) {
+	_capacity = 1;
+	while (_capacity < _queue) {
+		_capacity <<= 1;
+	}
+	_mask = _capacity - 1;
+	_q = new Packet *[_capacity];
+	for (uint32_t i = 0; i < _capacity; i++) {
+		_q[i] = 0;
+	}
+	_task.initialize(this, false);
+	return 0;
+}
+
+void ScyllaS1Monitor::cleanup(CleanupStage) {
+	if (_q) {
+		while (Packet *p = dequeue()) {
+			p->kill();
+		}
+		delete[] _q;
+		_q = 0;
+	}
+}
+
+bool ScyllaS1Monitor::enqueue(Packet *p) {
+	uint32_t t = _tail;
+	if (t - _head >= _capacity) {
+		_drops++;
+		return false;
+	}
+	_q[t & _mask] = p;
+	// publish the slot before the new tail
+	click_write_fence();
+	_tail = t + 1;
+	return true;
+}
+
+Packet *ScyllaS1Monitor::dequeue() {
+	uint32_t h = _head;
+	if (h == _tail) {
+		return 0;
+	}
+	// read the slot only after observing the tail
+	click_read_fence();
+	Packet *p = _q[h & _mask];
+	_q[h & _mask] = 0;
+	// release the slot only after it has been read
+	click_fence();
+	_head = h + 1;
+	return p;
+}
+
 Packet *
 ScyllaS1Monitor::simple_action(Packet *p) {
-	struct click_ip *ip = (struct click_ip *) (p->data() + _offset);
+	const uint8_t *end = p->data() + p->length();
+	const struct click_ip *ip = (const struct click_ip *) (p->data() + _offset);
 
-	if (ip->ip_p != IP_PROTO_SCTP) {
-		return p;        
+	if ((const uint8_t *) (ip + 1) > end || ip->ip_p != IP_PROTO_SCTP) {
+		return p;
 	}
 
-	struct click_sctp *sctp = (struct click_sctp *) (p->data() + _offset + ip->ip_hl * 4);
+	const uint8_t *ptr = (const uint8_t *) ip + ip->ip_hl * 4 + sizeof(struct click_sctp);
+	bool queued = false;
 
-	uint8_t *ptr =  (uint8_t *) sctp;
-	uint8_t *end = ptr + (p->length() - sizeof(struct click_sctp) - _offset - ip->ip_hl * 4);
+	while (ptr + sizeof(struct click_sctp_chunk) <= end) {
+		struct click_sctp_chunk *chunk = (struct click_sctp_chunk *) ptr;
+		uint16_t len = chunk->length();
 
-	ptr += sizeof(struct click_sctp);
+		if (len < sizeof(struct click_sctp_chunk) || ptr + len > end) {
+			break;
+		}
 
-	while (ptr < end) {
-		struct click_sctp_chunk *chunk = (struct click_sctp_chunk *) ptr;
-		
-                if (chunk->type() == 0) {
-     
-			struct click_sctp_data_chunk *data = (struct click_sctp_data_chunk *) ptr;
+		if (chunk->type() == 0 && len >= sizeof(struct click_sctp_data_chunk)
+			&& ((struct click_sctp_data_chunk *) ptr)->ppi() == S1AP_PPI) {
+			// decoded by the task, off the user plane path
+			if (Packet *q = Packet::make(ptr, len)) {
+				if (enqueue(q)) {
+					queued = true;
+				} else {
+					q->kill();
+				}
+			}
+		}
 
-			if (data->ppi() == 18) {
-				parse_s1ap(data);
+		ptr += (len + 3) & ~3;
+	}
+
+	if (queued) {
+		_task.reschedule();
+	}
+
+	return p;
+
+}
+
+bool ScyllaS1Monitor::run_task(Task *) {
+	int n = 0;
+	{
+		// the sessions returned by the table stay valid while the
+		// guard is held, so the versions it retires are freed after
+		EmpowerEpoch::Guard guard(gtp_sessions.epoch());
+		while (n < BURST) {
+			Packet *p = dequeue();
+			if (!p) {
+				break;
 			}
+			parse_s1ap((click_sctp_data_chunk *) p->data());
+			p->kill();
+			_chunks++;
+			n++;
 		}
-		if (chunk->length() % 4 == 0) {
+	}
+	if (n > 0) {
+		gtp_sessions.collect();
+	}
+	if (_head != _tail) {
+		_task.fast_reschedule();
+	}
+	return n > 0;
+}
 
-			ptr += chunk->length();
-		} else {
+/* Aligned PER reader over the octets of an S1AP PDU. Reads past the end
+ * return zeros and clear ok. */
+struct S1APCursor {
+	const uint8_t *p;
+	const uint8_t *end;
+	bool ok;
 
-			ptr += (chunk->length() + 4 - chunk->length() % 4);
+	S1APCursor(const uint8_t *data, uint32_t len) :
+			p(data), end(data + len), ok(data != 0) {
+	}
+
+	uint8_t u8() {
+		if (p >= end) {
+			ok = false;
+			return 0;
 		}
+		return *p++;
 	}
 
-	return p;
+	uint16_t u16() {
+		uint16_t hi = u8();
+		return (hi << 8) | u8();
+	}
+
+	/* Length determinant, fragmented lengths are not supported. */
+	uint32_t length() {
+		uint8_t b = u8();
+		if (!(b & 0x80))
+			return b;
+		if ((b & 0xC0) == 0x80)
+			return ((b & 0x3F) << 8) | u8();
+		ok = false;
+		return 0;
+	}
+
+	const uint8_t *take(uint32_t len) {
+		if (!ok || len > (uint32_t) (end - p)) {
+			ok = false;
+			return 0;
+		}
+		const uint8_t *r = p;
+		p += len;
+		return r;
+	}
+};
+
+/* INTEGER with a range over 65536, such as the UE S1AP ids: the number of
+ * octets in two bits, then the octets. */
+static uint32_t per_integer(const uint8_t *v, uint32_t len) {
+	uint32_t n_octets = (v[0] >> 6) + 1;
+	uint32_t value = 0;
+	if (len < n_octets + 1)
+		return 0;
+	for (uint32_t i = 1; i <= n_octets; i++)
+		value = (value << 8) | v[i];
+	return value;
+}
 
+uint8_t *ScyllaS1Monitor::expand(const uint8_t *v, uint32_t len) {
+	// room for decoders reading a little past a truncated item
+	if (len * 8 + 64 > sizeof(_bits))
+		return 0;
+	liblte_unpack((uint8_t *) v, len, _bits);
+	memset(_bits + len * 8, 0, 64);
+	return _bits;
 }
 
+/* Only InitialContextSetup carries the session fields. The procedure code
+ * is read first and other PDUs are left undecoded; in the messages kept,
+ * the IEs other than the UE ids and the E-RAB list are skipped by length,
+ * and only the E-RAB items are decoded by liblte. */
 void ScyllaS1Monitor::parse_s1ap(click_sctp_data_chunk *data) {
 
-	uint8_t *payload = (uint8_t *) data;
-	payload += sizeof(struct click_sctp_data_chunk);        
+	const uint8_t *payload = (const uint8_t *) data + sizeof(struct click_sctp_data_chunk);
+	if (data->length() < sizeof(struct click_sctp_data_chunk))
+		return;
 
-	LIBLTE_S1AP_S1AP_PDU_STRUCT s1ap_pdu;
-	LIBLTE_BYTE_MSG_STRUCT msg;
+	S1APCursor pdu(payload, data->length() - sizeof(struct click_sctp_data_chunk));
 
-	msg.reset();
-	msg.N_bytes = data->length();
-	msg.msg = payload;
+	uint8_t choice = pdu.u8();
+	uint8_t procedure_code = pdu.u8();
+	pdu.u8(); // criticality
 
-	if (LIBLTE_SUCCESS != liblte_s1ap_unpack_s1ap_pdu(&msg, &s1ap_pdu))
+	if (!pdu.ok || (choice & 0x80))
 		return;
 
-	/* initiatingMessage */
-	if (s1ap_pdu.choice_type == LIBLTE_S1AP_S1AP_PDU_CHOICE_INITIATINGMESSAGE) {
-		if (s1ap_pdu.choice.initiatingMessage.choice_type == LIBLTE_S1AP_INITIATINGMESSAGE_CHOICE_INITIALCONTEXTSETUPREQUEST) {
-			LIBLTE_S1AP_MESSAGE_INITIALCONTEXTSETUPREQUEST_STRUCT *InitialContextSetupRequest = &s1ap_pdu.choice.initiatingMessage.choice.InitialContextSetupRequest;
-
-			uint32_t MME_UE_S1AP_ID = InitialContextSetupRequest->MME_UE_S1AP_ID.MME_UE_S1AP_ID;
-			uint32_t ENB_UE_S1AP_ID = InitialContextSetupRequest->eNB_UE_S1AP_ID.ENB_UE_S1AP_ID;
-
-			LIBLTE_S1AP_E_RABTOBESETUPLISTCTXTSUREQ_STRUCT *E_RABToBeSetupListCtxtSUReq = &InitialContextSetupRequest->E_RABToBeSetupListCtxtSUReq;
-
-			for (uint8_t i = 0; i < E_RABToBeSetupListCtxtSUReq->len; i++) {
-				/* eRAB Id. */
-				uint8_t e_RAB_ID = E_RABToBeSetupListCtxtSUReq->buffer[i].e_RAB_ID.E_RAB_ID;
-				/* EPC IP address. */
-				char EPC_IP[16];
-				/* Tunnel End Point Id used for GTP traffic from UE to EPC. */
-				char UE2EPC_teid[9];
-				/* UE IP address. */
-				char UE_IP[16];
-
-				LIBLTE_S1AP_TRANSPORTLAYERADDRESS_STRUCT *transportLayerAddress = &E_RABToBeSetupListCtxtSUReq->buffer[i].transportLayerAddress;
-				LIBLTE_S1AP_GTP_TEID_STRUCT *gTP_TEID = &E_RABToBeSetupListCtxtSUReq->buffer[i].gTP_TEID;
-                                
-				/* IPv4 Address */
-				if (transportLayerAddress->n_bits == 32) {
-
-					uint8_t bytes[4];
-					liblte_pack(transportLayerAddress->buffer, transportLayerAddress->n_bits, bytes);
-                                        snprintf(EPC_IP, sizeof(EPC_IP), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
-                                        click_chatter("EPC_IP:%u.%u.%u.%u",bytes[0],bytes[1],bytes[2],bytes[3]);
-				}
-                                snprintf(UE2EPC_teid, sizeof(UE2EPC_teid), "%02x%02x%02x%02x", gTP_TEID->buffer[0], gTP_TEID->buffer[1], gTP_TEID->buffer[2], gTP_TEID->buffer[3]);
-				if (E_RABToBeSetupListCtxtSUReq->buffer[i].nAS_PDU_present) {
-					LIBLTE_S1AP_NAS_PDU_STRUCT *nAS_PDU = &E_RABToBeSetupListCtxtSUReq->buffer[i].nAS_PDU;
-
-					LIBLTE_MME_ATTACH_ACCEPT_MSG_STRUCT attach_accept;
-					LIBLTE_BYTE_MSG_STRUCT nas_msg;
-
-					nas_msg.reset();
-					nas_msg.N_bytes = nAS_PDU->n_octets;
-					nas_msg.msg = nAS_PDU->buffer;
-
-					if (LIBLTE_SUCCESS != liblte_mme_unpack_attach_accept_msg(&nas_msg, &attach_accept))
-						return;
-
-					LIBLTE_BYTE_MSG_STRUCT *esm_msg = &attach_accept.esm_msg;
-					LIBLTE_MME_ACTIVATE_DEFAULT_EPS_BEARER_CONTEXT_REQUEST_MSG_STRUCT act_def_eps_bearer_context_req;
-
-					if (LIBLTE_SUCCESS != liblte_mme_unpack_activate_default_eps_bearer_context_request_msg(esm_msg, &act_def_eps_bearer_context_req))
-						return;
-
-					LIBLTE_MME_PDN_ADDRESS_STRUCT *pdn_addr = &act_def_eps_bearer_context_req.pdn_addr;
-					if (pdn_addr->pdn_type == LIBLTE_MME_PDN_TYPE_IPV4) {
-						snprintf(UE_IP, sizeof(UE_IP), "%u.%u.%u.%u", pdn_addr->addr[0], pdn_addr->addr[1], pdn_addr->addr[2], pdn_addr->addr[3]);
-
-						struct S1APMonitorElement ele = {
-							.eNB_UE_S1AP_ID = ENB_UE_S1AP_ID,
-							.MME_UE_S1AP_ID = MME_UE_S1AP_ID,
-							.e_RAB_ID = e_RAB_ID,
-							.EPC_IP = EPC_IP,
-							.eNB_IP = "",
-							.UE_IP = UE_IP,
-							.UE2EPC_teid = UE2EPC_teid,
-							.EPC2UE_teid = ""
-						};
-                                                
-						S1APMonElelist.push_back(ele);
-					}
-				}
-			}
+	choice = (choice >> 5) & 0x3;
+
+	if (procedure_code != LIBLTE_S1AP_PROC_ID_INITIALCONTEXTSETUP ||
+		(choice != LIBLTE_S1AP_S1AP_PDU_CHOICE_INITIATINGMESSAGE &&
+		 choice != LIBLTE_S1AP_S1AP_PDU_CHOICE_SUCCESSFULOUTCOME))
+		return;
+
+	uint32_t len = pdu.length();
+	S1APCursor msg(pdu.take(len), len);
+
+	/* extensions are not supported */
+	if (msg.u8() & 0x80)
+		return;
+
+	uint16_t n_ie = msg.u16();
+
+	uint32_t MME_UE_S1AP_ID = 0;
+	uint32_t ENB_UE_S1AP_ID = 0;
+	const uint8_t *list = 0;
+	uint32_t list_len = 0;
+	uint32_t list_id = (choice == LIBLTE_S1AP_S1AP_PDU_CHOICE_INITIATINGMESSAGE) ?
+		LIBLTE_S1AP_IE_ID_E_RABTOBESETUPLISTCTXTSUREQ : LIBLTE_S1AP_IE_ID_E_RABSETUPLISTCTXTSURES;
+
+	for (uint16_t i = 0; i < n_ie && msg.ok; i++) {
+		uint16_t ie_id = msg.u16();
+		msg.u8(); // criticality
+		uint32_t ie_len = msg.length();
+		const uint8_t *ie = msg.take(ie_len);
+		if (!msg.ok)
+			return;
+		if (ie_id == LIBLTE_S1AP_IE_ID_MME_UE_S1AP_ID) {
+			MME_UE_S1AP_ID = per_integer(ie, ie_len);
+		} else if (ie_id == LIBLTE_S1AP_IE_ID_ENB_UE_S1AP_ID) {
+			ENB_UE_S1AP_ID = per_integer(ie, ie_len);
+		} else if (ie_id == list_id) {
+			list = ie;
+			list_len = ie_len;
 		}
 	}
-	/* successfulOutcome */
-	else if (s1ap_pdu.choice_type == LIBLTE_S1AP_S1AP_PDU_CHOICE_SUCCESSFULOUTCOME) {
-		if (s1ap_pdu.choice.successfulOutcome.choice_type == LIBLTE_S1AP_SUCCESSFULOUTCOME_CHOICE_INITIALCONTEXTSETUPRESPONSE) {
-			LIBLTE_S1AP_MESSAGE_INITIALCONTEXTSETUPRESPONSE_STRUCT *InitialContextSetupResponse = &s1ap_pdu.choice.successfulOutcome.choice.InitialContextSetupResponse;
 
-			uint32_t MME_UE_S1AP_ID = InitialContextSetupResponse->MME_UE_S1AP_ID.MME_UE_S1AP_ID;
-			uint32_t ENB_UE_S1AP_ID = InitialContextSetupResponse->eNB_UE_S1AP_ID.ENB_UE_S1AP_ID;
+	if (!msg.ok || !list)
+		return;
 
-			LIBLTE_S1AP_E_RABSETUPLISTCTXTSURES_STRUCT *E_RABSetupListCtxtSURes = &InitialContextSetupResponse->E_RABSetupListCtxtSURes;
+	S1APCursor items(list, list_len);
 
-			for (uint8_t i = 0; i < E_RABSetupListCtxtSURes->len; i++) {
+	uint32_t n_items = items.u8() + 1;
 
-				/* eRAB Id. */
-				uint8_t e_RAB_ID = E_RABSetupListCtxtSURes->buffer[i].e_RAB_ID.E_RAB_ID;
-				/* eNB IP address. */
-				char eNB_IP[16];
-				/* Tunnel End Point Id used for GTP traffic from EPC to UE. */
-				char EPC2UE_teid[9];
+	for (uint32_t i = 0; i < n_items && items.ok; i++) {
 
-				LIBLTE_S1AP_TRANSPORTLAYERADDRESS_STRUCT *transportLayerAddress = &E_RABSetupListCtxtSURes->buffer[i].transportLayerAddress;
-				LIBLTE_S1AP_GTP_TEID_STRUCT *gTP_TEID = &E_RABSetupListCtxtSURes->buffer[i].gTP_TEID;
+		uint16_t item_id = items.u16();
+		items.u8(); // criticality
+		uint32_t item_len = items.length();
+		const uint8_t *item = items.take(item_len);
+		if (!items.ok)
+			return;
 
-				/* IPv4 Address */
-				if (transportLayerAddress->n_bits == 32) {
+		uint8_t *bits = expand(item, item_len);
+		if (!bits)
+			continue;
 
-					uint8_t bytes[4];
-					liblte_pack(transportLayerAddress->buffer, transportLayerAddress->n_bits, bytes);
+		if (item_id == LIBLTE_S1AP_IE_ID_E_RABTOBESETUPITEMCTXTSUREQ) {
+			if (liblte_s1ap_unpack_e_rabtobesetupitemctxtsureq(&bits, &_req_item) == LIBLTE_SUCCESS)
+				setup_request(ENB_UE_S1AP_ID, MME_UE_S1AP_ID, &_req_item);
+		} else if (item_id == LIBLTE_S1AP_IE_ID_E_RABSETUPITEMCTXTSURES) {
+			if (liblte_s1ap_unpack_e_rabsetupitemctxtsures(&bits, &_res_item) == LIBLTE_SUCCESS)
+				setup_response(ENB_UE_S1AP_ID, MME_UE_S1AP_ID, &_res_item);
+		}
 
-					snprintf(eNB_IP, sizeof(eNB_IP), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
-				}
+	}
 
-				sprintf(EPC2UE_teid, "%02x%02x%02x%02x", gTP_TEID->buffer[0], gTP_TEID->buffer[1], gTP_TEID->buffer[2], gTP_TEID->buffer[3]);
+}
 
-				for(uint16_t i = 0; i != S1APMonElelist.size(); i++) {
+/* InitialContextSetupRequest, EPC side of an E-RAB */
+void ScyllaS1Monitor::setup_request(uint32_t ENB_UE_S1AP_ID, uint32_t MME_UE_S1AP_ID,
+				    LIBLTE_S1AP_E_RABTOBESETUPITEMCTXTSUREQ_STRUCT *item) {
 
-					if (S1APMonElelist[i].eNB_UE_S1AP_ID == ENB_UE_S1AP_ID &&
-						S1APMonElelist[i].MME_UE_S1AP_ID == MME_UE_S1AP_ID &&
-						S1APMonElelist[i].e_RAB_ID == e_RAB_ID) {
+	/* eRAB Id. */
+	uint8_t e_RAB_ID = item->e_RAB_ID.E_RAB_ID;
+	/* EPC IP address. */
+	IPAddress EPC_IP;
+	/* Tunnel End Point Id used for GTP traffic from UE to EPC. */
+	uint32_t UE2EPC_teid;
 
-						S1APMonElelist[i].eNB_IP = eNB_IP;
-						S1APMonElelist[i].EPC2UE_teid = EPC2UE_teid;
+	LIBLTE_S1AP_TRANSPORTLAYERADDRESS_STRUCT *transportLayerAddress = &item->transportLayerAddress;
+	LIBLTE_S1AP_GTP_TEID_STRUCT *gTP_TEID = &item->gTP_TEID;
 
-						click_chatter("<--------------- Entry ---------------->");
+	/* IPv4 Address */
+	if (transportLayerAddress->n_bits == 32) {
 
-						click_chatter("eNB_UE_S1AP_ID %u", S1APMonElelist[i].eNB_UE_S1AP_ID);
-						click_chatter("MME_UE_S1AP_ID %u", S1APMonElelist[i].MME_UE_S1AP_ID);
-						click_chatter("e_RAB_ID %u", S1APMonElelist[i].e_RAB_ID);
-						click_chatter("EPC_IP %s", S1APMonElelist[i].EPC_IP.c_str());
-						click_chatter("eNB_IP %s", S1APMonElelist[i].eNB_IP.c_str());
-						click_chatter("UE_IP %s", S1APMonElelist[i].UE_IP.c_str());
-						click_chatter("UE2EPC_teid %s", S1APMonElelist[i].UE2EPC_teid.c_str());
-						click_chatter("EPC2UE_teid %s", S1APMonElelist[i].EPC2UE_teid.c_str());
+		uint8_t bytes[4];
+		liblte_pack(transportLayerAddress->buffer, transportLayerAddress->n_bits, bytes);
+		EPC_IP = IPAddress(bytes);
+		click_chatter("EPC_IP:%s", EPC_IP.unparse().c_str());
+	}
+	UE2EPC_teid = teid(gTP_TEID->buffer);
 
-						click_chatter("<-------------------------------------->");
+	if (!item->nAS_PDU_present)
+		return;
+
+	LIBLTE_S1AP_NAS_PDU_STRUCT *nAS_PDU = &item->nAS_PDU;
+
+	LIBLTE_MME_ATTACH_ACCEPT_MSG_STRUCT attach_accept;
+	LIBLTE_BYTE_MSG_STRUCT nas_msg;
+
+	nas_msg.reset();
+	nas_msg.N_bytes = nAS_PDU->n_octets;
+	nas_msg.msg = nAS_PDU->buffer;
+
+	if (LIBLTE_SUCCESS != liblte_mme_unpack_attach_accept_msg(&nas_msg, &attach_accept))
+		return;
+
+	LIBLTE_BYTE_MSG_STRUCT *esm_msg = &attach_accept.esm_msg;
+	LIBLTE_MME_ACTIVATE_DEFAULT_EPS_BEARER_CONTEXT_REQUEST_MSG_STRUCT act_def_eps_bearer_context_req;
+
+	if (LIBLTE_SUCCESS != liblte_mme_unpack_activate_default_eps_bearer_context_request_msg(esm_msg, &act_def_eps_bearer_context_req))
+		return;
+
+	LIBLTE_MME_PDN_ADDRESS_STRUCT *pdn_addr = &act_def_eps_bearer_context_req.pdn_addr;
+	if (pdn_addr->pdn_type == LIBLTE_MME_PDN_TYPE_IPV4) {
+		gtp_sessions.add(ENB_UE_S1AP_ID, MME_UE_S1AP_ID, e_RAB_ID,
+				 EPC_IP, IPAddress(pdn_addr->addr), UE2EPC_teid);
+	}
+
+}
+
+/* InitialContextSetupResponse, eNB side of an E-RAB */
+void ScyllaS1Monitor::setup_response(uint32_t ENB_UE_S1AP_ID, uint32_t MME_UE_S1AP_ID,
+				     LIBLTE_S1AP_E_RABSETUPITEMCTXTSURES_STRUCT *item) {
+
+	/* eRAB Id. */
+	uint8_t e_RAB_ID = item->e_RAB_ID.E_RAB_ID;
+	/* eNB IP address. */
+	IPAddress eNB_IP;
+
+	LIBLTE_S1AP_TRANSPORTLAYERADDRESS_STRUCT *transportLayerAddress = &item->transportLayerAddress;
+	LIBLTE_S1AP_GTP_TEID_STRUCT *gTP_TEID = &item->gTP_TEID;
+
+	/* IPv4 Address */
+	if (transportLayerAddress->n_bits == 32) {
+
+		uint8_t bytes[4];
+		liblte_pack(transportLayerAddress->buffer, transportLayerAddress->n_bits, bytes);
+
+		eNB_IP = IPAddress(bytes);
+	}
+
+	const GTPSession *session = gtp_sessions.complete(ENB_UE_S1AP_ID, MME_UE_S1AP_ID, e_RAB_ID,
+						    eNB_IP, teid(gTP_TEID->buffer));
+
+	if (session) {
+
+		click_chatter("<--------------- Entry ---------------->");
+
+		click_chatter("eNB_UE_S1AP_ID %u", session->eNB_UE_S1AP_ID);
+		click_chatter("MME_UE_S1AP_ID %u", session->MME_UE_S1AP_ID);
+		click_chatter("e_RAB_ID %u", session->e_RAB_ID);
+		click_chatter("EPC_IP %s", session->EPC_IP.unparse().c_str());
+		click_chatter("eNB_IP %s", session->eNB_IP.unparse().c_str());
+		click_chatter("UE_IP %s", session->UE_IP.unparse().c_str());
+		click_chatter("UE2EPC_teid %08x", session->UE2EPC_teid);
+		click_chatter("EPC2UE_teid %08x", session->EPC2UE_teid);
+
+		click_chatter("<-------------------------------------->");
 
-						break;
-					}
-				}
-			}
-		}
 	}
 
 }
 
 enum {
 	H_DEBUG,
+	H_SESSIONS,
+	H_CHUNKS,
+	H_DROPS,
 };
 
 String ScyllaS1Monitor::read_handler(Element *e, void *thunk) {
@@ -227,6 +423,19 @@ String ScyllaS1Monitor::read_handler(Element *e, void *thunk) {
 	switch ((uintptr_t) thunk) {
 	case H_DEBUG:
 		return String(td->_debug) + "\n";
+	case H_SESSIONS: {
+		EmpowerEpoch::Guard guard(gtp_sessions.epoch());
+		const GTPSessionIndex *index = gtp_sessions.index();
+		StringAccum sa;
+		for (int i = 0; i < index->sessions.size(); i++) {
+			sa << index->sessions[i]->unparse() << "\n";
+		}
+		return sa.take_string();
+	}
+	case H_CHUNKS:
+		return String(td->_chunks) + "\n";
+	case H_DROPS:
+		return String(td->_drops) + "\n";
 	default:
 		return String();
 	}
@@ -252,7 +461,12 @@ int ScyllaS1Monitor::write_handler(const String &in_s, Element *e,
 void ScyllaS1Monitor::add_handlers() {
 	add_read_handler("debug", read_handler, (void *) H_DEBUG);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
+	add_read_handler("sessions", read_handler, (void *) H_SESSIONS);
+	add_read_handler("chunks", read_handler, (void *) H_CHUNKS);
+	add_read_handler("drops", read_handler, (void *) H_DROPS);
+	add_task_handlers(&_task);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(ScyllaS1Monitor)
+ELEMENT_REQUIRES(GTPSessionTable)
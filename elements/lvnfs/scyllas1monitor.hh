@@ -3,10 +3,11 @@
 #include <click/element.hh>
 #include <click/string.hh>
 #include <click/hashmap.hh>
+#include <click/task.hh>
+#include "gtpsessiontable.hh"
+#include "liblte_s1ap.h"
 CLICK_DECLS
 
-extern Vector <struct S1APMonitorElement> S1APMonElelist;
-
 struct click_sctp {
 private:
     uint16_t _src_port;
@@ -47,25 +48,15 @@ public:
     uint32_t ppi()                 { return ntohl(_ppi); }
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
-struct S1APMonitorElement {
-    /* eNB UE S1AP Id. */
-    uint32_t eNB_UE_S1AP_ID;
-    /* MME UE S1AP Id. */
-    uint32_t MME_UE_S1AP_ID;
-    /* eRAB Id. */
-    uint8_t e_RAB_ID;
-    /* EPC IP address. */
-    String EPC_IP;
-    /* eNB IP address. */
-    String eNB_IP;
-    /* UE IP address. */
-    String UE_IP;
-    /* Tunnel End Point Id used for GTP traffic from UE to EPC. */
-    String UE2EPC_teid;
-    /* Tunnel End Point Id used for GTP traffic from EPC to UE. */
-    String EPC2UE_teid;
-};
-
+/* Learns the GTP-U sessions of the UEs from the S1AP InitialContextSetup
+ * messages between the eNBs and the MME, for GTPEncap and friends.
+ *
+ * Packets go through untouched. The SCTP DATA chunks with the S1AP PPI
+ * are copied to a single-producer, single-consumer ring, QUEUE chunks
+ * long, and decoded by a task, which publishes the sessions to
+ * gtp_sessions. The user plane thread then only pays for the copy; use
+ * StaticThreadSched to run the parser task on a thread of its own.
+ * Chunks arriving while the ring is full are dropped and counted. */
 class ScyllaS1Monitor : public Element {
 
  public:
@@ -78,17 +69,48 @@ class ScyllaS1Monitor : public Element {
   const char *processing() const		{ return AGNOSTIC; }
 
   int configure(Vector<String> &, ErrorHandler *);
+  int initialize(ErrorHandler *);
+  void cleanup(CleanupStage);
   bool can_live_reconfigure() const	{ return true; }
 
   Packet *simple_action(Packet *);
+  bool run_task(Task *);
   void parse_s1ap(click_sctp_data_chunk *);
+  void setup_request(uint32_t, uint32_t, LIBLTE_S1AP_E_RABTOBESETUPITEMCTXTSUREQ_STRUCT *);
+  void setup_response(uint32_t, uint32_t, LIBLTE_S1AP_E_RABSETUPITEMCTXTSURES_STRUCT *);
 
   void add_handlers();
 
 private:
 
+  enum { S1AP_PPI = 18, BURST = 32 };
+
   bool _debug;
   unsigned _offset;
+  uint32_t _queue;
+
+  Task _task;
+
+  /* Chunk ring, sized at initialization: only simple_action() writes
+   * _tail and only the task writes _head. */
+  Packet **_q;
+  uint32_t _capacity;
+  uint32_t _mask;
+  uint32_t _drops;
+  uint64_t _chunks;
+  volatile uint32_t _head CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+  volatile uint32_t _tail CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+  /* Parser state, task side only. liblte works on one octet per bit,
+   * only the E-RAB items are expanded. Its decoders find octet
+   * boundaries from the address of the bits, hence the alignment. */
+  uint8_t _bits[LIBLTE_MAX_MSG_SIZE_BITS] CLICK_ALIGNED(8);
+  LIBLTE_S1AP_E_RABTOBESETUPITEMCTXTSUREQ_STRUCT _req_item;
+  LIBLTE_S1AP_E_RABSETUPITEMCTXTSURES_STRUCT _res_item;
+
+  bool enqueue(Packet *);
+  Packet *dequeue();
+  uint8_t *expand(const uint8_t *, uint32_t);
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
   static String read_handler(Element *, void *);
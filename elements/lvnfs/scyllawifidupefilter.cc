@@ -11,16 +11,64 @@
 CLICK_DECLS
 
 ScyllaWifiDupeFilter::ScyllaWifiDupeFilter() :
-		_debug(false), _buffer_size(10) {
+		_debug(false), _buffer_size(10), _max_transmitters(1024), _timeout(60),
+		_max_delay(Timestamp::make_msec(100)), _wtp_anno(PAINT_ANNO_OFFSET), _timer(this) {
+	memset(_wins, 0, sizeof(_wins));
+	memset(_losses, 0, sizeof(_losses));
 }
 
 ScyllaWifiDupeFilter::~ScyllaWifiDupeFilter() {
 }
 
 int ScyllaWifiDupeFilter::configure(Vector<String> &conf, ErrorHandler *errh) {
-	return Args(conf, this, errh).read("BUFFER_SIZE", _buffer_size)
+	if (Args(conf, this, errh).read("BUFFER_SIZE", _buffer_size)
+			                     .read("MAX_TRANSMITTERS", _max_transmitters)
+			                     .read("TIMEOUT", _timeout)
+			                     .read("MAX_DELAY", _max_delay)
+			                     .read("WTP_ANNO", AnnoArg(1), _wtp_anno)
 			                     .read("DEBUG", _debug)
-						         .complete();
+						         .complete() < 0) {
+		return -1;
+	}
+
+	if (_buffer_size < 1 || _buffer_size > WifiSeqWindow::MAX_SIZE) {
+		return errh->error("BUFFER_SIZE must be between 1 and %d", (int) WifiSeqWindow::MAX_SIZE);
+	}
+
+	if (_max_transmitters < 1) {
+		return errh->error("MAX_TRANSMITTERS must be positive");
+	}
+
+	if (!_timeout) {
+		return errh->error("TIMEOUT must be positive");
+	}
+
+	if (!_max_delay) {
+		return errh->error("MAX_DELAY must be positive");
+	}
+
+	return 0;
+}
+
+int ScyllaWifiDupeFilter::initialize(ErrorHandler *) {
+	_timer.initialize(this);
+	_timer.schedule_after(_timeout);
+	return 0;
+}
+
+// Forgets the transmitters not heard for TIMEOUT
+void ScyllaWifiDupeFilter::run_timer(Timer *) {
+	Timestamp now = Timestamp::recent_steady();
+	Vector<EtherAddress> stale;
+	for (DupesTable::iterator it = _dupes_table.begin(); it.live(); it++) {
+		if (now - it.value()._last_heard > _timeout) {
+			stale.push_back(it.key());
+		}
+	}
+	for (int i = 0; i < stale.size(); i++) {
+		_dupes_table.remove(stale[i]);
+	}
+	_timer.reschedule_after(_timeout);
 }
 
 Packet *
@@ -42,28 +90,44 @@ ScyllaWifiDupeFilter::simple_action(Packet *p_in) {
 
 	DupeFilterDstInfo *nfo = _dupes_table.findp(src);
 
-	if ((w->i_fc[0] & WIFI_FC0_TYPE_CTL) || dst.is_group() || is_frag) {
+	if ((w->i_fc[0] & WIFI_FC0_TYPE_CTL) || dst.is_group()) {
 		return p_in;
 	}
 
 	if (!nfo) {
+		if (_dupes_table.size() >= _max_transmitters) {
+			return p_in;
+		}
 		_dupes_table.insert(src, DupeFilterDstInfo(src, _buffer_size));
 		nfo = _dupes_table.findp(src);
 	}
 
-	if (nfo->_buffer->contains(seq)) {
+	// copies trail the first by less than MAX_DELAY, past that the
+	// numbers heard are stale
+	Timestamp now = Timestamp::recent_steady();
+	if (now - nfo->_last_heard > _max_delay) {
+		nfo->_window.clear();
+	}
+	nfo->_last_heard = now;
+
+	uint8_t wtp = p_in->anno_u8(_wtp_anno);
+
+	if (nfo->_window.add(seq, frag, is_frag)) {
 		nfo->_dupes++;
+		_losses[wtp]++;
 		p_in->kill();
 		return 0;
 	}
 
-	nfo->_buffer->add(seq);
+	_wins[wtp]++;
 	return p_in;
 }
 
 enum {
 	H_DEBUG,
-	H_DUPES_TABLE
+	H_DUPES_TABLE,
+	H_WTPS,
+	H_RESET
 };
 
 String ScyllaWifiDupeFilter::read_handler(Element *e, void *thunk) {
@@ -75,11 +139,20 @@ String ScyllaWifiDupeFilter::read_handler(Element *e, void *thunk) {
 		StringAccum sa;
 		for (DupesIter it = td->dupes_table()->begin(); it.live(); it++) {
 			sa << it.value()._eth.unparse() << ' ' << it.value()._dupes << ' '
-					<< it.value()._buffer_size << it.value()._buffer->unparse()
+					<< it.value()._window.size() << it.value()._window.unparse()
 					<< ' ' << "\n";
 		}
 		return sa.take_string();
 	}
+	case H_WTPS: {
+		StringAccum sa;
+		for (int i = 0; i < 256; i++) {
+			if (td->_wins[i] || td->_losses[i]) {
+				sa << i << ' ' << td->_wins[i] << ' ' << td->_losses[i] << "\n";
+			}
+		}
+		return sa.take_string();
+	}
 	default:
 		return String();
 	}
@@ -114,17 +187,25 @@ int ScyllaWifiDupeFilter::write_handler(const String &in_s, Element *e,
 		if (!IntArg().parse(tokens[2], buffer_size)) {
 			return errh->error("error param %s: must start with int", tokens[2].c_str());
 		}
-		SeqBuffer * buffer = new SeqBuffer(buffer_size);
+		if (buffer_size < 1 || buffer_size > WifiSeqWindow::MAX_SIZE) {
+			return errh->error("error param %s: must be between 1 and %d", tokens[2].c_str(), (int) WifiSeqWindow::MAX_SIZE);
+		}
+		DupeFilterDstInfo nfo(eth, dupes, buffer_size);
 		for (int i = 3; i < tokens.size(); i++) {
 			int seq;
 			if (!IntArg().parse(tokens[i], seq)) {
 				return errh->error("error param %s: must start with int", tokens[i].c_str());
 			}
-			buffer->add(seq);
+			nfo._window.add(seq);
 		}
-		f->dupes_table()->insert(eth, DupeFilterDstInfo(eth, dupes, buffer_size, buffer));
+		nfo._last_heard = Timestamp::recent_steady();
+		f->dupes_table()->insert(eth, nfo);
 		break;
 	}
+	case H_RESET:
+		memset(f->_wins, 0, sizeof(f->_wins));
+		memset(f->_losses, 0, sizeof(f->_losses));
+		break;
 	}
 	return 0;
 
@@ -135,6 +216,8 @@ void ScyllaWifiDupeFilter::add_handlers() {
 	add_read_handler("dupes_table", read_handler, (void *) H_DUPES_TABLE);
 	add_write_handler("debug", write_handler, (void *) H_DEBUG);
 	add_write_handler("dupes_table", write_handler, (void *) H_DUPES_TABLE);
+	add_read_handler("wtps", read_handler, (void *) H_WTPS);
+	add_write_handler("reset", write_handler, (void *) H_RESET);
 }
 
 CLICK_ENDDECLS
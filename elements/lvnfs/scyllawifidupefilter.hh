@@ -2,122 +2,45 @@
 #define CLICK_SCYLLAWIFIDUPEFILTER_HH
 #include <click/element.hh>
 #include <click/string.hh>
-#include <click/hashmap.hh>
+#include <click/flathashtable.hh>
+#include <click/timer.hh>
+#include <elements/wifi/wifiseqwindow.hh>
 CLICK_DECLS
 
-class SeqBuffer {
-public:
-	SeqBuffer(unsigned int period) :
-		period(period), window(new int[period]), head(NULL), tail(NULL) {
-		assert(period >= 1);
-	}
-	~SeqBuffer() {
-		delete[] window;
-	}
-	// Adds a value to the average, pushing one out if necessary
-	void add(int val) {
-		// Special case: Initialisation
-		if (head == NULL) {
-			head = window;
-			*head = val;
-			tail = head;
-			inc(tail);
-			return;
-		}
-		// Were we already full?
-		if (head == tail) {
-			// Make room
-			inc(head);
-		}
-		// Write the value in the next spot.
-		*tail = val;
-		inc(tail);
-	}
-
-	String unparse() {
-		StringAccum sa;
-		if (!head) {
-			return sa.take_string();
-		}
-		int * ptr = head;
-		do {
-			sa << ' ' << *ptr;
-			inc(ptr);
-		} while (ptr != head);
-		return sa.take_string();
-	}
-
-	bool contains(int val) {
-		if (!head) {
-			return false;
-		}
-		int * ptr = head;
-		do {
-			if (val == *ptr) {
-				return true;
-			}
-			inc(ptr);
-		} while (ptr != head);
-		return false;
-	}
-
-private:
-
-	unsigned int period;
-	int * window; // Holds the sequence numbers
-
-	// Logically, head is before tail
-	int * head; // Points at the oldest element we've stored.
-	int * tail; // Points at the newest element we've stored.
-
-	// Bumps the given pointer up by one.
-	// Wraps to the start of the array if needed.
-	void inc(int * & p) {
-		if (++p >= window + period) {
-			p = window;
-		}
-	}
-
-	// Returns how many sequence numbers
-	ptrdiff_t size() const {
-		if (head == NULL)
-			return 0;
-		if (head == tail)
-			return period;
-		return (period + tail - head) % period;
-	}
-
-};
-
 class DupeFilterDstInfo {
 public:
 	EtherAddress _eth;
 	int _dupes;
-	int _buffer_size;
-	SeqBuffer * _buffer;
-	DupeFilterDstInfo() {
-		_eth = EtherAddress();
-		_dupes = 0;
-		_buffer_size = 5;
-		_buffer = new SeqBuffer(_buffer_size);
+	WifiSeqWindow _window;
+	Timestamp _last_heard;
+	// a number behind the window is a copy from a slow WTP, the window
+	// only restarts after MAX_DELAY of silence
+	DupeFilterDstInfo() : _dupes(0), _window(5) {
+		_window.set_restart(false);
 	}
-	DupeFilterDstInfo(EtherAddress eth, int buffer_size) {
-		_eth = eth;
-		_dupes = 0;
-		_buffer_size = buffer_size;
-		_buffer = new SeqBuffer(_buffer_size);
+	DupeFilterDstInfo(EtherAddress eth, int buffer_size) :
+		_eth(eth), _dupes(0), _window(buffer_size) {
+		_window.set_restart(false);
 	}
-	DupeFilterDstInfo(EtherAddress eth, int dupes, int buffer_size, SeqBuffer * buffer) {
-		_eth = eth;
-		_dupes = dupes;
-		_buffer_size = buffer_size;
-		_buffer = buffer;
+	DupeFilterDstInfo(EtherAddress eth, int dupes, int buffer_size) :
+		_eth(eth), _dupes(dupes), _window(buffer_size) {
+		_window.set_restart(false);
 	}
 };
 
-typedef HashMap <EtherAddress, DupeFilterDstInfo> DupesTable;
+typedef FlatHashTable<EtherAddress, DupeFilterDstInfo> DupesTable;
 typedef DupesTable::const_iterator DupesIter;
 
+// Drops the copies of an uplink frame after the first, keyed by
+// transmitter, sequence number and fragment. At the gateway the copies
+// come from every WTP that heard the frame, each marked with its WTP in
+// the WTP_ANNO byte (e.g. with a Paint on each tunnel), and the first
+// copy in wins for its WTP. Copies of a frame trail each other by at most
+// the spread of the tunnel delays: a transmitter silent for longer than
+// MAX_DELAY starts a fresh window, so that a sequence number heard before
+// is no longer taken for a copy. Until then, a number too far behind the
+// newest to be in the window of BUFFER_SIZE numbers is taken for a late
+// copy and dropped.
 class ScyllaWifiDupeFilter : public Element {
 
  public:
@@ -130,8 +53,11 @@ class ScyllaWifiDupeFilter : public Element {
   const char *processing() const		{ return AGNOSTIC; }
 
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  int initialize(ErrorHandler *) CLICK_COLD;
   bool can_live_reconfigure() const	{ return true; }
 
+  void run_timer(Timer *);
+
   Packet *simple_action(Packet *);
 
   void add_handlers() CLICK_COLD;
@@ -142,6 +68,15 @@ private:
 
   bool _debug;
   int _buffer_size;
+  uint32_t _max_transmitters;
+  Timestamp _timeout;
+  Timestamp _max_delay;
+  int _wtp_anno;
+
+  // indexed by the WTP annotation
+  uint64_t _wins[256];
+  uint64_t _losses[256];
+  Timer _timer;
 
   DupesTable _dupes_table;
 
@@ -255,6 +255,23 @@ Classifier::push(int, Packet *p)
     checked_output_push(_prog.match(p), p);
 }
 
+void
+Classifier::push_batch(int, Packet *head)
+{
+    // runs of packets bound for the same output are pushed together
+    PacketBatch run;
+    int port = -1;
+    while (Packet *p = PacketBatch::pop(head)) {
+	int o = _prog.match(p);
+	if (o != port && !run.empty())
+	    checked_output_push_batch(port, run.take());
+	port = o;
+	run.append(p);
+    }
+    if (!run.empty())
+	checked_output_push_batch(port, run.take());
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(AlignmentInfo Classification)
 EXPORT_ELEMENT(Classifier)
@@ -76,6 +76,62 @@ FullNoteQueue::pull(int)
 	return pull_failure();
 }
 
+void
+FullNoteQueue::push_batch(int, Packet *list)
+{
+    // Code taken from push(), with one notification per batch.
+    Storage::index_type t = tail();
+    bool queued = false;
+
+    while (Packet *p = PacketBatch::pop(list)) {
+	Storage::index_type nt = next_i(t);
+	if (nt != head()) {
+	    _q[t] = p;
+	    set_tail(nt);
+	    t = nt;
+	    queued = true;
+	} else
+	    push_failure(p);
+    }
+
+    if (queued) {
+	int s = size(head(), t);
+	if (s > _highwater_length)
+	    _highwater_length = s;
+
+	_empty_note.wake();
+
+	if (s == capacity()) {
+	    _full_note.sleep();
+#if HAVE_MULTITHREAD
+	    if (size() < capacity())
+		_full_note.wake();
+#endif
+	}
+    }
+}
+
+Packet *
+FullNoteQueue::pull_batch(int, unsigned max)
+{
+    // Code taken from pull(), with one notification per batch.
+    Storage::index_type h = head(), t = tail();
+    PacketBatch batch;
+
+    while (h != t && batch.count() < max) {
+	batch.append(_q[h]);
+	h = next_i(h);
+    }
+
+    if (batch.empty())
+	return pull_failure();
+
+    set_head(h);
+    _sleepiness = 0;
+    _full_note.wake();
+    return batch.take();
+}
+
 #if CLICK_DEBUG_SCHEDULING
 String
 FullNoteQueue::read_handler(Element *e, void *)
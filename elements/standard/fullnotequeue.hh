@@ -29,6 +29,9 @@ notifies interested parties that it is non-full, and when a formerly-full
 queue gains some free space.  In all respects but notification, Queue behaves
 exactly like SimpleQueue.
 
+A batch of packets pushed or pulled at once is enqueued or dequeued with a
+single notification.
+
 You may also use the old element name "FullNoteQueue".
 
 B<Multithreaded Click note:> Queue is designed to be used in an environment
@@ -80,6 +83,8 @@ class FullNoteQueue : public NotifierQueue { public:
 
     void push(int port, Packet *p);
     Packet *pull(int port);
+    void push_batch(int port, Packet *list);
+    Packet *pull_batch(int port, unsigned max);
 
   protected:
 
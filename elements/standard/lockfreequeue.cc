@@ -0,0 +1,258 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * lockfreequeue.{cc,hh} -- lock-free multiple producer FIFO queue
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "lockfreequeue.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+LockFreeQueue::LockFreeQueue()
+    : _slots(0), _capacity(0), _mask(0), _burst(32),
+      _caches(0), _ncaches(0), _tail(0), _head(0)
+{
+}
+
+LockFreeQueue::~LockFreeQueue()
+{
+}
+
+void *
+LockFreeQueue::cast(const char *n)
+{
+    if (strcmp(n, "LockFreeQueue") == 0)
+	return (LockFreeQueue *)this;
+    else if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else if (strcmp(n, Notifier::FULL_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_full_note);
+    else
+	return Element::cast(n);
+}
+
+int
+LockFreeQueue::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t capacity = 1024;
+    if (Args(conf, this, errh)
+	.read_p("CAPACITY", capacity)
+	.read("BURST", _burst)
+	.complete() < 0)
+	return -1;
+    if (capacity < 1 || capacity > 0x10000000)
+	return errh->error("CAPACITY out of range");
+    if (_burst < 1 || _burst > MAX_BURST)
+	return errh->error("BURST must be between 1 and %d", MAX_BURST);
+
+    _capacity = 1;
+    while (_capacity < capacity)
+	_capacity <<= 1;
+    _mask = _capacity - 1;
+
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    _full_note.initialize(Notifier::FULL_NOTIFIER, router());
+    _full_note.set_active(true, false);
+    return 0;
+}
+
+int
+LockFreeQueue::initialize(ErrorHandler *)
+{
+    _slots = new Slot[_capacity];
+    for (uint32_t i = 0; i < _capacity; ++i) {
+	_slots[i].seq = i << 1;
+	_slots[i].p = 0;
+    }
+    _ncaches = noutputs();
+    _caches = new Cache[_ncaches];
+    for (int i = 0; i < _ncaches; ++i) {
+	_caches[i].p = new Packet *[_burst];
+	_caches[i].pos = _caches[i].n = _caches[i].sleepiness = 0;
+    }
+    _tail = _head = 0;
+    return 0;
+}
+
+void
+LockFreeQueue::cleanup(CleanupStage)
+{
+    if (_slots)
+	for (uint32_t pos = _head; pos != (_tail & ~1U); pos += 2)
+	    if (slot(pos).seq == pos + 2)
+		slot(pos).p->kill();
+    for (int i = 0; i < _ncaches; ++i) {
+	Cache &c = _caches[i];
+	while (c.pos < c.n)
+	    c.p[c.pos++]->kill();
+	delete[] c.p;
+    }
+    delete[] _caches;
+    delete[] _slots;
+    _caches = 0;
+    _slots = 0;
+    _ncaches = 0;
+}
+
+void
+LockFreeQueue::push(int, Packet *p)
+{
+    uint32_t w = _tail, pos;
+    while (1) {
+	pos = w & ~1U;
+	int32_t d = slot(pos).seq - pos;
+	if (d == 0) {
+	    uint32_t actual = atomic_uint32_t::compare_swap(_tail, w, pos + 2);
+	    if (actual == w)
+		break;
+	    w = actual;
+	} else if (d < 0) {
+	    // the slot still holds the packet of the previous round
+	    if (_full_note.active()) {
+		_full_note.sleep();
+		// a consumer may have freed it, and woken us, in between
+		if (slot(pos).seq == pos)
+		    _full_note.wake();
+	    }
+	    _drops++;
+	    p->kill();
+	    return;
+	} else
+	    // another producer took the slot
+	    w = _tail;
+    }
+
+    Slot &s = slot(pos);
+    s.p = p;
+    // publish the packet before the seq
+    click_write_fence();
+    s.seq = pos + 2;
+    if (w & 1)
+	_empty_note.wake();
+}
+
+int
+LockFreeQueue::claim(Cache &c)
+{
+    uint32_t h;
+    int n;
+    do {
+	h = _head;
+	for (n = 0; n < _burst; ++n)
+	    if (slot(h + 2 * n).seq != h + 2 * n + 2)
+		break;
+	if (n == 0)
+	    return 0;
+    } while (_ncaches > 1 && atomic_uint32_t::compare_swap(_head, h, h + 2 * n) != h);
+
+    // read the packets only after observing their seq
+    click_read_fence();
+    for (int i = 0; i < n; ++i)
+	c.p[i] = slot(h + 2 * i).p;
+    // release the slots only after they have been read
+    click_fence();
+    for (int i = 0; i < n; ++i)
+	slot(h + 2 * i).seq = h + 2 * i + 2 * _capacity;
+    if (_ncaches == 1)
+	_head = h + 2 * n;
+
+    c.pos = 0;
+    c.n = n;
+    if (!_full_note.active())
+	_full_note.wake();
+    return n;
+}
+
+Packet *
+LockFreeQueue::pull_failure(Cache &c)
+{
+    if (c.sleepiness < SLEEPINESS_TRIGGER) {
+	++c.sleepiness;
+	return 0;
+    }
+
+    // a producer that reserved a slot will fill it soon, don't sleep
+    uint32_t w = _tail;
+    if ((w & ~1U) != _head)
+	return 0;
+
+    _empty_note.sleep();
+    // if the producers moved on in between, one of them may have found
+    // us awake, so wake up again
+    if ((w & 1) ? _tail != w
+	: atomic_uint32_t::compare_swap(_tail, w, w | 1) != w)
+	_empty_note.wake();
+    else if (!_full_note.active())
+	// a producer may have missed the wakeup of our last claim
+	_full_note.wake();
+    return 0;
+}
+
+Packet *
+LockFreeQueue::pull(int port)
+{
+    Cache &c = _caches[port];
+    if (c.pos == c.n && !claim(c))
+	return pull_failure(c);
+    c.sleepiness = 0;
+    return c.p[c.pos++];
+}
+
+enum { h_length, h_capacity, h_drops, h_reset_counts };
+
+String
+LockFreeQueue::read_handler(Element *e, void *user_data)
+{
+    LockFreeQueue *q = static_cast<LockFreeQueue *>(e);
+    switch (reinterpret_cast<intptr_t>(user_data)) {
+    case h_length: {
+	uint32_t length = ((q->_tail & ~1U) - q->_head) >> 1;
+	for (int i = 0; i < q->_ncaches; ++i)
+	    length += q->_caches[i].n - q->_caches[i].pos;
+	return String(length);
+    }
+    case h_capacity:
+	return String(q->_capacity);
+    case h_drops:
+	return String(q->_drops.value());
+    default:
+	return String();
+    }
+}
+
+int
+LockFreeQueue::write_handler(const String &, Element *e, void *user_data, ErrorHandler *)
+{
+    LockFreeQueue *q = static_cast<LockFreeQueue *>(e);
+    switch (reinterpret_cast<intptr_t>(user_data)) {
+    case h_reset_counts:
+	q->_drops = 0;
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+LockFreeQueue::add_handlers()
+{
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("capacity", read_handler, h_capacity);
+    add_read_handler("drops", read_handler, h_drops);
+    add_write_handler("reset_counts", write_handler, h_reset_counts, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(LockFreeQueue)
+ELEMENT_MT_SAFE(LockFreeQueue)
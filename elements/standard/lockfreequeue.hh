@@ -0,0 +1,127 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_LOCKFREEQUEUE_HH
+#define CLICK_LOCKFREEQUEUE_HH
+#include <click/element.hh>
+#include <click/notifier.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+
+/*
+=c
+
+LockFreeQueue
+LockFreeQueue(CAPACITY [, I<keywords> BURST])
+
+=s storage
+
+stores packets in a lock-free FIFO queue
+
+=d
+
+Stores incoming packets in a bounded first-in-first-out ring that any
+number of threads may push into concurrently. Drops incoming packets if
+the queue already holds CAPACITY packets, rounded up to a power of two.
+The default for CAPACITY is 1024.
+
+Pushing a packet costs one compare-and-swap, which reserves its slot.
+Pulls claim up to BURST ready packets at a time, default 32, and serve
+the following pulls from a private cache.
+
+Every output is a consumer, which may run on its own thread. With a
+single output, packets are claimed without any atomic operation. With
+several, each output claims its batches with one compare-and-swap, and
+takes batches as they come: outputs do not get a fair share.
+
+LockFreeQueue has non-empty and non-full notifiers, like Queue. They only
+change state when the queue really empties or fills, so the steady state
+touches no notifier.
+
+Packets an output has claimed stay in its cache until it is pulled
+again, and still count in the I<length> handler.
+
+=h length read-only
+
+Returns the current number of packets in the queue.
+
+=h capacity read-only
+
+Returns the queue's capacity.
+
+=h drops read-only
+
+Returns the number of packets dropped by the queue so far.
+
+=h reset_counts write-only
+
+When written, resets the C<drops> counter.
+
+=a Queue, ThreadSafeQueue, CPUQueue */
+
+class LockFreeQueue : public Element { public:
+
+    LockFreeQueue() CLICK_COLD;
+    ~LockFreeQueue() CLICK_COLD;
+
+    const char *class_name() const		{ return "LockFreeQueue"; }
+    const char *port_count() const		{ return "1/1-"; }
+    const char *processing() const		{ return PUSH_TO_PULL; }
+    void *cast(const char *);
+
+    int configure(Vector<String> &conf, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+
+  private:
+
+    enum { SLEEPINESS_TRIGGER = 9, MAX_BURST = 256 };
+
+    // Positions advance by 2: the low bit of _tail is set while the
+    // consumers sleep, so that the producer reserving the next slot
+    // learns in the same compare-and-swap that it must wake them. A slot
+    // at position pos is free when its seq is pos, filled when it is
+    // pos + 2, and becomes free for the next round at pos + 2*capacity.
+    struct Slot {
+	volatile uint32_t seq;
+	Packet *p;
+    };
+
+    // packets claimed by one output
+    struct Cache {
+	Packet **p;
+	int pos;
+	int n;
+	int sleepiness;
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    Slot *_slots;
+    uint32_t _capacity;
+    uint32_t _mask;
+    int _burst;
+    Cache *_caches;
+    int _ncaches;
+    atomic_uint32_t _drops;
+
+    volatile uint32_t _tail CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    volatile uint32_t _head CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    ActiveNotifier _empty_note;
+    ActiveNotifier _full_note;
+
+    Slot &slot(uint32_t pos) const {
+	return _slots[(pos >> 1) & _mask];
+    }
+    int claim(Cache &c);
+    Packet *pull_failure(Cache &c);
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &, Element *e, void *user_data,
+			     ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -37,6 +37,8 @@ class Paint : public Element { public:
     void add_handlers() CLICK_COLD;
 
     Packet *simple_action(Packet *);
+    void push_batch(int port, Packet *head)	{ simple_action_push_batch(port, head); }
+    Packet *pull_batch(int port, unsigned max) { return simple_action_pull_batch(port, max); }
 
   private:
 
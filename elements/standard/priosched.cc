@@ -53,6 +53,22 @@ PrioSched::pull(int)
     return 0;
 }
 
+Packet *
+PrioSched::pull_batch(int, unsigned max)
+{
+    Packet *head = 0, **tail = &head;
+    for (int i = 0; i < ninputs() && max; i++)
+	if (_signals[i])
+	    if (Packet *p = input(i).pull_batch(max)) {
+		*tail = p;
+		for (; p; p = p->next()) {
+		    tail = &p->next();
+		    --max;
+		}
+	    }
+    return head;
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(PrioSched)
 ELEMENT_MT_SAFE(PrioSched)
@@ -19,6 +19,9 @@ CLICK_DECLS
  * The inputs usually come from Queues or other pull schedulers.
  * PrioSched uses notification to avoid pulling from empty inputs.
  *
+ * A batch pull takes as many packets as it can from input 0, then tops the
+ * batch up from input 1, and so on.
+ *
  * =a Queue, RoundRobinSched, StrideSched, DRRSched, SimplePrioSched
  */
 
@@ -35,6 +38,7 @@ class PrioSched : public Element { public:
     void cleanup(CleanupStage) CLICK_COLD;
 
     Packet *pull(int port);
+    Packet *pull_batch(int port, unsigned max);
 
   private:
 
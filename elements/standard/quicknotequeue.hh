@@ -72,8 +72,9 @@ class QuickNoteQueue : public FullNoteQueue { public:
 
     // FullNoteQueue's configure() suffices
 
-    // FullNoteQueue's push() suffices
+    // FullNoteQueue's push() and push_batch() suffice
     Packet *pull(int port);
+    Packet *pull_batch(int port, unsigned max)	{ return Element::pull_batch(port, max); }
 
 };
 
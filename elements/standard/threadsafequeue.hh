@@ -63,6 +63,9 @@ class ThreadSafeQueue : public FullNoteQueue { public:
 
     void push(int port, Packet *);
     Packet *pull(int port);
+    // Queue's batch functions assume a single pusher and puller
+    void push_batch(int port, Packet *list)	{ Element::push_batch(port, list); }
+    Packet *pull_batch(int port, unsigned max)	{ return Element::pull_batch(port, max); }
 
   private:
 
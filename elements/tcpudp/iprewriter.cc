@@ -61,6 +61,7 @@ IPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("UDP_TIMEOUT", SecondsArg(), _udp_timeouts[0])
 	.read("UDP_STREAMING_TIMEOUT", SecondsArg(), _udp_streaming_timeout).read_status(has_udp_streaming_timeout)
 	.read("UDP_GUARANTEE", SecondsArg(), _udp_timeouts[1])
+	.read("SHARDED", _sharded)
 	.consume() < 0)
 	return -1;
 
@@ -73,9 +74,31 @@ IPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
     return TCPRewriter::configure(conf, errh);
 }
 
+IPRewriterShard *
+IPRewriter::make_shard(int index, int count)
+{
+    return new Shard(index, count);
+}
+
 inline IPRewriterEntry *
 IPRewriter::get_entry(int ip_p, const IPFlowID &flowid, int input)
 {
+    if (_shards.size()) {
+	if (ip_p != IP_PROTO_TCP && ip_p != IP_PROTO_UDP)
+	    return 0;
+	Shard *s = static_cast<Shard *>(shard());
+	int mapid = (ip_p == IP_PROTO_TCP ? IPRewriterInput::mapid_default : IPRewriterInput::mapid_iprewriter_udp);
+	s->_lock.acquire();
+	IPRewriterEntry *m = s->map(mapid)->get(flowid);
+	if (!m && (unsigned) input < (unsigned) s->_inputs.size()) {
+	    IPRewriterInput &is = s->_inputs[input];
+	    IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
+	    if (is.rewrite_flowid(flowid, rewritten_flowid, 0, mapid) == rw_addmap)
+		m = add_shard_flow(s, ip_p, flowid, rewritten_flowid, input);
+	}
+	s->_lock.release();
+	return m;
+    }
     if (ip_p == IP_PROTO_TCP)
 	return TCPRewriter::get_entry(ip_p, flowid, input);
     if (ip_p != IP_PROTO_UDP)
@@ -94,6 +117,8 @@ IPRewriterEntry *
 IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 		     const IPFlowID &rewritten_flowid, int input)
 {
+    if (_shards.size())
+	return add_shard_flow(static_cast<Shard *>(shard()), ip_p, flowid, rewritten_flowid, input);
     if (ip_p == IP_PROTO_TCP)
 	return TCPRewriter::add_flow(ip_p, flowid, rewritten_flowid, input);
 
@@ -109,6 +134,44 @@ IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
     return store_flow(flow, input, _udp_map, &reply_udp_map(rwinput));
 }
 
+IPRewriterEntry *
+IPRewriter::add_shard_flow(Shard *s, int ip_p, const IPFlowID &flowid,
+			   const IPFlowID &rewritten_flowid, int input)
+{
+    IPRewriterInput *rwinput = &s->_inputs[input];
+    IPRewriterFlow *flow;
+    Map *map;
+    void *data;
+
+    s->_lock.acquire();
+    if (ip_p == IP_PROTO_TCP) {
+	if (!(data = s->_allocator.allocate()))
+	    goto failed;
+	flow = new(data) TCPFlow
+	    (rwinput, flowid, rewritten_flowid,
+	     !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts));
+	map = &s->_map;
+    } else {
+	if (!(data = s->_udp_allocator.allocate()))
+	    goto failed;
+	flow = new(data) IPRewriterFlow
+	    (rwinput, flowid, rewritten_flowid, IP_PROTO_UDP,
+	     !!_udp_timeouts[1], click_jiffies() + relevant_timeout(_udp_timeouts));
+	map = &s->_udp_map;
+    }
+
+    {
+	// a sharded rewriter is its own reply element
+	IPRewriterEntry *m = store_flow(flow, input, *map, map);
+	s->_lock.release();
+	return m;
+    }
+
+  failed:
+    s->_lock.release();
+    return 0;
+}
+
 void
 IPRewriter::push(int port, Packet *p_in)
 {
@@ -127,17 +190,33 @@ IPRewriter::push(int port, Packet *p_in)
 	return;
     }
 
+    // in sharded mode, everything below happens in the calling thread's
+    // shard, whose lock is only contended by handlers and the reaper
+    Shard *s = 0;
+    HashContainer<IPRewriterEntry> *map;
+    IPRewriterHeap *heap;
+    if (_shards.size()) {
+	s = static_cast<Shard *>(shard());
+	s->_lock.acquire();
+	map = (iph->ip_p == IP_PROTO_TCP ? &s->_map : &s->_udp_map);
+	heap = s->_heap;
+    } else {
+	map = (iph->ip_p == IP_PROTO_TCP ? &_map : &_udp_map);
+	heap = _heap;
+    }
+
     IPFlowID flowid(p);
-    HashContainer<IPRewriterEntry> *map = (iph->ip_p == IP_PROTO_TCP ? &_map : &_udp_map);
     IPRewriterEntry *m = map->get(flowid);
 
     if (!m) {			// create new mapping
-	IPRewriterInput &is = _input_specs.unchecked_at(port);
+	IPRewriterInput &is = s ? s->_inputs.unchecked_at(port) : _input_specs.unchecked_at(port);
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
 	int result = is.rewrite_flowid(flowid, rewritten_flowid, p, iph->ip_p == IP_PROTO_TCP ? 0 : IPRewriterInput::mapid_iprewriter_udp);
 	if (result == rw_addmap)
 	    m = IPRewriter::add_flow(iph->ip_p, flowid, rewritten_flowid, port);
 	if (!m) {
+	    if (s)
+		s->_lock.release();
 	    checked_output_push(result, p);
 	    return;
 	} else if (_annos & 2)
@@ -150,19 +229,22 @@ IPRewriter::push(int port, Packet *p_in)
 	TCPFlow *tcpmf = static_cast<TCPFlow *>(mf);
 	tcpmf->apply(p, m->direction(), _annos);
 	if (_timeouts[1])
-	    tcpmf->change_expiry(_heap, true, now_j + _timeouts[1]);
+	    tcpmf->change_expiry(heap, true, now_j + _timeouts[1]);
 	else
-	    tcpmf->change_expiry(_heap, false, now_j + tcp_flow_timeout(tcpmf));
+	    tcpmf->change_expiry(heap, false, now_j + tcp_flow_timeout(tcpmf));
     } else {
 	UDPFlow *udpmf = static_cast<UDPFlow *>(mf);
 	udpmf->apply(p, m->direction(), _annos);
 	if (_udp_timeouts[1])
-	    udpmf->change_expiry(_heap, true, now_j + _udp_timeouts[1]);
+	    udpmf->change_expiry(heap, true, now_j + _udp_timeouts[1]);
 	else
-	    udpmf->change_expiry(_heap, false, now_j + udp_flow_timeout(udpmf));
+	    udpmf->change_expiry(heap, false, now_j + udp_flow_timeout(udpmf));
     }
 
-    output(m->output()).push(p);
+    int o = m->output();
+    if (s)
+	s->_lock.release();
+    output(o).push(p);
 }
 
 String
@@ -178,11 +260,39 @@ IPRewriter::udp_mappings_handler(Element *e, void *)
     return sa.take_string();
 }
 
+String
+IPRewriter::shard_mappings_handler(Element *e, void *user_data)
+{
+    IPRewriter *rw = (IPRewriter *)e;
+    int mapid = (intptr_t) user_data;
+    click_jiffies_t now = click_jiffies();
+    StringAccum sa;
+    for (int i = 0; i < rw->_shards.size(); ++i) {
+	IPRewriterShard *s = rw->_shards[i];
+	s->_lock.acquire();
+	Map *map = s->map(mapid);
+	for (Map::iterator iter = map->begin(); iter.live(); ++iter) {
+	    if (mapid == IPRewriterInput::mapid_default)
+		static_cast<TCPFlow *>(iter->flow())->unparse(sa, iter->direction(), now);
+	    else
+		iter->flow()->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	s->_lock.release();
+    }
+    return sa.take_string();
+}
+
 void
 IPRewriter::add_handlers()
 {
-    add_read_handler("tcp_table", tcp_mappings_handler);
-    add_read_handler("udp_table", udp_mappings_handler);
+    if (_sharded) {
+	add_read_handler("tcp_table", shard_mappings_handler, IPRewriterInput::mapid_default);
+	add_read_handler("udp_table", shard_mappings_handler, IPRewriterInput::mapid_iprewriter_udp);
+    } else {
+	add_read_handler("tcp_table", tcp_mappings_handler);
+	add_read_handler("udp_table", udp_mappings_handler);
+    }
     add_read_handler("tcp_mappings", tcp_mappings_handler, 0, Handler::h_deprecated);
     add_read_handler("udp_mappings", udp_mappings_handler, 0, Handler::h_deprecated);
     set_handler("tcp_lookup", Handler::OP_READ | Handler::READ_PARAM, tcp_lookup_handler, 0);
@@ -169,6 +169,18 @@ element, in which case this element will share the other element's capacity.
 Boolean. If true, then set the destination IP address annotation on passing
 packets to the rewritten destination address. Default is true.
 
+=item SHARDED
+
+Boolean. If true, keep one mapping table per thread instead of one shared by
+all threads, so that rewriting scales across cores without contention. A
+mapping is only found by the thread that installed it: both directions of a
+flow must be handled on the same thread, for instance by spreading flows over
+threads with a symmetric hash. Each thread picks new source ports, or
+whatever else its patterns vary, from its own share of the patterns' ranges,
+so flows of different threads never collide. MAPPING_CAPACITY applies to each
+table. The IPRewriter must be the reply element of all its INPUTSPECs and
+cannot share its capacity with another element. Default is false.
+
 =back
 
 =h table_size r
@@ -230,7 +242,9 @@ class IPRewriter : public TCPRewriter { public:
 
     IPRewriterEntry *get_entry(int ip_p, const IPFlowID &flowid, int input);
     HashContainer<IPRewriterEntry> *get_map(int mapid) {
-	if (mapid == IPRewriterInput::mapid_default)
+	if (_shards.size())
+	    return shard()->map(mapid);
+	else if (mapid == IPRewriterInput::mapid_default)
 	    return &_map;
 	else if (mapid == IPRewriterInput::mapid_iprewriter_udp)
 	    return &_udp_map;
@@ -251,8 +265,20 @@ class IPRewriter : public TCPRewriter { public:
 
     void add_handlers() CLICK_COLD;
 
+  protected:
+
+    IPRewriterShard *make_shard(int index, int count);
+
   private:
 
+    struct Shard : public IPRewriterShard {
+	Shard(int index, int count)
+	    : IPRewriterShard(index, count) {
+	}
+	SizedHashAllocator<sizeof(TCPFlow)> _allocator;
+	SizedHashAllocator<sizeof(UDPFlow)> _udp_allocator;
+    };
+
     Map _udp_map;
     SizedHashAllocator<sizeof(UDPFlow)> _udp_allocator;
     uint32_t _udp_timeouts[2];
@@ -269,7 +295,11 @@ class IPRewriter : public TCPRewriter { public:
 	IPRewriter *x = static_cast<IPRewriter *>(rwinput->reply_element);
 	return x->_udp_map;
     }
+    IPRewriterEntry *add_shard_flow(Shard *s, int ip_p, const IPFlowID &flowid,
+				    const IPFlowID &rewritten_flowid, int input);
+
     static String udp_mappings_handler(Element *e, void *user_data);
+    static String shard_mappings_handler(Element *e, void *user_data);
 
 };
 
@@ -277,7 +307,18 @@ class IPRewriter : public TCPRewriter { public:
 inline void
 IPRewriter::destroy_flow(IPRewriterFlow *flow)
 {
-    if (flow->ip_p() == IP_PROTO_TCP)
+    if (IPRewriterShard *shard = flow->owner()->shard) {
+	Shard *s = static_cast<Shard *>(shard);
+	if (flow->ip_p() == IP_PROTO_TCP) {
+	    unmap_flow(flow, s->_map, &s->_map);
+	    static_cast<TCPFlow *>(flow)->~TCPFlow();
+	    s->_allocator.deallocate(flow);
+	} else {
+	    unmap_flow(flow, s->_udp_map, &s->_udp_map);
+	    flow->~IPRewriterFlow();
+	    s->_udp_allocator.deallocate(flow);
+	}
+    } else if (flow->ip_p() == IP_PROTO_TCP)
 	TCPRewriter::destroy_flow(flow);
     else {
 	unmap_flow(flow, _udp_map, &reply_udp_map(flow->owner()));
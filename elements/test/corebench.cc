@@ -0,0 +1,361 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * corebench.{cc,hh} -- microbenchmarks of the core containers and primitives
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "corebench.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+#include <click/flathashtable.hh>
+#include <click/vector.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+#include <click/packet.hh>
+#if CLICK_USERLEVEL
+# include <stdio.h>
+#endif
+CLICK_DECLS
+
+// results go here, so that the compiler keeps the work
+static volatile uintptr_t bench_sink;
+
+static inline int64_t
+bench_now()
+{
+    return Timestamp::now_steady().nsecval();
+}
+
+static EtherAddress
+make_ether(uint32_t i, uint8_t kind)
+{
+    unsigned char data[6] = { 0x02, kind, (unsigned char) (i >> 24), (unsigned char) (i >> 16),
+			      (unsigned char) (i >> 8), (unsigned char) i };
+    return EtherAddress(data);
+}
+
+// n addresses in random order
+static void
+make_keys(Vector<EtherAddress> &keys, int n, uint8_t kind)
+{
+    keys.clear();
+    for (int i = 0; i < n; i++)
+	keys.push_back(make_ether(i, kind));
+    for (int i = n - 1; i > 0; i--) {
+	int j = click_random(0, i);
+	EtherAddress t = keys[i];
+	keys[i] = keys[j];
+	keys[j] = t;
+    }
+}
+
+enum { T_INSERT, T_LOOKUP, T_MISS, T_ERASE, T_COUNT };
+
+// One round of the table benchmarks, nanoseconds of each phase in nsec
+template <typename T> static void
+bench_table(const Vector<EtherAddress> &keys, const Vector<EtherAddress> &misses,
+	    int64_t *nsec)
+{
+    T t;
+    int n = keys.size();
+    uintptr_t sum = 0;
+
+    int64_t t0 = bench_now();
+    for (int i = 0; i < n; i++)
+	t.set(keys[i], i);
+    int64_t t1 = bench_now();
+    for (int i = n - 1; i >= 0; i--)
+	sum += *t.get_pointer(keys[i]);
+    int64_t t2 = bench_now();
+    for (int i = 0; i < n; i++)
+	sum += (uintptr_t) t.get_pointer(misses[i]);
+    int64_t t3 = bench_now();
+    for (int i = 0; i < n; i++)
+	t.erase(keys[i]);
+    int64_t t4 = bench_now();
+
+    bench_sink += sum + t.size();
+    nsec[T_INSERT] = t1 - t0;
+    nsec[T_LOOKUP] = t2 - t1;
+    nsec[T_MISS] = t3 - t2;
+    nsec[T_ERASE] = t4 - t3;
+}
+
+CoreBench::CoreBench()
+    : _rounds(5), _quiet(false)
+{
+}
+
+int
+CoreBench::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String sizes = "1000 10000 100000";
+    if (Args(conf, this, errh)
+	.read("SIZES", AnyArg(), sizes)
+	.read("ROUNDS", _rounds)
+	.read("FILTER", WordArg(), _filter)
+	.read("QUIET", _quiet)
+	.complete() < 0)
+	return -1;
+
+    Vector<String> words;
+    cp_spacevec(cp_uncomment(sizes), words);
+    _sizes.clear();
+    for (int i = 0; i < words.size(); i++) {
+	int n;
+	if (!IntArg().parse(words[i], n) || n < 1 || n > 10000000)
+	    return errh->error("SIZES must be sizes between 1 and 10000000");
+	_sizes.push_back(n);
+    }
+    if (!_sizes.size())
+	return errh->error("SIZES is empty");
+    if (_rounds < 1)
+	return errh->error("ROUNDS must be positive");
+    return 0;
+}
+
+// whether a group of benchmarks has one FILTER selects
+bool
+CoreBench::wanted(const char *group) const
+{
+    String g(group);
+    return !_filter || g.starts_with(_filter) || _filter.starts_with(g);
+}
+
+void
+CoreBench::report(const char *name, int n, uint64_t ops, uint64_t nsec)
+{
+    if (_filter && !String(name).starts_with(_filter))
+	return;
+    StringAccum sa;
+    sa << "{\"bench\":\"" << name << "\",\"n\":" << n << ",\"ops\":" << ops
+       << ",\"ns_per_op\":";
+    sa.snprintf(32, "%.2f", ops ? (double) nsec / ops : 0.);
+    sa << "}\n";
+    _results << sa;
+    if (!_quiet) {
+#if CLICK_USERLEVEL
+	fputs(sa.c_str(), stdout);
+	fflush(stdout);
+#else
+	click_chatter("%s", sa.c_str());
+#endif
+    }
+}
+
+int
+CoreBench::initialize(ErrorHandler *)
+{
+    static const char * const table_names[2][T_COUNT] = {
+	{ "hashtable.insert", "hashtable.lookup", "hashtable.miss", "hashtable.erase" },
+	{ "flathashtable.insert", "flathashtable.lookup", "flathashtable.miss", "flathashtable.erase" }
+    };
+
+    for (int s = 0; s < _sizes.size(); s++) {
+	int n = _sizes[s];
+	Vector<EtherAddress> keys, misses;
+	make_keys(keys, n, 0x00);
+	make_keys(misses, n, 0x01);
+
+	// tables
+	for (int which = 0; which < 2; which++) {
+	    if (!wanted(which ? "flathashtable" : "hashtable"))
+		continue;
+	    int64_t best[T_COUNT], nsec[T_COUNT];
+	    for (int r = 0; r < _rounds; r++) {
+		if (which)
+		    bench_table<FlatHashTable<EtherAddress, int> >(keys, misses, nsec);
+		else
+		    bench_table<HashTable<EtherAddress, int> >(keys, misses, nsec);
+		for (int k = 0; k < T_COUNT; k++)
+		    if (!r || nsec[k] < best[k])
+			best[k] = nsec[k];
+	    }
+	    for (int k = 0; k < T_COUNT; k++)
+		report(table_names[which][k], n, n, best[k]);
+	}
+
+	// vectors
+	if (wanted("vector")) {
+	    int64_t best_push = 0, best_scan = 0;
+	    for (int r = 0; r < _rounds; r++) {
+		Vector<EtherAddress> v;
+		int64_t t0 = bench_now();
+		for (int i = 0; i < n; i++)
+		    v.push_back(keys[i]);
+		int64_t t1 = bench_now();
+		uintptr_t sum = 0;
+		for (const EtherAddress *it = v.begin(); it != v.end(); ++it)
+		    sum += it->data()[5];
+		int64_t t2 = bench_now();
+		bench_sink += sum;
+		if (!r || t1 - t0 < best_push)
+		    best_push = t1 - t0;
+		if (!r || t2 - t1 < best_scan)
+		    best_scan = t2 - t1;
+	    }
+	    report("vector.push_back", n, n, best_push);
+	    report("vector.scan", n, n, best_scan);
+	}
+
+	// strings
+	if (wanted("string") || wanted("straccum")) {
+	    int64_t best[4] = { 0, 0, 0, 0 };
+	    for (int r = 0; r < _rounds; r++) {
+		Vector<String> strs;
+		strs.reserve(n);
+		uintptr_t sum = 0;
+		int64_t t0 = bench_now();
+		for (int i = 0; i < n; i++)
+		    strs.push_back(keys[i].unparse());
+		int64_t t1 = bench_now();
+		for (int i = 0; i < n; i++)
+		    sum += strs[i].hashcode();
+		int64_t t2 = bench_now();
+		for (int i = 0; i < n; i++)
+		    sum += ("L" + strs[i]).length();
+		int64_t t3 = bench_now();
+		StringAccum sa;
+		for (int i = 0; i < n; i++)
+		    sa << keys[i] << ' ' << i << '\n';
+		String report_string = sa.take_string();
+		int64_t t4 = bench_now();
+		bench_sink += sum + report_string.length();
+		int64_t nsec[4] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3 };
+		for (int k = 0; k < 4; k++)
+		    if (!r || nsec[k] < best[k])
+			best[k] = nsec[k];
+	    }
+	    if (wanted("string")) {
+		report("string.unparse", n, n, best[0]);
+		report("string.hashcode", n, n, best[1]);
+		report("string.concat", n, n, best[2]);
+	    }
+	    if (wanted("straccum"))
+		report("straccum.append", n, n, best[3]);
+	}
+
+	// packets
+	if (wanted("packet")) {
+	    int64_t best[3] = { 0, 0, 0 };
+	    for (int r = 0; r < _rounds; r++) {
+		int64_t t0 = bench_now();
+		for (int i = 0; i < n; i++)
+		    if (WritablePacket *p = Packet::make(Packet::default_headroom, 0, 1500, 0))
+			p->kill();
+		int64_t t1 = bench_now();
+		Packet *base = Packet::make(Packet::default_headroom, 0, 1500, 0);
+		if (!base)
+		    break;
+		for (int i = 0; i < n; i++)
+		    if (Packet *q = base->clone())
+			q->kill();
+		int64_t t2 = bench_now();
+		// a chain of 4 clones, each made writable
+		for (int i = 0; i < n; i += 4) {
+		    Packet *q[4];
+		    for (int k = 0; k < 4; k++)
+			q[k] = base->clone();
+		    for (int k = 0; k < 4; k++)
+			if (q[k]) {
+			    if (WritablePacket *w = q[k]->uniqueify())
+				w->kill();
+			}
+		}
+		int64_t t3 = bench_now();
+		base->kill();
+		int64_t nsec[3] = { t1 - t0, t2 - t1, t3 - t2 };
+		for (int k = 0; k < 3; k++)
+		    if (!r || nsec[k] < best[k])
+			best[k] = nsec[k];
+	    }
+	    report("packet.make", n, n, best[0]);
+	    report("packet.clone", n, n, best[1]);
+	    report("packet.uniqueify", n, (n + 3) / 4 * 4, best[2]);
+	}
+
+	// timers
+	if (wanted("timer")) {
+	    int64_t best[3] = { 0, 0, 0 };
+	    Timer *timers = new Timer[n];
+	    for (int i = 0; i < n; i++)
+		timers[i].initialize(this);
+	    for (int r = 0; r < _rounds; r++) {
+		// far enough that none fires meanwhile
+		int64_t t0 = bench_now();
+		for (int i = 0; i < n; i++)
+		    timers[i].schedule_after_msec(3600000 + click_random(0, 60000));
+		int64_t t1 = bench_now();
+		for (int i = 0; i < n; i++)
+		    timers[i].schedule_after_msec(3600000 + click_random(0, 60000));
+		int64_t t2 = bench_now();
+		for (int i = 0; i < n; i++)
+		    timers[i].unschedule();
+		int64_t t3 = bench_now();
+		int64_t nsec[3] = { t1 - t0, t2 - t1, t3 - t2 };
+		for (int k = 0; k < 3; k++)
+		    if (!r || nsec[k] < best[k])
+			best[k] = nsec[k];
+	    }
+	    delete[] timers;
+	    report("timer.schedule", n, n, best[0]);
+	    report("timer.reschedule", n, n, best[1]);
+	    report("timer.unschedule", n, n, best[2]);
+	}
+
+	// locks
+	if (wanted("rwlock")) {
+	    int64_t best[2] = { 0, 0 };
+	    ReadWriteLock lock;
+	    for (int r = 0; r < _rounds; r++) {
+		int64_t t0 = bench_now();
+		for (int i = 0; i < n; i++) {
+		    lock.acquire_read();
+		    lock.release_read();
+		}
+		int64_t t1 = bench_now();
+		for (int i = 0; i < n; i++) {
+		    lock.acquire_write();
+		    lock.release_write();
+		}
+		int64_t t2 = bench_now();
+		int64_t nsec[2] = { t1 - t0, t2 - t1 };
+		for (int k = 0; k < 2; k++)
+		    if (!r || nsec[k] < best[k])
+			best[k] = nsec[k];
+	    }
+	    report("rwlock.read", n, n, best[0]);
+	    report("rwlock.write", n, n, best[1]);
+	}
+    }
+
+    return 0;
+}
+
+String
+CoreBench::read_handler(Element *e, void *)
+{
+    CoreBench *cb = static_cast<CoreBench *>(e);
+    return String(cb->_results.data(), cb->_results.length());
+}
+
+void
+CoreBench::add_handlers()
+{
+    add_read_handler("results", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(CoreBench)
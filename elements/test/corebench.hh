@@ -0,0 +1,124 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_COREBENCH_HH
+#define CLICK_COREBENCH_HH
+#include <click/element.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+=c
+
+CoreBench([I<KEYWORDS>])
+
+=s test
+
+runs microbenchmarks of the core containers and primitives
+
+=d
+
+CoreBench times the Click primitives the data path leans on, with
+workloads keyed by Ethernet addresses, at initialization time. It does not
+route packets. The benchmarks are:
+
+=over 8
+
+=item hashtable.*, flathashtable.*
+
+Insert, successful lookup, failed lookup and erase of N addresses in a
+HashTable and a FlatHashTable.
+
+=item vector.*
+
+push_back of N addresses and a scan over them.
+
+=item string.*, straccum.*
+
+Unparsing N addresses to Strings, hashing and comparing them, and
+building a report of N lines in a StringAccum.
+
+=item packet.*
+
+Packet::make and kill of 1500-byte packets, clone, and chains of clones
+each made writable with uniqueify.
+
+=item timer.*
+
+Scheduling N timers at random times, rescheduling them, and unscheduling
+them, on the TimerSet of the router thread.
+
+=item rwlock.*
+
+Uncontended read and write acquisitions of a ReadWriteLock.
+
+=back
+
+Each benchmark is run for every size in SIZES, ROUNDS times; the best
+round is reported. Results are printed on the standard output, one JSON
+object per line:
+
+  {"bench":"hashtable.insert","n":1000,"ops":1000,"ns_per_op":21.4}
+
+and are also available from the I<results> handler.
+
+Keyword arguments are:
+
+=over 8
+
+=item SIZES
+
+Space-separated sizes. Default is "1000 10000 100000".
+
+=item ROUNDS
+
+Rounds of each benchmark. Default is 5.
+
+=item FILTER
+
+Only run the benchmarks whose name starts with FILTER. Default is all.
+
+=item QUIET
+
+Boolean. If true, do not print the results. Default is false.
+
+=back
+
+=h results read-only
+
+The results, as printed.
+
+=e
+
+  click -q -e 'CoreBench(FILTER hashtable, SIZES "1000 100000"); DriverManager(stop)'
+
+=a HashTableTest, FlatHashTableTest, PacketTest
+*/
+
+class CoreBench : public Element { public:
+
+    CoreBench() CLICK_COLD;
+
+    const char *class_name() const		{ return "CoreBench"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    // one result, ops operations of a benchmark of size n in nsec
+    void report(const char *name, int n, uint64_t ops, uint64_t nsec);
+
+  private:
+
+    Vector<int> _sizes;
+    int _rounds;
+    String _filter;
+    bool _quiet;
+    StringAccum _results;
+
+    bool wanted(const char *name) const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,160 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * flathashtabletest.{cc,hh} -- regression test element for FlatHashTable<K, V>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flathashtabletest.hh"
+#include <click/flathashtable.hh>
+#include <click/hashtable.hh>
+#include <click/etheraddress.hh>
+#include <click/string.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+FlatHashTableTest::FlatHashTableTest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+typedef FlatHashTable<EtherAddress, int> EtherTable;
+
+static EtherAddress
+make_ether(uint32_t i)
+{
+    unsigned char data[6] = { 0x02, 0, (unsigned char) (i >> 24), (unsigned char) (i >> 16),
+			      (unsigned char) (i >> 8), (unsigned char) i };
+    return EtherAddress(data);
+}
+
+// the table and the reference hold the same elements
+static int
+check_same(const EtherTable &t, const HashTable<EtherAddress, int> &ref, ErrorHandler *errh)
+{
+    CHECK(t.size() == (uint32_t) ref.size());
+    HashTable<EtherAddress, int>::size_type n = 0;
+    for (EtherTable::const_iterator it = t.begin(); it.live(); it++, n++) {
+	const int *v = ref.get_pointer(it.key());
+	CHECK(v && *v == it.value());
+    }
+    CHECK(n == ref.size());
+    for (HashTable<EtherAddress, int>::const_iterator it = ref.begin(); it.live(); it++) {
+	const int *v = t.get_pointer(it.key());
+	CHECK(v && *v == it.value());
+    }
+    return 0;
+}
+
+int
+FlatHashTableTest::initialize(ErrorHandler *errh)
+{
+    {
+	FlatHashTable<String, int> h;
+	CHECK(h.empty() && !h.begin().live() && !h.get_pointer("A"));
+	h["A"] = 1;
+	h["B"] = 2;
+	CHECK(h.set("C", 3));
+	CHECK(!h.set("C", 4));
+	CHECK(h.insert("D", 5));
+	CHECK(h.size() == 4);
+	CHECK(h["A"] == 1 && h.get("C") == 4 && *h.findp("D") == 5);
+	CHECK(h.get("E") == 0 && h.count("E") == 0 && h.count("B") == 1);
+	CHECK(h.erase("B") == 1 && h.erase("B") == 0);
+	CHECK(h.remove("A") && !h.remove("A"));
+	CHECK(h.size() == 2 && !h.find("A").live() && h.find("C").live());
+	CHECK(h.find("C").key() == "C" && h.find("C").value() == 4);
+	FlatHashTable<String, int> h2(h);
+	h.clear();
+	CHECK(h.empty() && !h.begin().live());
+	CHECK(h2.size() == 2 && h2["C"] == 4 && h2["D"] == 5);
+	h = h2;
+	CHECK(h.size() == 2 && h["D"] == 5);
+    }
+
+    {
+	FlatHashTable<String, int> h(-1);
+	CHECK(h.get("X") == -1);
+	CHECK(h["X"] == -1);
+	CHECK(h.size() == 1);
+    }
+
+    // random operations against HashTable
+    {
+	EtherTable t;
+	HashTable<EtherAddress, int> ref;
+	uint32_t seed = 1;
+	for (int round = 0; round < 20000; round++) {
+	    seed = seed * 1103515245 + 12345;
+	    uint32_t k = (seed >> 16) % 3000;
+	    EtherAddress e = make_ether(k);
+	    switch ((seed >> 8) % 4) {
+	    case 0:
+	    case 1:
+		t[e] = round;
+		ref[e] = round;
+		break;
+	    case 2:
+		CHECK(t.erase(e) == (uint32_t) ref.erase(e));
+		break;
+	    case 3:
+		CHECK(!t.get_pointer(e) == !ref.get_pointer(e));
+		break;
+	    }
+	    if (round % 1000 == 0 && check_same(t, ref, errh) < 0)
+		return -1;
+	}
+	if (check_same(t, ref, errh) < 0)
+	    return -1;
+
+	// erasing while iterating visits every element once
+	int n = 0, size = t.size();
+	for (EtherTable::iterator it = t.begin(); it.live(); n++) {
+	    if (n % 2) {
+		ref.erase(it.key());
+		it = t.erase(it);
+	    } else
+		it++;
+	}
+	CHECK(n == size);
+	if (check_same(t, ref, errh) < 0)
+	    return -1;
+
+	// erased slots get reused instead of growing the table forever
+	uint32_t capacity = t.capacity();
+	for (int round = 0; round < 100000; round++) {
+	    EtherAddress e = make_ether(1000000 + round);
+	    t[e] = round;
+	    t.erase(e);
+	}
+	CHECK(t.capacity() == capacity);
+	if (check_same(t, ref, errh) < 0)
+	    return -1;
+    }
+
+    // addresses differing only in one byte, as the ones of a vendor
+    {
+	EtherTable t;
+	for (int i = 0; i < 256; i++)
+	    t[make_ether(i << 8)] = i;
+	for (int i = 0; i < 256; i++)
+	    CHECK(t[make_ether(i << 8)] == i);
+	CHECK(t.size() == 256 && t.capacity() <= 1024);
+    }
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+EXPORT_ELEMENT(FlatHashTableTest)
+CLICK_ENDDECLS
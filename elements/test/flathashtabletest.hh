@@ -0,0 +1,34 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLATHASHTABLETEST_HH
+#define CLICK_FLATHASHTABLETEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FlatHashTableTest()
+
+=s test
+
+runs regression tests for FlatHashTable<K, V>
+
+=d
+
+FlatHashTableTest runs FlatHashTable regression tests at initialization
+time. It does not route packets.
+
+*/
+
+class FlatHashTableTest : public Element { public:
+
+    FlatHashTableTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "FlatHashTableTest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,136 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * timerwheeltest.{cc,hh} -- regression test element for TimerWheel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "timerwheeltest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+CLICK_DECLS
+
+TimerWheelTest::TimerWheelTest()
+    : _timer(this), _items(0), _nitems(2000), _tick_msec(10), _errors(0)
+{
+}
+
+TimerWheelTest::~TimerWheelTest()
+{
+}
+
+int
+TimerWheelTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+	.read("ENTRIES", _nitems)
+	.read("TICK", _tick_msec)
+	.complete() < 0)
+	return -1;
+    if (_nitems < 1 || _tick_msec < 1)
+	return errh->error("ENTRIES and TICK must be positive");
+    return 0;
+}
+
+int
+TimerWheelTest::initialize(ErrorHandler *)
+{
+    _wheel.initialize(this, _tick_msec);
+    _items = new Item[_nitems];
+
+    // delays up to past the reach of level 2, and a few past the wheel
+    uint32_t span = _tick_msec << (TimerWheel::LEVEL_BITS * 3);
+    uint32_t last = 0;
+    for (int i = 0; i < _nitems; i++) {
+	Item &it = _items[i];
+	uint32_t delay;
+	if (i % 5 == 0)
+	    delay = click_random(0, _tick_msec * TimerWheel::LEVEL_SIZE);
+	else
+	    delay = click_random(0, span + span / 4);
+	it.test = this;
+	it.fired = 0;
+	it.canceled = (i % 7 == 3);
+	it.again = (i % 11 == 5);
+	it.due = Timestamp::recent_steady() + Timestamp::make_msec(delay);
+	it.entry.assign(fire_hook, &it);
+	_wheel.schedule_after_msec(&it.entry, delay);
+	if (delay > last)
+	    last = delay;
+    }
+    if (_wheel.size() != (uint32_t) _nitems) {
+	click_chatter("%p{element}: size %u, expected %d", this, _wheel.size(), _nitems);
+	_errors++;
+    }
+
+    for (int i = 0; i < _nitems; i++)
+	if (_items[i].canceled)
+	    _items[i].entry.unschedule();
+
+    // rescheduled entries fire a second time up to one level 1 slot later
+    last += 2 * _tick_msec * TimerWheel::LEVEL_SIZE;
+    _timer.initialize(this);
+    _timer.schedule_after_msec(last);
+    return 0;
+}
+
+void
+TimerWheelTest::cleanup(CleanupStage)
+{
+    delete[] _items;
+    _items = 0;
+}
+
+void
+TimerWheelTest::fire_hook(TimerWheelEntry *e, void *user_data)
+{
+    Item *it = static_cast<Item *>(user_data);
+    TimerWheelTest *t = it->test;
+    Timestamp now = Timestamp::recent_steady();
+    it->fired++;
+    if (e->scheduled() || it->canceled || it->fired > (it->again ? 2 : 1)
+	|| now < it->due || now > it->due + Timestamp::make_msec(2 * t->_tick_msec)) {
+	click_chatter("%p{element}: entry %d fired %d at %p{timestamp}, due %p{timestamp}",
+		      t, (int) (it - t->_items), it->fired, &now, &it->due);
+	t->_errors++;
+    }
+    if (it->again && it->fired == 1) {
+	uint32_t delay = click_random(0, t->_tick_msec * TimerWheel::LEVEL_SIZE);
+	it->due = now + Timestamp::make_msec(delay);
+	e->schedule_after_msec(delay);
+    }
+}
+
+void
+TimerWheelTest::run_timer(Timer *)
+{
+    for (int i = 0; i < _nitems; i++) {
+	Item &it = _items[i];
+	int expected = it.canceled ? 0 : (it.again ? 2 : 1);
+	if (it.fired != expected || it.entry.scheduled()) {
+	    click_chatter("%p{element}: entry %d fired %d times, expected %d",
+			  this, i, it.fired, expected);
+	    _errors++;
+	}
+    }
+    if (_wheel.size() != 0) {
+	click_chatter("%p{element}: %u entries left", this, _wheel.size());
+	_errors++;
+    }
+    if (_errors == 0)
+	click_chatter("All tests pass!");
+    router()->please_stop_driver();
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(TimerWheelTest)
@@ -0,0 +1,81 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_TIMERWHEELTEST_HH
+#define CLICK_TIMERWHEELTEST_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/timerwheel.hh>
+CLICK_DECLS
+
+/*
+=c
+
+TimerWheelTest([I<keywords>])
+
+=s test
+
+runs regression tests for TimerWheel
+
+=d
+
+TimerWheelTest schedules ENTRIES timers on a TimerWheel at initialization
+time, with delays spread over all its levels, and cancels or reschedules
+some of them. Every timer must fire once, neither early nor more than a
+tick late. When the last one is due TimerWheelTest prints "All tests
+pass!" or the failures, and stops the driver. Run it with --simtime.
+
+TimerWheelTest does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item ENTRIES
+
+Integer. Number of timers. Default is 2000.
+
+=item TICK
+
+Tick length in milliseconds. Default is 10.
+
+=back
+
+=a TimerTest
+*/
+
+class TimerWheelTest : public Element { public:
+
+    TimerWheelTest() CLICK_COLD;
+    ~TimerWheelTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "TimerWheelTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+
+    void run_timer(Timer *t);
+
+  private:
+
+    struct Item {
+	TimerWheelEntry entry;
+	TimerWheelTest *test;
+	Timestamp due;
+	int fired;
+	bool canceled;
+	bool again;
+    };
+
+    TimerWheel _wheel;
+    Timer _timer;
+    Item *_items;
+    int _nitems;
+    uint32_t _tick_msec;
+    int _errors;
+
+    static void fire_hook(TimerWheelEntry *e, void *user_data);
+
+};
+
+CLICK_ENDDECLS
+#endif
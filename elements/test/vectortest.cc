@@ -19,6 +19,8 @@
 #include <click/config.h>
 #include "vectortest.hh"
 #include <click/vector.hh>
+#include <click/smallvector.hh>
+#include <click/string.hh>
 #include <click/error.hh>
 #if CLICK_USERLEVEL
 # include <sys/time.h>
@@ -62,6 +64,35 @@ VectorTest::initialize(ErrorHandler *errh)
     for (int i = 0; i < 10000; i++)
 	v = v2;
 
+    // SmallVector, inline and spilled
+    SmallVector<int, 3> sv;
+    for (int i = 0; i < 3; i++)
+	sv.push_back(i);
+    CHECK(sv.is_inline() && sv.capacity() == 3);
+    sv.push_back(sv[0]);
+    CHECK(!sv.is_inline() && sv.size() == 4 && sv[3] == 0);
+    SmallVector<int, 3>::iterator si = sv.insert(sv.begin() + 1, 7);
+    CHECK(*si == 7 && sv.size() == 5 && sv[0] == 0 && sv[2] == 1 && sv[4] == 0);
+    sv.erase(sv.begin(), sv.begin() + 2);
+    CHECK(sv.size() == 3 && sv[0] == 1 && sv[1] == 2 && sv[2] == 0);
+    SmallVector<int, 3> sv2(2, 9);
+    sv2.swap(sv);
+    CHECK(sv.size() == 2 && sv[1] == 9 && sv2.size() == 3 && sv2[0] == 1);
+
+    SmallVector<String, 2> ss;
+    ss.push_back("a");
+    ss.push_back("b");
+    ss.push_back(ss[0]);
+    ss.push_front(ss[2]);
+    CHECK(ss.size() == 4 && ss[0] == "a" && ss[1] == "a" && ss[3] == "a");
+    SmallVector<String, 2> ss2(ss);
+    ss2.pop_front();
+    ss2.erase(ss2.begin() + 1);
+    CHECK(ss2.size() == 2 && ss2[0] == "a" && ss2[1] == "a");
+    ss2.resize(1);
+    ss = ss2;
+    CHECK(ss.size() == 1 && ss.back() == "a");
+
     errh->message("All tests pass!");
     return 0;
 }
@@ -15,7 +15,8 @@ runs regression tests for Vector
 
 =d
 
-VectorTest runs Vector regression tests at initialization time. It
+VectorTest runs Vector and SmallVector regression tests at initialization
+time. It
 does not route packets.
 
 */
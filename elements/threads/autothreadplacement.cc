@@ -0,0 +1,394 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * autothreadplacement.{cc,hh} -- element places the elements of each radio
+ * on the CPU serving its interrupts
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "autothreadplacement.hh"
+#include <click/master.hh>
+#include <click/router.hh>
+#include <click/routervisitor.hh>
+#include <click/straccum.hh>
+#include <click/userutils.hh>
+#include <click/error.hh>
+#include <click/args.hh>
+#include <dirent.h>
+#include <stdlib.h>
+CLICK_DECLS
+
+AutoThreadPlacement::AutoThreadPlacement()
+    : _control_thread(0), _offset(0), _sysfs("/sys"), _procfs("/proc"),
+      _next_thread_sched(0)
+{
+}
+
+AutoThreadPlacement::~AutoThreadPlacement()
+{
+}
+
+namespace {
+
+// records the elements next to the first one and goes no further
+class NeighborVisitor : public RouterVisitor { public:
+    NeighborVisitor(Vector<int> &neighbors)
+	: _neighbors(neighbors) {
+    }
+    bool visit(Element *e, bool, int, Element *, int, int) {
+	_neighbors.push_back(e->eindex());
+	return false;
+    }
+    Vector<int> &_neighbors;
+};
+
+String
+read_line(const String &filename)
+{
+    return file_string(filename).trim_space();
+}
+
+// "0-3,8,10-11"
+Vector<int>
+parse_cpulist(const String &str)
+{
+    Vector<int> cpus;
+    String s = str;
+    while (s) {
+	int comma = s.find_left(',');
+	String range = (comma < 0 ? s : s.substring(0, comma));
+	s = (comma < 0 ? String() : s.substring(comma + 1));
+	int dash = range.find_left('-');
+	int first, last;
+	if (dash < 0) {
+	    if (!IntArg().parse(range, first))
+		continue;
+	    last = first;
+	} else if (!IntArg().parse(range.substring(0, dash), first)
+		   || !IntArg().parse(range.substring(dash + 1), last))
+	    continue;
+	for (int cpu = first; cpu <= last; ++cpu)
+	    cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+void
+add_unique(Vector<int> &v, int x)
+{
+    for (int *it = v.begin(); it != v.end(); ++it)
+	if (*it == x)
+	    return;
+    v.push_back(x);
+}
+
+void
+unparse_list(StringAccum &sa, const Vector<int> &v)
+{
+    if (!v.size())
+	sa << '-';
+    for (int i = 0; i < v.size(); ++i)
+	sa << (i ? "," : "") << v[i];
+}
+
+}
+
+int
+AutoThreadPlacement::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String devices, control = "EmpowerLVAPManager EmpowerRegmon EmpowerRXStats ControlSocket Socket";
+    if (Args(conf, this, errh)
+	.read_mp("DEVICES", AnyArg(), devices)
+	.read("OFFSET", _offset)
+	.read("CONTROL", AnyArg(), control)
+	.read("SYSFS", FilenameArg(), _sysfs)
+	.read("PROCFS", FilenameArg(), _procfs)
+	.complete() < 0)
+	return -1;
+
+    Vector<String> words;
+    cp_spacevec(devices, words);
+    if (!words.size())
+	return errh->error("no DEVICES");
+    _pipelines.resize(words.size());
+    for (int i = 0; i < words.size(); ++i) {
+	_pipelines[i]._dev = words[i];
+	_pipelines[i]._thread = 0;
+	_pipelines[i]._reason = REASON_FALLBACK;
+	find_irqs(_pipelines[i]);
+    }
+
+    words.clear();
+    cp_spacevec(control, words);
+    find_pipelines(words);
+    place();
+
+    _next_thread_sched = router()->thread_sched();
+    router()->set_thread_sched(this);
+    return 0;
+}
+
+void
+AutoThreadPlacement::find_irqs(Pipeline &p)
+{
+    String dir = _sysfs + "/class/net/" + p._dev + "/device/";
+    if (DIR *d = opendir((dir + "msi_irqs").c_str())) {
+	while (struct dirent *de = readdir(d)) {
+	    int irq;
+	    if (IntArg().parse(String(de->d_name), irq))
+		p._irqs.push_back(irq);
+	}
+	closedir(d);
+	click_qsort(p._irqs.begin(), p._irqs.size());
+    }
+    int irq;
+    if (!p._irqs.size() && IntArg().parse(read_line(dir + "irq"), irq) && irq > 0)
+	p._irqs.push_back(irq);
+
+    for (int i = 0; i < p._irqs.size(); ++i) {
+	String prefix = _procfs + "/irq/" + String(p._irqs[i]) + "/";
+	String list = read_line(prefix + "effective_affinity_list");
+	if (!list)
+	    list = read_line(prefix + "smp_affinity_list");
+	Vector<int> cpus = parse_cpulist(list);
+	for (int j = 0; j < cpus.size(); ++j)
+	    add_unique(p._irq_cpus, cpus[j]);
+    }
+}
+
+// Grows every pipeline from its device and Paint elements, one hop at a
+// time, so that an element goes to the closest pipeline
+void
+AutoThreadPlacement::find_pipelines(const Vector<String> &control)
+{
+    int n = router()->nelements();
+    _owner.assign(n, UNKNOWN);
+
+    for (int i = 0; i < n; ++i) {
+	Element *e = router()->element(i);
+	String cls = e->class_name();
+	for (int c = 0; c < control.size(); ++c)
+	    if (cls == control[c])
+		_owner[i] = CONTROL;
+	if (_owner[i] == CONTROL)
+	    continue;
+
+	Vector<String> conf;
+	cp_argvec(router()->econfiguration(i), conf);
+	int p = -1;
+	if (cls == "Paint") {
+	    int color;
+	    if (Args(conf).read_mp("COLOR", color).consume() >= 0)
+		p = color;
+	} else if (cls.length() > 6 && cls.substring(-6) == "Device") {
+	    String dev;
+	    if (Args(conf).read_mp("DEVNAME", WordArg(), dev).consume() >= 0)
+		for (int j = 0; j < _pipelines.size(); ++j)
+		    if (_pipelines[j]._dev == dev)
+			p = j;
+	}
+	if (p < 0 || p >= _pipelines.size())
+	    continue;
+	_owner[i] = (_owner[i] == UNKNOWN || _owner[i] == p ? p : SHARED);
+    }
+
+    Vector<int> frontier, next, claim(n, UNKNOWN), neighbors;
+    for (int i = 0; i < n; ++i)
+	if (_owner[i] >= 0)
+	    frontier.push_back(i);
+
+    while (frontier.size()) {
+	next.clear();
+	for (int *it = frontier.begin(); it != frontier.end(); ++it) {
+	    Element *e = router()->element(*it);
+	    neighbors.clear();
+	    NeighborVisitor visitor(neighbors);
+	    router()->visit_downstream(e, -1, &visitor);
+	    router()->visit_upstream(e, -1, &visitor);
+	    for (int *jt = neighbors.begin(); jt != neighbors.end(); ++jt) {
+		if (_owner[*jt] != UNKNOWN)
+		    continue;
+		if (claim[*jt] == UNKNOWN) {
+		    claim[*jt] = _owner[*it];
+		    next.push_back(*jt);
+		} else if (claim[*jt] != _owner[*it])
+		    claim[*jt] = SHARED;
+	    }
+	}
+	frontier.clear();
+	for (int *it = next.begin(); it != next.end(); ++it) {
+	    _owner[*it] = claim[*it];
+	    claim[*it] = UNKNOWN;
+	    if (_owner[*it] >= 0)
+		frontier.push_back(*it);
+	}
+    }
+
+    for (int i = 0; i < n; ++i)
+	if (_owner[i] < 0)
+	    _owner[i] = CONTROL;
+}
+
+// CPUs sharing a cache with cpu, the smallest cache first
+Vector<int>
+AutoThreadPlacement::cache_siblings(int cpu)
+{
+    Vector<int> siblings;
+    for (int level = 1; level <= 4; ++level)
+	for (int index = 0; ; ++index) {
+	    String prefix = _sysfs + "/devices/system/cpu/cpu" + String(cpu)
+		+ "/cache/index" + String(index) + "/";
+	    String l = read_line(prefix + "level");
+	    if (!l)
+		break;
+	    int x;
+	    if (!IntArg().parse(l, x) || x != level
+		|| read_line(prefix + "type") == "Instruction")
+		continue;
+	    Vector<int> cpus = parse_cpulist(read_line(prefix + "shared_cpu_list"));
+	    for (int i = 0; i < cpus.size(); ++i)
+		if (cpus[i] != cpu)
+		    add_unique(siblings, cpus[i]);
+	}
+    return siblings;
+}
+
+bool
+AutoThreadPlacement::same_core(int a, int b)
+{
+    Vector<int> siblings = parse_cpulist(read_line(_sysfs + "/devices/system/cpu/cpu" + String(a) + "/topology/thread_siblings_list"));
+    for (int i = 0; i < siblings.size(); ++i)
+	if (siblings[i] == b)
+	    return true;
+    return a == b;
+}
+
+int
+AutoThreadPlacement::cpu_thread(int cpu) const
+{
+    int thread = cpu - _offset;
+    return thread >= 0 && thread < master()->nthreads() ? thread : -1;
+}
+
+void
+AutoThreadPlacement::place()
+{
+    int nthreads = master()->nthreads();
+    Vector<bool> used(nthreads, false);
+
+    for (int p = 0; p < _pipelines.size(); ++p) {
+	Pipeline &pl = _pipelines[p];
+	int thread = -1;
+	for (int i = 0; i < pl._irq_cpus.size() && thread < 0; ++i) {
+	    int t = cpu_thread(pl._irq_cpus[i]);
+	    if (t >= 0 && !used[t]) {
+		thread = t;
+		pl._reason = REASON_IRQ;
+	    }
+	}
+	for (int i = 0; i < pl._irq_cpus.size() && thread < 0; ++i) {
+	    Vector<int> siblings = cache_siblings(pl._irq_cpus[i]);
+	    for (int j = 0; j < siblings.size() && thread < 0; ++j) {
+		int t = cpu_thread(siblings[j]);
+		if (t >= 0 && !used[t]) {
+		    thread = t;
+		    pl._reason = REASON_CACHE;
+		}
+	    }
+	}
+	for (int t = 0; t < nthreads && thread < 0; ++t)
+	    if (!used[t]) {
+		thread = t;
+		pl._reason = REASON_FALLBACK;
+	    }
+	if (thread < 0) {
+	    thread = p % nthreads;
+	    pl._reason = REASON_FALLBACK;
+	}
+	pl._thread = thread;
+	used[thread] = true;
+    }
+
+    // a free thread, away from the cores of the pipelines if possible
+    _control_thread = -1;
+    for (int t = 0; t < nthreads && _control_thread < 0; ++t) {
+	if (used[t])
+	    continue;
+	bool apart = true;
+	for (int p = 0; p < _pipelines.size() && apart; ++p)
+	    if (same_core(thread_cpu(t), thread_cpu(_pipelines[p]._thread)))
+		apart = false;
+	if (apart)
+	    _control_thread = t;
+    }
+    for (int t = 0; t < nthreads && _control_thread < 0; ++t)
+	if (!used[t])
+	    _control_thread = t;
+    if (_control_thread < 0)
+	_control_thread = 0;
+}
+
+int
+AutoThreadPlacement::initial_home_thread_id(const Element *e)
+{
+    int eidx = e->eindex();
+    if (e->router() == router() && eidx >= 0 && eidx < _owner.size()
+	&& _owner[eidx] >= 0)
+	return _pipelines[_owner[eidx]]._thread;
+    if (_next_thread_sched) {
+	int thread = _next_thread_sched->initial_home_thread_id(e);
+	if (thread != THREAD_UNKNOWN)
+	    return thread;
+    }
+    if (e->router() != router())
+	return THREAD_UNKNOWN;
+    return _control_thread;
+}
+
+String
+AutoThreadPlacement::read_handler(Element *e, void *)
+{
+    static const char * const reasons[] = { "irq", "cache", "fallback" };
+    AutoThreadPlacement *atp = static_cast<AutoThreadPlacement *>(e);
+    Router *r = atp->router();
+    StringAccum sa;
+    for (int p = 0; p < atp->_pipelines.size(); ++p) {
+	const Pipeline &pl = atp->_pipelines[p];
+	sa << p << ' ' << pl._dev << " irqs ";
+	unparse_list(sa, pl._irqs);
+	sa << " irq_cpus ";
+	unparse_list(sa, pl._irq_cpus);
+	sa << " thread " << pl._thread << " cpu " << atp->thread_cpu(pl._thread)
+	   << ' ' << reasons[pl._reason] << " elements";
+	for (int i = 0; i < atp->_owner.size(); ++i)
+	    if (atp->_owner[i] == p)
+		sa << ' ' << r->ename(i);
+	sa << '\n';
+    }
+    sa << "control thread " << atp->_control_thread << " cpu "
+       << atp->thread_cpu(atp->_control_thread) << " elements";
+    for (int i = 0; i < atp->_owner.size(); ++i)
+	if (atp->_owner[i] == CONTROL)
+	    sa << ' ' << r->ename(i);
+    sa << '\n';
+    return sa.take_string();
+}
+
+void
+AutoThreadPlacement::add_handlers()
+{
+    add_read_handler("placement", read_handler);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(AutoThreadPlacement)
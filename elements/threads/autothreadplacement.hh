@@ -0,0 +1,128 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_AUTOTHREADPLACEMENT_HH
+#define CLICK_AUTOTHREADPLACEMENT_HH
+#include <click/element.hh>
+#include <click/standard/threadsched.hh>
+CLICK_DECLS
+
+/*
+=c
+
+AutoThreadPlacement(DEVICES, [I<keywords> OFFSET, CONTROL, SYSFS, PROCFS])
+
+=s threads
+
+places the elements of each radio on the CPU serving its interrupts
+
+=d
+
+Assigns the elements of every radio pipeline to the thread running on the
+CPU that services the interrupts of the radio, and everything else to a
+thread of its own, so that a configuration does not need StaticThreadSched
+lines tied to the hardware.
+
+DEVICES is a space-separated list of network devices; device I is the
+device of the pipeline painted I. The elements of pipeline I are found
+from the device elements naming device I (FromDevice, ToDevice and the
+like) and the Paint elements with color I, by following connections in
+both directions. An element as close to two pipelines is shared, and is
+not followed any further. Elements of the classes listed in CONTROL are
+never part of a pipeline.
+
+The CPU of every device is found from the interrupts of its bus device
+(MSI vectors or the legacy interrupt line) and their affinity. Each
+pipeline goes to the first such CPU not taken by another pipeline; failing
+that, to a free CPU sharing a cache with it, the closest cache first; and
+failing that, to any free thread. All other elements go to the control
+thread: a free thread, on another core than the pipelines if possible,
+unless an earlier thread scheduler such as StaticThreadSched places them.
+
+Thread I is taken to run on CPU I + OFFSET, as with "click --affinity".
+
+Keyword arguments are:
+
+=over 8
+
+=item DEVICES
+
+Space-separated device names, one per pipeline.
+
+=item OFFSET
+
+CPU of thread 0. Default is 0.
+
+=item CONTROL
+
+Space-separated class names whose elements go to the control thread.
+Default is "EmpowerLVAPManager EmpowerRegmon EmpowerRXStats ControlSocket
+Socket".
+
+=item SYSFS, PROCFS
+
+Where sysfs and procfs are mounted. Defaults are /sys and /proc.
+
+=back
+
+=h placement read-only
+
+One line per pipeline: paint ID, device, interrupts, their CPUs, the
+thread and CPU chosen, why (irq, cache or fallback), and the elements;
+then the same for the control thread.
+
+=n
+
+Only available at user level. The interrupts and topology are read once,
+when the router is configured.
+
+=a StaticThreadSched, WorkStealingThreadSched, Paint
+*/
+
+class AutoThreadPlacement : public Element, public ThreadSched { public:
+
+    AutoThreadPlacement() CLICK_COLD;
+    ~AutoThreadPlacement() CLICK_COLD;
+
+    const char *class_name() const	{ return "AutoThreadPlacement"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    int initial_home_thread_id(const Element *e);
+
+  private:
+
+    enum { CONTROL = -1, SHARED = -2, UNKNOWN = -3 };
+    enum { REASON_IRQ, REASON_CACHE, REASON_FALLBACK };
+
+    struct Pipeline {
+	String _dev;
+	Vector<int> _irqs;
+	Vector<int> _irq_cpus;
+	int _thread;
+	int _reason;
+    };
+
+    Vector<Pipeline> _pipelines;
+    // pipeline of every element, or CONTROL
+    Vector<int> _owner;
+    int _control_thread;
+    int _offset;
+    String _sysfs;
+    String _procfs;
+    ThreadSched *_next_thread_sched;
+
+    void find_pipelines(const Vector<String> &);
+    void find_irqs(Pipeline &);
+    void place();
+    Vector<int> cache_siblings(int cpu);
+    bool same_core(int a, int b);
+
+    int thread_cpu(int thread) const	{ return thread + _offset; }
+    int cpu_thread(int cpu) const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
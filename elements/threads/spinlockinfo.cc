@@ -23,6 +23,7 @@
 #include <click/confparse.hh>
 #include <click/nameinfo.hh>
 #include <click/error.hh>
+#include <click/straccum.hh>
 CLICK_DECLS
 
 SpinlockInfo::SpinlockInfo()
@@ -38,12 +39,16 @@ SpinlockInfo::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     if (NameDB *ndb = NameInfo::getdb(NameInfo::T_SPINLOCK, this,
 				      sizeof(Spinlock *), true)) {
+	// reserved so that neither the locks nor the names move
 	_spinlocks.reserve(conf.size());
+	_names.reserve(conf.size());
 	String name;
 	for (int i = 0; i < conf.size(); ++i)
 	    if (cp_string(conf[i], &name)) {
 		_spinlocks.push_back(Spinlock());
+		_names.push_back(name);
 		Spinlock *spinptr = &_spinlocks.back();
+		spinptr->set_name(this, _names.back().c_str());
 		ndb->define(name, &spinptr, sizeof(Spinlock *));
 	    } else
 		errh->error("bad NAME");
@@ -52,5 +57,31 @@ SpinlockInfo::configure(Vector<String> &conf, ErrorHandler *errh)
     return errh->nerrors() ? -1 : 0;
 }
 
+String
+SpinlockInfo::read_stats(Element *e, void *)
+{
+    SpinlockInfo *si = static_cast<SpinlockInfo *>(e);
+    StringAccum sa;
+#if CLICK_LOCK_STATS
+    for (int i = 0; i < si->_spinlocks.size(); ++i) {
+	const LockStats &ls = si->_spinlocks[i].stats();
+	sa << si->_names[i] << " acquisitions " << ls._acquisitions
+	   << " contended " << ls._contended << " spin_cycles " << ls._spin_cycles
+	   << " max_hold_cycles " << ls._max_hold << '\n';
+    }
+#else
+    (void) si;
+#endif
+    return sa.take_string();
+}
+
+void
+SpinlockInfo::add_handlers()
+{
+#if CLICK_LOCK_STATS
+    add_read_handler("stats", read_stats, 0);
+#endif
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(SpinlockInfo)
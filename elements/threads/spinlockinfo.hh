@@ -16,6 +16,12 @@ CLICK_DECLS
  * Lets you use mnemonic names for spinlocks. Each name names a spinlock that
  * the SpinlockAcquire and SpinlockRelease elements can use to reference a
  * spinlock.
+ *
+ * =h stats read-only
+ * One line per spinlock: name, acquisitions, acquisitions that had to spin,
+ * cycles spent spinning and longest hold, in cycles. Only present if Click
+ * was configured with --enable-lock-stats; the global "lock_stats" handler
+ * reports every other lock.
  * =a SpinlockAcquire, SpinlockRelease
  */
 
@@ -27,10 +33,14 @@ class SpinlockInfo : public Element { public:
     const char *class_name() const	{ return "SpinlockInfo"; }
     int configure_phase() const		{ return CONFIGURE_PHASE_INFO; }
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
 
   private:
 
     Vector<Spinlock> _spinlocks;
+    Vector<String> _names;
+
+    static String read_stats(Element *, void *);
 
 };
 
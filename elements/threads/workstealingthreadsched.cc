@@ -0,0 +1,156 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * workstealingthreadsched.{cc,hh} -- element moves tasks from busy threads
+ * to idle ones on demand
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "workstealingthreadsched.hh"
+#include <click/task.hh>
+#include <click/master.hh>
+#include <click/routerthread.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/error.hh>
+#include <click/args.hh>
+CLICK_DECLS
+
+WorkStealingThreadSched::WorkStealingThreadSched()
+    : _active(true), _next_thread_sched(0)
+{
+}
+
+WorkStealingThreadSched::~WorkStealingThreadSched()
+{
+}
+
+int
+WorkStealingThreadSched::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String pin;
+    if (Args(conf, this, errh)
+	.read("PIN", AnyArg(), pin)
+	.read("ACTIVE", _active)
+	.complete() < 0)
+	return -1;
+
+    _pinned.assign(router()->nelements(), false);
+    Vector<String> words;
+    cp_spacevec(pin, words);
+    for (String *it = words.begin(); it != words.end(); ++it)
+	if (Element *e = router()->find(*it, this))
+	    _pinned[e->eindex()] = true;
+	else
+	    return errh->error("%<%s%> does not name an element", it->c_str());
+
+    _next_thread_sched = router()->thread_sched();
+    router()->set_thread_sched(this);
+    return 0;
+}
+
+int
+WorkStealingThreadSched::initialize(ErrorHandler *errh)
+{
+    if (master()->nthreads() < 2)
+	errh->warning("only one thread, nothing to steal");
+    set_active(_active);
+    return 0;
+}
+
+void
+WorkStealingThreadSched::cleanup(CleanupStage)
+{
+    for (int i = 0; i < master()->nthreads(); ++i)
+	if (master()->thread(i)->work_stealing() == this)
+	    master()->thread(i)->set_work_stealing(0);
+}
+
+void
+WorkStealingThreadSched::set_active(bool active)
+{
+    _active = active;
+    for (int i = 0; i < master()->nthreads(); ++i)
+	master()->thread(i)->set_work_stealing(active ? this : 0);
+}
+
+int
+WorkStealingThreadSched::initial_home_thread_id(const Element *e)
+{
+    if (_next_thread_sched)
+	return _next_thread_sched->initial_home_thread_id(e);
+    else
+	return THREAD_UNKNOWN;
+}
+
+bool
+WorkStealingThreadSched::task_stealable(const Task *task)
+{
+    if (!ThreadSched::task_stealable(task))
+	return false;
+    Element *e = task->element();
+    return !e || e->router() != router() || !_pinned[e->eindex()];
+}
+
+enum { h_active, h_given, h_reset };
+
+String
+WorkStealingThreadSched::read_handler(Element *e, void *user_data)
+{
+    WorkStealingThreadSched *ws = static_cast<WorkStealingThreadSched *>(e);
+    switch (reinterpret_cast<intptr_t>(user_data)) {
+    case h_active:
+	return String(ws->_active);
+    case h_given: {
+	StringAccum sa;
+	for (int i = 0; i < ws->master()->nthreads(); ++i)
+	    sa << i << ' ' << ws->master()->thread(i)->tasks_given() << '\n';
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+int
+WorkStealingThreadSched::write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh)
+{
+    WorkStealingThreadSched *ws = static_cast<WorkStealingThreadSched *>(e);
+    switch (reinterpret_cast<intptr_t>(user_data)) {
+    case h_active: {
+	bool active;
+	if (!BoolArg().parse(str, active))
+	    return errh->error("syntax error");
+	ws->set_active(active);
+	return 0;
+    }
+    case h_reset:
+	for (int i = 0; i < ws->master()->nthreads(); ++i)
+	    ws->master()->thread(i)->clear_tasks_given();
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+WorkStealingThreadSched::add_handlers()
+{
+    add_read_handler("active", read_handler, h_active, Handler::CHECKBOX);
+    add_write_handler("active", write_handler, h_active);
+    add_read_handler("given", read_handler, h_given);
+    add_write_handler("reset", write_handler, h_reset, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(multithread)
+EXPORT_ELEMENT(WorkStealingThreadSched)
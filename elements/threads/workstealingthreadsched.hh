@@ -0,0 +1,99 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_WORKSTEALINGTHREADSCHED_HH
+#define CLICK_WORKSTEALINGTHREADSCHED_HH
+#include <click/element.hh>
+#include <click/bitvector.hh>
+#include <click/standard/threadsched.hh>
+CLICK_DECLS
+
+/*
+=c
+
+WorkStealingThreadSched([I<keywords> PIN, ACTIVE])
+
+=s threads
+
+moves tasks from busy threads to idle ones
+
+=d
+
+Balances tasks over the router's threads on demand. A thread that runs
+out of scheduled tasks asks a thread that has several for one; the busy
+thread answers at its next scheduling round by moving its most expensive
+task, as measured by the task's cycle count, to the idle thread. Tasks are
+only ever moved by the thread that runs them, and a thread always keeps at
+least one task, so tasks do not bounce between threads.
+
+Unlike BalancedThreadSched, which repacks all tasks at a fixed interval,
+WorkStealingThreadSched costs nothing while every thread has work.
+
+Initial placement is left to other thread schedulers, such as
+StaticThreadSched. Tasks whose element keeps per-thread state must not
+move: name their elements in PIN, or have the element call
+Task::set_pinned.
+
+Keyword arguments are:
+
+=over 8
+
+=item PIN
+
+Space-separated list of elements whose tasks are never stolen.
+
+=item ACTIVE
+
+Boolean. If false, no task is stolen until the I<active> handler is set.
+Default is true.
+
+=back
+
+=h active read/write
+
+Whether work stealing is on.
+
+=h given read-only
+
+One line per thread: the thread ID and the number of tasks it gave away.
+
+=h reset write-only
+
+Resets the I<given> counts.
+
+=n
+
+Only available in multithreaded drivers (click -j).
+
+=a StaticThreadSched, BalancedThreadSched, ThreadMonitor
+*/
+
+class WorkStealingThreadSched : public Element, public ThreadSched { public:
+
+    WorkStealingThreadSched() CLICK_COLD;
+    ~WorkStealingThreadSched() CLICK_COLD;
+
+    const char *class_name() const	{ return "WorkStealingThreadSched"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    int initial_home_thread_id(const Element *e);
+    bool task_stealable(const Task *task);
+
+  private:
+
+    Bitvector _pinned;
+    bool _active;
+    ThreadSched *_next_thread_sched;
+
+    void set_active(bool active);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *,
+			     ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
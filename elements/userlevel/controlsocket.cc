@@ -33,7 +33,7 @@
 #include <fcntl.h>
 CLICK_DECLS
 
-const char ControlSocket::protocol_version[] = "1.3";
+const char ControlSocket::protocol_version[] = "1.5";
 
 class ControlSocketErrorHandler : public ErrorHandler { public:
 
@@ -83,12 +83,18 @@ ControlSocketErrorHandler::account(int level)
 
 
 ControlSocket::ControlSocket()
-  : _socket_fd(-1), _proxy(0), _full_proxy(0), _retry_timer(0)
+  : _socket_fd(-1), _proxy(0), _full_proxy(0),
+    _worker_running(false), _worker_stop(false), _retry_timer(0)
 {
+    _wake_fd[0] = _wake_fd[1] = -1;
+    pthread_mutex_init(&_jobs_lock, 0);
+    pthread_cond_init(&_jobs_cond, 0);
 }
 
 ControlSocket::~ControlSocket()
 {
+    pthread_cond_destroy(&_jobs_cond);
+    pthread_mutex_destroy(&_jobs_lock);
 }
 
 int
@@ -101,6 +107,7 @@ ControlSocket::configure(Vector<String> &conf, ErrorHandler *errh)
 
     // remove keyword arguments
     bool read_only = false, verbose = false, retry_warnings = true, localhost = false;
+    bool handler_thread = false;
     _retries = 0;
     if (args.read("READONLY", read_only)
 	.read("PROXY", _proxy)
@@ -108,12 +115,18 @@ ControlSocket::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("RETRIES", _retries)
 	.read("RETRY_WARNINGS", retry_warnings)
 	.read("LOCALHOST", localhost)
+	.read("HANDLER_THREAD", handler_thread)
 	.consume() < 0)
 	return -1;
     _read_only = read_only;
     _verbose = verbose;
     _retry_warnings = retry_warnings;
     _localhost = localhost;
+    _handler_thread = handler_thread;
+#if !HAVE_MULTITHREAD
+    if (handler_thread)
+	return errh->error("HANDLER_THREAD requires multithreading support");
+#endif
 
     socktype = socktype.upper();
     if (socktype == "TCP") {
@@ -264,6 +277,10 @@ ControlSocket::initialize(ErrorHandler *errh)
   if (_full_proxy)
     _full_proxy->add_error_receiver(proxy_error_function, this);
 
+  // proxied handlers are always called on the router thread
+  if (_handler_thread && !_proxy && start_handler_thread(errh) < 0)
+    return -1;
+
   if (initialize_socket(errh) >= 0)
     return 0;
   else if (_retries >= 0) {
@@ -297,6 +314,11 @@ ControlSocket::take_state(Element *e, ErrorHandler *errh)
 	return;
     }
 
+    // answer the commands the old handler thread has, the connections
+    // move over without them
+    cs->stop_handler_thread();
+    cs->finish_jobs(true);
+
     _socket_fd = cs->_socket_fd;
     _unix_pathname = cs->_unix_pathname; // in case _unix_pathname == "41930+"
     cs->_socket_fd = -1;
@@ -305,6 +327,11 @@ ControlSocket::take_state(Element *e, ErrorHandler *errh)
     if (_socket_fd >= 0)
 	add_select(_socket_fd, SELECT_READ);
     for (connection **it = _conns.begin(); it != _conns.end(); ++it) {
+	// the handler belongs to the old router
+	if (*it && (*it)->stream_h) {
+	    (*it)->stream_h = 0;
+	    (*it)->message(CSERR_UNSPECIFIED, "Read handler '" + (*it)->stream_name + "' interrupted by hotswap");
+	}
 	if (*it && !(*it)->in_closed)
 	    add_select((*it)->fd, SELECT_READ);
 	if (*it && !(*it)->out_closed)
@@ -317,6 +344,13 @@ ControlSocket::cleanup(CleanupStage)
 {
     if (_full_proxy)
 	_full_proxy->remove_error_receiver(proxy_error_function, this);
+    stop_handler_thread();
+    finish_jobs(false);
+    for (handler_job **it = _jobs.begin(); it != _jobs.end(); ++it) {
+	delete (*it)->errh;
+	delete *it;
+    }
+    _jobs.clear();
     if (_socket_fd >= 0) {
 	// shut down the listening socket in case we forked
 #ifdef SHUT_RDWR
@@ -509,7 +543,7 @@ ControlSocket::parse_handler(connection &conn, const String &full_name, Element
 }
 
 int
-ControlSocket::read_command(connection &conn, const String &handlername, String param)
+ControlSocket::read_command(connection &conn, const String &handlername, String param, bool may_defer)
 {
   Element *e;
   const Handler* h = parse_handler(conn, handlername, &e);
@@ -518,6 +552,23 @@ ControlSocket::read_command(connection &conn, const String &handlername, String
   else if (!h->read_visible())
     return conn.message(CSERR_PERMISSION, "Handler '" + handlername + "' write-only");
 
+  // hand nonexclusive handlers to the handler thread, finish_job() answers
+  if (may_defer && _worker_running && h->allow_concurrent_threads()) {
+    handler_job *job = new handler_job;
+    job->conn = &conn;
+    job->h = h;
+    job->e = e;
+    job->handlername = handlername;
+    job->param = param;
+    job->errh = new ControlSocketErrorHandler;
+    conn.pending = true;
+    pthread_mutex_lock(&_jobs_lock);
+    _jobs.push_back(job);
+    pthread_cond_signal(&_jobs_cond);
+    pthread_mutex_unlock(&_jobs_lock);
+    return 0;
+  }
+
   // collect errors from proxy
   ControlSocketErrorHandler errh;
   _proxied_handler = h->name();
@@ -534,6 +585,108 @@ ControlSocket::read_command(connection &conn, const String &handlername, String
   return 0;
 }
 
+int
+ControlSocket::read_many_command(connection &conn, const Vector<String> &words)
+{
+  bool binary = words.size() > 1 && words[1].upper() == "-B";
+  int first = binary ? 2 : 1;
+  if (words.size() <= first)
+    return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+
+  StringAccum records;
+  for (int i = first; i < words.size(); i++) {
+    // run READ, then move its response from the connection to a record
+    int mark = conn.out_text.length();
+    int r = read_command(conn, words[i], String());
+    const char *begin = conn.out_text.begin() + mark, *end = conn.out_text.end();
+    int code = r >= 0 ? CSERR_OK : CSERR_UNSPECIFIED;
+    if (r >= 0) {
+      // skip the message line and the DATA line
+      for (int lines = 0; lines < 2 && begin != end; begin++)
+	if (*begin == '\n')
+	  lines++;
+    } else if (end - begin >= 3)
+      code = (begin[0] - '0') * 100 + (begin[1] - '0') * 10 + (begin[2] - '0');
+    String name = words[i];
+    if (binary) {
+      uint32_t header[3] = { htonl(code), htonl(name.length()), htonl(end - begin) };
+      records.append((const char *) header, sizeof(header));
+      records << name;
+    } else
+      records << code << ' ' << (end - begin) << ' ' << name << '\r' << '\n';
+    records.append(begin, end);
+    conn.out_text.resize(mark);
+  }
+
+  conn.message(CSERR_OK, "Read " + String(words.size() - first) + " handlers OK");
+  conn.out_text << "DATA " << records.length() << '\r' << '\n' << records;
+  return 0;
+}
+
+int
+ControlSocket::read_stream_command(connection &conn, const String &handlername)
+{
+  Element *e;
+  const Handler* h = parse_handler(conn, handlername, &e);
+  if (!h)
+    return ANY_ERR;
+  else if (!h->read_visible())
+    return conn.message(CSERR_PERMISSION, "Handler '" + handlername + "' write-only");
+
+  // the first chunk comes now, so that errors get the usual response
+  ControlSocketErrorHandler errh;
+  _proxied_handler = h->name();
+  _proxied_errh = &errh;
+  String chunk;
+  int cursor = h->call_read_chunk(e, 0, chunk, &errh);
+  _proxied_errh = 0;
+
+  if (cursor < 0 || errh.nerrors() > 0)
+    return conn.transfer_messages(CSERR_UNSPECIFIED, "Read handler '" + handlername + "' error", &errh);
+
+  conn.message(CSERR_OK, "Read handler '" + handlername + "' OK");
+  if (chunk.length())
+    conn.out_text << "DATA " << chunk.length() << '\r' << '\n' << chunk;
+  if (cursor > 0) {
+    // continue_stream() goes on from selected()
+    conn.stream_h = h;
+    conn.stream_e = e;
+    conn.stream_cursor = cursor;
+    conn.stream_name = handlername;
+  } else
+    conn.out_text << "DATA 0" << '\r' << '\n';
+  return 0;
+}
+
+void
+ControlSocket::continue_stream(connection *conn)
+{
+  // one chunk per call, once most of the previous ones went out
+  if (conn->out_closed || conn->out_text.length() - conn->outpos >= STREAM_BUFFER)
+    return;
+
+  ControlSocketErrorHandler errh;
+  _proxied_handler = conn->stream_h->name();
+  _proxied_errh = &errh;
+  String chunk;
+  int cursor = conn->stream_h->call_read_chunk(conn->stream_e, conn->stream_cursor, chunk, &errh);
+  _proxied_errh = 0;
+
+  if (cursor < 0 || errh.nerrors() > 0) {
+    conn->stream_h = 0;
+    conn->transfer_messages(CSERR_UNSPECIFIED, "Read handler '" + conn->stream_name + "' error", &errh);
+    return;
+  }
+
+  if (chunk.length())
+    conn->out_text << "DATA " << chunk.length() << '\r' << '\n' << chunk;
+  conn->stream_cursor = cursor;
+  if (!cursor) {
+    conn->stream_h = 0;
+    conn->out_text << "DATA 0" << '\r' << '\n';
+  }
+}
+
 int
 ControlSocket::write_command(connection &conn, const String &handlername, String data)
 {
@@ -705,7 +858,7 @@ ControlSocket::parse_command(connection &conn, const String &line)
       if (words.size() > 2)
 	  data = line.substring(words[2].begin(), words.back().end());
       if (command[0] == 'R' || command[0] == 'G')
-	  return read_command(conn, words[1], data);
+	  return read_command(conn, words[1], data, true);
       else
 	  return write_command(conn, words[1], data);
 
@@ -720,7 +873,7 @@ ControlSocket::parse_command(connection &conn, const String &line)
       if ((r = conn.read(datalen, data)) != 0)
 	  return r;
       if (command[0] == 'R')
-	  return read_command(conn, words[1], data);
+	  return read_command(conn, words[1], data, true);
       else
 	  return write_command(conn, words[1], data);
 
@@ -750,10 +903,18 @@ ControlSocket::parse_command(connection &conn, const String &line)
       String data(conn.in_text.begin() + conn.inpos, linebegin);
       conn.inpos = s - conn.in_text.begin();
       if (command[0] == 'R')
-	  return read_command(conn, words[1], data);
+	  return read_command(conn, words[1], data, true);
       else
 	  return write_command(conn, words[1], data);
 
+  } else if (command == "READMANY") {
+      return read_many_command(conn, words);
+
+  } else if (command == "READSTREAM") {
+      if (words.size() != 2)
+	  return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+      return read_stream_command(conn, words[1]);
+
   } else if (command == "CHECKREAD" || command == "CHECKWRITE") {
       if (words.size() != 2)
 	  return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
@@ -784,6 +945,8 @@ ControlSocket::parse_command(connection &conn, const String &line)
     conn.message(CSERR_OK, "READ handler [arg...]   call read handler, return DATA", true);
     conn.message(CSERR_OK, "READDATA handler len    call read handler with len data bytes, return DATA", true);
     conn.message(CSERR_OK, "READUNTIL handler term  call read handler, take data until term, return DATA", true);
+    conn.message(CSERR_OK, "READMANY [-B] handler.. call read handlers, return all their DATA at once", true);
+    conn.message(CSERR_OK, "READSTREAM handler      call read handler, return DATA in pieces", true);
     conn.message(CSERR_OK, "WRITE handler [arg...]  call write handler", true);
     conn.message(CSERR_OK, "WRITEDATA handler len   call write handler, pass len data bytes", true);
     conn.message(CSERR_OK, "WRITEUNTIL handler term call write handler, take data until term", true);
@@ -809,6 +972,131 @@ ControlSocket::initialize_connection(int fd)
     _conns[fd]->out_text << "Click::ControlSocket/" << protocol_version << '\r' << '\n';
 }
 
+void
+ControlSocket::maybe_close(connection *conn)
+{
+    // the handler thread still refers to a pending connection
+    if (conn->pending)
+	return;
+    if ((conn->in_closed && !conn->stream_h && !conn->in_text.length() && !conn->out_text.length())
+	|| conn->out_closed) {
+	remove_select(conn->fd, SELECT_READ | SELECT_WRITE);
+	close(conn->fd);
+	if (_verbose)
+	    click_chatter("%s: closed connection %d", declaration().c_str(), conn->fd);
+	_conns[conn->fd] = 0;
+	delete conn;
+    }
+}
+
+int
+ControlSocket::start_handler_thread(ErrorHandler *errh)
+{
+    if (pipe(_wake_fd) < 0)
+	return errh->error("pipe: %s", strerror(errno));
+    for (int i = 0; i < 2; i++) {
+	fcntl(_wake_fd[i], F_SETFL, O_NONBLOCK);
+	fcntl(_wake_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+    _worker_stop = false;
+    if (int r = pthread_create(&_worker, 0, handler_thread, this)) {
+	close(_wake_fd[0]);
+	close(_wake_fd[1]);
+	_wake_fd[0] = _wake_fd[1] = -1;
+	return errh->error("pthread_create: %s", strerror(r));
+    }
+    _worker_running = true;
+    add_select(_wake_fd[0], SELECT_READ);
+    return 0;
+}
+
+void
+ControlSocket::stop_handler_thread()
+{
+    if (!_worker_running)
+	return;
+    pthread_mutex_lock(&_jobs_lock);
+    _worker_stop = true;
+    pthread_cond_signal(&_jobs_cond);
+    pthread_mutex_unlock(&_jobs_lock);
+    pthread_join(_worker, 0);
+    _worker_running = false;
+    remove_select(_wake_fd[0], SELECT_READ);
+    close(_wake_fd[0]);
+    close(_wake_fd[1]);
+    _wake_fd[0] = _wake_fd[1] = -1;
+}
+
+void *
+ControlSocket::handler_thread(void *thunk)
+{
+    ControlSocket *cs = static_cast<ControlSocket *>(thunk);
+#if HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+    // an ID of its own, past those of the router threads, for the
+    // structures that keep per-thread state; never a RouterThread's
+    click_current_thread_id = click_nthreads;
+#endif
+    pthread_mutex_lock(&cs->_jobs_lock);
+    while (!cs->_worker_stop) {
+	if (!cs->_jobs.size()) {
+	    pthread_cond_wait(&cs->_jobs_cond, &cs->_jobs_lock);
+	    continue;
+	}
+	handler_job *job = cs->_jobs.front();
+	cs->_jobs.pop_front();
+	pthread_mutex_unlock(&cs->_jobs_lock);
+
+	job->data = job->h->call_read(job->e, job->param, job->errh);
+
+	pthread_mutex_lock(&cs->_jobs_lock);
+	cs->_done.push_back(job);
+	// if the pipe is full, selected() has a wakeup to read already
+	ssize_t w = write(cs->_wake_fd[1], "", 1);
+	(void) w;
+    }
+    pthread_mutex_unlock(&cs->_jobs_lock);
+    return 0;
+}
+
+void
+ControlSocket::finish_jobs(bool run_waiting)
+{
+    Vector<handler_job *> done, waiting;
+    pthread_mutex_lock(&_jobs_lock);
+    done.swap(_done);
+    if (run_waiting)
+	waiting.swap(_jobs);
+    pthread_mutex_unlock(&_jobs_lock);
+
+    // only once the handler thread has stopped
+    for (handler_job **it = waiting.begin(); it != waiting.end(); ++it) {
+	(*it)->data = (*it)->h->call_read((*it)->e, (*it)->param, (*it)->errh);
+	done.push_back(*it);
+    }
+
+    for (handler_job **it = done.begin(); it != done.end(); ++it)
+	finish_job(*it);
+}
+
+void
+ControlSocket::finish_job(handler_job *job)
+{
+    connection *conn = job->conn;
+    if (job->errh->nerrors() > 0)
+	conn->transfer_messages(CSERR_UNSPECIFIED, "Read handler '" + job->handlername + "' error", job->errh);
+    else {
+	conn->message(CSERR_OK, "Read handler '" + job->handlername + "' OK");
+	conn->out_text << "DATA " << job->data.length() << '\r' << '\n' << job->data;
+    }
+    delete job->errh;
+    delete job;
+
+    // go on with the commands that came in meanwhile
+    conn->pending = false;
+    conn->flush_write(this, conn->in_text.length());
+    maybe_close(conn);
+}
+
 void
 ControlSocket::selected(int fd, int)
 {
@@ -837,6 +1125,12 @@ ControlSocket::selected(int fd, int)
 
 	initialize_connection(new_fd);
 	fd = new_fd;
+    } else if (fd == _wake_fd[0]) {
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0)
+	    /* nada */;
+	finish_jobs(false);
+	return;
     }
 
     // find file descriptor
@@ -856,8 +1150,8 @@ ControlSocket::selected(int fd, int)
 
     // parse commands
     // 16.Jun.2004: process only one command each time through
-    bool blocked = false;
-    if (conn->in_text.length()) {
+    bool blocked = conn->pending || conn->stream_h;
+    if (conn->in_text.length() && !blocked) {
 	const char *in_text = conn->in_text.begin() + conn->inpos;
 	const char *in_end = conn->in_text.end();
 	const char *line_end = in_text;
@@ -892,18 +1186,15 @@ ControlSocket::selected(int fd, int)
     // write data until blocked
     // The 2nd argument causes write events to remain selected when commands
     // remain to be processed (whether or not CS has data to write).
-    conn->flush_write(this, conn->in_text.length() && !blocked);
+    if (conn->stream_h)
+	continue_stream(conn);
 
-    // maybe close out
-    if ((conn->in_closed && !conn->in_text.length() && !conn->out_text.length())
-	|| conn->out_closed) {
-	remove_select(conn->fd, SELECT_READ | SELECT_WRITE);
-	close(conn->fd);
-	if (_verbose)
-	    click_chatter("%s: closed connection %d", declaration().c_str(), fd);
-	_conns[conn->fd] = 0;
-	delete conn;
-    }
+    // A pending connection resumes from finish_job(). A stream keeps
+    // writes selected until it ends.
+    conn->flush_write(this, (conn->in_text.length() && !blocked && !conn->pending)
+		      || conn->stream_h);
+
+    maybe_close(conn);
 }
 
 ErrorHandler *
@@ -2,6 +2,7 @@
 #define CLICK_CONTROLSOCKET_HH
 #include "elements/userlevel/handlerproxy.hh"
 #include <click/straccum.hh>
+#include <pthread.h>
 CLICK_DECLS
 class ControlSocketErrorHandler;
 class Timer;
@@ -10,7 +11,7 @@ class Handler;
 /*
 =c
 
-ControlSocket("TCP", PORTNUMBER [, I<keywords READONLY, PROXY, VERBOSE, LOCALHOST, RETRIES, RETRY_WARNINGS>])
+ControlSocket("TCP", PORTNUMBER [, I<keywords READONLY, PROXY, VERBOSE, LOCALHOST, RETRIES, RETRY_WARNINGS, HANDLER_THREAD>])
 ControlSocket("UNIX", FILENAME [, I<keywords>])
 
 =s control
@@ -39,8 +40,8 @@ The server will accept lines terminated by CR, LF, or CRLF. Its response
 lines are always terminated by CRLF.
 
 When a connection is opened, the server responds by stating its protocol
-version number with a line like "Click::ControlSocket/1.3". The current
-version number is 1.3. Changes in minor version number will only add commands
+version number with a line like "Click::ControlSocket/1.5". The current
+version number is 1.5. Changes in minor version number will only add commands
 and functionality to this specification, not change existing functionality.
 
 ControlSocket supports hot-swapping, meaning you can change configurations
@@ -88,6 +89,13 @@ Boolean. If true, ControlSocket will print warning messages every time it
 fails to open a socket. If false, it will print messages only on the final
 failure. Default is true.
 
+=item HANDLER_THREAD
+
+Boolean. If true, ControlSocket calls nonexclusive read handlers on a thread
+of its own, so that handlers building large results, such as statistics
+tables, do not hold up the router thread. See below. Requires a Click built
+with multithreading support. Default is false.
+
 =back
 
 The PORT argument for TCP ControlSockets can also be an integer followed by a
@@ -96,6 +104,16 @@ ControlSocket should bind on some port I<greater than or equal to> PORT.  If
 PORT itself is in use, ControlSocket will try several nearby ports before
 giving up.  This can be useful in tests.
 
+With HANDLER_THREAD, the READ, READDATA and READUNTIL commands call a read
+handler flagged Handler::h_nonexclusive on the handler thread, while the
+router thread goes on. Elements set that flag on the handlers that can run
+concurrently with the router threads: the handlers reading data that is
+written under a lock or a SeqLock, or kept in a snapshot. Other handlers,
+READMANY, write handlers, and every handler reached through PROXY, are
+called on the router thread as usual. A connection's commands are still
+answered in order; the commands of other connections are not held up by a
+handler running on the handler thread.
+
 =head1 SERVER COMMANDS
 
 Many server commands
@@ -136,6 +154,32 @@ for a terminator, ControlSocket removes trailing spaces from both
 I<terminator> and the input lines. Introduced in version 1.3 of the
 ControlSocket protocol.
 
+=item READMANY [-B] I<handler...>
+
+Call each read I<handler>, with no arguments, and return all the results at
+once with "DATA I<n>" as in the READ command. The I<n> bytes hold one
+record per I<handler>, in order. A record starts with a line
+"I<code> I<length> I<handler>", terminated by CRLF, followed by I<length>
+bytes: the handler's results if I<code> is 200, the error messages
+otherwise. With -B, a record is instead the code, the length of the name,
+the length of the results, each as a 4-byte integer in network byte order,
+then the name and the results. The command itself fails only on a syntax
+error. Introduced in version 1.4 of the ControlSocket protocol.
+
+=item READSTREAM I<handler>
+
+Call a read I<handler>, with no arguments, and return its results in
+pieces. On success, responds with a "success" message followed by any
+number of "DATA I<n>" lines, each followed by I<n> bytes of results, and
+finally by a "DATA 0" line. The results are the concatenation of the
+pieces. A handler that fails halfway ends the pieces with an error message
+instead of "DATA 0". Handlers flagged Handler::f_read_chunked produce
+their results a chunk at a time, and ControlSocket calls them for the next
+chunk only once it has sent most of the previous ones, so that it never
+holds all of a large value at once; other handlers send a single piece.
+READ also works on chunked handlers, but builds their whole value first.
+Introduced in version 1.5 of the ControlSocket protocol.
+
 =item WRITE I<handler> I<params...>
 
 Call a write I<handler>, passing the I<params>, if any, as arguments.
@@ -263,6 +307,7 @@ class ControlSocket : public Element { public:
     bool _verbose : 1;
     bool _retry_warnings : 1;
     bool _localhost : 1;
+    bool _handler_thread : 1;
     uint8_t _type;
     Element *_proxy;
     HandlerProxy *_full_proxy;
@@ -275,9 +320,15 @@ class ControlSocket : public Element { public:
 	int outpos;
 	bool in_closed;
 	bool out_closed;
+	bool pending;		// a handler runs on the handler thread
+	const Handler *stream_h; // READSTREAM in progress
+	Element *stream_e;
+	int stream_cursor;
+	String stream_name;
 	connection(int fd_)
 	    : fd(fd_), inpos(0), outpos(0),
-	      in_closed(false), out_closed(false) {
+	      in_closed(false), out_closed(false), pending(false),
+	      stream_h(0), stream_e(0), stream_cursor(0) {
 	}
 	int message(int code, const String &msg, bool continuation = false);
 	int transfer_messages(int default_code, const String &msg, ControlSocketErrorHandler *);
@@ -288,6 +339,27 @@ class ControlSocket : public Element { public:
     };
     Vector<connection *> _conns;
 
+    // A read handler call for the handler thread. data and errh are
+    // filled in there, the rest by the router thread.
+    struct handler_job {
+	connection *conn;
+	const Handler *h;
+	Element *e;
+	String handlername;
+	String param;
+	String data;
+	ControlSocketErrorHandler *errh;
+    };
+
+    pthread_t _worker;
+    bool _worker_running;
+    bool _worker_stop;
+    pthread_mutex_t _jobs_lock;
+    pthread_cond_t _jobs_cond;
+    Vector<handler_job *> _jobs;	// waiting for the handler thread
+    Vector<handler_job *> _done;	// waiting for the router thread
+    int _wake_fd[2];		// the handler thread wakes selected() up
+
     String _proxied_handler;
     ErrorHandler *_proxied_errh;
 
@@ -296,16 +368,29 @@ class ControlSocket : public Element { public:
 
     enum { READ_CLOSED = 1, WRITE_CLOSED = 2, ANY_ERR = -1 };
 
+    // READSTREAM calls for the next chunk below this much unsent output
+    enum { STREAM_BUFFER = 65536 };
+
     static const char protocol_version[];
 
     int initialize_socket_error(ErrorHandler *, const char *);
     int initialize_socket(ErrorHandler *);
     static void retry_hook(Timer *, void *);
     void initialize_connection(int fd);
+    void maybe_close(connection *conn);
+
+    int start_handler_thread(ErrorHandler *);
+    void stop_handler_thread();
+    static void *handler_thread(void *);
+    void finish_jobs(bool run_waiting);
+    void finish_job(handler_job *job);
 
     String proxied_handler_name(const String &) const;
     const Handler* parse_handler(connection &conn, const String &, Element **);
-    int read_command(connection &conn, const String &, String);
+    int read_command(connection &conn, const String &, String, bool may_defer = false);
+    int read_many_command(connection &conn, const Vector<String> &words);
+    int read_stream_command(connection &conn, const String &);
+    void continue_stream(connection *conn);
     int write_command(connection &conn, const String &, String);
     int check_command(connection &conn, const String &, bool write);
     int llrpc_command(connection &conn, const String &, String);
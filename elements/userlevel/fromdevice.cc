@@ -50,18 +50,36 @@
 # include <net/if.h>
 # include <features.h>
 # include <linux/if_packet.h>
+# include <linux/net_tstamp.h>
+# include <linux/errqueue.h>
+# include <linux/sockios.h>
 # include <net/ethernet.h>
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+# include <net/if_arp.h>
+# include <sys/mman.h>
+# include <linux/filter.h>
+#endif
 
 CLICK_DECLS
 
 FromDevice::FromDevice()
     :
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
       _task(this),
 #endif
 #if FROMDEVICE_ALLOW_PCAP
       _pcap(0), _pcap_complaints(0),
+#endif
+#if FROMDEVICE_ALLOW_LINUX
+      _tstamping(tstamp_default),
+#endif
+#if FROMDEVICE_ALLOW_MMAP
+      _ring(0), _ring_blocks(16), _ring_block(0),
+      _fanout(fanout_none), _fanout_group(-1),
+#endif
+#if FROMDEVICE_ALLOW_XDP
+      _xsk(0), _queue(0),
 #endif
       _datalink(-1), _count(0), _promisc(0), _snaplen(0)
 {
@@ -84,8 +102,12 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
     _force_ip = false;
     _burst = 1;
-    String bpf_filter, capture, encap_type;
+    String bpf_filter, capture, encap_type, fanout, tstamping;
     bool has_encap;
+    unsigned ring_blocks = 16;
+    int fanout_group = -1;
+    int queue = 0;
+    bool has_queue;
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read_p("PROMISC", promisc)
@@ -101,6 +123,11 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("ENCAP", WordArg(), encap_type).read_status(has_encap)
 	.read("BURST", _burst)
 	.read("TIMESTAMP", timestamp)
+	.read("TIMESTAMPING", WordArg(), tstamping)
+	.read("RING_BLOCKS", ring_blocks)
+	.read("FANOUT", WordArg(), fanout)
+	.read("FANOUT_GROUP", fanout_group)
+	.read("QUEUE", queue).read_status(has_queue)
 	.complete() < 0)
 	return -1;
     if (_snaplen > 65535 || _snaplen < 14)
@@ -109,10 +136,33 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("HEADROOM out of range");
     if (_burst <= 0)
 	return errh->error("BURST out of range");
+    if (ring_blocks < 2 || ring_blocks > 4096)
+	return errh->error("RING_BLOCKS out of range");
     _protocol = htons(_protocol);
+    if (fanout_group < -1 || fanout_group > 65535)
+	return errh->error("FANOUT_GROUP out of range");
+#if FROMDEVICE_ALLOW_MMAP
+    _ring_blocks = ring_blocks;
+    _fanout_group = fanout_group;
+    if (fanout == "")
+	_fanout = fanout_none;
+    else if (fanout == "HASH")
+	_fanout = fanout_hash;
+    else if (fanout == "CPU")
+	_fanout = fanout_cpu;
+    else if (fanout == "STATION")
+	_fanout = fanout_station;
+    else
+	return errh->error("bad FANOUT");
+#else
+    if (fanout)
+	return errh->error("FANOUT requires METHOD PACKET_MMAP");
+#endif
 
 #if FROMDEVICE_ALLOW_PCAP
     _bpf_filter = bpf_filter;
+#endif
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
     if (has_encap) {
         _datalink = fake_pcap_parse_dlt(encap_type);
         if (_datalink < 0)
@@ -143,12 +193,46 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_NETMAP
     else if (capture == "NETMAP")
 	_method = method_netmap;
+#endif
+#if FROMDEVICE_ALLOW_MMAP
+    else if (capture == "PACKET_MMAP")
+	_method = method_mmap;
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    else if (capture == "XDP")
+	_method = method_xdp;
 #endif
     else
 	return errh->error("bad METHOD");
 
     if (bpf_filter && _method != method_pcap)
 	errh->warning("not using METHOD PCAP, BPF filter ignored");
+#if FROMDEVICE_ALLOW_MMAP
+    if (_fanout != fanout_none && _method != method_mmap)
+	return errh->error("FANOUT requires METHOD PACKET_MMAP");
+#endif
+    if (has_queue && _method != method_xdp)
+	return errh->error("QUEUE requires METHOD XDP");
+#if FROMDEVICE_ALLOW_LINUX
+    if (tstamping == "")
+	_tstamping = tstamp_default;
+    else if (tstamping == "SOFTWARE")
+	_tstamping = tstamp_software;
+    else if (tstamping == "HARDWARE")
+	_tstamping = tstamp_hardware;
+    else
+	return errh->error("bad TIMESTAMPING");
+    if (_tstamping != tstamp_default && _method != method_linux && _method != method_mmap)
+	return errh->error("TIMESTAMPING requires METHOD LINUX or PACKET_MMAP");
+    if (_tstamping != tstamp_default && !timestamp)
+	return errh->error("TIMESTAMPING conflicts with TIMESTAMP false");
+#else
+    if (tstamping)
+	return errh->error("TIMESTAMPING requires METHOD LINUX or PACKET_MMAP");
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    _queue = queue;
+#endif
 
     _sniffer = sniffer;
     _promisc = promisc;
@@ -227,8 +311,257 @@ FromDevice::set_promiscuous(int fd, String ifname, bool promisc)
 
     return was_promisc;
 }
+
+// Have the kernel hand over the receive time of each frame, see
+// TIMESTAMPING.
+int
+FromDevice::enable_timestamping(ErrorHandler *errh)
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (_tstamping == tstamp_hardware) {
+	// many drivers cannot stamp frames, the kernel then does
+	struct hwtstamp_config config;
+	memset(&config, 0, sizeof(config));
+	config.rx_filter = HWTSTAMP_FILTER_ALL;
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, _ifname.c_str(), sizeof(ifr.ifr_name));
+	ifr.ifr_data = (char *) &config;
+	if (ioctl(_fd, SIOCSHWTSTAMP, &ifr) < 0)
+	    errh->warning("%s: SIOCSHWTSTAMP: %s, using software timestamps", _ifname.c_str(), strerror(errno));
+	flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+	// the ring always carries a timestamp, the hardware one if asked
+	// for and the frame has one
+	int raw = SOF_TIMESTAMPING_RAW_HARDWARE;
+	if (_tstamping == tstamp_hardware
+	    && setsockopt(_fd, SOL_PACKET, PACKET_TIMESTAMP, &raw, sizeof(raw)) < 0)
+	    return errh->error("%s: PACKET_TIMESTAMP: %s", _ifname.c_str(), strerror(errno));
+	return 0;
+    }
+#endif
+
+    if (setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+	return errh->error("%s: SO_TIMESTAMPING: %s", _ifname.c_str(), strerror(errno));
+    return 0;
+}
+
+// recvfrom() for TIMESTAMPING, which also sets the timestamp annotation
+// from the control message that comes with the frame.
+int
+FromDevice::recv_stamped(WritablePacket *p, struct sockaddr_ll *sa)
+{
+    struct iovec iov;
+    iov.iov_base = p->data();
+    iov.iov_len = p->length();
+    union {
+	struct cmsghdr align;
+	char buf[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = sa;
+    msg.msg_namelen = sizeof(*sa);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    int len = recvmsg(_fd, &msg, MSG_TRUNC);
+    if (len <= 0)
+	return len;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+	if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+	    // ts[0] is the software stamp, ts[2] the raw hardware one
+	    struct scm_timestamping tss;
+	    memcpy(&tss, CMSG_DATA(c), sizeof(tss));
+	    const struct timespec *ts = &tss.ts[0];
+	    if (_tstamping == tstamp_hardware && (tss.ts[2].tv_sec || tss.ts[2].tv_nsec))
+		ts = &tss.ts[2];
+	    p->timestamp_anno() = Timestamp::make_nsec(ts->tv_sec, ts->tv_nsec);
+	}
+    return len;
+}
 #endif /* FROMDEVICE_ALLOW_LINUX */
 
+#if FROMDEVICE_ALLOW_MMAP
+int
+FromDevice::open_ring(ErrorHandler *errh)
+{
+    int version = TPACKET_V3;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	return errh->error("%s: PACKET_VERSION: %s", _ifname.c_str(), strerror(errno));
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = mmap_block_size;
+    req.tp_block_nr = _ring_blocks;
+    req.tp_frame_size = mmap_frame_size;
+    req.tp_frame_nr = (mmap_block_size / mmap_frame_size) * _ring_blocks;
+    req.tp_retire_blk_tov = mmap_block_timeout;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+	return errh->error("%s: PACKET_RX_RING: %s", _ifname.c_str(), strerror(errno));
+
+    void *ring = mmap(0, (size_t) mmap_block_size * _ring_blocks,
+		      PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (ring == MAP_FAILED)
+	return errh->error("%s: mmap: %s", _ifname.c_str(), strerror(errno));
+    _ring = (unsigned char *) ring;
+    _ring_block = 0;
+
+    // link level type of the frames, as for pcap
+    if (_datalink == -1) {
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, _ifname.c_str(), sizeof(ifr.ifr_name));
+	int hwtype = (ioctl(_fd, SIOCGIFHWADDR, &ifr) == 0 ? ifr.ifr_hwaddr.sa_family : -1);
+	if (hwtype == ARPHRD_ETHER || hwtype == ARPHRD_LOOPBACK)
+	    _datalink = FAKE_DLT_EN10MB;
+	else if (hwtype == ARPHRD_IEEE80211_RADIOTAP)
+	    _datalink = FAKE_DLT_IEEE802_11_RADIO;
+	else if (hwtype == ARPHRD_IEEE80211_PRISM)
+	    _datalink = FAKE_DLT_PRISM_HEADER;
+	else if (hwtype == ARPHRD_IEEE80211)
+	    _datalink = FAKE_DLT_IEEE802_11;
+	else {
+	    errh->warning("%s: unknown hardware type %d, assuming Ethernet", _ifname.c_str(), hwtype);
+	    _datalink = FAKE_DLT_EN10MB;
+	}
+    }
+    return 0;
+}
+
+// Join the PACKET_FANOUT group of the ring. Called once the ring is set up
+// and _datalink is known.
+int
+FromDevice::join_fanout(ErrorHandler *errh)
+{
+#if defined(PACKET_FANOUT) && defined(PACKET_FANOUT_CBPF)
+    int group = _fanout_group;
+    if (group < 0)
+	group = if_nametoindex(_ifname.c_str()) & 0xFFFF;
+
+    int mode;
+    if (_fanout == fanout_hash)
+	mode = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+    else if (_fanout == fanout_cpu)
+	mode = PACKET_FANOUT_CPU;
+    else {
+	if (_datalink != FAKE_DLT_IEEE802_11_RADIO)
+	    return errh->error("%s: FANOUT STATION requires radiotap headers", _ifname.c_str());
+	mode = PACKET_FANOUT_CBPF;
+    }
+
+    int arg = group | (mode << 16);
+    if (setsockopt(_fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+	return errh->error("%s: PACKET_FANOUT: %s", _ifname.c_str(), strerror(errno));
+
+    if (_fanout == fanout_station) {
+	// the member is the last byte of addr2, past the radiotap header
+	// whose length is the little endian 16 bits at offset 2. Frames too
+	// short to have one go to the first member
+	static struct sock_filter code[] = {
+	    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),
+	    BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+	    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 2),
+	    BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+	    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	    BPF_STMT(BPF_LD | BPF_B | BPF_IND, 15),
+	    BPF_STMT(BPF_RET | BPF_A, 0)
+	};
+	struct sock_fprog prog;
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	if (setsockopt(_fd, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog)) < 0)
+	    return errh->error("%s: PACKET_FANOUT_DATA: %s", _ifname.c_str(), strerror(errno));
+    }
+    return 0;
+#else
+    return errh->error("%s: PACKET_FANOUT not supported", _ifname.c_str());
+#endif
+}
+
+void
+FromDevice::close_ring()
+{
+    if (_ring)
+	munmap(_ring, (size_t) mmap_block_size * _ring_blocks);
+    _ring = 0;
+}
+
+// Emit the frames of the blocks the kernel handed over, until at least
+// burst frames have been emitted. Blocks are returned to the kernel as
+// soon as they are drained.
+int
+FromDevice::mmap_dispatch(int burst)
+{
+    int n = 0;
+    while (n < burst) {
+	struct tpacket_block_desc *bd = (struct tpacket_block_desc *)
+	    (_ring + (size_t) _ring_block * mmap_block_size);
+	if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+	    break;
+	// read the frames only after observing the block status
+	click_fence();
+
+	struct tpacket3_hdr *h = (struct tpacket3_hdr *)
+	    ((unsigned char *) bd + bd->hdr.bh1.offset_to_first_pkt);
+	for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+	    const struct sockaddr_ll *sa = (const struct sockaddr_ll *)
+		((unsigned char *) h + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+	    if ((sa->sll_pkttype != PACKET_OUTGOING || _outbound)
+		&& (_protocol == 0 || _protocol == sa->sll_protocol)) {
+		uint32_t caplen = h->tp_snaplen;
+		if (caplen > (uint32_t) _snaplen)
+		    caplen = _snaplen;
+		WritablePacket *p = Packet::make(_headroom, (unsigned char *) h + h->tp_mac, caplen, 0);
+		if (p) {
+		    Timestamp ts = Timestamp::make_nsec(h->tp_sec, h->tp_nsec);
+		    emit_packet(p, h->tp_len - caplen, ts);
+		    n++;
+		}
+	    }
+	    h = (struct tpacket3_hdr *) ((unsigned char *) h + h->tp_next_offset);
+	}
+
+	// hand the block back once all its frames have been copied
+	click_fence();
+	bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	if (++_ring_block == _ring_blocks)
+	    _ring_block = 0;
+    }
+    return n;
+}
+#endif /* FROMDEVICE_ALLOW_MMAP */
+
+#if FROMDEVICE_ALLOW_XDP
+// Emit up to burst frames of the RX ring, taken in chunks of at most
+// xsk_chunk. AF_XDP carries no timestamp, frames are stamped on reception.
+int
+FromDevice::xsk_dispatch(int burst)
+{
+    enum { xsk_chunk = 64 };
+    WritablePacket *pkts[xsk_chunk];
+    Timestamp ts = _timestamp ? Timestamp::now() : Timestamp();
+    int n = 0;
+    while (n < burst) {
+	int want = (burst - n < xsk_chunk ? burst - n : xsk_chunk);
+	int r = _xsk->receive(pkts, want, _headroom);
+	for (int i = 0; i < r; i++)
+	    emit_packet(pkts[i], 0, ts);
+	n += r;
+	if (r < want)
+	    break;
+    }
+    return n;
+}
+#endif
+
 #if FROMDEVICE_ALLOW_PCAP
 const char*
 FromDevice::fetch_pcap_error(pcap_t* pcap, const char *ebuf)
@@ -405,11 +738,47 @@ FromDevice::initialize(ErrorHandler *errh)
 
 	_datalink = FAKE_DLT_EN10MB;
 	_method = method_linux;
+	if (_tstamping != tstamp_default && enable_timestamping(errh) < 0)
+	    return -1;
     }
 #endif
 
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
-    if (_method == method_pcap || _method == method_netmap)
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+	_fd = open_packet_socket(_ifname, errh);
+	if (_fd < 0)
+	    return -1;
+
+	int promisc_ok = set_promiscuous(_fd, _ifname, _promisc);
+	if (promisc_ok < 0) {
+	    if (_promisc)
+		errh->warning("cannot set promiscuous mode");
+	    _was_promisc = -1;
+	} else
+	    _was_promisc = promisc_ok;
+
+	if (open_ring(errh) < 0)
+	    return -1;
+	if (_tstamping != tstamp_default && enable_timestamping(errh) < 0)
+	    return -1;
+	if (_fanout != fanout_none && join_fanout(errh) < 0)
+	    return -1;
+    }
+#endif
+
+#if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	_xsk = XskInfo::open(_ifname, _queue, true, errh);
+	if (!_xsk)
+	    return -1;
+	_fd = _xsk->fd();
+	_datalink = FAKE_DLT_EN10MB;
+    }
+#endif
+
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_MMAP
+    if (_method == method_pcap || _method == method_netmap || _method == method_mmap
+	|| _method == method_xdp)
 	ScheduleInfo::initialize_task(this, &_task, false, errh);
 #endif
 #if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_NETMAP
@@ -433,8 +802,17 @@ FromDevice::cleanup(CleanupStage stage)
     if (_fd >= 0 && _method == method_netmap)
 	_netmap.close(_fd);
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap)
+	close_ring();
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (_xsk)
+	_xsk->release();
+    _xsk = 0;
+#endif
 #if FROMDEVICE_ALLOW_LINUX
-    if (_fd >= 0 && _method == method_linux) {
+    if (_fd >= 0 && (_method == method_linux || _method == method_mmap)) {
 	if (_was_promisc >= 0)
 	    set_promiscuous(_fd, _ifname, _was_promisc);
 	close(_fd);
@@ -450,7 +828,7 @@ FromDevice::cleanup(CleanupStage stage)
 #endif
 }
 
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_MMAP
 void
 FromDevice::emit_packet(WritablePacket *p, int extra_len, const Timestamp &ts)
 {
@@ -468,7 +846,7 @@ FromDevice::emit_packet(WritablePacket *p, int extra_len, const Timestamp &ts)
     SET_EXTRA_LENGTH_ANNO(p, extra_len);
 
     if (!_force_ip || fake_pcap_force_ip(p, _datalink))
-	output(0).push(p);
+	_rx_batch.append(p);
     else
 	checked_output_push(1, p);
 }
@@ -509,6 +887,7 @@ FromDevice::selected(int, int)
 	// Read and push() at most one burst of packets.
 	int r = _netmap.dispatch(_burst,
 		reinterpret_cast<nm_cb_t>(FromDevice_get_packet), (u_char *) this);
+	flush_batch();
 	if (r > 0) {
 	    _count += r;
 	    _task.reschedule();
@@ -521,6 +900,7 @@ FromDevice::selected(int, int)
     if (_method == method_pcap) {
 	// Read and push() at most one burst of packets.
 	int r = pcap_dispatch(_pcap, _burst, FromDevice_get_packet, (u_char *) this);
+	flush_batch();
 	if (r > 0) {
 	    _count += r;
 	    _task.reschedule();
@@ -528,13 +908,37 @@ FromDevice::selected(int, int)
 	    ErrorHandler::default_handler()->error("%p{element}: %s", this, pcap_geterr(_pcap));
     }
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+	int r = mmap_dispatch(_burst);
+	flush_batch();
+	if (r > 0) {
+	    _count += r;
+	    _task.reschedule();
+	}
+    }
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	int r = xsk_dispatch(_burst);
+	flush_batch();
+	if (r > 0) {
+	    _count += r;
+	    _task.reschedule();
+	}
+    }
+#endif
 #if FROMDEVICE_ALLOW_LINUX
     int nlinux = 0;
     while (_method == method_linux && nlinux < _burst) {
 	struct sockaddr_ll sa;
 	socklen_t fromlen = sizeof(sa);
 	WritablePacket *p = Packet::make(_headroom, 0, _snaplen, 0);
-	int len = recvfrom(_fd, p->data(), p->length(), MSG_TRUNC, (sockaddr *)&sa, &fromlen);
+	int len;
+	if (_tstamping != tstamp_default)
+	    len = recv_stamped(p, &sa);
+	else
+	    len = recvfrom(_fd, p->data(), p->length(), MSG_TRUNC, (sockaddr *)&sa, &fromlen);
 	if (len > 0 && (sa.sll_pkttype != PACKET_OUTGOING || _outbound)
             && (_protocol == 0 || _protocol == sa.sll_protocol)) {
 	    if (len > _snaplen) {
@@ -543,12 +947,13 @@ FromDevice::selected(int, int)
 	    } else
 		p->take(_snaplen - len);
 	    p->set_packet_type_anno((Packet::PacketType)sa.sll_pkttype);
-	    p->timestamp_anno().set_timeval_ioctl(_fd, SIOCGSTAMP);
+	    if (_tstamping == tstamp_default && _timestamp)
+		p->timestamp_anno().set_timeval_ioctl(_fd, SIOCGSTAMP);
 	    p->set_mac_header(p->data());
 	    ++nlinux;
 	    ++_count;
 	    if (!_force_ip || fake_pcap_force_ip(p, _datalink))
-		output(0).push(p);
+		_rx_batch.append(p);
 	    else
 		checked_output_push(1, p);
 	} else {
@@ -558,10 +963,11 @@ FromDevice::selected(int, int)
 	    break;
 	}
     }
+    flush_batch();
 #endif
 }
 
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_MMAP
 bool
 FromDevice::run_task(Task *)
 {
@@ -584,6 +990,15 @@ FromDevice::run_task(Task *)
 	    ErrorHandler::default_handler()->error("%p{element}: %s", this, pcap_geterr(_pcap));
     }
 # endif
+# if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap)
+	r = mmap_dispatch(_burst);
+# endif
+# if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp)
+	r = xsk_dispatch(_burst);
+# endif
+    flush_batch();
     if (r > 0) {
 	_count += r;
 	_task.fast_reschedule();
@@ -612,6 +1027,21 @@ FromDevice::kernel_drops(bool& known, int& max_drops) const
             known = true, max_drops = stats.tp_drops;
     }
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+        struct tpacket_stats_v3 stats;
+        socklen_t statsize = sizeof(stats);
+        if (getsockopt(_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &statsize) >= 0)
+            known = true, max_drops = stats.tp_drops;
+    }
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	uint64_t dropped;
+	if (_xsk->drops(dropped))
+	    known = true, max_drops = dropped;
+    }
+#endif
 }
 
 String
@@ -652,5 +1082,5 @@ FromDevice::add_handlers()
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel FakePcap KernelFilter NetmapInfo)
+ELEMENT_REQUIRES(userlevel FakePcap KernelFilter NetmapInfo XskInfo)
 EXPORT_ELEMENT(FromDevice)
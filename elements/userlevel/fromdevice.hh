@@ -5,6 +5,7 @@
 
 #ifdef __linux__
 # define FROMDEVICE_ALLOW_LINUX 1
+# define FROMDEVICE_ALLOW_MMAP 1
 #endif
 
 #if HAVE_PCAP
@@ -23,8 +24,15 @@ int pcap_setnonblock(pcap_t *p, int nonblock, char *errbuf);
 # include "elements/userlevel/netmapinfo.hh"
 #endif
 
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if defined(__linux__) && HAVE_LINUX_IF_XDP_H
+# define FROMDEVICE_ALLOW_XDP 1
+# include "elements/userlevel/xskinfo.hh"
+#endif
+
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
 # include <click/task.hh>
+#endif
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
 extern "C" {
 void FromDevice_get_packet(u_char*, const struct pcap_pkthdr*, const u_char*);
 }
@@ -95,8 +103,28 @@ but the IP header annotation has been set appropriately.) Default is false.
 =item METHOD
 
 Word.  Defines the capture method FromDevice will use to read packets from the
-device.  Linux targets generally support PCAP and LINUX; other targets support
-only PCAP.  Defaults to PCAP.
+device.  Linux targets generally support PCAP, LINUX, PACKET_MMAP and XDP;
+other targets support only PCAP.  Defaults to PCAP.
+
+PACKET_MMAP reads packets from a TPACKET_V3 ring shared with the kernel. The
+kernel fills whole blocks of frames, FromDevice copies every frame once into
+a Click packet, and hands each block back as soon as it has been drained, so
+neither a system call nor a callback is paid per frame. Useful on interfaces
+netmap does not support, such as wireless monitor interfaces. The
+encapsulation is taken from the interface type (for instance 802.11 plus
+radiotap on a monitor interface) unless ENCAP is given.
+
+XDP reads Ethernet frames from an AF_XDP socket bound to receive queue QUEUE
+of the device. An XDP program, attached to the device for as long as one
+such FromDevice runs, redirects the frames of the queue to the socket; the
+kernel stack does not see them. Packets point into the memory the device
+received them into, which is given back to the device when they die; if
+downstream elements hold on to too many of them, further frames are copied.
+Drivers without AF_XDP zero-copy support fall back to a kernel copy. To
+spread a device over several cores, use one FromDevice per queue, each on
+its own thread, and configure the NIC to spread the flows (RSS) over those
+queues. A ToDevice with METHOD XDP on the same device and queue sends
+through the same socket. Needs Linux 5.9 or later.
 
 =item BPF_FILTER
 
@@ -127,12 +155,55 @@ to roughly 28.
 
 =item BURST
 
-Integer. Maximum number of packets to read per scheduling. Defaults to 1.
+Integer. Maximum number of packets to read per scheduling. The packets read
+are pushed downstream together, as a batch. Defaults to 1.
+With METHOD PACKET_MMAP, blocks are always drained whole, and blocks are
+read until at least BURST packets have been emitted.
+
+=item RING_BLOCKS
+
+Integer. Number of 256 kB blocks of the PACKET_MMAP ring. Blocks not yet
+full are handed over by the kernel after 1 ms. Defaults to 16.
+
+=item FANOUT
+
+Word. With METHOD PACKET_MMAP, join a PACKET_FANOUT group, so that several
+FromDevice elements on the same interface share its traffic, each with its
+own ring; put each one on its own thread with StaticThreadSched to spread
+the receive path of one interface over several cores. All the members of a
+group must use the same mode. HASH sends all the packets of a flow to the
+same member, CPU the packets received on a CPU to the same member. STATION,
+for 802.11 monitor interfaces with radiotap headers, sends all the frames
+transmitted by a station to the same member, after the last byte of their
+transmitter address, so that the frames of a station stay in order; the
+kernel flow hash does not parse 802.11 frames. Needs Linux 4.2 or later.
+Default is no fanout.
+
+=item FANOUT_GROUP
+
+Integer. Fanout group ID, from 0 to 65535. Defaults to the index of the
+interface, which groups all the FromDevice elements of an interface.
+
+=item QUEUE
+
+Integer. With METHOD XDP, the receive queue to read from. Defaults to 0.
 
 =item TIMESTAMP
 
 Boolean. If false, then do not timestamp packets. Defaults to true.
 
+=item TIMESTAMPING
+
+Word. With METHOD LINUX or PACKET_MMAP, where the timestamp annotation comes
+from. SOFTWARE is the time the kernel received the frame, handed over with
+the frame through SO_TIMESTAMPING instead of read with an ioctl per frame.
+HARDWARE is the time the network controller received it, if the driver
+supports hardware timestamps (SIOCSHWTSTAMP), and the kernel's otherwise;
+the clock of the controller should be kept in step with the system clock,
+e.g. with phc2sys. Either way downstream elements need not read the clock
+per frame. By default METHOD LINUX reads the kernel's time with an ioctl
+and PACKET_MMAP takes it from the ring.
+
 =back
 
 =e
@@ -206,7 +277,11 @@ class FromDevice : public Element { public:
     const NetmapInfo *netmap() const { return _method == method_netmap ? &_netmap : 0; }
 #endif
 
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_XDP
+    XskInfo *xsk() const		{ return _method == method_xdp ? _xsk : 0; }
+#endif
+
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
     bool run_task(Task *task);
 #endif
 
@@ -217,10 +292,10 @@ class FromDevice : public Element { public:
 #if FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
     int _fd;
 #endif
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
     Task _task;
 #endif
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_MMAP
     void emit_packet(WritablePacket *p, int extra_len, const Timestamp &ts);
 #endif
 #if FROMDEVICE_ALLOW_PCAP
@@ -231,6 +306,31 @@ class FromDevice : public Element { public:
     NetmapInfo _netmap;
     int netmap_dispatch();
 #endif
+#if FROMDEVICE_ALLOW_LINUX
+    enum { tstamp_default, tstamp_software, tstamp_hardware };
+    int _tstamping;
+    int enable_timestamping(ErrorHandler *errh);
+    int recv_stamped(WritablePacket *p, struct sockaddr_ll *sa);
+#endif
+#if FROMDEVICE_ALLOW_MMAP
+    enum { mmap_block_size = 1 << 18, mmap_frame_size = 1 << 11,
+	   mmap_block_timeout = 1 };
+    unsigned char *_ring;
+    unsigned _ring_blocks;
+    unsigned _ring_block;
+    enum { fanout_none, fanout_hash, fanout_cpu, fanout_station };
+    int _fanout;
+    int _fanout_group;
+    int open_ring(ErrorHandler *errh);
+    int join_fanout(ErrorHandler *errh);
+    void close_ring();
+    int mmap_dispatch(int burst);
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    XskInfo *_xsk;
+    int _queue;
+    int xsk_dispatch(int burst);
+#endif
 #if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
     friend void FromDevice_get_packet(u_char*, const struct pcap_pkthdr*,
                                       const u_char*);
@@ -242,6 +342,9 @@ class FromDevice : public Element { public:
 #endif
     int _burst;
     int _datalink;
+    // packets of the current burst, pushed downstream together
+    PacketBatch _rx_batch;
+    inline void flush_batch();
 
 #if HAVE_INT64_TYPES
     typedef uint64_t counter_t;
@@ -259,7 +362,8 @@ class FromDevice : public Element { public:
     int _snaplen;
     uint16_t _protocol;
     unsigned _headroom;
-    enum { method_default, method_netmap, method_pcap, method_linux };
+    enum { method_default, method_netmap, method_pcap, method_linux, method_mmap,
+	   method_xdp };
     int _method;
 #if FROMDEVICE_ALLOW_PCAP
     String _bpf_filter;
@@ -270,5 +374,12 @@ class FromDevice : public Element { public:
 
 };
 
+inline void
+FromDevice::flush_batch()
+{
+    if (!_rx_batch.empty())
+	output(0).push_batch(_rx_batch.take());
+}
+
 CLICK_ENDDECLS
 #endif
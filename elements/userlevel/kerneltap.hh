@@ -49,7 +49,8 @@ be set.
 =item HEADROOM
 
 Integer.  The number of bytes left empty before the packet data (to leave room
-for additional encapsulation headers).  Default is 0.
+for additional encapsulation headers).  Default is 0, or the bytes the
+elements downstream declare they push, if more (see HeadroomTracker).
 
 =item IGNORE_QUEUE_OVERFLOWS
 
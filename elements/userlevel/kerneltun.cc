@@ -26,7 +26,13 @@
 #include <click/straccum.hh>
 #include <click/glue.hh>
 #include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include <clicknet/tcp.h>
+#include <click/packet_anno.hh>
 #include <click/standard/scheduleinfo.hh>
+#include <click/router.hh>
+#include <click/routervisitor.hh>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -55,6 +61,24 @@
 #if HAVE_NET_IF_TAP_H
 # include <net/if_tap.h>
 #endif
+#if KERNELTUN_LINUX && defined(IFF_VNET_HDR)
+# include <sys/uio.h>
+# define KERNELTUN_VNET 1
+// from <linux/virtio_net.h>, which does not compile as C++
+struct virtio_net_hdr {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+};
+# define VIRTIO_NET_HDR_F_NEEDS_CSUM	1
+# define VIRTIO_NET_HDR_GSO_NONE	0
+# define VIRTIO_NET_HDR_GSO_TCPV4	1
+# define VIRTIO_NET_HDR_GSO_TCPV6	4
+# define VIRTIO_NET_HDR_GSO_ECN		0x80
+#endif
 
 #if defined(__NetBSD__)
 # include <sys/param.h>
@@ -68,14 +92,16 @@
 CLICK_DECLS
 
 KernelTun::KernelTun()
-    : _fd(-1), _tap(false), _task(this), _ignore_q_errs(false),
+    : _fd(-1), _nqueues(1), _tap(false), _task(this), _ignore_q_errs(false),
       _printed_write_err(false), _printed_read_err(false),
-      _selected_calls(0), _packets(0)
+      _vnet_hdr(false), _gso(false), _segment(true), _vnet_hdr_sz(0), _gso_buf(0),
+      _selected_calls(0), _packets(0), _gso_packets(0), _gso_drops(0)
 {
 }
 
 KernelTun::~KernelTun()
 {
+    delete[] _gso_buf;
 }
 
 void *
@@ -108,6 +134,10 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 #if KERNELTUN_LINUX
 	.read("DEV_NAME", Args::deprecated, _dev_name)
 	.read("DEVNAME", _dev_name)
+	.read("QUEUES", _nqueues)
+	.read("VNET_HDR", _vnet_hdr)
+	.read("GSO", _gso)
+	.read("SEGMENT", _segment)
 #endif
 	.complete() < 0)
 	return -1;
@@ -120,6 +150,21 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("MTU must be greater than %d", sizeof(click_ip));
     if (_headroom > 8192)
 	return errh->error("HEADROOM too big");
+    if (_nqueues < 1)
+	return errh->error("QUEUES must be >= 1");
+#if KERNELTUN_LINUX && !defined(IFF_MULTI_QUEUE)
+    if (_nqueues > 1)
+	return errh->error("QUEUES not supported on this system");
+#endif
+    if (_gso)
+	_vnet_hdr = true;
+#if KERNELTUN_VNET
+    if (_vnet_hdr)
+	_vnet_hdr_sz = sizeof(struct virtio_net_hdr);
+#else
+    if (_vnet_hdr)
+	return errh->error("VNET_HDR not supported on this system");
+#endif
     _adjust_headroom = !_adjust_headroom;
     return 0;
 }
@@ -135,6 +180,14 @@ KernelTun::try_linux_universal()
     struct ifreq ifr;
     memset(&ifr, 0, sizeof(ifr));
     ifr.ifr_flags = (_tap ? IFF_TAP : IFF_TUN);
+#ifdef IFF_MULTI_QUEUE
+    if (_nqueues > 1)
+	ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#endif
+#if KERNELTUN_VNET
+    if (_vnet_hdr)
+	ifr.ifr_flags |= IFF_VNET_HDR;
+#endif
     if (_dev_name)
 	// Setting ifr_name allows us to select an arbitrary interface name.
 	strncpy(ifr.ifr_name, _dev_name.c_str(), sizeof(ifr.ifr_name));
@@ -144,9 +197,35 @@ KernelTun::try_linux_universal()
 	return -errno;
     }
 
+#if KERNELTUN_VNET
+    if (_vnet_hdr) {
+	// TCP segmentation and checksums are done in one_selected
+	unsigned offload = (_gso ? TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN : 0);
+	if (ioctl(fd, TUNSETVNETHDRSZ, &_vnet_hdr_sz) < 0
+	    || ioctl(fd, TUNSETOFFLOAD, offload) < 0) {
+	    err = -errno;
+	    close(fd);
+	    return err;
+	}
+    }
+#endif
+
     _dev_name = ifr.ifr_name;
     _fd = fd;
+    _fds.push_back(fd);
     _type = LINUX_UNIVERSAL;
+
+    // the other queues attach to the device the first one created
+    while (_fds.size() < (int) _nqueues) {
+	if ((fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK)) < 0
+	    || ioctl(fd, TUNSETIFF, (void *)&ifr) < 0) {
+	    err = -errno;
+	    if (fd >= 0)
+		close(fd);
+	    return err;
+	}
+	_fds.push_back(fd);
+    }
     return 0;
 }
 #endif
@@ -161,6 +240,7 @@ KernelTun::try_tun(const String &dev_name, ErrorHandler *)
 
     _dev_name = dev_name;
     _fd = fd;
+    _fds.push_back(fd);
     return 0;
 }
 
@@ -183,6 +263,9 @@ KernelTun::alloc_tun(ErrorHandler *errh)
 #if KERNELTUN_LINUX
     if ((error = try_linux_universal()) >= 0)
 	return error;
+    else if (_nqueues > 1 || _vnet_hdr)
+	// the other devices know neither queues nor virtio-net headers
+	return errh->error("/dev/net/tun: %s", strerror(-error));
     else if (!saved_error || error != -ENOENT) {
 	saved_error = error, saved_device = "net/tun";
 	if (error == -ENODEV)
@@ -454,6 +537,11 @@ KernelTun::setup_tun(ErrorHandler *errh)
 	_mtu_in = _mtu_out + 4; // + 0?
     else /* _type == LINUX_ETHERTAP */
 	_mtu_in = _mtu_out + 16;
+    _mtu_in += _vnet_hdr_sz;
+
+    // super-frames overflow from the packet into _gso_buf, see one_selected
+    if (_gso)
+	_gso_buf = new unsigned char[_mtu_in + 65536];
 
     return 0;
 }
@@ -469,13 +557,23 @@ KernelTun::initialize(ErrorHandler *errh)
 	ScheduleInfo::join_scheduler(this, &_task, errh);
 	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
     }
+    if (noutputs()) {
+	// room for the headers pushed downstream
+	HeadroomTracker tracker(router());
+	router()->visit_downstream(this, 0, &tracker);
+	if (tracker.headroom() > _headroom && _adjust_headroom)
+	    _headroom = tracker.headroom();
+	else if (tracker.headroom() > _headroom)
+	    errh->warning("HEADROOM %u is less than the %u bytes pushed downstream", _headroom, tracker.headroom());
+    }
     if (_adjust_headroom) {
 	if (_tap && _type == LINUX_UNIVERSAL)
-	    _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
+	    _headroom += (4 - (_headroom + _vnet_hdr_sz + 2) % 4) % 4; // default 4/2 alignment
 	else
-	    _headroom += (4 - _headroom % 4) % 4; // default 4/0 alignment
+	    _headroom += (4 - (_headroom + _vnet_hdr_sz) % 4) % 4; // default 4/0 alignment
     }
-    add_select(_fd, SELECT_READ);
+    for (int i = 0; i < _fds.size(); i++)
+	add_select(_fds[i], SELECT_READ);
     return 0;
 }
 
@@ -485,25 +583,188 @@ KernelTun::cleanup(CleanupStage)
     if (_fd >= 0) {
 	if (_type != LINUX_UNIVERSAL && _type != NETBSD_TAP)
 	    updown(0, ~0, ErrorHandler::default_handler());
-	close(_fd);
-	remove_select(_fd, SELECT_READ);
     }
+    for (int i = 0; i < _fds.size(); i++) {
+	close(_fds[i]);
+	remove_select(_fds[i], SELECT_READ);
+    }
+    _fds.clear();
+    _fd = -1;
 }
 
 void
 KernelTun::selected(int fd, int)
 {
     Timestamp now = Timestamp::now();
-    if (fd != _fd)
+    int i = 0;
+    while (i < _fds.size() && _fds[i] != fd)
+	++i;
+    if (i == _fds.size())
 	return;
     ++_selected_calls;
     unsigned n = _burst;
-    while (n > 0 && one_selected(now))
+    while (n > 0 && one_selected(fd, now))
 	--n;
+    if (!_rx_batch.empty())
+	output(0).push_batch(_rx_batch.take());
 }
 
+#if KERNELTUN_VNET
+static uint16_t
+l4_cksum(const unsigned char *l3, const unsigned char *l4, int len, int proto)
+{
+    uint32_t csum = click_in_cksum(l4, len);
+    if ((l3[0] >> 4) == 4)
+	return click_in_cksum_pseudohdr(csum, (const click_ip *) l3, len);
+    const uint16_t *a = (const uint16_t *) &((const click_ip6 *) l3)->ip6_src;
+    csum = ~csum & 0xFFFF;
+    for (int i = 0; i < 16; i++)
+	csum += a[i];
+    csum += htons(len) + htons(proto);
+    csum = (csum & 0xFFFF) + (csum >> 16);
+    return ~(csum + (csum >> 16)) & 0xFFFF;
+}
+
+/*
+ * Cut a TCP super-frame handed over by the kernel into segments of at
+ * most gso_size bytes of payload. Every segment gets a copy of the
+ * headers with the lengths, sequence number, IP ID and checksums fixed,
+ * like the kernel's own TCP segmentation does.
+ */
+void
+KernelTun::gso_segment(const unsigned char *frame, int len,
+		       const struct virtio_net_hdr *vh, const Timestamp &now)
+{
+    int l3 = 0;
+    if (_tap) {
+	l3 = sizeof(click_ether);
+	if (len >= l3 + 4 && ((const click_ether *) frame)->ether_type == htons(ETHERTYPE_8021Q))
+	    l3 += 4;
+    }
+    int l4 = vh->csum_start;
+    int type = vh->gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+    int version = (len > l3 ? frame[l3] >> 4 : 0);
+    if ((type != VIRTIO_NET_HDR_GSO_TCPV4 || version != 4)
+	&& (type != VIRTIO_NET_HDR_GSO_TCPV6 || version != 6)) {
+	++_gso_drops;
+	return;
+    }
+    if (l4 < l3 + (version == 4 ? (int) sizeof(click_ip) : (int) sizeof(click_ip6))
+	|| l4 + (int) sizeof(click_tcp) > len || !vh->gso_size) {
+	++_gso_drops;
+	return;
+    }
+    int hlen = l4 + ((const click_tcp *) (frame + l4))->th_off * 4;
+    if (hlen > len) {
+	++_gso_drops;
+	return;
+    }
+
+    unsigned headroom = _headroom + 4 + _vnet_hdr_sz;
+    if (!_segment) {
+	// left to whoever reads the annotation
+	WritablePacket *q = Packet::make(headroom, frame, len, 0);
+	if (!q) {
+	    click_chatter("out of memory!");
+	    return;
+	}
+	SET_GSO_SIZE_ANNO(q, vh->gso_size);
+	if (_tap || fake_pcap_force_ip(q, FAKE_DLT_RAW)) {
+	    q->set_timestamp_anno(now);
+	    _rx_batch.append(q);
+	} else
+	    checked_output_push(1, q);
+	++_gso_packets;
+	return;
+    }
+
+    const click_ip *iph = (const click_ip *) (frame + l3);
+    const click_tcp *tcph = (const click_tcp *) (frame + l4);
+    int mss = vh->gso_size;
+    for (int off = hlen, i = 0; off < len; off += mss, i++) {
+	int seglen = (len - off < mss ? len - off : mss);
+	WritablePacket *q = Packet::make(headroom, 0, hlen + seglen, 0);
+	if (!q) {
+	    click_chatter("out of memory!");
+	    return;
+	}
+	memcpy(q->data(), frame, hlen);
+	memcpy(q->data() + hlen, frame + off, seglen);
+
+	unsigned char *d = q->data();
+	if (version == 4) {
+	    click_ip *ip = (click_ip *) (d + l3);
+	    ip->ip_len = htons(hlen - l3 + seglen);
+	    ip->ip_id = htons(ntohs(iph->ip_id) + i);
+	    ip->ip_sum = 0;
+	    ip->ip_sum = click_in_cksum((const unsigned char *) ip, ip->ip_hl << 2);
+	} else
+	    ((click_ip6 *) (d + l3))->ip6_plen = htons(hlen - l3 - sizeof(click_ip6) + seglen);
+	click_tcp *tcp = (click_tcp *) (d + l4);
+	tcp->th_seq = htonl(ntohl(tcph->th_seq) + off - hlen);
+	if (off + seglen < len)
+	    tcp->th_flags &= ~(TH_FIN | TH_PUSH);
+	if (i)
+	    tcp->th_flags &= ~TH_CWR;
+	tcp->th_sum = 0;
+	tcp->th_sum = l4_cksum(d + l3, d + l4, hlen - l4 + seglen, IP_PROTO_TCP);
+
+	if (_tap || fake_pcap_force_ip(q, FAKE_DLT_RAW)) {
+	    q->set_timestamp_anno(now);
+	    _rx_batch.append(q);
+	} else
+	    checked_output_push(1, q);
+    }
+    ++_gso_packets;
+}
+
+/*
+ * Fill the virtio-net header of a packet about to be written. A TCP
+ * super-frame, with a nonzero GSO size annotation, asks the kernel to
+ * segment it; its TCP checksum field gets the pseudo-header sum the kernel
+ * completes.
+ */
+void
+KernelTun::set_vnet_hdr(WritablePacket *p)
+{
+    struct virtio_net_hdr vh;
+    memset(&vh, 0, sizeof(vh));
+    unsigned char *frame = p->data() + 4 + _vnet_hdr_sz;
+    int len = p->length() - 4 - _vnet_hdr_sz;
+    int l3 = 0;
+    if (_tap) {
+	l3 = sizeof(click_ether);
+	if (len >= l3 + 4 && ((const click_ether *) frame)->ether_type == htons(ETHERTYPE_8021Q))
+	    l3 += 4;
+    }
+    int version = (len > l3 ? frame[l3] >> 4 : 0);
+    int l4 = l3 + (version == 4 ? (frame[l3] & 0xF) << 2 : (int) sizeof(click_ip6));
+    if (GSO_SIZE_ANNO(p) && (version == 4 || version == 6)
+	&& l4 + (int) sizeof(click_tcp) <= len) {
+	click_tcp *tcph = (click_tcp *) (frame + l4);
+	vh.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+	vh.gso_type = (version == 4 ? VIRTIO_NET_HDR_GSO_TCPV4 : VIRTIO_NET_HDR_GSO_TCPV6);
+	vh.gso_size = GSO_SIZE_ANNO(p);
+	vh.hdr_len = l4 + (tcph->th_off << 2);
+	vh.csum_start = l4;
+	vh.csum_offset = offsetof(click_tcp, th_sum);
+	if (version == 4)
+	    tcph->th_sum = ~click_in_cksum_pseudohdr(0xFFFF, (const click_ip *) (frame + l3), len - l4) & 0xFFFF;
+	else {
+	    const uint16_t *a = (const uint16_t *) &((const click_ip6 *) (frame + l3))->ip6_src;
+	    uint32_t csum = htons(len - l4) + htons(IP_PROTO_TCP);
+	    for (int i = 0; i < 16; i++)
+		csum += a[i];
+	    csum = (csum & 0xFFFF) + (csum >> 16);
+	    tcph->th_sum = (csum + (csum >> 16)) & 0xFFFF;
+	}
+    }
+    memcpy(p->data() + 4, &vh, _vnet_hdr_sz);
+}
+#endif
+
 bool
-KernelTun::one_selected(const Timestamp &now)
+KernelTun::one_selected(int fd, const Timestamp &now)
 {
     WritablePacket *p = Packet::make(_headroom, 0, _mtu_in, 0);
     if (!p) {
@@ -511,16 +772,63 @@ KernelTun::one_selected(const Timestamp &now)
 	return false;
     }
 
-    int cc = read(_fd, p->data(), _mtu_in);
+    int cc;
+#if KERNELTUN_VNET
+    if (_gso) {
+	// anything beyond the MTU is a super-frame, let it overflow
+	struct iovec iov[2];
+	iov[0].iov_base = p->data();
+	iov[0].iov_len = _mtu_in;
+	iov[1].iov_base = _gso_buf + _mtu_in;
+	iov[1].iov_len = 65536;
+	cc = readv(fd, iov, 2);
+    } else
+#endif
+	cc = read(fd, p->data(), _mtu_in);
     if (cc > 0) {
 	++_packets;
-	p->take(_mtu_in - cc);
 	bool ok = false;
 
+#if KERNELTUN_VNET
+	if (_vnet_hdr) {
+	    // 4-byte packet information, then the virtio-net header
+	    const unsigned char *frame = p->data();
+	    if (cc > _mtu_in) {
+		memcpy(_gso_buf, p->data(), _mtu_in);
+		frame = _gso_buf;
+	    }
+	    struct virtio_net_hdr vh;
+	    memcpy(&vh, frame + 4, sizeof(vh));
+	    if (cc < 4 + _vnet_hdr_sz) {
+		p->kill();
+		return true;
+	    } else if (vh.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+		gso_segment(frame + 4 + _vnet_hdr_sz, cc - 4 - _vnet_hdr_sz, &vh, now);
+		p->kill();
+		return true;
+	    } else if (cc > _mtu_in) {
+		++_gso_drops;
+		p->kill();
+		return true;
+	    }
+	    p->take(_mtu_in - cc);
+	    int cs = vh.csum_start + 4 + _vnet_hdr_sz;
+	    if ((vh.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+		&& cs + vh.csum_offset + 2 <= cc) {
+		uint16_t csum = click_in_cksum(p->data() + cs, cc - cs);
+		if (csum == 0 && vh.csum_offset == 6)
+		    // UDP sends a zero checksum as all ones
+		    csum = 0xFFFF;
+		memcpy(p->data() + cs + vh.csum_offset, &csum, 2);
+	    }
+	} else
+#endif
+	p->take(_mtu_in - cc);
+
 	if (_tap) {
 	    if (_type == LINUX_UNIVERSAL)
 		// 2-byte padding, 2-byte Ethernet type, then Ethernet header
-		p->pull(4);
+		p->pull(4 + _vnet_hdr_sz);
 	    else if (_type == LINUX_ETHERTAP)
 		// 2-byte padding, then Ethernet header
 		p->pull(2);
@@ -528,7 +836,7 @@ KernelTun::one_selected(const Timestamp &now)
 	} else if (_type == LINUX_UNIVERSAL) {
 	    // 2-byte padding followed by an Ethernet type
 	    uint16_t etype = *(uint16_t *)(p->data() + 2);
-	    p->pull(4);
+	    p->pull(4 + _vnet_hdr_sz);
 	    if (etype != htons(ETHERTYPE_IP) && etype != htons(ETHERTYPE_IP6))
 		checked_output_push(1, p->clone());
 	    else
@@ -556,7 +864,7 @@ KernelTun::one_selected(const Timestamp &now)
 
 	if (ok) {
 	    p->set_timestamp_anno(now);
-	    output(0).push(p);
+	    _rx_batch.append(p);
 	} else
 	    checked_output_push(1, p);
 	return true;
@@ -616,8 +924,8 @@ KernelTun::push(int, Packet *p)
 	check_length = p->length();
     }
 
-    // check MTU
-    if (check_length > _mtu_out) {
+    // check MTU, super-frames are segmented by the kernel
+    if (check_length > _mtu_out && !(_vnet_hdr && GSO_SIZE_ANNO(p))) {
 	click_chatter("%s(%s): packet larger than MTU (%d)", class_name(), _dev_name.c_str(), _mtu_out);
 	goto kill;
     }
@@ -627,8 +935,13 @@ KernelTun::push(int, Packet *p)
 	if (_type == LINUX_UNIVERSAL) {
 	    // 2-byte padding, 2-byte Ethernet type, then Ethernet header
 	    uint16_t ethertype = ((const click_ether *) p->data())->ether_type;
-	    if ((q = p->push(4)))
+	    if ((q = p->push(4 + _vnet_hdr_sz))) {
 		((uint16_t *) q->data())[1] = ethertype;
+#if KERNELTUN_VNET
+		if (_vnet_hdr)
+		    set_vnet_hdr(q);
+#endif
+	    }
 	    p = q;
 	} else if (_type == LINUX_ETHERTAP) {
 	    // 2-byte padding, then Ethernet header
@@ -639,8 +952,13 @@ KernelTun::push(int, Packet *p)
     } else if (_type == LINUX_UNIVERSAL) {
 	// 2-byte padding followed by an Ethernet type
 	uint32_t ethertype = (iph->ip_v == 4 ? htonl(ETHERTYPE_IP) : htonl(ETHERTYPE_IP6));
-	if ((q = p->push(4)))
+	if ((q = p->push(4 + _vnet_hdr_sz))) {
 	    *(uint32_t *)(q->data()) = ethertype;
+#if KERNELTUN_VNET
+	    if (_vnet_hdr)
+		set_vnet_hdr(q);
+#endif
+	}
 	p = q;
     } else if (_type == BSD_TUN) {
 	uint32_t af = (iph->ip_v == 4 ? htonl(AF_INET) : htonl(AF_INET6));
@@ -663,7 +981,9 @@ KernelTun::push(int, Packet *p)
     }
 
     if (p) {
-	int w = write(_fd, p->data(), p->length());
+	// every thread writes to its own queue
+	int fd = (_fds.size() > 1 ? _fds[click_current_cpu_id() % _fds.size()] : _fd);
+	int w = write(fd, p->data(), p->length());
 	if (w != (int) p->length() && (errno != ENOBUFS || !_ignore_q_errs || !_printed_write_err)) {
 	    _printed_write_err = true;
 	    click_chatter("%s(%s): write failed: %s", class_name(), _dev_name.c_str(), strerror(errno));
@@ -681,6 +1001,10 @@ KernelTun::add_handlers()
     add_data_handlers("dev_name", Handler::OP_READ, &_dev_name);
     add_data_handlers("selected_calls", Handler::OP_READ, &_selected_calls);
     add_data_handlers("packets", Handler::OP_READ, &_packets);
+    if (_gso) {
+	add_data_handlers("gso_packets", Handler::OP_READ, &_gso_packets);
+	add_data_handlers("gso_drops", Handler::OP_READ, &_gso_drops);
+    }
 }
 
 CLICK_ENDDECLS
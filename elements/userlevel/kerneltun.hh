@@ -5,12 +5,14 @@
 #include <click/etheraddress.hh>
 #include <click/task.hh>
 #include <click/notifier.hh>
+#include <click/vector.hh>
+struct virtio_net_hdr;
 CLICK_DECLS
 
 /*
 =c
 
-KernelTun(ADDR/MASK [, GATEWAY, I<keywords> HEADROOM, ETHER, MTU, IGNORE_QUEUE_OVERFLOWS])
+KernelTun(ADDR/MASK [, GATEWAY, I<keywords> HEADROOM, ETHER, MTU, IGNORE_QUEUE_OVERFLOWS, QUEUES, GSO])
 
 =s comm
 
@@ -42,12 +44,14 @@ Keyword arguments are:
 
 =item BURST
 
-Integer. The maximum number of packets to emit per scheduling. Default is 1.
+Integer. The maximum number of packets to emit per scheduling. The packets
+read are pushed downstream together, as a batch. Default is 1.
 
 =item HEADROOM
 
 Integer. The number of bytes left empty before output packet data to leave
-room for additional encapsulation headers. Default is 28.
+room for additional encapsulation headers. Default is 28, or the bytes the
+elements downstream declare they push, if more (see HeadroomTracker).
 
 =item MTU
 
@@ -73,6 +77,36 @@ String. If specified, try to alloc a tun device with name DEVNAME.
 Otherwise, we'll just take the first virtual device we find. This option
 only works with the Linux Universal TUN/TAP driver.
 
+=item QUEUES
+
+Integer. Number of queues of the device, each with its own file
+descriptor. Packets are written to the queue of the Click thread that
+sends them, so that threads do not contend on the same descriptor. Only
+works with the Linux Universal TUN/TAP driver. Default is 1.
+
+=item VNET_HDR
+
+Boolean. If true, every read and write carries a virtio-net header. Only
+works with the Linux Universal TUN/TAP driver. Default is false.
+
+=item GSO
+
+Boolean. If true, let the kernel hand TCP segmentation and checksum work
+over to KernelTun: a single read returns a TCP super-frame of up to 64 kB,
+which KernelTun cuts into MTU-sized segments and checksums before emitting
+them. Implies VNET_HDR. Default is false.
+
+=item SEGMENT
+
+Boolean. If false, TCP super-frames read with GSO are emitted whole, with
+their segment size in the GSO size annotation, for an element further down
+the path to segment them, e.g. EmpowerQOSManager. Their checksums are left
+to that element too. Default is true.
+
+With VNET_HDR, packets sent to KernelTun that have a nonzero GSO size
+annotation, such as the super-frames of EmpowerGRO, are handed to the
+kernel whole for it to segment, and may exceed the MTU.
+
 =back
 
 =n
@@ -134,6 +168,8 @@ class KernelTun : public Element { public:
 		NETBSD_TUN, NETBSD_TAP };
 
     int _fd;
+    Vector<int> _fds;
+    unsigned _nqueues;
     int _mtu_in;
     int _mtu_out;
     Type _type;
@@ -145,6 +181,8 @@ class KernelTun : public Element { public:
     EtherAddress _macaddr;
     unsigned _headroom;
     unsigned _burst;
+    // packets of the current burst, pushed downstream together
+    PacketBatch _rx_batch;
     Task _task;
     NotifierSignal _signal;
 
@@ -152,9 +190,16 @@ class KernelTun : public Element { public:
     bool _printed_write_err;
     bool _printed_read_err;
     bool _adjust_headroom;
+    bool _vnet_hdr;
+    bool _gso;
+    bool _segment;
+    int _vnet_hdr_sz;
+    unsigned char *_gso_buf;
 
     click_uint_large_t _selected_calls;
     click_uint_large_t _packets;
+    click_uint_large_t _gso_packets;
+    click_uint_large_t _gso_drops;
 
 #if HAVE_LINUX_IF_TUN_H
     int try_linux_universal();
@@ -163,7 +208,9 @@ class KernelTun : public Element { public:
     int alloc_tun(ErrorHandler *);
     int setup_tun(ErrorHandler *);
     int updown(IPAddress, IPAddress, ErrorHandler *);
-    bool one_selected(const Timestamp &now);
+    bool one_selected(int fd, const Timestamp &now);
+    void gso_segment(const unsigned char *, int, const struct virtio_net_hdr *, const Timestamp &);
+    void set_vnet_hdr(WritablePacket *);
 
     friend class KernelTap;
 
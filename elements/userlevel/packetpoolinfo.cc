@@ -0,0 +1,86 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * packetpoolinfo.{cc,hh} -- element reserves packet data buffers and
+ * reports on the packet pools
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "packetpoolinfo.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet.hh>
+CLICK_DECLS
+
+PacketPoolInfo::PacketPoolInfo()
+{
+}
+
+PacketPoolInfo::~PacketPoolInfo()
+{
+}
+
+int
+PacketPoolInfo::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<String> reserve;
+    bool hugepages = false;
+    if (Args(conf, this, errh)
+	.read_all("RESERVE", AnyArg(), reserve)
+	.read("HUGEPAGES", hugepages)
+	.complete() < 0)
+	return -1;
+
+    for (String *it = reserve.begin(); it != reserve.end(); ++it) {
+	uint32_t size, count;
+	if (Args(this, errh).push_back_words(*it)
+	    .read_mp("SIZE", size)
+	    .read_mp("COUNT", count)
+	    .complete() < 0)
+	    return -1;
+	int c = Packet::pool_reserve(size, count, hugepages);
+	if (c == -EINVAL)
+	    return errh->error("RESERVE size %u too large for the packet pools", size);
+	else if (c < 0)
+	    return errh->error("RESERVE %u %u: out of memory", size, count);
+	Packet::PoolStats stats;
+	if (hugepages && Packet::pool_stats(c, stats) && !stats.hugepages)
+	    errh->warning("no hugepages for %u byte buffers, using ordinary pages", stats.buffer_size);
+    }
+    return 0;
+}
+
+String
+PacketPoolInfo::read_handler(Element *, void *)
+{
+    StringAccum sa;
+    Packet::PoolStats stats;
+    for (int c = 0; Packet::pool_stats(c, stats); ++c)
+	sa << stats.buffer_size << " limit " << stats.limit
+	   << " free " << stats.free << " spare " << stats.spare
+	   << " reserved " << stats.reserved
+	   << " hugepages " << (stats.hugepages ? "true" : "false")
+	   << " hits " << stats.hits << " misses " << stats.misses
+	   << " frees " << stats.frees << '\n';
+    return sa.take_string();
+}
+
+void
+PacketPoolInfo::add_handlers()
+{
+    add_read_handler("stats", read_handler);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(PacketPoolInfo)
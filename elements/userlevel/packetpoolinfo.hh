@@ -0,0 +1,80 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PACKETPOOLINFO_HH
+#define CLICK_PACKETPOOLINFO_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+PacketPoolInfo([I<keywords> RESERVE, HUGEPAGES])
+
+=s information
+
+reserves packet data buffers and reports on the packet pools
+
+=d
+
+Click keeps freed packet data buffers in per-thread pools, with a global
+pool that evens out imbalance between threads, and reuses them for new
+packets. Buffers come in size classes of 2048, 9216 and 65536 bytes; a
+packet gets a buffer of the smallest class that fits, and buffers larger
+than 65536 bytes come from the heap.
+
+PacketPoolInfo reserves buffers ahead of time. Reserved buffers are
+allocated in large arenas and never return to the heap: once thread and
+global pools are full, they wait on a global overflow list until a pool
+runs dry.
+
+Keyword arguments are:
+
+=over 8
+
+=item RESERVE
+
+Buffer size and count, separated by a space, such as C<2048 10000>. The
+size is rounded up to its size class. Reserving a class again only
+allocates the buffers missing to reach the count. May be given several
+times.
+
+=item HUGEPAGES
+
+Boolean. If true, back reserved buffers with hugepages when the system
+has some free; see F<Documentation/vm/hugetlbpage.txt> in the Linux
+sources. Falls back to ordinary pages with a warning. Default is false.
+
+=back
+
+=h stats read-only
+
+One line per size class: the buffer size, the number of free buffers a
+thread's pool keeps at most, the free buffers in all pools, the reserved
+buffers on the overflow list, the number of buffers reserved, and whether
+they use hugepages; then the buffers allocated from a pool, allocated from
+the heap, and returned to the heap.
+
+=e
+
+  PacketPoolInfo(RESERVE 2048 65536, RESERVE 9216 1024, HUGEPAGES true);
+
+=a FromDevice.u, KernelTap */
+
+class PacketPoolInfo : public Element { public:
+
+    PacketPoolInfo() CLICK_COLD;
+    ~PacketPoolInfo() CLICK_COLD;
+
+    const char *class_name() const	{ return "PacketPoolInfo"; }
+
+    int configure_phase() const		{ return CONFIGURE_PHASE_FIRST; }
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+  private:
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
@@ -34,6 +35,9 @@
 #include <click/timer.hh>
 #include <click/handlercall.hh>
 #include "socket.hh"
+#if CLICK_SOCKET_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
 
 #ifdef HAVE_PROPER
 #include <proper/prop.h>
@@ -43,12 +47,15 @@ CLICK_DECLS
 
 Socket::Socket()
   : _task(this), _timer(this),
-    _fd(-1), _active(-1), _rq(0), _wq(0),
+    _fd(-1), _active(-1), _rq(0), _wq(0), _wq_tail(0), _wq_count(0), _gather(64),
+    _zerocopy(0), _zc_next(0), _zc_done(0), _wq_zc(false), _wq_zc_id(0),
+    _writes(0), _zc_writes(0), _zc_copied(0),
     _local_port(0), _local_pathname(""),
     _timestamp(true), _sndbuf(-1), _rcvbuf(-1),
     _snaplen(2048), _headroom(Packet::default_headroom), _nodelay(1),
     _verbose(false), _client(false), _proper(false), _allow(0), _deny(0), _reconnect_call_h(0)
 {
+  memset(_zc_window, 0, sizeof(_zc_window));
 }
 
 Socket::~Socket()
@@ -84,6 +91,8 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   if (args.read("VERBOSE", _verbose)
       .read("SNAPLEN", _snaplen)
       .read("HEADROOM", _headroom)
+      .read("GATHER", _gather)
+      .read("ZEROCOPY", _zerocopy)
       .read("TIMESTAMP", _timestamp)
       .read("RCVBUF", _rcvbuf)
       .read("SNDBUF", _sndbuf)
@@ -96,6 +105,9 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
       .consume() < 0)
     return -1;
 
+  if (_gather < 1 || _gather > MAX_GATHER)
+    return errh->error("GATHER must be between 1 and %d", MAX_GATHER);
+
   if (reconnect_call)
     _reconnect_call_h = new HandlerCall(reconnect_call);
 
@@ -139,6 +151,18 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
+#if CLICK_SOCKET_ZEROCOPY
+  if (_zerocopy && _protocol != IPPROTO_TCP) {
+    errh->warning("ZEROCOPY applies to TCP sockets only");
+    _zerocopy = 0;
+  }
+#else
+  if (_zerocopy) {
+    errh->warning("ZEROCOPY not supported on this system");
+    _zerocopy = 0;
+  }
+#endif
+
   return 0;
 }
 
@@ -211,6 +235,17 @@ Socket::initialize(ErrorHandler *errh)
       return initialize_socket_error(errh, "setsockopt(TCP_NODELAY)");
 #endif
 
+#if CLICK_SOCKET_ZEROCOPY
+  // allow MSG_ZEROCOPY, accepted connections inherit it
+  if (_zerocopy) {
+    int one = 1;
+    if (setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+      errh->warning("setsockopt(SO_ZEROCOPY): %s, ZEROCOPY disabled", strerror(errno));
+      _zerocopy = 0;
+    }
+  }
+#endif
+
   // set socket send buffer size
   if (_sndbuf >= 0)
     if (setsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &_sndbuf, sizeof(_sndbuf)) < 0)
@@ -297,8 +332,13 @@ Socket::cleanup(CleanupStage)
   }
   if (_rq)
     _rq->kill();
-  if (_wq)
-    _wq->kill();
+  while (Packet *p = _wq) {
+    _wq = p->next();
+    p->kill();
+  }
+  _wq_tail = 0;
+  _wq_count = 0;
+  clear_zerocopy();
   if (_fd >= 0) {
     // shut down the listening socket in case we forked
 #ifdef SHUT_RDWR
@@ -335,6 +375,8 @@ Socket::close_active(void)
     if (_verbose)
       click_chatter("%s: closed connection %d", declaration().c_str(), _active);
     _active = -1;
+    // the write numbers start over with the next connection
+    clear_zerocopy();
   }
 }
 
@@ -486,6 +528,196 @@ Socket::write_packet(Packet *p)
   return 0;
 }
 
+void
+Socket::retire(Packet *p, bool zc, uint32_t id)
+{
+  if (zc) {
+    ZeroCopyPacket zp;
+    zp.p = p;
+    zp.id = id;
+    _zc_packets.push_back(zp);
+  } else
+    p->kill();
+}
+
+// Writes the packets pulled, up to _gather at a time, with one writev()
+// each. Returns -1 if the socket would block, with the packets left in _wq
+int
+Socket::write_gather(bool &any)
+{
+  struct iovec iov[MAX_GATHER];
+  bool copy = false;
+
+  assert(_active >= 0);
+
+#if CLICK_SOCKET_ZEROCOPY
+  if (_zerocopy)
+    reap_zerocopy();
+#endif
+
+  while (1) {
+    // top up the batch
+    while (_wq_count < _gather) {
+      Packet *p = input(0).pull();
+      if (!p)
+	break;
+      any = true;
+      p->set_next(0);
+      if (_wq_tail)
+	_wq_tail->set_next(p);
+      else
+	_wq = p;
+      _wq_tail = p;
+      _wq_count++;
+    }
+
+    if (!_wq)
+      return 0;
+
+    int n = 0;
+    size_t bytes = 0;
+    for (Packet *p = _wq; p; p = p->next(), n++) {
+      iov[n].iov_base = const_cast<unsigned char *>(p->data());
+      iov[n].iov_len = p->length();
+      bytes += p->length();
+    }
+
+    // write segments
+    bool zc = false;
+    ssize_t len;
+#if CLICK_SOCKET_ZEROCOPY
+    zc = _zerocopy && !copy && bytes >= _zerocopy && _zc_next - _zc_done < ZC_WINDOW;
+    if (zc) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = n;
+      len = sendmsg(_active, &msg, MSG_ZEROCOPY);
+    } else
+#endif
+      len = writev(_active, iov, n);
+    copy = false;
+
+    // error
+    if (len < 0) {
+      // out of memory for the notifications, copy this one
+      if (zc && errno == ENOBUFS) {
+	copy = true;
+	continue;
+      }
+
+      // out of memory or would block
+      else if (errno == ENOBUFS || errno == EAGAIN)
+	return -1;
+
+      // interrupted by signal, try again immediately
+      else if (errno == EINTR)
+	continue;
+
+      // connection probably terminated or other fatal error
+      else {
+	if (_verbose)
+	  click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+	close_active();
+	return 0;
+      }
+    }
+
+    _writes++;
+    uint32_t id = 0;
+    if (zc && len > 0) {
+      id = _zc_next++;
+      _zc_writes++;
+    } else
+      zc = false;
+
+    // these segments OK; the kernel may still read the data of a
+    // MSG_ZEROCOPY write, so its packets live until it completes
+    while (_wq && (size_t) len >= _wq->length()) {
+      Packet *p = _wq;
+      len -= p->length();
+      _wq = p->next();
+      if (!_wq)
+	_wq_tail = 0;
+      _wq_count--;
+      p->set_next(0);
+      if (_wq_zc && !zc)
+	retire(p, true, _wq_zc_id);
+      else
+	retire(p, zc, id);
+      _wq_zc = false;
+    }
+
+    // this one partly
+    if (len > 0) {
+      _wq->pull(len);
+      if (zc) {
+	_wq_zc = true;
+	_wq_zc_id = id;
+      }
+    }
+  }
+}
+
+#if CLICK_SOCKET_ZEROCOPY
+// Reads the completions of MSG_ZEROCOPY writes from the error queue, and
+// kills the packets of the writes completed, in order
+void
+Socket::reap_zerocopy()
+{
+  while (1) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(_active, &msg, MSG_ERRQUEUE) < 0)
+      break;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+	    || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+	continue;
+      struct sock_extended_err *ee = (struct sock_extended_err *) CMSG_DATA(cm);
+      if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+	continue;
+      // writes ee_info to ee_data completed
+      for (uint32_t id = ee->ee_info; (int32_t) (ee->ee_data - id) >= 0; id++)
+	if (id - _zc_done < ZC_WINDOW)
+	  _zc_window[(id % ZC_WINDOW) / 32] |= 1U << (id % 32);
+      if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+	_zc_copied += ee->ee_data - ee->ee_info + 1;
+    }
+  }
+
+  while (_zc_done != _zc_next) {
+    uint32_t &w = _zc_window[(_zc_done % ZC_WINDOW) / 32];
+    uint32_t bit = 1U << (_zc_done % 32);
+    if (!(w & bit))
+      break;
+    w &= ~bit;
+    _zc_done++;
+  }
+
+  while (!_zc_packets.empty() && (int32_t) (_zc_packets.front().id - _zc_done) < 0) {
+    _zc_packets.front().p->kill();
+    _zc_packets.pop_front();
+  }
+}
+#endif
+
+void
+Socket::clear_zerocopy()
+{
+  while (!_zc_packets.empty()) {
+    _zc_packets.front().p->kill();
+    _zc_packets.pop_front();
+  }
+  _zc_next = _zc_done = 0;
+  memset(_zc_window, 0, sizeof(_zc_window));
+  _wq_zc = false;
+}
+
 void
 Socket::push(int, Packet *p)
 {
@@ -526,22 +758,30 @@ Socket::run_task(Task *)
     Packet *p = 0;
     int err = 0;
 
-    // write as much as we can
-    do {
-      p = _wq ? _wq : input(0).pull();
-      _wq = 0;
-      if (p) {
-	any = true;
-	err = write_packet(p);
-      }
-    } while (p && err >= 0);
+    if (_socktype == SOCK_STREAM) {
+      // write as much as we can, gathered
+      err = write_gather(any);
+      if (_active < 0)
+	return any;
+    } else {
+      // write as much as we can
+      do {
+	p = _wq ? _wq : input(0).pull();
+	_wq = 0;
+	if (p) {
+	  any = true;
+	  err = write_packet(p);
+	}
+      } while (p && err >= 0);
 
-    if (err < 0) {
       // queue packet for writing when socket becomes available
-      _wq = p;
-      p = 0;
+      if (err < 0)
+	_wq = p;
+    }
+
+    if (err < 0)
       add_select(_active, SELECT_WRITE);
-    } else if (_signal)
+    else if (_signal)
       // more pending
       // (can't use fast_reschedule() cause selected() calls this)
       _task.reschedule();
@@ -558,6 +798,9 @@ void
 Socket::add_handlers()
 {
   add_task_handlers(&_task);
+  add_data_handlers("writes", Handler::OP_READ, &_writes);
+  add_data_handlers("zerocopy_writes", Handler::OP_READ, &_zc_writes);
+  add_data_handlers("zerocopy_copied", Handler::OP_READ, &_zc_copied);
 }
 
 CLICK_ENDDECLS
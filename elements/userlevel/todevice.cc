@@ -46,13 +46,10 @@
 # include <sys/socket.h>
 # include <sys/ioctl.h>
 # include <net/if.h>
-# include <net/if_packet.h>
 # include <features.h>
-# if __GLIBC__ >= 2 && __GLIBC_MINOR__ >= 1
-#  include <netpacket/packet.h>
-# else
-#  include <linux/if_packet.h>
-# endif
+# include <linux/if_packet.h>
+# include <sys/mman.h>
+# include <sys/uio.h>
 #endif
 #if TODEVICE_ALLOW_NETMAP
 //# include <sys/mman.h>
@@ -61,7 +58,7 @@
 CLICK_DECLS
 
 ToDevice::ToDevice()
-    : _task(this), _timer(&_task), _q(0), _pulls(0)
+    : _task(this), _timer(&_task), _q(0), _pulls(0), _kick_errors(0)
 {
 #if TODEVICE_ALLOW_PCAP
     _pcap = 0;
@@ -71,22 +68,45 @@ ToDevice::ToDevice()
     _fd = -1;
     _my_fd = false;
 #endif
+#if TODEVICE_ALLOW_LINUX
+    _batch = 0;
+    _nbatch = 0;
+    _msgs = 0;
+    _iov = 0;
+    _ring = 0;
+    _ring_frame = 0;
+#endif
+#if TODEVICE_ALLOW_XDP
+    _xsk = 0;
+    _queue = 0;
+#endif
 }
 
 ToDevice::~ToDevice()
 {
+#if TODEVICE_ALLOW_LINUX
+    delete[] _batch;
+    delete[] _msgs;
+    delete[] _iov;
+#endif
 }
 
 int
 ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String method;
+    int queue = 0;
+    bool has_queue;
     _burst = 1;
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read("DEBUG", _debug)
 	.read("METHOD", WordArg(), method)
 	.read("BURST", _burst)
+#if TODEVICE_ALLOW_LINUX
+	.read("FLUSH_DELAY", _flush_delay)
+#endif
+	.read("QUEUE", queue).read_status(has_queue)
 	.complete() < 0)
 	return -1;
     if (!_ifname)
@@ -108,6 +128,10 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if TODEVICE_ALLOW_LINUX
     else if (method == "LINUX")
 	_method = method_linux;
+    else if (method == "SENDMMSG")
+	_method = method_sendmmsg;
+    else if (method == "PACKET_MMAP")
+	_method = method_mmap;
 #endif
 #if TODEVICE_ALLOW_DEVBPF
     else if (method == "DEVBPF")
@@ -120,10 +144,20 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if TODEVICE_ALLOW_NETMAP
     else if (method == "NETMAP")
 	_method = method_netmap;
+#endif
+#if TODEVICE_ALLOW_XDP
+    else if (method == "XDP")
+	_method = method_xdp;
 #endif
     else
 	return errh->error("bad METHOD");
 
+    if (has_queue && _method != method_xdp)
+	return errh->error("QUEUE requires METHOD XDP");
+#if TODEVICE_ALLOW_XDP
+    _queue = queue;
+#endif
+
     return 0;
 }
 
@@ -157,6 +191,10 @@ ToDevice::initialize(ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_LINUX && TODEVICE_ALLOW_LINUX
 	if (fd->linux_fd() >= 0)
 	    _method = method_linux;
+#endif
+#if TODEVICE_ALLOW_XDP
+	if (fd->xsk())
+	    _method = method_xdp;
 #endif
     }
 
@@ -234,6 +272,46 @@ ToDevice::initialize(ErrorHandler *errh)
 	}
 	_method = method_linux;
     }
+
+    if (_method == method_sendmmsg || _method == method_mmap) {
+	if (_method == method_sendmmsg && fd && fd->linux_fd() >= 0)
+	    _fd = fd->linux_fd();
+	else {
+	    _fd = FromDevice::open_packet_socket(_ifname, errh);
+	    if (_fd < 0)
+		return -1;
+	    _my_fd = true;
+	}
+	if (_method == method_mmap && open_tx_ring(errh) < 0)
+	    return -1;
+	_batch = new Packet *[_burst];
+	_msgs = new struct mmsghdr[_burst];
+	_iov = new struct iovec[_burst];
+	memset(_msgs, 0, sizeof(struct mmsghdr) * _burst);
+	for (int i = 0; i < _burst; i++) {
+	    _msgs[i].msg_hdr.msg_iov = &_iov[i];
+	    _msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+    }
+#endif
+
+#if TODEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	// share the socket of the FromDevice reading the same queue
+	Router *r = router();
+	for (int ei = 0; ei < r->nelements() && !_xsk; ++ei) {
+	    FromDevice *rfd = (FromDevice *) r->element(ei)->cast("FromDevice");
+	    if (rfd && rfd->ifname() == _ifname && rfd->xsk()
+		&& rfd->xsk()->queue() == _queue) {
+		_xsk = rfd->xsk();
+		_xsk->acquire();
+	    }
+	}
+	if (!_xsk && !(_xsk = XskInfo::open(_ifname, _queue, false, errh)))
+	    return -1;
+	_fd = _xsk->fd();
+	_batch = new Packet *[_burst];
+    }
 #endif
 
 #if TODEVICE_ALLOW_PCAPFD
@@ -272,6 +350,21 @@ ToDevice::cleanup(CleanupStage)
 	_fd = -1;
     }
 #endif
+#if TODEVICE_ALLOW_LINUX
+    for (int i = 0; i < _nbatch; i++)
+	_batch[i]->kill();
+    _nbatch = 0;
+    if (_ring)
+	munmap(_ring, (size_t) ring_block_size * ring_blocks);
+    _ring = 0;
+#endif
+#if TODEVICE_ALLOW_XDP
+    if (_xsk) {
+	_xsk->release();
+	_fd = -1;
+    }
+    _xsk = 0;
+#endif
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD || TODEVICE_ALLOW_NETMAP
     if (_fd >= 0 && _my_fd)
 	close(_fd);
@@ -279,6 +372,160 @@ ToDevice::cleanup(CleanupStage)
 #endif
 }
 
+#if TODEVICE_ALLOW_LINUX
+int
+ToDevice::open_tx_ring(ErrorHandler *errh)
+{
+    int version = TPACKET_V2;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	return errh->error("%s: PACKET_VERSION: %s", _ifname.c_str(), strerror(errno));
+
+    struct tpacket_req req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ring_block_size;
+    req.tp_block_nr = ring_blocks;
+    req.tp_frame_size = ring_frame_size;
+    req.tp_frame_nr = (ring_block_size / ring_frame_size) * ring_blocks;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+	return errh->error("%s: PACKET_TX_RING: %s", _ifname.c_str(), strerror(errno));
+
+    void *ring = mmap(0, (size_t) ring_block_size * ring_blocks,
+		      PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (ring == MAP_FAILED)
+	return errh->error("%s: mmap: %s", _ifname.c_str(), strerror(errno));
+    _ring = (unsigned char *) ring;
+    _ring_frame = 0;
+    return 0;
+}
+
+// Hand the first _nbatch packets to the kernel at once. Returns the number
+// of packets the kernel took, or a negative errno if it took none.
+int
+ToDevice::send_batch()
+{
+#if TODEVICE_ALLOW_XDP
+    if (_method == method_xdp)
+	return _xsk->send(_batch, _nbatch, noutputs() == 0);
+#endif
+
+    if (_method == method_sendmmsg) {
+	for (int i = 0; i < _nbatch; i++) {
+	    _iov[i].iov_base = (void *) _batch[i]->data();
+	    _iov[i].iov_len = _batch[i]->length();
+	}
+	int r = sendmmsg(_fd, _msgs, _nbatch, MSG_DONTWAIT);
+	return r >= 0 ? r : -errno;
+    }
+
+    // PACKET_MMAP, frames are laid out back to back in the blocks
+    const unsigned nframes = (ring_block_size / ring_frame_size) * ring_blocks;
+    const unsigned offset = TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+    int n = 0;
+    while (n < _nbatch) {
+	struct tpacket2_hdr *h = (struct tpacket2_hdr *)
+	    (_ring + (size_t) _ring_frame * ring_frame_size);
+	if (h->tp_status != TP_STATUS_AVAILABLE && h->tp_status != TP_STATUS_WRONG_FORMAT)
+	    break;
+	// the kernel released the frame before we read its status
+	click_fence();
+	Packet *p = _batch[n];
+	memcpy((unsigned char *) h + offset, p->data(), p->length());
+	h->tp_len = p->length();
+	// publish the frame before passing it to the kernel
+	click_fence();
+	h->tp_status = TP_STATUS_SEND_REQUEST;
+	if (++_ring_frame == nframes)
+	    _ring_frame = 0;
+	n++;
+    }
+    // the frames are in the ring whatever the kick says, the next kick
+    // sends them
+    if (n && send(_fd, 0, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+	++_kick_errors;
+	if (_debug)
+	    click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(errno));
+    }
+    return n ? n : -ENOBUFS;
+}
+
+bool
+ToDevice::run_task_batch()
+{
+    unsigned max_length = ring_frame_size - TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+#if TODEVICE_ALLOW_XDP
+    if (_method == method_xdp)
+	max_length = XskInfo::frame_size;
+#endif
+
+    if (_nbatch < _burst) {
+	// one pull for the free slots of the batch
+	++_pulls;
+	Packet *head = input(0).pull_batch(_burst - _nbatch);
+	while (Packet *p = PacketBatch::pop(head)) {
+	    if ((_method == method_mmap || _method == method_xdp)
+		&& p->length() > max_length) {
+		click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(EMSGSIZE));
+		checked_output_push(1, p);
+		continue;
+	    }
+	    _batch[_nbatch++] = p;
+	}
+    }
+
+    if (!_nbatch) {
+	_flush_deadline = Timestamp();
+	if (_signal)
+	    _task.fast_reschedule();
+	return false;
+    }
+
+    // a partial batch waits for more packets until the flush deadline
+    if (_nbatch < _burst && _flush_delay) {
+	Timestamp now = Timestamp::recent_steady();
+	if (!_flush_deadline)
+	    _flush_deadline = now + _flush_delay;
+	if (now < _flush_deadline) {
+	    if (_signal)
+		_task.fast_reschedule();
+	    else if (!_timer.scheduled())
+		_timer.schedule_at_steady(_flush_deadline);
+	    return false;
+	}
+    }
+    _flush_deadline = Timestamp();
+
+    int r = send_batch();
+    int sent = (r > 0 ? r : 0);
+    for (int i = 0; i < sent; i++)
+	checked_output_push(0, _batch[i]);
+    if (r < 0 && r != -ENOBUFS && r != -EAGAIN) {
+	// the first packet is at fault
+	click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(-r));
+	checked_output_push(1, _batch[0]);
+	sent = 1;
+    }
+    _nbatch -= sent;
+    memmove(_batch, _batch + sent, sizeof(Packet *) * _nbatch);
+
+    if (r == -ENOBUFS || r == -EAGAIN) {
+	if (!_backoff) {
+	    _backoff = 1;
+	    add_select(_fd, SELECT_WRITE);
+	} else {
+	    _timer.schedule_after(Timestamp::make_usec(_backoff));
+	    if (_backoff < 256)
+		_backoff *= 2;
+	}
+	return false;
+    }
+
+    _backoff = 0;
+    if (_nbatch || _signal)
+	_task.fast_reschedule();
+    return sent > 0;
+}
+#endif
+
 
 /*
  * Linux select marks datagram fd's as writeable when the socket
@@ -342,6 +589,12 @@ ToDevice::send_packet(Packet *p)
 bool
 ToDevice::run_task(Task *)
 {
+#if TODEVICE_ALLOW_LINUX
+    if (_method == method_sendmmsg || _method == method_mmap
+	|| _method == method_xdp)
+	return run_task_batch();
+#endif
+
     Packet *p = _q;
     _q = 0;
     int count = 0, r = 0;
@@ -407,7 +660,13 @@ ToDevice::read_param(Element *e, void *thunk)
 	return String(td->_signal);
     case h_pulls:
 	return String(td->_pulls);
+    case h_kick_errors:
+	return String(td->_kick_errors);
     case h_q:
+#if TODEVICE_ALLOW_LINUX
+	if (td->_nbatch)
+	    return String(true);
+#endif
 	return String((bool) td->_q);
     default:
 	return String();
@@ -438,6 +697,7 @@ ToDevice::add_handlers()
     add_task_handlers(&_task);
     add_read_handler("debug", read_param, h_debug, Handler::CHECKBOX);
     add_read_handler("pulls", read_param, h_pulls);
+    add_read_handler("kick_errors", read_param, h_kick_errors);
     add_read_handler("signal", read_param, h_signal);
     add_read_handler("q", read_param, h_q);
     add_write_handler("debug", write_param, h_debug);
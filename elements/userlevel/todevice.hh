@@ -29,14 +29,42 @@ CLICK_DECLS
  * =item BURST
  *
  * Integer. Maximum number of packets to pull per scheduling. Defaults to 1.
+ * With the SENDMMSG and PACKET_MMAP methods, this is also the number of
+ * packets handed to the kernel at once, and they are pulled from upstream
+ * with a single batch pull.
  *
  * =item METHOD
  *
  * Word. Defines the method ToDevice will use to write packets to the
- * device. Linux targets generally support PCAP and LINUX; other targets
- * support PCAP or, occasionally, other methods. Defaults to the method
- * specified for a matching L<FromDevice(n)>, or the first supported
- * method among NETMAP, PCAP, DEVBPF, LINUX and PCAPFD otherwise.
+ * device. Linux targets generally support PCAP, LINUX, SENDMMSG, PACKET_MMAP
+ * and XDP; other targets support PCAP or, occasionally, other methods.
+ * Defaults to the method specified for a matching L<FromDevice(n)>, or the
+ * first supported method among NETMAP, PCAP, DEVBPF, LINUX and PCAPFD
+ * otherwise.
+ *
+ * SENDMMSG sends the packets pulled in one scheduling with a single
+ * sendmmsg() call on a packet socket. PACKET_MMAP copies them to a
+ * TPACKET_V2 transmit ring shared with the kernel and kicks the kernel
+ * once. Packets longer than a ring frame (about 2 kB) are pushed to
+ * output 1. A failed kick leaves the packets in the ring for the next one
+ * and is counted by the I<kick_errors> handler.
+ *
+ * XDP sends through the AF_XDP socket of the L<FromDevice.u> with METHOD XDP
+ * on the same device and QUEUE, or through a socket of its own if there is
+ * none. Packets are copied into the memory of the socket, except, when
+ * ToDevice has no outputs, the packets that socket received, which are sent
+ * in place. Packets longer than 2 kB are pushed to output 1.
+ *
+ * =item QUEUE
+ *
+ * Integer. With METHOD XDP, the queue of the device to send on. Defaults to
+ * 0.
+ *
+ * =item FLUSH_DELAY
+ *
+ * Timestamp. With SENDMMSG and PACKET_MMAP, how long a batch of fewer than
+ * BURST packets may wait for more packets before it is sent anyway. Zero
+ * sends whatever is available at every scheduling. Defaults to 0.
  *
  * =item DEBUG
  *
@@ -82,6 +110,9 @@ extern "C" {
 #if FROMDEVICE_ALLOW_NETMAP
 # define TODEVICE_ALLOW_NETMAP 1
 #endif
+#if FROMDEVICE_ALLOW_XDP
+# define TODEVICE_ALLOW_XDP 1
+#endif
 
 class ToDevice : public Element { public:
 
@@ -120,7 +151,8 @@ class ToDevice : public Element { public:
 #if TODEVICE_ALLOW_NETMAP
     NetmapInfo _netmap;
 #endif
-    enum { method_default, method_netmap, method_linux, method_pcap, method_devbpf, method_pcapfd };
+    enum { method_default, method_netmap, method_linux, method_pcap, method_devbpf, method_pcapfd,
+	   method_sendmmsg, method_mmap, method_xdp };
     int _method;
     NotifierSignal _signal;
 
@@ -136,8 +168,30 @@ class ToDevice : public Element { public:
 #endif
     int _backoff;
     int _pulls;
+    int _kick_errors;
+
+#if TODEVICE_ALLOW_LINUX
+    // batched methods: packets waiting to be handed to the kernel
+    Packet **_batch;
+    int _nbatch;
+    Timestamp _flush_delay;
+    Timestamp _flush_deadline;
+    struct mmsghdr *_msgs;
+    struct iovec *_iov;
+    // PACKET_MMAP transmit ring
+    enum { ring_block_size = 1 << 16, ring_frame_size = 1 << 11, ring_blocks = 16 };
+    unsigned char *_ring;
+    unsigned _ring_frame;
+    int open_tx_ring(ErrorHandler *errh);
+    int send_batch();
+    bool run_task_batch();
+#endif
+#if TODEVICE_ALLOW_XDP
+    XskInfo *_xsk;
+    int _queue;
+#endif
 
-    enum { h_debug, h_signal, h_pulls, h_q };
+    enum { h_debug, h_signal, h_pulls, h_kick_errors, h_q };
     FromDevice *find_fromdevice() const;
     int send_packet(Packet *p);
     static int write_param(const String &in_s, Element *e, void *vparam, ErrorHandler *errh) CLICK_COLD;
@@ -126,26 +126,43 @@ void ToDPDKDevice::add_handlers()
 
 /* Return the rte_mbuf pointer for a packet. If the buffer of the packet is
  * from a DPDK pool, it will return the underlying rte_mbuf and remove the
- * destructor. If it's a Click buffer, it will allocate a DPDK mbuf and copy
- * the packet content to it if create is true. */
+ * destructor. If the buffer is shared with other packets, e.g. clones made
+ * by a Tee or the frames of an A-MSDU, each of them may point to a different
+ * part of it: an indirect mbuf attached to the underlying one carries the
+ * data of this packet, without copying it. If it's a Click buffer, it will
+ * allocate a DPDK mbuf and copy the packet content to it if create is true.
+ * Returns null if no mbuf could be had, or if the packet does not fit in
+ * one. */
 inline struct rte_mbuf* get_mbuf(Packet* p, bool create=true) {
     struct rte_mbuf* mbuf = 0;
 
     if (likely(DPDKDevice::is_dpdk_packet(p))) {
         mbuf = (struct rte_mbuf *) p->destructor_argument();
+        if (p->shared()) {
+            /* The indirect mbuf holds a reference to the buffer. When all
+             * shared packets are freed, DPDKDevice::free_pkt drops theirs,
+             * and DPDK frees the buffer once the indirect mbuf is sent. */
+            struct rte_mbuf* direct = mbuf;
+            mbuf = rte_pktmbuf_alloc(DPDKDevice::get_mpool(rte_socket_id()));
+            if (unlikely(!mbuf))
+                return 0;
+            rte_pktmbuf_attach(mbuf, direct);
+        }
         rte_pktmbuf_pkt_len(mbuf) = p->length();
         rte_pktmbuf_data_len(mbuf) = p->length();
         mbuf->data_off = p->headroom();
-        if (p->shared()) {
-            /*Prevent DPDK from freeing the buffer. When all shared packet
-             * are freed, DPDKDevice::free_pkt will effectively destroy it.*/
-            rte_mbuf_refcnt_update(mbuf, 1);
-        } else {
+        if (!p->shared()) {
             //Reset buffer, let DPDK free the buffer when it wants
             p->reset_buffer();
         }
     } else if (create) {
         mbuf = rte_pktmbuf_alloc(DPDKDevice::get_mpool(rte_socket_id()));
+        if (unlikely(!mbuf))
+            return 0;
+        if (unlikely(p->length() > rte_pktmbuf_tailroom(mbuf))) {
+            rte_pktmbuf_free(mbuf);
+            return 0;
+        }
         memcpy((void*) rte_pktmbuf_mtod(mbuf, unsigned char *), p->data(),
                p->length());
         rte_pktmbuf_pkt_len(mbuf) = p->length();
@@ -228,8 +245,16 @@ void ToDPDKDevice::push(int, Packet *p)
                 _congestion_warning_printed = true;
             }
         } else { // If there is space in the iqueue just after index + left
+            struct rte_mbuf* mbuf = get_mbuf(p);
+            if (unlikely(!mbuf)) {
+                // Out of mbufs, or too long for one
+                if (_n_dropped < 5)
+                    click_chatter("%s: packet dropped, no mbuf", name().c_str());
+                _n_dropped++;
+                break;
+            }
             iqueue.pkts[(iqueue.index + iqueue.nr_pending) % _iqueue_size] =
-                get_mbuf(p);
+                mbuf;
             iqueue.nr_pending++;
         }
 
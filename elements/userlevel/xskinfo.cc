@@ -0,0 +1,521 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * xskinfo.{cc,hh} -- library for AF_XDP sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#if HAVE_LINUX_IF_XDP_H
+#include "xskinfo.hh"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <unistd.h>
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+CLICK_DECLS
+
+/*
+ * The XDP program of an interface and its XSKMAP, shared by the sockets
+ * on its queues. The program redirects each frame to the socket of its
+ * receive queue, and passes it to the kernel if there is none. It stays
+ * attached, through a BPF link, as long as one of the sockets is open.
+ */
+struct XdpProgram {
+    int ifindex;
+    int map_fd;
+    int prog_fd;
+    int link_fd;
+    int users;
+    XdpProgram *next;
+};
+
+enum { xsk_map_size = 256 };
+
+static Spinlock xdp_program_lock;
+static XdpProgram *xdp_programs;
+
+static int
+sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static struct bpf_insn
+make_insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+{
+    struct bpf_insn insn;
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    return insn;
+}
+
+static void
+close_program(XdpProgram *xp)
+{
+    if (xp->link_fd >= 0)
+	close(xp->link_fd);
+    if (xp->prog_fd >= 0)
+	close(xp->prog_fd);
+    if (xp->map_fd >= 0)
+	close(xp->map_fd);
+    delete xp;
+}
+
+static XdpProgram *
+attach_program(const String &ifname, int ifindex, ErrorHandler *errh)
+{
+    xdp_program_lock.acquire();
+    for (XdpProgram *xp = xdp_programs; xp; xp = xp->next)
+	if (xp->ifindex == ifindex) {
+	    xp->users++;
+	    xdp_program_lock.release();
+	    return xp;
+	}
+
+    XdpProgram *xp = new XdpProgram;
+    xp->ifindex = ifindex;
+    xp->map_fd = xp->prog_fd = xp->link_fd = -1;
+    xp->users = 1;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = xsk_map_size;
+    xp->map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (xp->map_fd < 0) {
+	errh->error("%s: BPF_MAP_CREATE: %s", ifname.c_str(), strerror(errno));
+	goto fail;
+    }
+
+    {
+	// return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS)
+	struct bpf_insn insns[] = {
+	    make_insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1,
+		      offsetof(struct xdp_md, rx_queue_index), 0),
+	    make_insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xp->map_fd),
+	    make_insn(0, 0, 0, 0, 0),
+	    make_insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+	    make_insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+	    make_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+	};
+	static const char license[] = "Dual BSD/GPL";
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uintptr_t) insns;
+	attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+	attr.license = (uintptr_t) license;
+	xp->prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+	if (xp->prog_fd < 0) {
+	    errh->error("%s: BPF_PROG_LOAD: %s", ifname.c_str(), strerror(errno));
+	    goto fail;
+	}
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = xp->prog_fd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    xp->link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+    if (xp->link_fd < 0) {
+	errh->error("%s: BPF_LINK_CREATE: %s", ifname.c_str(), strerror(errno));
+	goto fail;
+    }
+
+    xp->next = xdp_programs;
+    xdp_programs = xp;
+    xdp_program_lock.release();
+    return xp;
+
+  fail:
+    xdp_program_lock.release();
+    close_program(xp);
+    return 0;
+}
+
+static void
+detach_program(XdpProgram *xp)
+{
+    xdp_program_lock.acquire();
+    if (--xp->users == 0) {
+	XdpProgram **pprev = &xdp_programs;
+	while (*pprev != xp)
+	    pprev = &(*pprev)->next;
+	*pprev = xp->next;
+	close_program(xp);
+    }
+    xdp_program_lock.release();
+}
+
+
+XskInfo::XskInfo()
+    : _fd(-1), _ifindex(0), _queue(0), _rx(false), _zerocopy(false), _umem(0),
+      _free(0), _nfree(0), _users(1), _lent(0), _tx_inflight(0), _copies(0),
+      _prog(0)
+{
+    memset(&_fill, 0, sizeof(_fill));
+    memset(&_comp, 0, sizeof(_comp));
+    memset(&_rxr, 0, sizeof(_rxr));
+    memset(&_txr, 0, sizeof(_txr));
+}
+
+XskInfo::~XskInfo()
+{
+    if (_umem)
+	munmap(_umem, (size_t) nframes * frame_size);
+    delete[] _free;
+}
+
+XskInfo *
+XskInfo::open(const String &ifname, int queue, bool rx, ErrorHandler *errh)
+{
+    if (queue < 0 || queue >= xsk_map_size) {
+	errh->error("%s: bad queue %d", ifname.c_str(), queue);
+	return 0;
+    }
+    XskInfo *x = new XskInfo;
+    x->_queue = queue;
+    x->_rx = rx;
+    if (x->setup(ifname, errh) < 0) {
+	x->close_socket();
+	delete x;
+	return 0;
+    }
+    return x;
+}
+
+int
+XskInfo::map_ring(XskRing &r, const struct xdp_ring_offset &off, size_t desc_size,
+		  off_t pgoff, ErrorHandler *errh)
+{
+    r.map_size = off.desc + ring_size * desc_size;
+    void *map = mmap(0, r.map_size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, _fd, pgoff);
+    if (map == MAP_FAILED)
+	return errh->error("mmap: %s", strerror(errno));
+    unsigned char *base = (unsigned char *) map;
+    r.map = map;
+    r.producer = (volatile uint32_t *) (base + off.producer);
+    r.consumer = (volatile uint32_t *) (base + off.consumer);
+    r.flags = (volatile uint32_t *) (base + off.flags);
+    r.ring = base + off.desc;
+    r.mask = ring_size - 1;
+    return 0;
+}
+
+int
+XskInfo::setup(const String &ifname, ErrorHandler *errh)
+{
+    const char *name = ifname.c_str();
+    _ifindex = if_nametoindex(name);
+    if (!_ifindex)
+	return errh->error("%s: %s", name, strerror(errno));
+
+    _fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (_fd < 0)
+	return errh->error("%s: socket: %s", name, strerror(errno));
+
+    void *umem = mmap(0, (size_t) nframes * frame_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (umem == MAP_FAILED)
+	return errh->error("%s: mmap: %s", name, strerror(errno));
+    _umem = (unsigned char *) umem;
+
+    struct xdp_umem_reg mr;
+    memset(&mr, 0, sizeof(mr));
+    mr.addr = (uintptr_t) _umem;
+    mr.len = (uint64_t) nframes * frame_size;
+    mr.chunk_size = frame_size;
+    mr.headroom = 0;
+    if (setsockopt(_fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) < 0)
+	return errh->error("%s: XDP_UMEM_REG: %s", name, strerror(errno));
+
+    int size = ring_size;
+    if (setsockopt(_fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0
+	|| setsockopt(_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) < 0
+	|| setsockopt(_fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0
+	|| setsockopt(_fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0)
+	return errh->error("%s: XDP rings: %s", name, strerror(errno));
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+	return errh->error("%s: XDP_MMAP_OFFSETS: %s", name, strerror(errno));
+
+    if (map_ring(_fill, off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING, errh) < 0
+	|| map_ring(_comp, off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING, errh) < 0
+	|| map_ring(_rxr, off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING, errh) < 0
+	|| map_ring(_txr, off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING, errh) < 0)
+	return -1;
+
+    // half the frames wait in the fill ring, if frames are received
+    _free = new uint64_t[nframes];
+    int nfill = _rx ? ring_size : 0;
+    for (int i = 0; i < nfill; i++)
+	_fill.addr(i) = (uint64_t) i * frame_size;
+    click_fence();
+    *_fill.producer = nfill;
+    for (int i = nframes - 1; i >= nfill; i--)
+	_free[_nfree++] = (uint64_t) i * frame_size;
+
+    // zero copy needs driver support, the copy mode works everywhere
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = _ifindex;
+    sxdp.sxdp_queue_id = _queue;
+    sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+    _zerocopy = true;
+    if (bind(_fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) < 0) {
+	sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+	_zerocopy = false;
+	if (bind(_fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) < 0)
+	    return errh->error("%s: bind queue %d: %s", name, _queue, strerror(errno));
+    }
+
+    if (_rx) {
+	if (!(_prog = attach_program(ifname, _ifindex, errh)))
+	    return -1;
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = _prog->map_fd;
+	attr.key = (uintptr_t) &_queue;
+	attr.value = (uintptr_t) &_fd;
+	attr.flags = BPF_ANY;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+	    return errh->error("%s: XSKMAP queue %d: %s", name, _queue, strerror(errno));
+    }
+
+    return 0;
+}
+
+void
+XskInfo::close_socket()
+{
+    if (_prog) {
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = _prog->map_fd;
+	attr.key = (uintptr_t) &_queue;
+	(void) sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+	detach_program(_prog);
+	_prog = 0;
+    }
+    XskRing *rings[] = { &_fill, &_comp, &_rxr, &_txr };
+    for (int i = 0; i < 4; i++)
+	if (rings[i]->map) {
+	    munmap(rings[i]->map, rings[i]->map_size);
+	    rings[i]->map = 0;
+	}
+    if (_fd >= 0)
+	close(_fd);
+    _fd = -1;
+}
+
+void
+XskInfo::acquire()
+{
+    _lock.acquire();
+    _users++;
+    _lock.release();
+}
+
+void
+XskInfo::release()
+{
+    _lock.acquire();
+    bool last = --_users == 0;
+    _lock.release();
+    if (!last)
+	return;
+
+    // the frames in the TX ring will not complete anymore
+    close_socket();
+    _lock.acquire();
+    _tx_inflight = 0;
+    bool dead = unused();
+    _lock.release();
+    if (dead)
+	delete this;
+}
+
+void
+XskInfo::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    XskInfo *x = reinterpret_cast<XskInfo *>(arg);
+    x->_lock.acquire();
+    x->_free[x->_nfree++] = buf - x->_umem;
+    x->_lent--;
+    bool dead = x->unused();
+    x->_lock.release();
+    if (dead)
+	delete x;
+}
+
+int
+XskInfo::receive(WritablePacket **out, int n, unsigned headroom)
+{
+    uint32_t cons = *_rxr.consumer;
+    uint32_t avail = *_rxr.producer - cons;
+    if (avail > (uint32_t) n)
+	avail = n;
+    // read the descriptors only after observing the producer
+    click_fence();
+
+    uint32_t fprod = *_fill.producer;
+    uint32_t fspace = ring_size - (fprod - *_fill.consumer);
+    bool copy = _lent >= max_lent;
+    int got = 0, lent = 0;
+
+    for (uint32_t i = 0; i < avail; i++) {
+	const struct xdp_desc &d = _rxr.desc(cons + i);
+	uint64_t chunk = d.addr & ~(uint64_t) (frame_size - 1);
+	unsigned char *data = _umem + d.addr;
+	WritablePacket *p = 0;
+	if (!copy) {
+	    p = Packet::make(data, d.len, buffer_destructor, this,
+			     d.addr - chunk, chunk + frame_size - d.addr - d.len);
+	    if (p)
+		lent++;
+	}
+	if (!p) {
+	    // the frame goes straight back to the kernel
+	    p = Packet::make(headroom, data, d.len, 0);
+	    _copies++;
+	    if (fspace) {
+		_fill.addr(fprod++) = chunk;
+		fspace--;
+	    } else {
+		_lock.acquire();
+		_free[_nfree++] = chunk;
+		_lock.release();
+	    }
+	}
+	if (p)
+	    out[got++] = p;
+    }
+
+    click_fence();
+    *_rxr.consumer = cons + avail;
+
+    // one batch of the frames freed since the last call
+    _lock.acquire();
+    _lent += lent;
+    while (fspace && _nfree) {
+	_fill.addr(fprod++) = _free[--_nfree];
+	fspace--;
+    }
+    _lock.release();
+
+    click_fence();
+    *_fill.producer = fprod;
+    if (_fill.need_wakeup())
+	recvfrom(_fd, 0, 0, MSG_DONTWAIT, 0, 0);
+    return got;
+}
+
+void
+XskInfo::reclaim()
+{
+    uint32_t cons = *_comp.consumer;
+    uint32_t avail = *_comp.producer - cons;
+    if (!avail)
+	return;
+    click_fence();
+    _lock.acquire();
+    for (uint32_t i = 0; i < avail; i++)
+	_free[_nfree++] = _comp.addr(cons + i) & ~(uint64_t) (frame_size - 1);
+    _tx_inflight -= avail;
+    _lock.release();
+    click_fence();
+    *_comp.consumer = cons + avail;
+}
+
+int
+XskInfo::send(Packet **p, int n, bool steal)
+{
+    reclaim();
+
+    uint32_t prod = *_txr.producer;
+    int space = ring_size - (prod - *_txr.consumer);
+    if (space > n)
+	space = n;
+
+    // frames are taken under the lock, copied outside of it
+    int k = 0, stolen = 0;
+    _lock.acquire();
+    for (; k < space; k++) {
+	Packet *q = p[k];
+	struct xdp_desc &d = _txr.desc(prod + k);
+	if (steal && q->buffer_destructor() == buffer_destructor
+	    && q->destructor_argument() == this && !q->shared()) {
+	    d.addr = q->data() - _umem;
+	    d.options = 1;	// marks the frame as stolen, reset below
+	    stolen++;
+	} else if (_nfree) {
+	    d.addr = _free[--_nfree];
+	    d.options = 0;
+	} else
+	    break;
+    }
+    _lent -= stolen;
+    _tx_inflight += k;
+    _lock.release();
+
+    if (!k)
+	return -ENOBUFS;
+
+    for (int i = 0; i < k; i++) {
+	struct xdp_desc &d = _txr.desc(prod + i);
+	if (d.options)
+	    p[i]->set_buffer_destructor(stolen_destructor);
+	else
+	    memcpy(_umem + d.addr, p[i]->data(), p[i]->length());
+	d.len = p[i]->length();
+	d.options = 0;
+    }
+
+    // publish the descriptors before passing them to the kernel
+    click_fence();
+    *_txr.producer = prod + k;
+    if (!_zerocopy || _txr.need_wakeup())
+	sendto(_fd, 0, 0, MSG_DONTWAIT, 0, 0);
+    return k;
+}
+
+bool
+XskInfo::drops(uint64_t &dropped) const
+{
+    struct xdp_statistics stats;
+    socklen_t optlen = sizeof(stats);
+    if (getsockopt(_fd, SOL_XDP, XDP_STATISTICS, &stats, &optlen) < 0)
+	return false;
+    dropped = stats.rx_dropped + stats.rx_ring_full + stats.rx_invalid_descs;
+    return true;
+}
+
+CLICK_ENDDECLS
+#endif
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(XskInfo)
@@ -0,0 +1,128 @@
+#ifndef CLICK_XSKINFO_HH
+#define CLICK_XSKINFO_HH 1
+
+#if HAVE_LINUX_IF_XDP_H
+#include <linux/if_xdp.h>
+#include <click/element.hh>
+#include <click/sync.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+/* one of the four rings of an AF_XDP socket, mapped from the kernel */
+class XskRing { public:
+
+    volatile uint32_t *producer;
+    volatile uint32_t *consumer;
+    volatile uint32_t *flags;
+    void *ring;			/* uint64_t frame addresses, or xdp_desc */
+    uint32_t mask;
+    void *map;
+    size_t map_size;
+
+    uint64_t &addr(uint32_t i) {
+	return reinterpret_cast<uint64_t *>(ring)[i & mask];
+    }
+    struct xdp_desc &desc(uint32_t i) {
+	return reinterpret_cast<struct xdp_desc *>(ring)[i & mask];
+    }
+    bool need_wakeup() const {
+	return *flags & XDP_RING_NEED_WAKEUP;
+    }
+};
+
+/*
+ * An AF_XDP socket bound to one queue of an interface, with its own UMEM,
+ * the memory its frames live in. Shared by the FromDevice and ToDevice of
+ * the same interface and queue, see FromDevice.u METHOD XDP.
+ *
+ * Received frames are handed out as Packets pointing into the UMEM; the
+ * frame goes back to the free list when the Packet dies, and from there to
+ * the fill ring in batches. Should downstream elements hold on to too many
+ * of them, further frames are copied, so that the kernel always has frames
+ * to receive into. Packets are sent from the UMEM as well: copied into a
+ * free frame, or, for a Packet received on the same socket that nothing
+ * else refers to, sent in place.
+ *
+ * The receive side (fill and RX rings) and the send side (TX and completion
+ * rings) may run on two threads; the free list is shared under a lock. The
+ * UMEM outlives the socket until the last Packet pointing into it dies.
+ */
+class XskInfo { public:
+
+    enum { frame_size = 2048, nframes = 4096, ring_size = 2048,
+	   max_lent = nframes / 4 };
+
+    // Open a socket on queue of ifname. If rx, frames received on that
+    // queue are redirected to it by an XDP program attached to the
+    // interface, shared by all the sockets of the interface.
+    static XskInfo *open(const String &ifname, int queue, bool rx, ErrorHandler *errh);
+
+    // another element uses the socket, each user calls release() once
+    void acquire();
+    void release();
+
+    int fd() const		{ return _fd; }
+    int queue() const		{ return _queue; }
+    bool zerocopy() const	{ return _zerocopy; }
+
+    // Receive up to n frames. Also hands the freed frames back to the
+    // kernel.
+    int receive(WritablePacket **out, int n, unsigned headroom);
+
+    // Queue the first n packets for transmission and kick the kernel.
+    // Returns how many were queued, or -ENOBUFS if none. If steal, the
+    // frames of packets received on this socket are sent in place, and
+    // the packets must then be killed without being looked at.
+    int send(Packet **p, int n, bool steal);
+
+    bool drops(uint64_t &dropped) const;
+
+    uint64_t copies() const	{ return _copies; }
+
+    static bool is_xsk_buffer(Packet *p) {
+	return p->buffer_destructor() == buffer_destructor;
+    }
+
+  private:
+
+    int _fd;
+    int _ifindex;
+    int _queue;
+    bool _rx;
+    bool _zerocopy;
+    unsigned char *_umem;
+    XskRing _fill;
+    XskRing _comp;
+    XskRing _rxr;
+    XskRing _txr;
+
+    // frames neither in the kernel rings nor in a Packet
+    Spinlock _lock;
+    uint64_t *_free;
+    int _nfree;
+    // element users, frames lent to Packets, frames in the TX ring
+    int _users;
+    int _lent;
+    int _tx_inflight;
+
+    uint64_t _copies;
+    struct XdpProgram *_prog;
+
+    XskInfo();
+    ~XskInfo();
+    int setup(const String &ifname, ErrorHandler *errh);
+    int map_ring(XskRing &r, const struct xdp_ring_offset &off, size_t desc_size,
+		 off_t pgoff, ErrorHandler *errh);
+    void close_socket();
+    void reclaim();
+    bool unused() const { return !_users && !_lent && !_tx_inflight; }
+    static void buffer_destructor(unsigned char *buf, size_t, void *arg);
+    static void stolen_destructor(unsigned char *, size_t, void *) {
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif // HAVE_LINUX_IF_XDP_H
+
+#endif
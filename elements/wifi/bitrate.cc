@@ -2,13 +2,84 @@
 #include "bitrate.hh"
 #include <clicknet/wifi.h>
 
-// MCS data rates (kbps)
-static const uint32_t mcs_rate_lookup[16] =
+// MCS data rates (kbps), 20 MHz and long guard interval
+static const uint32_t mcs_rate_lookup[32] =
 {
 6500, 13000, 19500, 26000, 39000, 52000, 58500, 65000,
-13000, 26000, 39000, 52000, 78000, 104000, 117000, 130000
+13000, 26000, 39000, 52000, 78000, 104000, 117000, 130000,
+19500, 39000, 58500, 78000, 117000, 156000, 175500, 195000,
+26000, 52000, 78000, 104000, 156000, 208000, 234000, 260000
 };
 
+// Contention window of try X: it doubles from CW0, plus one, up to CWMAX
+template <int CW0, int CWMAX, int X>
+struct ContentionWindow {
+	enum { value = WIFI_MIN(CWMAX, (ContentionWindow<CW0, CWMAX, X - 1>::value + 1) * 2) };
+};
+
+template <int CW0, int CWMAX>
+struct ContentionWindow<CW0, CWMAX, 0> {
+	enum { value = CW0 };
+};
+
+// Backoff of the tries before try X
+template <int SLOT, int CW0, int CWMAX, int X>
+struct BackoffSum {
+	enum { value = BackoffSum<SLOT, CW0, CWMAX, X - 1>::value
+			+ SLOT * ContentionWindow<CW0, CWMAX, X - 1>::value / 2 };
+};
+
+template <int SLOT, int CW0, int CWMAX>
+struct BackoffSum<SLOT, CW0, CWMAX, 0> {
+	enum { value = 0 };
+};
+
+// The contention windows reach their maximum by try 6, from then on
+// every try backs off the same
+enum { BACKOFF_TRIES = 8 };
+
+#define BACKOFF_SUMS(slot, cw0, cwmax) { \
+	BackoffSum<slot, cw0, cwmax, 0>::value, BackoffSum<slot, cw0, cwmax, 1>::value, \
+	BackoffSum<slot, cw0, cwmax, 2>::value, BackoffSum<slot, cw0, cwmax, 3>::value, \
+	BackoffSum<slot, cw0, cwmax, 4>::value, BackoffSum<slot, cw0, cwmax, 5>::value, \
+	BackoffSum<slot, cw0, cwmax, 6>::value, BackoffSum<slot, cw0, cwmax, 7>::value, \
+	BackoffSum<slot, cw0, cwmax, 8>::value }
+
+// backoff of the tries before each try, for 802.11b, a/g and n
+static const unsigned backoff_sums_b[BACKOFF_TRIES + 1] =
+	BACKOFF_SUMS(WIFI_SLOT_B, WIFI_CW_MIN_B, WIFI_CW_MAX_B);
+static const unsigned backoff_sums_a[BACKOFF_TRIES + 1] =
+	BACKOFF_SUMS(WIFI_SLOT_A, WIFI_CW_MIN, WIFI_CW_MAX);
+static const unsigned backoff_sums_n[BACKOFF_TRIES + 1] =
+	BACKOFF_SUMS(WIFI_SLOT_N, WIFI_CW_MIN, WIFI_CW_MAX);
+
+// Backoff of tries try0 to tryN. Tries before the first back off as the
+// first one, which is what the loops this replaces did
+static inline unsigned
+backoff_tries(const unsigned *sums, int try0, int tryN)
+{
+	unsigned first = sums[1];
+	unsigned last = sums[BACKOFF_TRIES] - sums[BACKOFF_TRIES - 1];
+	unsigned tt = 0;
+	if (try0 < 0) {
+		int n = (tryN < 0 ? tryN + 1 : 0) - try0;
+		tt += n * first;
+		try0 += n;
+		if (try0 > tryN) {
+			return tt;
+		}
+	}
+	int end = tryN + 1;
+	if (end > BACKOFF_TRIES) {
+		tt += (end - WIFI_MAX(try0, (int) BACKOFF_TRIES)) * last;
+		end = BACKOFF_TRIES;
+	}
+	if (try0 < end) {
+		tt += sums[end] - sums[try0];
+	}
+	return tt;
+}
+
 unsigned
 calc_transmit_time(int rate, int length)
 {
@@ -24,14 +95,8 @@ calc_transmit_time(int rate, int length)
 unsigned
 calc_backoff(int rate, int t)
 {
-	int t_slot = is_b_rate(rate) ? WIFI_SLOT_B : WIFI_SLOT_A;
-	int cw = is_b_rate(rate) ? WIFI_CW_MIN_B : WIFI_CW_MIN;
-	int cw_max = is_b_rate(rate) ? WIFI_CW_MAX_B : WIFI_CW_MAX;
 	/* there is backoff, even for the first packet */
-	for (int x = 0; x < t; x++) {
-		cw = WIFI_MIN(cw_max, (cw + 1) * 2);
-	}
-	return t_slot * cw / 2;
+	return backoff_tries(is_b_rate(rate) ? backoff_sums_b : backoff_sums_a, t, t);
 }
 
 unsigned
@@ -46,12 +111,13 @@ calc_usecs_wifi_packet_tries(int length, int rate, int try0, int tryN)
 		t_ack = WIFI_ACK_B;
 		t_sifs = WIFI_SIFS_B;
 	}
-	int tt = 0;
-	for (int x = try0; x <= tryN; x++) {
-		tt += calc_backoff(rate, x) + calc_transmit_time(rate, length) +
-			t_sifs + t_ack;
+	const unsigned *sums = backoff_sums_a;
+	if (is_b_rate(rate)) {
+		sums = backoff_sums_b;
 	}
-	return tt;
+	unsigned tries = tryN - try0 + 1;
+	return tries * (calc_transmit_time(rate, length) + t_sifs + t_ack)
+		+ backoff_tries(sums, try0, tryN);
 }
 
 unsigned
@@ -63,18 +129,17 @@ calc_usecs_wifi_packet(int length, int rate, int retries)
 unsigned
 calc_transmit_time_ht(int rate, int length)
 {
+	if (rate < 0 || rate >= 32) {
+		return 99999;
+	}
 	return (1000 * length * 8) / mcs_rate_lookup[rate] + WIFI_PLCP_HEADER_N;
 }
 
 unsigned
 calc_backoff_ht(int, int t)
 {
-	int cw = WIFI_CW_MIN;
 	/* there is backoff, even for the first packet */
-	for (int x = 0; x < t; x++) {
-		cw = WIFI_MIN(WIFI_CW_MAX, (cw + 1) * 2);
-	}
-	return WIFI_SLOT_N * cw / 2;
+	return backoff_tries(backoff_sums_n, t, t);
 }
 
 unsigned
@@ -83,12 +148,9 @@ calc_usecs_wifi_packet_tries_ht(int length, int rate, int try0, int tryN)
 	if (rate < 0 || !length || try0 > tryN) {
 		return 99999;
 	}
-	int tt = 0;
-	for (int x = try0; x <= tryN; x++) {
-		tt += calc_backoff_ht(rate, x) + calc_transmit_time_ht(rate, length) +
-			WIFI_SIFS_N + WIFI_ACK_N;
-	}
-	return tt;
+	unsigned tries = tryN - try0 + 1;
+	return tries * (calc_transmit_time_ht(rate, length) + WIFI_SIFS_N + WIFI_ACK_N)
+		+ backoff_tries(backoff_sums_n, try0, tryN);
 }
 
 unsigned
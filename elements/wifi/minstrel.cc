@@ -30,94 +30,193 @@
 CLICK_DECLS
 
 Minstrel::Minstrel() 
-  : _tx_policies(0), _timer(this), _lookaround_rate(20), _offset(0),
-	_active(true), _period(500), _ewma_level(75), _debug(false) {
+  : _tx_policies(0), _timer(this), _tx_cache_generation(0),
+	_group_generation(0), _tx_cache_group_generation(0), _nfeedback(0), _feedback_batch(1), _lookaround_rate(20), _offset(0),
+	_active(true), _period(500), _slices(10), _slice(0), _update_usecs(0), _update_usecs_max(0),
+	_ewma_level(75), _debug(false) {
+	_group_lock.set_name(this, "group rates");
 }
 
 Minstrel::~Minstrel() {
+	for (HashTable<int, uint32_t *>::iterator it = _airtime.begin(); it.live(); it++) {
+		delete[] it.value();
+	}
+}
+
+const uint32_t *Minstrel::airtime_table(int rate, bool ht) {
+	int key = ht ? (rate | 0x10000) : rate;
+	uint32_t *table = _airtime.get(key);
+	if (!table) {
+		table = new uint32_t[AIRTIME_BUCKETS];
+		for (int i = 0; i < AIRTIME_BUCKETS; i++) {
+			int length = ((i + 1) << AIRTIME_BUCKET_SHIFT) - 1;
+			if (ht)
+				table[i] = calc_usecs_wifi_packet_ht(length, rate, 0);
+			else
+				table[i] = calc_usecs_wifi_packet(length, rate, 0);
+		}
+		_airtime.set(key, table);
+	}
+	return table;
+}
+
+const MinstrelTxDesc &Minstrel::tx_desc(EtherAddress dst) {
+	// resolved once per destination and policy generation, so that the
+	// data path neither copies the rate sets nor looks them up twice
+	if (_tx_cache_generation != _tx_policies->generation()
+			|| _tx_cache_group_generation != _group_generation
+			|| _tx_cache.size() >= TX_CACHE_SIZE) {
+		_tx_cache.clear();
+		_tx_cache_generation = _tx_policies->generation();
+		_tx_cache_group_generation = _group_generation;
+	}
+	MinstrelTxDesc *desc = _tx_cache.get_pointer(dst);
+	if (desc) {
+		return *desc;
+	}
+	EmpowerEpoch::Guard guard(_tx_policies->epoch());
+	TxPolicyInfo *tx_policy = _tx_policies->supported(dst);
+	const TxPolicyInfo *policy = tx_policy ? tx_policy : _tx_policies->default_tx_policy();
+	MinstrelTxDesc &nd = _tx_cache[dst];
+	nd.rate = policy->_mcs.size() ? policy->_mcs[0] : 2;
+	nd.ht_rate = (tx_policy && tx_policy->_ht_mcs.size()) ? tx_policy->_ht_mcs[0] : -1;
+	nd.known = (tx_policy != 0);
+	if (dst.is_group() && _group_generation) {
+		_group_lock.acquire();
+		MinstrelTxDesc *group = _group_rates.get_pointer(dst);
+		if (group) {
+			if (group->ht_rate < 0) {
+				nd.rate = group->rate;
+			}
+			nd.ht_rate = group->ht_rate;
+		}
+		_group_lock.release();
+	}
+	return nd;
+}
+
+void Minstrel::set_group_rate(EtherAddress dst, int rate, bool ht) {
+	_group_lock.acquire();
+	MinstrelTxDesc *group = _group_rates.get_pointer(dst);
+	if (rate < 0) {
+		if (!group) {
+			_group_lock.release();
+			return;
+		}
+		_group_rates.erase(dst);
+	} else {
+		int ht_rate = ht ? rate : -1;
+		if (group && group->rate == rate && group->ht_rate == ht_rate) {
+			_group_lock.release();
+			return;
+		}
+		if (!group && _group_rates.size() >= TX_CACHE_SIZE) {
+			_group_rates.clear();
+		}
+		MinstrelTxDesc &nd = _group_rates[dst];
+		nd.rate = rate;
+		nd.ht_rate = ht_rate;
+		nd.known = false;
+	}
+	// picked up by tx_desc() on the next frame
+	_group_generation++;
+	_group_lock.release();
 }
 
 //tag_for_nif
 void Minstrel::run_timer(Timer *)
 {
+	flush_feedback();
+	// a neighbor is updated once every _slices ticks, on the tick its
+	// address hashes to, so that the work is spread over the period
+	Timestamp start = Timestamp::now_steady();
 	for (MinstrelIter iter = _neighbors.begin(); iter.live(); iter++) {
-		MinstrelDstInfo *nfo = &iter.value();
-		int max_tp = 0, index_max_tp = 0, index_max_tp2 = 0;
-		int max_prob = 0, index_max_prob = 0;
-		uint32_t usecs;
-		int i;
-		uint32_t p;
-		for (i = 0; i < nfo->rates.size(); i++) {
-			if (_transm_time.find(nfo->rates[i]) == _transm_time.end()) {
-				if (nfo->ht)
-					usecs = calc_usecs_wifi_packet_ht(1500, nfo->rates[i], 0);
-				else
-					usecs = calc_usecs_wifi_packet(1500, nfo->rates[i], 0);
-
-				_transm_time.set(nfo->rates[i], usecs);
-			}
+		if (_slices == 1 || iter.key().hashcode() % _slices == _slice) {
+			update_rates(&iter.value());
+		}
+	}
+	_update_usecs = (Timestamp::now_steady() - start).usecval();
+	if (_update_usecs > _update_usecs_max) {
+		_update_usecs_max = _update_usecs;
+	}
+	_slice = (_slice + 1) % _slices;
+	_timer.reschedule_after(Timestamp::make_usec((Timestamp::value_type) _period * 1000 / _slices));
+}
+
+void Minstrel::update_rates(MinstrelDstInfo *nfo)
+{
+	int n = nfo->nrates;
+	for (int i = 0; i < n; i++) {
+		if (!nfo->usecs[i]) {
+			uint32_t usecs;
+			if (nfo->ht)
+				usecs = calc_usecs_wifi_packet_ht(1500, nfo->rates[i], 0);
 			else
-			{
-				usecs = _transm_time.get(nfo->rates[i]);
-			}
-			if (!usecs) {
-				usecs = 1000000;
-			}
-			/* To avoid rounding issues, probabilities scale from 0 (0%)
-			 * to 18000 (100%) */
-			if (nfo->attempts[i]) {
-				p = (nfo->successes[i] * 18000) / nfo->attempts[i];
-				nfo->hist_successes[i] += nfo->successes[i];
-				nfo->hist_attempts[i] += nfo->attempts[i];
-				nfo->cur_prob[i] = p;
-				p = ((p * (100 - _ewma_level)) + (nfo->probability[i] * _ewma_level)) / 100;
-				nfo->probability[i] = p;
-				nfo->cur_tp[i] = p * (1000000 / usecs);
-				nfo->hist_acked_bytes[i] += (unsigned long long)nfo->acked_bytes[i];
-			}
-			nfo->last_successes[i] = nfo->successes[i];
-			nfo->last_attempts[i] = nfo->attempts[i];
-			nfo->last_acked_bytes[i] = nfo->acked_bytes[i];
-
-			nfo->successes[i] = 0;
-			nfo->attempts[i] = 0;
-			nfo->acked_bytes[i] = 0;
-			/* Sample less often below the 10% chance of success.
-			 * Sample less often above the 95% chance of success. */
-			if ((nfo->probability[i] > 17100) || (nfo->probability[i] < 1800)) {
-				nfo->sample_limit[i] = 4;
-			} else {
-				nfo->sample_limit[i] = -1;
-			}
-		}// End of for loop iterating over rates1
-		for (i = 0; i < nfo->rates.size(); i++) {
-			// Find the rate at which I get the highest cur_tp
-			if (max_tp < nfo->cur_tp[i]) {
-				index_max_tp = i;
-				max_tp = nfo->cur_tp[i];
-			}
-			// Find the rate at which I get the highest ewma probability of success 
-			if (max_prob < nfo->probability[i]) {
-				index_max_prob = i;
-				max_prob = nfo->probability[i];
-			}
-		}// End of for loop iterating over rates2
-		max_tp = 0;
-		// Find the rate at which I achieve the second maximum throughput
-		for (i = 0; i < nfo->rates.size(); i++) {
-			if (i == index_max_tp) {
-				continue;
-			}
-			if (max_tp < nfo->cur_tp[i]) {
-				index_max_tp2 = i;
-				max_tp = nfo->cur_tp[i];
-			}
-		}// End of for loop iterating over rates3
-		nfo->max_tp_rate = index_max_tp;
-		nfo->max_tp_rate2 = index_max_tp2;
-		nfo->max_prob_rate = index_max_prob;
+				usecs = calc_usecs_wifi_packet(1500, nfo->rates[i], 0);
+			nfo->usecs[i] = usecs ? usecs : 1000000;
+		}
+	}
+	update_probabilities(nfo);
+	// a single pass over the rates finds the two highest throughputs and
+	// the highest ewma probability of success
+	int max_tp = 0, max_tp2 = 0, index_max_tp = 0, index_max_tp2 = 0;
+	int max_prob = 0, index_max_prob = 0;
+	for (int i = 0; i < n; i++) {
+		int tp = nfo->probability[i] * (1000000 / nfo->usecs[i]);
+		nfo->cur_tp[i] = tp;
+		if (max_tp < tp) {
+			index_max_tp2 = index_max_tp;
+			max_tp2 = max_tp;
+			index_max_tp = i;
+			max_tp = tp;
+		} else if (max_tp2 < tp) {
+			index_max_tp2 = i;
+			max_tp2 = tp;
+		}
+		if (max_prob < nfo->probability[i]) {
+			index_max_prob = i;
+			max_prob = nfo->probability[i];
+		}
+	}
+	nfo->max_tp_rate = index_max_tp;
+	nfo->max_tp_rate2 = index_max_tp2;
+	nfo->max_prob_rate = index_max_prob;
+	if (n) {
+		nfo->airtime = airtime_table(nfo->rates[index_max_tp], nfo->ht);
+	}
+}
+
+void Minstrel::update_probabilities(MinstrelDstInfo *nfo)
+{
+	int n = nfo->nrates;
+	uint32_t p;
+	for (int i = 0; i < n; i++) {
+		/* To avoid rounding issues, probabilities scale from 0 (0%)
+		 * to 18000 (100%) */
+		if (nfo->attempts[i]) {
+			p = (nfo->successes[i] * 18000) / nfo->attempts[i];
+			nfo->hist_successes[i] += nfo->successes[i];
+			nfo->hist_attempts[i] += nfo->attempts[i];
+			nfo->cur_prob[i] = p;
+			p = ((p * (100 - _ewma_level)) + (nfo->probability[i] * _ewma_level)) / 100;
+			nfo->probability[i] = p;
+			nfo->hist_acked_bytes[i] += (unsigned long long)nfo->acked_bytes[i];
+		}
+		/* Sample less often below the 10% chance of success.
+		 * Sample less often above the 95% chance of success. */
+		if ((nfo->probability[i] > 17100) || (nfo->probability[i] < 1800)) {
+			nfo->sample_limit[i] = 4;
+		} else {
+			nfo->sample_limit[i] = -1;
+		}
 	}
-	_timer.schedule_after_msec(_period);
+	// roll the counters of this period over in one go
+	memcpy(nfo->last_successes, nfo->successes, n * sizeof(int));
+	memcpy(nfo->last_attempts, nfo->attempts, n * sizeof(int));
+	memcpy(nfo->last_acked_bytes, nfo->acked_bytes, n * sizeof(long));
+	memset(nfo->successes, 0, n * sizeof(int));
+	memset(nfo->attempts, 0, n * sizeof(int));
+	memset(nfo->acked_bytes, 0, n * sizeof(long));
 }
 
 int Minstrel::initialize(ErrorHandler *)
@@ -127,6 +226,23 @@ int Minstrel::initialize(ErrorHandler *)
 	return 0;
 }
 
+void Minstrel::take_state(Element *e, ErrorHandler *)
+{
+	Minstrel *rc = (Minstrel *) e->cast("Minstrel");
+	if (!rc) {
+		return;
+	}
+	rc->flush_feedback();
+	for (MinstrelIter iter = rc->_neighbors.begin(); iter.live(); iter++) {
+		MinstrelDstInfo nfo = iter.value();
+		// the airtime tables belong to the old element
+		if (nfo.airtime) {
+			nfo.airtime = airtime_table(nfo.rates[nfo.max_tp_rate], nfo.ht);
+		}
+		_neighbors.insert(nfo.eth, nfo);
+	}
+}
+
 int Minstrel::configure(Vector<String> &conf, ErrorHandler *errh)
 {
 
@@ -136,57 +252,118 @@ int Minstrel::configure(Vector<String> &conf, ErrorHandler *errh)
 		      .read("LOOKAROUND_RATE", _lookaround_rate)
 		      .read("EWMA_LEVEL", _ewma_level)
 		      .read("PERIOD", _period)
+		      .read("SLICES", _slices)
+		      .read("FEEDBACK_BATCH", _feedback_batch)
 		      .read("ACTIVE",  _active)
 		      .read("DEBUG",  _debug)
 		      .complete();
 
-	return ret;
+	if (ret < 0) {
+		return ret;
+	}
 
-}
+	if (_feedback_batch > MAX_FEEDBACK_BATCH) {
+		return errh->error("FEEDBACK_BATCH must be at most %d", MAX_FEEDBACK_BATCH);
+	}
 
-void Minstrel::process_feedback(Packet *p_in) {
-	if (!p_in) {
-		return;
+	if (_slices < 1 || _slices > _period) {
+		return errh->error("SLICES must be between 1 and PERIOD");
 	}
+
+	return 0;
+
+}
+
+bool Minstrel::parse_feedback(Packet *p_in, MinstrelFeedback &f) {
 	uint8_t *dst_ptr = (uint8_t *) p_in->data() + _offset;
-	EtherAddress dst = EtherAddress(dst_ptr);
+	f.dst = EtherAddress(dst_ptr);
 	/* don't record info for bcast packets */
-	if (dst.is_group()) {
-		return;
+	if (f.dst.is_group()) {
+		return false;
 	}
 	struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p_in);
-	int success = !(ceh->flags & WIFI_EXTRA_TX_FAIL);
-	MinstrelDstInfo *nfo = _neighbors.findp(dst);
+	f.success = !(ceh->flags & WIFI_EXTRA_TX_FAIL);
+	f.mcs = (ceh->flags & WIFI_EXTRA_MCS);
+	f.rate = ceh->rate;
+	f.tries = ceh->max_tries;
+	//tag_for_nif
+	// I need data length here not the full ethernet frame length. 
+	// How do I get that ?
+	//long data_bytes = p_in->length();
+	// Not sure if this is the correct way to get the data length...   
+	uint8_t *data_begin_ptr = (uint8_t *) p_in->data() + _offset;
+	uint8_t *data_end_ptr = (uint8_t *) p_in->end_data() + _offset;
+	f.bytes = (data_end_ptr - data_begin_ptr) * (sizeof(unsigned char));
+	return true;
+}
+
+void Minstrel::apply_feedback(const MinstrelFeedback &f, MinstrelDstInfo *nfo) {
 	/* rate wasn't set */
 	if (!nfo) {
 		if (_debug) {
 			click_chatter("%{element} :: %s :: no info for %s",
 					this, 
 					__func__,
-					dst.unparse().c_str());
+					f.dst.unparse().c_str());
 		}
 		return;
 	}
 	/* rate is HT but feedback is legacy */
-	if (nfo->ht && !(ceh->flags & WIFI_EXTRA_MCS)) {
+	if (nfo->ht && !f.mcs) {
 		if (_debug) {
 			click_chatter("%{element} :: %s :: rate is HT but feedback is legacy %u",
 					this,
 					__func__,
-					ceh->rate);
+					f.rate);
 		}
 		return;
 	}
-	//tag_for_nif
-	// I need data length here not the full ethernet frame length. 
-	// How do I get that ?
-	//long data_bytes = p_in->length();
-	// Not sure if this is the correct way to get the data length...   
-	uint8_t *data_begin_ptr = (uint8_t *) p_in->data() + _offset;
-	uint8_t *data_end_ptr = (uint8_t *) p_in->end_data() + _offset;
-	long data_bytes = (data_end_ptr - data_begin_ptr) * (sizeof(unsigned char));
-	nfo->add_result(ceh->rate, ceh->max_tries, success, data_bytes);
-	return;
+	nfo->add_result(f.rate, f.tries, f.success, f.bytes);
+}
+
+void Minstrel::process_feedback(Packet *p_in) {
+	if (!p_in) {
+		return;
+	}
+	MinstrelFeedback &f = _feedback[_nfeedback];
+	if (!parse_feedback(p_in, f)) {
+		return;
+	}
+	if (_feedback_batch <= 1) {
+		apply_feedback(f, _neighbors.findp(f.dst));
+		return;
+	}
+	if (++_nfeedback >= (int) _feedback_batch) {
+		flush_feedback();
+	}
+}
+
+void Minstrel::process_feedback_batch(Packet *head) {
+	for (Packet *p = head; p; p = p->next()) {
+		if (parse_feedback(p, _feedback[_nfeedback]) && ++_nfeedback >= MAX_FEEDBACK_BATCH) {
+			flush_feedback();
+		}
+	}
+	flush_feedback();
+}
+
+void Minstrel::flush_feedback() {
+	// one lookup per destination, then all of its records in a row
+	bool done[MAX_FEEDBACK_BATCH];
+	memset(done, 0, sizeof(done));
+	for (int i = 0; i < _nfeedback; i++) {
+		if (done[i]) {
+			continue;
+		}
+		MinstrelDstInfo *nfo = _neighbors.findp(_feedback[i].dst);
+		for (int j = i; j < _nfeedback; j++) {
+			if (!done[j] && _feedback[j].dst == _feedback[i].dst) {
+				apply_feedback(_feedback[j], nfo);
+				done[j] = true;
+			}
+		}
+	}
+	_nfeedback = 0;
 }
 
 void Minstrel::assign_rate(Packet *p_in)
@@ -202,16 +379,14 @@ void Minstrel::assign_rate(Packet *p_in)
 
 	memset((void*)ceh, 0, sizeof(struct click_wifi_extra));
 
-	TxPolicyInfo * tx_policy = _tx_policies->supported(dst);
 	if (dst.is_group()) {
+		const MinstrelTxDesc &desc = tx_desc(dst);
 		ceh->flags |= WIFI_EXTRA_TX_NOACK;
-		if(!tx_policy || tx_policy->_ht_mcs.size() == 0) {
-			Vector<int> rates = _tx_policies->lookup(dst)->_mcs;
-			ceh->rate = (rates.size()) ? rates[0] : 2;
+		if (desc.ht_rate < 0) {
+			ceh->rate = desc.rate;
 		}
 		else {
-			Vector<int> ht_rates = _tx_policies->lookup(dst)->_ht_mcs;
-			ceh->rate = (ht_rates.size()) ? ht_rates[0] : 2;
+			ceh->rate = desc.ht_rate;
 			ceh->flags |= WIFI_EXTRA_MCS;
 		}
 
@@ -234,8 +409,7 @@ void Minstrel::assign_rate(Packet *p_in)
 		if (subtype == WIFI_FC0_SUBTYPE_BEACON || subtype == WIFI_FC0_SUBTYPE_PROBE_RESP) {
 			ceh->flags |= WIFI_EXTRA_TX_NOACK;
 		}
-		Vector<int> rates = _tx_policies->lookup(dst)->_mcs;
-		ceh->rate = (rates.size()) ? rates[0] : 2;
+		ceh->rate = tx_desc(dst).rate;
 		ceh->rate1 = -1;
 		ceh->rate2 = -1;
 		ceh->rate3 = -1;
@@ -248,13 +422,16 @@ void Minstrel::assign_rate(Packet *p_in)
 
 	MinstrelDstInfo *nfo = _neighbors.findp(dst);
 
-	if (!nfo || !nfo->rates.size()) {
+	if (!nfo || !nfo->nrates) {
 		if (_debug) {
 			click_chatter("%{element} :: %s :: adding %s",
 					this, 
 					__func__,
 					dst.unparse().c_str());
 		}
+		const MinstrelTxDesc &desc = tx_desc(dst);
+		EmpowerEpoch::Guard guard(_tx_policies->epoch());
+		TxPolicyInfo *tx_policy = desc.known ? _tx_policies->supported(dst) : 0;
 		if (!tx_policy) {
 			if (_debug) {
 				click_chatter("%{element} :: %s :: rate info not found for %s",
@@ -262,8 +439,7 @@ void Minstrel::assign_rate(Packet *p_in)
 						__func__,
 						dst.unparse().c_str());
 			}
-			Vector<int> rates = _tx_policies->lookup(dst)->_mcs;
-			ceh->rate = (rates.size()) ? rates[0] : 2;
+			ceh->rate = desc.rate;
 			ceh->rate1 = -1;
 			ceh->rate2 = -1;
 			ceh->rate3 = -1;
@@ -273,15 +449,16 @@ void Minstrel::assign_rate(Packet *p_in)
 			ceh->max_tries3 = 0;
 			return;
 		}
-		if (tx_policy->_ht_mcs.size()) {
-			_neighbors.insert(dst, MinstrelDstInfo(dst, tx_policy->_ht_mcs, true));
-			nfo = _neighbors.findp(dst);
-		} else {
-			_neighbors.insert(dst, MinstrelDstInfo(dst, tx_policy->_mcs, false));
-			nfo = _neighbors.findp(dst);
-		}
+		nfo = insert_neighbor(dst, tx_policy);
 	}
 
+	set_rates(nfo, ceh);
+
+}
+
+void Minstrel::set_rates(MinstrelDstInfo *nfo, struct click_wifi_extra *ceh)
+{
+
 	int ndx;
 	bool sample = false;
 	int delta;
@@ -296,8 +473,8 @@ void Minstrel::assign_rate(Packet *p_in)
 			nfo->sample_count = 0;
 			nfo->packet_count = 0;
 		}
-		if (nfo->rates.size() > 0) {
-			int sample_ndx = click_random(0, nfo->rates.size() - 1);
+		if (nfo->nrates > 0) {
+			int sample_ndx = nfo->next_sample();
 			if (nfo->sample_limit[sample_ndx] != 0) {
 				sample = true;
 				ndx = sample_ndx;
@@ -368,6 +545,34 @@ void Minstrel::push(int port, Packet *p_in)
 	checked_output_push(port, p_in);
 }
 
+Packet* Minstrel::pull_batch(int port, unsigned max) {
+	Packet *head = input(port).pull_batch(max);
+	if (_active) {
+		for (Packet *p = head; p; p = p->next()) {
+			assign_rate(p);
+		}
+	}
+	return head;
+}
+
+void Minstrel::push_batch(int port, Packet *head)
+{
+	if (port != 0) {
+		process_feedback_batch(head);
+	} else {
+		for (Packet *p = head; p; p = p->next()) {
+			assign_rate(p);
+		}
+	}
+	if (port < noutputs()) {
+		output(port).push_batch(head);
+	} else {
+		while (Packet *p = PacketBatch::pop(head)) {
+			p->kill();
+		}
+	}
+}
+
 String Minstrel::print_rates()
 {
 	StringAccum sa;
@@ -379,7 +584,7 @@ String Minstrel::print_rates()
 }
 
 enum {
-	H_RATES, H_DEBUG
+	H_RATES, H_DEBUG, H_UPDATE_TIME
 };
 
 String Minstrel::read_handler(Element *e, void *thunk) {
@@ -389,6 +594,8 @@ String Minstrel::read_handler(Element *e, void *thunk) {
 		return String(c->_debug) + "\n";
 	case H_RATES:
 		return c->print_rates();
+	case H_UPDATE_TIME:
+		return String(c->_update_usecs) + " " + String(c->_update_usecs_max) + "\n";
 	default:
 		return "<error>\n";
 	}
@@ -412,6 +619,7 @@ int Minstrel::write_handler(const String &in_s, Element *e, void *vparam, ErrorH
 void Minstrel::add_handlers() {
 	add_read_handler("rates", read_handler, H_RATES);
 	add_read_handler("debug", read_handler, H_DEBUG);
+	add_read_handler("update_time", read_handler, H_UPDATE_TIME);
 	add_write_handler("debug", write_handler, H_DEBUG);
 }
 
@@ -5,7 +5,10 @@
 #include <click/bighashmap.hh>
 #include <click/glue.hh>
 #include <click/timer.hh>
+#include <click/sync.hh>
 #include <click/hashtable.hh>
+#include <click/flathashtable.hh>
+#include <clicknet/wifi.h>
 #include <elements/wifi/bitrate.hh>
 #include "transmissionpolicies.hh"
 CLICK_DECLS
@@ -15,28 +18,66 @@ CLICK_DECLS
  * Minstrel([, I<KEYWORDS>])
  * =s Wifi
  * Minstrel wireless bit-rate selection algorithm
- * =a SetTXRate, FilterTX
+ * =d
+ *
+ * Keyword arguments include:
+ *
+ * =over 8
+ *
+ * =item FEEDBACK_BATCH
+ * TX feedback received on input 1 is recorded and applied every
+ * FEEDBACK_BATCH frames, with a single neighbor lookup per destination,
+ * and at least once per PERIOD. Feedback frames are still forwarded
+ * right away. At most 64, default 1, i.e. applied as it arrives.
+ *
+ * =item PERIOD
+ * Interval between two updates of the statistics of a neighbor, in
+ * msecs. Default 500.
+ *
+ * =item SLICES
+ * The neighbors are updated in SLICES groups, one every PERIOD / SLICES
+ * msecs, by hash of their address, so that the update does not stall
+ * the data path every PERIOD. Default 10, 1 updates them all at once.
+ *
+ * =back 8
+ *
+ * =h update_time read-only
+ * Time taken by the last update and by the longest one, in usecs.
+ *
+ * On hot-swap the statistics of the neighbors are carried over from the
+ * old element, so that rates do not have to be learned again.
+ *
+ * =a MinstrelHT, SetTXRate, FilterTX
  */
 
 
+// Per neighbor statistics, one slot per supported rate. The table is
+// sized at compile time so that inserting a neighbor does not allocate
+// and the periodic update walks plain contiguous arrays. Rates beyond
+// MAX_RATES are ignored; this covers the legacy rates and MCS 0-31.
 struct MinstrelDstInfo {
 public:
+	enum { MAX_RATES = 32, MCS_GROUP_RATES = 8, MAX_GROUPS = MAX_RATES / MCS_GROUP_RATES };
+	enum { SAMPLE_COLUMNS = 10 };
+
 	EtherAddress eth;
-	Vector<int> rates;
-	Vector<int> successes;
-	Vector<int> attempts;
-	Vector<int> last_successes;
-	Vector<int> last_attempts;
-	Vector<int> hist_successes;
-	Vector<int> hist_attempts;
-	Vector<int> cur_prob;
-	Vector<int> cur_tp;
-	Vector<int> probability;
-	Vector<int> sample_limit;
+	int nrates;
+	int rates[MAX_RATES];
+	uint32_t usecs[MAX_RATES]; // airtime of a 1500 bytes frame, 0 if unknown
+	int successes[MAX_RATES];
+	int attempts[MAX_RATES];
+	int last_successes[MAX_RATES];
+	int last_attempts[MAX_RATES];
+	int hist_successes[MAX_RATES];
+	int hist_attempts[MAX_RATES];
+	int cur_prob[MAX_RATES];
+	int cur_tp[MAX_RATES];
+	int probability[MAX_RATES];
+	int sample_limit[MAX_RATES];
 	//tag_for_nif
-	Vector<long> last_acked_bytes;
-	Vector<unsigned long long> hist_acked_bytes;
-	Vector<long> acked_bytes;
+	long last_acked_bytes[MAX_RATES];
+	unsigned long long hist_acked_bytes[MAX_RATES];
+	long acked_bytes[MAX_RATES];
 
 	int packet_count;
 	int sample_count;
@@ -44,66 +85,97 @@ public:
 	int max_tp_rate2;
 	int max_prob_rate;
 	bool ht;
+	// airtime by length bucket at rates[max_tp_rate], owned by Minstrel
+	const uint32_t *airtime;
+	// look-around order, each column is a random permutation of the rates
+	uint8_t sample_table[SAMPLE_COLUMNS][MAX_RATES];
+	uint8_t sample_row;
+	uint8_t sample_col;
+	// MCS group sampling state, only used by MinstrelHT
+	int avg_len;
+	int sample_group;
+	uint8_t sample_column[MAX_GROUPS];
+	uint8_t sample_index[MAX_GROUPS];
+	int group_max_tp[MAX_GROUPS];
 	MinstrelDstInfo() {
 		eth = EtherAddress();
-		rates = Vector<int>();
-		successes = Vector<int>();
-		attempts = Vector<int>();
-		last_successes = Vector<int>();
-		last_attempts = Vector<int>();
-		hist_successes = Vector<int>();
-		hist_attempts = Vector<int>();
-		cur_prob = Vector<int>();
-		cur_tp = Vector<int>();
-		probability = Vector<int>();
-		sample_limit = Vector<int>();
-		//tag_for_nif
-		last_acked_bytes = Vector<long>();
-		hist_acked_bytes = Vector<unsigned long long>();
-		acked_bytes = Vector<long>();
-		packet_count = 0;
-		sample_count = 0;
-		max_tp_rate = 0;
-		max_tp_rate2 = 0;
-		max_prob_rate = 0;
+		nrates = 0;
+		clear();
 		ht = false;
 	}
-	MinstrelDstInfo(EtherAddress neighbor, Vector<int> supported, bool ht_rates) {
+	MinstrelDstInfo(EtherAddress neighbor, const TxPolicyRates &supported, bool ht_rates) {
 		eth = neighbor;
-		for (int i = 0; i < supported.size(); i++) {
-			rates.push_back(supported[i]);
+		nrates = supported.size() < MAX_RATES ? supported.size() : MAX_RATES;
+		clear();
+		for (int i = 0; i < nrates; i++) {
+			rates[i] = supported[i];
 		}
-		successes = Vector<int>(supported.size(), 0);
-		attempts = Vector<int>(supported.size(), 0);
-		last_successes = Vector<int>(supported.size(), 0);
-		last_attempts = Vector<int>(supported.size(), 0);
-		hist_successes = Vector<int>(supported.size(), 0);
-		hist_attempts = Vector<int>(supported.size(), 0);
-		cur_prob = Vector<int>(supported.size(), 0);
-		cur_tp = Vector<int>(supported.size(), 0);
-		probability = Vector<int>(supported.size(), 0);
-		sample_limit = Vector<int>(supported.size(), -1);
-		//tag_for_nif
-		last_acked_bytes = Vector<long>(supported.size(), 0);
-		hist_acked_bytes = Vector<unsigned long long>(supported.size(), 0);
-		acked_bytes = Vector<long>(supported.size(), 0);
-
+		for (int c = 0; c < SAMPLE_COLUMNS; c++) {
+			for (int i = 0; i < nrates; i++) {
+				sample_table[c][i] = i;
+			}
+			for (int i = nrates - 1; i > 0; i--) {
+				int j = click_random(0, i);
+				uint8_t tmp = sample_table[c][i];
+				sample_table[c][i] = sample_table[c][j];
+				sample_table[c][j] = tmp;
+			}
+		}
+		ht = ht_rates;
+	}
+	void clear() {
+		memset(rates, 0, sizeof(rates));
+		memset(usecs, 0, sizeof(usecs));
+		memset(successes, 0, sizeof(successes));
+		memset(attempts, 0, sizeof(attempts));
+		memset(last_successes, 0, sizeof(last_successes));
+		memset(last_attempts, 0, sizeof(last_attempts));
+		memset(hist_successes, 0, sizeof(hist_successes));
+		memset(hist_attempts, 0, sizeof(hist_attempts));
+		memset(cur_prob, 0, sizeof(cur_prob));
+		memset(cur_tp, 0, sizeof(cur_tp));
+		memset(probability, 0, sizeof(probability));
+		for (int i = 0; i < MAX_RATES; i++) {
+			sample_limit[i] = -1;
+		}
+		memset(last_acked_bytes, 0, sizeof(last_acked_bytes));
+		memset(hist_acked_bytes, 0, sizeof(hist_acked_bytes));
+		memset(acked_bytes, 0, sizeof(acked_bytes));
 		packet_count = 0;
 		sample_count = 0;
 		max_tp_rate = 0;
 		max_tp_rate2 = 0;
 		max_prob_rate = 0;
-		ht = ht_rates;
+		airtime = 0;
+		memset(sample_table, 0, sizeof(sample_table));
+		sample_row = 0;
+		sample_col = 0;
+		avg_len = 0;
+		sample_group = 0;
+		memset(sample_column, 0, sizeof(sample_column));
+		memset(sample_index, 0, sizeof(sample_index));
+		for (int i = 0; i < MAX_GROUPS; i++) {
+			group_max_tp[i] = -1;
+		}
+	}
+	// next rate to look around at, walks the sample table row by row
+	int next_sample() {
+		int ndx = sample_table[sample_col][sample_row];
+		if (++sample_row >= nrates) {
+			sample_row = 0;
+			if (++sample_col >= SAMPLE_COLUMNS) {
+				sample_col = 0;
+			}
+		}
+		return ndx;
 	}
 	int rate_index(int rate) {
-		int ndx = -1;
-		for (int x = 0; x < rates.size(); x++) {
+		for (int x = 0; x < nrates; x++) {
 			if (rate == rates[x]) {
-				ndx = x;
-				break;
+				return x;
 			}
 		}
-		return (ndx == rates.size()) ? -1 : ndx;
+		return -1;
 	}
 	void add_result(int rate, int tries, int success, long data_bytes) {
 		int ndx = rate_index(rate);
@@ -121,7 +193,7 @@ public:
 		char buffer[4096];
 		sa << eth << "\n";
 		sa << "rate    throughput    ewma prob    this prob    this success (attempts)    success    attempts\n";
-		for (int i = 0; i < rates.size(); i++) {
+		for (int i = 0; i < nrates; i++) {
 			tp = cur_tp[i] / ((18000 << 10) / 96);
 			prob = cur_prob[i] / 18;
 			eprob = probability[i] / 18;
@@ -164,14 +236,41 @@ public:
 	}
 };
 
-typedef HashMap<EtherAddress, MinstrelDstInfo> MinstrelNeighborTable;
+typedef FlatHashTable<EtherAddress, MinstrelDstInfo> MinstrelNeighborTable;
 typedef MinstrelNeighborTable::iterator MinstrelIter;
 
-typedef HashTable<uint8_t, uint32_t> TTime;
-typedef TTime::iterator TTimeIter;
+// What assign_rate() needs from the transmission policy of a destination
+// that is not handled by the rate control proper (group addressed,
+// management and not yet known destinations).
+struct MinstrelTxDesc {
+	int rate; // lowest legacy rate
+	int ht_rate; // lowest HT MCS, -1 if the destination has no HT policy
+	bool known; // the destination has its own policy
+};
+
+typedef HashTable<EtherAddress, MinstrelTxDesc> MinstrelTxCache;
+
+// TX status of one frame, as needed by the rate control
+struct MinstrelFeedback {
+	EtherAddress dst;
+	int rate;
+	int tries;
+	int success;
+	bool mcs;
+	long bytes;
+};
 
 class Minstrel : public Element { public:
 
+	// airtime tables cover frames up to AIRTIME_BUCKETS << AIRTIME_BUCKET_SHIFT
+	// bytes, each bucket holds the airtime of its longest frame
+	enum { AIRTIME_BUCKET_SHIFT = 6, AIRTIME_BUCKETS = 128 };
+
+	// the descriptor cache is flushed once it reaches this size
+	enum { TX_CACHE_SIZE = 256 };
+
+	enum { MAX_FEEDBACK_BATCH = 64 };
+
 	Minstrel();
 	~Minstrel();
 
@@ -182,10 +281,13 @@ class Minstrel : public Element { public:
 
 	int initialize(ErrorHandler *);
 	int configure(Vector<String> &, ErrorHandler *);
+	void take_state(Element *, ErrorHandler *);
 	void run_timer(Timer *);
 
 	void push (int, Packet *);
 	Packet *pull(int);
+	void push_batch(int, Packet *);
+	Packet *pull_batch(int, unsigned);
 
 	/* handler stuff */
 	void add_handlers();
@@ -193,17 +295,54 @@ class Minstrel : public Element { public:
 
 	void assign_rate(Packet *);
 	void process_feedback(Packet *);
+	// feedback for a Packet::next() chain, the packets are not consumed
+	void process_feedback_batch(Packet *);
+	void flush_feedback();
+
+	// rate control proper, overridden by MinstrelHT
+	virtual void update_rates(MinstrelDstInfo *);
+	virtual void set_rates(MinstrelDstInfo *, struct click_wifi_extra *);
 
 	inline uint32_t estimate_usecs_wifi_packet(Packet *p) {
-		//struct click_wifi *w = (struct click_wifi *) p->data();
-		//EtherAddress dst = EtherAddress(w->i_addr1);
-		return calc_usecs_wifi_packet(p->length(), 1, 0);
+		struct click_wifi *w = (struct click_wifi *) p->data();
+		EtherAddress dst = EtherAddress(w->i_addr1);
+		return estimate_usecs_wifi_length(dst, p->length());
+	}
+
+	// Airtime of a frame of the given length sent to dst at its current
+	// best throughput rate. Uses the table set up by run_timer(), so this
+	// is a lookup rather than a computation on the data path.
+	inline uint32_t estimate_usecs_wifi_length(EtherAddress dst, uint32_t length) {
+		MinstrelDstInfo *nfo = _neighbors.findp(dst);
+		if (!nfo || !nfo->nrates) {
+			if (dst.is_group()) {
+				const MinstrelTxDesc &desc = tx_desc(dst);
+				return desc.ht_rate < 0 ? calc_usecs_wifi_packet(length, desc.rate, 0) : calc_usecs_wifi_packet_ht(length, desc.ht_rate, 0);
+			}
+			return estimate_usecs_wifi_length(length);
+		}
+		uint32_t bucket = length >> AIRTIME_BUCKET_SHIFT;
+		if (nfo->airtime && bucket < AIRTIME_BUCKETS) {
+			return nfo->airtime[bucket];
+		}
+		int rate = nfo->rates[nfo->max_tp_rate];
+		return nfo->ht ? calc_usecs_wifi_packet_ht(length, rate, 0) : calc_usecs_wifi_packet(length, rate, 0);
+	}
+
+	// Conservative estimate when the destination is not known
+	inline uint32_t estimate_usecs_wifi_length(uint32_t length) {
+		return calc_usecs_wifi_packet(length, 1, 0);
 	}
 
 	MinstrelNeighborTable * neighbors() { return &_neighbors; }
 	TransmissionPolicies * tx_policies() { return _tx_policies; }
 	bool forget_station(EtherAddress addr) { return _neighbors.erase(addr); }
 
+	// Rate of the frames sent to the group dst, for whoever knows its
+	// receivers (e.g. EmpowerQOSManager). A negative rate goes back to
+	// the lowest rate of the transmission policy.
+	void set_group_rate(EtherAddress dst, int rate, bool ht);
+
 	MinstrelDstInfo * insert_neighbor(EtherAddress dst, TxPolicyInfo * txp) {
 		MinstrelDstInfo *nfo;
 		if (txp->_ht_mcs.size()) {
@@ -216,17 +355,36 @@ class Minstrel : public Element { public:
 		return nfo;
 	}
 
-private:
+protected:
 
 	MinstrelNeighborTable _neighbors;
 	TransmissionPolicies * _tx_policies;
 	Timer _timer;
-	TTime _transm_time;
+	HashTable<int, uint32_t *> _airtime;
+	MinstrelTxCache _tx_cache;
+	uint32_t _tx_cache_generation;
+	MinstrelTxCache _group_rates; // guarded by _group_lock
+	Spinlock _group_lock;
+	volatile uint32_t _group_generation;
+	uint32_t _tx_cache_group_generation;
+	MinstrelFeedback _feedback[MAX_FEEDBACK_BATCH];
+	int _nfeedback;
+	unsigned _feedback_batch;
+
+	const uint32_t *airtime_table(int, bool);
+	const MinstrelTxDesc &tx_desc(EtherAddress);
+	void update_probabilities(MinstrelDstInfo *);
+	bool parse_feedback(Packet *, MinstrelFeedback &);
+	void apply_feedback(const MinstrelFeedback &, MinstrelDstInfo *);
 
 	unsigned _lookaround_rate;
 	unsigned _offset;
 	bool _active;
 	unsigned _period;
+	unsigned _slices;
+	unsigned _slice; // group of neighbors updated by the next run_timer()
+	uint32_t _update_usecs;
+	uint32_t _update_usecs_max;
 	unsigned _ewma_level;
 	bool _debug;
 
@@ -0,0 +1,308 @@
+/*
+ * minstrelht.{cc,hh} -- Minstrel rate control for 802.11n destinations
+ *
+ * Copyright (c) 2016 CREATE-NET
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include <clicknet/wifi.h>
+#include <elements/wifi/bitrate.hh>
+#include "minstrelht.hh"
+CLICK_DECLS
+
+MinstrelHT::MinstrelHT() : _ampdu(1) {
+}
+
+MinstrelHT::~MinstrelHT() {
+}
+
+void *MinstrelHT::cast(const char *name) {
+	if (strcmp(name, "Minstrel") == 0) {
+		return (Minstrel *) this;
+	}
+	return Minstrel::cast(name);
+}
+
+int MinstrelHT::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+
+	if (Args(this, errh).bind(conf)
+		      .read("AMPDU", _ampdu)
+		      .consume() < 0) {
+		return -1;
+	}
+
+	if (_ampdu < 1) {
+		return errh->error("AMPDU must be at least 1");
+	}
+
+	return Minstrel::configure(conf, errh);
+
+}
+
+int MinstrelHT::initialize(ErrorHandler *errh)
+{
+	// one random permutation of the MCS of a group per column
+	for (int c = 0; c < MinstrelDstInfo::SAMPLE_COLUMNS; c++) {
+		for (int i = 0; i < MinstrelDstInfo::MCS_GROUP_RATES; i++) {
+			_sample_table[c][i] = i;
+		}
+		for (int i = MinstrelDstInfo::MCS_GROUP_RATES - 1; i > 0; i--) {
+			int j = click_random(0, i);
+			uint8_t tmp = _sample_table[c][i];
+			_sample_table[c][i] = _sample_table[c][j];
+			_sample_table[c][j] = tmp;
+		}
+	}
+	return Minstrel::initialize(errh);
+}
+
+// Airtime of an aggregate of _ampdu frames of length bytes, including
+// the medium access and the block ack
+uint32_t MinstrelHT::ampdu_usecs(int mcs, int length) const
+{
+	int mpdu = (_ampdu > 1) ? length + 4 : length; // MPDU delimiter
+	uint32_t payload = calc_transmit_time_ht(mcs, mpdu) - WIFI_PLCP_HEADER_N;
+	return WIFI_DIFS_N + WIFI_SLOT_N * WIFI_CW_MIN / 2 + WIFI_PLCP_HEADER_N
+			+ _ampdu * payload + WIFI_SIFS_N + WIFI_ACK_N;
+}
+
+void MinstrelHT::update_rates(MinstrelDstInfo *nfo)
+{
+	if (!nfo->ht) {
+		Minstrel::update_rates(nfo);
+		return;
+	}
+
+	int n = nfo->nrates;
+
+	// average length of the frames acked in this period
+	long bytes = 0;
+	int frames = 0;
+	for (int i = 0; i < n; i++) {
+		bytes += nfo->acked_bytes[i];
+		frames += nfo->successes[i];
+	}
+	if (frames) {
+		int len = bytes / frames;
+		if (nfo->avg_len) {
+			nfo->avg_len = ((len * (100 - _ewma_level)) + (nfo->avg_len * _ewma_level)) / 100;
+		} else {
+			nfo->avg_len = len;
+		}
+	}
+
+	update_probabilities(nfo);
+
+	int len = nfo->avg_len ? nfo->avg_len : DEFAULT_LEN;
+
+	for (int g = 0; g < MinstrelDstInfo::MAX_GROUPS; g++) {
+		nfo->group_max_tp[g] = -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		int mcs = nfo->rates[i];
+		if (mcs < 0 || mcs >= MinstrelDstInfo::MAX_RATES) {
+			nfo->usecs[i] = 1000000;
+			nfo->cur_tp[i] = 0;
+			continue;
+		}
+		if (!nfo->usecs[i]) {
+			nfo->usecs[i] = calc_usecs_wifi_packet_ht(1500, mcs, 0);
+		}
+		// scaled like Minstrel, i.e. 1500 bytes frames per second
+		uint32_t usecs = ampdu_usecs(mcs, len);
+		uint64_t fps = ((uint64_t) 1000000 * _ampdu * len) / (1500 * (uint64_t) usecs);
+		nfo->cur_tp[i] = nfo->probability[i] * fps;
+		int g = mcs / MinstrelDstInfo::MCS_GROUP_RATES;
+		int best = nfo->group_max_tp[g];
+		if (best < 0 || nfo->cur_tp[i] > nfo->cur_tp[best]) {
+			nfo->group_max_tp[g] = i;
+		}
+	}
+
+	// best rate overall is the best of the group winners
+	int index_max_tp = 0;
+	for (int g = 0; g < MinstrelDstInfo::MAX_GROUPS; g++) {
+		int best = nfo->group_max_tp[g];
+		if (best >= 0 && nfo->cur_tp[best] > nfo->cur_tp[index_max_tp]) {
+			index_max_tp = best;
+		}
+	}
+
+	int index_max_tp2 = (index_max_tp == 0 && n > 1) ? 1 : 0;
+	for (int i = 0; i < n; i++) {
+		if (i != index_max_tp && nfo->cur_tp[i] > nfo->cur_tp[index_max_tp2]) {
+			index_max_tp2 = i;
+		}
+	}
+
+	// the fallback rate is the fastest of the reliable ones, or the most
+	// reliable one if none is
+	int index_max_prob = -1;
+	for (int i = 0; i < n; i++) {
+		if (nfo->probability[i] >= 17100 && (index_max_prob < 0 || nfo->cur_tp[i] > nfo->cur_tp[index_max_prob])) {
+			index_max_prob = i;
+		}
+	}
+	if (index_max_prob < 0) {
+		index_max_prob = 0;
+		for (int i = 0; i < n; i++) {
+			if (nfo->probability[i] > nfo->probability[index_max_prob]) {
+				index_max_prob = i;
+			}
+		}
+	}
+
+	nfo->max_tp_rate = index_max_tp;
+	nfo->max_tp_rate2 = index_max_tp2;
+	nfo->max_prob_rate = index_max_prob;
+	if (n) {
+		nfo->airtime = airtime_table(nfo->rates[index_max_tp], true);
+	}
+}
+
+// Next rate to sample, groups take turns and each walks its own column
+// of the sample table. Returns -1 if this is not a good time to sample.
+int MinstrelHT::next_sample(MinstrelDstInfo *nfo)
+{
+	for (int k = 0; k < MinstrelDstInfo::MAX_GROUPS; k++) {
+		int g = nfo->sample_group;
+		nfo->sample_group = (g + 1) % MinstrelDstInfo::MAX_GROUPS;
+		int idx = _sample_table[nfo->sample_column[g]][nfo->sample_index[g]];
+		if (++nfo->sample_index[g] >= MinstrelDstInfo::MCS_GROUP_RATES) {
+			nfo->sample_index[g] = 0;
+			nfo->sample_column[g] = (nfo->sample_column[g] + 1) % MinstrelDstInfo::SAMPLE_COLUMNS;
+		}
+		int ndx = nfo->rate_index(g * MinstrelDstInfo::MCS_GROUP_RATES + idx);
+		if (ndx < 0) {
+			// not supported by the destination, try the next group
+			continue;
+		}
+		// nothing to learn from the rates in the retry chain anyway, and
+		// sampling a very reliable or much sampled rate wastes airtime
+		if (ndx == nfo->max_tp_rate || ndx == nfo->max_tp_rate2) {
+			return -1;
+		}
+		if (nfo->probability[ndx] > 17100 || nfo->sample_limit[ndx] == 0) {
+			return -1;
+		}
+		return ndx;
+	}
+	return -1;
+}
+
+void MinstrelHT::set_rates(MinstrelDstInfo *nfo, struct click_wifi_extra *ceh)
+{
+	if (!nfo->ht) {
+		Minstrel::set_rates(nfo, ceh);
+		return;
+	}
+
+	int sample = -1;
+
+	nfo->packet_count++;
+	int delta = (nfo->packet_count * _lookaround_rate / 100) - (nfo->sample_count);
+
+	/* delta > 0: sampling required */
+	if (delta > 0) {
+		if (nfo->packet_count >= 10000) {
+			nfo->sample_count = 0;
+			nfo->packet_count = 0;
+		}
+		sample = next_sample(nfo);
+		if (sample >= 0) {
+			nfo->sample_count++;
+			if (nfo->sample_limit[sample] > 0) {
+				nfo->sample_limit[sample]--;
+			}
+		}
+	}
+
+	ceh->magic = WIFI_EXTRA_MAGIC;
+	ceh->flags |= WIFI_EXTRA_MCS;
+
+	if (sample >= 0) {
+		// a slower sample only goes out if the best rate fails
+		if (nfo->usecs[sample] > nfo->usecs[nfo->max_tp_rate]) {
+			ceh->rate = nfo->rates[nfo->max_tp_rate];
+			ceh->rate1 = nfo->rates[sample];
+			ceh->max_tries = 4;
+			ceh->max_tries1 = 1;
+		} else {
+			ceh->rate = nfo->rates[sample];
+			ceh->rate1 = nfo->rates[nfo->max_tp_rate];
+			ceh->max_tries = 1;
+			ceh->max_tries1 = 4;
+		}
+	} else {
+		ceh->rate = nfo->rates[nfo->max_tp_rate];
+		ceh->rate1 = nfo->rates[nfo->max_tp_rate2];
+		ceh->max_tries = 4;
+		ceh->max_tries1 = 4;
+	}
+
+	ceh->rate2 = nfo->rates[nfo->max_prob_rate];
+	ceh->rate3 = nfo->rates[0];
+
+	ceh->max_tries2 = 4;
+	ceh->max_tries3 = 4;
+}
+
+String MinstrelHT::print_groups()
+{
+	StringAccum sa;
+	for (MinstrelIter iter = _neighbors.begin(); iter.live(); iter++) {
+		MinstrelDstInfo *nfo = &iter.value();
+		if (!nfo->ht) {
+			continue;
+		}
+		sa << nfo->eth << " avg_len " << (nfo->avg_len ? nfo->avg_len : (int) DEFAULT_LEN);
+		for (int g = 0; g < MinstrelDstInfo::MAX_GROUPS; g++) {
+			int best = nfo->group_max_tp[g];
+			if (best >= 0) {
+				sa << " group " << g << " mcs " << nfo->rates[best]
+				   << " tp " << (nfo->cur_tp[best] / ((18000 << 10) / 96));
+			}
+		}
+		sa << "\n";
+	}
+	return sa.take_string();
+}
+
+enum {
+	H_GROUPS
+};
+
+String MinstrelHT::read_handler(Element *e, void *thunk) {
+	MinstrelHT *c = (MinstrelHT *) e;
+	switch ((intptr_t) (thunk)) {
+	case H_GROUPS:
+		return c->print_groups();
+	default:
+		return "<error>\n";
+	}
+}
+
+void MinstrelHT::add_handlers() {
+	Minstrel::add_handlers();
+	add_read_handler("groups", read_handler, H_GROUPS);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(Minstrel bitrate)
+EXPORT_ELEMENT(MinstrelHT)
@@ -0,0 +1,72 @@
+#ifndef CLICK_MINSTRELHT_HH
+#define CLICK_MINSTRELHT_HH
+#include <click/element.hh>
+#include "minstrel.hh"
+CLICK_DECLS
+
+/*
+ * =c
+ * MinstrelHT([, I<KEYWORDS>])
+ * =s Wifi
+ * Minstrel HT wireless bit-rate selection algorithm
+ * =d
+ *
+ * Minstrel variant for 802.11n destinations. MCS are organised in groups
+ * of eight, one group per number of spatial streams. Samples are drawn
+ * in turn from each group following a per group random permutation, the
+ * way the Linux minstrel_ht does. Throughput estimates account for the
+ * preamble, backoff and block ack overhead of an aggregate, amortised
+ * over AMPDU frames of the average length seen in the feedback.
+ *
+ * Destinations without HT rates are handled exactly like Minstrel does.
+ * MinstrelHT can be used wherever a Minstrel element is expected.
+ *
+ * Keyword arguments are the ones of Minstrel plus:
+ *
+ * =over 8
+ *
+ * =item AMPDU
+ * Number of frames the driver aggregates in one A-MPDU. Default 1, i.e.
+ * no aggregation.
+ *
+ * =back 8
+ *
+ * =h groups read-only
+ * Best throughput MCS of every group, per destination.
+ *
+ * =a Minstrel, SetTXRate, FilterTX
+ */
+
+class MinstrelHT : public Minstrel { public:
+
+	enum { DEFAULT_LEN = 1200 };
+
+	MinstrelHT();
+	~MinstrelHT();
+
+	const char *class_name() const		{ return "MinstrelHT"; }
+	void *cast(const char *);
+
+	int initialize(ErrorHandler *);
+	int configure(Vector<String> &, ErrorHandler *);
+
+	void add_handlers();
+	String print_groups();
+
+	void update_rates(MinstrelDstInfo *);
+	void set_rates(MinstrelDstInfo *, struct click_wifi_extra *);
+
+private:
+
+	unsigned _ampdu;
+	uint8_t _sample_table[MinstrelDstInfo::SAMPLE_COLUMNS][MinstrelDstInfo::MCS_GROUP_RATES];
+
+	uint32_t ampdu_usecs(int, int) const;
+	int next_sample(MinstrelDstInfo *);
+
+	static String read_handler(Element *, void *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -29,7 +29,8 @@ extern "C" {
 }
 CLICK_DECLS
 
-RadiotapDecap::RadiotapDecap() : _debug(false)
+RadiotapDecap::RadiotapDecap() : _debug(false), _nb_layouts(0), _next_layout(0),
+	_layout_hits(0), _layout_misses(0)
 {
 }
 
@@ -37,12 +38,133 @@ RadiotapDecap::~RadiotapDecap()
 {
 }
 
+// Copies the present bitmaps of the header to present. Returns how many
+// there are, or -1 if they do not fit in MAX_PRESENT words or in len.
+int
+RadiotapDecap::present_words(const unsigned char *data, uint32_t len, uint32_t *present) {
+	uint32_t offset = offsetof(struct ieee80211_radiotap_header, it_present);
+	for (int i = 0; i < MAX_PRESENT; i++, offset += 4) {
+		if (offset + 4 > len) {
+			return -1;
+		}
+		uint32_t word;
+		memcpy(&word, data + offset, 4);
+		present[i] = word;
+		if (!(le32_to_cpu(word) & (1U << IEEE80211_RADIOTAP_EXT))) {
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+// Vendor namespaces carry their own skip length, so the same bitmaps do
+// not mean the same offsets
+bool
+RadiotapDecap::cacheable(const Layout &l) {
+	for (int i = 0; i < l.nb_present; i++) {
+		if (le32_to_cpu(l.present[i]) & (1U << IEEE80211_RADIOTAP_VENDOR_NAMESPACE)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const RadiotapDecap::Layout *
+RadiotapDecap::lookup(const unsigned char *data, uint32_t len) const {
+	const struct ieee80211_radiotap_header *th = (const struct ieee80211_radiotap_header *) data;
+	uint32_t present[MAX_PRESENT];
+	int n = present_words(data, len, present);
+	if (n < 0 || th->it_version || le16_to_cpu(th->it_len) > len) {
+		return 0;
+	}
+	for (int i = 0; i < _nb_layouts; i++) {
+		const Layout *l = &_layouts[i];
+		if (l->it_len == th->it_len && l->nb_present == n
+				&& !memcmp(l->present, present, n * sizeof(uint32_t))) {
+			return l;
+		}
+	}
+	return 0;
+}
+
 Packet *
 RadiotapDecap::simple_action(Packet *p) {
 
+	const Layout *l = lookup(p->data(), p->length());
+
+	if (!l) {
+		_layout_misses++;
+		return parse(p);
+	}
+
+	_layout_hits++;
+
+	const unsigned char *data = p->data();
+	struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
+	uint16_t flags;
+
+	memset((void*)ceh, 0, sizeof(struct click_wifi_extra));
+	ceh->magic = WIFI_EXTRA_MAGIC;
+
+	if (l->tsft >= 0) {
+		memcpy(&ceh->tsft, data + l->tsft, sizeof(ceh->tsft));
+	}
+	if (l->flags >= 0) {
+		if (data[l->flags] & IEEE80211_RADIOTAP_F_DATAPAD) {
+			ceh->pad = 1;
+		}
+		if (data[l->flags] & IEEE80211_RADIOTAP_F_FCS) {
+			p->take(4);
+		}
+	}
+	if (l->rate >= 0) {
+		ceh->rate = data[l->rate];
+	}
+	if (l->mcs) {
+		ceh->flags |= WIFI_EXTRA_MCS;
+	}
+	if (l->retries >= 0) {
+		ceh->max_tries = data[l->retries] + 1;
+	}
+	if (l->channel >= 0) {
+		memcpy(&flags, data + l->channel, 2);
+		ceh->channel = le16_to_cpu(flags);
+	}
+	if (l->rssi >= 0) {
+		ceh->rssi = data[l->rssi];
+	}
+	if (l->silence >= 0) {
+		ceh->silence = data[l->silence];
+	}
+	if (l->rx_flags >= 0) {
+		memcpy(&flags, data + l->rx_flags, 2);
+		if (le16_to_cpu(flags) & IEEE80211_RADIOTAP_F_BADFCS)
+			ceh->flags |= WIFI_EXTRA_RX_ERR;
+	}
+	if (l->tx_flags >= 0) {
+		memcpy(&flags, data + l->tx_flags, 2);
+		ceh->flags |= WIFI_EXTRA_TX;
+		if (le16_to_cpu(flags) & IEEE80211_RADIOTAP_F_TX_FAIL)
+			ceh->flags |= WIFI_EXTRA_TX_FAIL;
+	}
+
+	p->pull(l->it_len);
+	p->set_mac_header(p->data()); // reset mac-header pointer
+
+	return p;
+
+}
+
+// Decodes the header with the radiotap iterator, and remembers where the
+// fields were for the next headers with the same present bitmaps.
+Packet *
+RadiotapDecap::parse(Packet *p) {
+
 	struct ieee80211_radiotap_header *th = (struct ieee80211_radiotap_header *) p->data();
 	struct ieee80211_radiotap_iterator iter;
 	struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
+	const unsigned char *base = p->data();
+	Layout l;
 
 	int err = ieee80211_radiotap_iterator_init(&iter, th, p->length(), 0);
 
@@ -54,11 +176,19 @@ RadiotapDecap::simple_action(Packet *p) {
 	memset((void*)ceh, 0, sizeof(struct click_wifi_extra));
 	ceh->magic = WIFI_EXTRA_MAGIC;
 
+	l.nb_present = present_words(base, p->length(), l.present);
+	l.it_len = th->it_len;
+	l.tsft = l.flags = l.rate = l.retries = l.channel = -1;
+	l.rssi = l.silence = l.rx_flags = l.tx_flags = -1;
+	l.mcs = false;
+
 	while (!(err = ieee80211_radiotap_iterator_next(&iter))) {
 		u_int16_t flags;
+		int16_t offset = iter.this_arg - base;
 		switch (iter.this_arg_index) {
 		case IEEE80211_RADIOTAP_TSFT:
 			ceh->tsft = *((uint64_t *)iter.this_arg);
+			l.tsft = offset;
 			break;
 		case IEEE80211_RADIOTAP_FLAGS:
 			flags = le16_to_cpu(*(uint16_t *)iter.this_arg);
@@ -68,42 +198,54 @@ RadiotapDecap::simple_action(Packet *p) {
 			if (flags & IEEE80211_RADIOTAP_F_FCS) {
 				p->take(4);
 			}
+			l.flags = offset;
 			break;
 		case IEEE80211_RADIOTAP_MCS:
 			ceh->rate = *((uint8_t *)iter.this_arg+2);
 			ceh->flags |= WIFI_EXTRA_MCS;
+			l.rate = offset + 2;
+			l.mcs = true;
 			break;
 		case IEEE80211_RADIOTAP_RATE:
 			ceh->rate = *iter.this_arg;
+			l.rate = offset;
 			break;
 		case IEEE80211_RADIOTAP_DATA_RETRIES:
 			ceh->max_tries = *iter.this_arg + 1;
+			l.retries = offset;
 			break;
 		case IEEE80211_RADIOTAP_CHANNEL:
 			ceh->channel = le16_to_cpu(*(uint16_t *)iter.this_arg);
+			l.channel = offset;
 			break;
 		case IEEE80211_RADIOTAP_DBM_ANTSIGNAL:
 			ceh->rssi = *iter.this_arg;
+			l.rssi = offset;
 			break;
 		case IEEE80211_RADIOTAP_DBM_ANTNOISE:
 			ceh->silence = *iter.this_arg;
+			l.silence = offset;
 			break;
 		case IEEE80211_RADIOTAP_DB_ANTSIGNAL:
 			ceh->rssi = *iter.this_arg;
+			l.rssi = offset;
 			break;
 		case IEEE80211_RADIOTAP_DB_ANTNOISE:
 			ceh->silence = *iter.this_arg;
+			l.silence = offset;
 			break;
 		case IEEE80211_RADIOTAP_RX_FLAGS:
 			flags = le16_to_cpu(*(uint16_t *)iter.this_arg);
 			if (flags & IEEE80211_RADIOTAP_F_BADFCS)
 				ceh->flags |= WIFI_EXTRA_RX_ERR;
+			l.rx_flags = offset;
 			break;
 		case IEEE80211_RADIOTAP_TX_FLAGS:
 			flags = le16_to_cpu(*(uint16_t *)iter.this_arg);
 			ceh->flags |= WIFI_EXTRA_TX;
 			if (flags & IEEE80211_RADIOTAP_F_TX_FAIL)
 				ceh->flags |= WIFI_EXTRA_TX_FAIL;
+			l.tx_flags = offset;
 			break;
 		}
 	}
@@ -113,6 +255,14 @@ RadiotapDecap::simple_action(Packet *p) {
 		goto drop;
 	}
 
+	if (l.nb_present > 0 && cacheable(l)) {
+		_layouts[_next_layout] = l;
+		_next_layout = (_next_layout + 1) % NB_LAYOUTS;
+		if (_nb_layouts < NB_LAYOUTS) {
+			_nb_layouts++;
+		}
+	}
+
 	p->pull(le16_to_cpu(th->it_len));
 	p->set_mac_header(p->data()); // reset mac-header pointer
 
@@ -125,6 +275,13 @@ RadiotapDecap::simple_action(Packet *p) {
 
 }
 
+void
+RadiotapDecap::add_handlers()
+{
+	add_data_handlers("layout_hits", Handler::OP_READ, &_layout_hits);
+	add_data_handlers("layout_misses", Handler::OP_READ, &_layout_misses);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(RadiotapDecap)
 ELEMENT_REQUIRES(radiotap)
@@ -16,6 +16,17 @@ Pulls the click_wifi_radiotap header from a packet and stores it in Packet::anno
 Removes the radiotap header and copies to to Packet->anno(). This contains
 informatino such as rssi, noise, bitrate, etc.
 
+A driver fills the same fields for almost every frame it receives, so
+the offsets of the fields found for the last few distinct present bitmaps
+are remembered. Headers matching one of them are decoded straight from
+those offsets, the others go through the radiotap iterator.
+
+=h layout_hits read-only
+Number of headers decoded from a remembered layout.
+
+=h layout_misses read-only
+Number of headers that went through the radiotap iterator.
+
 =a RadiotapEncap
 */
 
@@ -30,9 +41,46 @@ class RadiotapDecap : public Element { public:
 
   bool can_live_reconfigure() const	{ return true; }
 
+  void add_handlers() CLICK_COLD;
+
   Packet *simple_action(Packet *);
   bool _debug;
 
+ private:
+
+  enum { NB_LAYOUTS = 4, MAX_PRESENT = 4 };
+
+  // where the fields used by simple_action() are for a given it_len and
+  // set of present bitmaps, -1 if absent. With repeated fields, e.g. one
+  // signal per antenna, the last one counts, as with the iterator.
+  struct Layout {
+    uint32_t present[MAX_PRESENT];
+    int nb_present;
+    uint16_t it_len;
+    int16_t tsft;
+    int16_t flags;
+    int16_t rate;
+    int16_t retries;
+    int16_t channel;
+    int16_t rssi;
+    int16_t silence;
+    int16_t rx_flags;
+    int16_t tx_flags;
+    bool mcs;
+  };
+
+  Layout _layouts[NB_LAYOUTS];
+  int _nb_layouts;
+  int _next_layout;
+
+  click_uint_large_t _layout_hits;
+  click_uint_large_t _layout_misses;
+
+  static int present_words(const unsigned char *, uint32_t, uint32_t *);
+  static bool cacheable(const Layout &);
+  const Layout *lookup(const unsigned char *, uint32_t) const;
+  Packet *parse(Packet *);
+
 };
 
 CLICK_ENDDECLS
@@ -92,39 +92,109 @@ struct click_radiotap_header_ht {
 	u_int8_t	wt_mcs3;
 } __attribute__((__packed__));
 
-RadiotapEncap::RadiotapEncap() : _debug(false) {
+static_assert(sizeof(struct click_radiotap_header) <= RadiotapEncap::MAX_HEADER_LEN, "radiotap header too long");
+static_assert(sizeof(struct click_radiotap_header_ht) <= RadiotapEncap::MAX_HEADER_LEN, "radiotap header too long");
+
+// the annotation bits that show in the radiotap header
+#define CLICK_RADIOTAP_EXTRA_FLAGS (WIFI_EXTRA_MCS | WIFI_EXTRA_MCS_SGI | WIFI_EXTRA_MCS_BW_40 | WIFI_EXTRA_TX_NOACK)
+
+RadiotapEncap::RadiotapEncap() : _debug(false), _nb_headers(0), _next_header(0),
+	_header_hits(0), _header_misses(0), _reallocs(0),
+	_headroom(WIFI_MAX(sizeof(struct click_radiotap_header), sizeof(struct click_radiotap_header_ht))) {
 }
 
 RadiotapEncap::~RadiotapEncap() {
 }
 
-Packet *
-RadiotapEncap::simple_action(Packet *p) {
-	click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
+void *
+RadiotapEncap::cast(const char *n) {
+	if (strcmp(n, "Headroom") == 0)
+		return &_headroom;
+	else
+		return Element::cast(n);
+}
+
+RadiotapEncap::HeaderKey::HeaderKey(const click_wifi_extra *ceh) {
+	memset(this, 0, sizeof(*this));
+	flags = ceh->flags & CLICK_RADIOTAP_EXTRA_FLAGS;
+	rate[0] = ceh->rate;
+	tries[0] = ceh->max_tries;
+	// the rest of the chain is ignored after the first rate left out
+	if (ceh->rate1 != -1) {
+		rate[1] = ceh->rate1;
+		tries[1] = ceh->max_tries1;
+		if (ceh->rate2 != -1) {
+			rate[2] = ceh->rate2;
+			tries[2] = ceh->max_tries2;
+			if (ceh->rate3 != -1) {
+				rate[3] = ceh->rate3;
+				tries[3] = ceh->max_tries3;
+			} else {
+				rate[3] = -1;
+			}
+		} else {
+			rate[2] = -1;
+		}
+	} else {
+		rate[1] = -1;
+	}
+}
+
+// The radiotap header for ceh, built the first time its rates, tries and
+// flags are seen and kept for the frames that come with the same ones
+const RadiotapEncap::Header *
+RadiotapEncap::header(const click_wifi_extra *ceh) {
+
+	HeaderKey key(ceh);
+
+	for (int i = 0; i < _nb_headers; i++) {
+		if (!memcmp(&_headers[i].key, &key, sizeof(key))) {
+			_header_hits++;
+			return &_headers[i];
+		}
+	}
+
+	_header_misses++;
+
+	Header *h = &_headers[_next_header];
+	_next_header = (_next_header + 1) % NB_HEADERS;
+	if (_nb_headers < NB_HEADERS) {
+		_nb_headers++;
+	}
+
+	h->key = key;
 	if (ceh->flags & WIFI_EXTRA_MCS)
-		return encap_ht(p);
-	return encap(p);
+		h->len = encap_ht(ceh, h->data);
+	else
+		h->len = encap(ceh, h->data);
+
+	return h;
+
 }
 
 Packet *
-RadiotapEncap::encap_ht(Packet *p) {
+RadiotapEncap::simple_action(Packet *p) {
 
-	click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
-	WritablePacket *p_out = p->uniqueify();
+	const Header *h = header(WIFI_EXTRA_ANNO(p));
+	if (p->headroom() < h->len) {
+		_reallocs++;
+	}
+	WritablePacket *p_out = p->push(h->len);
 
 	if (!p_out) {
-		p->kill();
 		return 0;
 	}
 
-	p_out = p_out->push(sizeof(struct click_radiotap_header_ht));
+	memcpy(p_out->data(), h->data, h->len);
 
-	if (!p_out) {
-		p->kill();
-		return 0;
-	}
+	return p_out;
 
-	struct click_radiotap_header_ht *crh  = (struct click_radiotap_header_ht *) p_out->data();
+}
+
+uint16_t
+RadiotapEncap::encap_ht(const click_wifi_extra *ceh, unsigned char *data) {
+
+	struct click_radiotap_header_ht *crh  = (struct click_radiotap_header_ht *) data;
 
 	memset(crh, 0, sizeof(struct click_radiotap_header_ht));
 
@@ -206,29 +276,14 @@ RadiotapEncap::encap_ht(Packet *p) {
 		}
 	}
 
-	return p_out;
+	return sizeof(struct click_radiotap_header_ht);
 
 }
 
-Packet *
-RadiotapEncap::encap(Packet *p) {
-
-	click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
-	WritablePacket *p_out = p->uniqueify();
+uint16_t
+RadiotapEncap::encap(const click_wifi_extra *ceh, unsigned char *data) {
 
-	if (!p_out) {
-		p->kill();
-		return 0;
-	}
-
-	p_out = p_out->push(sizeof(struct click_radiotap_header));
-
-	if (!p_out) {
-		p->kill();
-		return 0;
-	}
-
-	struct click_radiotap_header *crh  = (struct click_radiotap_header *) p_out->data();
+	struct click_radiotap_header *crh  = (struct click_radiotap_header *) data;
 
 	memset(crh, 0, sizeof(struct click_radiotap_header));
 
@@ -268,8 +323,16 @@ RadiotapEncap::encap(Packet *p) {
 		}
 	}
 
-	return p_out;
+	return sizeof(struct click_radiotap_header);
+
+}
 
+void
+RadiotapEncap::add_handlers()
+{
+	add_data_handlers("header_hits", Handler::OP_READ, &_header_hits);
+	add_data_handlers("header_misses", Handler::OP_READ, &_header_misses);
+	add_data_handlers("reallocs", Handler::OP_READ, &_reallocs);
 }
 
 CLICK_ENDDECLS
@@ -2,6 +2,7 @@
 #define CLICK_RADIOTAPENCAP_HH
 #include <click/element.hh>
 #include <clicknet/ether.h>
+#include <clicknet/wifi.h>
 CLICK_DECLS
 
 /*
@@ -16,6 +17,23 @@ Pushes the click_wifi_radiotap header on a packet based on information in Packet
 
 Copies the wifi_radiotap_header from Packet::anno() and pushes it onto the packet.
 
+Frames mostly go out with one of a few rate, retry and flag combinations,
+so the headers built for the last eight combinations seen are kept and
+copied onto the frames that use them again.
+
+The longest header is declared as the headroom this element needs, see
+HeadroomTracker: sources that size their headroom from it hand over
+frames the header fits in front of.
+
+=h header_hits read-only
+Number of frames that got a header built before.
+
+=h header_misses read-only
+Number of headers built.
+
+=h reallocs read-only
+Number of frames copied for lack of headroom.
+
 =a RadiotapDecap, SetTXRate
 */
 
@@ -28,15 +46,52 @@ class RadiotapEncap : public Element { public:
   const char *class_name() const	{ return "RadiotapEncap"; }
   const char *port_count() const	{ return PORTS_1_1; }
   const char *processing() const	{ return AGNOSTIC; }
+  void *cast(const char *);
 
   bool can_live_reconfigure() const	{ return true; }
 
+  void add_handlers() CLICK_COLD;
+
   Packet *simple_action(Packet *);
-  Packet *encap(Packet *);
-  Packet *encap_ht(Packet *);
+  void push_batch(int port, Packet *head)	{ simple_action_push_batch(port, head); }
+  Packet *pull_batch(int port, unsigned max) { return simple_action_pull_batch(port, max); }
+  static uint16_t encap(const click_wifi_extra *, unsigned char *);
+  static uint16_t encap_ht(const click_wifi_extra *, unsigned char *);
 
   bool _debug;
 
+  enum { NB_HEADERS = 8, MAX_HEADER_LEN = 64 };
+
+ private:
+
+  // what encap() and encap_ht() look at in the annotation
+  struct HeaderKey {
+    uint16_t flags;
+    int8_t rate[4];
+    uint8_t tries[4];
+    HeaderKey() { }
+    HeaderKey(const click_wifi_extra *);
+  };
+
+  struct Header {
+    HeaderKey key;
+    uint16_t len;
+    unsigned char data[MAX_HEADER_LEN];
+  };
+
+  Header _headers[NB_HEADERS];
+  int _nb_headers;
+  int _next_header;
+
+  click_uint_large_t _header_hits;
+  click_uint_large_t _header_misses;
+  click_uint_large_t _reallocs;
+
+  // length of the longest header, see cast()
+  unsigned _headroom;
+
+  const Header *header(const click_wifi_extra *);
+
 };
 
 CLICK_ENDDECLS
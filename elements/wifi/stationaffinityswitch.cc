@@ -0,0 +1,329 @@
+/*
+ * stationaffinityswitch.{cc,hh} -- spreads frames over per-thread queues
+ * by station
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "stationaffinityswitch.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+StationAffinitySwitch::StationAffinitySwitch()
+  : _offset(10), _capacity(0), _mask(0), _nbuckets(0), _rebalance(true),
+    _skew(150), _window(4096), _nrings(0), _rings(0), _buckets(0),
+    _seen(0), _moves(0)
+{
+}
+
+StationAffinitySwitch::~StationAffinitySwitch()
+{
+}
+
+void *
+StationAffinitySwitch::port_cast(bool isoutput, int port, const char *name)
+{
+  if (isoutput && strcmp(name, Notifier::EMPTY_NOTIFIER) == 0
+      && port >= 0 && port < _nrings)
+    return static_cast<Notifier *>(&_rings[port].empty_note);
+  else if (!isoutput && strcmp(name, Notifier::FULL_NOTIFIER) == 0)
+    return static_cast<Notifier *>(&_full_note);
+  return Element::port_cast(isoutput, port, name);
+}
+
+int
+StationAffinitySwitch::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  uint32_t capacity = 1024, buckets = 256;
+
+  if (Args(conf, this, errh)
+      .read("OFFSET", _offset)
+      .read("CAPACITY", capacity)
+      .read("BUCKETS", buckets)
+      .read("REBALANCE", _rebalance)
+      .read("SKEW", _skew)
+      .read("WINDOW", _window)
+      .complete() < 0)
+    return -1;
+
+  if (_offset < 0)
+    return errh->error("OFFSET must be >= 0");
+  if (capacity < 1 || capacity > 0x10000000)
+    return errh->error("CAPACITY out of range");
+  if (_skew <= 100)
+    return errh->error("SKEW must be more than 100");
+  if (_window < 1)
+    return errh->error("WINDOW must be positive");
+  if (noutputs() > 0xFFFF)
+    return errh->error("too many outputs");
+
+  _capacity = 1;
+  while (_capacity < capacity)
+    _capacity <<= 1;
+  _mask = _capacity - 1;
+  if (buckets < (uint32_t) noutputs())
+    buckets = noutputs();
+  _nbuckets = 1;
+  while (_nbuckets < buckets)
+    _nbuckets <<= 1;
+
+  _nrings = noutputs();
+  _rings = new Ring[_nrings];
+  for (int i = 0; i < _nrings; i++) {
+    _rings[i].q = new Packet *[_capacity];
+    memset(_rings[i].q, 0, sizeof(Packet *) * _capacity);
+    _rings[i].empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+  }
+  _full_note.initialize(Notifier::FULL_NOTIFIER, router());
+  _full_note.set_active(true, false);
+
+  _buckets = new Bucket[_nbuckets];
+  for (uint32_t b = 0; b < _nbuckets; b++) {
+    _buckets[b].ring = b % _nrings;
+    _buckets[b].load = 0;
+    _buckets[b].last = 0;
+  }
+
+  return 0;
+}
+
+void
+StationAffinitySwitch::cleanup(CleanupStage)
+{
+  for (int i = 0; i < _nrings; i++) {
+    Ring &r = _rings[i];
+    if (r.q) {
+      for (uint32_t h = r.head; h != r.tail; h++)
+	r.q[h & _mask]->kill();
+      delete[] r.q;
+    }
+  }
+  delete[] _rings;
+  delete[] _buckets;
+  _rings = 0;
+  _buckets = 0;
+  _nrings = 0;
+}
+
+inline uint32_t
+StationAffinitySwitch::bucket(Packet *p) const
+{
+  if (p->length() < (uint32_t) _offset + 6)
+    return 0;
+  const uint8_t *a = p->data() + _offset;
+  uint32_t x = ((a[0] << 8) | a[1])
+    ^ ((a[2] << 24) | (a[3] << 16) | (a[4] << 8) | a[5]);
+  x *= 0x9E3779B1U;
+  x ^= x >> 16;
+  return x & (_nbuckets - 1);
+}
+
+void
+StationAffinitySwitch::push(int, Packet *p)
+{
+  Bucket &b = _buckets[bucket(p)];
+  Ring &r = _rings[b.ring];
+
+  b.load++;
+  r.load++;
+
+  uint32_t t = r.tail;
+  uint32_t len = t - r.head;
+  if (len >= _capacity) {
+    r.drops++;
+    p->kill();
+  } else {
+    r.q[t & _mask] = p;
+    // publish the slot before the new tail
+    click_write_fence();
+    r.tail = t + 1;
+    b.last = t + 1;
+    r.enqueued++;
+    if (len + 1 > r.highwater)
+      r.highwater = len + 1;
+    r.empty_note.wake();
+    if (len + 1 == _capacity) {
+      _full_note.sleep();
+      // the consumer may have pulled, and woken us, in between
+      if (r.tail - r.head < _capacity)
+	_full_note.wake();
+    }
+  }
+
+  if (_rebalance && ++_seen >= _window)
+    rebalance();
+}
+
+Packet *
+StationAffinitySwitch::pull(int port)
+{
+  Ring &r = _rings[port];
+  uint32_t h = r.head;
+
+  if (h == r.tail) {
+    if (r.sleepiness >= SLEEPINESS_TRIGGER) {
+      r.empty_note.sleep();
+      // the producer may have pushed, and woken us, in between
+      click_fence();
+      if (r.tail != h)
+	r.empty_note.wake();
+    } else
+      r.sleepiness++;
+    return 0;
+  }
+
+  // read the slot only after observing the tail
+  click_read_fence();
+  Packet *p = r.q[h & _mask];
+  r.q[h & _mask] = 0;
+  bool was_full = (r.tail - h >= _capacity);
+  // release the slot only after it has been read
+  click_fence();
+  r.head = h + 1;
+  r.dequeued++;
+  r.sleepiness = 0;
+  if (was_full)
+    _full_note.wake();
+  return p;
+}
+
+// Runs in the producer, which alone reads and writes the buckets, so the
+// only state shared with the consumers is the head of the rings.
+void
+StationAffinitySwitch::rebalance()
+{
+  _seen = 0;
+
+  int busiest = 0, idlest = 0;
+  for (int i = 1; i < _nrings; i++) {
+    if (_rings[i].load > _rings[busiest].load)
+      busiest = i;
+    if (_rings[i].load < _rings[idlest].load)
+      idlest = i;
+  }
+
+  uint64_t total = 0;
+  for (int i = 0; i < _nrings; i++)
+    total += _rings[i].load;
+
+  Ring &from = _rings[busiest];
+  if (busiest != idlest
+      && (uint64_t) from.load * _nrings * 100 > total * _skew) {
+    // move the busiest bucket that leaves the busiest ring heavier
+    // than the idlest, and whose frames have all been pulled
+    uint32_t gap = from.load - _rings[idlest].load;
+    uint32_t head = from.head;
+    int best = -1;
+    for (uint32_t b = 0; b < _nbuckets; b++) {
+      Bucket &bk = _buckets[b];
+      if (bk.ring != busiest || !bk.load || 2 * bk.load > gap
+	  || (int32_t) (head - bk.last) < 0)
+	continue;
+      if (best < 0 || bk.load > _buckets[best].load)
+	best = b;
+    }
+    if (best >= 0) {
+      _buckets[best].ring = idlest;
+      _buckets[best].last = _rings[idlest].tail;
+      from.load -= _buckets[best].load;
+      _rings[idlest].load += _buckets[best].load;
+      _moves++;
+    }
+  }
+
+  for (uint32_t b = 0; b < _nbuckets; b++)
+    _buckets[b].load >>= 1;
+  for (int i = 0; i < _nrings; i++)
+    _rings[i].load >>= 1;
+}
+
+enum { H_STATS, H_DROPS, H_MOVES, H_REBALANCE, H_RESET };
+
+String
+StationAffinitySwitch::read_handler(Element *e, void *thunk)
+{
+  StationAffinitySwitch *s = static_cast<StationAffinitySwitch *>(e);
+
+  switch ((intptr_t) thunk) {
+  case H_STATS: {
+    Vector<uint32_t> buckets(s->_nrings, 0);
+    for (uint32_t b = 0; b < s->_nbuckets; b++)
+      buckets[s->_buckets[b].ring]++;
+    StringAccum sa;
+    for (int i = 0; i < s->_nrings; i++) {
+      Ring &r = s->_rings[i];
+      sa << i << " length " << (uint32_t) (r.tail - r.head)
+	 << " highwater " << r.highwater
+	 << " enqueued " << r.enqueued
+	 << " dequeued " << r.dequeued
+	 << " drops " << r.drops
+	 << " buckets " << buckets[i] << "\n";
+    }
+    return sa.take_string();
+  }
+  case H_DROPS: {
+    uint32_t drops = 0;
+    for (int i = 0; i < s->_nrings; i++)
+      drops += s->_rings[i].drops;
+    return String(drops);
+  }
+  case H_MOVES:
+    return String(s->_moves);
+  case H_REBALANCE:
+    return String(s->_rebalance);
+  default:
+    return String();
+  }
+}
+
+int
+StationAffinitySwitch::write_handler(const String &in_s, Element *e, void *vparam, ErrorHandler *errh)
+{
+  StationAffinitySwitch *s = static_cast<StationAffinitySwitch *>(e);
+  String str = cp_uncomment(in_s);
+
+  switch ((intptr_t) vparam) {
+  case H_REBALANCE: {
+    bool rebalance;
+    if (!BoolArg().parse(str, rebalance))
+      return errh->error("rebalance parameter must be boolean");
+    s->_rebalance = rebalance;
+    break;
+  }
+  case H_RESET:
+    for (int i = 0; i < s->_nrings; i++) {
+      Ring &r = s->_rings[i];
+      r.enqueued = r.dequeued = r.drops = 0;
+      r.highwater = r.tail - r.head;
+    }
+    s->_moves = 0;
+    break;
+  }
+  return 0;
+}
+
+void
+StationAffinitySwitch::add_handlers()
+{
+  add_read_handler("stats", read_handler, H_STATS);
+  add_read_handler("drops", read_handler, H_DROPS);
+  add_read_handler("moves", read_handler, H_MOVES);
+  add_read_handler("rebalance", read_handler, H_REBALANCE);
+  add_write_handler("rebalance", write_handler, H_REBALANCE);
+  add_write_handler("reset", write_handler, H_RESET, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(StationAffinitySwitch)
+ELEMENT_MT_SAFE(StationAffinitySwitch)
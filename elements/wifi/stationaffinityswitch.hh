@@ -0,0 +1,185 @@
+#ifndef CLICK_STATIONAFFINITYSWITCH_HH
+#define CLICK_STATIONAFFINITYSWITCH_HH
+#include <click/element.hh>
+#include <click/notifier.hh>
+CLICK_DECLS
+
+/*
+=c
+
+StationAffinitySwitch([I<keywords> OFFSET, CAPACITY, BUCKETS, REBALANCE, SKEW, WINDOW])
+
+=s Wifi
+
+Spreads frames over per-thread queues by station, keeping their order
+
+=d
+
+Hashes the station address of every frame pushed into its input into one
+of BUCKETS buckets, and enqueues the frame on the queue of the output its
+bucket is assigned to. Each output is a single-producer, single-consumer
+ring of CAPACITY frames: exactly one thread may push into the input, and
+each output must be pulled by exactly one thread, typically an Unqueue
+pinned with StaticThreadSched. The rings need no locks.
+
+All frames of a station take the same output, in order, so the elements
+behind each output, such as WifiDupeFilter, EmpowerRXStats or
+EmpowerWifiDecap, only ever see a station on one thread and keep its state
+there.
+
+Every output has its own empty notifier, so the thread draining it sleeps
+while its ring is empty. The input has a full notifier that goes quiet
+when a ring fills up. Frames arriving at a full ring are dropped.
+
+When REBALANCE is true, the load of the buckets is counted over a window
+of WINDOW frames. If the busiest output got more than SKEW percent of the
+average load, its busiest bucket that would not make things worse is
+moved to the least loaded output. A bucket only moves once all the frames
+it already queued have been pulled, which keeps the frames of every
+station in order. Counts are halved after every window.
+
+Keyword arguments are:
+
+=over 8
+
+=item OFFSET
+
+Offset of the station address in the frame. Default is 10, the
+transmitter address of an 802.11 header. Use 6 to hash Ethernet frames on
+their source. Frames too short to have an address go to the first bucket.
+
+=item CAPACITY
+
+Number of frames each ring holds, rounded up to a power of two. Default
+is 1024.
+
+=item BUCKETS
+
+Number of hash buckets, rounded up to a power of two and at least the
+number of outputs. Default is 256.
+
+=item REBALANCE
+
+Whether buckets are moved between outputs on load skew. Default is true.
+
+=item SKEW
+
+Load of the busiest output, in percent of the average, above which a
+bucket is moved. Default is 150.
+
+=item WINDOW
+
+Number of frames between two rebalancing decisions. Default is 4096.
+
+=back 8
+
+=h stats read-only
+
+One line per output: the ring length, the highest length seen, the
+frames enqueued, dequeued and dropped, and the buckets assigned.
+
+=h drops read-only
+
+Frames dropped because their ring was full.
+
+=h moves read-only
+
+Buckets moved by rebalancing.
+
+=h rebalance read/write
+
+Whether rebalancing is enabled.
+
+=h reset write-only
+
+Resets the counters.
+
+=e
+
+  FromDevice(moni0, BURST 32)
+    -> RadiotapDecap()
+    -> sas :: StationAffinitySwitch;
+
+  sas [0] -> uq0 :: Unqueue -> WifiDupeFilter -> ...;
+  sas [1] -> uq1 :: Unqueue -> WifiDupeFilter -> ...;
+
+  StaticThreadSched(uq0 1, uq1 2);
+
+=a HashSwitch, Unqueue, StaticThreadSched, ThreadSafeQueue
+*/
+
+class StationAffinitySwitch : public Element { public:
+
+  StationAffinitySwitch() CLICK_COLD;
+  ~StationAffinitySwitch() CLICK_COLD;
+
+  const char *class_name() const	{ return "StationAffinitySwitch"; }
+  const char *port_count() const	{ return "1/1-"; }
+  const char *processing() const	{ return "h/l"; }
+  const char *flow_code() const		{ return "x/x"; }
+  void *port_cast(bool, int, const char *);
+
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  void cleanup(CleanupStage) CLICK_COLD;
+  void add_handlers() CLICK_COLD;
+
+  void push(int, Packet *);
+  Packet *pull(int);
+
+ private:
+
+  enum { SLEEPINESS_TRIGGER = 9 };
+
+  // One output. The producer writes tail and the counters next to it,
+  // the consumer writes head and what follows; the index pairs are
+  // free-running so that tail - head is the length.
+  struct Ring {
+    Packet **q;
+    ActiveNotifier empty_note;
+    volatile uint32_t tail CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    uint32_t enqueued;
+    uint32_t drops;
+    uint32_t highwater;
+    uint32_t load;
+    volatile uint32_t head CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    uint32_t dequeued;
+    int sleepiness;
+    Ring() : q(0), tail(0), enqueued(0), drops(0), highwater(0), load(0),
+	     head(0), dequeued(0), sleepiness(0) {
+    }
+  };
+
+  struct Bucket {
+    uint16_t ring;
+    // frames counted in the current window
+    uint32_t load;
+    // ring tail after the last frame of the bucket was enqueued
+    uint32_t last;
+  };
+
+  int _offset;
+  uint32_t _capacity;
+  uint32_t _mask;
+  uint32_t _nbuckets;
+  bool _rebalance;
+  uint32_t _skew;
+  uint32_t _window;
+
+  int _nrings;
+  Ring *_rings;
+  Bucket *_buckets;
+  uint32_t _seen;
+  uint32_t _moves;
+
+  ActiveNotifier _full_note;
+
+  inline uint32_t bucket(Packet *) const;
+  void rebalance();
+
+  static String read_handler(Element *, void *);
+  static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -24,16 +24,30 @@
 #include "transmissionpolicies.hh"
 CLICK_DECLS
 
-TransmissionPolicies::TransmissionPolicies() : _default_tx_policy(0) {
+TransmissionPolicies::TransmissionPolicies() :
+		_tx_table(new TxTable()), _default_tx_policy(0), _generation(0), _epoch(&_own_epoch) {
 }
 
 TransmissionPolicies::~TransmissionPolicies() {
+	for (TxTableIter it = _tx_table->begin(); it.live(); it++) {
+		delete it.value();
+	}
+	delete _tx_table;
+	for (int i = 0; i < _retired.size(); i++) {
+		for (int j = 0; j < _retired[i]._policies.size(); j++) {
+			delete _retired[i]._policies[j];
+		}
+		delete _retired[i]._table;
+	}
 }
 
 int TransmissionPolicies::configure(Vector<String> &conf, ErrorHandler *errh) {
 
 	int res = 0;
 
+	// an Args would copy and rescan conf for every entry
+	ArgContext context(this, errh);
+
 	for (int x = 0; x < conf.size(); x++) {
 
 		Vector<String> args;
@@ -47,7 +61,7 @@ int TransmissionPolicies::configure(Vector<String> &conf, ErrorHandler *errh) {
 
 			TransmissionPolicy * tx_policy;
 
-			if (!ElementCastArg("TransmissionPolicy").parse(args[1], tx_policy, Args(conf, this, errh))) {
+			if (!ElementCastArg("TransmissionPolicy").parse(args[1], tx_policy, context)) {
 				return errh->error("error param %s: must be a TransmissionPolicy element", conf[x].c_str());
 			}
 
@@ -63,11 +77,14 @@ int TransmissionPolicies::configure(Vector<String> &conf, ErrorHandler *errh) {
 
 			TransmissionPolicy * tx_policy;
 
-			if (!ElementCastArg("TransmissionPolicy").parse(args[1], tx_policy, Args(conf, this, errh))) {
+			if (!ElementCastArg("TransmissionPolicy").parse(args[1], tx_policy, context)) {
 				return errh->error("error param %s: must be a TransmissionPolicy element", conf[x].c_str());
 			}
 
-			_tx_table.insert(eth, tx_policy->tx_policy());
+			// the table owns its policies, see publish()
+			TxPolicyInfo *old = _tx_table->get(eth);
+			delete old;
+			_tx_table->insert(eth, new TxPolicyInfo(*tx_policy->tx_policy()));
 
 		}
 
@@ -82,15 +99,36 @@ int TransmissionPolicies::configure(Vector<String> &conf, ErrorHandler *errh) {
 
 }
 
+void TransmissionPolicies::take_state(Element *e, ErrorHandler *) {
+
+	TransmissionPolicies *tp = (TransmissionPolicies *) e->cast("TransmissionPolicies");
+
+	if (!tp) {
+		return;
+	}
+
+	_lock.acquire();
+
+	TxTable *table = new TxTable(*_tx_table);
+	for (TxTableIter it = tp->_tx_table->begin(); it.live(); it++) {
+		if (!table->get(it.key())) {
+			table->insert(it.key(), new TxPolicyInfo(*it.value()));
+		}
+	}
+	publish(table, Vector<TxPolicyInfo *>());
+
+	_lock.release();
+
+}
+
 TxPolicyInfo *
 TransmissionPolicies::lookup(EtherAddress eth) {
 
 	if (!eth) {
-		click_chatter("%s: lookup called with NULL eth!\n", name().c_str());
-		return new TxPolicyInfo();
+		return _default_tx_policy;
 	}
 
-	TxPolicyInfo * dst = _tx_table.find(eth);
+	TxPolicyInfo * dst = tx_table()->get(eth);
 
 	if (dst) {
 		return dst;
@@ -104,25 +142,52 @@ TxPolicyInfo *
 TransmissionPolicies::supported(EtherAddress eth) {
 
 	if (!eth) {
-		click_chatter("%s: lookup called with NULL eth!\n", name().c_str());
-		return new TxPolicyInfo();
+		return 0;
 	}
 
-	TxPolicyInfo *dst = _tx_table.find(eth);
+	return tx_table()->get(eth);
 
-	if (dst) {
-		return dst;
-	}
+}
 
-	return 0;
+void TransmissionPolicies::publish(TxTable *table, const Vector<TxPolicyInfo *> &replaced) {
+
+	// swap in the new table, the old one and the policies it alone
+	// pointed to go away once no reader can be using them
+	TxTable *prev = _tx_table;
+	click_write_fence();
+	_tx_table = table;
+	_generation++;
+
+	TxRetired retired;
+	retired._table = prev;
+	retired._policies = replaced;
+	retired._epoch = _epoch->retire();
+	_retired.push_back(retired);
+
+	reclaim();
+
+}
 
+void TransmissionPolicies::reclaim() {
+	int kept = 0;
+	for (int i = 0; i < _retired.size(); i++) {
+		if (_epoch->quiescent(_retired[i]._epoch)) {
+			for (int j = 0; j < _retired[i]._policies.size(); j++) {
+				delete _retired[i]._policies[j];
+			}
+			delete _retired[i]._table;
+		} else {
+			_retired[kept++] = _retired[i];
+		}
+	}
+	_retired.resize(kept);
 }
 
-int TransmissionPolicies::insert(EtherAddress eth, Vector<int> mcs, Vector<int> ht_mcs) {
+int TransmissionPolicies::insert(EtherAddress eth, const TxPolicyRates &mcs, const TxPolicyRates &ht_mcs) {
 	return insert(eth, mcs, ht_mcs, false, TX_MCAST_LEGACY, 3, 2436);
 }
 
-int TransmissionPolicies::insert(EtherAddress eth, Vector<int> mcs, Vector<int> ht_mcs, bool no_ack, empower_tx_mcast_type tx_mcast, int ur_mcast_count, int rts_cts) {
+int TransmissionPolicies::insert(EtherAddress eth, const TxPolicyRates &mcs, const TxPolicyRates &ht_mcs, bool no_ack, empower_tx_mcast_type tx_mcast, int ur_mcast_count, int rts_cts) {
 
 	if (!(eth)) {
 		click_chatter("TransmissionPolicies %s: You fool, you tried to insert %s\n",
@@ -131,12 +196,12 @@ int TransmissionPolicies::insert(EtherAddress eth, Vector<int> mcs, Vector<int>
 		return -1;
 	}
 
-	TxPolicyInfo *dst = _tx_table.find(eth);
+	_lock.acquire();
 
-	if (!dst) {
-		_tx_table.insert(eth, new TxPolicyInfo());
-		dst = _tx_table.find(eth);
-	}
+	// policies are never changed in place, readers may be looking at the
+	// current one. the frame counters carry over.
+	TxPolicyInfo *old = _tx_table->get(eth);
+	TxPolicyInfo *dst = old ? new TxPolicyInfo(*old) : new TxPolicyInfo();
 
 	dst->_mcs.clear();
 	dst->_ht_mcs.clear();
@@ -171,6 +236,17 @@ int TransmissionPolicies::insert(EtherAddress eth, Vector<int> mcs, Vector<int>
 		dst->_ht_mcs = ht_mcs;
 	}
 
+	TxTable *table = new TxTable(*_tx_table);
+	table->insert(eth, dst);
+
+	Vector<TxPolicyInfo *> replaced;
+	if (old) {
+		replaced.push_back(old);
+	}
+	publish(table, replaced);
+
+	_lock.release();
+
 	return 0;
 
 }
@@ -184,22 +260,36 @@ int TransmissionPolicies::remove(EtherAddress eth) {
 		return -1;
 	}
 
-	TxPolicyInfo *dst = _tx_table.find(eth);
+	_lock.acquire();
+
+	TxPolicyInfo *dst = _tx_table->get(eth);
 
 	if (!dst) {
+		_lock.release();
 		return -1;
 	}
 
-	_tx_table.remove(eth);
+	TxTable *table = new TxTable(*_tx_table);
+	table->remove(eth);
+
+	Vector<TxPolicyInfo *> replaced;
+	replaced.push_back(dst);
+	publish(table, replaced);
+
+	_lock.release();
 
 	return 0;
 
 }
 
 void TransmissionPolicies::clear() {
-	for (TxTableIter it = _tx_table.begin(); it.live(); it++) {
-		remove(it.key());
+	_lock.acquire();
+	Vector<TxPolicyInfo *> replaced;
+	for (TxTableIter it = _tx_table->begin(); it.live(); it++) {
+		replaced.push_back(it.value());
 	}
+	publish(new TxTable(), replaced);
+	_lock.release();
 }
 
 enum {
@@ -210,9 +300,11 @@ String TransmissionPolicies::read_handler(Element *e, void *thunk) {
 	TransmissionPolicies *td = (TransmissionPolicies *) e;
 	switch ((uintptr_t) thunk) {
 	case H_POLICIES: {
+	    EmpowerEpoch::Guard guard(td->_epoch);
 	    StringAccum sa;
 	    sa << "DEFAULT " << td->_default_tx_policy->unparse() << "\n";
-		for (TxTableIter it = td->_tx_table.begin(); it.live(); it++) {
+		const TxTable *table = td->tx_table();
+		for (TxTableIter it = table->begin(); it.live(); it++) {
 		    sa << it.key().unparse() << " " << it.value()->unparse() << "\n";
 		}
 		return sa.take_string();
@@ -4,7 +4,10 @@
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
+#include <click/flathashtable.hh>
 #include <click/glue.hh>
+#include <click/sync.hh>
+#include <elements/empower/empowerepoch.hh>
 #include "transmissionpolicy.hh"
 CLICK_DECLS
 
@@ -30,12 +33,28 @@ Removes an ethernet address from the database.
 =h rates read-only
 Shows the entries in the database.
 
+The table is copied on write, so lookup() and supported() take no lock.
+Readers must hold an EmpowerEpoch::Guard on epoch() for as long as they
+use a policy or the table; replaced ones are freed once no reader can
+see them anymore. Writers are serialised internally.
+
+On hot-swap the policies of the old element are carried over, except for
+the addresses given in the configuration.
+
 =a BeaconScanner
  */
 
-typedef HashMap<EtherAddress, TxPolicyInfo *> TxTable;
+typedef FlatHashTable<EtherAddress, TxPolicyInfo *> TxTable;
 typedef TxTable::const_iterator TxTableIter;
 
+// A table and the policies it no longer points to, waiting for readers
+// of the given epoch to go away
+struct TxRetired {
+  TxTable *_table;
+  Vector<TxPolicyInfo *> _policies;
+  uint32_t _epoch;
+};
+
 class TransmissionPolicies : public Element { public:
 
   TransmissionPolicies() CLICK_COLD;
@@ -45,24 +64,47 @@ class TransmissionPolicies : public Element { public:
   const char *port_count() const		{ return PORTS_0_0; }
 
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  void take_state(Element *, ErrorHandler *) CLICK_COLD;
 
   void add_handlers() CLICK_COLD;
 
-  TxTable * tx_table() { return &_tx_table; }
+  const TxTable * tx_table() {
+    const TxTable *table = _tx_table;
+    click_read_fence();
+    return table;
+  }
   TxPolicyInfo * default_tx_policy() { return _default_tx_policy; }
+
+  // readers share the epoch of the elements they run in, so that one
+  // guard covers both (see EmpowerLVAPManager::epoch)
+  EmpowerEpoch * epoch() { return _epoch; }
+  void set_epoch(EmpowerEpoch *epoch) { _epoch = epoch; }
   void clear();
 
+  // bumped whenever a policy is added, changed or removed, so that
+  // users can cache what they derive from the policies
+  uint32_t generation() const { return _generation; }
+
   TxPolicyInfo * lookup(EtherAddress eth);
   TxPolicyInfo * supported(EtherAddress eth);
 
-  int insert(EtherAddress, Vector<int>, Vector<int>, bool, empower_tx_mcast_type, int, int);
-  int insert(EtherAddress, Vector<int>, Vector<int>);
+  int insert(EtherAddress, const TxPolicyRates &, const TxPolicyRates &, bool, empower_tx_mcast_type, int, int);
+  int insert(EtherAddress, const TxPolicyRates &, const TxPolicyRates &);
   int remove(EtherAddress);
 
 private:
 
-  TxTable _tx_table;
+  TxTable * volatile _tx_table;
   TxPolicyInfo * _default_tx_policy;
+  uint32_t _generation;
+
+  EmpowerEpoch _own_epoch;
+  EmpowerEpoch * _epoch;
+  Spinlock _lock;
+  Vector<TxRetired> _retired;
+
+  void publish(TxTable *, const Vector<TxPolicyInfo *> &);
+  void reclaim();
 
   static String read_handler(Element *, void *);
 
@@ -40,8 +40,8 @@ int TransmissionPolicy::configure(Vector<String> &conf, ErrorHandler *errh) {
 	String tx_mcast_string = "LEGACY";
 	empower_tx_mcast_type tx_mcast;
 	int ur_mcast_count = 3;
-	Vector<int> mcs;
-	Vector<int> ht_mcs;
+	TxPolicyRates mcs;
+	TxPolicyRates ht_mcs;
 
 	res = Args(conf, this, errh).read_m("MCS", mcs_string)
 								.read_m("HT_MCS", ht_mcs_string)
@@ -5,9 +5,12 @@
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
 #include <click/hashtable.hh>
+#include <click/smallvector.hh>
 #include <click/bighashmap.hh>
 #include <click/straccum.hh>
 #include <click/glue.hh>
+#include <click/integers.hh>
+#include <click/machine.hh>
 CLICK_DECLS
 
 /*
@@ -26,8 +29,200 @@ Tracks a list of bitrates other stations are capable of.
 =a BeaconScanner
  */
 
-typedef HashTable<uint16_t, uint32_t> CBytes;
-typedef CBytes::iterator CBytesIter;
+// Frame size histogram with a fixed set of buckets: 32 bytes wide up
+// to 2048 bytes, then one bucket per power of two up to 64K. Updating
+// it is a single increment and its footprint does not depend on the
+// traffic. Buckets are reported by their smallest frame size. The
+// total and the set of non-empty buckets are kept up to date as well,
+// so that reporting it costs one step per non-empty bucket.
+//
+// Frames of a station are counted by the threads receiving and sending
+// them, and read by the threads reporting them. Each thread counts in a
+// shard of its own, allocated the first time it counts a frame, so
+// counting needs no lock nor shared atomic; readers add up the shards.
+// Threads past MAX_SHARDS share the last shard, and may lose counts.
+class FrameSizeHistogram {
+public:
+
+	enum {
+		LINEAR_SHIFT = 5,
+		LINEAR_LIMIT = 2048,
+		LINEAR_BUCKETS = LINEAR_LIMIT >> LINEAR_SHIFT,
+		NBUCKETS = LINEAR_BUCKETS + 5,
+		NWORDS = (NBUCKETS + 31) / 32,
+		MAX_SHARDS = 16
+	};
+
+	FrameSizeHistogram() {
+		for (int i = 0; i < MAX_SHARDS; i++) {
+			_shards[i] = 0;
+		}
+	}
+
+	// the copy holds the counts of h in a single shard
+	FrameSizeHistogram(const FrameSizeHistogram &h) {
+		for (int i = 0; i < MAX_SHARDS; i++) {
+			_shards[i] = 0;
+		}
+		copy(h);
+	}
+
+	~FrameSizeHistogram() {
+		for (int i = 0; i < MAX_SHARDS; i++) {
+			delete _shards[i];
+		}
+	}
+
+	FrameSizeHistogram &operator=(const FrameSizeHistogram &h) {
+		if (this != &h) {
+			clear();
+			copy(h);
+		}
+		return *this;
+	}
+
+	void update(uint16_t len) {
+		Shard *s = shard();
+		int b = bucket(len);
+		if (!s->_counts[b]++) {
+			s->_used[b >> 5] |= 1U << (b & 31);
+		}
+		s->_total++;
+	}
+
+	uint32_t count(int i) const {
+		uint32_t n = 0;
+		for (int j = 0; j < MAX_SHARDS; j++) {
+			if (const Shard *s = _shards[j]) {
+				n += s->_counts[i];
+			}
+		}
+		return n;
+	}
+
+	uint32_t total() const {
+		uint32_t n = 0;
+		for (int j = 0; j < MAX_SHARDS; j++) {
+			if (const Shard *s = _shards[j]) {
+				n += s->_total;
+			}
+		}
+		return n;
+	}
+
+	// number of non-empty buckets
+	int size() const {
+		int n = 0;
+		for (int i = next(0); i < NBUCKETS; i = next(i + 1)) {
+			n++;
+		}
+		return n;
+	}
+
+	// bytes allocated for the shards
+	size_t bytes() const {
+		size_t n = 0;
+		for (int j = 0; j < MAX_SHARDS; j++) {
+			if (_shards[j]) {
+				n += sizeof(Shard);
+			}
+		}
+		return n;
+	}
+
+	// first non-empty bucket from i on, NBUCKETS if none
+	int next(int i) const {
+		while (i < NBUCKETS) {
+			uint32_t word = used(i >> 5) >> (i & 31);
+			if (word) {
+				return i + ffs_lsb(word) - 1;
+			}
+			i = (i | 31) + 1;
+		}
+		return NBUCKETS;
+	}
+
+	// frames counted meanwhile by other threads may survive
+	void clear() {
+		for (int j = 0; j < MAX_SHARDS; j++) {
+			if (Shard *s = _shards[j]) {
+				memset(s->_counts, 0, sizeof(s->_counts));
+				memset(s->_used, 0, sizeof(s->_used));
+				s->_total = 0;
+			}
+		}
+	}
+
+	static int bucket(uint16_t len) {
+		if (len < LINEAR_LIMIT) {
+			return len >> LINEAR_SHIFT;
+		}
+		// floor(log2(len)) is between 11 and 15
+		return LINEAR_BUCKETS + (32 - ffs_msb((unsigned) len)) - 11;
+	}
+
+	static uint16_t bucket_size(int i) {
+		if (i < LINEAR_BUCKETS) {
+			return i << LINEAR_SHIFT;
+		}
+		return LINEAR_LIMIT << (i - LINEAR_BUCKETS);
+	}
+
+private:
+
+	// written by one thread only; the padding keeps the counts of two
+	// shards off the same cache line
+	struct Shard {
+		uint32_t _counts[NBUCKETS];
+		uint32_t _used[NWORDS];
+		uint32_t _total;
+		char _pad[CLICK_CACHE_LINE_SIZE];
+	};
+
+	Shard * volatile _shards[MAX_SHARDS];
+
+	Shard *shard() {
+		unsigned id = click_current_cpu_id();
+		if (id >= MAX_SHARDS) {
+			id = MAX_SHARDS - 1;
+		}
+		Shard *s = _shards[id];
+		if (unlikely(!s)) {
+			s = new Shard;
+			memset(s, 0, sizeof(*s));
+			// publish the shard once zeroed
+			click_write_fence();
+			_shards[id] = s;
+		}
+		return s;
+	}
+
+	uint32_t used(int w) const {
+		uint32_t word = 0;
+		for (int j = 0; j < MAX_SHARDS; j++) {
+			if (const Shard *s = _shards[j]) {
+				word |= s->_used[w];
+			}
+		}
+		return word;
+	}
+
+	void copy(const FrameSizeHistogram &h) {
+		Shard *s = _shards[0];
+		if (!s) {
+			s = new Shard;
+			memset(s, 0, sizeof(*s));
+		}
+		for (int i = h.next(0); i < NBUCKETS; i = h.next(i + 1)) {
+			s->_counts[i] = h.count(i);
+			s->_used[i >> 5] |= 1U << (i & 31);
+		}
+		s->_total = h.total();
+		click_write_fence();
+		_shards[0] = s;
+	}
+
+};
 
 
 enum empower_tx_mcast_type {
@@ -36,28 +231,29 @@ enum empower_tx_mcast_type {
 	TX_MCAST_UR = 0x2,
 };
 
+// Rates of a policy, a dozen at most for the legacy ones
+typedef SmallVector<int, 12> TxPolicyRates;
+
 class TxPolicyInfo {
 public:
 
-	Vector<int> _mcs;
-	Vector<int> _ht_mcs;
+	TxPolicyRates _mcs;
+	TxPolicyRates _ht_mcs;
 	bool _no_ack;
 	empower_tx_mcast_type _tx_mcast;
 	int _ur_mcast_count;
 	int _rts_cts;
-	CBytes _tx;
-	CBytes _rx;
+	FrameSizeHistogram _tx;
+	FrameSizeHistogram _rx;
 
 	TxPolicyInfo() {
-		_mcs = Vector<int>();
-		_ht_mcs = Vector<int>();
 		_no_ack = false;
 		_tx_mcast = TX_MCAST_DMS;
 		_rts_cts = 2436;
 		_ur_mcast_count = 3;
 	}
 
-	TxPolicyInfo(Vector<int> mcs, Vector<int> ht_mcs, bool no_ack, empower_tx_mcast_type tx_mcast,
+	TxPolicyInfo(const TxPolicyRates &mcs, const TxPolicyRates &ht_mcs, bool no_ack, empower_tx_mcast_type tx_mcast,
 			int ur_mcast_count, int rts_cts) {
 
 		_mcs = mcs;
@@ -68,18 +264,19 @@ public:
 		_ur_mcast_count = ur_mcast_count;
 	}
 
+	// bytes allocated for this policy, histograms included
+	size_t bytes() const {
+		return sizeof(*this) + ((_mcs.is_inline() ? 0 : _mcs.capacity())
+				+ (_ht_mcs.is_inline() ? 0 : _ht_mcs.capacity())) * sizeof(int)
+				+ _tx.bytes() + _rx.bytes();
+	}
+
 	void update_tx(uint16_t len) {
-		if (_tx.find(len) == _tx.end()) {
-			_tx.set(len, 0);
-		}
-		(*_tx.get_pointer(len))++;
+		_tx.update(len);
 	}
 
 	void update_rx(uint16_t len) {
-		if (_rx.find(len) == _rx.end()) {
-			_rx.set(len, 0);
-		}
-		(*_rx.get_pointer(len))++;
+		_rx.update(len);
 	}
 
 	String unparse() {
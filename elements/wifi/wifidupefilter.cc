@@ -31,7 +31,11 @@ CLICK_DECLS
 
 WifiDupeFilter::WifiDupeFilter()
   : _debug(false),
-    _dupes(0)
+    _dupes(0),
+    _window(64),
+    _max_transmitters(1024),
+    _timeout(60),
+    _timer(this)
 {
 }
 
@@ -42,7 +46,45 @@ WifiDupeFilter::~WifiDupeFilter()
 int
 WifiDupeFilter::configure(Vector<String> &conf, ErrorHandler* errh)
 {
-    return Args(conf, this, errh).read("DEBUG", _debug).complete();
+    if (Args(conf, this, errh)
+	.read("WINDOW", _window)
+	.read("MAX_TRANSMITTERS", _max_transmitters)
+	.read("TIMEOUT", _timeout)
+	.read("DEBUG", _debug)
+	.complete() < 0)
+      return -1;
+
+    if (_window < 1 || _window > WifiSeqWindow::MAX_SIZE)
+      return errh->error("WINDOW must be between 1 and %d", (int) WifiSeqWindow::MAX_SIZE);
+    if (_max_transmitters < 1)
+      return errh->error("MAX_TRANSMITTERS must be positive");
+    if (!_timeout)
+      return errh->error("TIMEOUT must be positive");
+
+    return 0;
+}
+
+int
+WifiDupeFilter::initialize(ErrorHandler *)
+{
+    _timer.initialize(this);
+    _timer.schedule_after(_timeout);
+    return 0;
+}
+
+void
+WifiDupeFilter::run_timer(Timer *)
+{
+    Timestamp now = Timestamp::recent_steady();
+    Vector<EtherAddress> stale;
+    for (DstTable::iterator i = _table.begin(); i.live(); i++) {
+      if (now - i.value()._last_heard > _timeout)
+	stale.push_back(i.key());
+    }
+    for (int i = 0; i < stale.size(); i++) {
+      _table.remove(stale[i]);
+    }
+    _timer.reschedule_after(_timeout);
 }
 
 Packet *
@@ -68,13 +110,18 @@ WifiDupeFilter::simple_action(Packet *p_in)
     return p_in;
   }
   if (!nfo) {
-    _table.insert(src, DstInfo(src));
+    if (_table.size() >= _max_transmitters) {
+      return p_in;
+    }
+    _table.insert(src, DstInfo(src, _window));
     nfo = _table.findp(src);
     nfo->clear();
   }
 
-  if (w->i_fc[1] & WIFI_FC1_RETRY && seq == nfo->seq &&
-      (!is_frag || frag <= nfo->frag)) {
+  nfo->_packets++;
+  nfo->_last_heard = Timestamp::recent_steady();
+
+  if (nfo->_window.add(seq, frag, is_frag) && (w->i_fc[1] & WIFI_FC1_RETRY)) {
 	  /* duplicate detected */
 	  if (_debug) {
 		  click_chatter("%p{element}: dup seq %d frag %d src %s\n",
@@ -89,8 +136,6 @@ WifiDupeFilter::simple_action(Packet *p_in)
 	  return 0;
   }
 
-  nfo->seq = seq;
-  nfo->frag = frag;
   return p_in;
 }
 
@@ -102,12 +147,11 @@ WifiDupeFilter::static_read_stats(Element *xf, void *)
   StringAccum sa;
 
   for(DstTable::const_iterator i = e->_table.begin(); i.live(); i++) {
-    DstInfo nfo = i.value();
+    const DstInfo &nfo = i.value();
     sa << nfo._eth;
     sa << " packets " << nfo._packets;
     sa << " dupes " << nfo._dupes;
-    sa << " seq " << nfo.seq;
-    sa << " frag " << nfo.frag;
+    sa << " seq " << nfo._window.head();
     sa << "\n";
 
   }
@@ -2,7 +2,9 @@
 #define CLICK_WIFIDUPEFILTER_HH
 #include <click/element.hh>
 #include <click/string.hh>
-#include <click/hashmap.hh>
+#include <click/flathashtable.hh>
+#include <click/timer.hh>
+#include "wifiseqwindow.hh"
 CLICK_DECLS
 
 /*
@@ -16,6 +18,36 @@ Filters out duplicate 802.11 packets based on their sequence number.
 
 =d
 
+A retry is dropped if its sequence number, and fragment number for
+fragmented frames, was heard from the same transmitter among the last
+WINDOW sequence numbers. Control frames and frames sent to a group
+address are never dropped.
+
+Keyword arguments are:
+
+=over 8
+
+=item WINDOW
+
+Number of sequence numbers remembered for each transmitter, at most 2048.
+Default is 64, the largest block ack window.
+
+=item MAX_TRANSMITTERS
+
+Maximum number of transmitters tracked. Frames from other transmitters
+are let through. Default is 1024.
+
+=item TIMEOUT
+
+Transmitters not heard for this long are forgotten. Default is 60
+seconds.
+
+=item DEBUG
+
+Turn debug on/off.
+
+=back 8
+
 =a WifiEncap, WifiDecap
  */
 
@@ -31,6 +63,8 @@ class WifiDupeFilter : public Element {
   const char *processing() const		{ return AGNOSTIC; }
 
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  int initialize(ErrorHandler *) CLICK_COLD;
+  void run_timer(Timer *);
 
   Packet *simple_action(Packet *);
 
@@ -46,29 +80,32 @@ class WifiDupeFilter : public Element {
     int _dupes;
     int _packets;
 
-    uint16_t seq;
-    uint16_t frag;
+    WifiSeqWindow _window;
+    Timestamp _last_heard;
 
-    DstInfo(EtherAddress eth) {
+    DstInfo(EtherAddress eth, uint16_t window) : _window(window) {
       _eth = eth;
     }
     DstInfo () { }
     void clear() {
       _dupes = 0;
       _packets = 0;
-      seq = 0;
-      frag = 0;
-
+      _window.clear();
     }
   };
 
-  typedef HashMap <EtherAddress, DstInfo> DstTable;
+  typedef FlatHashTable<EtherAddress, DstInfo> DstTable;
   typedef DstTable::const_iterator DstIter;
 
   DstTable _table;
   bool _debug;
 
   int _dupes;
+
+  uint16_t _window;
+  uint32_t _max_transmitters;
+  Timestamp _timeout;
+  Timer _timer;
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,94 @@
+/*
+ * wififcclassifier.{cc,hh} -- classifies 802.11 frames on their type
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "wififcclassifier.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+WifiFCClassifier::WifiFCClassifier()
+{
+  memset(_table, -1, sizeof(_table));
+}
+
+WifiFCClassifier::~WifiFCClassifier()
+{
+}
+
+int
+WifiFCClassifier::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (conf.size() != noutputs())
+    return errh->error("need %d arguments, one per output port", noutputs());
+  if (conf.size() > 127)
+    return errh->error("too many patterns");
+
+  memset(_table, -1, sizeof(_table));
+
+  for (int i = conf.size() - 1; i >= 0; i--) {
+    String pattern = cp_uncomment(conf[i]);
+    uint32_t value = 0, mask = 0;
+
+    if (pattern != "-") {
+      if (pattern.starts_with("0/"))
+	pattern = pattern.substring(2);
+      else if (pattern.find_left('/') >= 0)
+	return errh->error("pattern %d: only offset 0 is supported", i);
+      int percent = pattern.find_left('%');
+      String v = (percent < 0 ? pattern : pattern.substring(0, percent));
+      String m = (percent < 0 ? String("ff") : pattern.substring(percent + 1));
+      if (v.length() != 2 || m.length() != 2
+	  || !IntArg(16).parse(v, value) || !IntArg(16).parse(m, mask))
+	return errh->error("pattern %d: expected one byte value and mask, like 08%%0c", i);
+    }
+
+    // later patterns first, so the first match wins
+    for (int fc = 0; fc < 256; fc++)
+      if ((fc & mask) == (value & mask))
+	_table[fc] = i;
+  }
+
+  return 0;
+}
+
+void
+WifiFCClassifier::push(int, Packet *p)
+{
+  int port = p->length() ? _table[p->data()[0]] : -1;
+  if (port < 0)
+    p->kill();
+  else
+    output(port).push(p);
+}
+
+void
+WifiFCClassifier::push_batch(int, Packet *head)
+{
+  // runs of frames bound for the same output are pushed together
+  PacketBatch run;
+  int port = -1;
+  while (Packet *p = PacketBatch::pop(head)) {
+    int o = p->length() ? _table[p->data()[0]] : -1;
+    if (o != port && !run.empty())
+      checked_output_push_batch(port, run.take());
+    port = o;
+    run.append(p);
+  }
+  if (!run.empty())
+    checked_output_push_batch(port, run.take());
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(WifiFCClassifier)
@@ -0,0 +1,60 @@
+#ifndef CLICK_WIFIFCCLASSIFIER_HH
+#define CLICK_WIFIFCCLASSIFIER_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+WifiFCClassifier(PATTERN_1, ..., PATTERN_N)
+
+=s Wifi
+
+Classifies 802.11 frames on their first frame control byte
+
+=d
+
+Sends each frame to the output of the first pattern its first frame
+control byte, which holds the type and subtype, matches. Frames matching
+no pattern, or too short to have one, are dropped.
+
+Patterns are written as in Classifier, restricted to offset 0: a hex
+value with an optional hex mask, like C<0/08%0c> for data frames or
+C<0/b0%f0> for authentication frames, or C<-> to match every frame. The
+C<0/> prefix may be left out.
+
+The patterns are compiled into one 256 entry table, so classifying a
+frame costs one lookup whatever the number of patterns.
+
+=e
+
+  mgt_cl :: WifiFCClassifier(0/40%f0,  // probe req
+                             0/b0%f0,  // auth req
+                             0/00%f0); // assoc req
+
+=a Classifier, WifiDecap
+*/
+
+class WifiFCClassifier : public Element { public:
+
+  WifiFCClassifier() CLICK_COLD;
+  ~WifiFCClassifier() CLICK_COLD;
+
+  const char *class_name() const	{ return "WifiFCClassifier"; }
+  const char *port_count() const	{ return "1/-"; }
+  const char *processing() const	{ return PUSH; }
+
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
+  void push(int, Packet *);
+  void push_batch(int, Packet *);
+
+ private:
+
+  // output for each value of the frame control byte, -1 to drop
+  int8_t _table[256];
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -21,6 +21,7 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
+#include <click/straccum.hh>
 #include <clicknet/wifi.h>
 #include <clicknet/llc.h>
 #include <click/packet_anno.hh>
@@ -41,6 +42,9 @@ WifiSeq::configure(Vector<String> &conf, ErrorHandler *errh)
 {
 
   _debug = false;
+  _per_tid = false;
+  _per_station = false;
+  _max_stations = 256;
   _seq = 0;
   _offset = 22;
   _bytes = 2;
@@ -51,12 +55,20 @@ WifiSeq::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("OFFSET", _offset)
       .read("BYTES", _bytes)
       .read("SHIFT", _shift)
+      .read("PER_TID", _per_tid)
+      .read("PER_STATION", _per_station)
+      .read("STATIONS", _max_stations)
       .complete() < 0)
     return -1;
 
   if (_bytes != 2 && _bytes != 4) {
     return errh->error("BYTES must be either 2 or 4");
   }
+  if (_max_stations < 1) {
+    return errh->error("STATIONS must be positive");
+  }
+  if (_per_station)
+    _per_tid = true;
   reset();
 
   return 0;
@@ -67,6 +79,48 @@ void
 WifiSeq::reset()
 {
   _seq = 0;
+  for (int i = 0; i < NB_TIDS; i++)
+    _tid_seqs[i] = 0;
+  _sta_index.clear();
+  _sta_seqs.clear();
+  _sta_addrs.clear();
+  _sta_used.clear();
+  _frames = 0;
+}
+
+u_int32_t *
+WifiSeq::tid_seq(const EtherAddress &ra, int tid)
+{
+  if (!_per_station)
+    return &_tid_seqs[tid];
+
+  _frames++;
+  HashTable<EtherAddress, int>::iterator it = _sta_index.find(ra);
+  if (it != _sta_index.end()) {
+    _sta_used[it.value()] = _frames;
+    return &_sta_seqs[it.value() * NB_TIDS + tid];
+  }
+
+  int index = _sta_addrs.size();
+  if (index < _max_stations) {
+    _sta_seqs.resize((index + 1) * NB_TIDS, 0);
+    _sta_addrs.push_back(ra);
+    _sta_used.push_back(_frames);
+  } else {
+    // the table is full, the least recently used row goes to ra; only
+    // new receivers pay for the scan
+    index = 0;
+    for (int i = 1; i < _sta_used.size(); i++)
+      if (_sta_used[i] < _sta_used[index])
+	index = i;
+    _sta_index.erase(_sta_addrs[index]);
+    for (int i = 0; i < NB_TIDS; i++)
+      _sta_seqs[index * NB_TIDS + i] = 0;
+    _sta_addrs[index] = ra;
+    _sta_used[index] = _frames;
+  }
+  _sta_index.set(ra, index);
+  return &_sta_seqs[index * NB_TIDS + tid];
 }
 
 Packet *
@@ -77,18 +131,29 @@ WifiSeq::simple_action(Packet *p_in) {
     struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p_in);
     ceh->flags |= WIFI_EXTRA_NO_SEQ;
     char *data = (char *)(p->data() + _offset);
+    u_int32_t *seq = &_seq;
+    if (_per_tid && p->length() >= sizeof(struct click_wifi)) {
+      struct click_wifi *w = (struct click_wifi *) p->data();
+      unsigned qos_offset = sizeof(struct click_wifi);
+      if ((w->i_fc[1] & WIFI_FC1_DIR_MASK) == WIFI_FC1_DIR_DSTODS)
+	qos_offset += WIFI_ADDR_LEN;
+      if (WIFI_QOS_HAS_SEQ(w) && p->length() >= qos_offset + sizeof(struct click_qos_control)) {
+	struct click_qos_control *qos = (struct click_qos_control *) (p->data() + qos_offset);
+	seq = tid_seq(EtherAddress(w->i_addr1), le16_to_cpu(qos->qos_control) & (NB_TIDS - 1));
+      }
+    }
     if (_bytes == 2) {
-      *(u_int16_t *)data = (cpu_to_le16(_seq << _shift));
+      *(u_int16_t *)data = (cpu_to_le16(*seq << _shift));
     } else {
-      *(u_int32_t *)data = (cpu_to_le32(_seq << _shift));
+      *(u_int32_t *)data = (cpu_to_le32(*seq << _shift));
     }
-    _seq++;
+    (*seq)++;
   }
   return p;
 
 }
 
-enum {H_DEBUG, H_SEQ, H_OFFSET, H_BYTES, H_SHIFT, H_RESET};
+enum {H_DEBUG, H_SEQ, H_OFFSET, H_BYTES, H_SHIFT, H_TID_SEQS, H_STATION_SEQS, H_RESET};
 
 String
 WifiSeq::read_param(Element *e, void *thunk)
@@ -105,6 +170,22 @@ WifiSeq::read_param(Element *e, void *thunk)
     return String(td->_bytes) + "\n";
   case H_SHIFT:
     return String(td->_shift) + "\n";
+  case H_TID_SEQS: {
+    StringAccum sa;
+    for (int i = 0; i < NB_TIDS; i++)
+      sa << i << " " << td->_tid_seqs[i] << "\n";
+    return sa.take_string();
+  }
+  case H_STATION_SEQS: {
+    StringAccum sa;
+    for (HashTable<EtherAddress, int>::iterator it = td->_sta_index.begin(); it; ++it) {
+      sa << it.key();
+      for (int i = 0; i < NB_TIDS; i++)
+	sa << " " << td->_sta_seqs[it.value() * NB_TIDS + i];
+      sa << "\n";
+    }
+    return sa.take_string();
+  }
   default:
     return String();
   }
@@ -145,6 +226,8 @@ WifiSeq::add_handlers()
   add_read_handler("offset", read_param, H_OFFSET);
   add_read_handler("bytes", read_param, H_BYTES);
   add_read_handler("shift", read_param, H_SHIFT);
+  add_read_handler("tid_seqs", read_param, H_TID_SEQS);
+  add_read_handler("station_seqs", read_param, H_STATION_SEQS);
 
   add_write_handler("debug", write_param, H_DEBUG);
   add_write_handler("seq", write_param, H_SEQ);
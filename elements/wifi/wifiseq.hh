@@ -3,6 +3,8 @@
 #include <click/element.hh>
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
 CLICK_DECLS
 
 /*
@@ -30,12 +32,40 @@ How many bytes the sequence number should use. Values can be
 How many bits to shift the sequence number before setting the value in the packet.
 Default is 4.
 
+=item PER_TID
+Boolean. If true, QoS data frames are numbered in a separate sequence
+space for each of their TIDs, as 802.11 requires for frames that may be
+aggregated or block acked; other frames share the sequence space of the
+element. The TID is read from the QoS control field of the 802.11 header
+at the front of the packet. Default is false.
+
+=item PER_STATION
+Boolean. If true, QoS data frames are numbered in a separate sequence
+space for each pair of receiver address and TID, so that the frames of
+one station carry consecutive sequence numbers whatever is sent to the
+others in between, as the block ack reorder window of the station
+expects. Implies PER_TID. Default is false.
+
+=item STATIONS
+Number of receivers PER_STATION keeps sequence spaces for. Each
+receiver gets a dense index on its first QoS data frame, and its
+counters a row of a table indexed by it. Once the table is full, a new
+receiver takes over the row of the receiver that went longest without
+a frame, with its counters starting over from 0. Default is 256.
+
 =back 8
 
 
 =h seq read/write
 Sets or reads the next sequence number
 
+=h tid_seqs read-only
+Next sequence number of each TID, if PER_TID is true
+
+=h station_seqs read-only
+One line per receiver if PER_STATION is true: its address and the next
+sequence number of each TID
+
 =a WifiEncap */
 
 class WifiSeq : public Element { public:
@@ -51,6 +81,8 @@ class WifiSeq : public Element { public:
   bool can_live_reconfigure() const	{ return true; }
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, Packet *head)	{ simple_action_push_batch(port, head); }
+  Packet *pull_batch(int port, unsigned max) { return simple_action_pull_batch(port, max); }
 
   void add_handlers() CLICK_COLD;
   static String read_param(Element *, void *) CLICK_COLD;
@@ -61,8 +93,24 @@ class WifiSeq : public Element { public:
 
   void reset();
   bool _debug;
+  bool _per_tid;
+  bool _per_station;
+  int _max_stations;
+
+  enum { NB_TIDS = 16 };
 
   u_int32_t _seq;
+  u_int32_t _tid_seqs[NB_TIDS];
+
+  // dense index of each receiver, and NB_TIDS counters per index
+  HashTable<EtherAddress, int> _sta_index;
+  Vector<u_int32_t> _sta_seqs;
+  // receiver of each index, and the frame count when it last sent one
+  Vector<EtherAddress> _sta_addrs;
+  Vector<uint64_t> _sta_used;
+  uint64_t _frames;
+
+  u_int32_t *tid_seq(const EtherAddress &ra, int tid);
   u_int32_t _offset;
   u_int32_t _shift;
   u_int32_t _bytes;
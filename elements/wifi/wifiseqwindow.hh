@@ -0,0 +1,149 @@
+#ifndef CLICK_WIFISEQWINDOW_HH
+#define CLICK_WIFISEQWINDOW_HH
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include <clicknet/wifi.h>
+CLICK_DECLS
+
+// The 802.11 sequence numbers heard from a transmitter, one bit each.
+//
+// Only the last size() numbers up to the newest one, head(), are kept:
+// moving head() forward clears the bits that fall out of the window, a
+// whole word at a time. Telling whether a number was heard, and adding
+// it, take constant time whatever the number of retries. A number more
+// than size() behind head() means the transmitter started over, e.g.
+// after a reassociation, and restarts the window from it, unless
+// set_restart(false) has it taken for an old copy instead. The window must
+// be shorter than half the sequence space for ahead and behind to make
+// sense.
+class WifiSeqWindow {
+public:
+
+	enum { SEQ_SPACE = 4096, MAX_SIZE = SEQ_SPACE / 2 };
+
+	WifiSeqWindow(uint16_t size = 128) : _size(size), _restart(true) {
+		assert(size >= 1 && size <= MAX_SIZE);
+		clear();
+	}
+
+	void clear() {
+		memset(_bits, 0, sizeof(_bits));
+		_head = 0;
+		_frag = 0;
+		_empty = true;
+	}
+
+	uint16_t size() const { return _size; }
+	uint16_t head() const { return _head; }
+	bool empty() const { return _empty; }
+
+	// Whether a number behind the window restarts it, or is a duplicate
+	void set_restart(bool restart) { _restart = restart; }
+
+	bool contains(uint16_t seq) const {
+		return !_empty && age(seq) < _size && test(seq);
+	}
+
+	// Adds seq, fragment frag, and tells whether it was there already.
+	// With is_frag, a fragment of the newest number is new if it comes
+	// after the last one heard.
+	bool add(uint16_t seq, uint8_t frag = 0, bool is_frag = false) {
+		seq &= SEQ_SPACE - 1;
+		if (_empty) {
+			_empty = false;
+			_head = seq;
+			_frag = frag;
+			set(seq);
+			return false;
+		}
+		uint16_t ahead = (seq - _head) & (SEQ_SPACE - 1);
+		if (ahead == 0) {
+			if (is_frag && frag > _frag) {
+				_frag = frag;
+				return false;
+			}
+			return true;
+		}
+		if (ahead < MAX_SIZE) {
+			advance(ahead);
+			_head = seq;
+			_frag = frag;
+			set(seq);
+			return false;
+		}
+		if (age(seq) < _size) {
+			if (test(seq)) {
+				return true;
+			}
+			set(seq);
+			return false;
+		}
+		if (!_restart) {
+			return true;
+		}
+		clear();
+		return add(seq, frag, is_frag);
+	}
+
+	// The numbers in the window, oldest first
+	String unparse() const {
+		StringAccum sa;
+		if (_empty) {
+			return sa.take_string();
+		}
+		for (int i = _size - 1; i >= 0; i--) {
+			uint16_t seq = (_head - i) & (SEQ_SPACE - 1);
+			if (test(seq)) {
+				sa << ' ' << seq;
+			}
+		}
+		return sa.take_string();
+	}
+
+private:
+
+	uint32_t _bits[SEQ_SPACE / 32];
+	uint16_t _size;
+	uint16_t _head;
+	uint8_t _frag;
+	bool _empty;
+	bool _restart;
+
+	uint16_t age(uint16_t seq) const {
+		return (_head - seq) & (SEQ_SPACE - 1);
+	}
+
+	bool test(uint16_t seq) const {
+		return _bits[seq >> 5] & (1U << (seq & 31));
+	}
+
+	void set(uint16_t seq) {
+		_bits[seq >> 5] |= 1U << (seq & 31);
+	}
+
+	// Clears the n numbers after the window, which the new head brings in
+	// and which may still hold bits from the previous lap
+	void advance(uint16_t n) {
+		if (n >= SEQ_SPACE - _size) {
+			memset(_bits, 0, sizeof(_bits));
+			return;
+		}
+		uint16_t seq = (_head + 1) & (SEQ_SPACE - 1);
+		while (n) {
+			if (!(seq & 31) && n >= 32) {
+				_bits[seq >> 5] = 0;
+				seq = (seq + 32) & (SEQ_SPACE - 1);
+				n -= 32;
+			} else {
+				_bits[seq >> 5] &= ~(1U << (seq & 31));
+				seq = (seq + 1) & (SEQ_SPACE - 1);
+				n--;
+			}
+		}
+	}
+
+};
+
+CLICK_ENDDECLS
+#endif
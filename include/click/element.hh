@@ -5,6 +5,7 @@
 #include <click/vector.hh>
 #include <click/string.hh>
 #include <click/packet.hh>
+#include <click/packetbatch.hh>
 #include <click/handler.hh>
 CLICK_DECLS
 class Router;
@@ -36,6 +37,10 @@ class Element { public:
     virtual void push(int port, Packet *p);
     virtual Packet *pull(int port) CLICK_WARN_UNUSED_RESULT;
     virtual Packet *simple_action(Packet *p);
+    virtual void push_batch(int port, Packet *head);
+    virtual Packet *pull_batch(int port, unsigned max) CLICK_WARN_UNUSED_RESULT;
+    void simple_action_push_batch(int port, Packet *head);
+    Packet *simple_action_pull_batch(int port, unsigned max) CLICK_WARN_UNUSED_RESULT;
 
     virtual bool run_task(Task *task);  // return true iff did useful work
     virtual void run_timer(Timer *timer);
@@ -46,6 +51,7 @@ class Element { public:
 #endif
 
     inline void checked_output_push(int port, Packet *p) const;
+    inline void checked_output_push_batch(int port, Packet *head) const;
     inline Packet* checked_input_pull(int port) const;
 
     // ELEMENT CHARACTERISTICS
@@ -211,6 +217,10 @@ class Element { public:
     virtual int llrpc(unsigned command, void* arg);
     int local_llrpc(unsigned command, void* arg);
 
+#if HAVE_CYCLE_ACCOUNTING
+    bool cycle_totals(uint64_t &packets, click_cycles_t &cycles) const;
+#endif
+
     class Port { public:
 
         inline bool active() const;
@@ -219,6 +229,8 @@ class Element { public:
 
         inline void push(Packet* p) const;
         inline Packet* pull() const;
+        inline void push_batch(Packet* head) const;
+        inline Packet* pull_batch(unsigned max) const;
 
 #if CLICK_STATS >= 1
         unsigned npackets() const       { return _packets; }
@@ -240,12 +252,16 @@ class Element { public:
 #if CLICK_STATS >= 1
         mutable unsigned _packets;      // How many packets have we moved?
 #endif
-#if CLICK_STATS >= 2
+#if CLICK_STATS >= 2 || HAVE_CYCLE_ACCOUNTING
         Element* _owner;                // Whose input or output are we?
 #endif
 
         inline Port();
         inline void assign(bool isoutput, Element *owner, Element *e, int port);
+#if HAVE_CYCLE_ACCOUNTING
+        void push_accounted(Packet *p) const;
+        Packet *pull_accounted() const;
+#endif
 
         friend class Element;
 
@@ -289,6 +305,35 @@ class Element { public:
     static int write_cycles_handler(const String &, Element *, void *, ErrorHandler *);
 #endif
 
+#if HAVE_CYCLE_ACCOUNTING
+    // RUNTIME CYCLE ACCOUNTING
+    struct CycleStats {
+        enum { C_PUSH, C_PULL, C_TASK, C_NKINDS };
+        enum { NBUCKETS = 32 };
+        uint64_t calls[C_NKINDS];
+        uint64_t packets[C_NKINDS];
+        click_cycles_t cycles[C_NKINDS];        // Cycles spent in self.
+        click_cycles_t child_cycles;            // Cycles spent in children.
+        uint32_t latency[NBUCKETS];     // Calls by log2 of own cycles.
+
+        CycleStats() {
+            clear();
+        }
+        void clear() {
+            memset(this, 0, sizeof(*this));
+        }
+        void account(int kind, click_cycles_t all_delta,
+                     click_cycles_t start_child_cycles, unsigned npackets);
+    };
+
+    CycleStats *_cycle_stats;
+    static bool cycle_accounting;       // Are calls being accounted?
+
+    static void set_cycle_accounting(Router *router, bool on);
+    static String read_cycles_handler(Element *, void *);
+    static int write_cycles_handler(const String &, Element *, void *, ErrorHandler *);
+#endif
+
     Element(const Element &);
     Element &operator=(const Element &);
 
@@ -307,8 +352,10 @@ class Element { public:
     inline void add_data_handlers(const char *name, int flags, HandlerCallback callback, void *data);
 
     friend class Router;
-#if CLICK_STATS >= 2
+#if CLICK_STATS >= 2 || HAVE_CYCLE_ACCOUNTING
     friend class Task;
+#endif
+#if CLICK_STATS >= 2
     friend class Master;
     friend class TimerSet;
 # if CLICK_USERLEVEL
@@ -517,8 +564,12 @@ Element::input_is_push(int port) const
 
 #if CLICK_STATS >= 2
 # define PORT_ASSIGN(o) _packets = 0; _owner = (o)
+#elif CLICK_STATS >= 1 && HAVE_CYCLE_ACCOUNTING
+# define PORT_ASSIGN(o) _packets = 0; _owner = (o)
 #elif CLICK_STATS >= 1
 # define PORT_ASSIGN(o) _packets = 0; (void) (o)
+#elif HAVE_CYCLE_ACCOUNTING
+# define PORT_ASSIGN(o) _owner = (o)
 #else
 # define PORT_ASSIGN(o) (void) (o)
 #endif
@@ -627,6 +678,12 @@ Element::Port::push(Packet* p) const
     _e->_xfer_own_cycles += own_delta;
     _owner->_child_cycles += all_delta;
 #else
+# if HAVE_CYCLE_ACCOUNTING
+    if (cycle_accounting) {
+        push_accounted(p);
+        return;
+    }
+# endif
 # if HAVE_BOUND_PORT_TRANSFER
     _bound.push(_e, _port, p);
 # else
@@ -671,10 +728,16 @@ Element::Port::pull() const
     _e->_xfer_own_cycles += own_delta;
     _owner->_child_cycles += all_delta;
 #else
+    Packet *p;
+# if HAVE_CYCLE_ACCOUNTING
+    if (cycle_accounting)
+        p = pull_accounted();
+    else
+# endif
 # if HAVE_BOUND_PORT_TRANSFER
-    Packet *p = _bound.pull(_e, _port);
+        p = _bound.pull(_e, _port);
 # else
-    Packet *p = _e->pull(_port);
+        p = _e->pull(_port);
 # endif
 #endif
 #if CLICK_STATS >= 1
@@ -684,6 +747,76 @@ Element::Port::pull() const
     return p;
 }
 
+/** @brief Push a list of packets to the next element.
+ *
+ * @param head first packet of a non-empty list linked through
+ * Packet::next()
+ *
+ * Relinquishes control of every packet of the list and hands the list to the
+ * next element's @link Element::push_batch() push_batch() @endlink function,
+ * in a single call.  Elements without a batch implementation receive the
+ * packets one at a time through push().
+ *
+ * When cycle statistics are kept (CLICK_STATS >= 2 or cycle accounting
+ * turned on), the packets are pushed one at a time, so that the statistics
+ * stay per packet.
+ */
+inline void
+Element::Port::push_batch(Packet* head) const
+{
+    assert(_e && head);
+#if CLICK_STATS >= 2 || HAVE_CYCLE_ACCOUNTING
+# if CLICK_STATS < 2
+    if (cycle_accounting)
+# endif
+    {
+        while (Packet *p = PacketBatch::pop(head))
+            push(p);
+        return;
+    }
+#endif
+#if CLICK_STATS >= 1
+    for (Packet *p = head; p; p = p->next())
+        ++_packets;
+#endif
+    _e->push_batch(_port, head);
+}
+
+/** @brief Pull up to @a max packets over this port and return them.
+ *
+ * Calls the previous element's @link Element::pull_batch() pull_batch()
+ * @endlink function and returns its list of at most @a max packets linked
+ * through Packet::next(), or null if no packet is available.  As with
+ * push_batch(), the packets are pulled one at a time when cycle statistics
+ * are kept.
+ */
+inline Packet*
+Element::Port::pull_batch(unsigned max) const
+{
+    assert(_e);
+#if CLICK_STATS >= 2 || HAVE_CYCLE_ACCOUNTING
+# if CLICK_STATS < 2
+    if (cycle_accounting)
+# endif
+    {
+        PacketBatch batch;
+        while (batch.count() < max) {
+            Packet *p = pull();
+            if (!p)
+                break;
+            batch.append(p);
+        }
+        return batch.take();
+    }
+#endif
+    Packet *head = _e->pull_batch(_port, max);
+#if CLICK_STATS >= 1
+    for (Packet *p = head; p; p = p->next())
+        ++_packets;
+#endif
+    return head;
+}
+
 /** @brief Push packet @a p to output @a port, or kill it if @a port is out of
  * range.
  *
@@ -705,6 +838,25 @@ Element::checked_output_push(int port, Packet* p) const
         p->kill();
 }
 
+/** @brief Push the list of packets @a head to output @a port, or kill them
+ * if @a port is out of range.
+ *
+ * @param port output port number
+ * @param head first packet of a non-empty list linked through
+ * Packet::next()
+ *
+ * The batch counterpart of checked_output_push().
+ */
+inline void
+Element::checked_output_push_batch(int port, Packet* head) const
+{
+    if ((unsigned) port < (unsigned) noutputs())
+        _ports[1][port].push_batch(head);
+    else
+        while (Packet *p = PacketBatch::pop(head))
+            p->kill();
+}
+
 /** @brief Pull a packet from input @a port, or return 0 if @a port is out of
  * range.
  *
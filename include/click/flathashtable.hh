@@ -0,0 +1,559 @@
+#ifndef CLICK_FLATHASHTABLE_HH
+#define CLICK_FLATHASHTABLE_HH
+/*
+ * flathashtable.hh -- FlatHashTable template
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software")
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <click/glue.hh>
+#include <click/hashcode.hh>
+#include <click/integers.hh>
+#if CLICK_USERLEVEL && defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+CLICK_DECLS
+
+/** @file <click/flathashtable.hh>
+ * @brief Open addressing hash table template.
+ */
+
+template <typename K, typename V> class FlatHashTable_iterator;
+template <typename K, typename V> class FlatHashTable_const_iterator;
+
+/** @class FlatHashTable
+  @brief Open addressing hash table template.
+
+  FlatHashTable<K, V> maps keys K to values V like HashTable<K, V>, and
+  offers the same interface for lookups, insertions, erasure and
+  iteration, plus HashMap's findp() and insert(). It suits small keys, such
+  as EtherAddress, looked up on the data path.
+
+  Elements live in one flat array rather than in separately allocated
+  nodes. A parallel array holds one control byte per slot: empty, erased,
+  or seven bits of the key's hash. Slots are probed in aligned groups of
+  16; the control bytes of a group are compared at once (with SSE2 at
+  user level), and keys are only compared for the slots whose hash bits
+  match. A lookup thus usually touches one line of control bytes and one
+  element.
+
+  K must have a hashcode() and operator==, and both K and V must be
+  default constructible and assignable.
+
+  @warning Unlike HashTable, inserting an element may move every other
+  element: it invalidates all iterators and all pointers to values.
+  Erasing does not move elements. */
+template <typename K, typename V>
+class FlatHashTable {
+
+    enum { GROUP = 16, CTRL_EMPTY = 0x80, CTRL_ERASED = 0xFE };
+
+    struct slot {
+	K key;
+	V value;
+    };
+
+  public:
+
+    typedef K key_type;
+    typedef const K &key_const_reference;
+    typedef V mapped_type;
+    typedef uint32_t size_type;
+
+    typedef FlatHashTable_const_iterator<K, V> const_iterator;
+    typedef FlatHashTable_iterator<K, V> iterator;
+
+    /** @brief Construct an empty hash table with normal default value. */
+    FlatHashTable()
+	: _ctrl(0), _slots(0), _capacity(0), _size(0), _erased(0),
+	  _default_value() {
+    }
+
+    /** @brief Construct an empty hash table with default value @a d. */
+    explicit FlatHashTable(const mapped_type &d)
+	: _ctrl(0), _slots(0), _capacity(0), _size(0), _erased(0),
+	  _default_value(d) {
+    }
+
+    /** @brief Construct a hash table as a copy of @a x. */
+    FlatHashTable(const FlatHashTable<K, V> &x)
+	: _ctrl(0), _slots(0), _capacity(0), _size(0), _erased(0),
+	  _default_value(x._default_value) {
+	copy_elements(x);
+    }
+
+    /** @brief Destroy this hash table, freeing its memory. */
+    ~FlatHashTable() {
+	delete[] _ctrl;
+	delete[] _slots;
+    }
+
+    /** @brief Return the number of elements in the hash table. */
+    size_type size() const {
+	return _size;
+    }
+
+    /** @brief Return true iff size() == 0. */
+    bool empty() const {
+	return _size == 0;
+    }
+
+    /** @brief Return the number of slots in the hash table. */
+    size_type capacity() const {
+	return _capacity;
+    }
+
+    /** @brief Return the number of bytes allocated for the slots. */
+    size_t memory() const {
+	return (size_t) _capacity * (sizeof(slot) + 1);
+    }
+
+    /** @brief Return the hash table's default value. */
+    const mapped_type &default_value() const {
+	return _default_value;
+    }
+
+    /** @brief Return an iterator for the first element in the table.
+     *
+     * @note FlatHashTable iterators return elements in undefined order. */
+    inline iterator begin();
+    /** @overload */
+    inline const_iterator begin() const;
+
+    /** @brief Return an iterator for the end of the table.
+     * @invariant end().live() == false */
+    inline iterator end();
+    /** @overload */
+    inline const_iterator end() const;
+
+    /** @brief Return 1 if an element with key @a key exists, 0 otherwise. */
+    size_type count(key_const_reference key) const {
+	return find_slot(key) < _capacity;
+    }
+
+    /** @brief Return an iterator for the element with key @a key, if any.
+     *
+     * Returns end() if no such element exists. */
+    inline iterator find(key_const_reference key);
+    /** @overload */
+    inline const_iterator find(key_const_reference key) const;
+
+    /** @brief Return the value for @a key, or default_value() if there is
+     * none. */
+    const mapped_type &get(key_const_reference key) const {
+	size_type i = find_slot(key);
+	return i < _capacity ? _slots[i].value : _default_value;
+    }
+
+    /** @brief Return a pointer to the value for @a key, or null if there
+     * is none. */
+    mapped_type *get_pointer(key_const_reference key) {
+	size_type i = find_slot(key);
+	return i < _capacity ? &_slots[i].value : 0;
+    }
+    /** @overload */
+    const mapped_type *get_pointer(key_const_reference key) const {
+	size_type i = find_slot(key);
+	return i < _capacity ? &_slots[i].value : 0;
+    }
+
+    /** @brief Return a pointer to the value for @a key, or null if there
+     * is none. Same as get_pointer(), as in HashMap. */
+    mapped_type *findp(key_const_reference key) {
+	return get_pointer(key);
+    }
+    /** @overload */
+    const mapped_type *findp(key_const_reference key) const {
+	return get_pointer(key);
+    }
+
+    /** @brief Return the value for @a key, or default_value() if there is
+     * none. */
+    const mapped_type &operator[](key_const_reference key) const {
+	return get(key);
+    }
+
+    /** @brief Return a reference to the value for @a key.
+     *
+     * If no element for @a key exists, adds one with default_value().
+     * @warning This may move all other elements. */
+    mapped_type &operator[](key_const_reference key) {
+	size_type i = find_insert_slot(key);
+	return _slots[i].value;
+    }
+
+    /** @brief Return an iterator for the element with key @a key, adding
+     * it with default_value() if there is none.
+     * @warning This may move all other elements. */
+    inline iterator find_insert(key_const_reference key);
+
+    /** @brief Set the value for @a key to @a value.
+     * @return true if the element was added, false if it existed
+     * @warning This may move all other elements. */
+    bool set(key_const_reference key, const mapped_type &value) {
+	size_type n = _size;
+	size_type i = find_insert_slot(key);
+	_slots[i].value = value;
+	return _size != n;
+    }
+
+    /** @brief Set the value for @a key to @a value. Same as set(), as in
+     * HashMap. */
+    bool insert(key_const_reference key, const mapped_type &value) {
+	return set(key, value);
+    }
+
+    /** @brief Remove the element pointed to by @a it.
+     * @return an iterator for the next element */
+    inline iterator erase(const iterator &it);
+
+    /** @brief Remove the element with key @a key, if any.
+     * @return the number of elements removed */
+    size_type erase(key_const_reference key) {
+	size_type i = find_slot(key);
+	if (i >= _capacity)
+	    return 0;
+	erase_slot(i);
+	return 1;
+    }
+
+    /** @brief Remove the element with key @a key, if any. Same as
+     * erase(), as in HashMap.
+     * @return true if an element was removed */
+    bool remove(key_const_reference key) {
+	return erase(key);
+    }
+
+    /** @brief Remove all elements, keeping the memory. */
+    void clear() {
+	for (size_type i = 0; i < _capacity; i++)
+	    if (full(_ctrl[i]))
+		_slots[i] = slot();
+	if (_capacity)
+	    memset(_ctrl, CTRL_EMPTY, _capacity);
+	_size = 0;
+	_erased = 0;
+    }
+
+    /** @brief Swap the contents of this hash table and @a x. */
+    void swap(FlatHashTable<K, V> &x) {
+	click_swap(_ctrl, x._ctrl);
+	click_swap(_slots, x._slots);
+	click_swap(_capacity, x._capacity);
+	click_swap(_size, x._size);
+	click_swap(_erased, x._erased);
+	click_swap(_default_value, x._default_value);
+    }
+
+    /** @brief Make room for at least @a n elements without growing. */
+    void reserve(size_type n) {
+	if (n > max_load(_capacity))
+	    rehash(n);
+    }
+
+    /** @brief Assign this hash table's contents to a copy of @a x. */
+    FlatHashTable<K, V> &operator=(const FlatHashTable<K, V> &x) {
+	if (&x != this) {
+	    FlatHashTable<K, V> copy(x);
+	    swap(copy);
+	}
+	return *this;
+    }
+
+  private:
+
+    uint8_t *_ctrl;
+    slot *_slots;
+    size_type _capacity;
+    size_type _size;
+    size_type _erased;
+    V _default_value;
+
+    static bool full(uint8_t c) {
+	return !(c & 0x80);
+    }
+
+    // kept at most 7/8 full, erased slots counting as full
+    static size_type max_load(size_type capacity) {
+	return capacity - capacity / 8;
+    }
+
+    static uint32_t hash(key_const_reference key) {
+	uint32_t h = hashcode(key) * 0x9E3779B1U;
+	return h ^ (h >> 15);
+    }
+
+    // bit i set if byte i of the group at ctrl equals c
+    static unsigned match(const uint8_t *ctrl, uint8_t c) {
+#if CLICK_USERLEVEL && defined(__SSE2__)
+	__m128i g = _mm_loadu_si128((const __m128i *) ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char) c)));
+#else
+	unsigned m = 0;
+	for (int i = 0; i < GROUP; i++)
+	    if (ctrl[i] == c)
+		m |= 1U << i;
+	return m;
+#endif
+    }
+
+    // bit i set if slot i of the group at ctrl is empty or erased
+    static unsigned match_free(const uint8_t *ctrl) {
+#if CLICK_USERLEVEL && defined(__SSE2__)
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+	unsigned m = 0;
+	for (int i = 0; i < GROUP; i++)
+	    if (!full(ctrl[i]))
+		m |= 1U << i;
+	return m;
+#endif
+    }
+
+    // Groups are probed triangularly, which visits each of them once as
+    // the number of groups is a power of two. A lookup stops at the first
+    // group with an empty slot: an element never lives past such a group.
+    size_type find_slot(key_const_reference key) const {
+	if (!_capacity)
+	    return 0;
+	uint32_t h = hash(key);
+	uint8_t h2 = h & 0x7F;
+	size_type gmask = _capacity / GROUP - 1;
+	size_type g = (h >> 7) & gmask;
+	for (size_type probe = 1; probe <= gmask + 1; probe++) {
+	    const uint8_t *ctrl = _ctrl + g * GROUP;
+	    for (unsigned m = match(ctrl, h2); m; m &= m - 1) {
+		size_type i = g * GROUP + ffs_lsb(m) - 1;
+		if (_slots[i].key == key)
+		    return i;
+	    }
+	    if (match(ctrl, CTRL_EMPTY))
+		break;
+	    g = (g + probe) & gmask;
+	}
+	return _capacity;
+    }
+
+    size_type find_insert_slot(key_const_reference key) {
+	size_type i = find_slot(key);
+	if (i < _capacity)
+	    return i;
+	if (_size + _erased + 1 > max_load(_capacity))
+	    rehash(_size + 1);
+	uint32_t h = hash(key);
+	size_type gmask = _capacity / GROUP - 1;
+	size_type g = (h >> 7) & gmask;
+	for (size_type probe = 1; ; probe++) {
+	    if (unsigned m = match_free(_ctrl + g * GROUP)) {
+		i = g * GROUP + ffs_lsb(m) - 1;
+		break;
+	    }
+	    g = (g + probe) & gmask;
+	}
+	if (_ctrl[i] == CTRL_ERASED)
+	    _erased--;
+	_ctrl[i] = h & 0x7F;
+	_slots[i].key = key;
+	_slots[i].value = _default_value;
+	_size++;
+	return i;
+    }
+
+    // A slot can go back to empty if its group has an empty slot already:
+    // no lookup went past that group. Otherwise it must stay erased.
+    void erase_slot(size_type i) {
+	_slots[i] = slot();
+	if (match(_ctrl + (i & ~(size_type) (GROUP - 1)), CTRL_EMPTY))
+	    _ctrl[i] = CTRL_EMPTY;
+	else {
+	    _ctrl[i] = CTRL_ERASED;
+	    _erased++;
+	}
+	_size--;
+    }
+
+    // room for n elements, also drops the erased slots
+    void rehash(size_type n) {
+	size_type capacity = GROUP;
+	while (max_load(capacity) < n || capacity < 2 * n)
+	    capacity *= 2;
+	uint8_t *ctrl = _ctrl;
+	slot *slots = _slots;
+	size_type old_capacity = _capacity;
+	_ctrl = new uint8_t[capacity];
+	_slots = new slot[capacity];
+	memset(_ctrl, CTRL_EMPTY, capacity);
+	_capacity = capacity;
+	_size = 0;
+	_erased = 0;
+	// _slots cannot move again, there is room for every element
+	for (size_type i = 0; i < old_capacity; i++)
+	    if (full(ctrl[i]))
+		_slots[find_insert_slot(slots[i].key)].value = slots[i].value;
+	delete[] ctrl;
+	delete[] slots;
+    }
+
+    void copy_elements(const FlatHashTable<K, V> &x) {
+	if (!x._size)
+	    return;
+	rehash(x._size);
+	for (size_type i = 0; i < x._capacity; i++)
+	    if (full(x._ctrl[i]))
+		_slots[find_insert_slot(x._slots[i].key)].value = x._slots[i].value;
+    }
+
+    size_type next_full(size_type i) const {
+	while (i < _capacity && !full(_ctrl[i]))
+	    i++;
+	return i;
+    }
+
+    friend class FlatHashTable_iterator<K, V>;
+    friend class FlatHashTable_const_iterator<K, V>;
+
+};
+
+template <typename K, typename V>
+class FlatHashTable_const_iterator { public:
+
+    /** @brief Construct an uninitialized iterator. */
+    FlatHashTable_const_iterator()
+	: _t(0), _i(0) {
+    }
+
+    /** @brief Return true iff the iterator does not point past the end. */
+    bool live() const {
+	return _t && _i < _t->_capacity;
+    }
+
+    typedef bool (FlatHashTable_const_iterator::*unspecified_bool_type)() const;
+    /** @brief Return true iff the iterator is live(). */
+    operator unspecified_bool_type() const {
+	return live() ? &FlatHashTable_const_iterator::live : 0;
+    }
+
+    /** @brief Return the key of the current element. */
+    const K &key() const {
+	return _t->_slots[_i].key;
+    }
+
+    /** @brief Return the value of the current element. */
+    const V &value() const {
+	return _t->_slots[_i].value;
+    }
+
+    /** @brief Advance this iterator to the next element. */
+    void operator++() {
+	_i = _t->next_full(_i + 1);
+    }
+    /** @overload */
+    void operator++(int) {
+	++*this;
+    }
+
+    bool operator==(const FlatHashTable_const_iterator<K, V> &x) const {
+	return _t == x._t && _i == x._i;
+    }
+    bool operator!=(const FlatHashTable_const_iterator<K, V> &x) const {
+	return !(*this == x);
+    }
+
+  protected:
+
+    const FlatHashTable<K, V> *_t;
+    uint32_t _i;
+
+    FlatHashTable_const_iterator(const FlatHashTable<K, V> *t, uint32_t i)
+	: _t(t), _i(i) {
+    }
+
+    friend class FlatHashTable<K, V>;
+
+};
+
+template <typename K, typename V>
+class FlatHashTable_iterator : public FlatHashTable_const_iterator<K, V> { public:
+
+    typedef FlatHashTable_const_iterator<K, V> inherited;
+
+    /** @brief Construct an uninitialized iterator. */
+    FlatHashTable_iterator() {
+    }
+
+    /** @brief Return the value of the current element. */
+    V &value() const {
+	return const_cast<FlatHashTable<K, V> *>(this->_t)->_slots[this->_i].value;
+    }
+
+  private:
+
+    FlatHashTable_iterator(FlatHashTable<K, V> *t, uint32_t i)
+	: inherited(t, i) {
+    }
+
+    friend class FlatHashTable<K, V>;
+
+};
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::iterator FlatHashTable<K, V>::begin()
+{
+    return iterator(this, next_full(0));
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::const_iterator FlatHashTable<K, V>::begin() const
+{
+    return const_iterator(this, next_full(0));
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::iterator FlatHashTable<K, V>::end()
+{
+    return iterator(this, _capacity);
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::const_iterator FlatHashTable<K, V>::end() const
+{
+    return const_iterator(this, _capacity);
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::iterator FlatHashTable<K, V>::find(key_const_reference key)
+{
+    size_type i = find_slot(key);
+    return iterator(this, i < _capacity ? i : _capacity);
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::const_iterator FlatHashTable<K, V>::find(key_const_reference key) const
+{
+    size_type i = find_slot(key);
+    return const_iterator(this, i < _capacity ? i : _capacity);
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::iterator FlatHashTable<K, V>::find_insert(key_const_reference key)
+{
+    return iterator(this, find_insert_slot(key));
+}
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::iterator FlatHashTable<K, V>::erase(const iterator &it)
+{
+    assert(it._t == this && it.live());
+    erase_slot(it._i);
+    return iterator(this, next_full(it._i + 1));
+}
+
+CLICK_ENDDECLS
+#endif
@@ -42,6 +42,8 @@ class Handler { public:
 	f_button = 0x2000,	///< @brief Write handler ignores data.
 	f_checkbox = 0x4000,	///< @brief Read/write handler is boolean and
 				///  should be rendered as a checkbox.
+	f_read_chunked = 0x8000,///< @brief Read handler produces its value
+				///  in chunks, see call_read_chunk().
 	f_driver0 = 1U << 26,
         f_driver1 = 1U << 27,   ///< @brief Uninterpreted handler flags
 				///  available for drivers.
@@ -53,7 +55,7 @@ class Handler { public:
 
 	f_read_comprehensive = 0x0008,
 	f_write_comprehensive = 0x0010,
-	f_special = f_read | f_write | f_read_param | f_read_comprehensive | f_write_comprehensive
+	f_special = f_read | f_write | f_read_param | f_read_comprehensive | f_write_comprehensive | f_read_chunked
 				///< @brief These flags may not be set by
 				///  Router::set_handler_flags().
     };
@@ -103,6 +105,13 @@ class Handler { public:
 	return _flags & f_read_param;
     }
 
+    /** @brief Test if this read handler produces its value in chunks.
+     *
+     * @sa call_read_chunk() */
+    inline bool read_chunked() const {
+	return _flags & f_read_chunked;
+    }
+
     /** @brief Test if this is a public read handler.
      *
      * Private handlers may be not called from outside the router
@@ -187,6 +196,28 @@ class Handler { public:
 	return call_read(e, String(), errh);
     }
 
+    /** @brief Call a read handler for one chunk of its value.
+     * @param e element on which to call the handler
+     * @param cursor where the chunk starts, 0 for the first one
+     * @param[out] chunk the chunk
+     * @param errh optional error handler
+     * @return the cursor of the next chunk, 0 after the last chunk, or a
+     * negative error code
+     *
+     * Chunked read handlers, set with Router::set_handler() and the
+     * f_read_chunked flag, let callers such as ControlSocket hold one
+     * chunk of a large value at a time.  Their callback is called with
+     * the cursor, in decimal, as data, or an empty string for the first
+     * chunk.  It replaces the data with the chunk, and returns the cursor
+     * of the next chunk, 0 after the last chunk, or a negative error code.
+     * What a cursor stands for is up to the handler, for instance a count
+     * of table entries; the value is only consistent within a chunk, and
+     * a chunk may be empty.
+     *
+     * For other read handlers, returns their whole value as one chunk.
+     * call_read() returns the chunks of a chunked handler concatenated. */
+    int call_read_chunk(Element *e, int cursor, String &chunk, ErrorHandler *errh) const;
+
     /** @brief Call a write handler.
      * @param value value to write to the handler
      * @param e element on which to call the handler
@@ -241,6 +272,7 @@ class Handler { public:
 	h_expensive = f_expensive,
 	h_button = f_button,
 	h_checkbox = f_checkbox,
+	h_read_chunked = f_read_chunked,
 	h_driver_flag_0 = f_driver0,
         h_driver_flag_1 = f_driver1,
 	h_user_flag_shift = f_user_shift,
@@ -16,6 +16,27 @@ class HashAllocator { public:
 	_size = new_size;
     }
 
+    /** @brief Carve elements out of hugepages when possible.
+     *
+     * Buffers are then one hugepage each, so that many elements share a
+     * TLB entry. Only effective at user level on Linux; the allocator
+     * falls back to ordinary buffers when no hugepage is free. */
+    inline void set_hugepages(bool hugepages) {
+	assert(!_free && !_buffer);
+	_hugepages = hugepages;
+    }
+
+    /** @brief Align every element on @a align bytes, a power of two.
+     *
+     * For elements of over-aligned types, such as those with members on
+     * cache lines of their own.  The element size is rounded up to a
+     * multiple of @a align. */
+    inline void set_alignment(size_t align) {
+	assert(!_free && !_buffer && align && !(align & (align - 1)));
+	_align = align;
+	_size = (_size + align - 1) & ~(align - 1);
+    }
+
     inline void *allocate();
     inline void deallocate(void *p);
 
@@ -31,6 +52,7 @@ class HashAllocator { public:
 	buffer *next;
 	size_t pos;
 	size_t maxpos;
+	bool mapped;
     };
 
     enum {
@@ -40,12 +62,15 @@ class HashAllocator { public:
 #else
 	max_buffer_size = 1048576,
 #endif
-	min_nelements = 8
+	min_nelements = 8,
+	hugepage_size = 2 << 20
     };
 
     link *_free;
     buffer *_buffer;
     size_t _size;
+    size_t _align;
+    bool _hugepages;
 
     void *hard_allocate();
 
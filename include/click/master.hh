@@ -144,6 +144,25 @@ RouterThread::run_signals()
         _master->process_signals(this);
 }
 
+/** @brief Returns how long the SelectSet may wait, like
+ * TimerSet::next_timer_delay().
+ *
+ * Normally the wait is zero while tasks are scheduled. An adaptive polling
+ * thread that backed off waits even then, but no longer than its current
+ * backoff. */
+inline int
+RouterThread::select_delay(Timestamp &t) const
+{
+    if (!_idle_wait)
+        return _timers.next_timer_delay(active(), t);
+    int delay_type = _timers.next_timer_delay(false, t);
+    if (delay_type < 0 || (delay_type > 0 && t > _idle_wait)) {
+        t = _idle_wait;
+        delay_type = 1;
+    }
+    return delay_type;
+}
+
 inline int
 TimerSet::next_timer_delay(bool more_tasks, Timestamp &t) const
 {
@@ -70,6 +70,25 @@ class Packet { public:
 
     static void static_cleanup();
 
+#if HAVE_CLICK_PACKET_POOL
+    /** @brief Statistics of a packet data buffer size class. */
+    struct PoolStats {
+	uint32_t buffer_size;	///< buffer_length() of the class's buffers
+	uint32_t limit;		///< most free buffers a thread's pool keeps
+	uint32_t free;		///< free buffers in all pools
+	uint32_t spare;		///< reserved buffers on the overflow list
+	uint32_t reserved;	///< buffers reserved by pool_reserve()
+	bool hugepages;		///< true iff reserved buffers use hugepages
+	uint64_t hits;		///< buffers allocated from a pool
+	uint64_t misses;	///< buffers allocated from the heap
+	uint64_t frees;		///< buffers returned to the heap
+    };
+
+    static int pool_reserve(uint32_t size, uint32_t count, bool hugepages);
+    static int pool_nclasses();
+    static bool pool_stats(int size_class, PoolStats &stats);
+#endif
+
     inline void kill();
 
     inline bool shared() const;
@@ -814,7 +833,7 @@ class WritablePacket : public Packet { public:
     ~WritablePacket() { }
 
 #if HAVE_CLICK_PACKET_POOL
-    static WritablePacket *pool_allocate(bool with_data);
+    static WritablePacket *pool_allocate(int size_class);
     static WritablePacket *pool_allocate(uint32_t headroom, uint32_t length,
 					 uint32_t tailroom);
     static void recycle(WritablePacket *p);
@@ -134,4 +134,16 @@
 # endif
 #endif
 
+// bytes 44-45
+#define GSO_SIZE_ANNO_OFFSET		44
+#define GSO_SIZE_ANNO_SIZE		2
+#define GSO_SIZE_ANNO(p)		((p)->anno_u16(GSO_SIZE_ANNO_OFFSET))
+#define SET_GSO_SIZE_ANNO(p, v)		((p)->set_anno_u16(GSO_SIZE_ANNO_OFFSET, (v)))
+
+// bytes 46-47
+#define SLICE_ANNO_OFFSET		46
+#define SLICE_ANNO_SIZE			2
+#define SLICE_ANNO(p)			((p)->anno_u16(SLICE_ANNO_OFFSET))
+#define SET_SLICE_ANNO(p, v)		((p)->set_anno_u16(SLICE_ANNO_OFFSET, (v)))
+
 #endif
@@ -0,0 +1,95 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PACKETBATCH_HH
+#define CLICK_PACKETBATCH_HH
+#include <click/packet.hh>
+CLICK_DECLS
+
+/** @class PacketBatch
+ * @brief Builds a list of packets linked through Packet::next().
+ *
+ * Element::push_batch() and Element::pull_batch() move packets as a
+ * null-terminated list linked through Packet::next(), passed around as a
+ * pointer to its first packet.  PacketBatch appends to such a list in
+ * constant time and counts its packets; take() hands the list over.
+ *
+ * @code
+ * PacketBatch out[2];
+ * while (Packet *p = PacketBatch::pop(head))
+ *     out[classify(p)].append(p);
+ * for (int i = 0; i < 2; ++i)
+ *     if (!out[i].empty())
+ *         output(i).push_batch(out[i].take());
+ * @endcode
+ */
+class PacketBatch { public:
+
+    /** @brief Construct an empty batch. */
+    PacketBatch()
+	: _head(0), _tail(0), _count(0) {
+    }
+
+    /** @brief Return true iff the batch has no packets. */
+    bool empty() const {
+	return !_head;
+    }
+
+    /** @brief Return the number of packets in the batch. */
+    unsigned count() const {
+	return _count;
+    }
+
+    /** @brief Return the first packet of the batch, or null. */
+    Packet *head() const {
+	return _head;
+    }
+
+    /** @brief Append packet @a p to the batch. */
+    void append(Packet *p) {
+	p->set_next(0);
+	if (_tail)
+	    _tail->set_next(p);
+	else
+	    _head = p;
+	_tail = p;
+	++_count;
+    }
+
+    /** @brief Return the list of packets and empty the batch. */
+    Packet *take() {
+	Packet *head = _head;
+	_head = _tail = 0;
+	_count = 0;
+	return head;
+    }
+
+    /** @brief Free every packet of the batch. */
+    void kill() {
+	while (Packet *p = pop(_head))
+	    p->kill();
+	_tail = 0;
+	_count = 0;
+    }
+
+    /** @brief Unlink the first packet of list @a head and return it.
+     *
+     * Advances @a head to the next packet. Returns null once the list is
+     * empty. The returned packet's next() is null. */
+    static Packet *pop(Packet *&head) {
+	Packet *p = head;
+	if (p) {
+	    head = p->next();
+	    p->set_next(0);
+	}
+	return p;
+    }
+
+  private:
+
+    Packet *_head;
+    Packet *_tail;
+    unsigned _count;
+
+};
+
+CLICK_ENDDECLS
+#endif
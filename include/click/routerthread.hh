@@ -24,6 +24,7 @@ CLICK_CXX_UNPROTECT
 // We cannot #include <click/task.hh> ourselves because of circular #include
 // dependency.
 CLICK_DECLS
+class ThreadSched;
 
 class RouterThread { public:
 
@@ -74,6 +75,32 @@ class RouterThread { public:
     void set_greedy(bool g)             { _greedy = g; }
 #endif
 
+#if CLICK_USERLEVEL
+    // Adaptive polling: while tasks find work the thread polls file
+    // descriptors without blocking, as usual. After idle iterations it
+    // backs off, first with sched_yield(), then with short sleeps, and
+    // finally waits for file descriptors for up to max_sleep even though
+    // tasks are scheduled.
+    enum { A_BUSY, A_SPIN, A_YIELD, A_SLEEP, A_WAIT, A_BLOCKED,
+           A_NSTATES };
+    bool adaptive_poll() const          { return _adaptive_poll; }
+    void set_adaptive_poll(bool on, const Timestamp &max_sleep);
+    Timestamp adaptive_state_time(int state) const;
+    static String adaptive_state_name(int state);
+#endif
+
+#if HAVE_MULTITHREAD
+    // Work stealing: a thread that runs out of tasks asks a busy thread
+    // for one. The busy thread answers at its next driver iteration by
+    // moving the costliest task @a sched deems stealable with
+    // Task::move_thread(), so a task only ever leaves the thread that
+    // runs it.
+    ThreadSched *work_stealing() const  { return _steal_sched; }
+    void set_work_stealing(ThreadSched *sched);
+    uint32_t tasks_given() const        { return _steal_given; }
+    void clear_tasks_given()            { _steal_given = 0; }
+#endif
+
     inline void wake();
 
 #if CLICK_USERLEVEL
@@ -127,6 +154,18 @@ class RouterThread { public:
     SelectSet _selects;
 #endif
 
+#if CLICK_USERLEVEL
+    bool _adaptive_poll;
+    int _adaptive_state;
+    unsigned _idle_iters;               // iterations since a task worked
+    Timestamp _idle_sleep;              // current backoff
+    Timestamp _idle_wait;               // bound on the select wait, if set
+    Timestamp _adaptive_max_sleep;
+    Timestamp _adaptive_timestamp;
+    Timestamp _adaptive_time[A_NSTATES];
+    enum { A_SPIN_ITERS = 64, A_YIELD_ITERS = 64 };
+#endif
+
 #if HAVE_ADAPTIVE_SCHEDULER
     enum { C_CLICK, C_KERNEL, NCLIENTS };
     struct Client {                     // top-level stride clients
@@ -166,6 +205,15 @@ class RouterThread { public:
 #endif
 #if CLICK_MINIOS
     struct thread *_minios_thread;
+#endif
+#if HAVE_MULTITHREAD
+    ThreadSched *_steal_sched;
+    volatile bool _steal_busy;          // has tasks to spare
+    volatile bool _steal_idle;          // has no task
+    int _steal_victim;                  // last thread asked for a task
+    uint32_t _steal_given;
+    // ID of the idle thread waiting for one of our tasks, or -1
+    volatile uint32_t _steal_request CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
 #endif
   public:
     unsigned _tasks_per_iter;
@@ -225,9 +273,18 @@ class RouterThread { public:
         assert(val == (uint32_t) -1);
     }
 
-    inline void run_tasks(int ntasks);
+    inline bool run_tasks(int ntasks);
     inline void process_pending();
+#if HAVE_MULTITHREAD
+    void work_steal();
+#endif
     inline void run_os();
+#if CLICK_USERLEVEL
+    inline int select_delay(Timestamp &t) const;
+    void set_adaptive_state(int state);
+    void adaptive_account(bool worked);
+    void run_os_adaptive();
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     void client_set_tickets(int client, int tickets);
     inline void client_update_pass(int client, const Timestamp &before);
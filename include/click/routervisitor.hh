@@ -189,5 +189,45 @@ class ElementNeighborhoodTracker : public ElementTracker { public:
 
 };
 
+/** @class HeadroomTracker
+ * @brief Router configuration visitor that finds the headroom packets need
+ * downstream.
+ *
+ * Elements that push headers onto packets declare how many bytes they push
+ * by answering cast("Headroom") with a pointer to an unsigned holding that
+ * number.  When passed to Router::visit_downstream(), HeadroomTracker adds
+ * those up along the paths from the source port.  A source that leaves
+ * headroom() bytes in front of its packets spares the elements downstream
+ * a copy:
+ * @code
+ * HeadroomTracker tracker(e->router());
+ * e->router()->visit_downstream(e, 0, &tracker);
+ * tracker.headroom();  // most bytes pushed on a path from [0]e
+ * @endcode
+ *
+ * Every port is reached once, by a shortest path: headers pushed on a
+ * longer path into an element already reached are missed.
+ */
+class HeadroomTracker : public RouterVisitor { public:
+
+    /** @brief Construct a HeadroomTracker.
+     * @param router the router to be traversed */
+    HeadroomTracker(Router *router);
+
+    /** @brief Return the most bytes pushed on a path. */
+    unsigned headroom() const {
+	return _headroom;
+    }
+
+    bool visit(Element *e, bool isoutput, int port,
+	       Element *from_e, int from_port, int distance);
+
+  private:
+
+    Vector<unsigned> _pushed;
+    unsigned _headroom;
+
+};
+
 CLICK_ENDDECLS
 #endif
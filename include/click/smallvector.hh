@@ -0,0 +1,363 @@
+#ifndef CLICK_SMALLVECTOR_HH
+#define CLICK_SMALLVECTOR_HH
+#include <click/vector.hh>
+CLICK_DECLS
+
+/** @file <click/smallvector.hh>
+  @brief Click's small vector container template. */
+
+/** @class SmallVector
+  @brief Vector template with inline storage for its first elements.
+
+  SmallVector<T, N> has the interface of Vector<T>, but keeps up to @a N
+  elements in the object itself, and allocates memory only when it grows
+  past them. It suits containers that are almost always short, such as the
+  SSIDs of a station or the rates of a transmission policy: creating and
+  copying them costs no allocation, and their elements are next to the
+  object that holds them.
+
+  Once grown past @a N elements, a SmallVector keeps its allocated memory
+  until it is destroyed, like a Vector. Iterators are pointers, and any
+  operation that adds elements may invalidate them, as for Vector; unlike
+  Vector, swap() copies the elements of vectors held inline.
+
+  @code
+  SmallVector<int, 4> v;             // no allocation
+  v.push_back(1);
+  v.push_back(2);
+  assert(v.is_inline() && v.capacity() == 4);
+  @endcode */
+template <typename T, int N>
+class SmallVector {
+
+    typedef typename array_memory<T>::type array_memory_type;
+    typedef typename array_memory_type::type type;
+
+  public:
+
+    typedef T value_type;		///< Value type.
+    typedef T &reference;		///< Reference to value type.
+    typedef const T &const_reference;	///< Const reference to value type.
+    typedef T *pointer;			///< Pointer to value type.
+    typedef const T *const_pointer;	///< Pointer to const value type.
+
+    /** @brief Type used for value arguments (either T or const T &). */
+    typedef typename fast_argument<T>::type value_argument_type;
+    typedef const T &const_access_type;
+
+    typedef int size_type;		///< Type of sizes (size()).
+
+    typedef T *iterator;		///< Iterator type.
+    typedef const T *const_iterator;	///< Const iterator type.
+
+    /** @brief Constant passed to reserve() to grow the SmallVector. */
+    enum { RESERVE_GROW = (size_type) -1 };
+
+    /** @brief Construct an empty vector. */
+    SmallVector()
+	: l_(inline_l()), n_(0), capacity_(N) {
+    }
+    /** @brief Construct a vector containing @a n copies of @a v. */
+    explicit SmallVector(size_type n, value_argument_type v)
+	: l_(inline_l()), n_(0), capacity_(N) {
+	resize(n, v);
+    }
+    /** @brief Construct a vector as a copy of @a x. */
+    SmallVector(const SmallVector<T, N> &x)
+	: l_(inline_l()), n_(0), capacity_(N) {
+	copy_from(x);
+    }
+    ~SmallVector() {
+	array_memory_type::destroy(l_, n_);
+	if (!is_inline())
+	    CLICK_LFREE(l_, capacity_ * sizeof(type));
+    }
+
+    /** @brief Assign this vector's contents to a copy of @a x. */
+    SmallVector<T, N> &operator=(const SmallVector<T, N> &x) {
+	if (&x != this) {
+	    clear();
+	    copy_from(x);
+	}
+	return *this;
+    }
+    /** @brief Assign this vector's contents to @a n copies of @a v. */
+    SmallVector<T, N> &assign(size_type n, value_argument_type v = T()) {
+	if (unlikely(need_argument_copy(&v))) {
+	    T v_copy(v);
+	    return assign(n, v_copy);
+	}
+	resize(0, v);
+	resize(n, v);
+	return *this;
+    }
+
+    /** @brief Return an iterator for the first element in the vector. */
+    iterator begin() {
+	return (iterator) l_;
+    }
+    /** @overload */
+    const_iterator begin() const {
+	return (const_iterator) l_;
+    }
+    /** @brief Return an iterator for the end of the vector. */
+    iterator end() {
+	return (iterator) l_ + n_;
+    }
+    /** @overload */
+    const_iterator end() const {
+	return (const_iterator) l_ + n_;
+    }
+    /** @brief Return a const_iterator for the beginning of the vector. */
+    const_iterator cbegin() const {
+	return (const_iterator) l_;
+    }
+    /** @brief Return a const_iterator for the end of the vector. */
+    const_iterator cend() const {
+	return (const_iterator) l_ + n_;
+    }
+
+    /** @brief Return the number of elements. */
+    size_type size() const {
+	return n_;
+    }
+    /** @brief Return the vector's capacity, at least @a N. */
+    size_type capacity() const {
+	return capacity_;
+    }
+    /** @brief Test if the vector is empty (size() == 0). */
+    bool empty() const {
+	return n_ == 0;
+    }
+    /** @brief Test if the elements are held in the object itself.
+
+	True until the vector grows past @a N elements. */
+    bool is_inline() const {
+	return l_ == inline_l();
+    }
+
+    /** @brief Resize the vector to @a n elements, new ones copies of @a v. */
+    void resize(size_type n, value_argument_type v = T()) {
+	if (unlikely(need_argument_copy(&v))) {
+	    T v_copy(v);
+	    return resize(n, v_copy);
+	}
+	if (n <= capacity_ || reserve(n)) {
+	    assert(n >= 0);
+	    if (n < n_)
+		array_memory_type::destroy(l_ + n, n_ - n);
+	    if (n_ < n)
+		array_memory_type::fill(l_ + n_, n - n_, array_memory_type::cast(&v));
+	    n_ = n;
+	}
+    }
+    /** @brief Reserve memory for at least @a n elements.
+	@return true iff the reservation succeeded
+
+	If @a n is RESERVE_GROW, the capacity doubles. */
+    bool reserve(size_type n) {
+	if (n < 0)
+	    n = capacity_ * 2;
+	if (n > capacity_) {
+	    type *new_l = (type *) CLICK_LALLOC(n * sizeof(type));
+	    if (!new_l)
+		return false;
+	    array_memory_type::move(new_l, l_, n_);
+	    if (!is_inline())
+		CLICK_LFREE(l_, capacity_ * sizeof(type));
+	    l_ = new_l;
+	    capacity_ = n;
+	}
+	return true;
+    }
+
+    /** @brief Return a reference to the <em>i</em>th element.
+	@pre 0 <= @a i < size() */
+    T &operator[](size_type i) {
+	assert((unsigned) i < (unsigned) n_);
+	return *(T *) &l_[i];
+    }
+    /** @overload */
+    const T &operator[](size_type i) const {
+	assert((unsigned) i < (unsigned) n_);
+	return *(T *) &l_[i];
+    }
+    /** @brief Return a reference to the <em>i</em>th element.
+	@pre 0 <= @a i < size() */
+    T &at(size_type i) {
+	return operator[](i);
+    }
+    /** @overload */
+    const T &at(size_type i) const {
+	return operator[](i);
+    }
+    /** @brief Return a reference to the first element.
+	@pre !empty() */
+    T &front() {
+	return operator[](0);
+    }
+    /** @overload */
+    const T &front() const {
+	return operator[](0);
+    }
+    /** @brief Return a reference to the last element.
+	@pre !empty() */
+    T &back() {
+	return operator[](n_ - 1);
+    }
+    /** @overload */
+    const T &back() const {
+	return operator[](n_ - 1);
+    }
+    /** @brief Return a reference to the <em>i</em>th element.
+	@pre 0 <= @a i < size()
+
+	Unlike operator[]() and at(), this function does not check bounds,
+	even if assertions are enabled. */
+    T &unchecked_at(size_type i) {
+	return *(T *) &l_[i];
+    }
+    /** @overload */
+    const T &unchecked_at(size_type i) const {
+	return *(T *) &l_[i];
+    }
+    /** @brief Return a pointer to the vector's data. */
+    T *data() {
+	return (T *) l_;
+    }
+    /** @overload */
+    const T *data() const {
+	return (const T *) l_;
+    }
+
+    /** @brief Append element @a v. */
+    void push_back(value_argument_type v) {
+	if (n_ == capacity_) {
+	    if (unlikely(need_argument_copy(&v))) {
+		T v_copy(v);
+		return push_back(v_copy);
+	    }
+	    if (!reserve(RESERVE_GROW))
+		return;
+	}
+	array_memory_type::fill(l_ + n_, 1, array_memory_type::cast(&v));
+	++n_;
+    }
+    /** @brief Remove the last element.
+	@pre !empty() */
+    void pop_back() {
+	assert(n_ > 0);
+	--n_;
+	array_memory_type::destroy(l_ + n_, 1);
+    }
+    /** @brief Prepend element @a v.
+
+	Takes time proportional to size(). */
+    void push_front(value_argument_type v) {
+	insert(begin(), v);
+    }
+    /** @brief Remove the first element.
+	@pre !empty() */
+    void pop_front() {
+	erase(begin());
+    }
+
+    /** @brief Insert @a v before position @a it.
+	@return An iterator pointing at the new element. */
+    iterator insert(iterator it, value_argument_type v) {
+	assert(it >= begin() && it <= end());
+	if (unlikely(need_argument_copy(&v))) {
+	    T v_copy(v);
+	    return insert(it, v_copy);
+	}
+	if (n_ == capacity_) {
+	    size_type pos = it - begin();
+	    if (!reserve(RESERVE_GROW))
+		return end();
+	    it = begin() + pos;
+	}
+	type *l = (type *) it;
+	array_memory_type::move(l + 1, l, (l_ + n_) - l);
+	array_memory_type::fill(l, 1, array_memory_type::cast(&v));
+	++n_;
+	return it;
+    }
+    /** @brief Remove the element at position @a it.
+	@return An iterator pointing at the element following @a it. */
+    iterator erase(iterator it) {
+	return (it < end() ? erase(it, it + 1) : it);
+    }
+    /** @brief Remove the elements in [@a a, @a b).
+	@return An iterator corresponding to @a b. */
+    iterator erase(iterator a, iterator b) {
+	if (a < b) {
+	    assert(a >= begin() && b <= end());
+	    array_memory_type::move_onto((type *) a, (type *) b, end() - b);
+	    n_ -= b - a;
+	    array_memory_type::destroy(l_ + n_, b - a);
+	    return a;
+	} else
+	    return b;
+    }
+
+    /** @brief Remove all elements.
+
+	Memory allocated past @a N elements is kept. */
+    void clear() {
+	array_memory_type::destroy(l_, n_);
+	n_ = 0;
+    }
+
+    /** @brief Swap the contents of this vector and @a x. */
+    void swap(SmallVector<T, N> &x) {
+	if (!is_inline() && !x.is_inline()) {
+	    click_swap(l_, x.l_);
+	    click_swap(n_, x.n_);
+	    click_swap(capacity_, x.capacity_);
+	} else {
+	    SmallVector<T, N> tmp(*this);
+	    *this = x;
+	    x = tmp;
+	}
+    }
+
+  private:
+
+    type *l_;
+    size_type n_;
+    size_type capacity_;
+    union {
+	char c[N * sizeof(T)];
+	void *p;
+	double d;
+	long long ll;
+    } inline_;
+
+    type *inline_l() const {
+	return (type *) inline_.c;
+    }
+    bool need_argument_copy(const T *argp) const {
+	return fast_argument<T>::is_reference
+	    && (uintptr_t) argp - (uintptr_t) l_ < (size_t) (n_ * sizeof(T));
+    }
+    void copy_from(const SmallVector<T, N> &x) {
+	if (x.n_ <= capacity_ || reserve(x.n_)) {
+	    array_memory_type::copy(l_, x.l_, x.n_);
+	    n_ = x.n_;
+	}
+    }
+
+};
+
+template <typename T, int N>
+inline void click_swap(SmallVector<T, N> &a, SmallVector<T, N> &b) {
+    a.swap(b);
+}
+
+template <typename T, int N>
+inline void assign_consume(SmallVector<T, N> &a, SmallVector<T, N> &b) {
+    a.swap(b);
+}
+
+CLICK_ENDDECLS
+#endif
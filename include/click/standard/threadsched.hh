@@ -2,6 +2,7 @@
 #ifndef CLICK_THREADSCHED_HH
 #define CLICK_THREADSCHED_HH
 CLICK_DECLS
+class Task;
 
 class ThreadSched { public:
 
@@ -12,6 +13,12 @@ class ThreadSched { public:
 
     virtual int initial_home_thread_id(const Element *e);
 
+    /** @brief Return true iff work stealing may move @a task to another
+     * thread.
+     *
+     * The default refuses pinned tasks only. */
+    virtual bool task_stealable(const Task *task);
+
 };
 
 CLICK_ENDDECLS
@@ -19,6 +19,77 @@ CLICK_DECLS
  * Linux kernel.
  */
 
+class Element;
+class String;
+
+#if CLICK_LOCK_STATS
+/** @class LockStats
+ * @brief Contention counters of a lock.
+ *
+ * With --enable-lock-stats, every Spinlock and ReadWriteLock carries a
+ * LockStats that counts its acquisitions, the acquisitions that had to spin,
+ * the cycles spent spinning and the longest time the lock was held, in
+ * cycles.  The counters are only updated by the thread holding the lock.
+ *
+ * A lock is reported under the name its owner gives it with set_name().  All
+ * the LockStats are linked on a global list, which the global "lock_stats"
+ * handler walks.
+ */
+class LockStats { public:
+
+    LockStats();
+    LockStats(const LockStats &x);
+    ~LockStats();
+    LockStats &operator=(const LockStats &) {
+	return *this;
+    }
+
+    void set_name(const Element *owner, const char *name) {
+	_owner = owner;
+	_name = name;
+    }
+
+    inline void acquired(click_cycles_t spin, click_cycles_t now) {
+	_acquisitions++;
+	if (spin) {
+	    _contended++;
+	    _spin_cycles += spin;
+	}
+	_acquired_at = now;
+    }
+
+    inline void released(click_cycles_t now) {
+	click_cycles_t hold = now - _acquired_at;
+	if (hold > _max_hold)
+	    _max_hold = hold;
+    }
+
+    void reset();
+
+    /** @brief Returns one line per named lock, then a line adding up the
+     * unnamed ones. */
+    static String unparse_all();
+    static void reset_all();
+
+    const Element *_owner;
+    const char *_name;
+    uint64_t _acquisitions;
+    uint64_t _contended;
+    uint64_t _spin_cycles;
+    click_cycles_t _max_hold;
+    click_cycles_t _acquired_at;
+
+  private:
+
+    LockStats *_prev;
+    LockStats *_next;
+
+    void link();
+    void unlink();
+
+};
+#endif
+
 /** @class Spinlock
  * @brief A recursive spinlock for SMP Click threads.
  *
@@ -41,6 +112,9 @@ CLICK_DECLS
  * It is OK for a thread to acquire a lock it has already acquired, but you
  * must release it as many times as you have acquired it.
  *
+ * With --enable-lock-stats, each Spinlock also counts how it is contended,
+ * see LockStats and set_name().
+ *
  * @sa SimpleSpinlock, SpinlockIRQ
  */
 class Spinlock { public:
@@ -53,13 +127,36 @@ class Spinlock { public:
     inline bool attempt();
     inline bool nested() const;
 
-#if CLICK_MULTITHREAD_SPINLOCK
-  private:
+    /** @brief Names the lock in the lock statistics.
+     * @param owner element the lock belongs to, or null
+     * @param name static string naming the lock within @a owner
+     *
+     * Does nothing unless Click was configured with --enable-lock-stats. */
+    inline void set_name(const Element *owner, const char *name) {
+#if CLICK_LOCK_STATS
+	_stats.set_name(owner, name);
+#else
+	(void) owner, (void) name;
+#endif
+    }
 
+#if CLICK_LOCK_STATS
+    const LockStats &stats() const {
+	return _stats;
+    }
+#endif
+
+#if CLICK_MULTITHREAD_SPINLOCK || CLICK_LOCK_STATS
+  private:
+#endif
+#if CLICK_MULTITHREAD_SPINLOCK
     atomic_uint32_t _lock;
     int32_t _depth;
     click_processor_t _owner;
 #endif
+#if CLICK_LOCK_STATS
+    LockStats _stats;
+#endif
 
 };
 
@@ -97,13 +194,31 @@ Spinlock::acquire()
 #if CLICK_MULTITHREAD_SPINLOCK
     click_processor_t my_cpu = click_get_processor();
     if (_owner != my_cpu) {
+# if CLICK_LOCK_STATS
+	click_cycles_t spin = 0;
+	if (_lock.swap(1) != 0) {
+	    click_cycles_t start = click_get_cycles();
+	    do {
+		do {
+		    click_relax_fence();
+		} while (_lock != 0);
+	    } while (_lock.swap(1) != 0);
+	    spin = click_get_cycles() - start;
+	    if (!spin)
+		spin = 1;
+	}
+	_stats.acquired(spin, click_get_cycles());
+# else
 	while (_lock.swap(1) != 0)
 	    do {
 		click_relax_fence();
 	    } while (_lock != 0);
+# endif
 	_owner = my_cpu;
     }
     _depth++;
+#elif CLICK_LOCK_STATS
+    _stats.acquired(0, click_get_cycles());
 #endif
 }
 
@@ -123,11 +238,17 @@ Spinlock::attempt()
 	    click_put_processor();
 	    return false;
 	}
+# if CLICK_LOCK_STATS
+	_stats.acquired(0, click_get_cycles());
+# endif
 	_owner = my_cpu;
     }
     _depth++;
     return true;
 #else
+# if CLICK_LOCK_STATS
+    _stats.acquired(0, click_get_cycles());
+# endif
     return true;
 #endif
 }
@@ -145,12 +266,17 @@ Spinlock::release()
 	click_chatter(SPINLOCK_ASSERTLEVEL "Spinlock::release(): assertion \"owner == click_current_processor()\" failed");
     if (likely(_depth > 0)) {
 	if (--_depth == 0) {
+# if CLICK_LOCK_STATS
+	    _stats.released(click_get_cycles());
+# endif
 	    _owner = click_invalid_processor();
 	    _lock = 0;
 	}
     } else
 	click_chatter(SPINLOCK_ASSERTLEVEL "Spinlock::release(): assertion \"_depth > 0\" failed");
     click_put_processor();
+#elif CLICK_LOCK_STATS
+    _stats.released(click_get_cycles());
 #endif
 }
 
@@ -402,6 +528,11 @@ SpinlockIRQ::release(flags_t flags)
  *
  * ReadWriteLock objects are relatively large in terms of memory usage; don't
  * create too many of them.
+ *
+ * With --enable-lock-stats, a ReadWriteLock counts its write acquisitions,
+ * see LockStats and set_name().  Read acquisitions only take the lock of the
+ * current CPU, whose contention is counted by that Spinlock.  At user level,
+ * where ReadWriteLock does not lock, the counters are approximate.
  */
 class ReadWriteLock { public:
 
@@ -417,14 +548,35 @@ class ReadWriteLock { public:
     inline bool attempt_write();
     inline void release_write();
 
-#if CLICK_LINUXMODULE && defined(CONFIG_SMP)
+    /** @brief Names the lock in the lock statistics.
+     * @sa Spinlock::set_name */
+    inline void set_name(const Element *owner, const char *name) {
+#if CLICK_LOCK_STATS
+	_stats.set_name(owner, name);
+#else
+	(void) owner, (void) name;
+#endif
+    }
+
+#if CLICK_LOCK_STATS
+    const LockStats &stats() const {
+	return _stats;
+    }
+#endif
+
+#if (CLICK_LINUXMODULE && defined(CONFIG_SMP)) || CLICK_LOCK_STATS
   private:
+#endif
+#if CLICK_LINUXMODULE && defined(CONFIG_SMP)
     // allocate a cache line for every member
     struct lock_t {
 	Spinlock _lock;
 	unsigned char reserved[L1_CACHE_BYTES - sizeof(Spinlock)];
     } *_l;
 #endif
+#if CLICK_LOCK_STATS
+    LockStats _stats;
+#endif
 
 };
 
@@ -510,9 +662,24 @@ ReadWriteLock::release_read()
 inline void
 ReadWriteLock::acquire_write()
 {
+#if CLICK_LOCK_STATS
+    click_cycles_t start = click_get_cycles();
+    bool contended = false;
+#endif
 #if CLICK_LINUXMODULE && defined(CONFIG_SMP)
-    for (unsigned i = 0; i < (unsigned) num_possible_cpus(); i++)
+    for (unsigned i = 0; i < (unsigned) num_possible_cpus(); i++) {
+# if CLICK_LOCK_STATS
+	if (_l[i]._lock.attempt())
+	    continue;
+	contended = true;
+# endif
 	_l[i]._lock.acquire();
+    }
+#endif
+#if CLICK_LOCK_STATS
+    click_cycles_t now = click_get_cycles();
+    click_cycles_t spin = contended ? now - start : 0;
+    _stats.acquired(contended && !spin ? 1 : spin, now);
 #endif
 }
 
@@ -540,8 +707,15 @@ ReadWriteLock::attempt_write()
     if (!all)
 	for (unsigned j = 0; j < i; j++)
 	    _l[j]._lock.release();
+# if CLICK_LOCK_STATS
+    if (all)
+	_stats.acquired(0, click_get_cycles());
+# endif
     return all;
 #else
+# if CLICK_LOCK_STATS
+    _stats.acquired(0, click_get_cycles());
+# endif
     return true;
 #endif
 }
@@ -557,12 +731,111 @@ ReadWriteLock::attempt_write()
 inline void
 ReadWriteLock::release_write()
 {
+#if CLICK_LOCK_STATS
+    _stats.released(click_get_cycles());
+#endif
 #if CLICK_LINUXMODULE && defined(CONFIG_SMP)
     for (unsigned i = 0; i < (unsigned) num_possible_cpus(); i++)
 	_l[i]._lock.release();
 #endif
 }
 
+
+/** @class SeqLock
+ * @brief A sequence lock for data written often and read rarely.
+ *
+ * The SeqLock class protects a small group of plain values, such as
+ * counters, that one thread updates and other threads copy out.  The
+ * writer never waits: write_begin() and write_end() each cost a store and a
+ * write fence.  A reader copies the values between read_begin() and
+ * read_retry(), and starts over if the writer ran meanwhile:
+ *
+ * @code
+ * unsigned seq;
+ * do {
+ *     seq = lock.read_begin();
+ *     pkts = _pkts;
+ *     bytes = _bytes;
+ * } while (lock.read_retry(seq));
+ * @endcode
+ *
+ * Writers must be serialized by other means, for instance because a single
+ * thread updates the values, or because they hold a Spinlock.  Readers must
+ * only copy the values out: they can see them half written, and must not
+ * follow pointers read under the lock.
+ *
+ * Unlike Spinlock, SeqLock is active whether or not Click was compiled with
+ * --enable-multithread, since handlers and timers may also read values
+ * while a driver thread writes them.
+ *
+ * @sa ReadWriteLock
+ */
+class SeqLock { public:
+
+    inline SeqLock();
+
+    inline void write_begin();
+    inline void write_end();
+    inline unsigned read_begin() const;
+    inline bool read_retry(unsigned seq) const;
+
+  private:
+    volatile unsigned _seq;
+
+};
+
+/** @brief Creates a SeqLock. */
+inline
+SeqLock::SeqLock()
+    : _seq(0)
+{
+}
+
+/** @brief Starts an update of the protected values.
+ *
+ * The sequence number is odd until write_end().
+ */
+inline void
+SeqLock::write_begin()
+{
+    _seq = _seq + 1;
+    click_write_fence();
+}
+
+/** @brief Ends an update of the protected values. */
+inline void
+SeqLock::write_end()
+{
+    click_write_fence();
+    _seq = _seq + 1;
+}
+
+/** @brief Starts reading the protected values.
+ * @return The sequence number to pass to read_retry().
+ *
+ * Spins while an update is in progress.
+ */
+inline unsigned
+SeqLock::read_begin() const
+{
+    unsigned seq;
+    while ((seq = _seq) & 1)
+	click_relax_fence();
+    click_read_fence();
+    return seq;
+}
+
+/** @brief Checks the values read since read_begin().
+ * @param seq sequence number returned by read_begin()
+ * @return True iff the values changed meanwhile and must be read again.
+ */
+inline bool
+SeqLock::read_retry(unsigned seq) const
+{
+    click_read_fence();
+    return _seq != seq;
+}
+
 CLICK_ENDDECLS
 #undef SPINLOCK_ASSERTLEVEL
 #endif
@@ -274,6 +274,23 @@ class Task : private TaskLink { public:
      */
     void move_thread(int new_thread_id);
 
+    /** @brief Return true iff the task is pinned to its home thread.
+     *
+     * Work stealing never moves pinned tasks to another thread; see
+     * RouterThread::set_work_stealing(). */
+    inline bool pinned() const {
+        return _pinned;
+    }
+
+    /** @brief Pin the task to its home thread, or unpin it.
+     *
+     * Tasks whose element keeps thread-local state should be pinned, so
+     * that work stealing leaves them where they are. move_thread() still
+     * moves pinned tasks. */
+    inline void set_pinned(bool pinned) {
+        _pinned = pinned;
+    }
+
 
 #if HAVE_STRIDE_SCHED
     inline int tickets() const;
@@ -335,6 +352,7 @@ class Task : private TaskLink { public:
     RouterThread *_thread;
 
     Element *_owner;
+    bool _pinned;
 
     union Pending {
         Task *t;
@@ -393,7 +411,7 @@ Task::Task(TaskCallback f, void *user_data)
 #if HAVE_MULTITHREAD
       _cycle_runs(0),
 #endif
-      _thread(0), _owner(0)
+      _thread(0), _owner(0), _pinned(false)
 {
     _status.home_thread_id = -2;
     _status.is_scheduled = _status.is_strong_unscheduled = false;
@@ -416,7 +434,7 @@ Task::Task(Element* e)
 #if HAVE_MULTITHREAD
       _cycle_runs(0),
 #endif
-      _thread(0), _owner(0)
+      _thread(0), _owner(0), _pinned(false)
 {
     _status.home_thread_id = -2;
     _status.is_scheduled = _status.is_strong_unscheduled = false;
@@ -576,6 +594,14 @@ Task::fire()
     click_cycles_t start_cycles = click_get_cycles(),
         start_child_cycles = _owner->_child_cycles;
 #endif
+#if HAVE_CYCLE_ACCOUNTING
+    Element::CycleStats *cs = Element::cycle_accounting ? _owner->_cycle_stats : 0;
+    click_cycles_t start_cycles = 0, start_child_cycles = 0;
+    if (cs) {
+        start_cycles = click_get_cycles();
+        start_child_cycles = cs->child_cycles;
+    }
+#endif
 #if HAVE_MULTITHREAD
     _cycle_runs++;
 #endif
@@ -584,6 +610,11 @@ Task::fire()
         work_done = ((Element*)_thunk)->run_task(this);
     else
         work_done = _hook(this, _thunk);
+#if HAVE_CYCLE_ACCOUNTING
+    if (cs)
+        cs->account(Element::CycleStats::C_TASK, click_get_cycles() - start_cycles,
+                    start_child_cycles, 0);
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     ++_runs;
     _work_done += work_done;
@@ -0,0 +1,246 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/timerwheel.cc" -*-
+#ifndef CLICK_TIMERWHEEL_HH
+#define CLICK_TIMERWHEEL_HH 1
+#include <click/timer.hh>
+CLICK_DECLS
+class TimerWheel;
+class TimerWheelEntry;
+
+typedef void (*TimerWheelCallback)(TimerWheelEntry *entry, void *user_data);
+
+/** @file <click/timerwheel.hh>
+ * @brief Hierarchical timing wheel for large numbers of coarse timers.
+ */
+
+/** @class TimerWheelEntry
+  @brief A timer scheduled on a TimerWheel.
+
+  A TimerWheelEntry is linked into a slot of its wheel, so scheduling and
+  unscheduling it cost O(1) regardless of how many entries are pending. Its
+  callback runs in the tick its expiry falls in; entries expiring in the
+  same tick run in no particular order. */
+class TimerWheelEntry { public:
+
+    /** @brief Construct an entry that does nothing when fired. */
+    TimerWheelEntry()
+	: _next(0), _prev(0), _wheel(0), _expiry(0), _callback(0), _thunk(0) {
+    }
+
+    /** @brief Construct an entry that calls @a f(this, @a user_data) when
+     * fired. */
+    TimerWheelEntry(TimerWheelCallback f, void *user_data)
+	: _next(0), _prev(0), _wheel(0), _expiry(0), _callback(f),
+	  _thunk(user_data) {
+    }
+
+    /** @brief Destroy the entry, unscheduling it first if necessary. */
+    ~TimerWheelEntry() {
+	unschedule();
+    }
+
+    /** @brief Change the entry to call @a f(this, @a user_data) when
+     * fired. */
+    void assign(TimerWheelCallback f, void *user_data) {
+	_callback = f;
+	_thunk = user_data;
+    }
+
+    /** @brief Return true iff the entry is scheduled. */
+    bool scheduled() const {
+	return _next != 0;
+    }
+
+    /** @brief Return the wheel the entry was last scheduled on, if any. */
+    TimerWheel *wheel() const {
+	return _wheel;
+    }
+
+    /** @brief Return the user data passed to the callback. */
+    void *user_data() const {
+	return _thunk;
+    }
+
+    inline void schedule_now(TimerWheel *wheel);
+    inline void schedule_after_msec(TimerWheel *wheel, uint32_t delta_msec);
+    inline void schedule_after_msec(uint32_t delta_msec);
+
+    /** @brief Unschedule the entry.
+     *
+     * Does nothing if the entry is not scheduled. */
+    inline void unschedule();
+
+  private:
+
+    TimerWheelEntry *_next;
+    TimerWheelEntry *_prev;
+    TimerWheel *_wheel;
+    uint64_t _expiry;
+    TimerWheelCallback _callback;
+    void *_thunk;
+
+    TimerWheelEntry(const TimerWheelEntry &x);
+    TimerWheelEntry &operator=(const TimerWheelEntry &x);
+
+    friend class TimerWheel;
+
+};
+
+/** @class TimerWheel
+  @brief Hierarchical timing wheel.
+
+  A TimerWheel keeps TimerWheelEntry objects in LEVELS wheels of
+  LEVEL_SIZE slots each. Level 0 slots are one tick wide, each slot of
+  level l covers LEVEL_SIZE times the span of a slot of level l - 1. An
+  entry goes to the lowest level whose span reaches its expiry, and moves
+  down a level each time the wheel below completes a turn, so inserting
+  and canceling are O(1) and each entry is moved at most LEVELS - 1 times.
+  Delays longer than the span of the whole wheel are cut to that span.
+
+  The price is precision: expiries are rounded up to the next tick and
+  entries due in the same tick fire in no particular order. This suits
+  many coarse per-object timers, such as periodic reports or idle
+  timeouts, that would otherwise each sit in the router's timer heap.
+
+  The wheel is driven by a single Timer owned by an element, scheduled
+  only while entries are pending. Callbacks run from that Timer, in the
+  thread of the owner, and may schedule or unschedule any entry of the
+  wheel, including themselves. */
+class TimerWheel { public:
+
+    enum {
+	LEVEL_BITS = 6,
+	LEVEL_SIZE = 1 << LEVEL_BITS,
+	LEVEL_MASK = LEVEL_SIZE - 1,
+	LEVELS = 4
+    };
+
+    /** @brief Construct a wheel with 1 millisecond ticks.
+     *
+     * The wheel must be initialized before entries are scheduled. */
+    TimerWheel();
+
+    /** @brief Destroy the wheel, unscheduling its entries. */
+    ~TimerWheel();
+
+    /** @brief Initialize the wheel.
+     * @param owner the element owning the driving Timer
+     * @param tick_msec tick length in milliseconds, at least 1 */
+    void initialize(Element *owner, uint32_t tick_msec = 1);
+
+    /** @brief Return true iff the wheel has been initialized. */
+    bool initialized() const {
+	return _timer.initialized();
+    }
+
+    /** @brief Return the tick length in milliseconds. */
+    uint32_t tick_msec() const {
+	return _tick_msec;
+    }
+
+    /** @brief Return the number of scheduled entries. */
+    uint32_t size() const {
+	return _size;
+    }
+
+    /** @brief Return the longest delay, in ticks, an entry can wait. */
+    static uint64_t max_delay_ticks() {
+	return ((uint64_t) 1 << (LEVEL_BITS * LEVELS)) - 1;
+    }
+
+    /** @brief Schedule @a e to fire in the next tick. */
+    void schedule_now(TimerWheelEntry *e) {
+	schedule_at_tick(e, _tick);
+    }
+
+    /** @brief Schedule @a e to fire @a delta_msec milliseconds from now.
+     *
+     * The delay is rounded up to a whole number of ticks. */
+    void schedule_after_msec(TimerWheelEntry *e, uint32_t delta_msec);
+
+    /** @brief Unschedule @a e. */
+    void unschedule(TimerWheelEntry *e) {
+	e->unschedule();
+    }
+
+    /** @brief Unschedule every entry. */
+    void clear();
+
+  private:
+
+    TimerWheelEntry _slots[LEVELS][LEVEL_SIZE];
+    uint64_t _tick;
+    Timestamp _epoch;
+    uint32_t _tick_msec;
+    uint32_t _size;
+    Timer _timer;
+
+    static void link(TimerWheelEntry *head, TimerWheelEntry *e) {
+	e->_next = head->_next;
+	e->_prev = head;
+	head->_next->_prev = e;
+	head->_next = e;
+    }
+
+    static void unlink(TimerWheelEntry *e) {
+	e->_prev->_next = e->_next;
+	e->_next->_prev = e->_prev;
+	e->_next = e->_prev = 0;
+    }
+
+    static void splice(TimerWheelEntry *head, TimerWheelEntry *to);
+
+    uint64_t now_tick() const;
+    Timestamp tick_time(uint64_t tick) const {
+	return _epoch + Timestamp::make_msec((Timestamp::value_type) (tick * _tick_msec));
+    }
+    void place(TimerWheelEntry *e);
+    void schedule_at_tick(TimerWheelEntry *e, uint64_t expiry);
+    void cascade(int level);
+    void run_tick();
+    void reschedule();
+
+    static void timer_hook(Timer *timer, void *user_data);
+
+    TimerWheel(const TimerWheel &x);
+    TimerWheel &operator=(const TimerWheel &x);
+
+    friend class TimerWheelEntry;
+
+};
+
+/** @brief Schedule the entry on @a wheel to fire in the next tick. */
+inline void
+TimerWheelEntry::schedule_now(TimerWheel *wheel)
+{
+    wheel->schedule_now(this);
+}
+
+/** @brief Schedule the entry on @a wheel to fire @a delta_msec milliseconds
+ * from now. */
+inline void
+TimerWheelEntry::schedule_after_msec(TimerWheel *wheel, uint32_t delta_msec)
+{
+    wheel->schedule_after_msec(this, delta_msec);
+}
+
+/** @brief Schedule the entry @a delta_msec milliseconds from now on the
+ * wheel it was last scheduled on.
+ * @pre wheel() != 0 */
+inline void
+TimerWheelEntry::schedule_after_msec(uint32_t delta_msec)
+{
+    assert(_wheel);
+    _wheel->schedule_after_msec(this, delta_msec);
+}
+
+inline void
+TimerWheelEntry::unschedule()
+{
+    if (_next) {
+	TimerWheel::unlink(this);
+	_wheel->_size--;
+    }
+}
+
+CLICK_ENDDECLS
+#endif
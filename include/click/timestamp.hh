@@ -486,6 +486,18 @@ class Timestamp { public:
      * @sa recent_steady(), assign_now_steady() */
     inline void assign_recent_steady();
 
+#if CLICK_USERLEVEL
+    /** @brief Refresh the times returned by recent() and recent_steady()
+     * on the calling thread.
+     *
+     * At user level recent() and recent_steady() return the times of the
+     * last refresh on the calling thread, so per-packet timestamps cost a
+     * memory read instead of a clock call. RouterThread refreshes them
+     * once per scheduling iteration. Threads that never refresh get the
+     * current time. */
+    static void refresh_recent();
+#endif
+
 
     /** @brief Unparse this timestamp into a String.
      *
@@ -754,6 +766,20 @@ inline Timestamp Timestamp::warped(bool steady) const {
 }
 #endif
 
+#if CLICK_USERLEVEL
+/** @cond never */
+struct TimestampRecent {
+    Timestamp::seconds_type sec[2];	// system, steady
+    uint32_t subsec[2];
+};
+# if HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+extern __thread TimestampRecent timestamp_recent;
+# else
+extern TimestampRecent timestamp_recent;
+# endif
+/** @endcond never */
+#endif
+
 
 /** @brief Create a Timestamp measuring @a tv.
     @param tv timeval structure */
@@ -789,6 +815,14 @@ Timestamp::assign_now(bool recent, bool steady, bool unwarped)
 {
     (void) recent, (void) steady, (void) unwarped;
 
+#if CLICK_USERLEVEL
+    // refresh_recent() stores warped times
+    if (recent && timestamp_recent.sec[steady]) {
+        assign(timestamp_recent.sec[steady], timestamp_recent.subsec[steady]);
+        return;
+    }
+#endif
+
 #if TIMESTAMP_PUNS_TIMESPEC
 # define TIMESTAMP_DECLARE_TSP struct timespec &tsp = _t.tspec
 # define TIMESTAMP_RESOLVE_TSP /* nothing */
@@ -336,11 +336,13 @@ struct click_wifi_wmm {
  * AMSDU subframe header
  */
 struct click_wifi_amsdu_subframe_header {
-    uint8_t		sa[6];		/* 0-5   Ethernet destination address */
-    uint8_t		da[6];		/* 6-11  Ethernet source address      */
-	uint8_t		len;
+	uint8_t		da[6];		/* 0-5   Ethernet destination address */
+	uint8_t		sa[6];		/* 6-11  Ethernet source address      */
+	uint16_t	len;		/* 12-13 MSDU length, network order   */
 } CLICK_SIZE_PACKED_ATTRIBUTE;
 
+#define WIFI_QOS_CONTROL_AMSDU_PRESENT	0x0080
+
 #define WIFI_RATES_MAXSIZE	15
 #define WIFI_NWID_MAXSIZE	32
 
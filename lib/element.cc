@@ -31,6 +31,7 @@
 #include <click/master.hh>
 #include <click/straccum.hh>
 #include <click/etheraddress.hh>
+#include <click/integers.hh>
 #if CLICK_DEBUG_SCHEDULING
 # include <click/notifier.hh>
 #endif
@@ -426,11 +427,17 @@ Element::Element()
 #if CLICK_STATS >= 2
     reset_cycles();
 #endif
+#if HAVE_CYCLE_ACCOUNTING
+    _cycle_stats = 0;
+#endif
 }
 
 Element::~Element()
 {
     nelements_allocated--;
+#if HAVE_CYCLE_ACCOUNTING
+    delete _cycle_stats;
+#endif
     if (_ports[0] < _inline_ports || _ports[0] > _inline_ports + INLINE_PORTS)
 	delete[] _ports[0];
     if (_ports[1] < _inline_ports || _ports[1] > _inline_ports + INLINE_PORTS)
@@ -2089,6 +2096,142 @@ Element::write_cycles_handler(const String &, Element *e, void *, ErrorHandler *
 }
 #endif
 
+#if HAVE_CYCLE_ACCOUNTING
+bool Element::cycle_accounting;
+
+void
+Element::CycleStats::account(int kind, click_cycles_t all_delta,
+                             click_cycles_t start_child_cycles, unsigned npackets)
+{
+    click_cycles_t own_delta = all_delta - (child_cycles - start_child_cycles);
+    calls[kind] += 1;
+    packets[kind] += npackets;
+    cycles[kind] += own_delta;
+    // bucket b counts calls of 2^b to 2^(b+1) - 1 own cycles
+    int bucket = own_delta ? 64 - ffs_msb((uint64_t) own_delta) : 0;
+    if (bucket >= NBUCKETS)
+        bucket = NBUCKETS - 1;
+    latency[bucket] += 1;
+}
+
+void
+Element::Port::push_accounted(Packet *p) const
+{
+    CycleStats *cs = _e->_cycle_stats;
+    if (!cs) {
+# if HAVE_BOUND_PORT_TRANSFER
+        _bound.push(_e, _port, p);
+# else
+        _e->push(_port, p);
+# endif
+        return;
+    }
+    click_cycles_t start_cycles = click_get_cycles(),
+        start_child_cycles = cs->child_cycles;
+# if HAVE_BOUND_PORT_TRANSFER
+    _bound.push(_e, _port, p);
+# else
+    _e->push(_port, p);
+# endif
+    click_cycles_t all_delta = click_get_cycles() - start_cycles;
+    cs->account(CycleStats::C_PUSH, all_delta, start_child_cycles, 1);
+    if (_owner && _owner->_cycle_stats)
+        _owner->_cycle_stats->child_cycles += all_delta;
+}
+
+Packet *
+Element::Port::pull_accounted() const
+{
+    CycleStats *cs = _e->_cycle_stats;
+    if (!cs) {
+# if HAVE_BOUND_PORT_TRANSFER
+        return _bound.pull(_e, _port);
+# else
+        return _e->pull(_port);
+# endif
+    }
+    click_cycles_t start_cycles = click_get_cycles(),
+        start_child_cycles = cs->child_cycles;
+# if HAVE_BOUND_PORT_TRANSFER
+    Packet *p = _bound.pull(_e, _port);
+# else
+    Packet *p = _e->pull(_port);
+# endif
+    click_cycles_t all_delta = click_get_cycles() - start_cycles;
+    cs->account(CycleStats::C_PULL, all_delta, start_child_cycles, p ? 1 : 0);
+    if (_owner && _owner->_cycle_stats)
+        _owner->_cycle_stats->child_cycles += all_delta;
+    return p;
+}
+
+/** @brief Turn cycle accounting on or off.
+ *
+ * Accounting is global, but only elements with statistics are accounted.
+ * Turning it on gives statistics to the elements of @a router that have
+ * none; elements keep their statistics when it is turned off, so they can
+ * still be read. */
+void
+Element::set_cycle_accounting(Router *router, bool on)
+{
+    if (on && router)
+        for (int i = 0; i < router->nelements(); i++) {
+            Element *e = router->element(i);
+            if (!e->_cycle_stats)
+                e->_cycle_stats = new CycleStats;
+        }
+    cycle_accounting = on;
+}
+
+/** @brief Return the packets and own cycles accounted to this element.
+ * @param[out] packets packets pushed into or pulled from the element
+ * @param[out] cycles cycles spent in the element's push(), pull() and
+ * run_task(), excluding those spent downstream
+ * @return true iff the element has cycle statistics
+ *
+ * The totals are those reported by the "cycles" handler. */
+bool
+Element::cycle_totals(uint64_t &packets, click_cycles_t &cycles) const
+{
+    packets = 0;
+    cycles = 0;
+    if (!_cycle_stats)
+        return false;
+    for (int k = 0; k < CycleStats::C_NKINDS; k++) {
+        if (k != CycleStats::C_TASK)
+            packets += _cycle_stats->packets[k];
+        cycles += _cycle_stats->cycles[k];
+    }
+    return true;
+}
+
+String
+Element::read_cycles_handler(Element *e, void *)
+{
+    static const char * const kind_names[] = { "push", "pull", "task" };
+    StringAccum sa;
+    CycleStats *cs = e->_cycle_stats;
+    if (!cs)
+        return String();
+    for (int k = 0; k < CycleStats::C_NKINDS; k++)
+        if (cs->calls[k])
+            sa << kind_names[k] << ' ' << cs->calls[k] << ' '
+               << cs->packets[k] << ' ' << cs->cycles[k] << '\n';
+    for (int b = 0; b < CycleStats::NBUCKETS; b++)
+        if (cs->latency[b])
+            sa << "latency " << (b ? (click_cycles_t) 1 << b : 0) << ' '
+               << cs->latency[b] << '\n';
+    return sa.take_string();
+}
+
+int
+Element::write_cycles_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    if (e->_cycle_stats)
+        e->_cycle_stats->clear();
+    return 0;
+}
+#endif
+
 void
 Element::add_default_handlers(bool allow_write_config)
 {
@@ -2107,6 +2250,13 @@ Element::add_default_handlers(bool allow_write_config)
   add_write_handler("cycles", write_cycles_handler, 0);
 # endif
 #endif
+#if HAVE_CYCLE_ACCOUNTING
+  // elements of routers installed while accounting is on get accounted too
+  if (cycle_accounting && !_cycle_stats)
+      _cycle_stats = new CycleStats;
+  add_read_handler("cycles", read_cycles_handler, 0);
+  add_write_handler("cycles", write_cycles_handler, 0, Handler::f_button);
+#endif
 }
 
 #if HAVE_STRIDE_SCHED
@@ -2971,6 +3121,102 @@ Element::simple_action(Packet *p)
     return p;
 }
 
+/** @brief Push a list of packets onto push input @a port.
+ *
+ * @param port the input port number on which the packets arrive
+ * @param head first packet of a non-empty list linked through
+ * Packet::next()
+ *
+ * An upstream element transferred a burst of packets to this element with
+ * Element::Port::push_batch().  push_batch() must account for every packet
+ * of the list, as push() does for a single packet.  Elements that handle a
+ * burst more cheaply than its packets one by one -- one virtual call, one
+ * lock, one wakeup per burst -- should override it, passing on the packets
+ * they emit with output(i).push_batch() so the burst stays together
+ * downstream.  PacketBatch helps build the output lists.
+ *
+ * The default implementation unlinks the packets and calls push() for each
+ * of them, in order.
+ *
+ * @sa simple_action_push_batch()
+ */
+void
+Element::push_batch(int port, Packet *head)
+{
+    while (Packet *p = PacketBatch::pop(head))
+	push(port, p);
+}
+
+/** @brief Pull up to @a max packets from pull output @a port.
+ *
+ * @param port the output port number receiving the pull request
+ * @param max the maximum number of packets to return
+ * @return a list of packets linked through Packet::next(), or null
+ *
+ * A downstream element asked for a burst of packets with
+ * Element::Port::pull_batch().  Queues and schedulers should override it to
+ * dequeue a burst at once; elements in between can pass the request
+ * upstream with input(i).pull_batch().
+ *
+ * The default implementation calls pull() until it returns null or @a max
+ * packets have been pulled.
+ *
+ * @sa simple_action_pull_batch()
+ */
+Packet *
+Element::pull_batch(int port, unsigned max)
+{
+    PacketBatch batch;
+    while (batch.count() < max) {
+	Packet *p = pull(port);
+	if (!p)
+	    break;
+	batch.append(p);
+    }
+    return batch.take();
+}
+
+/** @brief Batch implementation of push() for simple_action() elements.
+ *
+ * Runs simple_action() on every packet of the list @a head and pushes the
+ * packets it returns to output @a port as one batch.  An element that
+ * implements its processing with simple_action() and wants bursts to go
+ * through it unbroken overrides push_batch() as follows:
+ *
+ * @code
+ * void push_batch(int port, Packet *head) {
+ *     simple_action_push_batch(port, head);
+ * }
+ * @endcode
+ */
+void
+Element::simple_action_push_batch(int port, Packet *head)
+{
+    PacketBatch out;
+    while (Packet *p = PacketBatch::pop(head))
+	if ((p = simple_action(p)))
+	    out.append(p);
+    if (!out.empty())
+	output(port).push_batch(out.take());
+}
+
+/** @brief Batch implementation of pull() for simple_action() elements.
+ *
+ * Pulls up to @a max packets from input @a port with one call, runs
+ * simple_action() on each of them, and returns the packets it kept.  See
+ * simple_action_push_batch().
+ */
+Packet *
+Element::simple_action_pull_batch(int port, unsigned max)
+{
+    Packet *head = input(port).pull_batch(max);
+    PacketBatch out;
+    while (Packet *p = PacketBatch::pop(head))
+	if ((p = simple_action(p)))
+	    out.append(p);
+    return out.take();
+}
+
 /** @brief Run the element's task.
  *
  * @return true if the task accomplished some meaningful work, false otherwise
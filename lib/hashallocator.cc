@@ -20,10 +20,13 @@
 #include <click/glue.hh>
 #include <click/hashallocator.hh>
 #include <click/integers.hh>
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+#endif
 CLICK_DECLS
 
 HashAllocator::HashAllocator(size_t size)
-    : _free(0), _buffer(0), _size(size)
+    : _free(0), _buffer(0), _size(size), _align(1), _hugepages(false)
 {
 #ifdef VALGRIND_CREATE_MEMPOOL
     VALGRIND_CREATE_MEMPOOL(this, 0, 0);
@@ -34,7 +37,12 @@ HashAllocator::~HashAllocator()
 {
     while (buffer *b = _buffer) {
 	_buffer = b->next;
-	delete[] reinterpret_cast<char *>(b);
+#if CLICK_USERLEVEL
+	if (b->mapped)
+	    munmap(b, hugepage_size);
+	else
+#endif
+	    delete[] reinterpret_cast<char *>(b);
     }
 #ifdef VALGRIND_DESTROY_MEMPOOL
     VALGRIND_DESTROY_MEMPOOL(this);
@@ -57,13 +65,31 @@ void *HashAllocator::hard_allocate()
     if (nelements < min_nelements)
 	nelements = min_nelements;
 
-    buffer *b = reinterpret_cast<buffer *>(new char[sizeof(buffer) + _size * nelements]);
+    buffer *b = 0;
+    bool mapped = false;
+#if CLICK_USERLEVEL && defined(MAP_HUGETLB)
+    if (_hugepages && _size <= hugepage_size - sizeof(buffer) - (_align - 1)) {
+	void *m = mmap(0, hugepage_size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (m != MAP_FAILED) {
+	    b = reinterpret_cast<buffer *>(m);
+	    mapped = true;
+	    nelements = (hugepage_size - sizeof(buffer) - (_align - 1)) / _size;
+	}
+    }
+#endif
+    // room to align the first element, the others follow at _size apart
+    if (!b)
+	b = reinterpret_cast<buffer *>(new char[sizeof(buffer) + _align - 1 + _size * nelements]);
     if (b) {
+	uintptr_t first = reinterpret_cast<uintptr_t>(b) + sizeof(buffer);
+	first = ((first + _align - 1) & ~(uintptr_t) (_align - 1)) - reinterpret_cast<uintptr_t>(b);
+	b->mapped = mapped;
 	b->next = _buffer;
 	_buffer = b;
-	b->maxpos = sizeof(buffer) + _size * nelements;
-	b->pos = sizeof(buffer) + _size;
-	void *data = reinterpret_cast<char *>(_buffer) + sizeof(buffer);
+	b->maxpos = first + _size * nelements;
+	b->pos = first + _size;
+	void *data = reinterpret_cast<char *>(_buffer) + first;
 #ifdef VALGRIND_MEMPOOL_ALLOC
 	VALGRIND_MEMPOOL_ALLOC(this, data, _size);
 #endif
@@ -86,6 +112,14 @@ void HashAllocator::swap(HashAllocator &x)
     _buffer = x._buffer;
     x._buffer = xbuffer;
 
+    size_t xalign = _align;
+    _align = x._align;
+    x._align = xalign;
+
+    bool xhugepages = _hugepages;
+    _hugepages = x._hugepages;
+    x._hugepages = xhugepages;
+
 #ifdef VALGRIND_MOVE_MEMPOOL
     VALGRIND_MOVE_MEMPOOL(this, reinterpret_cast<HashAllocator *>(100));
     VALGRIND_MOVE_MEMPOOL(&x, this);
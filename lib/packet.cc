@@ -27,6 +27,9 @@
 #if CLICK_USERLEVEL || CLICK_MINIOS
 # include <unistd.h>
 #endif
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+#endif
 CLICK_DECLS
 
 /** @file packet.hh
@@ -233,10 +236,17 @@ Packet::~Packet()
 // pre-initialized Packet objects, either with or without data, for fast
 // reuse. It can support multithreaded deployments: each thread has its own
 // pool, with a global pool to even out imbalance.
+//
+// Data buffers come in a few size classes with separate lists. Buffers
+// reserved by Packet::pool_reserve() are carved out of large arenas,
+// possibly backed by hugepages. They are never returned to the heap: when
+// the global pool is full they wait on a global overflow list instead.
 
 #  define CLICK_PACKET_POOL_BUFSIZ		2048
 #  define CLICK_PACKET_POOL_SIZE		1000 // see LIMIT in packetpool-01.testie
 #  define CLICK_GLOBAL_PACKET_POOL_COUNT	16
+#  define CLICK_PACKET_POOL_NCLASSES		3
+#  define CLICK_PACKET_POOL_NARENAS		16
 
 namespace {
 struct PacketData {
@@ -250,12 +260,58 @@ struct PacketData {
 struct PacketPool {
     WritablePacket* p;          // free packets, linked by p->next()
     unsigned pcount;            // # packets in `p` list
-    PacketData* pd;             // free data buffers, linked by pd->next
-    unsigned pdcount;           // # buffers in `pd` list
+    PacketData* pd[CLICK_PACKET_POOL_NCLASSES]; // free data buffers, linked
+                                //   by pd->next, per size class
+    unsigned pdcount[CLICK_PACKET_POOL_NCLASSES]; // # buffers in `pd` lists
+    uint64_t hits[CLICK_PACKET_POOL_NCLASSES];   // buffers taken from `pd`
+    uint64_t misses[CLICK_PACKET_POOL_NCLASSES]; // buffers allocated anew
+    uint64_t frees[CLICK_PACKET_POOL_NCLASSES];  // buffers freed on overflow
 #  if HAVE_MULTITHREAD
     PacketPool* thread_pool_next; // link to next per-thread pool
 #  endif
 };
+
+struct PacketArena {
+    unsigned char* start;
+    unsigned char* end;
+    size_t mapped;              // mmap()ed length, 0 if allocated by new[]
+};
+
+struct PacketReserve {
+    PacketData* spare[CLICK_PACKET_POOL_NCLASSES]; // overflow lists of
+                                //   reserved buffers, linked by pd->next
+    unsigned sparecount[CLICK_PACKET_POOL_NCLASSES];
+    unsigned reserved[CLICK_PACKET_POOL_NCLASSES]; // # reserved buffers
+    bool hugepages[CLICK_PACKET_POOL_NCLASSES];
+    PacketArena arena[CLICK_PACKET_POOL_NARENAS];
+    int narenas;
+};
+}
+
+// buffer length of each size class, and # free buffers a pool keeps
+static const uint32_t packet_pool_bufsiz[CLICK_PACKET_POOL_NCLASSES] = {
+    CLICK_PACKET_POOL_BUFSIZ, 9216, 65536
+};
+static const unsigned packet_pool_size[CLICK_PACKET_POOL_NCLASSES] = {
+    CLICK_PACKET_POOL_SIZE, 256, 32
+};
+
+/** @brief Return the smallest size class whose buffers hold @a n bytes,
+    or -1 if there is none. */
+static inline int packet_pool_fit(uint32_t n) {
+    for (int c = 0; c < CLICK_PACKET_POOL_NCLASSES; ++c)
+	if (n <= packet_pool_bufsiz[c])
+	    return c;
+    return -1;
+}
+
+/** @brief Return the size class of @a n byte buffers, or -1 if there is
+    none. */
+static inline int packet_pool_class(uint32_t n) {
+    for (int c = 0; c < CLICK_PACKET_POOL_NCLASSES; ++c)
+	if (n == packet_pool_bufsiz[c])
+	    return c;
+    return -1;
 }
 
 #  if HAVE_MULTITHREAD
@@ -265,8 +321,10 @@ struct GlobalPacketPool {
     WritablePacket* pbatch;     // batches of free packets, linked by p->prev()
                                 //   p->anno_u32(0) is # packets in batch
     unsigned pbatchcount;       // # batches in `pbatch` list
-    PacketData* pdbatch;        // batches of free data buffers
-    unsigned pdbatchcount;      // # batches in `pdbatch` list
+    PacketData* pdbatch[CLICK_PACKET_POOL_NCLASSES]; // batches of free data
+                                //   buffers, per size class
+    unsigned pdbatchcount[CLICK_PACKET_POOL_NCLASSES]; // # batches in
+                                //   `pdbatch` lists
 
     PacketPool* thread_pools;   // all thread packet pools
     volatile uint32_t lock;
@@ -276,6 +334,23 @@ static GlobalPacketPool global_packet_pool;
 static PacketPool global_packet_pool;
 #  endif
 
+// protected by the global packet pool lock
+static PacketReserve packet_reserve;
+
+static inline void lock_global_packet_pool() {
+#  if HAVE_MULTITHREAD
+    while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
+	/* do nothing */;
+#  endif
+}
+
+static inline void unlock_global_packet_pool() {
+#  if HAVE_MULTITHREAD
+    click_compiler_fence();
+    global_packet_pool.lock = 0;
+#  endif
+}
+
 /** @brief Return the local packet pool for this thread.
     @pre make_local_packet_pool() has succeeded on this thread. */
 static inline PacketPool& local_packet_pool() {
@@ -293,13 +368,11 @@ static inline PacketPool* make_local_packet_pool() {
     PacketPool *pp = thread_packet_pool;
     if (!pp && (pp = new PacketPool)) {
 	memset(pp, 0, sizeof(PacketPool));
-	while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
-	    /* do nothing */;
+	lock_global_packet_pool();
 	pp->thread_pool_next = global_packet_pool.thread_pools;
 	global_packet_pool.thread_pools = pp;
 	thread_packet_pool = pp;
-	click_compiler_fence();
-	global_packet_pool.lock = 0;
+	unlock_global_packet_pool();
     }
     return pp;
 #  else
@@ -307,20 +380,147 @@ static inline PacketPool* make_local_packet_pool() {
 #  endif
 }
 
+/** @brief Return true iff @a pd was carved out of a reserved arena. */
+static bool packet_data_reserved(const PacketData *pd) {
+    const unsigned char *x = reinterpret_cast<const unsigned char *>(pd);
+    for (int i = 0; i < packet_reserve.narenas; ++i)
+	if (x >= packet_reserve.arena[i].start
+	    && x < packet_reserve.arena[i].end)
+	    return true;
+    return false;
+}
+
+/** @brief Free the class @a c data buffers listed from @a pd.
+    @return # buffers returned to the heap
+    @pre The global packet pool lock is held.
+
+    Reserved buffers go to the overflow list instead. */
+static unsigned free_packet_data(PacketData *pd, int c) {
+    unsigned n = 0;
+    while (pd) {
+	PacketData *next = pd->next;
+	if (packet_data_reserved(pd)) {
+	    pd->next = packet_reserve.spare[c];
+	    packet_reserve.spare[c] = pd;
+	    ++packet_reserve.sparecount[c];
+	} else {
+	    delete[] reinterpret_cast<unsigned char *>(pd);
+	    ++n;
+	}
+	pd = next;
+    }
+    return n;
+}
+
+/** @brief Return true iff the global pool has class @a c data to hand out. */
+static inline bool global_packet_data(int c) {
+    return
+#  if HAVE_MULTITHREAD
+	global_packet_pool.pdbatch[c] ||
+#  endif
+	packet_reserve.spare[c];
+}
+
+/** @brief Refill @a pp's empty class @a c list from the global pool.
+    @pre The global packet pool lock is held. */
+static void refill_packet_data(PacketPool &pp, int c) {
+    PacketData *pd;
+#  if HAVE_MULTITHREAD
+    if ((pd = global_packet_pool.pdbatch[c])) {
+	global_packet_pool.pdbatch[c] = pd->batch_next;
+	--global_packet_pool.pdbatchcount[c];
+	pp.pd[c] = pd;
+	pp.pdcount[c] = pd->batch_pdcount;
+	return;
+    }
+#  endif
+    while (pp.pdcount[c] < packet_pool_size[c]
+	   && (pd = packet_reserve.spare[c])) {
+	packet_reserve.spare[c] = pd->next;
+	--packet_reserve.sparecount[c];
+	pd->next = pp.pd[c];
+	pp.pd[c] = pd;
+	++pp.pdcount[c];
+    }
+}
+
+/** @brief Return a class @a c data buffer of @a n bytes, preferably from
+    @a pp. */
+static inline unsigned char *allocate_packet_data(PacketPool &pp, int c,
+						  uint32_t n) {
+    if (c >= 0) {
+	if (PacketData *pd = pp.pd[c]) {
+	    pp.pd[c] = pd->next;
+	    --pp.pdcount[c];
+	    ++pp.hits[c];
+	    return reinterpret_cast<unsigned char *>(pd);
+	}
+	++pp.misses[c];
+    }
+    return new unsigned char[n];
+}
+
+/** @brief Return the class @a c data buffer @a data to @a pp. */
+static void recycle_packet_data(PacketPool &pp, unsigned char *data, int c) {
+    if (pp.pdcount[c] == packet_pool_size[c]) {
+	lock_global_packet_pool();
+#  if HAVE_MULTITHREAD
+	if (global_packet_pool.pdbatchcount[c] == CLICK_GLOBAL_PACKET_POOL_COUNT)
+	    pp.frees[c] += free_packet_data(pp.pd[c], c);
+	else {
+	    pp.pd[c]->batch_next = global_packet_pool.pdbatch[c];
+	    pp.pd[c]->batch_pdcount = pp.pdcount[c];
+	    global_packet_pool.pdbatch[c] = pp.pd[c];
+	    ++global_packet_pool.pdbatchcount[c];
+	}
+	pp.pd[c] = 0;
+	pp.pdcount[c] = 0;
+#  else
+	PacketData *pd = reinterpret_cast<PacketData *>(data);
+	pd->next = 0;
+	pp.frees[c] += free_packet_data(pd, c);
+	data = 0;
+#  endif
+	unlock_global_packet_pool();
+    }
+
+    if (data) {
+	++pp.pdcount[c];
+	PacketData *pd = reinterpret_cast<PacketData *>(data);
+	pd->next = pp.pd[c];
+	pp.pd[c] = pd;
+	assert(pp.pdcount[c] <= packet_pool_size[c]);
+    }
+}
+
+/** @brief Free the data buffer @a data of @a n bytes, keeping it in the
+    local pool if it belongs to a size class. */
+static void free_data(unsigned char *data, uint32_t n) {
+    int c = packet_pool_class(n);
+    if (c >= 0)
+	recycle_packet_data(*make_local_packet_pool(), data, c);
+    else
+	delete[] data;
+}
+
 WritablePacket *
-WritablePacket::pool_allocate(bool with_data)
+WritablePacket::pool_allocate(int size_class)
 {
     PacketPool& packet_pool = *make_local_packet_pool();
-    (void) with_data;
 
-#  if HAVE_MULTITHREAD
     // Steal packets and/or data from the global pool if there's nothing on
     // the local pool.
-    if ((!packet_pool.p && global_packet_pool.pbatch)
-	|| (with_data && !packet_pool.pd && global_packet_pool.pdbatch)) {
-	while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
-	    /* do nothing */;
+    bool need_data = size_class >= 0 && !packet_pool.pd[size_class]
+	&& global_packet_data(size_class);
+#  if HAVE_MULTITHREAD
+    bool need_packets = !packet_pool.p && global_packet_pool.pbatch;
+#  else
+    bool need_packets = false;
+#  endif
+    if (need_packets || need_data) {
+	lock_global_packet_pool();
 
+#  if HAVE_MULTITHREAD
 	WritablePacket *pp;
 	if (!packet_pool.p && (pp = global_packet_pool.pbatch)) {
 	    global_packet_pool.pbatch = static_cast<WritablePacket *>(pp->prev());
@@ -328,19 +528,13 @@ WritablePacket::pool_allocate(bool with_data)
 	    packet_pool.p = pp;
 	    packet_pool.pcount = pp->anno_u32(0);
 	}
+#  endif
 
-	PacketData *pd;
-	if (with_data && !packet_pool.pd && (pd = global_packet_pool.pdbatch)) {
-	    global_packet_pool.pdbatch = pd->batch_next;
-	    --global_packet_pool.pdbatchcount;
-	    packet_pool.pd = pd;
-	    packet_pool.pdcount = pd->batch_pdcount;
-	}
+	if (need_data && !packet_pool.pd[size_class])
+	    refill_packet_data(packet_pool, size_class);
 
-	click_compiler_fence();
-	global_packet_pool.lock = 0;
+	unlock_global_packet_pool();
     }
-#  endif /* HAVE_MULTITHREAD */
 
     WritablePacket *p = packet_pool.p;
     if (p) {
@@ -358,18 +552,13 @@ WritablePacket::pool_allocate(uint32_t headroom, uint32_t length,
     uint32_t n = headroom + length + tailroom;
     if (n < CLICK_PACKET_POOL_BUFSIZ)
 	n = CLICK_PACKET_POOL_BUFSIZ;
-    WritablePacket *p = pool_allocate(n == CLICK_PACKET_POOL_BUFSIZ);
+    int c = packet_pool_fit(n);
+    if (c >= 0)
+	n = packet_pool_bufsiz[c];
+    WritablePacket *p = pool_allocate(c);
     if (p) {
 	p->initialize();
-	PacketData *pd;
-	PacketPool& packet_pool = local_packet_pool();
-	if (n == CLICK_PACKET_POOL_BUFSIZ && (pd = packet_pool.pd)) {
-	    packet_pool.pd = pd->next;
-	    --packet_pool.pdcount;
-	    p->_head = reinterpret_cast<unsigned char *>(pd);
-	} else if ((p->_head = new unsigned char[n]))
-	    /* OK */;
-	else {
+	if (!(p->_head = allocate_packet_data(local_packet_pool(), c, n))) {
 	    delete p;
 	    return 0;
 	}
@@ -384,8 +573,9 @@ void
 WritablePacket::recycle(WritablePacket *p)
 {
     unsigned char *data = 0;
+    int c = -1;
     if (!p->_data_packet && p->_head && !p->_destructor
-	&& p->_end - p->_head == CLICK_PACKET_POOL_BUFSIZ) {
+	&& (c = packet_pool_class(p->_end - p->_head)) >= 0) {
 	data = p->_head;
 	p->_head = 0;
     }
@@ -393,55 +583,28 @@ WritablePacket::recycle(WritablePacket *p)
 
     PacketPool& packet_pool = *make_local_packet_pool();
 #  if HAVE_MULTITHREAD
-    if ((packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE)
-	|| (data && packet_pool.pd && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE)) {
-	while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
-	    /* do nothing */;
-
-	if (packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
-	    if (global_packet_pool.pbatchcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
-		while (WritablePacket *p = packet_pool.p) {
-		    packet_pool.p = static_cast<WritablePacket *>(p->next());
-		    ::operator delete((void *) p);
-		}
-	    } else {
-		packet_pool.p->set_prev(global_packet_pool.pbatch);
-                packet_pool.p->set_anno_u32(0, packet_pool.pcount);
-		global_packet_pool.pbatch = packet_pool.p;
-		++global_packet_pool.pbatchcount;
-		packet_pool.p = 0;
+    if (packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
+	lock_global_packet_pool();
+	if (global_packet_pool.pbatchcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
+	    while (WritablePacket *p = packet_pool.p) {
+		packet_pool.p = static_cast<WritablePacket *>(p->next());
+		::operator delete((void *) p);
 	    }
-	    packet_pool.pcount = 0;
+	} else {
+	    packet_pool.p->set_prev(global_packet_pool.pbatch);
+	    packet_pool.p->set_anno_u32(0, packet_pool.pcount);
+	    global_packet_pool.pbatch = packet_pool.p;
+	    ++global_packet_pool.pbatchcount;
+	    packet_pool.p = 0;
 	}
-
-	if (data && packet_pool.pd && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
-	    if (global_packet_pool.pdbatchcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
-		while (PacketData *pd = packet_pool.pd) {
-		    packet_pool.pd = pd->next;
-		    delete[] reinterpret_cast<unsigned char *>(pd);
-		}
-	    } else {
-		packet_pool.pd->batch_next = global_packet_pool.pdbatch;
-                packet_pool.pd->batch_pdcount = packet_pool.pdcount;
-		global_packet_pool.pdbatch = packet_pool.pd;
-		++global_packet_pool.pdbatchcount;
-		packet_pool.pd = 0;
-	    }
-	    packet_pool.pdcount = 0;
-	}
-
-	click_compiler_fence();
-	global_packet_pool.lock = 0;
+	packet_pool.pcount = 0;
+	unlock_global_packet_pool();
     }
 #  else /* !HAVE_MULTITHREAD */
     if (packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
 	::operator delete((void *) p);
 	p = 0;
     }
-    if (data && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
-	delete[] data;
-	data = 0;
-    }
 #  endif /* HAVE_MULTITHREAD */
 
     if (p) {
@@ -450,13 +613,131 @@ WritablePacket::recycle(WritablePacket *p)
 	packet_pool.p = p;
 	assert(packet_pool.pcount <= CLICK_PACKET_POOL_SIZE);
     }
-    if (data) {
-	++packet_pool.pdcount;
-	PacketData *pd = reinterpret_cast<PacketData *>(data);
-	pd->next = packet_pool.pd;
-	packet_pool.pd = pd;
-	assert(packet_pool.pdcount <= CLICK_PACKET_POOL_SIZE);
+    if (data)
+	recycle_packet_data(packet_pool, data, c);
+}
+
+/** @brief Reserve packet data buffers for the packet pools.
+ * @param size buffer size, rounded up to a size class
+ * @param count number of buffers of that class to reserve
+ * @param hugepages if true, try to back the buffers with hugepages
+ * @return the size class, -EINVAL if no size class holds @a size bytes,
+ * or -ENOMEM if memory ran out
+ *
+ * Reserved buffers are allocated at once and are never returned to the
+ * heap: the pools keep reusing them. Only the buffers missing to have @a
+ * count reserved are allocated, so calling this again with the same
+ * arguments does nothing. Hugepages are only available at user level on
+ * Linux; ordinary pages are used when none are free. */
+int
+Packet::pool_reserve(uint32_t size, uint32_t count, bool hugepages)
+{
+    int c = packet_pool_fit(size);
+    if (c < 0)
+	return -EINVAL;
+    uint32_t bufsiz = packet_pool_bufsiz[c];
+    (void) hugepages;
+
+    lock_global_packet_pool();
+    int r = c;
+    if (packet_reserve.reserved[c] >= count)
+	goto out;
+    else if (packet_reserve.narenas == CLICK_PACKET_POOL_NARENAS) {
+	r = -ENOMEM;
+	goto out;
     }
+
+    {
+	uint32_t n = count - packet_reserve.reserved[c];
+	size_t len = (size_t) n * bufsiz, mapped = 0;
+	unsigned char *start = 0;
+#  if CLICK_USERLEVEL && defined(MAP_HUGETLB)
+	if (hugepages) {
+	    size_t hlen = (len + (2 << 20) - 1) & ~(size_t) ((2 << 20) - 1);
+	    void *m = mmap(0, hlen, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	    if (m != MAP_FAILED) {
+		start = reinterpret_cast<unsigned char *>(m);
+		mapped = hlen;
+		n = hlen / bufsiz;
+		len = (size_t) n * bufsiz;
+		packet_reserve.hugepages[c] = true;
+	    }
+	}
+#  endif
+	if (!start && !(start = new unsigned char[len])) {
+	    r = -ENOMEM;
+	    goto out;
+	}
+
+	PacketArena &a = packet_reserve.arena[packet_reserve.narenas];
+	++packet_reserve.narenas;
+	a.start = start;
+	a.end = start + len;
+	a.mapped = mapped;
+	for (uint32_t i = 0; i < n; ++i) {
+	    PacketData *pd = reinterpret_cast<PacketData *>(start + (size_t) i * bufsiz);
+	    pd->next = packet_reserve.spare[c];
+	    packet_reserve.spare[c] = pd;
+	}
+	packet_reserve.sparecount[c] += n;
+	packet_reserve.reserved[c] += n;
+    }
+
+  out:
+    unlock_global_packet_pool();
+    return r;
+}
+
+static void
+add_pool_stats(const PacketPool *pp, int c, Packet::PoolStats &stats)
+{
+    stats.free += pp->pdcount[c];
+    stats.hits += pp->hits[c];
+    stats.misses += pp->misses[c];
+    stats.frees += pp->frees[c];
+}
+
+/** @brief Return the number of packet data buffer size classes. */
+int
+Packet::pool_nclasses()
+{
+    return CLICK_PACKET_POOL_NCLASSES;
+}
+
+/** @brief Collect the statistics of a packet data buffer size class.
+ * @param size_class size class, between 0 and pool_nclasses() - 1
+ * @param[out] stats statistics
+ * @return true iff @a size_class is valid
+ *
+ * Other threads' counters are read without synchronization, so the
+ * statistics are approximate while packets flow. */
+bool
+Packet::pool_stats(int size_class, PoolStats &stats)
+{
+    int c = size_class;
+    if (c < 0 || c >= CLICK_PACKET_POOL_NCLASSES)
+	return false;
+    memset(&stats, 0, sizeof(stats));
+    stats.buffer_size = packet_pool_bufsiz[c];
+    stats.limit = packet_pool_size[c];
+
+    lock_global_packet_pool();
+#  if HAVE_MULTITHREAD
+    for (PacketPool *pp = global_packet_pool.thread_pools; pp;
+	 pp = pp->thread_pool_next)
+	add_pool_stats(pp, c, stats);
+    for (PacketData *pd = global_packet_pool.pdbatch[c]; pd;
+	 pd = pd->batch_next)
+	stats.free += pd->batch_pdcount;
+#  else
+    add_pool_stats(&global_packet_pool, c, stats);
+#  endif
+    stats.spare = packet_reserve.sparecount[c];
+    stats.reserved = packet_reserve.reserved[c];
+    stats.hugepages = packet_reserve.hugepages[c];
+    unlock_global_packet_pool();
+    return true;
 }
 
 # endif /* HAVE_PACKET_POOL */
@@ -470,7 +751,18 @@ Packet::alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom)
 	n = min_buffer_length;
     }
 # if CLICK_USERLEVEL || CLICK_MINIOS
+#  if HAVE_CLICK_PACKET_POOL
+    // Growing a pooled buffer would often pick the next, much larger size
+    // class; only use a class that at most doubles the buffer.
+    int c = packet_pool_fit(n < CLICK_PACKET_POOL_BUFSIZ ? CLICK_PACKET_POOL_BUFSIZ : n);
+    if (c >= 0 && packet_pool_bufsiz[c] > 2 * n && n > CLICK_PACKET_POOL_BUFSIZ / 2)
+	c = -1;
+    if (c >= 0)
+	n = packet_pool_bufsiz[c];
+    unsigned char *d = allocate_packet_data(*make_local_packet_pool(), c, n);
+#  else
     unsigned char *d = new unsigned char[n];
+#  endif
     if (!d)
 	return false;
     _head = d;
@@ -596,7 +888,7 @@ Packet::make(unsigned char *data, uint32_t length,
 	     buffer_destructor_type destructor, void* argument, int headroom, int tailroom)
 {
 # if HAVE_CLICK_PACKET_POOL
-    WritablePacket *p = WritablePacket::pool_allocate(false);
+    WritablePacket *p = WritablePacket::pool_allocate(-1);
 # else
     WritablePacket *p = new WritablePacket;
 # endif
@@ -757,7 +1049,11 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
     else if (_destructor)
 	_destructor(old_head, old_end - old_head, _destructor_argument);
     else
+#  if HAVE_CLICK_PACKET_POOL
+	free_data(old_head, old_end - old_head);
+#  else
 	delete[] old_head;
+#  endif
     _destructor = 0;
 # elif CLICK_BSDMODULE
     m_freem(old_m); // alloc_data() created a new mbuf, so free the old one
@@ -936,20 +1232,25 @@ Packet::shift_data(int offset, bool free_on_failure)
 static void
 cleanup_pool(PacketPool *pp, int global)
 {
-    unsigned pcount = 0, pdcount = 0;
+    unsigned pcount = 0;
     while (WritablePacket *p = pp->p) {
 	++pcount;
 	pp->p = static_cast<WritablePacket *>(p->next());
 	::operator delete((void *) p);
     }
-    while (PacketData *pd = pp->pd) {
-	++pdcount;
-	pp->pd = pd->next;
-	delete[] reinterpret_cast<unsigned char *>(pd);
-    }
     assert(pcount <= CLICK_PACKET_POOL_SIZE);
-    assert(pdcount <= CLICK_PACKET_POOL_SIZE);
-    assert(global || (pcount == pp->pcount && pdcount == pp->pdcount));
+    assert(global || pcount == pp->pcount);
+    for (int c = 0; c < CLICK_PACKET_POOL_NCLASSES; ++c) {
+	unsigned pdcount = 0;
+	while (PacketData *pd = pp->pd[c]) {
+	    ++pdcount;
+	    pp->pd[c] = pd->next;
+	    if (!packet_data_reserved(pd))
+		delete[] reinterpret_cast<unsigned char *>(pd);
+	}
+	assert(pdcount <= packet_pool_size[c]);
+	assert(global || pdcount == pp->pdcount[c]);
+    }
 }
 #endif
 
@@ -964,22 +1265,42 @@ Packet::static_cleanup()
 	delete pp;
     }
     unsigned rounds = global_packet_pool.pbatchcount;
-    if (rounds < global_packet_pool.pdbatchcount)
-        rounds = global_packet_pool.pdbatchcount;
+    for (int c = 0; c < CLICK_PACKET_POOL_NCLASSES; ++c)
+	if (rounds < global_packet_pool.pdbatchcount[c])
+	    rounds = global_packet_pool.pdbatchcount[c];
     assert(rounds <= CLICK_GLOBAL_PACKET_POOL_COUNT);
     PacketPool fake_pool;
-    while (global_packet_pool.pbatch || global_packet_pool.pdbatch) {
-        if ((fake_pool.p = global_packet_pool.pbatch))
+    while (1) {
+	bool any = false;
+        if ((fake_pool.p = global_packet_pool.pbatch)) {
             global_packet_pool.pbatch = static_cast<WritablePacket*>(fake_pool.p->prev());
-        if ((fake_pool.pd = global_packet_pool.pdbatch))
-            global_packet_pool.pdbatch = fake_pool.pd->batch_next;
+	    any = true;
+	}
+	for (int c = 0; c < CLICK_PACKET_POOL_NCLASSES; ++c)
+	    if ((fake_pool.pd[c] = global_packet_pool.pdbatch[c])) {
+		global_packet_pool.pdbatch[c] = fake_pool.pd[c]->batch_next;
+		any = true;
+	    }
+	if (!any)
+	    break;
 	cleanup_pool(&fake_pool, 1);
 	--rounds;
     }
     assert(rounds == 0);
+    memset(&global_packet_pool, 0, sizeof(global_packet_pool));
 # else
     cleanup_pool(&global_packet_pool, 0);
 # endif
+    for (int i = 0; i < packet_reserve.narenas; ++i) {
+	PacketArena &a = packet_reserve.arena[i];
+# if CLICK_USERLEVEL
+	if (a.mapped)
+	    munmap(a.start, a.mapped);
+	else
+# endif
+	    delete[] a.start;
+    }
+    memset(&packet_reserve, 0, sizeof(packet_reserve));
 #endif
 }
 
@@ -1305,7 +1305,7 @@ Handler::combine(const Handler &x)
     if (!(_flags & f_read) && (x._flags & f_read)) {
         _read_hook = x._read_hook;
         _read_user_data = x._read_user_data;
-        _flags |= x._flags & (f_read | f_read_comprehensive | ~f_special);
+        _flags |= x._flags & (f_read | f_read_comprehensive | f_read_chunked | ~f_special);
     }
     if (!(_flags & f_write) && (x._flags & f_write)) {
         _write_hook = x._write_hook;
@@ -1336,7 +1336,17 @@ Handler::call_read(Element* e, const String& param, ErrorHandler* errh) const
         lerrh.error("read handler %<%s%> does not take parameters", unparse_name(e).c_str());
     else if ((_flags & (f_read | f_read_comprehensive)) == f_read)
         return _read_hook.r(e, _read_user_data);
-    else if (_flags & f_read) {
+    else if (_flags & f_read_chunked) {
+        StringAccum sa;
+        int cursor = 0;
+        do {
+            String chunk;
+            if ((cursor = call_read_chunk(e, cursor, chunk, &lerrh)) < 0)
+                return String();
+            sa << chunk;
+        } while (cursor > 0);
+        return sa.take_string();
+    } else if (_flags & f_read) {
         String s(param);
         if (_read_hook.h(f_read, s, e, this, &lerrh) >= 0)
             return s;
@@ -1346,6 +1356,21 @@ Handler::call_read(Element* e, const String& param, ErrorHandler* errh) const
     return String();
 }
 
+int
+Handler::call_read_chunk(Element* e, int cursor, String& chunk, ErrorHandler* errh) const
+{
+    LocalErrorHandler lerrh(errh);
+    if (!(_flags & f_read_chunked)) {
+        chunk = call_read(e, String(), &lerrh);
+        return lerrh.nerrors() ? -EINVAL : 0;
+    }
+    chunk = cursor ? String(cursor) : String();
+    int r = _read_hook.h(f_read, chunk, e, this, &lerrh);
+    if (r < 0)
+        chunk = String();
+    return r;
+}
+
 int
 Handler::call_write(const String& value, Element* e, ErrorHandler* errh) const
 {
@@ -1798,7 +1823,7 @@ Router::set_handler(const Element *e, const String &hname, uint32_t flags,
         to_add._read_hook.h = callback;
         flags |= Handler::f_read_comprehensive;
     } else
-        flags &= ~(Handler::f_read_comprehensive | Handler::f_read_param);
+        flags &= ~(Handler::f_read_comprehensive | Handler::f_read_param | Handler::f_read_chunked);
     if (flags & Handler::f_write) {
         to_add._write_hook.h = callback;
         flags |= Handler::f_write_comprehensive;
@@ -1945,6 +1970,12 @@ ThreadSched::initial_home_thread_id(const Element *)
     return 0;
 }
 
+bool
+ThreadSched::task_stealable(const Task *task)
+{
+    return !task->pinned();
+}
+
 /** @cond never */
 /** @brief  Create (if necessary) and return the NameInfo object for this router.
  *
@@ -2187,7 +2218,9 @@ Router::configuration_string() const
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
        GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE, GH_STOP,
-       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES };
+       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES,
+       GH_ADAPTIVE_POLL, GH_CYCLE_ACCOUNTING, GH_LOCK_STATS,
+       GH_RESET_LOCK_STATS };
 
 #if CLICK_STATS >= 2
 struct stats_info {
@@ -2283,6 +2316,32 @@ Router::router_read_handler(Element *e, void *thunk)
         break;
 #endif
 
+#if CLICK_USERLEVEL
+    case GH_ADAPTIVE_POLL:
+        if (r)
+            for (int t = 0; t < r->master()->nthreads(); ++t) {
+                RouterThread *thread = r->master()->thread(t);
+                if (!thread->adaptive_poll())
+                    continue;
+                sa << "thread " << t << ':';
+                for (int s = 0; s < RouterThread::A_NSTATES; ++s)
+                    sa << '\t' << RouterThread::adaptive_state_name(s)
+                       << ' ' << thread->adaptive_state_time(s);
+                sa << '\n';
+            }
+        break;
+#endif
+
+#if HAVE_CYCLE_ACCOUNTING
+    case GH_CYCLE_ACCOUNTING:
+        return String(Element::cycle_accounting);
+#endif
+
+#if CLICK_LOCK_STATS
+    case GH_LOCK_STATS:
+        return LockStats::unparse_all();
+#endif
+
 #if CLICK_DEBUG_MASTER || CLICK_DEBUG_SCHEDULING
     case GH_SCHEDULING_PROFILE:
         if (r)
@@ -2399,6 +2458,20 @@ Router::router_write_handler(const String &s, Element *e, void *thunk, ErrorHand
         for (int i = 0; i < (r ? r->nelements() : 0); i++)
             r->_elements[i]->reset_cycles();
         break;
+#endif
+#if HAVE_CYCLE_ACCOUNTING
+    case GH_CYCLE_ACCOUNTING: {
+        bool on;
+        if (!BoolArg().parse(cp_uncomment(s), on))
+            return errh->error("syntax error");
+        Element::set_cycle_accounting(r, on);
+        break;
+    }
+#endif
+#if CLICK_LOCK_STATS
+    case GH_RESET_LOCK_STATS:
+        LockStats::reset_all();
+        break;
 #endif
     default:
         break;
@@ -2429,6 +2502,17 @@ Router::static_initialize()
         add_read_handler(0, "string_profile_long", router_read_handler, (void *) GH_STRING_PROFILE_LONG);
 # endif
 #endif
+#if CLICK_USERLEVEL
+        add_read_handler(0, "adaptive_poll", router_read_handler, (void *) GH_ADAPTIVE_POLL);
+#endif
+#if HAVE_CYCLE_ACCOUNTING
+        add_read_handler(0, "cycle_accounting", router_read_handler, (void *) GH_CYCLE_ACCOUNTING, Handler::f_checkbox);
+        add_write_handler(0, "cycle_accounting", router_write_handler, (void *) GH_CYCLE_ACCOUNTING);
+#endif
+#if CLICK_LOCK_STATS
+        add_read_handler(0, "lock_stats", router_read_handler, (void *) GH_LOCK_STATS);
+        add_write_handler(0, "reset_lock_stats", router_write_handler, (void *) GH_RESET_LOCK_STATS);
+#endif
 #if CLICK_DEBUG_MASTER || CLICK_DEBUG_SCHEDULING
         add_read_handler(0, "scheduling_profile", router_read_handler, (void *) GH_SCHEDULING_PROFILE);
 #endif
@@ -2440,6 +2524,108 @@ Router::static_initialize()
     }
 }
 
+#if CLICK_LOCK_STATS
+// Every LockStats, so that the "lock_stats" handler finds the locks
+// wherever they live. SimpleSpinlock carries no LockStats.
+static LockStats *lock_stats_head;
+static SimpleSpinlock lock_stats_lock;
+
+LockStats::LockStats()
+    : _owner(0), _name(0)
+{
+    reset();
+    link();
+}
+
+LockStats::LockStats(const LockStats &x)
+    : _owner(x._owner), _name(x._name)
+{
+    reset();
+    link();
+}
+
+LockStats::~LockStats()
+{
+    unlink();
+}
+
+void
+LockStats::link()
+{
+    lock_stats_lock.acquire();
+    _prev = 0;
+    _next = lock_stats_head;
+    if (_next)
+        _next->_prev = this;
+    lock_stats_head = this;
+    lock_stats_lock.release();
+}
+
+void
+LockStats::unlink()
+{
+    lock_stats_lock.acquire();
+    if (_prev)
+        _prev->_next = _next;
+    else
+        lock_stats_head = _next;
+    if (_next)
+        _next->_prev = _prev;
+    lock_stats_lock.release();
+}
+
+void
+LockStats::reset()
+{
+    _acquisitions = _contended = _spin_cycles = 0;
+    _max_hold = _acquired_at = 0;
+}
+
+static void
+unparse_lock_stats(StringAccum &sa, uint64_t acquisitions, uint64_t contended,
+                   uint64_t spin_cycles, uint64_t max_hold)
+{
+    sa << " acquisitions " << acquisitions << " contended " << contended
+       << " spin_cycles " << spin_cycles << " max_hold_cycles " << max_hold << '\n';
+}
+
+String
+LockStats::unparse_all()
+{
+    StringAccum sa;
+    uint64_t unnamed = 0, acquisitions = 0, contended = 0, spin_cycles = 0, max_hold = 0;
+    lock_stats_lock.acquire();
+    for (LockStats *ls = lock_stats_head; ls; ls = ls->_next)
+        if (ls->_name) {
+            if (ls->_owner)
+                sa << ls->_owner->name() << '/';
+            sa << ls->_name;
+            unparse_lock_stats(sa, ls->_acquisitions, ls->_contended,
+                               ls->_spin_cycles, ls->_max_hold);
+        } else {
+            unnamed++;
+            acquisitions += ls->_acquisitions;
+            contended += ls->_contended;
+            spin_cycles += ls->_spin_cycles;
+            if (ls->_max_hold > max_hold)
+                max_hold = ls->_max_hold;
+        }
+    lock_stats_lock.release();
+    sa << "unnamed " << unnamed;
+    unparse_lock_stats(sa, acquisitions, contended, spin_cycles, max_hold);
+    return sa.take_string();
+}
+
+void
+LockStats::reset_all()
+{
+    lock_stats_lock.acquire();
+    for (LockStats *ls = lock_stats_head; ls; ls = ls->_next)
+        ls->reset();
+    lock_stats_lock.release();
+}
+#endif
+
 void
 Router::static_cleanup()
 {
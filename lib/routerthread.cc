@@ -40,6 +40,8 @@ CLICK_CXX_UNPROTECT
 # include <click/cxxunprotect.h>
 #elif CLICK_USERLEVEL
 # include <fcntl.h>
+# include <sched.h>
+# include <time.h>
 #endif
 CLICK_DECLS
 
@@ -83,6 +85,14 @@ RouterThread::RouterThread(Master *master, int id)
 
     _task_blocker = 0;
     _task_blocker_waiting = 0;
+#if HAVE_MULTITHREAD
+    _steal_sched = 0;
+    _steal_busy = false;
+    _steal_idle = false;
+    _steal_victim = id;
+    _steal_given = 0;
+    _steal_request = (uint32_t) -1;
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     _max_click_share = 80 * Task::MAX_UTILIZATION / 100;
     _min_click_share = Task::MAX_UTILIZATION / 200;
@@ -109,6 +119,11 @@ RouterThread::RouterThread(Master *master, int id)
 #if CLICK_LINUXMODULE
     greedy_schedule_jiffies = jiffies;
 #endif
+#if CLICK_USERLEVEL
+    _adaptive_poll = false;
+    _adaptive_state = A_BUSY;
+    _idle_iters = 0;
+#endif
 
 #if CLICK_NS
     _ns_scheduled = _ns_last_active = Timestamp(-1, 0);
@@ -332,7 +347,7 @@ RouterThread::task_reheapify_from(int pos, Task* t)
 #endif
 
 /* Run at most 'ntasks' tasks. */
-inline void
+inline bool
 RouterThread::run_tasks(int ntasks)
 {
     set_thread_state(S_RUNTASK);
@@ -367,7 +382,7 @@ RouterThread::run_tasks(int ntasks)
 #if HAVE_MULTITHREAD
     int runs;
 #endif
-    bool work_done;
+    bool work_done, any_work_done = false;
 
     for (; ntasks >= 0; --ntasks) {
         t = task_begin();
@@ -390,6 +405,7 @@ RouterThread::run_tasks(int ntasks)
 
         t->_status.is_scheduled = false;
         work_done = t->fire();
+        any_work_done |= work_done;
 
 #if HAVE_MULTITHREAD
         if (runs > PROFILE_ELEMENT) {
@@ -458,7 +474,128 @@ RouterThread::run_tasks(int ntasks)
 #if HAVE_ADAPTIVE_SCHEDULER
     client_update_pass(C_CLICK, t_before);
 #endif
+    return any_work_done;
+}
+
+#if CLICK_USERLEVEL
+/** @brief Turns adaptive polling on or off.
+ * @param on whether to back off when tasks find no work
+ * @param max_sleep longest wait for file descriptors while backed off
+ *
+ * The time the thread spent in each adaptive state since then is returned
+ * by adaptive_state_time(). */
+void
+RouterThread::set_adaptive_poll(bool on, const Timestamp &max_sleep)
+{
+    _adaptive_poll = on;
+    _adaptive_max_sleep = max_sleep;
+    _adaptive_state = A_BUSY;
+    _idle_iters = 0;
+    _idle_sleep = _idle_wait = Timestamp();
+    _adaptive_timestamp = Timestamp::now_steady();
+    for (int s = 0; s < A_NSTATES; ++s)
+        _adaptive_time[s] = Timestamp();
+}
+
+void
+RouterThread::set_adaptive_state(int state)
+{
+    if (state != _adaptive_state) {
+        Timestamp now = Timestamp::now_steady();
+        _adaptive_time[_adaptive_state] += now - _adaptive_timestamp;
+        _adaptive_timestamp = now;
+        _adaptive_state = state;
+    }
+}
+
+/** @brief Returns the time spent in adaptive state @a state.
+ *
+ * The result is approximate when read from another thread. */
+Timestamp
+RouterThread::adaptive_state_time(int state) const
+{
+    assert(state >= 0 && state < A_NSTATES);
+    Timestamp t = _adaptive_time[state];
+    if (state == _adaptive_state && _adaptive_poll)
+        t += Timestamp::now_steady() - _adaptive_timestamp;
+    return t;
+}
+
+String
+RouterThread::adaptive_state_name(int state)
+{
+    switch (state) {
+    case A_BUSY:                return String::make_stable("busy");
+    case A_SPIN:                return String::make_stable("spin");
+    case A_YIELD:               return String::make_stable("yield");
+    case A_SLEEP:               return String::make_stable("sleep");
+    case A_WAIT:                return String::make_stable("wait");
+    case A_BLOCKED:             return String::make_stable("blocked");
+    default:                    return String(state);
+    }
+}
+
+void
+RouterThread::adaptive_account(bool worked)
+{
+    if (worked) {
+        _idle_iters = 0;
+        _idle_sleep = Timestamp();
+        set_adaptive_state(A_BUSY);
+    } else {
+        if (_idle_iters < A_SPIN_ITERS + A_YIELD_ITERS)
+            ++_idle_iters;
+        if (_adaptive_state == A_BUSY)
+            set_adaptive_state(A_SPIN);
+    }
+}
+
+// Polls file descriptors like run_selects() alone would, then backs off
+// according to how long tasks have been finding no work: spin, yield the
+// CPU, sleep a little longer each time, and once the sleeps grow past a
+// millisecond wait for file descriptors instead, up to _adaptive_max_sleep.
+void
+RouterThread::run_os_adaptive()
+{
+    if (!active()) {
+        set_adaptive_state(A_BLOCKED);
+        select_set().run_selects(this);
+        return;
+    }
+
+    if (_idle_iters < A_SPIN_ITERS) {
+        select_set().run_selects(this);
+        return;
+    }
+
+    if (_idle_iters < A_SPIN_ITERS + A_YIELD_ITERS) {
+        select_set().run_selects(this);
+        set_adaptive_state(A_YIELD);
+        sched_yield();
+        return;
+    }
+
+    if (!_idle_sleep)
+        _idle_sleep = Timestamp::make_usec(16);
+    else if (_idle_sleep < _adaptive_max_sleep) {
+        _idle_sleep += _idle_sleep;
+        if (_idle_sleep > _adaptive_max_sleep)
+            _idle_sleep = _adaptive_max_sleep;
+    }
+
+    if (_idle_sleep < Timestamp::make_msec(1)) {
+        select_set().run_selects(this);
+        set_adaptive_state(A_SLEEP);
+        struct timespec ts = _idle_sleep.timespec();
+        nanosleep(&ts, 0);
+    } else {
+        set_adaptive_state(A_WAIT);
+        _idle_wait = _idle_sleep;
+        select_set().run_selects(this);
+        _idle_wait = Timestamp();
+    }
 }
+#endif
 
 inline void
 RouterThread::run_os()
@@ -473,7 +610,10 @@ RouterThread::run_os()
 #endif
 
 #if CLICK_USERLEVEL
-    select_set().run_selects(this);
+    if (_adaptive_poll)
+        run_os_adaptive();
+    else
+        select_set().run_selects(this);
 #elif CLICK_MINIOS
     /*
      * MiniOS uses a cooperative scheduler. By schedule() we'll give a chance
@@ -528,6 +668,88 @@ RouterThread::run_os()
     driver_lock_tasks();
 }
 
+#if HAVE_MULTITHREAD
+/** @brief Turns work stealing on or off.
+ * @param sched decides which tasks may be stolen, or null to turn it off
+ *
+ * Every thread taking part must have work stealing on: only those ask for
+ * tasks when idle, and only those give tasks away. */
+void
+RouterThread::set_work_stealing(ThreadSched *sched)
+{
+    _steal_sched = sched;
+    _steal_busy = _steal_idle = false;
+    _steal_request = (uint32_t) -1;
+    // an idle thread must wake up to ask for work
+    wake();
+}
+
+void
+RouterThread::work_steal()
+{
+    // must be called with thread's lock acquired
+
+    // answer a thread asking for a task: give it our costliest stealable
+    // task, provided we keep one
+    bool given = false;
+    uint32_t thief = _steal_request;
+    if (thief != (uint32_t) -1) {
+        Task *best = 0;
+        Task *first = task_begin();
+        if (first != task_end() && task_next(first) != task_end()
+            && !_stop_flag)
+            for (Task *t = first; t != task_end(); t = task_next(t))
+                if (t->home_thread_id() == _id
+                    && (!best || t->cycles() > best->cycles())
+                    && _steal_sched->task_stealable(t))
+                    best = t;
+        if (best) {
+            best->move_thread(thief);
+            ++_steal_given;
+            given = true;
+        }
+        click_fence();
+        _steal_request = (uint32_t) -1;
+    }
+
+    Task *first = task_begin();
+    bool idle = (first == task_end());
+    bool busy = !idle && task_next(first) != task_end();
+    if (idle != _steal_idle)
+        _steal_idle = idle;
+    int n = _master->nthreads();
+
+    // when we start having tasks to spare, or may still have some, let
+    // the idle threads ask again
+    if (busy && (!_steal_busy || given)) {
+        _steal_busy = true;
+        for (int i = 0; i < n; ++i) {
+            RouterThread *t = _master->thread(i);
+            if (i != _id && t->_steal_idle)
+                t->wake();
+        }
+    } else if (!busy && _steal_busy)
+        _steal_busy = false;
+
+    // ask a busy thread for a task, one at a time
+    if (idle && !_stop_flag) {
+        if (_master->thread(_steal_victim)->_steal_request == (uint32_t) _id)
+            return;
+        for (int i = 1; i < n; ++i) {
+            int v = (_steal_victim + i) % n;
+            RouterThread *victim = _master->thread(v);
+            if (v != _id && victim->_steal_sched && victim->_steal_busy
+                && victim->_steal_request == (uint32_t) -1
+                && atomic_uint32_t::compare_swap(victim->_steal_request, (uint32_t) -1, _id) == (uint32_t) -1) {
+                _steal_victim = v;
+                victim->wake();
+                break;
+            }
+        }
+    }
+}
+#endif
+
 void
 RouterThread::process_pending()
 {
@@ -604,13 +826,30 @@ RouterThread::driver()
         if (_pending_head.x)
             process_pending();
 
+#if HAVE_MULTITHREAD
+        // give tasks to idle threads, or ask busy ones
+        if (_steal_sched)
+            work_steal();
+#endif
+
+#if CLICK_USERLEVEL
+        // cache the time for Timestamp::recent()
+        Timestamp::refresh_recent();
+#endif
+
         // run tasks
         do {
 #if HAVE_ADAPTIVE_SCHEDULER
             if (PASS_GT(_clients[C_CLICK].pass, _clients[C_KERNEL].pass))
                 break;
 #endif
+#if CLICK_USERLEVEL
+            bool worked = run_tasks(_tasks_per_iter);
+            if (_adaptive_poll)
+                adaptive_account(worked);
+#else
             run_tasks(_tasks_per_iter);
+#endif
         } while (0);
 
 #if CLICK_USERLEVEL
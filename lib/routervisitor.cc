@@ -55,4 +55,26 @@ ElementNeighborhoodTracker::visit(Element *e, bool, int,
     return distance < _diameter;
 }
 
+HeadroomTracker::HeadroomTracker(Router *router)
+    : _pushed(router->nelements(), 0), _headroom(0)
+{
+}
+
+bool
+HeadroomTracker::visit(Element *e, bool isoutput, int,
+		       Element *from_e, int, int)
+{
+    if (isoutput)
+	return true;
+    // bytes pushed from the source up to e, e's own included
+    unsigned pushed = _pushed[from_e->eindex()];
+    if (const unsigned *h = static_cast<const unsigned *>(e->cast("Headroom")))
+	pushed += *h;
+    if (pushed > _pushed[e->eindex()])
+	_pushed[e->eindex()] = pushed;
+    if (pushed > _headroom)
+	_headroom = pushed;
+    return true;
+}
+
 CLICK_ENDDECLS
@@ -33,6 +33,9 @@
 #  define EV_SET_UDATA_CAST	/* nothing */
 # endif
 #endif
+#if HAVE_ALLOW_EPOLL
+# include <sys/epoll.h>
+#endif
 CLICK_DECLS
 
 namespace {
@@ -58,6 +61,12 @@ SelectSet::SelectSet()
 # endif
 #endif
 
+#if HAVE_ALLOW_EPOLL
+    // Registrations persist in the kernel, so waiting does not cost a walk
+    // over every file descriptor.
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
 #if !HAVE_ALLOW_POLL
     FD_ZERO(&_read_select_fd_set);
     FD_ZERO(&_write_select_fd_set);
@@ -85,6 +94,10 @@ SelectSet::~SelectSet()
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0)
 	close(_kqueue);
+#endif
+#if HAVE_ALLOW_EPOLL
+    if (_epoll >= 0)
+	close(_epoll);
 #endif
     if (_wake_pipe[0] >= 0) {
 	close(_wake_pipe[0]);
@@ -138,6 +151,9 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
 	_pollfds.back().events = 0;
     }
     int pi = _selinfo[fd].pollfd;
+#if HAVE_ALLOW_EPOLL
+    int old_events = _pollfds[pi].events;
+#endif
 
     // add the elements
     if (add_read)
@@ -145,6 +161,10 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
     if (add_write)
 	_pollfds[pi].events |= POLLOUT;
 
+#if HAVE_ALLOW_EPOLL
+    update_epoll(fd, old_events, _pollfds[pi].events);
+#endif
+
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0) {
 	// Add events to the kqueue
@@ -179,13 +199,17 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
 	    _max_select_fd = fd;
     } else {
 	static int warned = 0;
+	bool warn = true;
 # if HAVE_ALLOW_KQUEUE
-	if (_kqueue < 0)
+	warn = warn && _kqueue < 0;
 # endif
-	    if (!warned) {
-		click_chatter("SelectSet::add_select(%d): fd >= FD_SETSIZE", fd);
-		warned = 1;
-	    }
+# if HAVE_ALLOW_EPOLL
+	warn = warn && _epoll < 0;
+# endif
+	if (warn && !warned) {
+	    click_chatter("SelectSet::add_select(%d): fd >= FD_SETSIZE", fd);
+	    warned = 1;
+	}
     }
 #endif
 
@@ -194,6 +218,31 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
 	_selinfo.resize(fd + 1);
 }
 
+#if HAVE_ALLOW_EPOLL
+void
+SelectSet::update_epoll(int fd, int old_events, int events)
+{
+    if (_epoll < 0 || old_events == events)
+	return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (events & POLLIN ? (uint32_t) EPOLLIN : 0) | (events & POLLOUT ? (uint32_t) EPOLLOUT : 0);
+    ev.data.fd = fd;
+    int op = !old_events ? EPOLL_CTL_ADD : (events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL);
+    if (epoll_ctl(_epoll, op, fd, &ev) < 0) {
+	if (op == EPOLL_CTL_DEL)
+	    click_chatter("SelectSet::remove_pollfd(fd %d): epoll_ctl: %s", fd, strerror(errno));
+	else {
+	    // Regular files, among others, cannot be watched with epoll.
+	    // Fall back to poll() or select(), which see every pollfd.
+	    close(_epoll);
+	    _epoll = -1;
+	}
+    }
+}
+#endif
+
 int
 SelectSet::add_select(int fd, Element *element, int mask)
 {
@@ -268,6 +317,9 @@ SelectSet::remove_pollfd(int pi, int event)
 	    click_chatter("SelectSet::remove_pollfd(fd %d): kevent: %s", _pollfds[pi].fd, strerror(errno));
     }
 #endif
+#if HAVE_ALLOW_EPOLL
+    update_epoll(fd, _pollfds[pi].events | event, _pollfds[pi].events);
+#endif
 #if !HAVE_ALLOW_POLL
     // remove event from select list
     if (fd < FD_SETSIZE) {
@@ -390,7 +442,7 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
     // Decide how long to wait.
     struct timespec wait, *wait_ptr = &wait;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->select_delay(t);
     if (delay_type == 0)
 	wait.tv_sec = wait.tv_nsec = 0;
     else if (delay_type > 0)
@@ -424,6 +476,49 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
 }
 #endif /* HAVE_ALLOW_KQUEUE */
 
+#if HAVE_ALLOW_EPOLL
+void
+SelectSet::run_selects_epoll(RouterThread *thread)
+{
+# if HAVE_MULTITHREAD
+    click_fence();
+    _select_lock.release();
+# endif
+
+    // Decide how long to wait.
+    int timeout;
+    Timestamp t;
+    int delay_type = thread->select_delay(t);
+    if (delay_type == 0)
+	timeout = 0;
+    else if (delay_type > 0)
+	timeout = (t.sec() >= INT_MAX / 1000 ? INT_MAX - 1000 : t.msecval());
+    else
+	timeout = -1;
+    thread->set_thread_state_for_blocking(delay_type);
+
+    struct epoll_event ev[256];
+    int n = epoll_wait(_epoll, &ev[0], 256, timeout);
+    int was_errno = errno;
+
+    if (post_select(thread, true))
+	return;
+
+    thread->set_thread_state(RouterThread::S_RUNSELECT);
+    if (n < 0 && was_errno != EINTR)
+	perror("epoll_wait");
+    else
+	// Events are level triggered: an element that does not drain its
+	// file descriptor in selected() is called again next time, as with
+	// poll(). Stale events for removed descriptors find no element.
+	for (int i = 0; i < n; i++) {
+	    int mask = (ev[i].events & ~EPOLLOUT ? Element::SELECT_READ : 0)
+		+ (ev[i].events & ~EPOLLIN ? Element::SELECT_WRITE : 0);
+	    call_selected(ev[i].data.fd, mask);
+	}
+}
+#endif /* HAVE_ALLOW_EPOLL */
+
 #if HAVE_ALLOW_POLL
 void
 SelectSet::run_selects_poll(RouterThread *thread)
@@ -441,7 +536,7 @@ SelectSet::run_selects_poll(RouterThread *thread)
     // Decide how long to wait.
     int timeout;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->select_delay(t);
     if (delay_type == 0)
 	timeout = 0;
     else if (delay_type > 0)
@@ -497,7 +592,7 @@ SelectSet::run_selects_select(RouterThread *thread)
     // Decide how long to wait.
     struct timeval wait, *wait_ptr = &wait;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->select_delay(t);
     if (delay_type == 0)
 	timerclear(&wait);
     else if (delay_type > 0)
@@ -559,9 +654,9 @@ SelectSet::run_selects(RouterThread *thread)
     }
 
     // Return early (just run signals) if there are no selectors and there are
-    // tasks to run.  NB there will always be at least one _pollfd (the
-    // _wake_pipe).
-    if (_pollfds.size() < 2 && thread->active()) {
+    // tasks to run, unless the thread backed off and wants to wait.  NB
+    // there will always be at least one _pollfd (the _wake_pipe).
+    if (_pollfds.size() < 2 && thread->active() && !thread->_idle_wait) {
 #if HAVE_MULTITHREAD
 	_select_lock.release();
 #endif
@@ -577,6 +672,12 @@ SelectSet::run_selects(RouterThread *thread)
 	    break;
 	}
 #endif
+#if HAVE_ALLOW_EPOLL
+	if (_epoll >= 0) {
+	    run_selects_epoll(thread);
+	    break;
+	}
+#endif
 #if HAVE_ALLOW_POLL
 	run_selects_poll(thread);
 #else
@@ -0,0 +1,206 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/timerwheel.hh" -*-
+/*
+ * timerwheel.{cc,hh} -- hierarchical timing wheel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/timerwheel.hh>
+#include <click/integers.hh>
+CLICK_DECLS
+
+TimerWheel::TimerWheel()
+    : _tick(0), _tick_msec(1), _size(0), _timer(timer_hook, this)
+{
+    for (int l = 0; l < LEVELS; l++)
+	for (int i = 0; i < LEVEL_SIZE; i++)
+	    _slots[l][i]._next = _slots[l][i]._prev = &_slots[l][i];
+}
+
+TimerWheel::~TimerWheel()
+{
+    clear();
+    // the slot heads are not entries, keep their destructors off the lists
+    for (int l = 0; l < LEVELS; l++)
+	for (int i = 0; i < LEVEL_SIZE; i++)
+	    _slots[l][i]._next = _slots[l][i]._prev = 0;
+}
+
+void
+TimerWheel::initialize(Element *owner, uint32_t tick_msec)
+{
+    assert(!initialized() && tick_msec > 0);
+    _tick_msec = tick_msec;
+    _epoch = Timestamp::recent_steady();
+    _tick = 0;
+    _timer.initialize(owner);
+}
+
+void
+TimerWheel::clear()
+{
+    for (int l = 0; l < LEVELS; l++)
+	for (int i = 0; i < LEVEL_SIZE; i++) {
+	    TimerWheelEntry *head = &_slots[l][i];
+	    while (head->_next != head)
+		unlink(head->_next);
+	}
+    _size = 0;
+    _timer.unschedule();
+}
+
+// Moves the entries linked to head to the list headed by to, leaving head
+// empty.
+void
+TimerWheel::splice(TimerWheelEntry *head, TimerWheelEntry *to)
+{
+    if (head->_next == head) {
+	to->_next = to->_prev = to;
+	return;
+    }
+    to->_next = head->_next;
+    to->_prev = head->_prev;
+    to->_next->_prev = to;
+    to->_prev->_next = to;
+    head->_next = head->_prev = head;
+}
+
+uint64_t
+TimerWheel::now_tick() const
+{
+    Timestamp::value_type msec = (Timestamp::recent_steady() - _epoch).msecval();
+    return msec > 0 ? int_divide((uint64_t) msec, _tick_msec) : 0;
+}
+
+// Links e to the slot of the lowest level whose span reaches its expiry.
+void
+TimerWheel::place(TimerWheelEntry *e)
+{
+    uint64_t delta = e->_expiry > _tick ? e->_expiry - _tick : 0;
+    if (delta == 0) {
+	link(&_slots[0][_tick & LEVEL_MASK], e);
+	return;
+    }
+    int l = 0;
+    while (l < LEVELS - 1 && delta >= ((uint64_t) 1 << (LEVEL_BITS * (l + 1))))
+	l++;
+    link(&_slots[l][(e->_expiry >> (LEVEL_BITS * l)) & LEVEL_MASK], e);
+}
+
+void
+TimerWheel::schedule_at_tick(TimerWheelEntry *e, uint64_t expiry)
+{
+    assert(initialized());
+    if (e->_next)
+	e->unschedule();
+    if (_size == 0) {
+	// nothing is pending, skip the ticks that went by idle
+	uint64_t now = now_tick();
+	if (now > _tick)
+	    _tick = now;
+    }
+    if (expiry < _tick)
+	expiry = _tick;
+    else if (expiry - _tick > max_delay_ticks())
+	expiry = _tick + max_delay_ticks();
+    e->_wheel = this;
+    e->_expiry = expiry;
+    place(e);
+    _size++;
+    Timestamp when = tick_time(expiry);
+    if (!_timer.scheduled() || when < _timer.expiry_steady())
+	_timer.schedule_at_steady(when);
+}
+
+void
+TimerWheel::schedule_after_msec(TimerWheelEntry *e, uint32_t delta_msec)
+{
+    Timestamp when = Timestamp::recent_steady() + Timestamp::make_msec(delta_msec);
+    Timestamp::value_type msec = (when - _epoch).msecval();
+    uint64_t expiry = msec > 0 ? int_divide((uint64_t) msec, _tick_msec) : 0;
+    // round up so that e never fires early
+    if (tick_time(expiry) < when)
+	expiry++;
+    schedule_at_tick(e, expiry);
+}
+
+// Moves the entries of the current slot of level down to the levels below.
+void
+TimerWheel::cascade(int level)
+{
+    TimerWheelEntry pending;
+    splice(&_slots[level][(_tick >> (LEVEL_BITS * level)) & LEVEL_MASK], &pending);
+    while (pending._next != &pending) {
+	TimerWheelEntry *e = pending._next;
+	unlink(e);
+	place(e);
+    }
+    pending._next = pending._prev = 0;
+}
+
+void
+TimerWheel::run_tick()
+{
+    if ((_tick & LEVEL_MASK) == 0)
+	for (int l = 1; l < LEVELS; l++) {
+	    cascade(l);
+	    if ((_tick >> (LEVEL_BITS * l)) & LEVEL_MASK)
+		break;
+	}
+
+    TimerWheelEntry pending;
+    splice(&_slots[0][_tick & LEVEL_MASK], &pending);
+    _tick++;
+
+    // callbacks may unschedule any entry, so take them one at a time
+    while (pending._next != &pending) {
+	TimerWheelEntry *e = pending._next;
+	unlink(e);
+	_size--;
+	if (e->_callback)
+	    e->_callback(e, e->_thunk);
+    }
+    pending._next = pending._prev = 0;
+}
+
+// Schedules the driving Timer for the next level 0 slot holding entries,
+// or for the next cascade if there are none before it.
+void
+TimerWheel::reschedule()
+{
+    if (_size == 0)
+	return;
+    uint64_t next = _tick;
+    while ((next & LEVEL_MASK) != 0
+	   && _slots[0][next & LEVEL_MASK]._next == &_slots[0][next & LEVEL_MASK])
+	next++;
+    _timer.schedule_at_steady(tick_time(next));
+}
+
+void
+TimerWheel::timer_hook(Timer *, void *user_data)
+{
+    TimerWheel *w = static_cast<TimerWheel *>(user_data);
+    uint64_t now = w->now_tick();
+    while (w->_tick <= now && w->_size) {
+	if ((w->_tick & LEVEL_MASK) != 0
+	    && w->_slots[0][w->_tick & LEVEL_MASK]._next == &w->_slots[0][w->_tick & LEVEL_MASK])
+	    w->_tick++;
+	else
+	    w->run_tick();
+    }
+    if (w->_size == 0 && now >= w->_tick)
+	w->_tick = now + 1;
+    w->reschedule();
+}
+
+CLICK_ENDDECLS
@@ -56,6 +56,24 @@ CLICK_DECLS
  -1, usec() == +900000.
  */
 
+#if CLICK_USERLEVEL
+# if HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+__thread TimestampRecent timestamp_recent;
+# else
+TimestampRecent timestamp_recent;
+# endif
+
+void
+Timestamp::refresh_recent()
+{
+    Timestamp now = Timestamp::now(), now_steady = Timestamp::now_steady();
+    timestamp_recent.sec[0] = now.sec();
+    timestamp_recent.subsec[0] = now.subsec();
+    timestamp_recent.sec[1] = now_steady.sec();
+    timestamp_recent.subsec[1] = now_steady.subsec();
+}
+#endif
+
 #if TIMESTAMP_WARPABLE
 Timestamp::warp_class_type TimestampWarp::kind = Timestamp::warp_none;
 double TimestampWarp::speed = 1.0;
@@ -82,8 +82,10 @@ CLICK_USING_DECLS
 #define SOCKET_OPT              318
 #define THREADS_AFF_OPT         319
 #define DPDK_OPT                320
+#define ADAPTIVE_POLL_OPT       321
 
 static const Clp_Option options[] = {
+    { "adaptive-poll", 0, ADAPTIVE_POLL_OPT, Clp_ValInt, Clp_Optional | Clp_Negate },
     { "allow-reconfigure", 'R', ALLOW_RECONFIG_OPT, 0, Clp_Negate },
     { "clickpath", 'C', CLICKPATH_OPT, Clp_ValString, 0 },
     { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
@@ -131,7 +133,9 @@ Usage: %s [OPTION]... [ROUTERFILE]\n\
 Options:\n\
   -f, --file FILE               Read router configuration from FILE.\n\
   -e, --expression EXPR         Use EXPR as router configuration.\n\
-  -j, --threads N               Start N threads (default 1).\n", program_name);
+  -j, --threads N               Start N threads (default 1).\n\
+      --adaptive-poll[=MSEC]    Back off when tasks are idle, waiting for at\n\
+                                most MSEC milliseconds (default 10).\n", program_name);
 #if HAVE_DPDK
     printf("\
       --dpdk DPDK_ARGS --       Enable DPDK and give DPDK's own arguments.\n");
@@ -339,6 +343,7 @@ static Vector<String> cs_ports;
 static Vector<String> cs_sockets;
 static bool warnings = true;
 int click_nthreads = 1;
+static int adaptive_poll_msec = -1;
 bool dpdk_enabled = false;
 
 static String
@@ -661,6 +666,16 @@ main(int argc, char **argv)
 #endif
       break;
 
+     case ADAPTIVE_POLL_OPT:
+      if (clp->negated)
+          adaptive_poll_msec = -1;
+      else if (clp->have_val && clp->val.i <= 0) {
+          Clp_OptionError(clp, "%<%O%> expects a positive number of milliseconds");
+          goto bad_option;
+      } else
+          adaptive_poll_msec = clp->have_val ? clp->val.i : 10;
+      break;
+
     case SIMTIME_OPT: {
         Timestamp::warp_set_class(Timestamp::warp_simulation);
         Timestamp simbegin(clp->have_val ? clp->val.d : 1000000000);
@@ -775,8 +790,11 @@ particular purpose.\n");
       hotswap_task.initialize(hotswap_thunk_router->root_element(), false);
       hotswap_thunk_router->activate(false, errh);
     }
-    for (int t = 0; t < click_nthreads; ++t)
+    for (int t = 0; t < click_nthreads; ++t) {
+        if (adaptive_poll_msec > 0)
+            click_master->thread(t)->set_adaptive_poll(true, Timestamp::make_msec(adaptive_poll_msec));
         click_master->thread(t)->mark_driver_entry();
+    }
 #if HAVE_MULTITHREAD
 # if HAVE_DPDK
     if (dpdk_enabled) {